@@ -21,6 +21,33 @@ namespace HttpFilteringEngine.Managed
 
     public delegate void HttpMessageEndCallback(string requestHeaders, byte[] requestBody, string responseHeaders, byte[] responseBody, out bool shouldBlock, ResponseWriter responseWriter);
 
+    /// <summary>
+    /// View form of HttpMessageBeginCallback, used by engines created with useMessageViews. When
+    /// allowing a response for inspection, responseSampleBytes may be set to have only the first
+    /// bytes of its payload inspected. Zero means the whole payload.
+    /// </summary>
+    public delegate void HttpMessageBeginViewCallback(HttpMessageView message, out ProxyNextAction nextAction, out uint responseSampleBytes, ResponseWriter responseWriter);
+
+    /// <summary>
+    /// View form of HttpMessageEndCallback, used by engines created with useMessageViews.
+    /// </summary>
+    public delegate void HttpMessageEndViewCallback(HttpMessageView message, out bool shouldBlock, ResponseWriter responseWriter);
+
+    /// <summary>
+    /// Asynchronous form of HttpMessageBeginViewCallback. Either answers right away, exactly as
+    /// HttpMessageBeginViewCallback does, and returns false, or returns true and answers later
+    /// through AbstractEngine.CompleteVerdict with the verdictToken it was given. The message is
+    /// only valid until the callback returns, so anything needed later must be copied out.
+    /// </summary>
+    public delegate bool HttpMessageBeginAsyncCallback(HttpMessageView message, ulong verdictToken, out ProxyNextAction nextAction, out uint responseSampleBytes, ResponseWriter responseWriter);
+
+    /// <summary>
+    /// Asynchronous form of HttpMessageEndViewCallback. See HttpMessageBeginAsyncCallback.
+    /// </summary>
+    public delegate bool HttpMessageEndAsyncCallback(HttpMessageView message, ulong verdictToken, out bool shouldBlock, ResponseWriter responseWriter);
+
+    public delegate void FilterConfigurationLoadedCallback(bool success, ulong generation, uint ruleCount, uint failedRuleCount, uint blocklistEntryCount);
+
     public abstract class AbstractEngine : IDisposable
     {
         [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
@@ -30,15 +57,40 @@ namespace HttpFilteringEngine.Managed
         protected delegate void NativeReportMessageCallback([In()] [MarshalAs(UnmanagedType.LPStr)] string message, uint messageLength);
 
         [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
-        protected delegate void NativeCustomResponseStreamWriter([In()] byte[] data, uint dataLength);
+        protected delegate void NativeCustomResponseStreamWriter(IntPtr writerContext, [In()] byte[] data, uint dataLength);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        protected delegate void NativeHttpMessageBeginCallback([In()] [MarshalAs(UnmanagedType.LPStr)] string requestHeaders, uint requestHeadersLength, [In()] IntPtr requestBody, uint requestBodyLength, [In()] [MarshalAs(UnmanagedType.LPStr)] string responseHeaders, uint responseHeadersLength, [In()] IntPtr responseBody, uint responseBodyLength, ref uint nextAction, NativeCustomResponseStreamWriter customBlockResponseStreamWriter, IntPtr writerContext);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        protected delegate void NativeHttpMessageEndCallback([In()] [MarshalAs(UnmanagedType.LPStr)] string requestHeaders, uint requestHeadersLength, [In()] IntPtr requestBody, uint requestBodyLength, [In()] [MarshalAs(UnmanagedType.LPStr)] string responseHeaders, uint responseHeadersLength, [In()] IntPtr responseBody, uint responseBodyLength, ref bool shouldBlock, NativeCustomResponseStreamWriter customBlockResponseStreamWriter, IntPtr writerContext);
 
         [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
-        protected delegate void NativeHttpMessageBeginCallback([In()] [MarshalAs(UnmanagedType.LPStr)] string requestHeaders, uint requestHeadersLength, [In()] IntPtr requestBody, uint requestBodyLength, [In()] [MarshalAs(UnmanagedType.LPStr)] string responseHeaders, uint responseHeadersLength, [In()] IntPtr responseBody, uint responseBodyLength, ref uint nextAction, NativeCustomResponseStreamWriter customBlockResponseStreamWriter);
+        protected delegate void NativeHttpMessageBeginViewCallback([In()] ref HttpMessageView message, ref uint nextAction, ref uint responseSampleBytes, NativeCustomResponseStreamWriter customBlockResponseStreamWriter, IntPtr writerContext);
 
         [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
-        protected delegate void NativeHttpMessageEndCallback([In()] [MarshalAs(UnmanagedType.LPStr)] string requestHeaders, uint requestHeadersLength, [In()] IntPtr requestBody, uint requestBodyLength, [In()] [MarshalAs(UnmanagedType.LPStr)] string responseHeaders, uint responseHeadersLength, [In()] IntPtr responseBody, uint responseBodyLength, ref bool shouldBlock, NativeCustomResponseStreamWriter customBlockResponseStreamWriter);
+        protected delegate void NativeHttpMessageEndViewCallback([In()] ref HttpMessageView message, [MarshalAs(UnmanagedType.I1)] ref bool shouldBlock, NativeCustomResponseStreamWriter customBlockResponseStreamWriter, IntPtr writerContext);
 
-        public static AbstractEngine Create(string caBundleAbsPath, ushort preferredHttpListeningPort = 0, ushort preferredHttpsListeningPort = 0)
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        protected delegate bool NativeHttpMessageBeginAsyncCallback([In()] ref HttpMessageView message, ulong verdictToken, ref uint nextAction, ref uint responseSampleBytes, NativeCustomResponseStreamWriter customBlockResponseStreamWriter, IntPtr writerContext);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        protected delegate bool NativeHttpMessageEndAsyncCallback([In()] ref HttpMessageView message, ulong verdictToken, [MarshalAs(UnmanagedType.I1)] ref bool shouldBlock, NativeCustomResponseStreamWriter customBlockResponseStreamWriter, IntPtr writerContext);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        protected delegate void NativeFilterConfigurationLoadedCallback(IntPtr context, [MarshalAs(UnmanagedType.I1)] bool success, ulong generation, uint ruleCount, uint failedRuleCount, uint blocklistEntryCount);
+
+        /// <summary>
+        /// Creates an engine for the current platform.
+        /// </summary>
+        /// <param name="useMessageViews">
+        /// If true, the engine calls HttpMessageBeginViewCallback and HttpMessageEndViewCallback
+        /// with a view of each transaction, rather than formatting its headers into strings for
+        /// HttpMessageBeginCallback and HttpMessageEndCallback.
+        /// </param>
+        public static AbstractEngine Create(string caBundleAbsPath, ushort preferredHttpListeningPort = 0, ushort preferredHttpsListeningPort = 0, bool useMessageViews = false)
         {            
             if(Environment.OSVersion.Platform == PlatformID.Win32NT)
             {
@@ -46,12 +98,12 @@ namespace HttpFilteringEngine.Managed
                 {
                     case true:
                         {
-                            return new Win64PInvoke(caBundleAbsPath, preferredHttpListeningPort, preferredHttpsListeningPort);
+                            return new Win64PInvoke(caBundleAbsPath, preferredHttpListeningPort, preferredHttpsListeningPort, useMessageViews);
                         }
 
                     case false:
                         {
-                            return new Win32PInvoke(caBundleAbsPath, preferredHttpListeningPort, preferredHttpsListeningPort);
+                            return new Win32PInvoke(caBundleAbsPath, preferredHttpListeningPort, preferredHttpsListeningPort, useMessageViews);
                         }
                 }
             }
@@ -81,6 +133,30 @@ namespace HttpFilteringEngine.Managed
             private set;
         }
 
+        protected NativeHttpMessageBeginViewCallback NativeHttpMsgBeginViewCbReference
+        {
+            get;
+            private set;
+        }
+
+        protected NativeHttpMessageEndViewCallback NativeHttpMsgEndViewCbReference
+        {
+            get;
+            private set;
+        }
+
+        protected NativeHttpMessageBeginAsyncCallback NativeHttpMsgBeginAsyncCbReference
+        {
+            get;
+            private set;
+        }
+
+        protected NativeHttpMessageEndAsyncCallback NativeHttpMsgEndAsyncCbReference
+        {
+            get;
+            private set;
+        }
+
         protected NativeReportMessageCallback NativeOnInfoCbReference
         {
             get;
@@ -99,6 +175,12 @@ namespace HttpFilteringEngine.Managed
             private set;
         }
 
+        protected NativeFilterConfigurationLoadedCallback NativeFilterConfigLoadedCbReference
+        {
+            get;
+            private set;
+        }
+
         public FirewallCheckCallback FirewallCheckCallback
         {
             get;
@@ -117,6 +199,36 @@ namespace HttpFilteringEngine.Managed
             set;
         }
 
+        public HttpMessageBeginViewCallback HttpMessageBeginViewCallback
+        {
+            get;
+            set;
+        }
+
+        public HttpMessageEndViewCallback HttpMessageEndViewCallback
+        {
+            get;
+            set;
+        }
+
+        /// <summary>
+        /// The asynchronous message begin callback supplied to SetAsyncVerdictCallbacks, if any.
+        /// </summary>
+        public HttpMessageBeginAsyncCallback HttpMessageBeginAsyncCallback
+        {
+            get;
+            protected set;
+        }
+
+        /// <summary>
+        /// The asynchronous message end callback supplied to SetAsyncVerdictCallbacks, if any.
+        /// </summary>
+        public HttpMessageEndAsyncCallback HttpMessageEndAsyncCallback
+        {
+            get;
+            protected set;
+        }
+
         public EngineMessageCallback OnInfo
         {
             get;
@@ -135,6 +247,16 @@ namespace HttpFilteringEngine.Managed
             set;
         }
 
+        /// <summary>
+        /// Called on the engine's configuration thread whenever a configuration supplied to
+        /// LoadFilterConfiguration has been put into effect, or has failed to load.
+        /// </summary>
+        public FilterConfigurationLoadedCallback OnFilterConfigurationLoaded
+        {
+            get;
+            set;
+        }
+
         public abstract bool IsRunning
         {
             get;
@@ -167,9 +289,14 @@ namespace HttpFilteringEngine.Managed
             NativeFirewallCbReference = new NativeFirewallCheckCallback(OnFirewallCheckCallback);
             NativeHttpMsgBeginCbReference = new NativeHttpMessageBeginCallback(OnEngineHttpMessageBegin);
             NativeHttpMsgEndCbReference = new NativeHttpMessageEndCallback(OnEngineHttpMessageEnd);
+            NativeHttpMsgBeginViewCbReference = new NativeHttpMessageBeginViewCallback(OnEngineHttpMessageBeginView);
+            NativeHttpMsgEndViewCbReference = new NativeHttpMessageEndViewCallback(OnEngineHttpMessageEndView);
+            NativeHttpMsgBeginAsyncCbReference = new NativeHttpMessageBeginAsyncCallback(OnEngineHttpMessageBeginAsync);
+            NativeHttpMsgEndAsyncCbReference = new NativeHttpMessageEndAsyncCallback(OnEngineHttpMessageEndAsync);
             NativeOnInfoCbReference = new NativeReportMessageCallback(OnEngineInfo);
             NativeOnWarnCbReference = new NativeReportMessageCallback(OnEngineWarning);
             NativeOnErrorCbReference = new NativeReportMessageCallback(OnEngineError);
+            NativeFilterConfigLoadedCbReference = new NativeFilterConfigurationLoadedCallback(OnEngineFilterConfigurationLoaded);
         }
 
         private bool OnFirewallCheckCallback([In] [MarshalAs(UnmanagedType.LPStr)] string binaryAbsolutePath, IntPtr binaryAbsolutePathLength)
@@ -179,7 +306,7 @@ namespace HttpFilteringEngine.Managed
             return result.HasValue ? result.Value : false;
         }
 
-        private void OnEngineHttpMessageBegin([In] [MarshalAs(UnmanagedType.LPStr)] string requestHeaders, uint requestHeadersLength, [In] IntPtr requestBody, uint requestBodyLength, [In] [MarshalAs(UnmanagedType.LPStr)] string responseHeaders, uint responseHeadersLength, [In] IntPtr responseBody, uint responseBodyLength, ref uint nextAction, NativeCustomResponseStreamWriter customBlockResponseStreamWriter)
+        private void OnEngineHttpMessageBegin([In] [MarshalAs(UnmanagedType.LPStr)] string requestHeaders, uint requestHeadersLength, [In] IntPtr requestBody, uint requestBodyLength, [In] [MarshalAs(UnmanagedType.LPStr)] string responseHeaders, uint responseHeadersLength, [In] IntPtr responseBody, uint responseBodyLength, ref uint nextAction, NativeCustomResponseStreamWriter customBlockResponseStreamWriter, IntPtr writerContext)
         {
             byte[] requestBodyManaged = null;
             byte[] responseBodyManaged = null;
@@ -199,12 +326,8 @@ namespace HttpFilteringEngine.Managed
             ResponseWriter thisWriter = (byte[] responseData) =>
             {
                 var myNativeWriter = customBlockResponseStreamWriter;
-                if (myNativeWriter == null)
-                {
-                    OnWarning?.Invoke("Native response writers exhausted.");
-                }
 
-                myNativeWriter?.Invoke(responseData, (uint)responseData.Length);
+                myNativeWriter?.Invoke(writerContext, responseData, (uint)responseData.Length);
 
                 GC.KeepAlive(myNativeWriter);
             };
@@ -216,7 +339,7 @@ namespace HttpFilteringEngine.Managed
             nextAction = (uint)managedNextAction;
         }
 
-        private void OnEngineHttpMessageEnd([In] [MarshalAs(UnmanagedType.LPStr)] string requestHeaders, uint requestHeadersLength, [In] IntPtr requestBody, uint requestBodyLength, [In] [MarshalAs(UnmanagedType.LPStr)] string responseHeaders, uint responseHeadersLength, [In] IntPtr responseBody, uint responseBodyLength, ref bool shouldBlock, NativeCustomResponseStreamWriter customBlockResponseStreamWriter)
+        private void OnEngineHttpMessageEnd([In] [MarshalAs(UnmanagedType.LPStr)] string requestHeaders, uint requestHeadersLength, [In] IntPtr requestBody, uint requestBodyLength, [In] [MarshalAs(UnmanagedType.LPStr)] string responseHeaders, uint responseHeadersLength, [In] IntPtr responseBody, uint responseBodyLength, ref bool shouldBlock, NativeCustomResponseStreamWriter customBlockResponseStreamWriter, IntPtr writerContext)
         {
             byte[] requestBodyManaged = null;
             byte[] responseBodyManaged = null;
@@ -235,14 +358,9 @@ namespace HttpFilteringEngine.Managed
 
             ResponseWriter thisWriter = (byte[] responseData) =>
             {
-                
                 var myNativeWriter = customBlockResponseStreamWriter;
-                if (myNativeWriter == null)
-                {
-                    OnWarning?.Invoke("Native response writers exhausted.");
-                }
 
-                myNativeWriter?.Invoke(responseData, (uint)responseData.Length);
+                myNativeWriter?.Invoke(writerContext, responseData, (uint)responseData.Length);
 
                 GC.KeepAlive(myNativeWriter);
             };
@@ -254,6 +372,76 @@ namespace HttpFilteringEngine.Managed
             shouldBlock = shouldBlockManaged;
         }
 
+        private void OnEngineHttpMessageBeginView([In] ref HttpMessageView message, ref uint nextAction, ref uint responseSampleBytes, NativeCustomResponseStreamWriter customBlockResponseStreamWriter, IntPtr writerContext)
+        {
+            var managedNextAction = ProxyNextAction.AllowAndIgnoreContentAndResponse;
+            uint managedResponseSampleBytes = 0;
+
+            HttpMessageBeginViewCallback?.Invoke(message, out managedNextAction, out managedResponseSampleBytes, MakeResponseWriter(customBlockResponseStreamWriter, writerContext));
+
+            nextAction = (uint)managedNextAction;
+            responseSampleBytes = managedResponseSampleBytes;
+        }
+
+        private void OnEngineHttpMessageEndView([In] ref HttpMessageView message, ref bool shouldBlock, NativeCustomResponseStreamWriter customBlockResponseStreamWriter, IntPtr writerContext)
+        {
+            var shouldBlockManaged = false;
+
+            HttpMessageEndViewCallback?.Invoke(message, out shouldBlockManaged, MakeResponseWriter(customBlockResponseStreamWriter, writerContext));
+
+            shouldBlock = shouldBlockManaged;
+        }
+
+        private bool OnEngineHttpMessageBeginAsync([In] ref HttpMessageView message, ulong verdictToken, ref uint nextAction, ref uint responseSampleBytes, NativeCustomResponseStreamWriter customBlockResponseStreamWriter, IntPtr writerContext)
+        {
+            var callback = HttpMessageBeginAsyncCallback;
+
+            if (callback == null)
+            {
+                return false;
+            }
+
+            var managedNextAction = ProxyNextAction.AllowAndIgnoreContentAndResponse;
+            uint managedResponseSampleBytes = 0;
+
+            var pending = callback(message, verdictToken, out managedNextAction, out managedResponseSampleBytes, MakeResponseWriter(customBlockResponseStreamWriter, writerContext));
+
+            nextAction = (uint)managedNextAction;
+            responseSampleBytes = managedResponseSampleBytes;
+
+            return pending;
+        }
+
+        private bool OnEngineHttpMessageEndAsync([In] ref HttpMessageView message, ulong verdictToken, ref bool shouldBlock, NativeCustomResponseStreamWriter customBlockResponseStreamWriter, IntPtr writerContext)
+        {
+            var callback = HttpMessageEndAsyncCallback;
+
+            if (callback == null)
+            {
+                return false;
+            }
+
+            var shouldBlockManaged = false;
+
+            var pending = callback(message, verdictToken, out shouldBlockManaged, MakeResponseWriter(customBlockResponseStreamWriter, writerContext));
+
+            shouldBlock = shouldBlockManaged;
+
+            return pending;
+        }
+
+        private static ResponseWriter MakeResponseWriter(NativeCustomResponseStreamWriter customBlockResponseStreamWriter, IntPtr writerContext)
+        {
+            return (byte[] responseData) =>
+            {
+                var myNativeWriter = customBlockResponseStreamWriter;
+
+                myNativeWriter?.Invoke(writerContext, responseData, (uint)responseData.Length);
+
+                GC.KeepAlive(myNativeWriter);
+            };
+        }
+
         private void OnEngineInfo(string message, uint messageLength)
         {
             OnInfo?.Invoke(message);
@@ -269,10 +457,474 @@ namespace HttpFilteringEngine.Managed
             OnError?.Invoke(message);
         }
 
+        private void OnEngineFilterConfigurationLoaded(IntPtr context, bool success, ulong generation, uint ruleCount, uint failedRuleCount, uint blocklistEntryCount)
+        {
+            OnFilterConfigurationLoaded?.Invoke(success, generation, ruleCount, failedRuleCount, blocklistEntryCount);
+        }
+
         public abstract bool Start();
 
         public abstract void Stop();
 
+        /// <summary>
+        /// Configures how much data may be held in memory while being streamed through the
+        /// engine. Every connection bounds the reads it has outstanding, in both directions
+        /// combined, to the per-connection limit, and must reserve those bytes against the global
+        /// limit before reading. When the global limit is exhausted, connections pause reading
+        /// until enough data has been written out the other side. Payloads flagged for inspection
+        /// are not subject to these limits. May be called at any time.
+        /// </summary>
+        /// <param name="maxBridgeInFlightBytes">
+        /// The maximum number of bytes a single connection may have in flight, in both directions
+        /// combined. Values below 8192 are raised to 8192. The default is 131072.
+        /// </param>
+        /// <param name="maxGlobalInFlightBytes">
+        /// The maximum number of bytes that may be in flight across all connections combined.
+        /// Zero, the default, means no global limit.
+        /// </param>
+        public abstract void SetFlowControl(uint maxBridgeInFlightBytes, ulong maxGlobalInFlightBytes);
+
+        /// <summary>
+        /// Configures how much new work the engine will take on at once, and what happens to work
+        /// that doesn't fit, so that connections already being serviced aren't starved when a
+        /// storm of new ones arrives. May be called at any time.
+        /// </summary>
+        /// <param name="maxActiveBridges">
+        /// The maximum number of client connections that may be serviced at once. Zero, the
+        /// default, means no limit.
+        /// </param>
+        /// <param name="maxPendingHandshakes">
+        /// The maximum number of TLS connections that may be handshaking at once. Zero, the
+        /// default, means no limit.
+        /// </param>
+        /// <param name="maxPendingSpoofs">
+        /// The maximum number of TLS connections that may be waiting on a certificate at once.
+        /// Zero, the default, means no limit.
+        /// </param>
+        /// <param name="deferWhenFull">
+        /// If true, new clients wait in the listener backlog while the connection limit is
+        /// reached. If false, they are accepted and immediately reset.
+        /// </param>
+        /// <param name="tunnelWhenOverloaded">
+        /// If true, TLS connections refused by the handshake or spoof limit are tunnelled without
+        /// filtering. If false, they are dropped.
+        /// </param>
+        public abstract void SetAdmissionControl(uint maxActiveBridges, uint maxPendingHandshakes, uint maxPendingSpoofs, bool deferWhenFull, bool tunnelWhenOverloaded);
+
+        /// <summary>
+        /// Gets the present state of admission control, along with counts of every load shedding
+        /// decision made since the engine was created.
+        /// </summary>
+        public abstract void GetAdmissionStats(out uint activeBridges, out uint pendingHandshakes, out uint pendingSpoofs, out ulong acceptedCount, out ulong deferredCount, out ulong rejectedCount, out ulong tunnelledCount, out ulong shedCount);
+
+        /// <summary>
+        /// Configures the accept loop of both the HTTP and HTTPS listeners. Takes effect the next
+        /// time the engine is started.
+        /// </summary>
+        /// <param name="outstandingAccepts">
+        /// The number of accepts each listener keeps outstanding at once. The default is 4.
+        /// </param>
+        /// <param name="maxAcceptsPerWakeup">
+        /// The maximum number of waiting clients picked up every time an accept completes,
+        /// including the one that completed. 1 disables draining. The default is 16.
+        /// </param>
+        /// <param name="listenBacklog">
+        /// The listen backlog to request. Zero, the default, means the platform maximum.
+        /// </param>
+        public abstract void SetAcceptOptions(uint outstandingAccepts, uint maxAcceptsPerWakeup, uint listenBacklog);
+
+        /// <summary>
+        /// Gets the accept loop instrumentation of either the HTTP or HTTPS listener.
+        /// </summary>
+        /// <param name="secure">
+        /// True for the HTTPS listener, false for the HTTP listener.
+        /// </param>
+        public abstract void GetAcceptStats(bool secure, out uint armedAccepts, out ulong acceptedCount, out ulong drainedCount, out uint peakDrainDepth, out ulong backlogSaturationCount, out ulong acceptErrorCount, out ulong averageRearmMicroseconds, out ulong peakRearmMicroseconds);
+
+        /// <summary>
+        /// Sets how many reusable message begin verdicts the engine keeps. A verdict is only
+        /// reused when the message begin callback asks for it, by combining the action with a
+        /// cache scope in bits 8 and 9 and a lifetime in seconds in bits 16 through 31. See
+        /// HttpVerdictCacheScope in the native headers.
+        /// </summary>
+        /// <param name="maxEntries">
+        /// The maximum number of cached verdicts. Zero disables the cache. The default is 16384.
+        /// </param>
+        public abstract void SetVerdictCacheCapacity(uint maxEntries);
+
+        /// <summary>
+        /// Discards every cached verdict. Call this whenever filtering rules have changed.
+        /// </summary>
+        public abstract void FlushVerdictCache();
+
+        /// <summary>
+        /// Gets the verdict cache counters.
+        /// </summary>
+        public abstract void GetVerdictCacheStats(out uint entryCount, out ulong hitCount, out ulong missCount, out ulong insertCount, out ulong evictionCount, out ulong flushCount);
+
+        /// <summary>
+        /// Compiles the supplied Adblock Plus formatted network rules and has the engine match
+        /// every request against them natively, before the message begin callback is called.
+        /// Requests that a blocking rule matches, and that no exception rule matches, are blocked
+        /// without ever reaching the callback. Any rules loaded before are replaced. May be called
+        /// while the engine is running.
+        /// </summary>
+        /// <param name="rules">
+        /// The rules, one per line. Comments, element hiding rules and blank lines are ignored.
+        /// </param>
+        /// <param name="loadedCount">
+        /// The number of rules that were loaded.
+        /// </param>
+        /// <param name="failedCount">
+        /// The number of network rules that were malformed or unsupported, and were skipped.
+        /// </param>
+        /// <returns>
+        /// True if the rules were compiled and swapped in, false otherwise.
+        /// </returns>
+        public abstract bool LoadRules(string rules, out uint loadedCount, out uint failedCount);
+
+        /// <summary>
+        /// Discards the native rules, so that every request is handed to the message begin
+        /// callback again.
+        /// </summary>
+        public abstract void ClearRules();
+
+        /// <summary>
+        /// Gets the native rule counters.
+        /// </summary>
+        public abstract void GetRuleStats(out uint ruleCount, out ulong checkedCount, out ulong blockedCount, out ulong exceptedCount);
+
+        /// <summary>
+        /// Builds a hostname blocklist file that LoadHostnameBlocklist can map later. Lists may be
+        /// built ahead of time, and the engine need not be running. A host is blocked when it, or
+        /// any domain it's beneath, is in the list.
+        /// </summary>
+        /// <param name="hostnames">
+        /// The hostnames, one per line. Hosts file lines and ||domain^ rules are accepted too.
+        /// </param>
+        /// <param name="outputPath">
+        /// The path to write the file to. Must not be the path of a blocklist currently loaded.
+        /// </param>
+        /// <param name="entryCount">
+        /// The number of distinct hostnames written.
+        /// </param>
+        /// <returns>
+        /// True if the file was written, false otherwise.
+        /// </returns>
+        public abstract bool BuildHostnameBlocklist(string hostnames, string outputPath, out uint entryCount);
+
+        /// <summary>
+        /// Maps a hostname blocklist file, replacing any loaded before. TLS connections to a host
+        /// on the blocklist are closed before the handshake, and plain requests to one are
+        /// answered with the block response. May be called while the engine is running.
+        /// </summary>
+        /// <param name="path">
+        /// The path to a file written by BuildHostnameBlocklist. The file must not be modified
+        /// while it's loaded.
+        /// </param>
+        /// <param name="entryCount">
+        /// The number of hostnames in the blocklist.
+        /// </param>
+        /// <returns>
+        /// True if the blocklist was loaded, false otherwise.
+        /// </returns>
+        public abstract bool LoadHostnameBlocklist(string path, out uint entryCount);
+
+        /// <summary>
+        /// Unloads the hostname blocklist.
+        /// </summary>
+        public abstract void ClearHostnameBlocklist();
+
+        /// <summary>
+        /// Gets the hostname blocklist counters.
+        /// </summary>
+        public abstract void GetHostnameBlocklistStats(out uint entryCount, out ulong checkedCount, out ulong blockedCount);
+
+        /// <summary>
+        /// Loads a complete filtering configuration in the background, and puts it into effect
+        /// in one step once every part of it has loaded. Anything left null is absent from the new
+        /// configuration rather than carried over. If any part fails to load, the current
+        /// configuration stays in effect. The outcome is reported through
+        /// OnFilterConfigurationLoaded. May be called while the engine is running.
+        /// </summary>
+        /// <param name="rules">
+        /// Adblock Plus formatted network rules, one per line, as for LoadRules. May be null.
+        /// </param>
+        /// <param name="blocklistPath">
+        /// The path to a file written by BuildHostnameBlocklist. May be null.
+        /// </param>
+        /// <param name="bypassHosts">
+        /// Hosts that aren't to be filtered at all, one per line, each covering its subdomains
+        /// too. TLS connections to them are passed through without being intercepted. May be null.
+        /// </param>
+        /// <param name="preservedEncodingHosts">
+        /// Hosts whose requests keep the client's Accept-Encoding, in the same format as
+        /// bypassHosts. Requests to other hosts have it narrowed to gzip and deflate, so that their
+        /// responses can be decompressed for inspection. May be null.
+        /// </param>
+        /// <param name="inspectionPolicy">
+        /// The response inspection policy table, as for SetInspectionPolicy. May be null.
+        /// </param>
+        /// <param name="verdictTimeoutMilliseconds">
+        /// How long to wait on a pending asynchronous verdict before applying the default.
+        /// </param>
+        /// <param name="defaultBeginAction">
+        /// The action applied when a pending message begin verdict times out.
+        /// </param>
+        /// <param name="defaultEndShouldBlock">
+        /// Whether or not to block when a pending message end verdict times out.
+        /// </param>
+        /// <returns>
+        /// True if the load was queued, false otherwise.
+        /// </returns>
+        public abstract bool LoadFilterConfiguration(string rules, string blocklistPath, string bypassHosts, string preservedEncodingHosts, string inspectionPolicy, uint verdictTimeoutMilliseconds, ProxyNextAction defaultBeginAction, bool defaultEndShouldBlock);
+
+        /// <summary>
+        /// Gets the filtering configuration counters.
+        /// </summary>
+        public abstract void GetFilterConfigurationStats(out ulong generation, out ulong publishedCount, out ulong bypassedCount);
+
+        /// <summary>
+        /// Sets the policy that decides, by Content-Type and Content-Length, how much of a response
+        /// flagged for inspection is held back before the message end callback sees it. Each line
+        /// is "type [&gt;length] [&lt;length] action", where type is a MIME type, a wildcard subtype
+        /// such as "video/*" or "*", and action is "inspect", "stream" or "sample:N" to inspect
+        /// only the first N bytes. The first entry that matches decides, and responses no entry
+        /// matches are buffered in full. May be called while the engine is running.
+        /// </summary>
+        /// <param name="policy">
+        /// The policy table, one entry per line.
+        /// </param>
+        /// <param name="entryCount">
+        /// The number of entries that were loaded.
+        /// </param>
+        /// <param name="failedCount">
+        /// The number of lines that were malformed, and were skipped.
+        /// </param>
+        /// <returns>
+        /// True if the policy was compiled and put into effect, false otherwise.
+        /// </returns>
+        public abstract bool SetInspectionPolicy(string policy, out uint entryCount, out uint failedCount);
+
+        /// <summary>
+        /// Discards the response inspection policy, so that every response flagged for inspection
+        /// is buffered in full.
+        /// </summary>
+        public abstract void ClearInspectionPolicy();
+
+        /// <summary>
+        /// Gets the counters of one entry of the response inspection policy. The entry one past
+        /// the last refers to responses no entry matched.
+        /// </summary>
+        /// <returns>
+        /// True if a policy is in effect and has such an entry, false otherwise.
+        /// </returns>
+        public abstract bool GetInspectionPolicyStats(uint entry, out ulong responseCount, out ulong bufferedBytes, out ulong streamedBytes);
+
+        /// <summary>
+        /// Sets how many message end verdicts the engine remembers by the content of the response
+        /// body they were reached for, so that the very same body turning up again is decided
+        /// without calling the message end callback. This assumes the verdict depends on the body
+        /// alone, so the cache is disabled by default.
+        /// </summary>
+        /// <param name="maxEntries">
+        /// The maximum number of cached verdicts. Zero disables the cache.
+        /// </param>
+        public abstract void SetContentVerdictCacheCapacity(uint maxEntries);
+
+        /// <summary>
+        /// Discards every verdict remembered by response body content. Call this whenever the
+        /// classifier has changed.
+        /// </summary>
+        public abstract void FlushContentVerdictCache();
+
+        /// <summary>
+        /// Gets the content verdict cache counters. hashedBytes over hashNanoseconds gives the
+        /// hashing throughput.
+        /// </summary>
+        public abstract void GetContentVerdictCacheStats(out uint entryCount, out ulong hitCount, out ulong missCount, out ulong evictionCount, out ulong hashedBytes, out ulong hashNanoseconds);
+
+        /// <summary>
+        /// Sets how responses that were decompressed for inspection are encoded on their way back
+        /// to the client. Mode 0 sends them uncompressed whenever the client allows it, which is
+        /// the default. Mode 1 compresses them with whichever of gzip and deflate the client
+        /// prefers, mode 2 with gzip and mode 3 with deflate, provided the client accepts it. They
+        /// are compressed a slice at a time as they're written, and sent chunked.
+        /// </summary>
+        /// <param name="mode">
+        /// The recompression mode.
+        /// </param>
+        /// <param name="level">
+        /// The compression level, from 1, the fastest, to 9, the smallest.
+        /// </param>
+        public abstract void SetRecompression(uint mode, int level);
+
+        /// <summary>
+        /// Gets the recompression counters. inputBytes over nanoseconds gives the compression
+        /// throughput, and firstSliceNanoseconds over recompressedCount the average delay it added
+        /// to the first byte of a response.
+        /// </summary>
+        public abstract void GetRecompressionStats(out ulong identityCount, out ulong recompressedCount, out ulong inputBytes, out ulong outputBytes, out ulong nanoseconds, out ulong firstSliceNanoseconds);
+
+        /// <summary>
+        /// Sets how much memory may be used to store responses, so that clients asking for the
+        /// same thing again are served without the request going to the server. Requests are still
+        /// filtered as usual first. Responses are stored and revalidated as RFC 7234 requires of a
+        /// shared cache. Zero, the default, disables the cache.
+        /// </summary>
+        /// <param name="maxBytes">
+        /// The memory budget, in bytes.
+        /// </param>
+        public abstract void SetResponseCacheCapacity(ulong maxBytes);
+
+        /// <summary>
+        /// Discards every stored response.
+        /// </summary>
+        public abstract void FlushResponseCache();
+
+        /// <summary>
+        /// Gets the response cache counters. hitCount over hitCount plus missCount gives the hit
+        /// rate, and servedBytes is how much wasn't fetched from servers.
+        /// </summary>
+        public abstract void GetResponseCacheStats(out uint entryCount, out ulong usedBytes, out ulong hitCount, out ulong notModifiedCount, out ulong staleCount, out ulong revalidatedCount, out ulong missCount, out ulong storeCount, out ulong evictionCount, out ulong servedBytes);
+
+        /// <summary>
+        /// Registers a block page under an ID. A message callback blocking a transaction can then
+        /// hand the response writer the reference returned by MakeBlockPageReference, instead of
+        /// writing the whole page out every time. Any page already registered under the ID is
+        /// replaced. May be called at any time.
+        /// </summary>
+        /// <param name="pageId">
+        /// The ID references are to refer to the page by.
+        /// </param>
+        /// <param name="page">
+        /// The complete response, status line, headers and payload. Supply null to remove the
+        /// page.
+        /// </param>
+        public abstract void RegisterBlockPage(uint pageId, byte[] page);
+
+        /// <summary>
+        /// Removes every registered block page.
+        /// </summary>
+        public abstract void ClearBlockPages();
+
+        /// <summary>
+        /// Gets the block page counters. missCount is the number of blocks that referred to a page
+        /// that wasn't registered, and were answered with the usual 204 instead.
+        /// </summary>
+        public abstract void GetBlockPageStats(out uint pageCount, out ulong hitCount, out ulong missCount);
+
+        /// <summary>
+        /// Makes a reference to a page registered with RegisterBlockPage, to be handed to the
+        /// response writer of a message callback in place of a custom block response.
+        /// </summary>
+        /// <param name="pageId">
+        /// The ID the page was registered under.
+        /// </param>
+        /// <returns>
+        /// The reference.
+        /// </returns>
+        public static byte[] MakeBlockPageReference(uint pageId)
+        {
+            return new byte[] { 0, (byte)pageId, (byte)(pageId >> 8), (byte)(pageId >> 16), (byte)(pageId >> 24) };
+        }
+
+        /// <summary>
+        /// Sets whether requests a client has pipelined may be written to the server along with
+        /// the request before them. Pipelined requests are always handled in order. With this
+        /// enabled, complete GET requests for the same host go out together when each already has
+        /// a verdict that neither blocks it nor has it inspected, from the bypass list or the
+        /// verdict cache, so no callback would be asked about them anyway. Disabled by default.
+        /// </summary>
+        /// <param name="enabled">
+        /// Whether pipelined requests may be coalesced.
+        /// </param>
+        public abstract void SetPipelineCoalescing(bool enabled);
+
+        /// <summary>
+        /// Gets the pipelining counters. pipelinedCount is the number of requests taken from what
+        /// a client sent along with the request before them, and coalescedCount how many of those
+        /// were written to the server along with it.
+        /// </summary>
+        public abstract void GetPipelineStats(out ulong pipelinedCount, out ulong coalescedCount);
+
+        /// <summary>
+        /// Supplies the asynchronous form of the message callbacks, which are then called instead
+        /// of the ones the engine was created with. A callback that can't answer right away
+        /// returns true, and the connection waits, without holding any of the engine's threads,
+        /// until CompleteVerdict is called with its token, or the timeout applies the default.
+        /// May only be called while the engine is stopped.
+        /// </summary>
+        /// <param name="onMessageBegin">
+        /// The asynchronous message begin callback. May be null, in which case the message begin
+        /// callback the engine was created with is used.
+        /// </param>
+        /// <param name="onMessageEnd">
+        /// The asynchronous message end callback. May be null, in which case the message end
+        /// callback the engine was created with is used.
+        /// </param>
+        /// <param name="timeoutMilliseconds">
+        /// How long a connection waits on a pending verdict.
+        /// </param>
+        /// <param name="defaultBeginAction">
+        /// The action applied when a pending message begin verdict times out.
+        /// </param>
+        /// <param name="defaultEndShouldBlock">
+        /// Whether or not to block when a pending message end verdict times out.
+        /// </param>
+        /// <returns>
+        /// True if the callbacks were set, false if the engine is running.
+        /// </returns>
+        public abstract bool SetAsyncVerdictCallbacks(HttpMessageBeginAsyncCallback onMessageBegin, HttpMessageEndAsyncCallback onMessageEnd, uint timeoutMilliseconds, ProxyNextAction defaultBeginAction, bool defaultEndShouldBlock);
+
+        /// <summary>
+        /// Supplies a verdict that an asynchronous message callback left pending. May be called
+        /// from any thread, including from within the callback itself.
+        /// </summary>
+        /// <param name="verdictToken">
+        /// The token that was supplied to the callback.
+        /// </param>
+        /// <param name="verdict">
+        /// For a message begin callback, the ProxyNextAction. For a message end callback, non-zero
+        /// to block the transaction.
+        /// </param>
+        /// <param name="responseSampleBytes">
+        /// For a message begin callback on a response, how many bytes of the payload to inspect,
+        /// or zero for all of it. Ignored otherwise.
+        /// </param>
+        /// <param name="customResponse">
+        /// Optional custom block response, or a reference made by MakeBlockPageReference. May be
+        /// null.
+        /// </param>
+        /// <returns>
+        /// True if the connection was waiting on the verdict and has been resumed. False if the
+        /// verdict already timed out, or the connection has since been closed.
+        /// </returns>
+        public abstract bool CompleteVerdict(ulong verdictToken, uint verdict, uint responseSampleBytes, byte[] customResponse);
+
+        /// <summary>
+        /// Supplies a verdict that HttpMessageBeginAsyncCallback left pending. See CompleteVerdict.
+        /// </summary>
+        public bool CompleteMessageBeginVerdict(ulong verdictToken, ProxyNextAction nextAction, uint responseSampleBytes = 0, byte[] customResponse = null)
+        {
+            return CompleteVerdict(verdictToken, (uint)nextAction, responseSampleBytes, customResponse);
+        }
+
+        /// <summary>
+        /// Supplies a verdict that HttpMessageEndAsyncCallback left pending. See CompleteVerdict.
+        /// </summary>
+        public bool CompleteMessageEndVerdict(ulong verdictToken, bool shouldBlock, byte[] customResponse = null)
+        {
+            return CompleteVerdict(verdictToken, shouldBlock ? 1u : 0u, 0, customResponse);
+        }
+
+        /// <summary>
+        /// Gets the asynchronous verdict counters. pendingCount is the number of connections
+        /// presently waiting on a verdict, and lateCompletionCount the number of verdicts supplied
+        /// for connections that were no longer waiting.
+        /// </summary>
+        public abstract void GetVerdictStats(out uint pendingCount, out ulong parkedCount, out ulong completedCount, out ulong timedOutCount, out ulong lateCompletionCount);
+
         protected abstract void DisposeNativeEngine();
 
         #region IDisposable Support
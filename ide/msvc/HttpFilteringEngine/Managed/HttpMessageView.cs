@@ -0,0 +1,311 @@
+﻿/*
+* Copyright © 2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+using System;
+using System.Runtime.InteropServices;
+
+namespace HttpFilteringEngine.Managed
+{
+    /// <summary>
+    /// Identifies headers that the engine recognizes by name. Mirrors HttpKnownHeader in
+    /// EngineCallbackTypes.h.
+    /// </summary>
+    public enum HttpKnownHeader : uint
+    {
+        Unknown = 0,
+        Host = 1,
+        Connection = 2,
+        ProxyConnection = 3,
+        KeepAlive = 4,
+        ContentType = 5,
+        ContentLength = 6,
+        ContentEncoding = 7,
+        TransferEncoding = 8,
+        Accept = 9,
+        AcceptEncoding = 10,
+        AcceptLanguage = 11,
+        UserAgent = 12,
+        Referer = 13,
+        Origin = 14,
+        Cookie = 15,
+        SetCookie = 16,
+        Location = 17,
+        CacheControl = 18,
+        Pragma = 19,
+        Expires = 20,
+        LastModified = 21,
+        ETag = 22,
+        IfModifiedSince = 23,
+        IfNoneMatch = 24,
+        Authorization = 25,
+        Expect = 26,
+        Upgrade = 27,
+        Range = 28,
+        ContentRange = 29,
+        Vary = 30,
+        Date = 31,
+        Server = 32,
+        ContentDisposition = 33,
+        Te = 34,
+        Trailer = 35
+    };
+
+    /// <summary>
+    /// Flags describing a message supplied through HttpMessageView. Mirrors HttpMessageFlags in
+    /// EngineCallbackTypes.h.
+    /// </summary>
+    [Flags]
+    public enum HttpMessageFlags : uint
+    {
+        None = 0,
+
+        /// <summary>
+        /// The response body is only the first bytes of the response, either because of the
+        /// inspection policy, or because the message begin callback asked for a sample.
+        /// </summary>
+        ResponseBodyTruncated = 1
+    };
+
+    /// <summary>
+    /// A view of a single header, laid out exactly as HttpHeaderView in EngineCallbackTypes.h. The
+    /// name and value point into the engine's own storage, and are only valid for the duration of
+    /// the callback the view was supplied to. Name and Value copy them out on every access.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct HttpHeaderView
+    {
+        private IntPtr name;
+        private uint nameLength;
+        private IntPtr value;
+        private uint valueLength;
+        private uint knownHeaderId;
+
+        public string Name
+        {
+            get
+            {
+                return HttpMessageView.CopyString(name, nameLength);
+            }
+        }
+
+        public string Value
+        {
+            get
+            {
+                return HttpMessageView.CopyString(value, valueLength);
+            }
+        }
+
+        public HttpKnownHeader KnownHeader
+        {
+            get
+            {
+                return (HttpKnownHeader)knownHeaderId;
+            }
+        }
+    }
+
+    /// <summary>
+    /// A view of a transaction, laid out exactly as HttpMessageView in EngineCallbackTypes.h, and
+    /// handed to the view forms of the message callbacks without being copied. Everything it points
+    /// to belongs to the engine, and is only valid for the duration of the callback it was supplied
+    /// to, so it must not be kept. The properties and methods copy out only what they're asked for,
+    /// so a callback that looks at a couple of headers pays for just those.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct HttpMessageView
+    {
+        private IntPtr method;
+        private uint methodLength;
+        private IntPtr uri;
+        private uint uriLength;
+        private IntPtr host;
+        private uint hostLength;
+        private uint statusCode;
+        private IntPtr statusLine;
+        private uint statusLineLength;
+        private IntPtr requestHeaders;
+        private uint requestHeaderCount;
+        private IntPtr responseHeaders;
+        private uint responseHeaderCount;
+        private IntPtr requestBody;
+        private uint requestBodyLength;
+        private IntPtr responseBody;
+        private uint responseBodyLength;
+        private uint flags;
+
+        public string Method
+        {
+            get
+            {
+                return CopyString(method, methodLength);
+            }
+        }
+
+        public string Uri
+        {
+            get
+            {
+                return CopyString(uri, uriLength);
+            }
+        }
+
+        public string Host
+        {
+            get
+            {
+                return CopyString(host, hostLength);
+            }
+        }
+
+        /// <summary>
+        /// The response status code, or zero if there's no response yet.
+        /// </summary>
+        public uint StatusCode
+        {
+            get
+            {
+                return statusCode;
+            }
+        }
+
+        public string StatusLine
+        {
+            get
+            {
+                return CopyString(statusLine, statusLineLength);
+            }
+        }
+
+        public int RequestHeaderCount
+        {
+            get
+            {
+                return (int)requestHeaderCount;
+            }
+        }
+
+        public int ResponseHeaderCount
+        {
+            get
+            {
+                return (int)responseHeaderCount;
+            }
+        }
+
+        public HttpMessageFlags Flags
+        {
+            get
+            {
+                return (HttpMessageFlags)flags;
+            }
+        }
+
+        public HttpHeaderView GetRequestHeader(int index)
+        {
+            return GetHeader(requestHeaders, requestHeaderCount, index);
+        }
+
+        public HttpHeaderView GetResponseHeader(int index)
+        {
+            return GetHeader(responseHeaders, responseHeaderCount, index);
+        }
+
+        /// <summary>
+        /// Gets the value of the first request header with the given id, without copying the name
+        /// of any header.
+        /// </summary>
+        /// <returns>
+        /// The value of the header, or null if the request has no such header.
+        /// </returns>
+        public string FindRequestHeader(HttpKnownHeader header)
+        {
+            return FindHeader(requestHeaders, requestHeaderCount, header);
+        }
+
+        /// <summary>
+        /// Gets the value of the first response header with the given id, without copying the
+        /// name of any header.
+        /// </summary>
+        /// <returns>
+        /// The value of the header, or null if there's no response or it has no such header.
+        /// </returns>
+        public string FindResponseHeader(HttpKnownHeader header)
+        {
+            return FindHeader(responseHeaders, responseHeaderCount, header);
+        }
+
+        /// <summary>
+        /// Copies out the request body.
+        /// </summary>
+        /// <returns>
+        /// The request body, or null if none was supplied.
+        /// </returns>
+        public byte[] CopyRequestBody()
+        {
+            return CopyBytes(requestBody, requestBodyLength);
+        }
+
+        /// <summary>
+        /// Copies out the response body. See Flags for whether it's the whole body.
+        /// </summary>
+        /// <returns>
+        /// The response body, or null if none was supplied.
+        /// </returns>
+        public byte[] CopyResponseBody()
+        {
+            return CopyBytes(responseBody, responseBodyLength);
+        }
+
+        internal static string CopyString(IntPtr data, uint length)
+        {
+            if (data == IntPtr.Zero)
+            {
+                return null;
+            }
+
+            return Marshal.PtrToStringAnsi(data, (int)length);
+        }
+
+        private static byte[] CopyBytes(IntPtr data, uint length)
+        {
+            if (data == IntPtr.Zero)
+            {
+                return null;
+            }
+
+            var copy = new byte[length];
+            Marshal.Copy(data, copy, 0, copy.Length);
+            return copy;
+        }
+
+        private static HttpHeaderView GetHeader(IntPtr headers, uint count, int index)
+        {
+            if (index < 0 || index >= count)
+            {
+                throw new ArgumentOutOfRangeException("index");
+            }
+
+            return (HttpHeaderView)Marshal.PtrToStructure(headers + (index * Marshal.SizeOf(typeof(HttpHeaderView))), typeof(HttpHeaderView));
+        }
+
+        private static string FindHeader(IntPtr headers, uint count, HttpKnownHeader header)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                var view = GetHeader(headers, count, i);
+
+                if (view.KnownHeader == header)
+                {
+                    return view.Value;
+                }
+            }
+
+            return null;
+        }
+    }
+}
@@ -56,9 +56,16 @@ namespace HttpFilteringEngine.Native.Win
             }
         }
 
-        internal Win64PInvoke(string caBundleAbsPath, ushort preferredHttpListeningPort = 0, ushort preferredHttpsListeningPort = 0) : base(caBundleAbsPath, preferredHttpListeningPort, preferredHttpsListeningPort)
+        internal Win64PInvoke(string caBundleAbsPath, ushort preferredHttpListeningPort = 0, ushort preferredHttpsListeningPort = 0, bool useMessageViews = false) : base(caBundleAbsPath, preferredHttpListeningPort, preferredHttpsListeningPort)
         {
-            m_engineHandle = NativeMethods64.fe_ctl_create(NativeFirewallCbReference, caBundleAbsPath, (uint)caBundleAbsPath.Length, preferredHttpListeningPort, preferredHttpsListeningPort, (uint)Environment.ProcessorCount, NativeHttpMsgBeginCbReference, NativeHttpMsgEndCbReference, NativeOnInfoCbReference, NativeOnWarnCbReference, NativeOnErrorCbReference);
+            if (useMessageViews)
+            {
+                m_engineHandle = NativeMethods64.fe_ctl_create_with_views(NativeFirewallCbReference, caBundleAbsPath, (uint)caBundleAbsPath.Length, preferredHttpListeningPort, preferredHttpsListeningPort, (uint)Environment.ProcessorCount, NativeHttpMsgBeginViewCbReference, NativeHttpMsgEndViewCbReference, NativeOnInfoCbReference, NativeOnWarnCbReference, NativeOnErrorCbReference);
+            }
+            else
+            {
+                m_engineHandle = NativeMethods64.fe_ctl_create_v2(NativeFirewallCbReference, caBundleAbsPath, (uint)caBundleAbsPath.Length, preferredHttpListeningPort, preferredHttpsListeningPort, (uint)Environment.ProcessorCount, NativeHttpMsgBeginCbReference, NativeHttpMsgEndCbReference, NativeOnInfoCbReference, NativeOnWarnCbReference, NativeOnErrorCbReference);
+            }
 
             if (m_engineHandle == IntPtr.Zero || m_engineHandle == new IntPtr(-1))
             {
@@ -84,6 +91,427 @@ namespace HttpFilteringEngine.Native.Win
             }
         }
 
+        public override void SetFlowControl(uint maxBridgeInFlightBytes, ulong maxGlobalInFlightBytes)
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_set_flow_control(m_engineHandle, maxBridgeInFlightBytes, maxGlobalInFlightBytes);
+            }
+        }
+
+        public override void SetAdmissionControl(uint maxActiveBridges, uint maxPendingHandshakes, uint maxPendingSpoofs, bool deferWhenFull, bool tunnelWhenOverloaded)
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_set_admission_control(m_engineHandle, maxActiveBridges, maxPendingHandshakes, maxPendingSpoofs, deferWhenFull, tunnelWhenOverloaded);
+            }
+        }
+
+        public override void GetAdmissionStats(out uint activeBridges, out uint pendingHandshakes, out uint pendingSpoofs, out ulong acceptedCount, out ulong deferredCount, out ulong rejectedCount, out ulong tunnelledCount, out ulong shedCount)
+        {
+            activeBridges = 0;
+            pendingHandshakes = 0;
+            pendingSpoofs = 0;
+            acceptedCount = 0;
+            deferredCount = 0;
+            rejectedCount = 0;
+            tunnelledCount = 0;
+            shedCount = 0;
+
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_get_admission_stats(m_engineHandle, out activeBridges, out pendingHandshakes, out pendingSpoofs, out acceptedCount, out deferredCount, out rejectedCount, out tunnelledCount, out shedCount);
+            }
+        }
+
+        public override void SetAcceptOptions(uint outstandingAccepts, uint maxAcceptsPerWakeup, uint listenBacklog)
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_set_accept_options(m_engineHandle, outstandingAccepts, maxAcceptsPerWakeup, listenBacklog);
+            }
+        }
+
+        public override void GetAcceptStats(bool secure, out uint armedAccepts, out ulong acceptedCount, out ulong drainedCount, out uint peakDrainDepth, out ulong backlogSaturationCount, out ulong acceptErrorCount, out ulong averageRearmMicroseconds, out ulong peakRearmMicroseconds)
+        {
+            armedAccepts = 0;
+            acceptedCount = 0;
+            drainedCount = 0;
+            peakDrainDepth = 0;
+            backlogSaturationCount = 0;
+            acceptErrorCount = 0;
+            averageRearmMicroseconds = 0;
+            peakRearmMicroseconds = 0;
+
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_get_accept_stats(m_engineHandle, secure, out armedAccepts, out acceptedCount, out drainedCount, out peakDrainDepth, out backlogSaturationCount, out acceptErrorCount, out averageRearmMicroseconds, out peakRearmMicroseconds);
+            }
+        }
+
+        public override void SetVerdictCacheCapacity(uint maxEntries)
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_set_verdict_cache_capacity(m_engineHandle, maxEntries);
+            }
+        }
+
+        public override void FlushVerdictCache()
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_flush_verdict_cache(m_engineHandle);
+            }
+        }
+
+        public override void GetVerdictCacheStats(out uint entryCount, out ulong hitCount, out ulong missCount, out ulong insertCount, out ulong evictionCount, out ulong flushCount)
+        {
+            entryCount = 0;
+            hitCount = 0;
+            missCount = 0;
+            insertCount = 0;
+            evictionCount = 0;
+            flushCount = 0;
+
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_get_verdict_cache_stats(m_engineHandle, out entryCount, out hitCount, out missCount, out insertCount, out evictionCount, out flushCount);
+            }
+        }
+
+        public override bool LoadRules(string rules, out uint loadedCount, out uint failedCount)
+        {
+            loadedCount = 0;
+            failedCount = 0;
+
+            if (m_engineHandle != IntPtr.Zero && rules != null)
+            {
+                var ruleBytes = Encoding.UTF8.GetBytes(rules);
+                return NativeMethods64.fe_ctl_load_rules(m_engineHandle, ruleBytes, (uint)ruleBytes.Length, out loadedCount, out failedCount);
+            }
+
+            return false;
+        }
+
+        public override void ClearRules()
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_clear_rules(m_engineHandle);
+            }
+        }
+
+        public override void GetRuleStats(out uint ruleCount, out ulong checkedCount, out ulong blockedCount, out ulong exceptedCount)
+        {
+            ruleCount = 0;
+            checkedCount = 0;
+            blockedCount = 0;
+            exceptedCount = 0;
+
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_get_rule_stats(m_engineHandle, out ruleCount, out checkedCount, out blockedCount, out exceptedCount);
+            }
+        }
+
+        public override bool BuildHostnameBlocklist(string hostnames, string outputPath, out uint entryCount)
+        {
+            entryCount = 0;
+
+            if (m_engineHandle != IntPtr.Zero && hostnames != null && !string.IsNullOrEmpty(outputPath))
+            {
+                var hostnameBytes = Encoding.UTF8.GetBytes(hostnames);
+                return NativeMethods64.fe_ctl_build_hostname_blocklist(m_engineHandle, hostnameBytes, (uint)hostnameBytes.Length, outputPath, (uint)outputPath.Length, out entryCount);
+            }
+
+            return false;
+        }
+
+        public override bool LoadHostnameBlocklist(string path, out uint entryCount)
+        {
+            entryCount = 0;
+
+            if (m_engineHandle != IntPtr.Zero && !string.IsNullOrEmpty(path))
+            {
+                return NativeMethods64.fe_ctl_load_hostname_blocklist(m_engineHandle, path, (uint)path.Length, out entryCount);
+            }
+
+            return false;
+        }
+
+        public override void ClearHostnameBlocklist()
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_clear_hostname_blocklist(m_engineHandle);
+            }
+        }
+
+        public override void GetHostnameBlocklistStats(out uint entryCount, out ulong checkedCount, out ulong blockedCount)
+        {
+            entryCount = 0;
+            checkedCount = 0;
+            blockedCount = 0;
+
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_get_hostname_blocklist_stats(m_engineHandle, out entryCount, out checkedCount, out blockedCount);
+            }
+        }
+
+        public override bool LoadFilterConfiguration(string rules, string blocklistPath, string bypassHosts, string preservedEncodingHosts, string inspectionPolicy, uint verdictTimeoutMilliseconds, ProxyNextAction defaultBeginAction, bool defaultEndShouldBlock)
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                var ruleBytes = rules != null ? Encoding.UTF8.GetBytes(rules) : null;
+                var bypassHostBytes = bypassHosts != null ? Encoding.UTF8.GetBytes(bypassHosts) : null;
+                var preservedEncodingHostBytes = preservedEncodingHosts != null ? Encoding.UTF8.GetBytes(preservedEncodingHosts) : null;
+                var inspectionPolicyBytes = inspectionPolicy != null ? Encoding.UTF8.GetBytes(inspectionPolicy) : null;
+
+                return NativeMethods64.fe_ctl_load_filter_configuration(
+                    m_engineHandle,
+                    ruleBytes, ruleBytes != null ? (uint)ruleBytes.Length : 0,
+                    blocklistPath, blocklistPath != null ? (uint)blocklistPath.Length : 0,
+                    bypassHostBytes, bypassHostBytes != null ? (uint)bypassHostBytes.Length : 0,
+                    preservedEncodingHostBytes, preservedEncodingHostBytes != null ? (uint)preservedEncodingHostBytes.Length : 0,
+                    inspectionPolicyBytes, inspectionPolicyBytes != null ? (uint)inspectionPolicyBytes.Length : 0,
+                    verdictTimeoutMilliseconds, (uint)defaultBeginAction, defaultEndShouldBlock,
+                    NativeFilterConfigLoadedCbReference, IntPtr.Zero
+                    );
+            }
+
+            return false;
+        }
+
+        public override void GetFilterConfigurationStats(out ulong generation, out ulong publishedCount, out ulong bypassedCount)
+        {
+            generation = 0;
+            publishedCount = 0;
+            bypassedCount = 0;
+
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_get_filter_configuration_stats(m_engineHandle, out generation, out publishedCount, out bypassedCount);
+            }
+        }
+
+        public override bool SetInspectionPolicy(string policy, out uint entryCount, out uint failedCount)
+        {
+            entryCount = 0;
+            failedCount = 0;
+
+            if (m_engineHandle != IntPtr.Zero && policy != null)
+            {
+                var policyBytes = Encoding.UTF8.GetBytes(policy);
+                return NativeMethods64.fe_ctl_set_inspection_policy(m_engineHandle, policyBytes, (uint)policyBytes.Length, out entryCount, out failedCount);
+            }
+
+            return false;
+        }
+
+        public override void ClearInspectionPolicy()
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_clear_inspection_policy(m_engineHandle);
+            }
+        }
+
+        public override bool GetInspectionPolicyStats(uint entry, out ulong responseCount, out ulong bufferedBytes, out ulong streamedBytes)
+        {
+            responseCount = 0;
+            bufferedBytes = 0;
+            streamedBytes = 0;
+
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                return NativeMethods64.fe_ctl_get_inspection_policy_stats(m_engineHandle, entry, out responseCount, out bufferedBytes, out streamedBytes);
+            }
+
+            return false;
+        }
+
+        public override void SetContentVerdictCacheCapacity(uint maxEntries)
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_set_content_verdict_cache_capacity(m_engineHandle, maxEntries);
+            }
+        }
+
+        public override void FlushContentVerdictCache()
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_flush_content_verdict_cache(m_engineHandle);
+            }
+        }
+
+        public override void GetContentVerdictCacheStats(out uint entryCount, out ulong hitCount, out ulong missCount, out ulong evictionCount, out ulong hashedBytes, out ulong hashNanoseconds)
+        {
+            entryCount = 0;
+            hitCount = 0;
+            missCount = 0;
+            evictionCount = 0;
+            hashedBytes = 0;
+            hashNanoseconds = 0;
+
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_get_content_verdict_cache_stats(m_engineHandle, out entryCount, out hitCount, out missCount, out evictionCount, out hashedBytes, out hashNanoseconds);
+            }
+        }
+
+        public override void SetRecompression(uint mode, int level)
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_set_recompression(m_engineHandle, mode, level);
+            }
+        }
+
+        public override void GetRecompressionStats(out ulong identityCount, out ulong recompressedCount, out ulong inputBytes, out ulong outputBytes, out ulong nanoseconds, out ulong firstSliceNanoseconds)
+        {
+            identityCount = 0;
+            recompressedCount = 0;
+            inputBytes = 0;
+            outputBytes = 0;
+            nanoseconds = 0;
+            firstSliceNanoseconds = 0;
+
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_get_recompression_stats(m_engineHandle, out identityCount, out recompressedCount, out inputBytes, out outputBytes, out nanoseconds, out firstSliceNanoseconds);
+            }
+        }
+
+        public override void SetResponseCacheCapacity(ulong maxBytes)
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_set_response_cache_capacity(m_engineHandle, maxBytes);
+            }
+        }
+
+        public override void FlushResponseCache()
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_flush_response_cache(m_engineHandle);
+            }
+        }
+
+        public override void GetResponseCacheStats(out uint entryCount, out ulong usedBytes, out ulong hitCount, out ulong notModifiedCount, out ulong staleCount, out ulong revalidatedCount, out ulong missCount, out ulong storeCount, out ulong evictionCount, out ulong servedBytes)
+        {
+            entryCount = 0;
+            usedBytes = 0;
+            hitCount = 0;
+            notModifiedCount = 0;
+            staleCount = 0;
+            revalidatedCount = 0;
+            missCount = 0;
+            storeCount = 0;
+            evictionCount = 0;
+            servedBytes = 0;
+
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_get_response_cache_stats(m_engineHandle, out entryCount, out usedBytes, out hitCount, out notModifiedCount, out staleCount, out revalidatedCount, out missCount, out storeCount, out evictionCount, out servedBytes);
+            }
+        }
+
+        public override void RegisterBlockPage(uint pageId, byte[] page)
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_register_block_page(m_engineHandle, pageId, page, page != null ? (uint)page.Length : 0);
+            }
+        }
+
+        public override void ClearBlockPages()
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_clear_block_pages(m_engineHandle);
+            }
+        }
+
+        public override void GetBlockPageStats(out uint pageCount, out ulong hitCount, out ulong missCount)
+        {
+            pageCount = 0;
+            hitCount = 0;
+            missCount = 0;
+
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_get_block_page_stats(m_engineHandle, out pageCount, out hitCount, out missCount);
+            }
+        }
+
+        public override void SetPipelineCoalescing(bool enabled)
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_set_pipeline_coalescing(m_engineHandle, enabled);
+            }
+        }
+
+        public override void GetPipelineStats(out ulong pipelinedCount, out ulong coalescedCount)
+        {
+            pipelinedCount = 0;
+            coalescedCount = 0;
+
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_get_pipeline_stats(m_engineHandle, out pipelinedCount, out coalescedCount);
+            }
+        }
+
+        public override bool SetAsyncVerdictCallbacks(HttpMessageBeginAsyncCallback onMessageBegin, HttpMessageEndAsyncCallback onMessageEnd, uint timeoutMilliseconds, ProxyNextAction defaultBeginAction, bool defaultEndShouldBlock)
+        {
+            if (m_engineHandle == IntPtr.Zero || IsRunning)
+            {
+                return false;
+            }
+
+            // Set before the native side can call them. The engine is stopped, so nothing is
+            // calling the previous ones.
+            HttpMessageBeginAsyncCallback = onMessageBegin;
+            HttpMessageEndAsyncCallback = onMessageEnd;
+
+            return NativeMethods64.fe_ctl_set_async_verdict_callbacks(
+                m_engineHandle,
+                onMessageBegin != null ? NativeHttpMsgBeginAsyncCbReference : null,
+                onMessageEnd != null ? NativeHttpMsgEndAsyncCbReference : null,
+                timeoutMilliseconds, (uint)defaultBeginAction, defaultEndShouldBlock
+                );
+        }
+
+        public override bool CompleteVerdict(ulong verdictToken, uint verdict, uint responseSampleBytes, byte[] customResponse)
+        {
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                return NativeMethods64.fe_ctl_complete_verdict(m_engineHandle, verdictToken, verdict, responseSampleBytes, customResponse, customResponse != null ? (uint)customResponse.Length : 0);
+            }
+
+            return false;
+        }
+
+        public override void GetVerdictStats(out uint pendingCount, out ulong parkedCount, out ulong completedCount, out ulong timedOutCount, out ulong lateCompletionCount)
+        {
+            pendingCount = 0;
+            parkedCount = 0;
+            completedCount = 0;
+            timedOutCount = 0;
+            lateCompletionCount = 0;
+
+            if (m_engineHandle != IntPtr.Zero)
+            {
+                NativeMethods64.fe_ctl_get_verdict_stats(m_engineHandle, out pendingCount, out parkedCount, out completedCount, out timedOutCount, out lateCompletionCount);
+            }
+        }
+
         protected override void DisposeNativeEngine()
         {
             if (IsRunning)
@@ -99,8 +527,12 @@ namespace HttpFilteringEngine.Native.Win
 
         private class NativeMethods64
         {
-            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_create", CallingConvention = CallingConvention.Cdecl)]
-            public static extern IntPtr fe_ctl_create([MarshalAs(UnmanagedType.FunctionPtr)] NativeFirewallCheckCallback firewallCb, [In()] [MarshalAs(UnmanagedType.LPStr)] string caBundleAbsolutePath, uint caBundleAbsolutePathLength, ushort httpListenerPort, ushort httpsListenerPort, uint numThreads, [MarshalAs(UnmanagedType.FunctionPtr)] NativeHttpMessageBeginCallback onMessageBegin, [MarshalAs(UnmanagedType.FunctionPtr)] NativeHttpMessageEndCallback onMessageEnd, [MarshalAs(UnmanagedType.FunctionPtr)] NativeReportMessageCallback onInfo, [MarshalAs(UnmanagedType.FunctionPtr)] NativeReportMessageCallback onWarn, [MarshalAs(UnmanagedType.FunctionPtr)] NativeReportMessageCallback onError);
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_create_v2", CallingConvention = CallingConvention.Cdecl)]
+            public static extern IntPtr fe_ctl_create_v2([MarshalAs(UnmanagedType.FunctionPtr)] NativeFirewallCheckCallback firewallCb, [In()] [MarshalAs(UnmanagedType.LPStr)] string caBundleAbsolutePath, uint caBundleAbsolutePathLength, ushort httpListenerPort, ushort httpsListenerPort, uint numThreads, [MarshalAs(UnmanagedType.FunctionPtr)] NativeHttpMessageBeginCallback onMessageBegin, [MarshalAs(UnmanagedType.FunctionPtr)] NativeHttpMessageEndCallback onMessageEnd, [MarshalAs(UnmanagedType.FunctionPtr)] NativeReportMessageCallback onInfo, [MarshalAs(UnmanagedType.FunctionPtr)] NativeReportMessageCallback onWarn, [MarshalAs(UnmanagedType.FunctionPtr)] NativeReportMessageCallback onError);
+
+
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_create_with_views", CallingConvention = CallingConvention.Cdecl)]
+            public static extern IntPtr fe_ctl_create_with_views([MarshalAs(UnmanagedType.FunctionPtr)] NativeFirewallCheckCallback firewallCb, [In()] [MarshalAs(UnmanagedType.LPStr)] string caBundleAbsolutePath, uint caBundleAbsolutePathLength, ushort httpListenerPort, ushort httpsListenerPort, uint numThreads, [MarshalAs(UnmanagedType.FunctionPtr)] NativeHttpMessageBeginViewCallback onMessageBegin, [MarshalAs(UnmanagedType.FunctionPtr)] NativeHttpMessageEndViewCallback onMessageEnd, [MarshalAs(UnmanagedType.FunctionPtr)] NativeReportMessageCallback onInfo, [MarshalAs(UnmanagedType.FunctionPtr)] NativeReportMessageCallback onWarn, [MarshalAs(UnmanagedType.FunctionPtr)] NativeReportMessageCallback onError);
 
 
             /// Return Type: void
@@ -153,6 +585,359 @@ namespace HttpFilteringEngine.Native.Win
             ///bufferSize: size_t*
             [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_get_rootca_pem", CallingConvention = CallingConvention.Cdecl)]
             public static extern void fe_ctl_get_rootca_pem(IntPtr ptr, ref IntPtr bufferPP, ref uint bufferSize);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///maxBridgeInFlightBytes: uint32_t->unsigned int
+            ///maxGlobalInFlightBytes: uint64_t->unsigned long long
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_set_flow_control", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_set_flow_control(IntPtr ptr, uint maxBridgeInFlightBytes, ulong maxGlobalInFlightBytes);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///maxActiveBridges: uint32_t->unsigned int
+            ///maxPendingHandshakes: uint32_t->unsigned int
+            ///maxPendingSpoofs: uint32_t->unsigned int
+            ///deferWhenFull: boolean
+            ///tunnelWhenOverloaded: boolean
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_set_admission_control", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_set_admission_control(IntPtr ptr, uint maxActiveBridges, uint maxPendingHandshakes, uint maxPendingSpoofs, [MarshalAs(UnmanagedType.I1)] bool deferWhenFull, [MarshalAs(UnmanagedType.I1)] bool tunnelWhenOverloaded);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///activeBridges: uint32_t*
+            ///pendingHandshakes: uint32_t*
+            ///pendingSpoofs: uint32_t*
+            ///acceptedCount: uint64_t*
+            ///deferredCount: uint64_t*
+            ///rejectedCount: uint64_t*
+            ///tunnelledCount: uint64_t*
+            ///shedCount: uint64_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_get_admission_stats", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_get_admission_stats(IntPtr ptr, out uint activeBridges, out uint pendingHandshakes, out uint pendingSpoofs, out ulong acceptedCount, out ulong deferredCount, out ulong rejectedCount, out ulong tunnelledCount, out ulong shedCount);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///outstandingAccepts: uint32_t->unsigned int
+            ///maxAcceptsPerWakeup: uint32_t->unsigned int
+            ///listenBacklog: uint32_t->unsigned int
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_set_accept_options", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_set_accept_options(IntPtr ptr, uint outstandingAccepts, uint maxAcceptsPerWakeup, uint listenBacklog);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///secure: boolean
+            ///armedAccepts: uint32_t*
+            ///acceptedCount: uint64_t*
+            ///drainedCount: uint64_t*
+            ///peakDrainDepth: uint32_t*
+            ///backlogSaturationCount: uint64_t*
+            ///acceptErrorCount: uint64_t*
+            ///averageRearmMicroseconds: uint64_t*
+            ///peakRearmMicroseconds: uint64_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_get_accept_stats", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_get_accept_stats(IntPtr ptr, [MarshalAs(UnmanagedType.I1)] bool secure, out uint armedAccepts, out ulong acceptedCount, out ulong drainedCount, out uint peakDrainDepth, out ulong backlogSaturationCount, out ulong acceptErrorCount, out ulong averageRearmMicroseconds, out ulong peakRearmMicroseconds);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///maxEntries: uint32_t->unsigned int
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_set_verdict_cache_capacity", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_set_verdict_cache_capacity(IntPtr ptr, uint maxEntries);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_flush_verdict_cache", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_flush_verdict_cache(IntPtr ptr);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///entryCount: uint32_t*
+            ///hitCount: uint64_t*
+            ///missCount: uint64_t*
+            ///insertCount: uint64_t*
+            ///evictionCount: uint64_t*
+            ///flushCount: uint64_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_get_verdict_cache_stats", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_get_verdict_cache_stats(IntPtr ptr, out uint entryCount, out ulong hitCount, out ulong missCount, out ulong insertCount, out ulong evictionCount, out ulong flushCount);
+
+
+            /// Return Type: boolean
+            ///ptr: PVOID->void*
+            ///rules: char*
+            ///rulesLength: uint32_t->unsigned int
+            ///loadedCount: uint32_t*
+            ///failedCount: uint32_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_load_rules", CallingConvention = CallingConvention.Cdecl)]
+            [return: MarshalAs(UnmanagedType.I1)]
+            public static extern bool fe_ctl_load_rules(IntPtr ptr, [In()] byte[] rules, uint rulesLength, out uint loadedCount, out uint failedCount);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_clear_rules", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_clear_rules(IntPtr ptr);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///ruleCount: uint32_t*
+            ///checkedCount: uint64_t*
+            ///blockedCount: uint64_t*
+            ///exceptedCount: uint64_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_get_rule_stats", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_get_rule_stats(IntPtr ptr, out uint ruleCount, out ulong checkedCount, out ulong blockedCount, out ulong exceptedCount);
+
+
+            /// Return Type: boolean
+            ///ptr: PVOID->void*
+            ///hostnames: char*
+            ///hostnamesLength: uint32_t->unsigned int
+            ///outputPath: char*
+            ///outputPathLength: uint32_t->unsigned int
+            ///entryCount: uint32_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_build_hostname_blocklist", CallingConvention = CallingConvention.Cdecl)]
+            [return: MarshalAs(UnmanagedType.I1)]
+            public static extern bool fe_ctl_build_hostname_blocklist(IntPtr ptr, [In()] byte[] hostnames, uint hostnamesLength, [In()] [MarshalAs(UnmanagedType.LPStr)] string outputPath, uint outputPathLength, out uint entryCount);
+
+
+            /// Return Type: boolean
+            ///ptr: PVOID->void*
+            ///path: char*
+            ///pathLength: uint32_t->unsigned int
+            ///entryCount: uint32_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_load_hostname_blocklist", CallingConvention = CallingConvention.Cdecl)]
+            [return: MarshalAs(UnmanagedType.I1)]
+            public static extern bool fe_ctl_load_hostname_blocklist(IntPtr ptr, [In()] [MarshalAs(UnmanagedType.LPStr)] string path, uint pathLength, out uint entryCount);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_clear_hostname_blocklist", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_clear_hostname_blocklist(IntPtr ptr);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///entryCount: uint32_t*
+            ///checkedCount: uint64_t*
+            ///blockedCount: uint64_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_get_hostname_blocklist_stats", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_get_hostname_blocklist_stats(IntPtr ptr, out uint entryCount, out ulong checkedCount, out ulong blockedCount);
+
+
+            /// Return Type: boolean
+            ///ptr: PVOID->void*
+            ///rules: char*
+            ///rulesLength: uint32_t->unsigned int
+            ///blocklistPath: char*
+            ///blocklistPathLength: uint32_t->unsigned int
+            ///bypassHosts: char*
+            ///bypassHostsLength: uint32_t->unsigned int
+            ///preservedEncodingHosts: char*
+            ///preservedEncodingHostsLength: uint32_t->unsigned int
+            ///inspectionPolicy: char*
+            ///inspectionPolicyLength: uint32_t->unsigned int
+            ///verdictTimeoutMilliseconds: uint32_t->unsigned int
+            ///defaultBeginAction: uint32_t->unsigned int
+            ///defaultEndShouldBlock: boolean
+            ///onLoaded: FilterConfigurationLoadedCallback
+            ///context: void*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_load_filter_configuration", CallingConvention = CallingConvention.Cdecl)]
+            [return: MarshalAs(UnmanagedType.I1)]
+            public static extern bool fe_ctl_load_filter_configuration(IntPtr ptr, [In()] byte[] rules, uint rulesLength, [In()] [MarshalAs(UnmanagedType.LPStr)] string blocklistPath, uint blocklistPathLength, [In()] byte[] bypassHosts, uint bypassHostsLength, [In()] byte[] preservedEncodingHosts, uint preservedEncodingHostsLength, [In()] byte[] inspectionPolicy, uint inspectionPolicyLength, uint verdictTimeoutMilliseconds, uint defaultBeginAction, [MarshalAs(UnmanagedType.I1)] bool defaultEndShouldBlock, [MarshalAs(UnmanagedType.FunctionPtr)] NativeFilterConfigurationLoadedCallback onLoaded, IntPtr context);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///generation: uint64_t*
+            ///publishedCount: uint64_t*
+            ///bypassedCount: uint64_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_get_filter_configuration_stats", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_get_filter_configuration_stats(IntPtr ptr, out ulong generation, out ulong publishedCount, out ulong bypassedCount);
+
+
+            /// Return Type: boolean
+            ///ptr: PVOID->void*
+            ///policy: char*
+            ///policyLength: uint32_t->unsigned int
+            ///entryCount: uint32_t*
+            ///failedCount: uint32_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_set_inspection_policy", CallingConvention = CallingConvention.Cdecl)]
+            [return: MarshalAs(UnmanagedType.I1)]
+            public static extern bool fe_ctl_set_inspection_policy(IntPtr ptr, [In()] byte[] policy, uint policyLength, out uint entryCount, out uint failedCount);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_clear_inspection_policy", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_clear_inspection_policy(IntPtr ptr);
+
+
+            /// Return Type: boolean
+            ///ptr: PVOID->void*
+            ///entry: uint32_t->unsigned int
+            ///responseCount: uint64_t*
+            ///bufferedBytes: uint64_t*
+            ///streamedBytes: uint64_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_get_inspection_policy_stats", CallingConvention = CallingConvention.Cdecl)]
+            [return: MarshalAs(UnmanagedType.I1)]
+            public static extern bool fe_ctl_get_inspection_policy_stats(IntPtr ptr, uint entry, out ulong responseCount, out ulong bufferedBytes, out ulong streamedBytes);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///maxEntries: uint32_t->unsigned int
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_set_content_verdict_cache_capacity", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_set_content_verdict_cache_capacity(IntPtr ptr, uint maxEntries);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_flush_content_verdict_cache", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_flush_content_verdict_cache(IntPtr ptr);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///entryCount: uint32_t*
+            ///hitCount: uint64_t*
+            ///missCount: uint64_t*
+            ///evictionCount: uint64_t*
+            ///hashedBytes: uint64_t*
+            ///hashNanoseconds: uint64_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_get_content_verdict_cache_stats", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_get_content_verdict_cache_stats(IntPtr ptr, out uint entryCount, out ulong hitCount, out ulong missCount, out ulong evictionCount, out ulong hashedBytes, out ulong hashNanoseconds);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///mode: uint32_t->unsigned int
+            ///level: int32_t->int
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_set_recompression", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_set_recompression(IntPtr ptr, uint mode, int level);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///identityCount: uint64_t*
+            ///recompressedCount: uint64_t*
+            ///inputBytes: uint64_t*
+            ///outputBytes: uint64_t*
+            ///nanoseconds: uint64_t*
+            ///firstSliceNanoseconds: uint64_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_get_recompression_stats", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_get_recompression_stats(IntPtr ptr, out ulong identityCount, out ulong recompressedCount, out ulong inputBytes, out ulong outputBytes, out ulong nanoseconds, out ulong firstSliceNanoseconds);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///maxBytes: uint64_t->unsigned __int64
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_set_response_cache_capacity", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_set_response_cache_capacity(IntPtr ptr, ulong maxBytes);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_flush_response_cache", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_flush_response_cache(IntPtr ptr);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///entryCount: uint32_t*
+            ///usedBytes: uint64_t*
+            ///hitCount: uint64_t*
+            ///notModifiedCount: uint64_t*
+            ///staleCount: uint64_t*
+            ///revalidatedCount: uint64_t*
+            ///missCount: uint64_t*
+            ///storeCount: uint64_t*
+            ///evictionCount: uint64_t*
+            ///servedBytes: uint64_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_get_response_cache_stats", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_get_response_cache_stats(IntPtr ptr, out uint entryCount, out ulong usedBytes, out ulong hitCount, out ulong notModifiedCount, out ulong staleCount, out ulong revalidatedCount, out ulong missCount, out ulong storeCount, out ulong evictionCount, out ulong servedBytes);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///pageId: uint32_t->unsigned int
+            ///page: char*
+            ///pageLength: uint32_t->unsigned int
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_register_block_page", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_register_block_page(IntPtr ptr, uint pageId, [In()] byte[] page, uint pageLength);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_clear_block_pages", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_clear_block_pages(IntPtr ptr);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///pageCount: uint32_t*
+            ///hitCount: uint64_t*
+            ///missCount: uint64_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_get_block_page_stats", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_get_block_page_stats(IntPtr ptr, out uint pageCount, out ulong hitCount, out ulong missCount);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///enabled: boolean
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_set_pipeline_coalescing", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_set_pipeline_coalescing(IntPtr ptr, [MarshalAs(UnmanagedType.I1)] bool enabled);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///pipelinedCount: uint64_t*
+            ///coalescedCount: uint64_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_get_pipeline_stats", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_get_pipeline_stats(IntPtr ptr, out ulong pipelinedCount, out ulong coalescedCount);
+
+
+            /// Return Type: boolean
+            ///ptr: PVOID->void*
+            ///onMessageBegin: HttpMessageBeginAsyncCallback
+            ///onMessageEnd: HttpMessageEndAsyncCallback
+            ///timeoutMilliseconds: uint32_t->unsigned int
+            ///defaultBeginAction: uint32_t->unsigned int
+            ///defaultEndShouldBlock: boolean
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_set_async_verdict_callbacks", CallingConvention = CallingConvention.Cdecl)]
+            [return: MarshalAs(UnmanagedType.I1)]
+            public static extern bool fe_ctl_set_async_verdict_callbacks(IntPtr ptr, [MarshalAs(UnmanagedType.FunctionPtr)] NativeHttpMessageBeginAsyncCallback onMessageBegin, [MarshalAs(UnmanagedType.FunctionPtr)] NativeHttpMessageEndAsyncCallback onMessageEnd, uint timeoutMilliseconds, uint defaultBeginAction, [MarshalAs(UnmanagedType.I1)] bool defaultEndShouldBlock);
+
+
+            /// Return Type: boolean
+            ///ptr: PVOID->void*
+            ///verdictToken: uint64_t->unsigned long long
+            ///verdict: uint32_t->unsigned int
+            ///responseSampleBytes: uint32_t->unsigned int
+            ///customResponse: char*
+            ///customResponseLength: uint32_t->unsigned int
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_complete_verdict", CallingConvention = CallingConvention.Cdecl)]
+            [return: MarshalAs(UnmanagedType.I1)]
+            public static extern bool fe_ctl_complete_verdict(IntPtr ptr, ulong verdictToken, uint verdict, uint responseSampleBytes, [In()] byte[] customResponse, uint customResponseLength);
+
+
+            /// Return Type: void
+            ///ptr: PVOID->void*
+            ///pendingCount: uint32_t*
+            ///parkedCount: uint64_t*
+            ///completedCount: uint64_t*
+            ///timedOutCount: uint64_t*
+            ///lateCompletionCount: uint64_t*
+            [DllImport(@"x64\HttpFilteringEngine.dll", EntryPoint = "fe_ctl_get_verdict_stats", CallingConvention = CallingConvention.Cdecl)]
+            public static extern void fe_ctl_get_verdict_stats(IntPtr ptr, out uint pendingCount, out ulong parkedCount, out ulong completedCount, out ulong timedOutCount, out ulong lateCompletionCount);
         }
     }
 }
@@ -9,6 +9,7 @@
 
 #include "HttpFilteringEngineCAPI.h"
 #include "HttpFilteringEngineControl.hpp"
+#include "util/cb/StreamCopyUtils.hpp"
 #include <iostream>
 
 #include <boost/predef.h>
@@ -17,16 +18,21 @@
 	#include <WinSock2.h>
 #endif
 
-
-PVOID fe_ctl_create(
+/// <summary>
+/// Shared implementation of fe_ctl_create and fe_ctl_create_v2. Message callbacks are taken in
+/// the V2 form, which is what the Engine uses internally.
+/// </summary>
+static PVOID fe_ctl_create_internal(
 	FirewallCheckCallback firewallCb,
 	const char* caBundleAbsolutePath,
 	uint32_t caBundleAbsolutePathLength,
 	uint16_t httpListenerPort,
 	uint16_t httpsListenerPort,
 	uint32_t numThread,	
-	HttpMessageBeginCallback onMessageBegin,
-	HttpMessageEndCallback onMessageEnd,
+	te::httpengine::util::cb::HttpMessageBeginCheckFunction onMessageBegin,
+	te::httpengine::util::cb::HttpMessageEndCheckFunction onMessageEnd,
+	te::httpengine::util::cb::HttpMessageBeginViewFunction onMessageBeginView,
+	te::httpengine::util::cb::HttpMessageEndViewFunction onMessageEndView,
 	ReportMessageCallback onInfo,
 	ReportMessageCallback onWarn,
 	ReportMessageCallback onError
@@ -75,6 +81,8 @@ PVOID fe_ctl_create(
 			numThread,
 			onMessageBegin,
 			onMessageEnd,
+			onMessageBeginView,
+			onMessageEndView,
 			onInfo,
 			onWarn,
 			onError
@@ -96,6 +104,99 @@ PVOID fe_ctl_create(
 	return inst;
 }
 
+PVOID fe_ctl_create(
+	FirewallCheckCallback firewallCb,
+	const char* caBundleAbsolutePath,
+	uint32_t caBundleAbsolutePathLength,
+	uint16_t httpListenerPort,
+	uint16_t httpsListenerPort,
+	uint32_t numThread,	
+	HttpMessageBeginCallback onMessageBegin,
+	HttpMessageEndCallback onMessageEnd,
+	ReportMessageCallback onInfo,
+	ReportMessageCallback onWarn,
+	ReportMessageCallback onError
+	)
+{
+	return fe_ctl_create_internal(
+		firewallCb,
+		caBundleAbsolutePath,
+		caBundleAbsolutePathLength,
+		httpListenerPort,
+		httpsListenerPort,
+		numThread,
+		te::httpengine::util::cb::AdaptLegacyCallback(onMessageBegin),
+		te::httpengine::util::cb::AdaptLegacyCallback(onMessageEnd),
+		nullptr,
+		nullptr,
+		onInfo,
+		onWarn,
+		onError
+		);
+}
+
+PVOID fe_ctl_create_v2(
+	FirewallCheckCallback firewallCb,
+	const char* caBundleAbsolutePath,
+	uint32_t caBundleAbsolutePathLength,
+	uint16_t httpListenerPort,
+	uint16_t httpsListenerPort,
+	uint32_t numThread,	
+	HttpMessageBeginCallbackV2 onMessageBegin,
+	HttpMessageEndCallbackV2 onMessageEnd,
+	ReportMessageCallback onInfo,
+	ReportMessageCallback onWarn,
+	ReportMessageCallback onError
+	)
+{
+	return fe_ctl_create_internal(
+		firewallCb,
+		caBundleAbsolutePath,
+		caBundleAbsolutePathLength,
+		httpListenerPort,
+		httpsListenerPort,
+		numThread,
+		onMessageBegin,
+		onMessageEnd,
+		nullptr,
+		nullptr,
+		onInfo,
+		onWarn,
+		onError
+		);
+}
+
+PVOID fe_ctl_create_with_views(
+	FirewallCheckCallback firewallCb,
+	const char* caBundleAbsolutePath,
+	uint32_t caBundleAbsolutePathLength,
+	uint16_t httpListenerPort,
+	uint16_t httpsListenerPort,
+	uint32_t numThread,	
+	HttpMessageBeginViewCallback onMessageBegin,
+	HttpMessageEndViewCallback onMessageEnd,
+	ReportMessageCallback onInfo,
+	ReportMessageCallback onWarn,
+	ReportMessageCallback onError
+	)
+{
+	return fe_ctl_create_internal(
+		firewallCb,
+		caBundleAbsolutePath,
+		caBundleAbsolutePathLength,
+		httpListenerPort,
+		httpsListenerPort,
+		numThread,
+		nullptr,
+		nullptr,
+		onMessageBegin,
+		onMessageEnd,
+		onInfo,
+		onWarn,
+		onError
+		);
+}
+
 void fe_ctl_destroy(PVOID* ptr)
 {	
 	te::httpengine::HttpFilteringEngineControl* cppPtr = static_cast<te::httpengine::HttpFilteringEngineControl*>(*ptr);
@@ -295,3 +396,1278 @@ void fe_ctl_get_rootca_pem(PVOID ptr, char** bufferPP, size_t* bufferSize)
 
 	assert(callSuccess == true && u8"In fe_ctl_get_rootca_pem(...) - Caught exception and failed to fetch root CA certificate.");
 }
+
+void fe_ctl_set_flow_control(PVOID ptr, uint32_t maxBridgeInFlightBytes, uint64_t maxGlobalInFlightBytes)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_set_flow_control(PVOID, uint32_t, uint64_t) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->SetFlowControl(maxBridgeInFlightBytes, maxGlobalInFlightBytes);
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_set_flow_control(PVOID, uint32_t, uint64_t) - Caught exception and failed to set flow control.");
+}
+
+void fe_ctl_set_admission_control(PVOID ptr, uint32_t maxActiveBridges, uint32_t maxPendingHandshakes, uint32_t maxPendingSpoofs, bool deferWhenFull, bool tunnelWhenOverloaded)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_set_admission_control(PVOID, uint32_t, uint32_t, uint32_t, bool, bool) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->SetAdmissionControl(maxActiveBridges, maxPendingHandshakes, maxPendingSpoofs, deferWhenFull, tunnelWhenOverloaded);
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_set_admission_control(PVOID, uint32_t, uint32_t, uint32_t, bool, bool) - Caught exception and failed to set admission control.");
+}
+
+void fe_ctl_get_admission_stats(
+	PVOID ptr,
+	uint32_t* activeBridges,
+	uint32_t* pendingHandshakes,
+	uint32_t* pendingSpoofs,
+	uint64_t* acceptedCount,
+	uint64_t* deferredCount,
+	uint64_t* rejectedCount,
+	uint64_t* tunnelledCount,
+	uint64_t* shedCount
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_admission_stats(PVOID, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	if (ptr != nullptr)
+	{
+		const auto& admissionControl = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetAdmissionControl();
+
+		if (activeBridges != nullptr)
+		{
+			*activeBridges = admissionControl.GetActiveBridges();
+		}
+
+		if (pendingHandshakes != nullptr)
+		{
+			*pendingHandshakes = admissionControl.GetPendingHandshakes();
+		}
+
+		if (pendingSpoofs != nullptr)
+		{
+			*pendingSpoofs = admissionControl.GetPendingSpoofs();
+		}
+
+		if (acceptedCount != nullptr)
+		{
+			*acceptedCount = admissionControl.GetAcceptedCount();
+		}
+
+		if (deferredCount != nullptr)
+		{
+			*deferredCount = admissionControl.GetDeferredCount();
+		}
+
+		if (rejectedCount != nullptr)
+		{
+			*rejectedCount = admissionControl.GetRejectedCount();
+		}
+
+		if (tunnelledCount != nullptr)
+		{
+			*tunnelledCount = admissionControl.GetTunnelledCount();
+		}
+
+		if (shedCount != nullptr)
+		{
+			*shedCount = admissionControl.GetShedCount();
+		}
+	}
+}
+
+void fe_ctl_set_accept_options(PVOID ptr, uint32_t outstandingAccepts, uint32_t maxAcceptsPerWakeup, uint32_t listenBacklog)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_set_accept_options(PVOID, uint32_t, uint32_t, uint32_t) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->SetAcceptOptions(outstandingAccepts, maxAcceptsPerWakeup, listenBacklog);
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_set_accept_options(PVOID, uint32_t, uint32_t, uint32_t) - Caught exception and failed to set accept options.");
+}
+
+void fe_ctl_get_accept_stats(
+	PVOID ptr,
+	bool secure,
+	uint32_t* armedAccepts,
+	uint64_t* acceptedCount,
+	uint64_t* drainedCount,
+	uint32_t* peakDrainDepth,
+	uint64_t* backlogSaturationCount,
+	uint64_t* acceptErrorCount,
+	uint64_t* averageRearmMicroseconds,
+	uint64_t* peakRearmMicroseconds
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_accept_stats(PVOID, bool, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	if (ptr != nullptr)
+	{
+		const auto& acceptControl = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetAcceptControl(secure);
+
+		if (armedAccepts != nullptr)
+		{
+			*armedAccepts = acceptControl.GetArmedAccepts();
+		}
+
+		if (acceptedCount != nullptr)
+		{
+			*acceptedCount = acceptControl.GetAcceptedCount();
+		}
+
+		if (drainedCount != nullptr)
+		{
+			*drainedCount = acceptControl.GetDrainedCount();
+		}
+
+		if (peakDrainDepth != nullptr)
+		{
+			*peakDrainDepth = acceptControl.GetPeakDrainDepth();
+		}
+
+		if (backlogSaturationCount != nullptr)
+		{
+			*backlogSaturationCount = acceptControl.GetBacklogSaturationCount();
+		}
+
+		if (acceptErrorCount != nullptr)
+		{
+			*acceptErrorCount = acceptControl.GetAcceptErrorCount();
+		}
+
+		if (averageRearmMicroseconds != nullptr)
+		{
+			*averageRearmMicroseconds = acceptControl.GetAverageRearmMicroseconds();
+		}
+
+		if (peakRearmMicroseconds != nullptr)
+		{
+			*peakRearmMicroseconds = acceptControl.GetPeakRearmMicroseconds();
+		}
+	}
+}
+
+const bool fe_ctl_set_async_verdict_callbacks(
+	PVOID ptr,
+	HttpMessageBeginAsyncCallback onMessageBegin,
+	HttpMessageEndAsyncCallback onMessageEnd,
+	uint32_t timeoutMilliseconds,
+	uint32_t defaultBeginAction,
+	bool defaultEndShouldBlock
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_set_async_verdict_callbacks(PVOID, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			te::httpengine::util::cb::HttpMessageBeginAsyncFunction beginFunction = nullptr;
+			te::httpengine::util::cb::HttpMessageEndAsyncFunction endFunction = nullptr;
+
+			if (onMessageBegin != nullptr)
+			{
+				beginFunction = onMessageBegin;
+			}
+
+			if (onMessageEnd != nullptr)
+			{
+				endFunction = onMessageEnd;
+			}
+
+			success = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->SetAsyncVerdictCallbacks(beginFunction, endFunction, timeoutMilliseconds, defaultBeginAction, defaultEndShouldBlock);
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	return success;
+}
+
+const bool fe_ctl_complete_verdict(PVOID ptr, uint64_t verdictToken, uint32_t verdict, uint32_t responseSampleBytes, const char* customResponse, uint32_t customResponseLength)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_complete_verdict(PVOID, uint64_t, uint32_t, uint32_t, const char*, uint32_t) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			success = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->CompleteVerdict(verdictToken, verdict, responseSampleBytes, customResponse, customResponseLength);
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	return success;
+}
+
+void fe_ctl_get_verdict_stats(
+	PVOID ptr,
+	uint32_t* pendingCount,
+	uint64_t* parkedCount,
+	uint64_t* completedCount,
+	uint64_t* timedOutCount,
+	uint64_t* lateCompletionCount
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_verdict_stats(PVOID, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	if (ptr != nullptr)
+	{
+		const auto& verdictControl = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetVerdictControl();
+
+		if (pendingCount != nullptr)
+		{
+			*pendingCount = verdictControl.GetPendingCount();
+		}
+
+		if (parkedCount != nullptr)
+		{
+			*parkedCount = verdictControl.GetParkedCount();
+		}
+
+		if (completedCount != nullptr)
+		{
+			*completedCount = verdictControl.GetCompletedCount();
+		}
+
+		if (timedOutCount != nullptr)
+		{
+			*timedOutCount = verdictControl.GetTimedOutCount();
+		}
+
+		if (lateCompletionCount != nullptr)
+		{
+			*lateCompletionCount = verdictControl.GetLateCompletionCount();
+		}
+	}
+}
+
+void fe_ctl_set_verdict_cache_capacity(PVOID ptr, uint32_t maxEntries)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_set_verdict_cache_capacity(PVOID, uint32_t) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->SetVerdictCacheCapacity(maxEntries);
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_set_verdict_cache_capacity(PVOID, uint32_t) - Caught exception and failed to set verdict cache capacity.");
+}
+
+void fe_ctl_flush_verdict_cache(PVOID ptr)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_flush_verdict_cache(PVOID) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->FlushVerdictCache();
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_flush_verdict_cache(PVOID) - Caught exception and failed to flush verdict cache.");
+}
+
+void fe_ctl_get_verdict_cache_stats(
+	PVOID ptr,
+	uint32_t* entryCount,
+	uint64_t* hitCount,
+	uint64_t* missCount,
+	uint64_t* insertCount,
+	uint64_t* evictionCount,
+	uint64_t* flushCount
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_verdict_cache_stats(PVOID, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	if (ptr != nullptr)
+	{
+		const auto& verdictCache = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetVerdictControl().GetCache();
+
+		if (entryCount != nullptr)
+		{
+			*entryCount = verdictCache.GetEntryCount();
+		}
+
+		if (hitCount != nullptr)
+		{
+			*hitCount = verdictCache.GetHitCount();
+		}
+
+		if (missCount != nullptr)
+		{
+			*missCount = verdictCache.GetMissCount();
+		}
+
+		if (insertCount != nullptr)
+		{
+			*insertCount = verdictCache.GetInsertCount();
+		}
+
+		if (evictionCount != nullptr)
+		{
+			*evictionCount = verdictCache.GetEvictionCount();
+		}
+
+		if (flushCount != nullptr)
+		{
+			*flushCount = verdictCache.GetFlushCount();
+		}
+	}
+}
+
+void fe_ctl_set_content_verdict_cache_capacity(PVOID ptr, uint32_t maxEntries)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_set_content_verdict_cache_capacity(PVOID, uint32_t) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->SetContentVerdictCacheCapacity(maxEntries);
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_set_content_verdict_cache_capacity(PVOID, uint32_t) - Caught exception and failed to set content verdict cache capacity.");
+}
+
+void fe_ctl_flush_content_verdict_cache(PVOID ptr)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_flush_content_verdict_cache(PVOID) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->FlushContentVerdictCache();
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_flush_content_verdict_cache(PVOID) - Caught exception and failed to flush content verdict cache.");
+}
+
+void fe_ctl_get_content_verdict_cache_stats(
+	PVOID ptr,
+	uint32_t* entryCount,
+	uint64_t* hitCount,
+	uint64_t* missCount,
+	uint64_t* evictionCount,
+	uint64_t* hashedBytes,
+	uint64_t* hashNanoseconds
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_content_verdict_cache_stats(PVOID, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	if (ptr != nullptr)
+	{
+		const auto& contentCache = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetVerdictControl().GetContentCache();
+
+		if (entryCount != nullptr)
+		{
+			*entryCount = contentCache.GetEntryCount();
+		}
+
+		if (hitCount != nullptr)
+		{
+			*hitCount = contentCache.GetHitCount();
+		}
+
+		if (missCount != nullptr)
+		{
+			*missCount = contentCache.GetMissCount();
+		}
+
+		if (evictionCount != nullptr)
+		{
+			*evictionCount = contentCache.GetEvictionCount();
+		}
+
+		if (hashedBytes != nullptr)
+		{
+			*hashedBytes = contentCache.GetHashedBytes();
+		}
+
+		if (hashNanoseconds != nullptr)
+		{
+			*hashNanoseconds = contentCache.GetHashNanoseconds();
+		}
+	}
+}
+
+const bool fe_ctl_load_rules(PVOID ptr, const char* rules, uint32_t rulesLength, uint32_t* loadedCount, uint32_t* failedCount)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_load_rules(PVOID, const char*, uint32_t, uint32_t*, uint32_t*) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+		assert((rules != nullptr || rulesLength == 0) && u8"In fe_ctl_load_rules(PVOID, const char*, uint32_t, uint32_t*, uint32_t*) - Supplied rules ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr && (rules != nullptr || rulesLength == 0))
+		{
+			uint32_t loaded = 0;
+			uint32_t failed = 0;
+
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->LoadRules(rules, rulesLength, loaded, failed);
+
+			if (loadedCount != nullptr)
+			{
+				*loadedCount = loaded;
+			}
+
+			if (failedCount != nullptr)
+			{
+				*failedCount = failed;
+			}
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	return success;
+}
+
+void fe_ctl_clear_rules(PVOID ptr)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_clear_rules(PVOID) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ClearRules();
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_clear_rules(PVOID) - Caught exception and failed to clear rules.");
+}
+
+void fe_ctl_get_rule_stats(
+	PVOID ptr,
+	uint32_t* ruleCount,
+	uint64_t* checkedCount,
+	uint64_t* blockedCount,
+	uint64_t* exceptedCount
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_rule_stats(PVOID, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	if (ptr != nullptr)
+	{
+		const auto& verdictControl = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetVerdictControl();
+
+		if (ruleCount != nullptr)
+		{
+			auto rules = verdictControl.GetRules();
+			*ruleCount = rules ? rules->GetRuleCount() : 0;
+		}
+
+		if (checkedCount != nullptr)
+		{
+			*checkedCount = verdictControl.GetRuleCheckedCount();
+		}
+
+		if (blockedCount != nullptr)
+		{
+			*blockedCount = verdictControl.GetRuleBlockedCount();
+		}
+
+		if (exceptedCount != nullptr)
+		{
+			*exceptedCount = verdictControl.GetRuleExceptedCount();
+		}
+	}
+}
+
+const bool fe_ctl_build_hostname_blocklist(
+	PVOID ptr,
+	const char* hostnames,
+	uint32_t hostnamesLength,
+	const char* outputPath,
+	uint32_t outputPathLength,
+	uint32_t* entryCount
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_build_hostname_blocklist(PVOID, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+		assert(outputPath != nullptr && outputPathLength > 0 && u8"In fe_ctl_build_hostname_blocklist(PVOID, ...) - Supplied output path is empty!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr && outputPath != nullptr && outputPathLength > 0 && (hostnames != nullptr || hostnamesLength == 0))
+		{
+			auto written = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->BuildHostnameBlocklist(
+				hostnames, hostnamesLength, std::string(outputPath, static_cast<size_t>(outputPathLength))
+				);
+
+			if (entryCount != nullptr)
+			{
+				*entryCount = written;
+			}
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	return success;
+}
+
+const bool fe_ctl_load_hostname_blocklist(PVOID ptr, const char* path, uint32_t pathLength, uint32_t* entryCount)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_load_hostname_blocklist(PVOID, const char*, uint32_t, uint32_t*) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+		assert(path != nullptr && pathLength > 0 && u8"In fe_ctl_load_hostname_blocklist(PVOID, const char*, uint32_t, uint32_t*) - Supplied path is empty!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr && path != nullptr && pathLength > 0)
+		{
+			auto loaded = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->LoadHostnameBlocklist(std::string(path, static_cast<size_t>(pathLength)));
+
+			if (entryCount != nullptr)
+			{
+				*entryCount = loaded;
+			}
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	return success;
+}
+
+void fe_ctl_clear_hostname_blocklist(PVOID ptr)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_clear_hostname_blocklist(PVOID) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ClearHostnameBlocklist();
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_clear_hostname_blocklist(PVOID) - Caught exception and failed to clear hostname blocklist.");
+}
+
+void fe_ctl_get_hostname_blocklist_stats(
+	PVOID ptr,
+	uint32_t* entryCount,
+	uint64_t* checkedCount,
+	uint64_t* blockedCount
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_hostname_blocklist_stats(PVOID, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	if (ptr != nullptr)
+	{
+		const auto& verdictControl = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetVerdictControl();
+
+		if (entryCount != nullptr)
+		{
+			auto blocklist = verdictControl.GetBlocklist();
+			*entryCount = blocklist ? blocklist->GetEntryCount() : 0;
+		}
+
+		if (checkedCount != nullptr)
+		{
+			*checkedCount = verdictControl.GetBlocklistCheckedCount();
+		}
+
+		if (blockedCount != nullptr)
+		{
+			*blockedCount = verdictControl.GetBlocklistBlockedCount();
+		}
+	}
+}
+
+const bool fe_ctl_load_filter_configuration(
+	PVOID ptr,
+	const char* rules,
+	uint32_t rulesLength,
+	const char* blocklistPath,
+	uint32_t blocklistPathLength,
+	const char* bypassHosts,
+	uint32_t bypassHostsLength,
+	const char* preservedEncodingHosts,
+	uint32_t preservedEncodingHostsLength,
+	const char* inspectionPolicy,
+	uint32_t inspectionPolicyLength,
+	uint32_t verdictTimeoutMilliseconds,
+	uint32_t defaultBeginAction,
+	bool defaultEndShouldBlock,
+	FilterConfigurationLoadedCallback onLoaded,
+	void* context
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_load_filter_configuration(PVOID, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			te::httpengine::util::cb::FilterConfigurationLoadedFunction onLoadedFunction;
+
+			if (onLoaded != nullptr)
+			{
+				onLoadedFunction = [onLoaded, context](const bool loaded, const uint64_t generation, const uint32_t ruleCount, const uint32_t failedRuleCount, const uint32_t blocklistEntryCount)
+				{
+					onLoaded(context, loaded, generation, ruleCount, failedRuleCount, blocklistEntryCount);
+				};
+			}
+
+			// Everything is copied here, since the caller's buffers are only good until we return.
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->LoadFilterConfigurationAsync(
+				rules != nullptr ? std::string(rules, static_cast<size_t>(rulesLength)) : std::string(),
+				blocklistPath != nullptr ? std::string(blocklistPath, static_cast<size_t>(blocklistPathLength)) : std::string(),
+				bypassHosts != nullptr ? std::string(bypassHosts, static_cast<size_t>(bypassHostsLength)) : std::string(),
+				preservedEncodingHosts != nullptr ? std::string(preservedEncodingHosts, static_cast<size_t>(preservedEncodingHostsLength)) : std::string(),
+				inspectionPolicy != nullptr ? std::string(inspectionPolicy, static_cast<size_t>(inspectionPolicyLength)) : std::string(),
+				verdictTimeoutMilliseconds,
+				defaultBeginAction,
+				defaultEndShouldBlock,
+				onLoadedFunction
+				);
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	return success;
+}
+
+void fe_ctl_get_filter_configuration_stats(
+	PVOID ptr,
+	uint64_t* generation,
+	uint64_t* publishedCount,
+	uint64_t* bypassedCount
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_filter_configuration_stats(PVOID, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	if (ptr != nullptr)
+	{
+		const auto& verdictControl = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetVerdictControl();
+
+		if (generation != nullptr)
+		{
+			*generation = verdictControl.GetGeneration();
+		}
+
+		if (publishedCount != nullptr)
+		{
+			*publishedCount = verdictControl.GetPublishedCount();
+		}
+
+		if (bypassedCount != nullptr)
+		{
+			*bypassedCount = verdictControl.GetBypassedCount();
+		}
+	}
+}
+
+const bool fe_ctl_set_inspection_policy(PVOID ptr, const char* policy, uint32_t policyLength, uint32_t* entryCount, uint32_t* failedCount)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_set_inspection_policy(PVOID, const char*, uint32_t, uint32_t*, uint32_t*) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+		assert((policy != nullptr || policyLength == 0) && u8"In fe_ctl_set_inspection_policy(PVOID, const char*, uint32_t, uint32_t*, uint32_t*) - Supplied policy ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr && (policy != nullptr || policyLength == 0))
+		{
+			uint32_t loaded = 0;
+			uint32_t failed = 0;
+
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->SetInspectionPolicy(policy, policyLength, loaded, failed);
+
+			if (entryCount != nullptr)
+			{
+				*entryCount = loaded;
+			}
+
+			if (failedCount != nullptr)
+			{
+				*failedCount = failed;
+			}
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	return success;
+}
+
+void fe_ctl_clear_inspection_policy(PVOID ptr)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_clear_inspection_policy(PVOID) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ClearInspectionPolicy();
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_clear_inspection_policy(PVOID) - Caught exception and failed to clear inspection policy.");
+}
+
+const bool fe_ctl_get_inspection_policy_stats(
+	PVOID ptr,
+	uint32_t entry,
+	uint64_t* responseCount,
+	uint64_t* bufferedBytes,
+	uint64_t* streamedBytes
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_inspection_policy_stats(PVOID, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	if (ptr == nullptr)
+	{
+		return false;
+	}
+
+	auto policy = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetVerdictControl().GetInspectionPolicy();
+
+	uint64_t responses = 0;
+	uint64_t buffered = 0;
+	uint64_t streamed = 0;
+
+	if (!policy || !policy->GetEntryStats(entry, responses, buffered, streamed))
+	{
+		return false;
+	}
+
+	if (responseCount != nullptr)
+	{
+		*responseCount = responses;
+	}
+
+	if (bufferedBytes != nullptr)
+	{
+		*bufferedBytes = buffered;
+	}
+
+	if (streamedBytes != nullptr)
+	{
+		*streamedBytes = streamed;
+	}
+
+	return true;
+}
+
+void fe_ctl_set_recompression(PVOID ptr, uint32_t mode, int32_t level)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_set_recompression(PVOID, uint32_t, int32_t) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->SetRecompression(mode, level);
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_set_recompression(PVOID, uint32_t, int32_t) - Caught exception and failed to set recompression.");
+}
+
+void fe_ctl_get_recompression_stats(
+	PVOID ptr,
+	uint64_t* identityCount,
+	uint64_t* recompressedCount,
+	uint64_t* inputBytes,
+	uint64_t* outputBytes,
+	uint64_t* nanoseconds,
+	uint64_t* firstSliceNanoseconds
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_recompression_stats(PVOID, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	if (ptr != nullptr)
+	{
+		const auto& recompression = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetVerdictControl().GetRecompression();
+
+		if (identityCount != nullptr)
+		{
+			*identityCount = recompression.GetIdentityCount();
+		}
+
+		if (recompressedCount != nullptr)
+		{
+			*recompressedCount = recompression.GetRecompressedCount();
+		}
+
+		if (inputBytes != nullptr)
+		{
+			*inputBytes = recompression.GetInputBytes();
+		}
+
+		if (outputBytes != nullptr)
+		{
+			*outputBytes = recompression.GetOutputBytes();
+		}
+
+		if (nanoseconds != nullptr)
+		{
+			*nanoseconds = recompression.GetNanoseconds();
+		}
+
+		if (firstSliceNanoseconds != nullptr)
+		{
+			*firstSliceNanoseconds = recompression.GetFirstSliceNanoseconds();
+		}
+	}
+}
+
+void fe_ctl_set_response_cache_capacity(PVOID ptr, uint64_t maxBytes)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_set_response_cache_capacity(PVOID, uint64_t) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->SetResponseCacheCapacity(maxBytes);
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_set_response_cache_capacity(PVOID, uint64_t) - Caught exception and failed to set response cache capacity.");
+}
+
+void fe_ctl_flush_response_cache(PVOID ptr)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_flush_response_cache(PVOID) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->FlushResponseCache();
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_flush_response_cache(PVOID) - Caught exception and failed to flush response cache.");
+}
+
+void fe_ctl_get_response_cache_stats(
+	PVOID ptr,
+	uint32_t* entryCount,
+	uint64_t* usedBytes,
+	uint64_t* hitCount,
+	uint64_t* notModifiedCount,
+	uint64_t* staleCount,
+	uint64_t* revalidatedCount,
+	uint64_t* missCount,
+	uint64_t* storeCount,
+	uint64_t* evictionCount,
+	uint64_t* servedBytes
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_response_cache_stats(PVOID, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	if (ptr != nullptr)
+	{
+		const auto& responseCache = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetVerdictControl().GetResponseCache();
+
+		if (entryCount != nullptr)
+		{
+			*entryCount = responseCache.GetEntryCount();
+		}
+
+		if (usedBytes != nullptr)
+		{
+			*usedBytes = responseCache.GetUsedBytes();
+		}
+
+		if (hitCount != nullptr)
+		{
+			*hitCount = responseCache.GetHitCount();
+		}
+
+		if (notModifiedCount != nullptr)
+		{
+			*notModifiedCount = responseCache.GetNotModifiedCount();
+		}
+
+		if (staleCount != nullptr)
+		{
+			*staleCount = responseCache.GetStaleCount();
+		}
+
+		if (revalidatedCount != nullptr)
+		{
+			*revalidatedCount = responseCache.GetRevalidatedCount();
+		}
+
+		if (missCount != nullptr)
+		{
+			*missCount = responseCache.GetMissCount();
+		}
+
+		if (storeCount != nullptr)
+		{
+			*storeCount = responseCache.GetStoreCount();
+		}
+
+		if (evictionCount != nullptr)
+		{
+			*evictionCount = responseCache.GetEvictionCount();
+		}
+
+		if (servedBytes != nullptr)
+		{
+			*servedBytes = responseCache.GetServedBytes();
+		}
+	}
+}
+
+void fe_ctl_register_block_page(PVOID ptr, uint32_t pageId, const char* page, uint32_t pageLength)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_register_block_page(PVOID, uint32_t, const char*, uint32_t) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->RegisterBlockPage(pageId, page, pageLength);
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_register_block_page(PVOID, uint32_t, const char*, uint32_t) - Caught exception and failed to register block page.");
+}
+
+void fe_ctl_clear_block_pages(PVOID ptr)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_clear_block_pages(PVOID) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ClearBlockPages();
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_clear_block_pages(PVOID) - Caught exception and failed to clear block pages.");
+}
+
+void fe_ctl_get_block_page_stats(
+	PVOID ptr,
+	uint32_t* pageCount,
+	uint64_t* hitCount,
+	uint64_t* missCount
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_block_page_stats(PVOID, ...) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	if (ptr != nullptr)
+	{
+		const auto& blockResponses = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetVerdictControl().GetBlockResponses();
+
+		if (pageCount != nullptr)
+		{
+			*pageCount = blockResponses.GetPageCount();
+		}
+
+		if (hitCount != nullptr)
+		{
+			*hitCount = blockResponses.GetPageHitCount();
+		}
+
+		if (missCount != nullptr)
+		{
+			*missCount = blockResponses.GetPageMissCount();
+		}
+	}
+}
+
+void fe_ctl_set_pipeline_coalescing(PVOID ptr, bool enabled)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_set_pipeline_coalescing(PVOID, bool) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool success = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->SetPipelineCoalescing(enabled);
+
+			success = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(success == true && u8"In fe_ctl_set_pipeline_coalescing(PVOID, bool) - Caught exception and failed to set pipeline coalescing.");
+}
+
+void fe_ctl_get_pipeline_stats(PVOID ptr, uint64_t* pipelinedCount, uint64_t* coalescedCount)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_pipeline_stats(PVOID, uint64_t*, uint64_t*) - Supplied HttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	if (ptr != nullptr)
+	{
+		const auto& verdictControl = static_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetVerdictControl();
+
+		if (pipelinedCount != nullptr)
+		{
+			*pipelinedCount = verdictControl.GetPipelinedCount();
+		}
+
+		if (coalescedCount != nullptr)
+		{
+			*coalescedCount = verdictControl.GetCoalescedCount();
+		}
+	}
+}
@@ -104,6 +104,79 @@ extern "C" {
 		ReportMessageCallback onError
 		);
 
+	/// <summary>
+	/// Identical to fe_ctl_create, except that the message callbacks take the context carrying
+	/// V2 form. In the original form, every concurrent transaction needs its own block response
+	/// writer function, which the Engine hands out from a fixed size table. Under heavy load,
+	/// that table can wrap around onto writers still in use by earlier transactions. In the V2
+	/// form, the writer is a single function that is also given an opaque writerContext, which
+	/// says which transaction to write to, so there is no limit on concurrent writers. New
+	/// users should prefer this function.
+	/// </summary>
+	/// <param name="onMessageBegin">
+	/// Called when a new HTTP transaction starts, with, at-minimum headers, complete. The
+	/// writerContext argument must be passed back unmodified to the supplied writer, and is only
+	/// valid until the callback returns.
+	/// </param>
+	/// <param name="onMessageEnd">
+	/// Called when a HTTP transaction that was flagged for content inspection has completed. The
+	/// writerContext argument must be passed back unmodified to the supplied writer, and is only
+	/// valid until the callback returns.
+	/// </param>
+	/// <remarks>
+	/// See fe_ctl_create for all other parameters and the return value.
+	/// </remarks>
+	extern HTTP_FILTERING_ENGINE_API PVOID fe_ctl_create_v2(
+		FirewallCheckCallback firewallCb,
+		const char* caBundleAbsolutePath,
+		uint32_t caBundleAbsolutePathLength,
+		uint16_t httpListenerPort,
+		uint16_t httpsListenerPort,
+		uint32_t numThreads,
+		HttpMessageBeginCallbackV2 onMessageBegin,
+		HttpMessageEndCallbackV2 onMessageEnd,
+		ReportMessageCallback onInfo,
+		ReportMessageCallback onWarn,
+		ReportMessageCallback onError
+		);
+
+	/// <summary>
+	/// Identical to fe_ctl_create_v2, except that the message callbacks receive a structured
+	/// HttpMessageView rather than formatted header strings. The string forms format both the
+	/// request and response headers into freshly allocated strings for every callback, which
+	/// consumers then typically parse right back apart. The view form instead supplies the method,
+	/// URI, host and status separately, along with an array of header name and value views that
+	/// point directly into the transaction's own storage. Each header also comes with its
+	/// HttpKnownHeader id, so common headers can be recognized without string comparisons.
+	/// Producing the view allocates nothing in the steady state.
+	/// </summary>
+	/// <param name="onMessageBegin">
+	/// Called when a new HTTP transaction starts, with, at-minimum headers, complete. The message
+	/// view, and everything it points to, is only valid until the callback returns. For a
+	/// response, the callback may ask for only the first bytes of the payload to be inspected,
+	/// see HttpMessageBeginViewCallback.
+	/// </param>
+	/// <param name="onMessageEnd">
+	/// Called when a HTTP transaction that was flagged for content inspection has completed. The
+	/// message view, and everything it points to, is only valid until the callback returns.
+	/// </param>
+	/// <remarks>
+	/// See fe_ctl_create for all other parameters and the return value.
+	/// </remarks>
+	extern HTTP_FILTERING_ENGINE_API PVOID fe_ctl_create_with_views(
+		FirewallCheckCallback firewallCb,
+		const char* caBundleAbsolutePath,
+		uint32_t caBundleAbsolutePathLength,
+		uint16_t httpListenerPort,
+		uint16_t httpsListenerPort,
+		uint32_t numThreads,
+		HttpMessageBeginViewCallback onMessageBegin,
+		HttpMessageEndViewCallback onMessageEnd,
+		ReportMessageCallback onInfo,
+		ReportMessageCallback onWarn,
+		ReportMessageCallback onError
+		);
+
 	/// <summary>
 	/// Destroys an existing Engine instance. If the Engine is running, it will be correctly shut
 	/// down. Regardless of its state, the Engine instance pointed to will be destroyed and the
@@ -194,6 +267,1009 @@ extern "C" {
 	/// </param>
 	extern HTTP_FILTERING_ENGINE_API void fe_ctl_get_rootca_pem(PVOID ptr, char** bufferPP, size_t* bufferSize);
 
+	/// <summary>
+	/// Configures how much data may be held in memory while being streamed through the Engine.
+	/// Every bridge bounds the streaming reads it has outstanding, in both directions combined, to
+	/// the per-bridge limit, and must reserve those bytes against the global limit before reading.
+	/// When the global limit is exhausted, bridges pause reading from their peers until enough data
+	/// has been written out the other side. Payloads that have been flagged for inspection are not
+	/// subject to these limits. May be called at any time, whether or not the Engine is running.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="maxBridgeInFlightBytes">
+	/// The maximum number of bytes a single connection may have in flight, in both directions
+	/// combined. Values below 8192 are raised to 8192. The default is 131072.
+	/// </param>
+	/// <param name="maxGlobalInFlightBytes">
+	/// The maximum number of bytes that may be in flight across all connections combined. Supply
+	/// zero for no global limit, which is the default.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_set_flow_control(PVOID ptr, uint32_t maxBridgeInFlightBytes, uint64_t maxGlobalInFlightBytes);
+
+	/// <summary>
+	/// Configures how much new work the Engine will take on at once, and what happens to work
+	/// that doesn't fit, so that connections already being serviced aren't starved when a storm
+	/// of new ones arrives. May be called at any time, whether or not the Engine is running.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="maxActiveBridges">
+	/// The maximum number of client connections that may be serviced at once. Supply zero for no
+	/// limit, which is the default.
+	/// </param>
+	/// <param name="maxPendingHandshakes">
+	/// The maximum number of TLS connections that may be handshaking at once. Supply zero for no
+	/// limit, which is the default.
+	/// </param>
+	/// <param name="maxPendingSpoofs">
+	/// The maximum number of TLS connections that may be waiting on a certificate to be fetched
+	/// or generated at once. Supply zero for no limit, which is the default.
+	/// </param>
+	/// <param name="deferWhenFull">
+	/// If true, new clients are left waiting in the listener backlog while the connection limit
+	/// is reached. If false, they are accepted and immediately reset. The default is true.
+	/// </param>
+	/// <param name="tunnelWhenOverloaded">
+	/// If true, TLS connections refused by the handshake or spoof limit are tunnelled straight
+	/// through without any filtering. If false, they are dropped. The default is true.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_set_admission_control(PVOID ptr, uint32_t maxActiveBridges, uint32_t maxPendingHandshakes, uint32_t maxPendingSpoofs, bool deferWhenFull, bool tunnelWhenOverloaded);
+
+	/// <summary>
+	/// Gets the present state of admission control, along with counts of every load shedding
+	/// decision that has been made since the Engine instance was created. Any of the out
+	/// parameters may be nullptr if the caller isn't interested in it.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="activeBridges">
+	/// The number of client connections presently being serviced.
+	/// </param>
+	/// <param name="pendingHandshakes">
+	/// The number of TLS connections presently handshaking.
+	/// </param>
+	/// <param name="pendingSpoofs">
+	/// The number of TLS connections presently waiting on the certificate store.
+	/// </param>
+	/// <param name="acceptedCount">
+	/// The number of clients that were admitted.
+	/// </param>
+	/// <param name="deferredCount">
+	/// The number of times a listener stopped accepting because the connection limit was
+	/// reached.
+	/// </param>
+	/// <param name="rejectedCount">
+	/// The number of clients that were reset because the connection limit was reached.
+	/// </param>
+	/// <param name="tunnelledCount">
+	/// The number of TLS connections that were tunnelled without filtering because the
+	/// handshake or spoof limit was reached.
+	/// </param>
+	/// <param name="shedCount">
+	/// The number of TLS connections that were dropped because the handshake or spoof limit
+	/// was reached.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_get_admission_stats(
+		PVOID ptr,
+		uint32_t* activeBridges,
+		uint32_t* pendingHandshakes,
+		uint32_t* pendingSpoofs,
+		uint64_t* acceptedCount,
+		uint64_t* deferredCount,
+		uint64_t* rejectedCount,
+		uint64_t* tunnelledCount,
+		uint64_t* shedCount
+		);
+
+	/// <summary>
+	/// Configures the accept loop of both the HTTP and HTTPS listeners. Takes effect the next
+	/// time the Engine is started.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="outstandingAccepts">
+	/// The number of accepts each listener keeps outstanding at once, so that several threads
+	/// can be picking up new clients at the same time. Values below 1 are raised to 1. The
+	/// default is 4.
+	/// </param>
+	/// <param name="maxAcceptsPerWakeup">
+	/// The maximum number of clients already waiting in the backlog that a listener will pick up
+	/// every time an accept completes, including the one that completed. Supply 1 to disable
+	/// draining. The default is 16.
+	/// </param>
+	/// <param name="listenBacklog">
+	/// The listen backlog to request. Supply zero, the default, for the platform maximum.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_set_accept_options(PVOID ptr, uint32_t outstandingAccepts, uint32_t maxAcceptsPerWakeup, uint32_t listenBacklog);
+
+	/// <summary>
+	/// Gets the accept loop instrumentation of either the HTTP or HTTPS listener. Counts are
+	/// kept from the time the Engine instance was created. Any of the out parameters may be
+	/// nullptr if the caller isn't interested in it.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="secure">
+	/// True for the HTTPS listener, false for the HTTP listener.
+	/// </param>
+	/// <param name="armedAccepts">
+	/// The number of accepts presently outstanding.
+	/// </param>
+	/// <param name="acceptedCount">
+	/// The number of clients accepted.
+	/// </param>
+	/// <param name="drainedCount">
+	/// The number of clients that were picked up from the backlog while draining.
+	/// </param>
+	/// <param name="peakDrainDepth">
+	/// The most clients found already waiting in the backlog in a single drain.
+	/// </param>
+	/// <param name="backlogSaturationCount">
+	/// The number of drains that stopped because they hit the per-wakeup limit while clients
+	/// may still have been waiting. When this climbs steadily, the backlog is at risk of
+	/// overflowing.
+	/// </param>
+	/// <param name="acceptErrorCount">
+	/// The number of accepts that failed, for example because the process ran out of
+	/// descriptors.
+	/// </param>
+	/// <param name="averageRearmMicroseconds">
+	/// The average time from an accept completing until its replacement was armed.
+	/// </param>
+	/// <param name="peakRearmMicroseconds">
+	/// The longest time from an accept completing until its replacement was armed.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_get_accept_stats(
+		PVOID ptr,
+		bool secure,
+		uint32_t* armedAccepts,
+		uint64_t* acceptedCount,
+		uint64_t* drainedCount,
+		uint32_t* peakDrainDepth,
+		uint64_t* backlogSaturationCount,
+		uint64_t* acceptErrorCount,
+		uint64_t* averageRearmMicroseconds,
+		uint64_t* peakRearmMicroseconds
+		);
+
+	/// <summary>
+	/// Supplies the asynchronous form of the message callbacks. When supplied, these are called
+	/// instead of the message callbacks given at creation. A callback that can't reach a verdict
+	/// right away returns true, and the connection is parked without holding any of the Engine's
+	/// threads until fe_ctl_complete_verdict is called with the token the callback was given, or
+	/// until the timeout expires and the default verdict is applied. May only be called while the
+	/// Engine is stopped.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="onMessageBegin">
+	/// The asynchronous form of the message begin callback. May be nullptr, in which case the
+	/// message begin callback given at creation is used.
+	/// </param>
+	/// <param name="onMessageEnd">
+	/// The asynchronous form of the message end callback. May be nullptr, in which case the
+	/// message end callback given at creation is used.
+	/// </param>
+	/// <param name="timeoutMilliseconds">
+	/// How long a connection waits on a pending verdict.
+	/// </param>
+	/// <param name="defaultBeginAction">
+	/// The nextAction applied when a pending message begin verdict times out.
+	/// </param>
+	/// <param name="defaultEndShouldBlock">
+	/// Whether or not to block when a pending message end verdict times out.
+	/// </param>
+	/// <returns>
+	/// True if the callbacks were set, false if the Engine is running or an error occurred.
+	/// </returns>
+	extern HTTP_FILTERING_ENGINE_API const bool fe_ctl_set_async_verdict_callbacks(
+		PVOID ptr,
+		HttpMessageBeginAsyncCallback onMessageBegin,
+		HttpMessageEndAsyncCallback onMessageEnd,
+		uint32_t timeoutMilliseconds,
+		uint32_t defaultBeginAction,
+		bool defaultEndShouldBlock
+		);
+
+	/// <summary>
+	/// Supplies a verdict that an asynchronous message callback left pending. May be called from
+	/// any thread, including from within the callback itself.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="verdictToken">
+	/// The token that was supplied to the callback.
+	/// </param>
+	/// <param name="verdict">
+	/// For a message begin callback, the nextAction. For a message end callback, non-zero to
+	/// block the transaction.
+	/// </param>
+	/// <param name="responseSampleBytes">
+	/// For a message begin callback on a response, how many bytes of the payload to inspect, or
+	/// zero for all of it, exactly as the callback's own responseSampleBytes. Ignored otherwise.
+	/// </param>
+	/// <param name="customResponse">
+	/// Optional custom block response, used if the transaction is blocked. May be nullptr.
+	/// </param>
+	/// <param name="customResponseLength">
+	/// The length of the custom block response.
+	/// </param>
+	/// <returns>
+	/// True if the connection was waiting on the verdict and has been resumed. False if the
+	/// verdict already timed out, or the connection has since been closed.
+	/// </returns>
+	extern HTTP_FILTERING_ENGINE_API const bool fe_ctl_complete_verdict(PVOID ptr, uint64_t verdictToken, uint32_t verdict, uint32_t responseSampleBytes, const char* customResponse, uint32_t customResponseLength);
+
+	/// <summary>
+	/// Gets the asynchronous verdict counters. Counts are kept from the time the Engine instance
+	/// was created. Any of the out parameters may be nullptr if the caller isn't interested in it.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="pendingCount">
+	/// The number of connections presently waiting on a verdict.
+	/// </param>
+	/// <param name="parkedCount">
+	/// The number of times a connection has been parked waiting on a verdict.
+	/// </param>
+	/// <param name="completedCount">
+	/// The number of pending verdicts that were supplied in time.
+	/// </param>
+	/// <param name="timedOutCount">
+	/// The number of pending verdicts that timed out.
+	/// </param>
+	/// <param name="lateCompletionCount">
+	/// The number of verdicts supplied for a connection that was no longer waiting.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_get_verdict_stats(
+		PVOID ptr,
+		uint32_t* pendingCount,
+		uint64_t* parkedCount,
+		uint64_t* completedCount,
+		uint64_t* timedOutCount,
+		uint64_t* lateCompletionCount
+		);
+
+	/// <summary>
+	/// Sets how many reusable message begin verdicts the Engine keeps. Verdicts are only ever
+	/// reused when the message begin callback asks for it, by answering with a nextAction built
+	/// with HTTP_NEXT_ACTION_CACHED. May be called at any time.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="maxEntries">
+	/// The maximum number of cached verdicts. Supply zero to disable the cache. The default is
+	/// 16384.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_set_verdict_cache_capacity(PVOID ptr, uint32_t maxEntries);
+
+	/// <summary>
+	/// Discards every cached verdict, so that every request is once again handed to the message
+	/// begin callback. Call this whenever the rules verdicts are reached with have changed.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_flush_verdict_cache(PVOID ptr);
+
+	/// <summary>
+	/// Gets the verdict cache counters. Counts are kept from the time the Engine instance was
+	/// created. Any of the out parameters may be nullptr if the caller isn't interested in it.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="entryCount">
+	/// The number of verdicts presently cached.
+	/// </param>
+	/// <param name="hitCount">
+	/// The number of requests decided from the cache, without calling out.
+	/// </param>
+	/// <param name="missCount">
+	/// The number of requests no cached verdict applied to.
+	/// </param>
+	/// <param name="insertCount">
+	/// The number of verdicts that have been cached.
+	/// </param>
+	/// <param name="evictionCount">
+	/// The number of unexpired verdicts evicted to make room.
+	/// </param>
+	/// <param name="flushCount">
+	/// The number of times the cache has been flushed.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_get_verdict_cache_stats(
+		PVOID ptr,
+		uint32_t* entryCount,
+		uint64_t* hitCount,
+		uint64_t* missCount,
+		uint64_t* insertCount,
+		uint64_t* evictionCount,
+		uint64_t* flushCount
+		);
+
+	/// <summary>
+	/// Sets how many message end verdicts the Engine remembers by the content of the response
+	/// body they were reached for. When a response inspected in full turns up with exactly the
+	/// same body as one already decided, as the same scripts and images constantly do, the
+	/// remembered verdict, custom block response included, is applied without calling the
+	/// message end callback. Bodies are recognized by their length and a fast, non-cryptographic
+	/// hash of their bytes, computed as they're read. This assumes the verdict depends on the body
+	/// alone, so the cache is disabled by default. Samples, transactions whose request body was
+	/// inspected too, and verdicts applied because the consumer timed out are never remembered.
+	/// May be called at any time, and flushes anything already cached.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="maxEntries">
+	/// The maximum number of cached verdicts. Supply zero to disable the cache.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_set_content_verdict_cache_capacity(PVOID ptr, uint32_t maxEntries);
+
+	/// <summary>
+	/// Discards every verdict remembered by response body content. Call this whenever the
+	/// classifier verdicts are reached with has changed.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_flush_content_verdict_cache(PVOID ptr);
+
+	/// <summary>
+	/// Gets the content verdict cache counters. Counts are kept from the time the Engine instance
+	/// was created. Any of the out parameters may be nullptr if the caller isn't interested in it.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="entryCount">
+	/// The number of verdicts presently cached.
+	/// </param>
+	/// <param name="hitCount">
+	/// The number of responses decided from the cache, without calling out.
+	/// </param>
+	/// <param name="missCount">
+	/// The number of responses no verdict was cached for.
+	/// </param>
+	/// <param name="evictionCount">
+	/// The number of verdicts evicted to make room.
+	/// </param>
+	/// <param name="hashedBytes">
+	/// The number of response body bytes hashed for responses looked up in the cache.
+	/// </param>
+	/// <param name="hashNanoseconds">
+	/// The time spent hashing those bytes, in nanoseconds. Together with hashedBytes, gives the
+	/// hashing throughput.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_get_content_verdict_cache_stats(
+		PVOID ptr,
+		uint32_t* entryCount,
+		uint64_t* hitCount,
+		uint64_t* missCount,
+		uint64_t* evictionCount,
+		uint64_t* hashedBytes,
+		uint64_t* hashNanoseconds
+		);
+
+	/// <summary>
+	/// Compiles the supplied Adblock Plus formatted network rules, and has the Engine match
+	/// every request against them before the message begin callback is consulted. Requests a
+	/// blocking rule matches, and no exception rule does, are blocked without the callback ever
+	/// seeing them. Everything else carries on to the callback as before. Any rules loaded
+	/// before are replaced. May be called at any time, including while the Engine is running.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="rules">
+	/// The rules, one per line. Comments, element hiding rules and blank lines are ignored.
+	/// </param>
+	/// <param name="rulesLength">
+	/// The length of the rules, in bytes.
+	/// </param>
+	/// <param name="loadedCount">
+	/// The number of rules that were loaded. May be nullptr.
+	/// </param>
+	/// <param name="failedCount">
+	/// The number of network rules that were malformed or unsupported, and were skipped. May be
+	/// nullptr.
+	/// </param>
+	/// <returns>
+	/// True if the rules were compiled and swapped in, false otherwise.
+	/// </returns>
+	extern HTTP_FILTERING_ENGINE_API const bool fe_ctl_load_rules(PVOID ptr, const char* rules, uint32_t rulesLength, uint32_t* loadedCount, uint32_t* failedCount);
+
+	/// <summary>
+	/// Discards the native rules, so that every request is once again handed to the message
+	/// begin callback.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_clear_rules(PVOID ptr);
+
+	/// <summary>
+	/// Gets the native rule counters. Counts are kept from the time the Engine instance was
+	/// created. Any of the out parameters may be nullptr if the caller isn't interested in it.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="ruleCount">
+	/// The number of rules presently loaded.
+	/// </param>
+	/// <param name="checkedCount">
+	/// The number of requests matched against the rules.
+	/// </param>
+	/// <param name="blockedCount">
+	/// The number of requests blocked by the rules.
+	/// </param>
+	/// <param name="exceptedCount">
+	/// The number of requests a blocking rule matched, but an exception rule let through.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_get_rule_stats(
+		PVOID ptr,
+		uint32_t* ruleCount,
+		uint64_t* checkedCount,
+		uint64_t* blockedCount,
+		uint64_t* exceptedCount
+		);
+
+	/// <summary>
+	/// Builds a hostname blocklist file from a list of hostnames, for fe_ctl_load_hostname_blocklist
+	/// to map later. Doesn't touch the Engine itself, so lists may be built ahead of time, and the
+	/// Engine need not be running. A host is blocked when it, or any domain it's beneath, is in
+	/// the list.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance, for error reporting.
+	/// </param>
+	/// <param name="hostnames">
+	/// The hostnames, one per line. Hosts file lines, such as "0.0.0.0 example.com", and Adblock
+	/// Plus domain rules, such as "||example.com^", are accepted as well. Blank lines, comments
+	/// and hostnames without a dot are ignored.
+	/// </param>
+	/// <param name="hostnamesLength">
+	/// The length of the hostnames, in bytes.
+	/// </param>
+	/// <param name="outputPath">
+	/// The path to write the file to. Any existing file is overwritten, so this must not be the
+	/// path of a file that is currently loaded.
+	/// </param>
+	/// <param name="outputPathLength">
+	/// The length of the output path.
+	/// </param>
+	/// <param name="entryCount">
+	/// The number of distinct hostnames written. May be nullptr.
+	/// </param>
+	/// <returns>
+	/// True if the file was written, false otherwise.
+	/// </returns>
+	extern HTTP_FILTERING_ENGINE_API const bool fe_ctl_build_hostname_blocklist(
+		PVOID ptr,
+		const char* hostnames,
+		uint32_t hostnamesLength,
+		const char* outputPath,
+		uint32_t outputPathLength,
+		uint32_t* entryCount
+		);
+
+	/// <summary>
+	/// Maps a hostname blocklist file built by fe_ctl_build_hostname_blocklist, replacing any
+	/// loaded before. The host named by TLS clients in the SNI extension is checked against it
+	/// before anything else is done with the connection, and a blocked host has its connection
+	/// closed. The host named in the Host header of every request is checked too, and a blocked
+	/// request is answered with the block response. May be called at any time, including while
+	/// the Engine is running, and lookups are never held up by it.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="path">
+	/// The path to the blocklist file. The file must not be modified while it's loaded.
+	/// </param>
+	/// <param name="pathLength">
+	/// The length of the path.
+	/// </param>
+	/// <param name="entryCount">
+	/// The number of hostnames in the blocklist. May be nullptr.
+	/// </param>
+	/// <returns>
+	/// True if the blocklist was mapped and swapped in, false otherwise.
+	/// </returns>
+	extern HTTP_FILTERING_ENGINE_API const bool fe_ctl_load_hostname_blocklist(PVOID ptr, const char* path, uint32_t pathLength, uint32_t* entryCount);
+
+	/// <summary>
+	/// Unloads the hostname blocklist.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_clear_hostname_blocklist(PVOID ptr);
+
+	/// <summary>
+	/// Gets the hostname blocklist counters. Counts are kept from the time the Engine instance
+	/// was created. Any of the out parameters may be nullptr if the caller isn't interested in
+	/// it.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="entryCount">
+	/// The number of hostnames in the blocklist presently loaded.
+	/// </param>
+	/// <param name="checkedCount">
+	/// The number of hosts checked against the blocklist.
+	/// </param>
+	/// <param name="blockedCount">
+	/// The number of hosts found on the blocklist.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_get_hostname_blocklist_stats(
+		PVOID ptr,
+		uint32_t* entryCount,
+		uint64_t* checkedCount,
+		uint64_t* blockedCount
+		);
+
+	/// <summary>
+	/// Loads a complete filtering configuration in the background and, if every part of it loads,
+	/// puts it into effect in one step, replacing the current configuration as a whole. Anything
+	/// left empty is absent from the new configuration, rather than carried over. Connections are
+	/// never held up while this happens, and every decision is made against either the old
+	/// configuration or the new one, never a mix of both. The old configuration is released once
+	/// the last connection using it is done with it. If any part fails to load, the current
+	/// configuration stays in effect. Loads are carried out in the order they're requested. May
+	/// be called at any time, including while the Engine is running.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="rules">
+	/// Adblock Plus formatted network rules, one per line, as for fe_ctl_load_rules. May be
+	/// nullptr.
+	/// </param>
+	/// <param name="rulesLength">
+	/// The length of the rules, in bytes.
+	/// </param>
+	/// <param name="blocklistPath">
+	/// The path to a file built by fe_ctl_build_hostname_blocklist. May be nullptr.
+	/// </param>
+	/// <param name="blocklistPathLength">
+	/// The length of the blocklist path.
+	/// </param>
+	/// <param name="bypassHosts">
+	/// Hosts that aren't to be filtered at all, one per line, each covering its subdomains too.
+	/// TLS connections to them are passed through without being intercepted, and requests to
+	/// them skip every check, including the message callbacks. May be nullptr.
+	/// </param>
+	/// <param name="bypassHostsLength">
+	/// The length of the bypass hosts, in bytes.
+	/// </param>
+	/// <param name="preservedEncodingHosts">
+	/// Hosts whose requests keep the Accept-Encoding the client sent, in the same format as
+	/// bypassHosts. Requests to any other host have Accept-Encoding narrowed to gzip and deflate,
+	/// which the Engine can decompress for inspection, unless the request was allowed without
+	/// inspection of its response. Responses from these hosts that come back in a coding the
+	/// Engine can't decompress, such as br, are streamed to the client rather than inspected.
+	/// Meant for origins where bandwidth matters more than inspection. May be nullptr.
+	/// </param>
+	/// <param name="preservedEncodingHostsLength">
+	/// The length of the preserved encoding hosts, in bytes.
+	/// </param>
+	/// <param name="inspectionPolicy">
+	/// The response inspection policy table, as for fe_ctl_set_inspection_policy. May be
+	/// nullptr.
+	/// </param>
+	/// <param name="inspectionPolicyLength">
+	/// The length of the inspection policy table, in bytes.
+	/// </param>
+	/// <param name="verdictTimeoutMilliseconds">
+	/// How long to wait on a pending asynchronous verdict before applying the default. See
+	/// fe_ctl_set_async_verdict_callbacks.
+	/// </param>
+	/// <param name="defaultBeginAction">
+	/// The nextAction applied when a pending message begin verdict times out.
+	/// </param>
+	/// <param name="defaultEndShouldBlock">
+	/// Whether or not to block when a pending message end verdict times out.
+	/// </param>
+	/// <param name="onLoaded">
+	/// Called once the configuration has been put into effect or has failed to load. May be
+	/// nullptr.
+	/// </param>
+	/// <param name="context">
+	/// Passed back to onLoaded, untouched.
+	/// </param>
+	/// <returns>
+	/// True if the load was queued, false otherwise. The outcome of the load itself is only
+	/// reported through onLoaded.
+	/// </returns>
+	extern HTTP_FILTERING_ENGINE_API const bool fe_ctl_load_filter_configuration(
+		PVOID ptr,
+		const char* rules,
+		uint32_t rulesLength,
+		const char* blocklistPath,
+		uint32_t blocklistPathLength,
+		const char* bypassHosts,
+		uint32_t bypassHostsLength,
+		const char* preservedEncodingHosts,
+		uint32_t preservedEncodingHostsLength,
+		const char* inspectionPolicy,
+		uint32_t inspectionPolicyLength,
+		uint32_t verdictTimeoutMilliseconds,
+		uint32_t defaultBeginAction,
+		bool defaultEndShouldBlock,
+		FilterConfigurationLoadedCallback onLoaded,
+		void* context
+		);
+
+	/// <summary>
+	/// Gets the filtering configuration counters. Any of the out parameters may be nullptr if the
+	/// caller isn't interested in it.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="generation">
+	/// Identifies the configuration presently in effect. Changes whenever any part of the
+	/// configuration changes, including through fe_ctl_load_rules and the like.
+	/// </param>
+	/// <param name="publishedCount">
+	/// The number of configurations that have been put into effect since the Engine instance was
+	/// created.
+	/// </param>
+	/// <param name="bypassedCount">
+	/// The number of connections and requests passed through because their host is on the bypass
+	/// list.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_get_filter_configuration_stats(
+		PVOID ptr,
+		uint64_t* generation,
+		uint64_t* publishedCount,
+		uint64_t* bypassedCount
+		);
+
+	/// <summary>
+	/// Sets the policy that decides how much of a response flagged for inspection is held back
+	/// before the message end callback sees it, going by the Content-Type and Content-Length of
+	/// the response. Without a policy, such responses are buffered in full before any of them
+	/// reaches the client. A policy may instead have them streamed without being inspected, or
+	/// have only their first bytes held and inspected, after which the rest is streamed. When
+	/// only the first bytes are inspected, the message end callback is handed just those bytes,
+	/// less any chunked framing but still compressed if they were sent compressed, and
+	/// HttpMessageFlagResponseBodyTruncated is set on
+	/// the message. Nothing of the response has reached the client at that point, so blocking
+	/// works just as it does for a response buffered in full.
+	///
+	/// The table has one entry per line, each of the form "type [>length] [&lt;length] action",
+	/// where type is a MIME type, a wildcard subtype such as "video/*", or "*" for anything,
+	/// the optional conditions restrict the entry by Content-Length, and action is "inspect",
+	/// "stream" or "sample:N" to inspect the first N bytes. A response of unknown length is
+	/// taken to be longer than any length. The first entry that matches decides, and a
+	/// response no entry matches is buffered in full. Blank lines and lines starting with '#'
+	/// are ignored. For example:
+	///
+	///     text/html inspect
+	///     image/* &lt;65536 inspect
+	///     video/* stream
+	///     * >1048576 sample:16384
+	///
+	/// Any policy set before is replaced. May be called at any time, including while the Engine
+	/// is running.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="policy">
+	/// The policy table.
+	/// </param>
+	/// <param name="policyLength">
+	/// The length of the policy table, in bytes.
+	/// </param>
+	/// <param name="entryCount">
+	/// The number of entries that were loaded. May be nullptr.
+	/// </param>
+	/// <param name="failedCount">
+	/// The number of lines that were malformed, and were skipped. May be nullptr.
+	/// </param>
+	/// <returns>
+	/// True if the policy was compiled and swapped in, false otherwise.
+	/// </returns>
+	extern HTTP_FILTERING_ENGINE_API const bool fe_ctl_set_inspection_policy(PVOID ptr, const char* policy, uint32_t policyLength, uint32_t* entryCount, uint32_t* failedCount);
+
+	/// <summary>
+	/// Discards the response inspection policy, so that every response flagged for inspection
+	/// is once again buffered in full.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_clear_inspection_policy(PVOID ptr);
+
+	/// <summary>
+	/// Gets the counters of one entry of the response inspection policy presently in effect.
+	/// Counts are kept from the time the policy was set. Any of the out parameters may be
+	/// nullptr if the caller isn't interested in it.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="entry">
+	/// The index of the entry, in the order the entries were loaded. The index one past the
+	/// last entry refers to responses no entry matched.
+	/// </param>
+	/// <param name="responseCount">
+	/// The number of responses the entry decided.
+	/// </param>
+	/// <param name="bufferedBytes">
+	/// The number of payload bytes held back for inspection.
+	/// </param>
+	/// <param name="streamedBytes">
+	/// The number of payload bytes passed to the client without being held back.
+	/// </param>
+	/// <returns>
+	/// True if a policy is in effect and has such an entry, false otherwise.
+	/// </returns>
+	extern HTTP_FILTERING_ENGINE_API const bool fe_ctl_get_inspection_policy_stats(
+		PVOID ptr,
+		uint32_t entry,
+		uint64_t* responseCount,
+		uint64_t* bufferedBytes,
+		uint64_t* streamedBytes
+		);
+
+	/// <summary>
+	/// Sets how responses that were decompressed for inspection are encoded on their way back to
+	/// the client. A response consumed in full for inspection is decompressed, so that the message
+	/// end callback sees its real content, and by default it's then sent to the client
+	/// uncompressed. It can instead be compressed again. Rather than compressing the whole
+	/// payload before sending any of it, it's compressed a slice at a time as it's written, and
+	/// sent chunked, so that the first bytes go out as soon as the first slice is ready.
+	///
+	/// The modes are:
+	///
+	///     0 - Uncompressed, whenever the client allows it. The default.
+	///     1 - Compressed with whichever of gzip and deflate the client's Accept-Encoding
+	///         prefers.
+	///     2 - Compressed with gzip, if the client accepts it.
+	///     3 - Compressed with deflate, if the client accepts it.
+	///
+	/// Whatever the mode, a client that refuses identity gets a coding it does accept, and one
+	/// that accepts neither gzip nor deflate gets the payload uncompressed. HTTP/1.0 clients, and
+	/// payloads under a kilobyte, are always sent uncompressed. May be called at any time,
+	/// including while the Engine is running.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="mode">
+	/// One of the modes above. Unknown values are taken to mean 0.
+	/// </param>
+	/// <param name="level">
+	/// The compression level, from 1, the fastest and the default, to 9, the smallest.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_set_recompression(PVOID ptr, uint32_t mode, int32_t level);
+
+	/// <summary>
+	/// Gets the recompression counters. Counts are kept from the time the Engine instance was
+	/// created. Any of the out parameters may be nullptr if the caller isn't interested in it.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="identityCount">
+	/// The number of decompressed responses sent to the client uncompressed.
+	/// </param>
+	/// <param name="recompressedCount">
+	/// The number of decompressed responses compressed again.
+	/// </param>
+	/// <param name="inputBytes">
+	/// The total size of the responses compressed again, before compression.
+	/// </param>
+	/// <param name="outputBytes">
+	/// The total size of the responses compressed again, after compression.
+	/// </param>
+	/// <param name="nanoseconds">
+	/// The total time spent compressing. Together with inputBytes, gives the cost per megabyte.
+	/// </param>
+	/// <param name="firstSliceNanoseconds">
+	/// The total time spent preparing the first write of each response compressed again, which
+	/// is how long compressing held up its first byte.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_get_recompression_stats(
+		PVOID ptr,
+		uint64_t* identityCount,
+		uint64_t* recompressedCount,
+		uint64_t* inputBytes,
+		uint64_t* outputBytes,
+		uint64_t* nanoseconds,
+		uint64_t* firstSliceNanoseconds
+		);
+
+	/// <summary>
+	/// Sets how much memory the Engine may use to store responses, so that the next client to
+	/// ask for the same thing is served the stored response without the request going to the
+	/// server, and without the response being put before the message callbacks again. Requests
+	/// are still filtered as usual before the cache is consulted. Caching follows the rules for a
+	/// shared cache in RFC 7234: responses marked no-store or private, responses that set
+	/// cookies, and responses to requests carrying credentials or cookies, unless the response
+	/// is explicitly public, are never stored, and stored responses are revalidated with the
+	/// server once they're no longer fresh. Only complete, uncompressed GET responses of a known
+	/// length are stored, which are mostly those inspected in full, as they were written to the
+	/// client. Responses stored under an earlier filtering configuration aren't served. The cache
+	/// is disabled by default. May be called at any time. Lowering the budget evicts whatever no
+	/// longer fits, and zero flushes anything already stored.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="maxBytes">
+	/// The memory budget, in bytes. Supply zero to disable the cache.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_set_response_cache_capacity(PVOID ptr, uint64_t maxBytes);
+
+	/// <summary>
+	/// Discards every stored response. Call this whenever whatever responses are decided on with
+	/// has changed.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_flush_response_cache(PVOID ptr);
+
+	/// <summary>
+	/// Gets the response cache counters. Counts are kept from the time the Engine instance was
+	/// created. Any of the out parameters may be nullptr if the caller isn't interested in it.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="entryCount">
+	/// The number of responses presently stored.
+	/// </param>
+	/// <param name="usedBytes">
+	/// The memory presently used by stored responses, in bytes.
+	/// </param>
+	/// <param name="hitCount">
+	/// The number of requests answered from the cache without contacting the server.
+	/// </param>
+	/// <param name="notModifiedCount">
+	/// Of those, the number answered with 304 Not Modified, because the client already had the
+	/// stored response.
+	/// </param>
+	/// <param name="staleCount">
+	/// The number of requests sent to the server to revalidate a stored response.
+	/// </param>
+	/// <param name="revalidatedCount">
+	/// Of those, the number the server confirmed, which were answered from the cache.
+	/// </param>
+	/// <param name="missCount">
+	/// The number of cacheable requests nothing was stored for.
+	/// </param>
+	/// <param name="storeCount">
+	/// The number of responses stored.
+	/// </param>
+	/// <param name="evictionCount">
+	/// The number of stored responses evicted to make room.
+	/// </param>
+	/// <param name="servedBytes">
+	/// The number of payload bytes served from the cache, which is how much wasn't fetched from
+	/// servers.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_get_response_cache_stats(
+		PVOID ptr,
+		uint32_t* entryCount,
+		uint64_t* usedBytes,
+		uint64_t* hitCount,
+		uint64_t* notModifiedCount,
+		uint64_t* staleCount,
+		uint64_t* revalidatedCount,
+		uint64_t* missCount,
+		uint64_t* storeCount,
+		uint64_t* evictionCount,
+		uint64_t* servedBytes
+		);
+
+	/// <summary>
+	/// Registers a block page under an ID. A message callback blocking a transaction can then
+	/// write a reference to the page as its custom block response, see HTTP_BLOCK_PAGE_REFERENCE,
+	/// instead of writing the whole page out every time. Every transaction blocked with the page
+	/// shares the one copy registered here. Any page already registered under the ID is replaced,
+	/// and blocks referring to it get the new page from then on, including blocks decided by the
+	/// verdict caches. May be called at any time.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="pageId">
+	/// The ID references are to refer to the page by.
+	/// </param>
+	/// <param name="page">
+	/// The complete response to write to the client, status line, headers and payload, exactly
+	/// as for a custom block response. Supply nullptr to remove the page.
+	/// </param>
+	/// <param name="pageLength">
+	/// The length of the response, in bytes.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_register_block_page(PVOID ptr, uint32_t pageId, const char* page, uint32_t pageLength);
+
+	/// <summary>
+	/// Removes every registered block page. References to them are answered with the usual 204
+	/// from then on.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_clear_block_pages(PVOID ptr);
+
+	/// <summary>
+	/// Gets the block page counters. Counts are kept from the time the Engine instance was
+	/// created. Any of the out parameters may be nullptr if the caller isn't interested in it.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="pageCount">
+	/// The number of block pages presently registered.
+	/// </param>
+	/// <param name="hitCount">
+	/// The number of blocks answered with a registered page.
+	/// </param>
+	/// <param name="missCount">
+	/// The number of blocks that referred to a page that wasn't registered.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_get_block_page_stats(
+		PVOID ptr,
+		uint32_t* pageCount,
+		uint64_t* hitCount,
+		uint64_t* missCount
+		);
+
+	/// <summary>
+	/// Sets whether requests a client has pipelined, sending the next before it has the response
+	/// to the last, may be written to the server along with the request before them. Pipelined
+	/// requests are always handled, in order, and their responses matched to them in the same
+	/// order. With coalescing disabled, the default, each is written to the server only once the
+	/// response before it has been written to the client. With it enabled, complete GET requests
+	/// for the same host go out together when each already has a verdict that neither blocks it
+	/// nor has it inspected: its host is bypassed, or the verdict cache allows it and neither the
+	/// blocklist nor the native rules block it. Requests that would be put before a callback always
+	/// wait their turn, so that none reaches the server before its verdict. May be called at any
+	/// time.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="enabled">
+	/// Whether pipelined requests may be coalesced.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_set_pipeline_coalescing(PVOID ptr, bool enabled);
+
+	/// <summary>
+	/// Gets the pipelining counters. Counts are kept from the time the Engine instance was
+	/// created. Any of the out parameters may be nullptr if the caller isn't interested in it.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="pipelinedCount">
+	/// The number of requests taken from what a client sent along with the request before them.
+	/// </param>
+	/// <param name="coalescedCount">
+	/// The number of those that were written to the server along with the request before them.
+	/// </param>
+	extern HTTP_FILTERING_ENGINE_API void fe_ctl_get_pipeline_stats(PVOID ptr, uint64_t* pipelinedCount, uint64_t* coalescedCount);
+
 #ifdef __cplusplus
 };
 #endif // __cplusplus
\ No newline at end of file
@@ -64,6 +64,8 @@ namespace te
 			uint32_t proxyNumThreads,
 			util::cb::HttpMessageBeginCheckFunction onMessageBegin,
 			util::cb::HttpMessageEndCheckFunction onMessageEnd,
+			util::cb::HttpMessageBeginViewFunction onMessageBeginView,
+			util::cb::HttpMessageEndViewFunction onMessageEndView,
 			util::cb::MessageFunction onInfo,
 			util::cb::MessageFunction onWarn,
 			util::cb::MessageFunction onError
@@ -77,8 +79,16 @@ namespace te
 			m_proxyNumThreads(proxyNumThreads),
 			m_isRunning(false),
 			m_onMessageBegin(onMessageBegin),
-			m_onMessageEnd(onMessageEnd)
+			m_onMessageEnd(onMessageEnd),
+			m_onMessageBeginView(onMessageBeginView),
+			m_onMessageEndView(onMessageEndView)
 		{
+			m_flowControl.reset(new network::FlowControl());
+			m_admissionControl.reset(new network::AdmissionControl());
+			m_verdictControl.reset(new network::VerdictControl());
+			m_httpAcceptControl.reset(new network::AcceptControl());
+			m_httpsAcceptControl.reset(new network::AcceptControl());
+
 			if (m_store == nullptr)
 			{
 				// XXX TODO - Make a factory for cert store so we don't have this horrible mess everywhere.
@@ -98,17 +108,34 @@ namespace te
 
 			if (!m_onMessageBegin)
 			{
-				m_onMessageBegin = std::bind(&HttpFilteringEngineControl::DummyOnMessageBeginCallback, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6, std::placeholders::_7, std::placeholders::_8, std::placeholders::_9, std::placeholders::_10);
+				m_onMessageBegin = std::bind(&HttpFilteringEngineControl::DummyOnMessageBeginCallback, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6, std::placeholders::_7, std::placeholders::_8, std::placeholders::_9, std::placeholders::_10, std::placeholders::_11);
 			}
 
 			if (!m_onMessageEnd)
 			{
-				m_onMessageEnd = std::bind(&HttpFilteringEngineControl::DummyOnMessageEndCallback, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6, std::placeholders::_7, std::placeholders::_8, std::placeholders::_9, std::placeholders::_10);
+				m_onMessageEnd = std::bind(&HttpFilteringEngineControl::DummyOnMessageEndCallback, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6, std::placeholders::_7, std::placeholders::_8, std::placeholders::_9, std::placeholders::_10, std::placeholders::_11);
 			}
+
+			// Started last, since nothing stops it if construction fails.
+			m_configWork.reset(new boost::asio::io_service::work(m_configService));
+			m_configThread = std::thread([this]()
+			{
+				m_configService.run();
+			});
 		}
 
 		HttpFilteringEngineControl::~HttpFilteringEngineControl()
 		{
+			// Stop the configuration thread first. A load that's under way is finished, but
+			// any that haven't started yet are dropped, along with their callbacks.
+			m_configWork.reset();
+			m_configService.stop();
+
+			if (m_configThread.joinable())
+			{
+				m_configThread.join();
+			}
+
 			// Cleanup any installed certs HERE.
 			if (m_store != nullptr)
 			{
@@ -144,8 +171,14 @@ namespace te
 						m_httpListenerPort,
 						m_caBundleAbsolutePath,
 						nullptr,
+						m_flowControl.get(),
+						m_admissionControl.get(),
+						m_httpAcceptControl.get(),
+						m_verdictControl.get(),
 						m_onMessageBegin,
 						m_onMessageEnd,
+						m_onMessageBeginView,
+						m_onMessageEndView,
 						m_onInfo,
 						m_onWarning,
 						m_onError
@@ -162,8 +195,14 @@ namespace te
 						m_httpsListenerPort,
 						m_caBundleAbsolutePath,
 						m_store.get(),
+						m_flowControl.get(),
+						m_admissionControl.get(),
+						m_httpsAcceptControl.get(),
+						m_verdictControl.get(),
 						m_onMessageBegin,
 						m_onMessageEnd,
+						m_onMessageBeginView,
+						m_onMessageEndView,
 						m_onInfo,
 						m_onWarning,
 						m_onError
@@ -217,6 +256,9 @@ namespace te
 
 				m_proxyServiceThreads.clear();
 
+				// Nothing is going to resume the bridges still waiting on a verdict now.
+				m_verdictControl->WithdrawAll();
+
 				m_isRunning = false;
 			}
 		}
@@ -256,10 +298,276 @@ namespace te
 			return{};
 		}
 
+		void HttpFilteringEngineControl::SetFlowControl(const uint32_t maxBridgeInFlightBytes, const uint64_t maxGlobalInFlightBytes)
+		{
+			m_flowControl->SetMaxBridgeInFlightBytes(maxBridgeInFlightBytes);
+			m_flowControl->SetMaxGlobalInFlightBytes(maxGlobalInFlightBytes);
+		}
+
+		void HttpFilteringEngineControl::SetAdmissionControl(
+			const uint32_t maxActiveBridges,
+			const uint32_t maxPendingHandshakes,
+			const uint32_t maxPendingSpoofs,
+			const bool deferWhenFull,
+			const bool tunnelWhenOverloaded
+			)
+		{
+			m_admissionControl->Configure(maxActiveBridges, maxPendingHandshakes, maxPendingSpoofs, deferWhenFull, tunnelWhenOverloaded);
+		}
+
+		const network::AdmissionControl& HttpFilteringEngineControl::GetAdmissionControl() const
+		{
+			return *m_admissionControl;
+		}
+
+		void HttpFilteringEngineControl::SetAcceptOptions(const uint32_t outstandingAccepts, const uint32_t maxAcceptsPerWakeup, const uint32_t listenBacklog)
+		{
+			m_httpAcceptControl->Configure(outstandingAccepts, maxAcceptsPerWakeup, listenBacklog);
+			m_httpsAcceptControl->Configure(outstandingAccepts, maxAcceptsPerWakeup, listenBacklog);
+		}
+
+		const network::AcceptControl& HttpFilteringEngineControl::GetAcceptControl(const bool secure) const
+		{
+			return secure ? *m_httpsAcceptControl : *m_httpAcceptControl;
+		}
+
+		const bool HttpFilteringEngineControl::SetAsyncVerdictCallbacks(
+			util::cb::HttpMessageBeginAsyncFunction onMessageBegin,
+			util::cb::HttpMessageEndAsyncFunction onMessageEnd,
+			const uint32_t timeoutMilliseconds,
+			const uint32_t defaultBeginAction,
+			const bool defaultEndShouldBlock
+			)
+		{
+			std::lock_guard<std::mutex> lock(m_ctlMutex);
+
+			if (m_isRunning)
+			{
+				ReportWarning(u8"In HttpFilteringEngineControl::SetAsyncVerdictCallbacks(...) - Cannot change verdict callbacks while the Engine is running.");
+				return false;
+			}
+
+			m_verdictControl->Configure(onMessageBegin, onMessageEnd, timeoutMilliseconds, defaultBeginAction, defaultEndShouldBlock);
+
+			return true;
+		}
+
+		const bool HttpFilteringEngineControl::CompleteVerdict(const uint64_t verdictToken, const uint32_t verdict, const uint32_t responseSampleBytes, const char* customResponse, const uint32_t customResponseLength)
+		{
+			return m_verdictControl->Complete(verdictToken, verdict, responseSampleBytes, customResponse, customResponseLength);
+		}
+
+		const network::VerdictControl& HttpFilteringEngineControl::GetVerdictControl() const
+		{
+			return *m_verdictControl;
+		}
+
+		void HttpFilteringEngineControl::SetVerdictCacheCapacity(const uint32_t maxEntries)
+		{
+			m_verdictControl->GetCache().SetMaxEntries(maxEntries);
+		}
+
+		void HttpFilteringEngineControl::FlushVerdictCache()
+		{
+			m_verdictControl->GetCache().Flush();
+		}
+
+		void HttpFilteringEngineControl::SetContentVerdictCacheCapacity(const uint32_t maxEntries)
+		{
+			m_verdictControl->GetContentCache().SetMaxEntries(maxEntries);
+		}
+
+		void HttpFilteringEngineControl::FlushContentVerdictCache()
+		{
+			m_verdictControl->GetContentCache().Flush();
+		}
+
+		void HttpFilteringEngineControl::SetRecompression(const uint32_t mode, const int32_t level)
+		{
+			m_verdictControl->GetRecompression().Configure(static_cast<network::RecompressionControl::Mode>(mode), level);
+		}
+
+		void HttpFilteringEngineControl::SetResponseCacheCapacity(const uint64_t maxBytes)
+		{
+			m_verdictControl->GetResponseCache().SetMaxBytes(maxBytes);
+		}
+
+		void HttpFilteringEngineControl::FlushResponseCache()
+		{
+			m_verdictControl->GetResponseCache().Flush();
+		}
+
+		void HttpFilteringEngineControl::RegisterBlockPage(const uint32_t pageId, const char* page, const uint32_t pageLength)
+		{
+			m_verdictControl->GetBlockResponses().RegisterPage(pageId, page, pageLength);
+		}
+
+		void HttpFilteringEngineControl::ClearBlockPages()
+		{
+			m_verdictControl->GetBlockResponses().ClearPages();
+		}
+
+		void HttpFilteringEngineControl::SetPipelineCoalescing(const bool enabled)
+		{
+			m_verdictControl->SetPipelineCoalescing(enabled);
+		}
+
+		void HttpFilteringEngineControl::LoadRules(const char* rules, const uint32_t rulesLength, uint32_t& loadedCount, uint32_t& failedCount)
+		{
+			// Compiled before the swap, so bridges carry on with the old rules meanwhile.
+			auto compiled = std::make_shared<const filtering::RuleMatcher>(rules, rulesLength);
+
+			loadedCount = compiled->GetRuleCount();
+			failedCount = compiled->GetFailedCount();
+
+			m_verdictControl->SetRules(std::move(compiled));
+
+			if (failedCount > 0)
+			{
+				ReportWarning(u8"In HttpFilteringEngineControl::LoadRules(...) - " + std::to_string(failedCount) + u8" rules were malformed or unsupported, and were skipped.");
+			}
+		}
+
+		void HttpFilteringEngineControl::ClearRules()
+		{
+			m_verdictControl->SetRules(nullptr);
+		}
+
+		const uint32_t HttpFilteringEngineControl::BuildHostnameBlocklist(const char* hostnames, const uint32_t hostnamesLength, const std::string& outputPath)
+		{
+			return filtering::HostnameSet::Build(hostnames, hostnamesLength, outputPath);
+		}
+
+		const uint32_t HttpFilteringEngineControl::LoadHostnameBlocklist(const std::string& path)
+		{
+			// Mapped before the swap, so bridges carry on with the old blocklist meanwhile. The
+			// old mapping is released once the last bridge using it lets go.
+			auto blocklist = std::make_shared<const filtering::HostnameSet>(path);
+			const uint32_t entryCount = blocklist->GetEntryCount();
+
+			m_verdictControl->SetBlocklist(std::move(blocklist));
+
+			return entryCount;
+		}
+
+		void HttpFilteringEngineControl::ClearHostnameBlocklist()
+		{
+			m_verdictControl->SetBlocklist(nullptr);
+		}
+
+		void HttpFilteringEngineControl::SetInspectionPolicy(const char* policy, const uint32_t policyLength, uint32_t& entryCount, uint32_t& failedCount)
+		{
+			auto compiled = std::make_shared<const filtering::InspectionPolicy>(policy, static_cast<size_t>(policyLength));
+
+			entryCount = compiled->GetEntryCount();
+			failedCount = compiled->GetFailedCount();
+
+			m_verdictControl->SetInspectionPolicy(std::move(compiled));
+
+			if (failedCount > 0)
+			{
+				ReportWarning(u8"In HttpFilteringEngineControl::SetInspectionPolicy(...) - " + std::to_string(failedCount) + u8" policy lines were malformed, and were skipped.");
+			}
+		}
+
+		void HttpFilteringEngineControl::ClearInspectionPolicy()
+		{
+			m_verdictControl->SetInspectionPolicy(nullptr);
+		}
+
+		void HttpFilteringEngineControl::LoadFilterConfigurationAsync(
+			std::string rules,
+			std::string blocklistPath,
+			std::string bypassHosts,
+			std::string preservedEncodingHosts,
+			std::string inspectionPolicy,
+			const uint32_t verdictTimeoutMilliseconds,
+			const uint32_t defaultBeginAction,
+			const bool defaultEndShouldBlock,
+			util::cb::FilterConfigurationLoadedFunction onLoaded
+			)
+		{
+			m_configService.post(
+				[this, rules = std::move(rules), blocklistPath = std::move(blocklistPath), bypassHosts = std::move(bypassHosts),
+				preservedEncodingHosts = std::move(preservedEncodingHosts), inspectionPolicy = std::move(inspectionPolicy), verdictTimeoutMilliseconds, defaultBeginAction, defaultEndShouldBlock, onLoaded = std::move(onLoaded)]()
+			{
+				bool success = false;
+				uint64_t generation = 0;
+				uint32_t ruleCount = 0;
+				uint32_t failedRuleCount = 0;
+				uint32_t blocklistEntryCount = 0;
+
+				try
+				{
+					// Built entirely off to the side. Bridges carry on with the current snapshot
+					// until the new one is published, and with whichever one they already hold
+					// after that.
+					auto snapshot = std::make_shared<filtering::FilterSnapshot>();
+
+					snapshot->bypassHosts = filtering::FilterSnapshot::CompileHostList(bypassHosts.c_str(), bypassHosts.size());
+					snapshot->preservedEncodingHosts = filtering::FilterSnapshot::CompileHostList(preservedEncodingHosts.c_str(), preservedEncodingHosts.size());
+
+					if (!rules.empty())
+					{
+						auto compiled = std::make_shared<const filtering::RuleMatcher>(rules.c_str(), rules.size());
+
+						ruleCount = compiled->GetRuleCount();
+						failedRuleCount = compiled->GetFailedCount();
+
+						snapshot->rules = std::move(compiled);
+					}
+
+					if (!blocklistPath.empty())
+					{
+						auto blocklist = std::make_shared<const filtering::HostnameSet>(blocklistPath);
+
+						blocklistEntryCount = blocklist->GetEntryCount();
+
+						snapshot->blocklist = std::move(blocklist);
+					}
+
+					if (!inspectionPolicy.empty())
+					{
+						auto policy = std::make_shared<const filtering::InspectionPolicy>(inspectionPolicy.c_str(), inspectionPolicy.size());
+
+						if (policy->GetFailedCount() > 0)
+						{
+							ReportWarning(u8"In HttpFilteringEngineControl::LoadFilterConfigurationAsync(...) - " + std::to_string(policy->GetFailedCount()) + u8" policy lines were malformed, and were skipped.");
+						}
+
+						snapshot->inspectionPolicy = std::move(policy);
+					}
+
+					snapshot->verdictTimeoutMilliseconds = verdictTimeoutMilliseconds;
+					snapshot->defaultBeginAction = defaultBeginAction;
+					snapshot->defaultEndShouldBlock = defaultEndShouldBlock;
+
+					generation = m_verdictControl->Publish(std::move(snapshot));
+					success = true;
+
+					if (failedRuleCount > 0)
+					{
+						ReportWarning(u8"In HttpFilteringEngineControl::LoadFilterConfigurationAsync(...) - " + std::to_string(failedRuleCount) + u8" rules were malformed or unsupported, and were skipped.");
+					}
+				}
+				catch (std::exception& e)
+				{
+					std::string errMessage(u8"In HttpFilteringEngineControl::LoadFilterConfigurationAsync(...) - The configuration was not loaded, and the current one was kept. Got error:\t");
+					errMessage.append(e.what());
+					ReportError(errMessage);
+				}
+
+				if (onLoaded)
+				{
+					onLoaded(success, generation, ruleCount, failedRuleCount, blocklistEntryCount);
+				}
+			});
+		}
+
 		void HttpFilteringEngineControl::DummyOnMessageBeginCallback(
 			const char* requestHeaders, const uint32_t requestHeadersLength, const char* requestBody, const uint32_t requestBodyLength,
 			const char* responseHeaders, const uint32_t responseHeadersLength, const char* responseBody, const uint32_t responseBodyLength,
-			uint32_t* nextAction, CustomResponseStreamWriter responseWriter
+			uint32_t* nextAction, CustomResponseStreamWriterV2 responseWriter, void* writerContext
 		)
 		{
 			// Do nothing, say nothing, tell no one.
@@ -268,7 +576,7 @@ namespace te
 		void HttpFilteringEngineControl::DummyOnMessageEndCallback(
 			const char* requestHeaders, const uint32_t requestHeadersLength, const char* requestBody, const uint32_t requestBodyLength,
 			const char* responseHeaders, const uint32_t responseHeadersLength, const char* responseBody, const uint32_t responseBodyLength,
-			bool* shouldBlock, CustomResponseStreamWriter responseWriter
+			bool* shouldBlock, CustomResponseStreamWriterV2 responseWriter, void* writerContext
 		)
 		{
 			// Do nothing, say nothing, tell no one.
@@ -16,6 +16,10 @@
 
 #include "util/cb/EventReporter.hpp"
 #include "mitm/secure/TlsCapableHttpAcceptor.hpp"
+#include "network/FlowControl.hpp"
+#include "network/AdmissionControl.hpp"
+#include "network/VerdictControl.hpp"
+#include "network/AcceptControl.hpp"
 
 namespace te
 {
@@ -84,10 +88,22 @@ namespace te
 			/// threads that execute the filtering functionality.
 			/// </param>
 			/// <param name="onMessageBegin">
-			/// Called when a new HTTP transaction starts, with, at-minimum headers, complete.
+			/// Called when a new HTTP transaction starts, with, at-minimum headers, complete. This
+			/// takes the context carrying V2 form. Callbacks in the original form can be adapted with
+			/// util::cb::AdaptLegacyCallback(...).
 			/// </param>
 			/// <param name="onMessageEnd">
 			/// Called when a HTTP transaction that was flagged for content inspection has completed.
+			/// This takes the context carrying V2 form. Callbacks in the original form can be adapted
+			/// with util::cb::AdaptLegacyCallback(...).
+			/// </param>
+			/// <param name="onMessageBeginView">
+			/// The view form of onMessageBegin. Optional. If supplied, this and onMessageEndView
+			/// are called instead of onMessageBegin and onMessageEnd, with views pointing into each
+			/// transaction's own storage, rather than with freshly formatted header strings.
+			/// </param>
+			/// <param name="onMessageEndView">
+			/// The view form of onMessageEnd. Optional. See onMessageBeginView.
 			/// </param>
 			/// <param name="onInfo">
 			/// A function that can accept string informational data generated by the underlying
@@ -108,7 +124,9 @@ namespace te
 				uint16_t httpsListenerPort = 0,
 				uint32_t proxyNumThreads = std::thread::hardware_concurrency(),
 				util::cb::HttpMessageBeginCheckFunction onMessageBegin = nullptr,
-				util::cb::HttpMessageEndCheckFunction onMessageEnd = nullptr,
+util::cb::HttpMessageEndCheckFunction onMessageEnd = nullptr,
+				util::cb::HttpMessageBeginViewFunction onMessageBeginView = nullptr,
+				util::cb::HttpMessageEndViewFunction onMessageEndView = nullptr,
 				util::cb::MessageFunction onInfo = nullptr,
 				util::cb::MessageFunction onWarn = nullptr,
 				util::cb::MessageFunction onError = nullptr
@@ -176,6 +194,414 @@ namespace te
 			/// </returns>
 			std::vector<char> GetRootCertificatePEM() const;
 
+			/// <summary>
+			/// Configures how much data may be held in memory while being streamed through the
+			/// Engine. Every bridge bounds the streaming reads it has outstanding, in both
+			/// directions combined, to the per-bridge limit, and must reserve those bytes against
+			/// the global limit before reading. When the global limit is exhausted, bridges pause
+			/// reading from their peers until enough data has been written out the other side.
+			/// Payloads that have been flagged for inspection are not subject to these limits. May
+			/// be called at any time, changes take effect on the next read each bridge issues.
+			/// </summary>
+			/// <param name="maxBridgeInFlightBytes">
+			/// The maximum number of bytes a single bridge may have in flight, in both directions
+			/// combined. The default is network::FlowControl::DefaultMaxBridgeInFlightBytes.
+			/// </param>
+			/// <param name="maxGlobalInFlightBytes">
+			/// The maximum number of bytes that may be in flight across all bridges combined.
+			/// Zero, the default, means no global limit.
+			/// </param>
+			void SetFlowControl(const uint32_t maxBridgeInFlightBytes, const uint64_t maxGlobalInFlightBytes);
+
+			/// <summary>
+			/// Configures how much new work the Engine will take on at once, and what happens to
+			/// work that doesn't fit. This keeps latency bounded for existing connections when
+			/// there's a storm of new ones. May be called at any time. See
+			/// network::AdmissionControl.
+			/// </summary>
+			/// <param name="maxActiveBridges">
+			/// The maximum number of client connections that may be serviced at once. Zero means
+			/// no limit, which is the default.
+			/// </param>
+			/// <param name="maxPendingHandshakes">
+			/// The maximum number of TLS connections that may be handshaking at once. Zero means
+			/// no limit, which is the default.
+			/// </param>
+			/// <param name="maxPendingSpoofs">
+			/// The maximum number of TLS connections that may be waiting on the certificate store
+			/// at once. Zero means no limit, which is the default.
+			/// </param>
+			/// <param name="deferWhenFull">
+			/// If true, new clients are left waiting in the listener backlog while the connection
+			/// limit is reached. If false, they are accepted and immediately reset.
+			/// </param>
+			/// <param name="tunnelWhenOverloaded">
+			/// If true, TLS connections refused by the handshake or spoof limit are tunnelled
+			/// straight through without filtering. If false, they are dropped.
+			/// </param>
+			void SetAdmissionControl(
+				const uint32_t maxActiveBridges,
+				const uint32_t maxPendingHandshakes,
+				const uint32_t maxPendingSpoofs,
+				const bool deferWhenFull,
+				const bool tunnelWhenOverloaded
+				);
+
+			/// <summary>
+			/// Gets the admission control shared by every bridge, for the purpose of reading its
+			/// gauges and counters.
+			/// </summary>
+			/// <returns>
+			/// The admission control shared by every bridge.
+			/// </returns>
+			const network::AdmissionControl& GetAdmissionControl() const;
+
+			/// <summary>
+			/// Configures the accept loop of both the HTTP and HTTPS listeners. Takes effect the
+			/// next time the Engine is started. See network::AcceptControl.
+			/// </summary>
+			/// <param name="outstandingAccepts">
+			/// The number of accepts each listener keeps outstanding at once. The default is
+			/// network::AcceptControl::DefaultOutstandingAccepts.
+			/// </param>
+			/// <param name="maxAcceptsPerWakeup">
+			/// The maximum number of waiting clients each listener picks up every time an accept
+			/// completes, including the one that completed. One disables draining. The default is
+			/// network::AcceptControl::DefaultMaxAcceptsPerWakeup.
+			/// </param>
+			/// <param name="listenBacklog">
+			/// The listen backlog to request. Zero, the default, means the platform maximum.
+			/// </param>
+			void SetAcceptOptions(const uint32_t outstandingAccepts, const uint32_t maxAcceptsPerWakeup, const uint32_t listenBacklog);
+
+			/// <summary>
+			/// Gets the accept control of either the HTTP or the HTTPS listener, for the purpose
+			/// of reading its instrumentation.
+			/// </summary>
+			/// <param name="secure">
+			/// True for the HTTPS listener, false for the HTTP listener.
+			/// </param>
+			/// <returns>
+			/// The accept control of the requested listener.
+			/// </returns>
+			const network::AcceptControl& GetAcceptControl(const bool secure) const;
+
+			/// <summary>
+			/// Supplies the asynchronous form of the message callbacks. When supplied, these are
+			/// called instead of the synchronous forms, and may answer later through
+			/// ::CompleteVerdict(...), so that a slow verdict doesn't hold up an io_service
+			/// thread, and with it every other connection being driven by that thread. May only
+			/// be called while the Engine is stopped. See network::VerdictControl.
+			/// </summary>
+			/// <param name="onMessageBegin">
+			/// The asynchronous form of the message begin callback. May be empty, in which case
+			/// the synchronous form is used.
+			/// </param>
+			/// <param name="onMessageEnd">
+			/// The asynchronous form of the message end callback. May be empty, in which case the
+			/// synchronous form is used.
+			/// </param>
+			/// <param name="timeoutMilliseconds">
+			/// How long to wait on a pending verdict before applying the default.
+			/// </param>
+			/// <param name="defaultBeginAction">
+			/// The nextAction applied when a pending message begin verdict times out.
+			/// </param>
+			/// <param name="defaultEndShouldBlock">
+			/// Whether or not to block when a pending message end verdict times out.
+			/// </param>
+			/// <returns>
+			/// True if the callbacks were set, false if the Engine is running.
+			/// </returns>
+			const bool SetAsyncVerdictCallbacks(
+				util::cb::HttpMessageBeginAsyncFunction onMessageBegin,
+				util::cb::HttpMessageEndAsyncFunction onMessageEnd,
+				const uint32_t timeoutMilliseconds,
+				const uint32_t defaultBeginAction,
+				const bool defaultEndShouldBlock
+				);
+
+			/// <summary>
+			/// Supplies a verdict that an asynchronous message callback left pending. May be
+			/// called from any thread.
+			/// </summary>
+			/// <param name="verdictToken">
+			/// The token that was supplied to the callback.
+			/// </param>
+			/// <param name="verdict">
+			/// For a message begin callback, the nextAction. For a message end callback, non-zero
+			/// to block the transaction.
+			/// </param>
+			/// <param name="responseSampleBytes">
+			/// For a message begin callback on a response, how many bytes of the payload to
+			/// inspect, or zero for all of it. Ignored otherwise.
+			/// </param>
+			/// <param name="customResponse">
+			/// Optional custom block response. May be nullptr.
+			/// </param>
+			/// <param name="customResponseLength">
+			/// The length of the custom block response.
+			/// </param>
+			/// <returns>
+			/// True if the connection was waiting on the verdict and has been resumed. False if
+			/// the verdict already timed out, or the connection has since been closed.
+			/// </returns>
+			const bool CompleteVerdict(const uint64_t verdictToken, const uint32_t verdict, const uint32_t responseSampleBytes, const char* customResponse, const uint32_t customResponseLength);
+
+			/// <summary>
+			/// Gets the verdict control shared by every bridge, for the purpose of reading its
+			/// counters.
+			/// </summary>
+			/// <returns>
+			/// The verdict control shared by every bridge.
+			/// </returns>
+			const network::VerdictControl& GetVerdictControl() const;
+
+			/// <summary>
+			/// Sets how many reusable message begin verdicts are kept. May be called at any time.
+			/// See network::VerdictCache.
+			/// </summary>
+			/// <param name="maxEntries">
+			/// The maximum number of cached verdicts. Zero disables the cache. The default is
+			/// network::VerdictCache::DefaultMaxEntries.
+			/// </param>
+			void SetVerdictCacheCapacity(const uint32_t maxEntries);
+
+			/// <summary>
+			/// Discards every cached verdict, so that every request is once again handed to the
+			/// message begin callback. To be called whenever the rules the consumer reaches its
+			/// verdicts with have changed. May be called at any time.
+			/// </summary>
+			void FlushVerdictCache();
+
+			/// <summary>
+			/// Sets how many message end verdicts are remembered by the content of the response
+			/// body they were reached for, so that the same body turning up again is decided
+			/// without calling out. May be called at any time. See network::ContentVerdictCache.
+			/// </summary>
+			/// <param name="maxEntries">
+			/// The maximum number of cached verdicts. Zero, the default, disables the cache.
+			/// </param>
+			void SetContentVerdictCacheCapacity(const uint32_t maxEntries);
+
+			/// <summary>
+			/// Discards every verdict remembered by response body content. To be called whenever
+			/// the classifier the consumer reaches its verdicts with has changed. May be called at
+			/// any time.
+			/// </summary>
+			void FlushContentVerdictCache();
+
+			/// <summary>
+			/// Sets how responses that were decompressed for inspection are encoded on their way
+			/// back to the client: uncompressed, as by default, or compressed again, a slice at a
+			/// time as they're written, with a coding the client accepts. May be called at any
+			/// time, and takes effect for responses written afterwards. See
+			/// network::RecompressionControl.
+			/// </summary>
+			/// <param name="mode">
+			/// A network::RecompressionControl::Mode value. Unknown values mean identity.
+			/// </param>
+			/// <param name="level">
+			/// The compression level, from one, the fastest, to nine, the smallest.
+			/// </param>
+			void SetRecompression(const uint32_t mode, const int32_t level);
+
+			/// <summary>
+			/// Sets how much memory the shared response cache may use, which clients are served
+			/// stored responses from without going to the server. May be called at any time. See
+			/// mitm::http::ResponseCache.
+			/// </summary>
+			/// <param name="maxBytes">
+			/// The memory budget, in bytes. Zero, the default, disables the cache.
+			/// </param>
+			void SetResponseCacheCapacity(const uint64_t maxBytes);
+
+			/// <summary>
+			/// Discards every stored response. To be called whenever whatever the consumer decides
+			/// on response content with has changed. May be called at any time.
+			/// </summary>
+			void FlushResponseCache();
+
+			/// <summary>
+			/// Registers a block page under an ID, for verdicts to refer to instead of supplying the
+			/// page every time. Any page already registered under the ID is replaced. May be called
+			/// at any time. See mitm::http::BlockResponses.
+			/// </summary>
+			/// <param name="pageId">
+			/// The ID verdicts are to refer to the page by.
+			/// </param>
+			/// <param name="page">
+			/// The complete response, status line, headers and payload. May be nullptr, to remove
+			/// the page.
+			/// </param>
+			/// <param name="pageLength">
+			/// The length of the response, in bytes.
+			/// </param>
+			void RegisterBlockPage(const uint32_t pageId, const char* page, const uint32_t pageLength);
+
+			/// <summary>
+			/// Removes every registered block page. May be called at any time.
+			/// </summary>
+			void ClearBlockPages();
+
+			/// <summary>
+			/// Sets whether requests a client has pipelined may be written to the server along
+			/// with the request before them, rather than each waiting until the response before it
+			/// has been written to the client. Only requests no callback would be asked about go
+			/// ahead like this. May be called at any time, and takes effect for requests read
+			/// afterwards. See mitm::secure::TlsCapableHttpBridge.
+			/// </summary>
+			/// <param name="enabled">
+			/// Whether pipelined requests may be coalesced. Disabled by default.
+			/// </param>
+			void SetPipelineCoalescing(const bool enabled);
+
+			/// <summary>
+			/// Compiles the supplied Adblock Plus formatted network rules and has every bridge
+			/// match requests against them natively, before the message begin callback is
+			/// consulted. Any rules loaded before are replaced. May be called at any time, and
+			/// requests already being matched finish against the rules they started with. See
+			/// filtering::RuleMatcher.
+			/// </summary>
+			/// <param name="rules">
+			/// The rules, one per line.
+			/// </param>
+			/// <param name="rulesLength">
+			/// The length of the rules, in bytes.
+			/// </param>
+			/// <param name="loadedCount">
+			/// The number of rules that were loaded.
+			/// </param>
+			/// <param name="failedCount">
+			/// The number of network rules that were malformed or unsupported, and were skipped.
+			/// </param>
+			void LoadRules(const char* rules, const uint32_t rulesLength, uint32_t& loadedCount, uint32_t& failedCount);
+
+			/// <summary>
+			/// Discards the native rules, so that every request is once again handed to the
+			/// message begin callback. May be called at any time.
+			/// </summary>
+			void ClearRules();
+
+			/// <summary>
+			/// Builds a hostname blocklist file, to be loaded later with ::LoadHostnameBlocklist(...).
+			/// Doesn't touch the Engine itself, so it may be done ahead of time, and at any time.
+			/// See filtering::HostnameSet.
+			/// </summary>
+			/// <param name="hostnames">
+			/// The hostnames, one per line. Hosts file lines and ||domain^ rules are accepted too.
+			/// </param>
+			/// <param name="hostnamesLength">
+			/// The length of the hostnames, in bytes.
+			/// </param>
+			/// <param name="outputPath">
+			/// The path to write the file to.
+			/// </param>
+			/// <returns>
+			/// The number of distinct hostnames written.
+			/// </returns>
+			const uint32_t BuildHostnameBlocklist(const char* hostnames, const uint32_t hostnamesLength, const std::string& outputPath);
+
+			/// <summary>
+			/// Maps a hostname blocklist file and has every bridge check hosts against it, both
+			/// the SNI of TLS clients and the Host header of requests. Any blocklist loaded before
+			/// is replaced. May be called at any time, and checks already underway finish against
+			/// the blocklist they started with. The file must not be modified while it's loaded.
+			/// </summary>
+			/// <param name="path">
+			/// The path to a file written by ::BuildHostnameBlocklist(...).
+			/// </param>
+			/// <returns>
+			/// The number of hostnames in the blocklist.
+			/// </returns>
+			const uint32_t LoadHostnameBlocklist(const std::string& path);
+
+			/// <summary>
+			/// Unloads the hostname blocklist. May be called at any time.
+			/// </summary>
+			void ClearHostnameBlocklist();
+
+			/// <summary>
+			/// Compiles a response inspection policy and has every bridge consult it for responses
+			/// that have been flagged for inspection, to decide whether they're buffered in full,
+			/// have only their first bytes inspected, or are streamed without inspection. Any
+			/// policy set before is replaced. May be called at any time, and takes effect for
+			/// responses that begin afterwards. See filtering::InspectionPolicy for the format.
+			/// </summary>
+			/// <param name="policy">
+			/// The policy table, one entry per line.
+			/// </param>
+			/// <param name="policyLength">
+			/// The length of the policy table, in bytes.
+			/// </param>
+			/// <param name="entryCount">
+			/// The number of entries that were loaded.
+			/// </param>
+			/// <param name="failedCount">
+			/// The number of lines that were malformed, and were skipped.
+			/// </param>
+			void SetInspectionPolicy(const char* policy, const uint32_t policyLength, uint32_t& entryCount, uint32_t& failedCount);
+
+			/// <summary>
+			/// Discards the response inspection policy, so that every response flagged for
+			/// inspection is once again buffered in full. May be called at any time.
+			/// </summary>
+			void ClearInspectionPolicy();
+
+			/// <summary>
+			/// Builds a complete filtering configuration on a background thread and, if every
+			/// part of it loads, publishes it in place of the current one, in one step. Bridges
+			/// never wait on this, and never see part of the old configuration mixed with part
+			/// of the new one. Anything not supplied is absent from the new configuration, rather
+			/// than carried over from the current one. If any part fails to load, the current
+			/// configuration is kept and the failure is reported through the error callback. May
+			/// be called at any time. Loads are carried out in the order they were requested. See
+			/// filtering::FilterSnapshot.
+			/// </summary>
+			/// <param name="rules">
+			/// Adblock Plus formatted network rules, one per line. May be empty. See ::LoadRules(...).
+			/// </param>
+			/// <param name="blocklistPath">
+			/// The path to a hostname blocklist file. May be empty. See ::LoadHostnameBlocklist(...).
+			/// </param>
+			/// <param name="bypassHosts">
+			/// Hosts that aren't to be filtered at all, one per line. May be empty. TLS
+			/// connections to them are tunnelled rather than intercepted. See
+			/// filtering::FilterSnapshot::CompileHostList(...).
+			/// </param>
+			/// <param name="preservedEncodingHosts">
+			/// Hosts whose requests keep the client's Accept-Encoding, one per line, in the same
+			/// format as bypassHosts. May be empty. See
+			/// filtering::FilterSnapshot::preservedEncodingHosts.
+			/// </param>
+			/// <param name="inspectionPolicy">
+			/// The response inspection policy table. May be empty. See ::SetInspectionPolicy(...).
+			/// </param>
+			/// <param name="verdictTimeoutMilliseconds">
+			/// How long to wait on a pending asynchronous verdict before applying the default.
+			/// </param>
+			/// <param name="defaultBeginAction">
+			/// The nextAction applied when a pending message begin verdict times out.
+			/// </param>
+			/// <param name="defaultEndShouldBlock">
+			/// Whether or not to block when a pending message end verdict times out.
+			/// </param>
+			/// <param name="onLoaded">
+			/// Called on the background thread once the load has succeeded or failed. May be
+			/// empty.
+			/// </param>
+			void LoadFilterConfigurationAsync(
+				std::string rules,
+				std::string blocklistPath,
+				std::string bypassHosts,
+				std::string preservedEncodingHosts,
+				std::string inspectionPolicy,
+				const uint32_t verdictTimeoutMilliseconds,
+				const uint32_t defaultBeginAction,
+				const bool defaultEndShouldBlock,
+				util::cb::FilterConfigurationLoadedFunction onLoaded
+				);
+
 		private:
 
 			/// <summary>
@@ -230,6 +656,57 @@ namespace te
 			/// </summary>
 			std::vector<std::thread> m_proxyServiceThreads;
 
+			/// <summary>
+			/// The flow control shared by every bridge created by our acceptors. Declared ahead
+			/// of the io_service, because bridges that are still held by pending handlers are
+			/// only destroyed along with the io_service, and they release their reservations
+			/// against this object when they are.
+			/// </summary>
+			std::unique_ptr<network::FlowControl> m_flowControl = nullptr;
+
+			/// <summary>
+			/// The admission control shared by every bridge created by our acceptors. Declared
+			/// ahead of the io_service for the same reason as the flow control, since bridges
+			/// give back their slots when they're destroyed.
+			/// </summary>
+			std::unique_ptr<network::AdmissionControl> m_admissionControl = nullptr;
+
+			/// <summary>
+			/// The verdict control shared by every bridge created by our acceptors. Bridges that
+			/// are waiting on a verdict are held here rather than by the io_service, so they're
+			/// dropped once the Engine has been stopped, while the io_service still exists.
+			/// </summary>
+			std::unique_ptr<network::VerdictControl> m_verdictControl = nullptr;
+
+			/// <summary>
+			/// The accept control for the HTTP listener. Held here rather than by the acceptor so
+			/// that configuration and instrumentation survive the Engine being restarted.
+			/// </summary>
+			std::unique_ptr<network::AcceptControl> m_httpAcceptControl = nullptr;
+
+			/// <summary>
+			/// The accept control for the HTTPS listener.
+			/// </summary>
+			std::unique_ptr<network::AcceptControl> m_httpsAcceptControl = nullptr;
+
+			/// <summary>
+			/// The service that the configuration thread runs. Filtering configurations handed
+			/// to ::LoadFilterConfigurationAsync(...) are posted here. Independent of the Engine
+			/// being started or stopped.
+			/// </summary>
+			boost::asio::io_service m_configService;
+
+			/// <summary>
+			/// Keeps the configuration thread running while there is nothing to load.
+			/// </summary>
+			std::unique_ptr<boost::asio::io_service::work> m_configWork = nullptr;
+
+			/// <summary>
+			/// The configuration thread. A single thread, so that loads are published in the
+			/// order they were requested.
+			/// </summary>
+			std::thread m_configThread;
+
 			/// <summary>
 			/// The io_service that will drive the proxy.
 			/// </summary>
@@ -271,16 +748,19 @@ namespace te
 			util::cb::HttpMessageBeginCheckFunction m_onMessageBegin;
 			util::cb::HttpMessageEndCheckFunction m_onMessageEnd;
 
+			util::cb::HttpMessageBeginViewFunction m_onMessageBeginView;
+			util::cb::HttpMessageEndViewFunction m_onMessageEndView;
+
 			static void DummyOnMessageBeginCallback(
 				const char* requestHeaders, const uint32_t requestHeadersLength, const char* requestBody, const uint32_t requestBodyLength,
 				const char* responseHeaders, const uint32_t responseHeadersLength, const char* responseBody, const uint32_t responseBodyLength,
-				uint32_t* nextAction, CustomResponseStreamWriter responseWriter
+				uint32_t* nextAction, CustomResponseStreamWriterV2 responseWriter, void* writerContext
 			);
 
 			static void DummyOnMessageEndCallback(
 				const char* requestHeaders, const uint32_t requestHeadersLength, const char* requestBody, const uint32_t requestBodyLength,
 				const char* responseHeaders, const uint32_t responseHeadersLength, const char* responseBody, const uint32_t responseBodyLength,
-				bool* shouldBlock, CustomResponseStreamWriter responseWriter
+				bool* shouldBlock, CustomResponseStreamWriterV2 responseWriter, void* writerContext
 			);
 
 		};
@@ -0,0 +1,338 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <boost/utility/string_ref.hpp>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace filtering
+		{
+
+			/// <summary>
+			/// The AhoCorasick class finds every occurrence of any of a set of keywords in a text
+			/// with a single pass over the text, regardless of how many keywords there are.
+			///
+			/// Keywords are added to a trie, and ::Compile() computes the failure link of every
+			/// node, being the node for the longest proper suffix of that node's path that is also
+			/// a path in the trie, and the output link, being the nearest node along the failure
+			/// chain at which some keyword ends. It then flattens the trie so that each node's
+			/// transitions are a sorted run in one contiguous array. The root, which is where
+			/// most of the text is consumed from, gets a full table of 256 transitions instead.
+			///
+			/// Matching is byte wise and case sensitive, so callers wanting case insensitive
+			/// matching must lowercase both the keywords and the text. Adding keywords after
+			/// ::Compile() is an error. Once compiled, searches are thread safe.
+			/// </summary>
+			class AhoCorasick
+			{
+
+			public:
+
+				/// <summary>
+				/// Constructs a new AhoCorasick instance with no keywords.
+				/// </summary>
+				AhoCorasick()
+				{
+					m_buildKeyword.push_back(static_cast<uint32_t>(NoKeyword));
+				}
+
+				/// <summary>
+				/// Adds a keyword.
+				/// </summary>
+				/// <param name="keyword">
+				/// The keyword. Must not be empty.
+				/// </param>
+				/// <param name="id">
+				/// The id to report when the keyword is found. Adding the same keyword twice keeps
+				/// the first id.
+				/// </param>
+				/// <returns>
+				/// The id that will be reported for the keyword, or NoKeyword if the keyword was
+				/// empty or the automaton has already been compiled.
+				/// </returns>
+				uint32_t Add(boost::string_ref keyword, const uint32_t id)
+				{
+					if (m_compiled || keyword.empty())
+					{
+						return NoKeyword;
+					}
+
+					uint32_t node = 0;
+
+					for (auto c : keyword)
+					{
+						const uint64_t key = (static_cast<uint64_t>(node) << 8) | static_cast<uint8_t>(c);
+						auto existing = m_buildEdges.find(key);
+
+						if (existing != m_buildEdges.end())
+						{
+							node = existing->second;
+							continue;
+						}
+
+						uint32_t child = static_cast<uint32_t>(m_buildKeyword.size());
+						m_buildEdges.emplace(key, child);
+						m_buildKeyword.push_back(static_cast<uint32_t>(NoKeyword));
+						node = child;
+					}
+
+					if (m_buildKeyword[node] == NoKeyword)
+					{
+						m_buildKeyword[node] = id;
+						++m_keywordCount;
+					}
+
+					return m_buildKeyword[node];
+				}
+
+				/// <summary>
+				/// Computes the failure and output links and flattens the automaton for searching.
+				/// Must be called once all keywords have been added, and before any searches are
+				/// done.
+				/// </summary>
+				void Compile()
+				{
+					if (m_compiled)
+					{
+						return;
+					}
+
+					const uint32_t nodeCount = static_cast<uint32_t>(m_buildKeyword.size());
+
+					// Gather each node's children so they can be laid out contiguously and sorted.
+					std::vector<uint32_t> childCount(nodeCount, 0);
+
+					for (auto& edge : m_buildEdges)
+					{
+						++childCount[static_cast<uint32_t>(edge.first >> 8)];
+					}
+
+					m_nodes.resize(nodeCount);
+
+					uint32_t offset = 0;
+					for (uint32_t i = 0; i < nodeCount; ++i)
+					{
+						m_nodes[i].firstEdge = offset;
+						m_nodes[i].edgeCount = childCount[i];
+						m_nodes[i].keyword = m_buildKeyword[i];
+						offset += childCount[i];
+					}
+
+					m_edges.resize(offset);
+
+					std::vector<uint32_t> filled(nodeCount, 0);
+					for (auto& edge : m_buildEdges)
+					{
+						const uint32_t parent = static_cast<uint32_t>(edge.first >> 8);
+						Edge& e = m_edges[m_nodes[parent].firstEdge + filled[parent]++];
+						e.c = static_cast<uint8_t>(edge.first & 0xFF);
+						e.child = edge.second;
+					}
+
+					for (uint32_t i = 0; i < nodeCount; ++i)
+					{
+						auto first = m_edges.begin() + m_nodes[i].firstEdge;
+						std::sort(first, first + m_nodes[i].edgeCount, [](const Edge& a, const Edge& b)
+						{
+							return a.c < b.c;
+						});
+					}
+
+					decltype(m_buildEdges)().swap(m_buildEdges);
+					std::vector<uint32_t>().swap(m_buildKeyword);
+
+					// Failure links, breadth first, so that a node's failure link is always
+					// resolved before its children's are.
+					for (uint32_t c = 0; c < 256; ++c)
+					{
+						m_rootNext[c] = 0;
+					}
+
+					std::vector<uint32_t> queue;
+					queue.reserve(nodeCount);
+
+					for (uint32_t i = 0; i < m_nodes[0].edgeCount; ++i)
+					{
+						const Edge& e = m_edges[m_nodes[0].firstEdge + i];
+						m_rootNext[e.c] = e.child;
+						m_nodes[e.child].fail = 0;
+						m_nodes[e.child].output = NoNode;
+						queue.push_back(e.child);
+					}
+
+					for (size_t q = 0; q < queue.size(); ++q)
+					{
+						const uint32_t node = queue[q];
+
+						for (uint32_t i = 0; i < m_nodes[node].edgeCount; ++i)
+						{
+							const Edge& e = m_edges[m_nodes[node].firstEdge + i];
+
+							uint32_t fail = m_nodes[node].fail;
+							uint32_t next = NoNode;
+
+							while ((next = Step(fail, e.c)) == NoNode && fail != 0)
+							{
+								fail = m_nodes[fail].fail;
+							}
+
+							if (next == NoNode)
+							{
+								next = m_rootNext[e.c];
+							}
+
+							Node& child = m_nodes[e.child];
+							child.fail = next;
+							child.output = m_nodes[child.fail].keyword != NoKeyword ? child.fail : m_nodes[child.fail].output;
+
+							queue.push_back(e.child);
+						}
+					}
+
+					m_compiled = true;
+				}
+
+				/// <summary>
+				/// Searches the supplied text for every occurrence of every keyword.
+				/// </summary>
+				/// <param name="text">
+				/// The text to search.
+				/// </param>
+				/// <param name="onMatch">
+				/// Called with the id of the keyword and the offset just past the end of the
+				/// occurrence, for every occurrence. Returning true stops the search.
+				/// </param>
+				/// <returns>
+				/// True if the search was stopped by the function, false otherwise.
+				/// </returns>
+				template<typename MatchFunction>
+				bool Search(boost::string_ref text, MatchFunction&& onMatch) const
+				{
+					if (!m_compiled || m_keywordCount == 0)
+					{
+						return false;
+					}
+
+					uint32_t state = 0;
+
+					for (size_t pos = 0; pos < text.size(); ++pos)
+					{
+						const uint8_t c = static_cast<uint8_t>(text[pos]);
+
+						uint32_t next = NoNode;
+						while (state != 0 && (next = Step(state, c)) == NoNode)
+						{
+							state = m_nodes[state].fail;
+						}
+
+						state = state == 0 ? m_rootNext[c] : next;
+
+						for (uint32_t out = m_nodes[state].keyword != NoKeyword ? state : m_nodes[state].output; out != NoNode; out = m_nodes[out].output)
+						{
+							if (onMatch(m_nodes[out].keyword, pos + 1))
+							{
+								return true;
+							}
+						}
+					}
+
+					return false;
+				}
+
+				/// <summary>
+				/// Gets the number of distinct keywords.
+				/// </summary>
+				/// <returns>
+				/// The number of distinct keywords.
+				/// </returns>
+				const uint32_t GetKeywordCount() const
+				{
+					return m_keywordCount;
+				}
+
+				/// <summary>
+				/// Returned in place of a keyword id when nothing was added.
+				/// </summary>
+				static constexpr uint32_t NoKeyword = UINT32_MAX;
+
+			private:
+
+				static constexpr uint32_t NoNode = UINT32_MAX;
+
+				struct Node
+				{
+					uint32_t firstEdge = 0;
+					uint32_t edgeCount = 0;
+					uint32_t fail = 0;
+					uint32_t output = NoNode;
+					uint32_t keyword = NoKeyword;
+				};
+
+				struct Edge
+				{
+					uint8_t c;
+					uint32_t child;
+				};
+
+				/// <summary>
+				/// Follows the goto transition for the supplied byte out of the supplied node.
+				/// </summary>
+				/// <returns>
+				/// The next node, or NoNode if there is no such transition.
+				/// </returns>
+				const uint32_t Step(const uint32_t node, const uint8_t c) const
+				{
+					const Node& current = m_nodes[node];
+
+					if (node == 0)
+					{
+						return m_rootNext[c] != 0 ? m_rootNext[c] : NoNode;
+					}
+
+					auto first = m_edges.begin() + current.firstEdge;
+					auto last = first + current.edgeCount;
+
+					// Most nodes have a single child.
+					if (current.edgeCount == 1)
+					{
+						return first->c == c ? first->child : NoNode;
+					}
+
+					auto found = std::lower_bound(first, last, c, [](const Edge& edge, const uint8_t what)
+					{
+						return edge.c < what;
+					});
+
+					return (found != last && found->c == c) ? found->child : NoNode;
+				}
+
+				bool m_compiled = false;
+
+				uint32_t m_keywordCount = 0;
+
+				std::unordered_map<uint64_t, uint32_t> m_buildEdges;
+
+				std::vector<uint32_t> m_buildKeyword;
+
+				std::vector<Node> m_nodes;
+
+				std::vector<Edge> m_edges;
+
+				uint32_t m_rootNext[256];
+			};
+
+		} /* namespace filtering */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,286 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <boost/utility/string_ref.hpp>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace filtering
+		{
+
+			/// <summary>
+			/// The DomainTrie class maps domains to values, and finds every value whose domain is
+			/// either a given host or one of its parents. Domains are stored label by label,
+			/// starting from the rightmost, so "ads.example.com" is the path com, example, ads.
+			/// Looking up "cdn.ads.example.com" walks that path one label at a time, and reports
+			/// the values found on every node along the way, which makes the cost of a lookup a
+			/// function of the number of labels in the host rather than the number of domains in
+			/// the trie.
+			///
+			/// Values are inserted into a build-time representation, and ::Compile() flattens the
+			/// trie into contiguous arrays with each node's children sorted by label, so lookups
+			/// don't allocate or chase scattered pointers. Inserting after ::Compile() is an
+			/// error. Once compiled, lookups are thread safe.
+			/// </summary>
+			class DomainTrie
+			{
+
+			public:
+
+				/// <summary>
+				/// Constructs a new, empty DomainTrie.
+				/// </summary>
+				DomainTrie()
+				{
+					m_buildNodes.emplace_back();
+				}
+
+				/// <summary>
+				/// Associates the supplied value with the supplied domain.
+				/// </summary>
+				/// <param name="domain">
+				/// The domain, already lowercased. Leading and trailing dots are ignored.
+				/// </param>
+				/// <param name="value">
+				/// The value to report when a host is, or is beneath, the domain.
+				/// </param>
+				/// <returns>
+				/// True if the value was inserted, false if the domain was empty or the trie has
+				/// already been compiled.
+				/// </returns>
+				bool Insert(boost::string_ref domain, const uint32_t value)
+				{
+					if (m_compiled)
+					{
+						return false;
+					}
+
+					uint32_t node = 0;
+					bool any = false;
+
+					while (!domain.empty())
+					{
+						auto dot = domain.rfind('.');
+						auto label = dot == boost::string_ref::npos ? domain : domain.substr(dot + 1);
+						domain = dot == boost::string_ref::npos ? boost::string_ref() : domain.substr(0, dot);
+
+						if (label.empty())
+						{
+							continue;
+						}
+
+						auto& children = m_buildNodes[node].children;
+						auto existing = children.find(label.to_string());
+
+						if (existing != children.end())
+						{
+							node = existing->second;
+						}
+						else
+						{
+							uint32_t child = static_cast<uint32_t>(m_buildNodes.size());
+							m_buildNodes[node].children.emplace(label.to_string(), child);
+							m_buildNodes.emplace_back();
+							node = child;
+						}
+
+						any = true;
+					}
+
+					if (!any)
+					{
+						return false;
+					}
+
+					m_buildNodes[node].values.push_back(value);
+					return true;
+				}
+
+				/// <summary>
+				/// Flattens the trie for lookups. Must be called once all values have been
+				/// inserted, and before any lookups are done.
+				/// </summary>
+				void Compile()
+				{
+					if (m_compiled)
+					{
+						return;
+					}
+
+					m_nodes.resize(m_buildNodes.size());
+
+					for (size_t i = 0; i < m_buildNodes.size(); ++i)
+					{
+						auto& built = m_buildNodes[i];
+						auto& node = m_nodes[i];
+
+						node.firstEdge = static_cast<uint32_t>(m_edges.size());
+						node.edgeCount = static_cast<uint32_t>(built.children.size());
+
+						// std::map is ordered, so the edges come out sorted by label.
+						for (auto& child : built.children)
+						{
+							Edge edge;
+							edge.labelOffset = static_cast<uint32_t>(m_labels.size());
+							edge.labelLength = static_cast<uint32_t>(child.first.size());
+							edge.child = child.second;
+							m_labels.append(child.first);
+							m_edges.push_back(edge);
+						}
+
+						node.firstValue = static_cast<uint32_t>(m_values.size());
+						node.valueCount = static_cast<uint32_t>(built.values.size());
+						m_values.insert(m_values.end(), built.values.begin(), built.values.end());
+					}
+
+					std::vector<BuildNode>().swap(m_buildNodes);
+					m_compiled = true;
+				}
+
+				/// <summary>
+				/// Invokes the supplied function with every value whose domain is the supplied host
+				/// or one of its parents. Values for parents are reported before values for their
+				/// children.
+				/// </summary>
+				/// <param name="host">
+				/// The host, already lowercased, without a port.
+				/// </param>
+				/// <param name="onValue">
+				/// Called with each value found. Returning true stops the lookup.
+				/// </param>
+				/// <returns>
+				/// True if the lookup was stopped by the function, false otherwise.
+				/// </returns>
+				template<typename ValueFunction>
+				bool ForEachMatch(boost::string_ref host, ValueFunction&& onValue) const
+				{
+					if (!m_compiled || m_nodes.empty())
+					{
+						return false;
+					}
+
+					uint32_t node = 0;
+
+					while (!host.empty())
+					{
+						auto dot = host.rfind('.');
+						auto label = dot == boost::string_ref::npos ? host : host.substr(dot + 1);
+						host = dot == boost::string_ref::npos ? boost::string_ref() : host.substr(0, dot);
+
+						if (label.empty())
+						{
+							continue;
+						}
+
+						node = FindChild(node, label);
+
+						if (node == NoNode)
+						{
+							return false;
+						}
+
+						const Node& current = m_nodes[node];
+
+						for (uint32_t i = 0; i < current.valueCount; ++i)
+						{
+							if (onValue(m_values[current.firstValue + i]))
+							{
+								return true;
+							}
+						}
+					}
+
+					return false;
+				}
+
+				/// <summary>
+				/// Gets the number of nodes in the trie, including the root.
+				/// </summary>
+				/// <returns>
+				/// The number of nodes in the trie.
+				/// </returns>
+				const size_t GetNodeCount() const
+				{
+					return m_compiled ? m_nodes.size() : m_buildNodes.size();
+				}
+
+			private:
+
+				static constexpr uint32_t NoNode = UINT32_MAX;
+
+				struct BuildNode
+				{
+					std::map<std::string, uint32_t> children;
+					std::vector<uint32_t> values;
+				};
+
+				struct Node
+				{
+					uint32_t firstEdge = 0;
+					uint32_t edgeCount = 0;
+					uint32_t firstValue = 0;
+					uint32_t valueCount = 0;
+				};
+
+				struct Edge
+				{
+					uint32_t labelOffset;
+					uint32_t labelLength;
+					uint32_t child;
+				};
+
+				/// <summary>
+				/// Binary searches the children of the supplied node for the supplied label.
+				/// </summary>
+				/// <returns>
+				/// The child node, or NoNode if there is no such child.
+				/// </returns>
+				const uint32_t FindChild(const uint32_t node, boost::string_ref label) const
+				{
+					const Node& current = m_nodes[node];
+
+					auto first = m_edges.begin() + current.firstEdge;
+					auto last = first + current.edgeCount;
+
+					auto found = std::lower_bound(first, last, label, [this](const Edge& edge, boost::string_ref what)
+					{
+						return boost::string_ref(m_labels.data() + edge.labelOffset, edge.labelLength) < what;
+					});
+
+					if (found != last && boost::string_ref(m_labels.data() + found->labelOffset, found->labelLength) == label)
+					{
+						return found->child;
+					}
+
+					return NoNode;
+				}
+
+				bool m_compiled = false;
+
+				std::vector<BuildNode> m_buildNodes;
+
+				std::vector<Node> m_nodes;
+
+				std::vector<Edge> m_edges;
+
+				std::string m_labels;
+
+				std::vector<uint32_t> m_values;
+			};
+
+		} /* namespace filtering */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,151 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "FilterSnapshot.hpp"
+
+#include <string>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace filtering
+		{
+
+			namespace
+			{
+				inline char ToLower(const char c)
+				{
+					return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+				}
+
+				inline bool IsSpace(const char c)
+				{
+					return c == ' ' || c == '\t' || c == '\r';
+				}
+
+				/// <summary>
+				/// The longest host we'll bother looking up, per RFC 1035.
+				/// </summary>
+				constexpr size_t MaxHostLength = 255;
+
+				/// <summary>
+				/// Checks whether a host, or one of its parents, is in a compiled host list.
+				/// </summary>
+				bool IsHostListed(const DomainTrie* hosts, boost::string_ref host)
+				{
+					if (hosts == nullptr)
+					{
+						return false;
+					}
+
+					// Drop the port, and for IPv6 literals, the brackets.
+					if (!host.empty() && host.front() == '[')
+					{
+						host = host.substr(1, host.find(']') - 1);
+					}
+					else
+					{
+						host = host.substr(0, host.find(':'));
+					}
+
+					if (host.empty() || host.size() > MaxHostLength)
+					{
+						return false;
+					}
+
+					char lowered[MaxHostLength];
+
+					for (size_t i = 0; i < host.size(); ++i)
+					{
+						lowered[i] = ToLower(host[i]);
+					}
+
+					return hosts->ForEachMatch(boost::string_ref(lowered, host.size()), [](const uint32_t)
+					{
+						return true;
+					});
+				}
+			}
+
+			std::shared_ptr<const DomainTrie> FilterSnapshot::CompileHostList(const char* hosts, const size_t hostsLength)
+			{
+				if (hosts == nullptr || hostsLength == 0)
+				{
+					return nullptr;
+				}
+
+				auto trie = std::make_shared<DomainTrie>();
+				bool any = false;
+
+				boost::string_ref remaining(hosts, hostsLength);
+				std::string host;
+
+				while (!remaining.empty())
+				{
+					auto newline = remaining.find('\n');
+					auto line = remaining.substr(0, newline);
+					remaining = newline == boost::string_ref::npos ? boost::string_ref() : remaining.substr(newline + 1);
+
+					while (!line.empty() && IsSpace(line.front()))
+					{
+						line.remove_prefix(1);
+					}
+
+					while (!line.empty() && IsSpace(line.back()))
+					{
+						line.remove_suffix(1);
+					}
+
+					if (line.empty() || line.front() == '#' || line.front() == '!')
+					{
+						continue;
+					}
+
+					if (line.starts_with(u8"*."))
+					{
+						line.remove_prefix(2);
+					}
+
+					host.clear();
+
+					for (const char c : line)
+					{
+						host.push_back(ToLower(c));
+					}
+
+					// DomainTrie ignores leading and trailing dots itself, and only the presence
+					// of a value on a node matters to us, not what it is.
+					if (trie->Insert(host, 0))
+					{
+						any = true;
+					}
+				}
+
+				if (!any)
+				{
+					return nullptr;
+				}
+
+				trie->Compile();
+
+				return trie;
+			}
+
+			const bool FilterSnapshot::IsBypassed(boost::string_ref host) const
+			{
+				return IsHostListed(bypassHosts.get(), host);
+			}
+
+			const bool FilterSnapshot::IsEncodingPreserved(boost::string_ref host) const
+			{
+				return IsHostListed(preservedEncodingHosts.get(), host);
+			}
+
+		} /* namespace filtering */
+	} /* namespace httpengine */
+} /* namespace te */
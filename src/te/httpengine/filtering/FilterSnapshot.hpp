@@ -0,0 +1,145 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <boost/utility/string_ref.hpp>
+#include "RuleMatcher.hpp"
+#include "HostnameSet.hpp"
+#include "DomainTrie.hpp"
+#include "InspectionPolicy.hpp"
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace filtering
+		{
+
+			/// <summary>
+			/// The FilterSnapshot struct is one complete, immutable version of the native filtering
+			/// configuration: the hosts that aren't to be filtered at all, the native rules, the
+			/// hostname blocklist, and how long to wait on a pending verdict and what to do when
+			/// it doesn't come.
+			///
+			/// A snapshot is never modified once it has been published. Changing anything means
+			/// building a new snapshot, usually by copying the current one and replacing the
+			/// parts that changed, and publishing that in its place. See
+			/// network::VerdictControl. Bridges take a reference to whatever snapshot is current
+			/// when they reach a decision, and use that one for the whole decision, so they never
+			/// see half of one configuration and half of another. The parts are themselves
+			/// immutable and held by shared_ptr, so copying a snapshot to change one part doesn't
+			/// copy the others, and a snapshot, along with whatever parts only it refers to, is
+			/// released once the last bridge holding it lets go.
+			/// </summary>
+			struct FilterSnapshot
+			{
+
+				/// <summary>
+				/// The default number of milliseconds a bridge waits on a pending verdict before
+				/// applying the default verdict.
+				/// </summary>
+				static constexpr uint32_t DefaultVerdictTimeoutMilliseconds = 5000;
+
+				/// <summary>
+				/// Compiles a list of hosts, such as the hosts that aren't to be filtered. Every
+				/// subdomain of a listed host is included.
+				/// </summary>
+				/// <param name="hosts">
+				/// The hosts, one per line. A leading "*." or "." is ignored. Blank lines, and
+				/// lines starting with '#' or '!', are skipped.
+				/// </param>
+				/// <param name="hostsLength">
+				/// The length of the hosts, in bytes.
+				/// </param>
+				/// <returns>
+				/// The compiled list, or nullptr if it doesn't contain any hosts.
+				/// </returns>
+				static std::shared_ptr<const DomainTrie> CompileHostList(const char* hosts, const size_t hostsLength);
+
+				/// <summary>
+				/// Checks whether or not a host is exempt from filtering.
+				/// </summary>
+				/// <param name="host">
+				/// The host, possibly including a port.
+				/// </param>
+				/// <returns>
+				/// True if the host, or one of its parents, is on the bypass list.
+				/// </returns>
+				const bool IsBypassed(boost::string_ref host) const;
+
+				/// <summary>
+				/// Checks whether or not requests to a host keep the client's own Accept-Encoding.
+				/// </summary>
+				/// <param name="host">
+				/// The host, possibly including a port.
+				/// </param>
+				/// <returns>
+				/// True if the host, or one of its parents, is on the preserved encoding list.
+				/// </returns>
+				const bool IsEncodingPreserved(boost::string_ref host) const;
+
+				/// <summary>
+				/// Uniquely identifies this snapshot among every snapshot published by any Engine
+				/// in the process. Assigned when the snapshot is published. Zero until then.
+				/// </summary>
+				uint64_t generation = 0;
+
+				/// <summary>
+				/// Hosts whose traffic is passed through untouched. TLS connections to them are
+				/// tunnelled rather than intercepted, and plain requests to them skip every check.
+				/// May be nullptr.
+				/// </summary>
+				std::shared_ptr<const DomainTrie> bypassHosts;
+
+				/// <summary>
+				/// Hosts whose requests keep the Accept-Encoding the client sent, rather than
+				/// having it narrowed to the codings we can decompress. Responses from them in a
+				/// coding we can't decompress are streamed rather than inspected. Meant for
+				/// origins where the bandwidth saved by stronger compression matters more than
+				/// inspecting their content. May be nullptr.
+				/// </summary>
+				std::shared_ptr<const DomainTrie> preservedEncodingHosts;
+
+				/// <summary>
+				/// The native rules. May be nullptr.
+				/// </summary>
+				std::shared_ptr<const RuleMatcher> rules;
+
+				/// <summary>
+				/// The hostname blocklist. May be nullptr.
+				/// </summary>
+				std::shared_ptr<const HostnameSet> blocklist;
+
+				/// <summary>
+				/// Decides how much of a response flagged for inspection is buffered. May be
+				/// nullptr, in which case such responses are buffered in full.
+				/// </summary>
+				std::shared_ptr<const InspectionPolicy> inspectionPolicy;
+
+				/// <summary>
+				/// How long a bridge waits on a pending verdict, in milliseconds. Never below one.
+				/// </summary>
+				uint32_t verdictTimeoutMilliseconds = DefaultVerdictTimeoutMilliseconds;
+
+				/// <summary>
+				/// The nextAction applied when a pending message begin verdict times out.
+				/// </summary>
+				uint32_t defaultBeginAction = 0;
+
+				/// <summary>
+				/// Whether or not a transaction is blocked when a pending message end verdict times
+				/// out.
+				/// </summary>
+				bool defaultEndShouldBlock = false;
+			};
+
+		} /* namespace filtering */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,356 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "HostnameSet.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace filtering
+		{
+
+			namespace
+			{
+				inline char ToLower(const char c)
+				{
+					return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+				}
+
+				inline bool IsSpace(const char c)
+				{
+					return c == ' ' || c == '\t' || c == '\r';
+				}
+
+				inline bool IsHostnameChar(const char c)
+				{
+					return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_';
+				}
+
+				/// <summary>
+				/// Whether a token is the address part of a hosts file line.
+				/// </summary>
+				inline bool IsAddress(boost::string_ref token)
+				{
+					return !token.empty() && std::all_of(token.begin(), token.end(), [](const char c)
+					{
+						return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F') || c == '.' || c == ':';
+					}) && token.find_first_of(u8".:") != boost::string_ref::npos;
+				}
+			}
+
+			const char HostnameSet::Magic[8] = { 'H', 'F', 'E', 'H', 'O', 'S', 'T', 'S' };
+
+			const uint32_t HostnameSet::Build(const char* hostnames, const size_t hostnamesLength, const std::string& outputPath)
+			{
+				std::vector<uint64_t> hashes;
+				boost::string_ref remaining(hostnames, hostnames != nullptr ? hostnamesLength : 0);
+
+				auto add = [&hashes](boost::string_ref hostname)
+				{
+					if (hostname.empty() || hostname.size() > MaxHostLength)
+					{
+						return;
+					}
+
+					std::string lowered(hostname.begin(), hostname.end());
+
+					for (auto& c : lowered)
+					{
+						c = ToLower(c);
+					}
+
+					while (!lowered.empty() && lowered.back() == '.')
+					{
+						lowered.pop_back();
+					}
+
+					if (lowered.find('.') == std::string::npos || !std::all_of(lowered.begin(), lowered.end(), IsHostnameChar))
+					{
+						return;
+					}
+
+					hashes.push_back(Hash(lowered));
+				};
+
+				while (!remaining.empty())
+				{
+					auto newline = remaining.find('\n');
+					auto line = newline == boost::string_ref::npos ? remaining : remaining.substr(0, newline);
+					remaining = newline == boost::string_ref::npos ? boost::string_ref() : remaining.substr(newline + 1);
+
+					// Anything after a # is a comment.
+					line = line.substr(0, line.find('#'));
+
+					while (!line.empty() && IsSpace(line.front()))
+					{
+						line.remove_prefix(1);
+					}
+
+					while (!line.empty() && IsSpace(line.back()))
+					{
+						line.remove_suffix(1);
+					}
+
+					if (line.empty() || line.front() == '!')
+					{
+						continue;
+					}
+
+					// Adblock Plus domain rules. Anything with a path or options isn't a
+					// hostname.
+					if (line.starts_with(u8"||"))
+					{
+						line.remove_prefix(2);
+
+						if (line.ends_with(u8"^"))
+						{
+							line.remove_suffix(1);
+						}
+
+						add(line);
+						continue;
+					}
+
+					bool first = true;
+					bool hostsFormat = false;
+
+					while (!line.empty())
+					{
+						size_t end = 0;
+						while (end < line.size() && !IsSpace(line[end]))
+						{
+							++end;
+						}
+
+						auto token = line.substr(0, end);
+						line = line.substr(end);
+
+						while (!line.empty() && IsSpace(line.front()))
+						{
+							line.remove_prefix(1);
+						}
+
+						if (first)
+						{
+							first = false;
+							hostsFormat = IsAddress(token) && !line.empty();
+
+							if (hostsFormat)
+							{
+								continue;
+							}
+						}
+
+						add(token);
+
+						if (!hostsFormat)
+						{
+							break;
+						}
+					}
+				}
+
+				uint32_t bucketBits = 1;
+				while ((static_cast<uint64_t>(1) << bucketBits) * TargetBucketSize < hashes.size() && bucketBits < MaxBucketBits)
+				{
+					++bucketBits;
+				}
+
+				// Sort by bucket, then by fingerprint, which is the order lookups expect.
+				const uint32_t shift = 64 - bucketBits;
+
+				std::vector<uint64_t> keys;
+				keys.reserve(hashes.size());
+
+				for (auto hash : hashes)
+				{
+					keys.push_back(((hash >> shift) << 32) | static_cast<uint32_t>(hash));
+				}
+
+				std::vector<uint64_t>().swap(hashes);
+
+				std::sort(keys.begin(), keys.end());
+				keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+				if (keys.size() > UINT32_MAX)
+				{
+					throw std::runtime_error(u8"In HostnameSet::Build(const char*, const size_t, const std::string&) - Too many hostnames.");
+				}
+
+				const uint32_t bucketCount = 1u << bucketBits;
+				std::vector<uint32_t> bucketEnds(bucketCount, 0);
+				std::vector<uint32_t> fingerprints;
+				fingerprints.reserve(keys.size());
+
+				for (auto key : keys)
+				{
+					++bucketEnds[static_cast<uint32_t>(key >> 32)];
+					fingerprints.push_back(static_cast<uint32_t>(key));
+				}
+
+				for (uint32_t i = 1; i < bucketCount; ++i)
+				{
+					bucketEnds[i] += bucketEnds[i - 1];
+				}
+
+				Header header;
+				std::memset(&header, 0, sizeof(header));
+				std::memcpy(header.magic, Magic, sizeof(header.magic));
+				header.version = Version;
+				header.bucketBits = bucketBits;
+				header.entryCount = static_cast<uint32_t>(fingerprints.size());
+
+				std::ofstream output(outputPath, std::ios::binary | std::ios::trunc);
+
+				if (!output)
+				{
+					throw std::runtime_error(u8"In HostnameSet::Build(const char*, const size_t, const std::string&) - Failed to open output file.");
+				}
+
+				output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				output.write(reinterpret_cast<const char*>(bucketEnds.data()), bucketEnds.size() * sizeof(uint32_t));
+				output.write(reinterpret_cast<const char*>(fingerprints.data()), fingerprints.size() * sizeof(uint32_t));
+				output.close();
+
+				if (!output)
+				{
+					throw std::runtime_error(u8"In HostnameSet::Build(const char*, const size_t, const std::string&) - Failed to write output file.");
+				}
+
+				return header.entryCount;
+			}
+
+			HostnameSet::HostnameSet(const std::string& path) :
+				m_file(path.c_str(), boost::interprocess::read_only),
+				m_region(m_file, boost::interprocess::read_only)
+			{
+				const size_t size = m_region.get_size();
+				const char* base = static_cast<const char*>(m_region.get_address());
+
+				if (size < sizeof(Header))
+				{
+					throw std::runtime_error(u8"In HostnameSet::HostnameSet(const std::string&) - File is too small to be a hostname set.");
+				}
+
+				m_header = reinterpret_cast<const Header*>(base);
+
+				if (std::memcmp(m_header->magic, Magic, sizeof(Magic)) != 0 || m_header->version != Version)
+				{
+					throw std::runtime_error(u8"In HostnameSet::HostnameSet(const std::string&) - File is not a hostname set, or is of an unsupported version.");
+				}
+
+				if (m_header->bucketBits < 1 || m_header->bucketBits > MaxBucketBits)
+				{
+					throw std::runtime_error(u8"In HostnameSet::HostnameSet(const std::string&) - File has an invalid bucket count.");
+				}
+
+				const uint64_t expectedSize = sizeof(Header) + (static_cast<uint64_t>(1) << m_header->bucketBits) * sizeof(uint32_t) + static_cast<uint64_t>(m_header->entryCount) * sizeof(uint32_t);
+
+				if (size < expectedSize)
+				{
+					throw std::runtime_error(u8"In HostnameSet::HostnameSet(const std::string&) - File is truncated.");
+				}
+
+				m_bucketEnds = reinterpret_cast<const uint32_t*>(base + sizeof(Header));
+				m_fingerprints = m_bucketEnds + (static_cast<size_t>(1) << m_header->bucketBits);
+			}
+
+			const bool HostnameSet::Contains(boost::string_ref host) const
+			{
+				// Drop the port, and for IPv6 literals, the brackets.
+				if (!host.empty() && host.front() == '[')
+				{
+					host = host.substr(1, host.find(']') - 1);
+				}
+				else
+				{
+					host = host.substr(0, host.find(':'));
+				}
+
+				while (!host.empty() && host.back() == '.')
+				{
+					host.remove_suffix(1);
+				}
+
+				if (host.empty() || host.size() > MaxHostLength)
+				{
+					return false;
+				}
+
+				char lowered[MaxHostLength];
+
+				for (size_t i = 0; i < host.size(); ++i)
+				{
+					lowered[i] = ToLower(host[i]);
+				}
+
+				boost::string_ref suffix(lowered, host.size());
+
+				// The host itself, then every parent that still has a dot in it, since entries
+				// without one are never built.
+				while (suffix.find('.') != boost::string_ref::npos)
+				{
+					if (ContainsHash(Hash(suffix)))
+					{
+						return true;
+					}
+
+					suffix.remove_prefix(suffix.find('.') + 1);
+				}
+
+				return false;
+			}
+
+			const uint32_t HostnameSet::GetEntryCount() const
+			{
+				return m_header->entryCount;
+			}
+
+			const uint64_t HostnameSet::Hash(boost::string_ref hostname)
+			{
+				// FNV-1a, then the MurmurHash3 finalizer, since FNV alone leaves the top bits,
+				// which pick the bucket, poorly mixed for short strings.
+				uint64_t hash = 14695981039346656037ULL;
+
+				for (auto c : hostname)
+				{
+					hash ^= static_cast<uint8_t>(c);
+					hash *= 1099511628211ULL;
+				}
+
+				hash ^= hash >> 33;
+				hash *= 0xff51afd7ed558ccdULL;
+				hash ^= hash >> 33;
+				hash *= 0xc4ceb9fe1a85ec53ULL;
+				hash ^= hash >> 33;
+
+				return hash;
+			}
+
+			const bool HostnameSet::ContainsHash(const uint64_t hash) const
+			{
+				const uint32_t bucket = static_cast<uint32_t>(hash >> (64 - m_header->bucketBits));
+				const uint32_t fingerprint = static_cast<uint32_t>(hash);
+
+				// Bounds are checked here rather than when the file is loaded, so that loading
+				// doesn't have to touch every page of the bucket table.
+				uint32_t end = std::min(m_bucketEnds[bucket], m_header->entryCount);
+				uint32_t start = bucket == 0 ? 0 : std::min(m_bucketEnds[bucket - 1], end);
+
+				return std::binary_search(m_fingerprints + start, m_fingerprints + end, fingerprint);
+			}
+
+		} /* namespace filtering */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,169 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <boost/utility/string_ref.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace filtering
+		{
+
+			/// <summary>
+			/// The HostnameSet class is an immutable set of hostnames, read straight out of a
+			/// memory mapped file, for blocklists that run to millions of entries.
+			///
+			/// The file is produced ahead of time by ::Build(...). Each hostname is reduced to a 64
+			/// bit hash. The top bits of the hash pick a bucket, and the low 32 bits are kept as a
+			/// fingerprint, so every entry costs four bytes no matter how long the hostname was.
+			/// The file holds a small header, then the end offset of every bucket, then every
+			/// fingerprint, sorted by bucket and then by value. Loading maps the file and checks
+			/// the header, and nothing more, so the cost of loading doesn't depend on the size of
+			/// the list, and pages are only faulted in as lookups touch them. A lookup hashes the
+			/// host and each of its parent domains in turn, and searches a bucket holding a handful
+			/// of fingerprints for each, so "ads.example.com" is blocked by an entry for
+			/// "example.com".
+			///
+			/// Since only fingerprints are kept, a host that isn't in the set can be taken for one
+			/// that is. With buckets holding a few entries each, the odds of that are on the order
+			/// of one in a billion per lookup.
+			///
+			/// The file must not be modified while it's mapped. To change the list, build a new
+			/// file, under a new name, and load that. Instances are immutable and so may be shared
+			/// freely between threads.
+			/// </summary>
+			class HostnameSet
+			{
+
+			public:
+
+				/// <summary>
+				/// Builds a hostname set file from a list of hostnames.
+				/// </summary>
+				/// <param name="hostnames">
+				/// The hostnames, one per line. Lines in hosts file format, such as "0.0.0.0
+				/// example.com", and Adblock Plus domain rules, such as "||example.com^", are
+				/// accepted as well. Blank lines and lines beginning with # or ! are ignored, as
+				/// are hostnames without a dot, such as "localhost".
+				/// </param>
+				/// <param name="hostnamesLength">
+				/// The length of the hostnames, in bytes.
+				/// </param>
+				/// <param name="outputPath">
+				/// The path to write the file to. Any existing file is overwritten.
+				/// </param>
+				/// <returns>
+				/// The number of distinct hostnames written.
+				/// </returns>
+				/// <exception cref="std::runtime_error">
+				/// If the file could not be written.
+				/// </exception>
+				static const uint32_t Build(const char* hostnames, const size_t hostnamesLength, const std::string& outputPath);
+
+				/// <summary>
+				/// Maps the supplied hostname set file.
+				/// </summary>
+				/// <param name="path">
+				/// The path to a file produced by ::Build(...).
+				/// </param>
+				/// <exception cref="std::runtime_error">
+				/// If the file could not be mapped, or isn't a hostname set file.
+				/// </exception>
+				explicit HostnameSet(const std::string& path);
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				HostnameSet(const HostnameSet&) = delete;
+				HostnameSet(HostnameSet&&) = delete;
+				HostnameSet& operator=(const HostnameSet&) = delete;
+
+				/// <summary>
+				/// Gets whether the supplied host, or any domain it is beneath, is in the set.
+				/// </summary>
+				/// <param name="host">
+				/// The host, in any case, optionally with a port and a trailing dot.
+				/// </param>
+				/// <returns>
+				/// True if the host or one of its parents is in the set, false otherwise.
+				/// </returns>
+				const bool Contains(boost::string_ref host) const;
+
+				/// <summary>
+				/// Gets the number of hostnames in the set.
+				/// </summary>
+				/// <returns>
+				/// The number of hostnames in the set.
+				/// </returns>
+				const uint32_t GetEntryCount() const;
+
+			private:
+
+				/// <summary>
+				/// The layout of the start of the file. Everything in the file is little endian,
+				/// which is to say native, on every platform the Engine runs on.
+				/// </summary>
+				struct Header
+				{
+					char magic[8];
+
+					uint32_t version;
+
+					uint32_t bucketBits;
+
+					uint32_t entryCount;
+
+					uint32_t reserved[3];
+				};
+
+				static const char Magic[8];
+
+				static constexpr uint32_t Version = 1;
+
+				/// <summary>
+				/// Aim for about this many fingerprints per bucket.
+				/// </summary>
+				static constexpr uint32_t TargetBucketSize = 4;
+
+				static constexpr uint32_t MaxBucketBits = 26;
+
+				/// <summary>
+				/// Hosts longer than this aren't valid, and aren't looked up.
+				/// </summary>
+				static constexpr size_t MaxHostLength = 255;
+
+				/// <summary>
+				/// Hashes a hostname, which must already be lowercased.
+				/// </summary>
+				static const uint64_t Hash(boost::string_ref hostname);
+
+				/// <summary>
+				/// Gets whether the exact hash is in the set.
+				/// </summary>
+				const bool ContainsHash(const uint64_t hash) const;
+
+				boost::interprocess::file_mapping m_file;
+
+				boost::interprocess::mapped_region m_region;
+
+				const Header* m_header = nullptr;
+
+				const uint32_t* m_bucketEnds = nullptr;
+
+				const uint32_t* m_fingerprints = nullptr;
+			};
+
+		} /* namespace filtering */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,294 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "InspectionPolicy.hpp"
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace filtering
+		{
+
+			namespace
+			{
+				inline char ToLower(const char c)
+				{
+					return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+				}
+
+				inline bool IsSpace(const char c)
+				{
+					return c == ' ' || c == '\t' || c == '\r';
+				}
+
+				boost::string_ref Trim(boost::string_ref str)
+				{
+					while (!str.empty() && IsSpace(str.front()))
+					{
+						str.remove_prefix(1);
+					}
+
+					while (!str.empty() && IsSpace(str.back()))
+					{
+						str.remove_suffix(1);
+					}
+
+					return str;
+				}
+
+				/// <summary>
+				/// Parses a non-negative decimal number. Returns false if str is empty, contains
+				/// anything but digits, or is too large to be a length.
+				/// </summary>
+				bool ParseNumber(boost::string_ref str, int64_t& value)
+				{
+					if (str.empty() || str.size() > 15)
+					{
+						return false;
+					}
+
+					value = 0;
+
+					for (const char c : str)
+					{
+						if (c < '0' || c > '9')
+						{
+							return false;
+						}
+
+						value = (value * 10) + (c - '0');
+					}
+
+					return true;
+				}
+			}
+
+			InspectionPolicy::InspectionPolicy(const char* table, const size_t tableLength)
+			{
+				boost::string_ref remaining(table, table != nullptr ? tableLength : 0);
+
+				while (!remaining.empty())
+				{
+					auto newline = remaining.find('\n');
+					auto line = newline == boost::string_ref::npos ? remaining : remaining.substr(0, newline);
+					remaining = newline == boost::string_ref::npos ? boost::string_ref() : remaining.substr(newline + 1);
+
+					line = Trim(line);
+
+					if (line.empty() || line.front() == '#')
+					{
+						continue;
+					}
+
+					Entry entry;
+
+					if (ParseLine(line, entry))
+					{
+						m_entries.push_back(std::move(entry));
+					}
+					else
+					{
+						++m_failedCount;
+					}
+				}
+
+				m_counters.reset(new Counters[m_entries.size() + 1]);
+			}
+
+			const InspectionPolicy::Decision InspectionPolicy::Decide(boost::string_ref contentType, const int64_t contentLength) const
+			{
+				// Only the type and subtype are compared, never the parameters.
+				auto semicolon = contentType.find(';');
+				auto mimeType = Trim(semicolon == boost::string_ref::npos ? contentType : contentType.substr(0, semicolon));
+
+				Decision decision;
+				decision.entry = static_cast<uint32_t>(m_entries.size());
+
+				for (size_t i = 0; i < m_entries.size(); ++i)
+				{
+					if (EntryMatches(m_entries[i], mimeType, contentLength))
+					{
+						decision.action = m_entries[i].action;
+						decision.sampleBytes = m_entries[i].sampleBytes;
+						decision.entry = static_cast<uint32_t>(i);
+						break;
+					}
+				}
+
+				m_counters[decision.entry].responseCount.fetch_add(1, std::memory_order_relaxed);
+
+				return decision;
+			}
+
+			void InspectionPolicy::RecordBuffered(const uint32_t entry, const uint64_t bytes) const
+			{
+				if (entry <= m_entries.size())
+				{
+					m_counters[entry].bufferedBytes.fetch_add(bytes, std::memory_order_relaxed);
+				}
+			}
+
+			void InspectionPolicy::RecordStreamed(const uint32_t entry, const uint64_t bytes) const
+			{
+				if (entry <= m_entries.size())
+				{
+					m_counters[entry].streamedBytes.fetch_add(bytes, std::memory_order_relaxed);
+				}
+			}
+
+			const uint32_t InspectionPolicy::GetEntryCount() const
+			{
+				return static_cast<uint32_t>(m_entries.size());
+			}
+
+			const uint32_t InspectionPolicy::GetFailedCount() const
+			{
+				return m_failedCount;
+			}
+
+			const bool InspectionPolicy::GetEntryStats(const uint32_t entry, uint64_t& responseCount, uint64_t& bufferedBytes, uint64_t& streamedBytes) const
+			{
+				if (entry > m_entries.size())
+				{
+					return false;
+				}
+
+				responseCount = m_counters[entry].responseCount.load(std::memory_order_relaxed);
+				bufferedBytes = m_counters[entry].bufferedBytes.load(std::memory_order_relaxed);
+				streamedBytes = m_counters[entry].streamedBytes.load(std::memory_order_relaxed);
+
+				return true;
+			}
+
+			const bool InspectionPolicy::ParseLine(boost::string_ref line, Entry& entry)
+			{
+				bool haveType = false;
+				bool haveAction = false;
+
+				while (!line.empty())
+				{
+					auto space = line.find_first_of(" \t");
+					auto token = space == boost::string_ref::npos ? line : line.substr(0, space);
+					line = space == boost::string_ref::npos ? boost::string_ref() : Trim(line.substr(space + 1));
+
+					if (!haveType)
+					{
+						haveType = true;
+
+						if (token == "*")
+						{
+							continue;
+						}
+
+						auto slash = token.find('/');
+
+						if (slash == boost::string_ref::npos || slash == 0 || slash == token.size() - 1)
+						{
+							return false;
+						}
+
+						for (const char c : token)
+						{
+							entry.type.push_back(ToLower(c));
+						}
+
+						if (token.substr(slash + 1) == "*")
+						{
+							entry.type.pop_back();
+							entry.typeIsPrefix = true;
+						}
+
+						continue;
+					}
+
+					if (token.front() == '>' || token.front() == '<')
+					{
+						int64_t length = 0;
+
+						if (!ParseNumber(token.substr(1), length))
+						{
+							return false;
+						}
+
+						(token.front() == '>' ? entry.longerThan : entry.shorterThan) = length;
+						continue;
+					}
+
+					if (haveAction)
+					{
+						return false;
+					}
+
+					haveAction = true;
+
+					if (token == "inspect")
+					{
+						entry.action = Action::Inspect;
+					}
+					else if (token == "stream")
+					{
+						entry.action = Action::Stream;
+					}
+					else if (token.starts_with("sample:"))
+					{
+						int64_t sampleBytes = 0;
+
+						if (!ParseNumber(token.substr(7), sampleBytes) || sampleBytes < 1 || sampleBytes > UINT32_MAX)
+						{
+							return false;
+						}
+
+						entry.action = Action::Sample;
+						entry.sampleBytes = static_cast<uint32_t>(sampleBytes);
+					}
+					else
+					{
+						return false;
+					}
+				}
+
+				return haveType && haveAction;
+			}
+
+			const bool InspectionPolicy::EntryMatches(const Entry& entry, boost::string_ref mimeType, const int64_t contentLength)
+			{
+				// An unknown length is taken to be longer than any.
+				if (entry.longerThan >= 0 && contentLength >= 0 && contentLength <= entry.longerThan)
+				{
+					return false;
+				}
+
+				if (entry.shorterThan >= 0 && (contentLength < 0 || contentLength >= entry.shorterThan))
+				{
+					return false;
+				}
+
+				if (entry.type.empty())
+				{
+					return true;
+				}
+
+				if (entry.typeIsPrefix ? mimeType.size() <= entry.type.size() : mimeType.size() != entry.type.size())
+				{
+					return false;
+				}
+
+				for (size_t i = 0; i < entry.type.size(); ++i)
+				{
+					if (ToLower(mimeType[i]) != entry.type[i])
+					{
+						return false;
+					}
+				}
+
+				return true;
+			}
+
+		} /* namespace filtering */
+	} /* namespace httpengine */
+} /* namespace te */
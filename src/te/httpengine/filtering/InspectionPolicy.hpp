@@ -0,0 +1,260 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace filtering
+		{
+
+			/// <summary>
+			/// The InspectionPolicy class decides, from the Content-Type and Content-Length of a
+			/// response that has been flagged for inspection, how much of it is actually worth
+			/// holding on to. Without a policy, a response flagged for inspection is buffered in
+			/// full before any of it is sent to the client, which for video, large images and
+			/// archives means holding the whole thing in memory just to pass it along. A policy
+			/// can instead have such responses streamed untouched, or have only the first few
+			/// bytes held and inspected, after which the rest is streamed.
+			///
+			/// A policy is a table of entries, one per line, each of the form:
+			///
+			///     type [>length] [&lt;length] action
+			///
+			/// where type is a MIME type such as "text/html", a wildcard subtype such as
+			/// "video/*", or "*" for anything, including responses without a Content-Type. The
+			/// optional >length and &lt;length conditions restrict the entry to responses whose
+			/// Content-Length is greater or less than the given number of bytes. A response whose
+			/// length isn't known up front, such as a chunked one, is taken to be longer than any
+			/// length. The action is "inspect" to buffer the response in full, "stream" to not
+			/// inspect it at all, or "sample:N" to inspect only the first N bytes. Blank lines and
+			/// lines starting with '#' are ignored. The first entry that matches decides. A
+			/// response no entry matches is buffered in full, as it would be without a policy.
+			///
+			/// Each entry, along with the implicit default, counts how many responses it decided
+			/// and how many of their payload bytes were buffered and streamed, so that the table
+			/// can be tuned. Instances are otherwise immutable once constructed, and so may be
+			/// shared freely between threads. The counters are thread safe.
+			/// </summary>
+			class InspectionPolicy
+			{
+
+			public:
+
+				/// <summary>
+				/// What to do with a response.
+				/// </summary>
+				enum class Action : uint32_t
+				{
+					/// <summary>
+					/// Buffer the response in full, then inspect it.
+					/// </summary>
+					Inspect = 0,
+
+					/// <summary>
+					/// Buffer the first bytes of the response, inspect those, then stream the rest.
+					/// </summary>
+					Sample = 1,
+
+					/// <summary>
+					/// Don't inspect the response. Stream it.
+					/// </summary>
+					Stream = 2
+				};
+
+				/// <summary>
+				/// The outcome of consulting the policy for a response.
+				/// </summary>
+				struct Decision
+				{
+					/// <summary>
+					/// What to do with the response.
+					/// </summary>
+					Action action = Action::Inspect;
+
+					/// <summary>
+					/// For Action::Sample, how many bytes of the payload to inspect.
+					/// </summary>
+					uint32_t sampleBytes = 0;
+
+					/// <summary>
+					/// The index of the entry that decided, or the entry count if none matched.
+					/// Used to attribute bytes to the entry afterwards.
+					/// </summary>
+					uint32_t entry = 0;
+				};
+
+				/// <summary>
+				/// Compiles the supplied policy table.
+				/// </summary>
+				/// <param name="table">
+				/// The table, one entry per line. May be nullptr.
+				/// </param>
+				/// <param name="tableLength">
+				/// The length of the table, in bytes.
+				/// </param>
+				InspectionPolicy(const char* table, const size_t tableLength);
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				InspectionPolicy(const InspectionPolicy&) = delete;
+				InspectionPolicy(InspectionPolicy&&) = delete;
+				InspectionPolicy& operator=(const InspectionPolicy&) = delete;
+
+				/// <summary>
+				/// Decides what to do with a response, and counts the response against the entry
+				/// that decided.
+				/// </summary>
+				/// <param name="contentType">
+				/// The value of the Content-Type header, parameters and all. Empty if absent.
+				/// </param>
+				/// <param name="contentLength">
+				/// The value of the Content-Length header, or a negative number if the length
+				/// isn't known up front.
+				/// </param>
+				/// <returns>
+				/// What to do with the response.
+				/// </returns>
+				const Decision Decide(boost::string_ref contentType, const int64_t contentLength) const;
+
+				/// <summary>
+				/// Records payload bytes that were held for inspection.
+				/// </summary>
+				/// <param name="entry">
+				/// The entry from the decision.
+				/// </param>
+				/// <param name="bytes">
+				/// The number of bytes.
+				/// </param>
+				void RecordBuffered(const uint32_t entry, const uint64_t bytes) const;
+
+				/// <summary>
+				/// Records payload bytes that were passed to the client without being held.
+				/// </summary>
+				/// <param name="entry">
+				/// The entry from the decision.
+				/// </param>
+				/// <param name="bytes">
+				/// The number of bytes.
+				/// </param>
+				void RecordStreamed(const uint32_t entry, const uint64_t bytes) const;
+
+				/// <summary>
+				/// Gets the number of entries that were loaded. The implicit default entry is
+				/// not included.
+				/// </summary>
+				/// <returns>
+				/// The number of entries that were loaded.
+				/// </returns>
+				const uint32_t GetEntryCount() const;
+
+				/// <summary>
+				/// Gets the number of lines that were malformed, and were skipped.
+				/// </summary>
+				/// <returns>
+				/// The number of lines that were skipped.
+				/// </returns>
+				const uint32_t GetFailedCount() const;
+
+				/// <summary>
+				/// Gets the counters of an entry.
+				/// </summary>
+				/// <param name="entry">
+				/// The index of the entry, in the order they were loaded, or ::GetEntryCount() for
+				/// the implicit default.
+				/// </param>
+				/// <param name="responseCount">
+				/// The number of responses the entry decided.
+				/// </param>
+				/// <param name="bufferedBytes">
+				/// The number of payload bytes held for inspection.
+				/// </param>
+				/// <param name="streamedBytes">
+				/// The number of payload bytes streamed.
+				/// </param>
+				/// <returns>
+				/// True if the entry exists, false otherwise.
+				/// </returns>
+				const bool GetEntryStats(const uint32_t entry, uint64_t& responseCount, uint64_t& bufferedBytes, uint64_t& streamedBytes) const;
+
+			private:
+
+				/// <summary>
+				/// A single line of the table.
+				/// </summary>
+				struct Entry
+				{
+					/// <summary>
+					/// The lowercased type, "type/" for a wildcard subtype, or empty for "*".
+					/// </summary>
+					std::string type;
+
+					/// <summary>
+					/// Whether type is a prefix, for a wildcard subtype.
+					/// </summary>
+					bool typeIsPrefix = false;
+
+					/// <summary>
+					/// The response must be longer than this, or -1 for no condition.
+					/// </summary>
+					int64_t longerThan = -1;
+
+					/// <summary>
+					/// The response must be shorter than this, or -1 for no condition.
+					/// </summary>
+					int64_t shorterThan = -1;
+
+					Action action = Action::Inspect;
+
+					uint32_t sampleBytes = 0;
+				};
+
+				/// <summary>
+				/// The counters of a single entry.
+				/// </summary>
+				struct Counters
+				{
+					std::atomic<uint64_t> responseCount{ 0 };
+
+					std::atomic<uint64_t> bufferedBytes{ 0 };
+
+					std::atomic<uint64_t> streamedBytes{ 0 };
+				};
+
+				/// <summary>
+				/// Parses a single line into an entry. Returns false if it's malformed.
+				/// </summary>
+				static const bool ParseLine(boost::string_ref line, Entry& entry);
+
+				/// <summary>
+				/// Checks whether an entry applies to a response.
+				/// </summary>
+				static const bool EntryMatches(const Entry& entry, boost::string_ref mimeType, const int64_t contentLength);
+
+				std::vector<Entry> m_entries;
+
+				/// <summary>
+				/// One per entry, plus one for the implicit default at the end.
+				/// </summary>
+				std::unique_ptr<Counters[]> m_counters;
+
+				uint32_t m_failedCount = 0;
+			};
+
+		} /* namespace filtering */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,795 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "RuleMatcher.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <unordered_map>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace filtering
+		{
+
+			namespace
+			{
+				/// <summary>
+				/// Literal runs shorter than this aren't worth indexing, since they'd turn up in
+				/// nearly every URL anyway.
+				/// </summary>
+				constexpr size_t MinKeywordLength = 3;
+
+				inline char ToLower(const char c)
+				{
+					return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+				}
+
+				inline std::string ToLower(boost::string_ref str)
+				{
+					std::string ret(str.begin(), str.end());
+
+					for (auto& c : ret)
+					{
+						c = ToLower(c);
+					}
+
+					return ret;
+				}
+
+				inline bool IEquals(boost::string_ref lhs, boost::string_ref rhs)
+				{
+					if (lhs.size() != rhs.size())
+					{
+						return false;
+					}
+
+					for (size_t i = 0; i < lhs.size(); ++i)
+					{
+						if (ToLower(lhs[i]) != ToLower(rhs[i]))
+						{
+							return false;
+						}
+					}
+
+					return true;
+				}
+
+				inline bool IStartsWith(boost::string_ref str, boost::string_ref prefix)
+				{
+					return str.size() >= prefix.size() && IEquals(str.substr(0, prefix.size()), prefix);
+				}
+
+				inline boost::string_ref Trim(boost::string_ref str)
+				{
+					while (!str.empty() && (str.front() == ' ' || str.front() == '\t' || str.front() == '\r'))
+					{
+						str.remove_prefix(1);
+					}
+
+					while (!str.empty() && (str.back() == ' ' || str.back() == '\t' || str.back() == '\r'))
+					{
+						str.remove_suffix(1);
+					}
+
+					return str;
+				}
+
+				/// <summary>
+				/// Per the Adblock Plus definition, a separator is anything but a letter, a
+				/// digit, or one of _-.%
+				/// </summary>
+				inline bool IsSeparator(const char c)
+				{
+					return !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.' || c == '%');
+				}
+
+				inline bool IsDomainChar(const char c)
+				{
+					return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '.';
+				}
+
+				const struct
+				{
+					const char* name;
+					uint32_t type;
+				} TypeOptions[] =
+				{
+					{ u8"other", RuleMatcher::RequestTypeOther },
+					{ u8"script", RuleMatcher::RequestTypeScript },
+					{ u8"image", RuleMatcher::RequestTypeImage },
+					{ u8"stylesheet", RuleMatcher::RequestTypeStylesheet },
+					{ u8"object", RuleMatcher::RequestTypeObject },
+					{ u8"object-subrequest", RuleMatcher::RequestTypeObject },
+					{ u8"subdocument", RuleMatcher::RequestTypeSubdocument },
+					{ u8"document", RuleMatcher::RequestTypeDocument },
+					{ u8"xmlhttprequest", RuleMatcher::RequestTypeXmlHttpRequest },
+					{ u8"media", RuleMatcher::RequestTypeMedia },
+					{ u8"font", RuleMatcher::RequestTypeFont },
+					{ u8"websocket", RuleMatcher::RequestTypeWebSocket },
+					{ u8"ping", RuleMatcher::RequestTypePing }
+				};
+			}
+
+			RuleMatcher::RuleMatcher(const char* rules, const size_t rulesLength)
+			{
+				boost::string_ref remaining(rules, rules != nullptr ? rulesLength : 0);
+
+				while (!remaining.empty())
+				{
+					auto newline = remaining.find('\n');
+					auto line = newline == boost::string_ref::npos ? remaining : remaining.substr(0, newline);
+					remaining = newline == boost::string_ref::npos ? boost::string_ref() : remaining.substr(newline + 1);
+
+					ParseLine(Trim(line));
+				}
+
+				m_blockRules.Compile();
+				m_exceptionRules.Compile();
+			}
+
+			const RuleMatcher::Verdict RuleMatcher::Match(const Request& request) const
+			{
+				if (m_blockRules.Empty())
+				{
+					return Verdict::NoMatch;
+				}
+
+				Context context;
+				context.url = request.url;
+				context.type = request.type;
+				context.lowerUrl = ToLower(request.url);
+
+				FindHost(request.url, context.hostStart, context.hostEnd);
+				context.host = context.lowerUrl.substr(context.hostStart, context.hostEnd - context.hostStart);
+
+				if (!request.documentUrl.empty())
+				{
+					size_t documentHostStart = 0;
+					size_t documentHostEnd = 0;
+					FindHost(request.documentUrl, documentHostStart, documentHostEnd);
+					context.documentHost = ToLower(request.documentUrl.substr(documentHostStart, documentHostEnd - documentHostStart));
+				}
+
+				context.thirdParty = !context.documentHost.empty() && GetBaseDomain(context.host) != GetBaseDomain(context.documentHost);
+
+				if (!m_blockRules.Matches(context))
+				{
+					return Verdict::NoMatch;
+				}
+
+				return m_exceptionRules.Matches(context) ? Verdict::Exception : Verdict::Block;
+			}
+
+			const uint32_t RuleMatcher::GetRuleCount() const
+			{
+				return m_ruleCount;
+			}
+
+			const uint32_t RuleMatcher::GetFailedCount() const
+			{
+				return m_failedCount;
+			}
+
+			const uint32_t RuleMatcher::InferRequestType(
+				boost::string_ref fetchDest, boost::string_ref accept,
+				boost::string_ref requestedWith, boost::string_ref upgrade,
+				boost::string_ref uri
+				)
+			{
+				if (IEquals(upgrade, u8"websocket"))
+				{
+					return RequestTypeWebSocket;
+				}
+
+				if (!fetchDest.empty())
+				{
+					if (IEquals(fetchDest, u8"document")) return RequestTypeDocument;
+					if (IEquals(fetchDest, u8"iframe") || IEquals(fetchDest, u8"frame")) return RequestTypeSubdocument;
+					if (IEquals(fetchDest, u8"script") || IStartsWith(fetchDest, u8"worker") || IEquals(fetchDest, u8"sharedworker") || IEquals(fetchDest, u8"serviceworker")) return RequestTypeScript;
+					if (IEquals(fetchDest, u8"style")) return RequestTypeStylesheet;
+					if (IEquals(fetchDest, u8"image")) return RequestTypeImage;
+					if (IEquals(fetchDest, u8"font")) return RequestTypeFont;
+					if (IEquals(fetchDest, u8"audio") || IEquals(fetchDest, u8"video") || IEquals(fetchDest, u8"track")) return RequestTypeMedia;
+					if (IEquals(fetchDest, u8"object") || IEquals(fetchDest, u8"embed")) return RequestTypeObject;
+					if (IEquals(fetchDest, u8"empty")) return RequestTypeXmlHttpRequest;
+
+					return RequestTypeOther;
+				}
+
+				if (IEquals(requestedWith, u8"XMLHttpRequest"))
+				{
+					return RequestTypeXmlHttpRequest;
+				}
+
+				// Go by the extension, if there is one.
+				auto path = uri.substr(0, std::min(uri.find('?'), uri.find('#')));
+				auto slash = path.rfind('/');
+				auto dot = path.rfind('.');
+
+				if (dot != boost::string_ref::npos && (slash == boost::string_ref::npos || dot > slash))
+				{
+					auto ext = path.substr(dot + 1);
+
+					if (IEquals(ext, u8"js") || IEquals(ext, u8"mjs")) return RequestTypeScript;
+					if (IEquals(ext, u8"css")) return RequestTypeStylesheet;
+
+					if (IEquals(ext, u8"png") || IEquals(ext, u8"jpg") || IEquals(ext, u8"jpeg") || IEquals(ext, u8"gif") ||
+						IEquals(ext, u8"webp") || IEquals(ext, u8"svg") || IEquals(ext, u8"ico") || IEquals(ext, u8"bmp"))
+					{
+						return RequestTypeImage;
+					}
+
+					if (IEquals(ext, u8"woff") || IEquals(ext, u8"woff2") || IEquals(ext, u8"ttf") || IEquals(ext, u8"otf") || IEquals(ext, u8"eot"))
+					{
+						return RequestTypeFont;
+					}
+
+					if (IEquals(ext, u8"mp4") || IEquals(ext, u8"webm") || IEquals(ext, u8"mp3") || IEquals(ext, u8"ogg") || IEquals(ext, u8"m4a") || IEquals(ext, u8"wav"))
+					{
+						return RequestTypeMedia;
+					}
+
+					if (IEquals(ext, u8"swf")) return RequestTypeObject;
+				}
+
+				if (IStartsWith(accept, u8"text/html"))
+				{
+					return RequestTypeDocument;
+				}
+
+				if (IStartsWith(accept, u8"image/"))
+				{
+					return RequestTypeImage;
+				}
+
+				if (IStartsWith(accept, u8"text/css"))
+				{
+					return RequestTypeStylesheet;
+				}
+
+				return RequestTypeOther;
+			}
+
+			void RuleMatcher::ParseLine(boost::string_ref line)
+			{
+				// Blank lines, comments and the list header.
+				if (line.empty() || line.front() == '!' || line.front() == '[')
+				{
+					return;
+				}
+
+				// Element hiding and the like are for browsers, not for us.
+				if (line.find(u8"##") != boost::string_ref::npos || line.find(u8"#@#") != boost::string_ref::npos ||
+					line.find(u8"#?#") != boost::string_ref::npos || line.find(u8"#$#") != boost::string_ref::npos)
+				{
+					return;
+				}
+
+				Rule rule;
+				bool exception = false;
+
+				if (line.starts_with(u8"@@"))
+				{
+					exception = true;
+					line.remove_prefix(2);
+				}
+
+				// Regular expression rules. Options may follow the closing slash.
+				if (line.size() > 1 && line.front() == '/' && (line.back() == '/' || line.find(u8"/$") != boost::string_ref::npos))
+				{
+					++m_failedCount;
+					return;
+				}
+
+				auto optionsStart = line.rfind('$');
+
+				if (optionsStart != boost::string_ref::npos)
+				{
+					if (!ParseOptions(line.substr(optionsStart + 1), rule))
+					{
+						++m_failedCount;
+						return;
+					}
+
+					line = line.substr(0, optionsStart);
+				}
+
+				if (line.starts_with(u8"||"))
+				{
+					rule.anchorDomain = true;
+					line.remove_prefix(2);
+				}
+				else if (line.starts_with(u8"|"))
+				{
+					rule.anchorStart = true;
+					line.remove_prefix(1);
+				}
+
+				if (line.ends_with(u8"|"))
+				{
+					rule.anchorEnd = true;
+					line.remove_suffix(1);
+				}
+
+				// Leading and trailing wildcards mean nothing but cost a lot.
+				while (!line.empty() && line.front() == '*' && !rule.anchorDomain)
+				{
+					rule.anchorStart = false;
+					line.remove_prefix(1);
+				}
+
+				while (!line.empty() && line.back() == '*')
+				{
+					rule.anchorEnd = false;
+					line.remove_suffix(1);
+				}
+
+				if (line.empty() && rule.includeDomains.empty())
+				{
+					// This would match every request there is.
+					++m_failedCount;
+					return;
+				}
+
+				rule.pattern = rule.matchCase ? line.to_string() : ToLower(line);
+
+				if (exception)
+				{
+					m_exceptionRules.Add(std::move(rule));
+				}
+				else
+				{
+					m_blockRules.Add(std::move(rule));
+				}
+
+				++m_ruleCount;
+			}
+
+			const bool RuleMatcher::ParseOptions(boost::string_ref options, Rule& rule)
+			{
+				uint32_t includeTypes = 0;
+				uint32_t excludeTypes = 0;
+
+				while (!options.empty())
+				{
+					auto comma = options.find(',');
+					auto option = comma == boost::string_ref::npos ? options : options.substr(0, comma);
+					options = comma == boost::string_ref::npos ? boost::string_ref() : options.substr(comma + 1);
+
+					option = Trim(option);
+
+					if (option.empty())
+					{
+						continue;
+					}
+
+					if (IStartsWith(option, u8"domain="))
+					{
+						auto domains = option.substr(7);
+
+						while (!domains.empty())
+						{
+							auto bar = domains.find('|');
+							auto domain = bar == boost::string_ref::npos ? domains : domains.substr(0, bar);
+							domains = bar == boost::string_ref::npos ? boost::string_ref() : domains.substr(bar + 1);
+
+							if (domain.empty())
+							{
+								continue;
+							}
+
+							if (domain.front() == '~')
+							{
+								domain.remove_prefix(1);
+
+								if (!domain.empty())
+								{
+									rule.excludeDomains.push_back(ToLower(domain));
+								}
+							}
+							else
+							{
+								rule.includeDomains.push_back(ToLower(domain));
+							}
+						}
+
+						continue;
+					}
+
+					bool negated = false;
+
+					if (option.front() == '~')
+					{
+						negated = true;
+						option.remove_prefix(1);
+					}
+
+					if (IEquals(option, u8"third-party") || IEquals(option, u8"3p"))
+					{
+						rule.thirdParty = negated ? -1 : 1;
+						continue;
+					}
+
+					if (IEquals(option, u8"first-party") || IEquals(option, u8"1p"))
+					{
+						rule.thirdParty = negated ? 1 : -1;
+						continue;
+					}
+
+					if (IEquals(option, u8"match-case") && !negated)
+					{
+						rule.matchCase = true;
+						continue;
+					}
+
+					bool known = false;
+
+					for (auto& typeOption : TypeOptions)
+					{
+						if (IEquals(option, typeOption.name))
+						{
+							(negated ? excludeTypes : includeTypes) |= typeOption.type;
+							known = true;
+							break;
+						}
+					}
+
+					if (!known)
+					{
+						return false;
+					}
+				}
+
+				rule.types = (includeTypes != 0 ? includeTypes : static_cast<uint32_t>(RequestTypeAll)) & ~excludeTypes;
+
+				return rule.types != 0;
+			}
+
+			const bool RuleMatcher::OptionsMatch(const Rule& rule, const Context& context)
+			{
+				if ((rule.types & context.type) == 0)
+				{
+					return false;
+				}
+
+				if ((rule.thirdParty > 0 && !context.thirdParty) || (rule.thirdParty < 0 && context.thirdParty))
+				{
+					return false;
+				}
+
+				if (!rule.includeDomains.empty() || !rule.excludeDomains.empty())
+				{
+					// When we don't know the page, the request is taken to be the page.
+					const std::string& page = context.documentHost.empty() ? context.host : context.documentHost;
+
+					for (auto& domain : rule.excludeDomains)
+					{
+						if (IsDomainOrSubdomain(page, domain))
+						{
+							return false;
+						}
+					}
+
+					if (!rule.includeDomains.empty())
+					{
+						return std::any_of(rule.includeDomains.begin(), rule.includeDomains.end(), [&page](const std::string& domain)
+						{
+							return IsDomainOrSubdomain(page, domain);
+						});
+					}
+				}
+
+				return true;
+			}
+
+			const bool RuleMatcher::PatternMatch(const Rule& rule, const Context& context)
+			{
+				boost::string_ref text = rule.matchCase ? context.url : boost::string_ref(context.lowerUrl);
+
+				if (rule.anchorDomain)
+				{
+					// The pattern may begin at the start of the host, or at the start of any
+					// label within it.
+					if (context.hostStart >= context.hostEnd)
+					{
+						return false;
+					}
+
+					if (GlobMatch(rule.pattern, text, context.hostStart, true, rule.anchorEnd))
+					{
+						return true;
+					}
+
+					for (size_t i = context.hostStart; i < context.hostEnd; ++i)
+					{
+						if (text[i] == '.' && GlobMatch(rule.pattern, text, i + 1, true, rule.anchorEnd))
+						{
+							return true;
+						}
+					}
+
+					return false;
+				}
+
+				return GlobMatch(rule.pattern, text, 0, rule.anchorStart, rule.anchorEnd);
+			}
+
+			const bool RuleMatcher::GlobMatch(boost::string_ref pattern, boost::string_ref text, const size_t offset, const bool anchorStart, const bool anchorEnd)
+			{
+				size_t p = 0;
+				size_t t = offset;
+
+				// Where to resume from when a mismatch follows a *. An unanchored pattern
+				// behaves as though it began with one.
+				size_t starPattern = anchorStart ? boost::string_ref::npos : 0;
+				size_t starText = offset;
+
+				while (t < text.size())
+				{
+					if (p < pattern.size())
+					{
+						const char pc = pattern[p];
+
+						if (pc == '*')
+						{
+							starPattern = ++p;
+							starText = t;
+							continue;
+						}
+
+						if (pc == '^' ? IsSeparator(text[t]) : pc == text[t])
+						{
+							++p;
+							++t;
+							continue;
+						}
+					}
+					else if (!anchorEnd)
+					{
+						return true;
+					}
+
+					if (starPattern == boost::string_ref::npos)
+					{
+						return false;
+					}
+
+					p = starPattern;
+					t = ++starText;
+				}
+
+				// The text is used up. What's left of the pattern may only be wildcards, or
+				// separators, since ^ also matches the end of the address.
+				while (p < pattern.size() && (pattern[p] == '*' || pattern[p] == '^'))
+				{
+					++p;
+				}
+
+				return p == pattern.size();
+			}
+
+			void RuleMatcher::FindHost(boost::string_ref url, size_t& hostStart, size_t& hostEnd)
+			{
+				hostStart = 0;
+
+				auto scheme = url.find(u8"://");
+				if (scheme != boost::string_ref::npos)
+				{
+					hostStart = scheme + 3;
+				}
+
+				hostEnd = url.substr(hostStart).find_first_of(u8"/?#");
+				hostEnd = hostEnd == boost::string_ref::npos ? url.size() : hostStart + hostEnd;
+
+				auto authority = url.substr(hostStart, hostEnd - hostStart);
+				auto at = authority.rfind('@');
+
+				if (at != boost::string_ref::npos)
+				{
+					hostStart += at + 1;
+					authority = authority.substr(at + 1);
+				}
+
+				if (!authority.empty() && authority.front() == '[')
+				{
+					auto bracket = authority.find(']');
+					hostEnd = bracket == boost::string_ref::npos ? hostEnd : hostStart + bracket + 1;
+				}
+				else
+				{
+					auto colon = authority.find(':');
+					hostEnd = colon == boost::string_ref::npos ? hostEnd : hostStart + colon;
+				}
+
+				// A fully qualified host may carry a trailing dot, which changes nothing.
+				if (hostEnd > hostStart && url[hostEnd - 1] == '.')
+				{
+					--hostEnd;
+				}
+			}
+
+			boost::string_ref RuleMatcher::GetBaseDomain(boost::string_ref host)
+			{
+				auto last = host.rfind('.');
+
+				if (last == boost::string_ref::npos || last == 0)
+				{
+					return host;
+				}
+
+				auto second = host.substr(0, last).rfind('.');
+
+				if (second == boost::string_ref::npos)
+				{
+					return host;
+				}
+
+				// Keep three labels for the likes of example.co.uk.
+				auto tld = host.substr(last + 1);
+				auto sld = host.substr(second + 1, last - second - 1);
+
+				if (tld.size() == 2 && (sld == u8"co" || sld == u8"com" || sld == u8"net" || sld == u8"org" || sld == u8"gov" ||
+					sld == u8"edu" || sld == u8"ac" || sld == u8"or" || sld == u8"ne" || sld == u8"go"))
+				{
+					if (second == 0)
+					{
+						return host;
+					}
+
+					auto third = host.substr(0, second).rfind('.');
+					return third == boost::string_ref::npos ? host : host.substr(third + 1);
+				}
+
+				return host.substr(second + 1);
+			}
+
+			const bool RuleMatcher::IsDomainOrSubdomain(boost::string_ref host, boost::string_ref domain)
+			{
+				if (host.size() < domain.size() || !host.ends_with(domain))
+				{
+					return false;
+				}
+
+				return host.size() == domain.size() || host[host.size() - domain.size() - 1] == '.';
+			}
+
+			void RuleMatcher::RuleSet::Add(Rule&& rule)
+			{
+				m_rules.push_back(std::move(rule));
+			}
+
+			void RuleMatcher::RuleSet::Compile()
+			{
+				std::unordered_map<std::string, uint32_t> keywordIds;
+
+				for (uint32_t i = 0; i < static_cast<uint32_t>(m_rules.size()); ++i)
+				{
+					const Rule& rule = m_rules[i];
+					boost::string_ref pattern(rule.pattern);
+
+					// ||domain^ rules go straight into the trie, since the host alone decides
+					// whether they match.
+					if (rule.anchorDomain && !rule.anchorEnd && pattern.size() > 1 && pattern.back() == '^' &&
+						std::all_of(pattern.begin(), pattern.end() - 1, [](const char c) { return IsDomainChar(ToLower(c)); }))
+					{
+						m_domainRules.Insert(ToLower(pattern.substr(0, pattern.size() - 1)), i);
+						continue;
+					}
+
+					// Otherwise, index the rule by the longest literal run in its pattern.
+					boost::string_ref keyword;
+					boost::string_ref remaining = pattern;
+
+					while (!remaining.empty())
+					{
+						auto special = remaining.find_first_of(u8"*^");
+						auto run = special == boost::string_ref::npos ? remaining : remaining.substr(0, special);
+						remaining = special == boost::string_ref::npos ? boost::string_ref() : remaining.substr(special + 1);
+
+						if (run.size() > keyword.size())
+						{
+							keyword = run;
+						}
+					}
+
+					if (keyword.size() < MinKeywordLength)
+					{
+						m_genericRules.push_back(i);
+						continue;
+					}
+
+					// The URL is searched lowercased, whatever the rule says about case.
+					auto lowered = ToLower(keyword);
+					auto existing = keywordIds.find(lowered);
+
+					if (existing == keywordIds.end())
+					{
+						const uint32_t id = static_cast<uint32_t>(m_keywordRules.size());
+						m_keywords.Add(lowered, id);
+						m_keywordRules.emplace_back();
+						existing = keywordIds.emplace(std::move(lowered), id).first;
+					}
+
+					m_keywordRules[existing->second].push_back(i);
+				}
+
+				m_domainRules.Compile();
+				m_keywords.Compile();
+			}
+
+			const bool RuleMatcher::RuleSet::Matches(const Context& context) const
+			{
+				if (m_rules.empty())
+				{
+					return false;
+				}
+
+				bool matched = m_domainRules.ForEachMatch(context.host, [this, &context](const uint32_t index)
+				{
+					return OptionsMatch(m_rules[index], context);
+				});
+
+				if (matched)
+				{
+					return true;
+				}
+
+				// The same keyword may turn up more than once in a URL, but its rules only need
+				// checking the first time.
+				std::vector<uint32_t> seen;
+
+				matched = m_keywords.Search(context.lowerUrl, [this, &context, &seen](const uint32_t keyword, const size_t)
+				{
+					if (std::find(seen.begin(), seen.end(), keyword) != seen.end())
+					{
+						return false;
+					}
+
+					seen.push_back(keyword);
+
+					for (auto index : m_keywordRules[keyword])
+					{
+						const Rule& rule = m_rules[index];
+
+						if (OptionsMatch(rule, context) && PatternMatch(rule, context))
+						{
+							return true;
+						}
+					}
+
+					return false;
+				});
+
+				if (matched)
+				{
+					return true;
+				}
+
+				for (auto index : m_genericRules)
+				{
+					const Rule& rule = m_rules[index];
+
+					if (OptionsMatch(rule, context) && PatternMatch(rule, context))
+					{
+						return true;
+					}
+				}
+
+				return false;
+			}
+
+			const bool RuleMatcher::RuleSet::Empty() const
+			{
+				return m_rules.empty();
+			}
+
+		} /* namespace filtering */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,370 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+#include "DomainTrie.hpp"
+#include "AhoCorasick.hpp"
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace filtering
+		{
+
+			/// <summary>
+			/// The RuleMatcher class compiles a list of Adblock Plus formatted network rules, and
+			/// matches requests against them natively, so that the most common filtering decisions
+			/// don't need to go out to the message begin callback at all.
+			///
+			/// Supported are blocking rules and @@ exception rules, with the |, || and trailing |
+			/// anchors, the * wildcard and the ^ separator, and the options script, image,
+			/// stylesheet, object, subdocument, document, xmlhttprequest, media, font, websocket,
+			/// ping, other, third-party, first-party, match-case and domain=, any of which but the
+			/// last two may be negated with ~. Rules without any type option apply to every type of
+			/// request, including documents, since unlike in a browser, there is no other way to
+			/// stop a document from being fetched through us. Comments, element hiding rules and
+			/// blank lines are ignored. Regular expression rules and rules with any other option
+			/// are counted as failed, rather than being applied with an option silently dropped.
+			///
+			/// Rules of the form ||domain^, which are the vast majority of any real list, are
+			/// stored in a DomainTrie keyed on the domain, so they're found by walking the labels
+			/// of the request host. Every other rule is indexed by the longest literal run in its
+			/// pattern, and those runs are loaded into an AhoCorasick automaton, so a single pass
+			/// over the URL yields the few rules that could possibly match it, which are then
+			/// checked in full. Rules without a literal run long enough to index are checked
+			/// against every request. Exception rules are kept apart from blocking rules and are
+			/// only consulted once some blocking rule has matched.
+			///
+			/// Whether a request is third party is decided by comparing the registrable domain of
+			/// the request host with that of the page that made it, taken from the Referer or
+			/// Origin header. There is no public suffix list in the tree, so the registrable domain
+			/// is approximated as the last two labels of the host, or the last three when the host
+			/// ends in a two letter country code preceded by a common second level label such as
+			/// "co" or "com".
+			///
+			/// Instances are immutable once constructed, and so may be shared freely between
+			/// threads. To change the rules, construct a new instance and swap it in.
+			/// </summary>
+			class RuleMatcher
+			{
+
+			public:
+
+				/// <summary>
+				/// Request types, as named by the rule type options. A request has exactly one.
+				/// </summary>
+				enum RequestType : uint32_t
+				{
+					RequestTypeOther = 1 << 0,
+					RequestTypeScript = 1 << 1,
+					RequestTypeImage = 1 << 2,
+					RequestTypeStylesheet = 1 << 3,
+					RequestTypeObject = 1 << 4,
+					RequestTypeSubdocument = 1 << 5,
+					RequestTypeDocument = 1 << 6,
+					RequestTypeXmlHttpRequest = 1 << 7,
+					RequestTypeMedia = 1 << 8,
+					RequestTypeFont = 1 << 9,
+					RequestTypeWebSocket = 1 << 10,
+					RequestTypePing = 1 << 11,
+					RequestTypeAll = (1 << 12) - 1
+				};
+
+				/// <summary>
+				/// The outcome of matching a request.
+				/// </summary>
+				enum class Verdict
+				{
+					/// <summary>
+					/// No blocking rule matched.
+					/// </summary>
+					NoMatch,
+
+					/// <summary>
+					/// A blocking rule matched, and no exception rule did.
+					/// </summary>
+					Block,
+
+					/// <summary>
+					/// A blocking rule matched, but so did an exception rule.
+					/// </summary>
+					Exception
+				};
+
+				/// <summary>
+				/// What is known about a request when it is matched.
+				/// </summary>
+				struct Request
+				{
+					/// <summary>
+					/// The absolute URL of the request, including the scheme.
+					/// </summary>
+					boost::string_ref url;
+
+					/// <summary>
+					/// The URL or origin of the page that made the request, from the Referer or
+					/// Origin header. Empty if unknown.
+					/// </summary>
+					boost::string_ref documentUrl;
+
+					/// <summary>
+					/// The type of the request. See ::InferRequestType(...).
+					/// </summary>
+					uint32_t type = RequestTypeOther;
+				};
+
+				/// <summary>
+				/// Parses and compiles the supplied rules.
+				/// </summary>
+				/// <param name="rules">
+				/// The rules, one per line, in Adblock Plus format.
+				/// </param>
+				/// <param name="rulesLength">
+				/// The length of the rules, in bytes.
+				/// </param>
+				RuleMatcher(const char* rules, const size_t rulesLength);
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				RuleMatcher(const RuleMatcher&) = delete;
+				RuleMatcher(RuleMatcher&&) = delete;
+				RuleMatcher& operator=(const RuleMatcher&) = delete;
+
+				/// <summary>
+				/// Matches the supplied request against the rules.
+				/// </summary>
+				/// <param name="request">
+				/// The request.
+				/// </param>
+				/// <returns>
+				/// The verdict.
+				/// </returns>
+				const Verdict Match(const Request& request) const;
+
+				/// <summary>
+				/// Gets the number of rules that were loaded.
+				/// </summary>
+				/// <returns>
+				/// The number of rules that were loaded.
+				/// </returns>
+				const uint32_t GetRuleCount() const;
+
+				/// <summary>
+				/// Gets the number of network rules that could not be loaded, because they were
+				/// malformed or used something that isn't supported.
+				/// </summary>
+				/// <returns>
+				/// The number of rules that could not be loaded.
+				/// </returns>
+				const uint32_t GetFailedCount() const;
+
+				/// <summary>
+				/// Infers the type of a request from its headers and path, for lack of the browser
+				/// telling us outright. The Sec-Fetch-Dest header is used where the browser sends
+				/// it, and the other sources are guesses in descending order of reliability.
+				/// </summary>
+				/// <param name="fetchDest">
+				/// The value of the Sec-Fetch-Dest header, or empty.
+				/// </param>
+				/// <param name="accept">
+				/// The value of the Accept header, or empty.
+				/// </param>
+				/// <param name="requestedWith">
+				/// The value of the X-Requested-With header, or empty.
+				/// </param>
+				/// <param name="upgrade">
+				/// The value of the Upgrade header, or empty.
+				/// </param>
+				/// <param name="uri">
+				/// The request URI.
+				/// </param>
+				/// <returns>
+				/// The inferred request type.
+				/// </returns>
+				static const uint32_t InferRequestType(
+					boost::string_ref fetchDest, boost::string_ref accept,
+					boost::string_ref requestedWith, boost::string_ref upgrade,
+					boost::string_ref uri
+					);
+
+			private:
+
+				/// <summary>
+				/// A single parsed rule.
+				/// </summary>
+				struct Rule
+				{
+					/// <summary>
+					/// The pattern, without its anchors, lowercased unless the rule is
+					/// match-case.
+					/// </summary>
+					std::string pattern;
+
+					/// <summary>
+					/// The request types the rule applies to.
+					/// </summary>
+					uint32_t types = RequestTypeAll;
+
+					/// <summary>
+					/// One if the rule applies only to third party requests, minus one if only
+					/// to first party requests, zero if to both.
+					/// </summary>
+					int8_t thirdParty = 0;
+
+					bool matchCase = false;
+
+					bool anchorStart = false;
+
+					bool anchorEnd = false;
+
+					bool anchorDomain = false;
+
+					/// <summary>
+					/// The page domains the rule is restricted to, if any.
+					/// </summary>
+					std::vector<std::string> includeDomains;
+
+					/// <summary>
+					/// The page domains the rule doesn't apply on.
+					/// </summary>
+					std::vector<std::string> excludeDomains;
+				};
+
+				/// <summary>
+				/// A request prepared for matching, so that the work is done once no matter how
+				/// many rules are checked against it.
+				/// </summary>
+				struct Context
+				{
+					boost::string_ref url;
+
+					std::string lowerUrl;
+
+					size_t hostStart = 0;
+
+					size_t hostEnd = 0;
+
+					std::string host;
+
+					std::string documentHost;
+
+					uint32_t type = RequestTypeOther;
+
+					bool thirdParty = false;
+				};
+
+				/// <summary>
+				/// A compiled set of rules, either all blocking or all exceptions.
+				/// </summary>
+				class RuleSet
+				{
+
+				public:
+
+					/// <summary>
+					/// Adds a parsed rule.
+					/// </summary>
+					void Add(Rule&& rule);
+
+					/// <summary>
+					/// Compiles the rules for matching.
+					/// </summary>
+					void Compile();
+
+					/// <summary>
+					/// Gets whether any rule in the set matches the prepared request.
+					/// </summary>
+					const bool Matches(const Context& context) const;
+
+					/// <summary>
+					/// Gets whether the set contains no rules.
+					/// </summary>
+					const bool Empty() const;
+
+				private:
+
+					std::vector<Rule> m_rules;
+
+					DomainTrie m_domainRules;
+
+					AhoCorasick m_keywords;
+
+					std::vector<std::vector<uint32_t>> m_keywordRules;
+
+					std::vector<uint32_t> m_genericRules;
+				};
+
+				/// <summary>
+				/// Parses a single line, and if it's a network rule, adds it to the relevant set
+				/// and counts it as loaded or failed.
+				/// </summary>
+				void ParseLine(boost::string_ref line);
+
+				/// <summary>
+				/// Parses the options of a rule, the part following the $.
+				/// </summary>
+				/// <returns>
+				/// False if any option is malformed or unsupported.
+				/// </returns>
+				static const bool ParseOptions(boost::string_ref options, Rule& rule);
+
+				/// <summary>
+				/// Gets whether the options of the rule allow it to match the prepared request.
+				/// </summary>
+				static const bool OptionsMatch(const Rule& rule, const Context& context);
+
+				/// <summary>
+				/// Gets whether the pattern of the rule matches the prepared request.
+				/// </summary>
+				static const bool PatternMatch(const Rule& rule, const Context& context);
+
+				/// <summary>
+				/// Matches a pattern of literals, * and ^ against text, beginning at the supplied
+				/// offset.
+				/// </summary>
+				/// <param name="anchorStart">
+				/// Whether the pattern must match at the offset, rather than anywhere after it.
+				/// </param>
+				/// <param name="anchorEnd">
+				/// Whether the pattern must match through to the end of the text.
+				/// </param>
+				static const bool GlobMatch(boost::string_ref pattern, boost::string_ref text, const size_t offset, const bool anchorStart, const bool anchorEnd);
+
+				/// <summary>
+				/// Finds the host in an absolute URL, without any user info or port.
+				/// </summary>
+				static void FindHost(boost::string_ref url, size_t& hostStart, size_t& hostEnd);
+
+				/// <summary>
+				/// Approximates the registrable domain of a host.
+				/// </summary>
+				static boost::string_ref GetBaseDomain(boost::string_ref host);
+
+				/// <summary>
+				/// Gets whether a host is the supplied domain or beneath it.
+				/// </summary>
+				static const bool IsDomainOrSubdomain(boost::string_ref host, boost::string_ref domain);
+
+				RuleSet m_blockRules;
+
+				RuleSet m_exceptionRules;
+
+				uint32_t m_ruleCount = 0;
+
+				uint32_t m_failedCount = 0;
+			};
+
+		} /* namespace filtering */
+	} /* namespace httpengine */
+} /* namespace te */
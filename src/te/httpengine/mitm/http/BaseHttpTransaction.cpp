@@ -12,13 +12,17 @@
 #include <algorithm>
 #include <iomanip>
 #include <chrono>
+#include <limits>
 #include <boost/algorithm/string.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/iostreams/filter/zlib.hpp>
 #include <boost/iostreams/copy.hpp>
 #include "BaseHttpTransaction.hpp"
+#include "BlockResponses.hpp"
 #include "../../../util/http/KnownHttpHeaders.hpp"
+#include "../../util/hash/StringHashUtils.hpp"
+#include <unordered_map>
 #include <stdexcept>
 
 
@@ -31,6 +35,123 @@ namespace te
 			namespace http
 			{
 
+				namespace
+				{
+					/// <summary>
+					/// Appends the header of a chunk of the given size, in hex, with its CRLF.
+					/// </summary>
+					void AppendChunkHeader(std::vector<char>& out, uint64_t size)
+					{
+						char digits[16];
+						size_t count = 0;
+
+						do
+						{
+							digits[count++] = "0123456789abcdef"[size & 0xF];
+							size >>= 4;
+						} while (size != 0);
+
+						while (count > 0)
+						{
+							out.push_back(digits[--count]);
+						}
+
+						out.push_back('\r');
+						out.push_back('\n');
+					}
+
+					/// <summary>
+					/// Case insensitive prefix match, without the locale lookups of
+					/// boost::istarts_with, since it runs for every header of every message.
+					/// </summary>
+					inline bool StartsWithNoCase(const boost::string_ref name, const std::string& prefix)
+					{
+						return name.size() >= prefix.size() && strncasecmp(name.data(), prefix.c_str(), prefix.size()) == 0;
+					}
+
+					/// <summary>
+					/// Whether http_parser might read the given header to frame the message. These
+					/// are the only headers http_parser is shown when the head has been tokenized.
+					/// Names are matched by prefix, because that's as far as http_parser looks in
+					/// places. It flags a Transfer-Encoding as soon as it has seen that much of a
+					/// name, whatever follows. Showing it a header it ignores costs nothing.
+					/// </summary>
+					bool IsFramingHeader(const boost::string_ref name)
+					{
+						return StartsWithNoCase(name, util::http::headers::ContentLength) ||
+							StartsWithNoCase(name, util::http::headers::TransferEncoding) ||
+							StartsWithNoCase(name, util::http::headers::Connection) ||
+							StartsWithNoCase(name, util::http::headers::ProxyConnection) ||
+							StartsWithNoCase(name, util::http::headers::Upgrade);
+					}
+
+					/// <summary>
+					/// What a scratch http_parser saw of a framing head.
+					/// </summary>
+					struct FramingHeadCheck
+					{
+						const char* firstField = nullptr;
+
+						bool headersComplete = false;
+					};
+
+					/// <summary>
+					/// Whether http_parser, as it stands, reads the framing head the way the
+					/// tokenizer read the head it stands in for. Accepting it isn't enough, since
+					/// http_parser is lenient about start lines and can read on into the line
+					/// endings after one. The first header has to begin where the start line
+					/// ended, and the headers have to be complete where the framing head ends.
+					/// The check runs on a copy of the parser without callbacks, so nothing is
+					/// changed.
+					/// </summary>
+					bool IsFramingHeadSound(const http_parser& parser, const std::string& framingHead, const size_t startLineLength)
+					{
+						static const http_parser_settings settings = []()
+						{
+							http_parser_settings s;
+							http_parser_settings_init(&s);
+
+							s.on_header_field = [](http_parser* p, const char* at, size_t)
+							{
+								auto check = static_cast<FramingHeadCheck*>(p->data);
+
+								if (check->firstField == nullptr)
+								{
+									check->firstField = at;
+								}
+
+								return 0;
+							};
+
+							s.on_headers_complete = [](http_parser* p)
+							{
+								static_cast<FramingHeadCheck*>(p->data)->headersComplete = true;
+								return 0;
+							};
+
+							return s;
+						}();
+
+						FramingHeadCheck check;
+
+						http_parser scratch = parser;
+						scratch.data = &check;
+
+						const auto parsed = http_parser_execute(&scratch, &settings, framingHead.data(), framingHead.size());
+
+						if (HTTP_PARSER_ERRNO(&scratch) != HPE_OK || parsed != framingHead.size() || !check.headersComplete)
+						{
+							return false;
+						}
+
+						// The start line and its CRLF, then either the first header or the CRLF
+						// that ends the head.
+						const bool hasHeaders = framingHead.size() > startLineLength + 4;
+
+						return hasHeaders ? check.firstField == framingHead.data() + startLineLength + 2 : check.firstField == nullptr;
+					}
+				}
+
 				const boost::string_ref BaseHttpTransaction::ContentTypeText = u8"text/";
 
 				const boost::string_ref BaseHttpTransaction::ContentTypeHtml = u8"html";
@@ -146,35 +267,285 @@ namespace te
 					return m_headersComplete;
 				}
 
-				const bool BaseHttpTransaction::Parse(const size_t bytesReceived)
+				void BaseHttpTransaction::HeadersToViews(std::vector<HttpHeaderView>& views)
+				{
+					views.clear();
+					views.reserve(m_headers.size());
+
+					for (auto header = m_headers.begin(); header != m_headers.end(); ++header)
+					{
+						HttpHeaderView view;
+						view.name = header->first.c_str();
+						view.nameLength = static_cast<uint32_t>(header->first.size());
+						view.value = header->second.c_str();
+						view.valueLength = static_cast<uint32_t>(header->second.size());
+						view.knownHeaderId = GetKnownHeaderId(header->first);
+
+						views.push_back(view);
+					}
+				}
+
+				uint32_t BaseHttpTransaction::GetKnownHeaderId(const std::string& header)
+				{
+					static const std::unordered_map<std::string, uint32_t, util::hash::ICaseStringHash, util::hash::ICaseStringEquality> knownHeaders
+					{
+						{ util::http::headers::Host, HttpKnownHeaderHost },
+						{ util::http::headers::Connection, HttpKnownHeaderConnection },
+						{ util::http::headers::ProxyConnection, HttpKnownHeaderProxyConnection },
+						{ util::http::headers::KeepAlive, HttpKnownHeaderKeepAlive },
+						{ util::http::headers::ContentType, HttpKnownHeaderContentType },
+						{ util::http::headers::ContentLength, HttpKnownHeaderContentLength },
+						{ util::http::headers::ContentEncoding, HttpKnownHeaderContentEncoding },
+						{ util::http::headers::TransferEncoding, HttpKnownHeaderTransferEncoding },
+						{ util::http::headers::Accept, HttpKnownHeaderAccept },
+						{ util::http::headers::AcceptEncoding, HttpKnownHeaderAcceptEncoding },
+						{ util::http::headers::AcceptLanguage, HttpKnownHeaderAcceptLanguage },
+						{ util::http::headers::UserAgent, HttpKnownHeaderUserAgent },
+						{ util::http::headers::Referer, HttpKnownHeaderReferer },
+						{ util::http::headers::Origin, HttpKnownHeaderOrigin },
+						{ util::http::headers::Cookie, HttpKnownHeaderCookie },
+						{ util::http::headers::SetCookie, HttpKnownHeaderSetCookie },
+						{ util::http::headers::Location, HttpKnownHeaderLocation },
+						{ util::http::headers::CacheControl, HttpKnownHeaderCacheControl },
+						{ util::http::headers::Pragma, HttpKnownHeaderPragma },
+						{ util::http::headers::Expires, HttpKnownHeaderExpires },
+						{ util::http::headers::LastModified, HttpKnownHeaderLastModified },
+						{ util::http::headers::ETag, HttpKnownHeaderETag },
+						{ util::http::headers::IfModifiedSince, HttpKnownHeaderIfModifiedSince },
+						{ util::http::headers::IfNoneMatch, HttpKnownHeaderIfNoneMatch },
+						{ util::http::headers::Authorization, HttpKnownHeaderAuthorization },
+						{ util::http::headers::Expect, HttpKnownHeaderExpect },
+						{ util::http::headers::Upgrade, HttpKnownHeaderUpgrade },
+						{ util::http::headers::Range, HttpKnownHeaderRange },
+						{ util::http::headers::ContentRange, HttpKnownHeaderContentRange },
+						{ util::http::headers::Vary, HttpKnownHeaderVary },
+						{ util::http::headers::Date, HttpKnownHeaderDate },
+						{ util::http::headers::Server, HttpKnownHeaderServer },
+						{ util::http::headers::ContentDisposition, HttpKnownHeaderContentDisposition },
+						{ util::http::headers::TE, HttpKnownHeaderTe },
+						{ util::http::headers::Trailer, HttpKnownHeaderTrailer }
+					};
+
+					const auto result = knownHeaders.find(header);
+
+					if (result != knownHeaders.end())
+					{
+						return result->second;
+					}
+
+					return HttpKnownHeaderUnknown;
+				}
+
+				const bool BaseHttpTransaction::Parse(const size_t bytesReceived, const bool reportErrors)
+				{
+					if (m_bodyScanActive || TryStartBodyScan())
+					{
+						return ScanBody(bytesReceived, reportErrors);
+					}
+
+					return ExecuteParser(m_buffer.data(), bytesReceived, reportErrors);
+				}
+
+				const bool BaseHttpTransaction::TryStartBodyScan()
+				{
+					if (!m_headersComplete || m_payloadComplete || m_consumeAllBeforeSending || !m_headersSent)
+					{
+						return false;
+					}
+
+					if ((m_httpParser->flags & F_CHUNKED) != 0)
+					{
+						// Anywhere other than within the data of a chunk, we can't tell exactly
+						// where in the framing http_parser left off.
+						if (m_chunkPhase != ChunkPhase::InChunk || m_chunkRemaining == 0)
+						{
+							return false;
+						}
+
+						m_bodyScanner.StartInChunk(m_chunkRemaining);
+					}
+					else
+					{
+						// While http_parser is in a body of known length, content_length holds
+						// what's left of it. The maximum means the body runs until the connection
+						// closes.
+						const uint64_t remaining = m_httpParser->content_length;
+
+						if (remaining == 0 || remaining == std::numeric_limits<uint64_t>::max())
+						{
+							return false;
+						}
+
+						m_bodyScanner.StartLengthDelimited(remaining);
+					}
+
+					m_bodyScanActive = true;
+
+					return true;
+				}
+
+				const bool BaseHttpTransaction::ScanBody(const size_t bytesReceived, const bool reportErrors)
+				{
+					size_t consumed = 0;
+
+					const auto result = m_bodyScanner.Scan(m_buffer.data(), bytesReceived, consumed);
+
+					if (result == BodyScanner::ScanResult::Error)
+					{
+						m_bodyScanActive = false;
+
+						if (reportErrors)
+						{
+							ReportError(u8"In BaseHttpTransaction::ScanBody(const size_t, const bool) - Malformed chunked framing.");
+						}
+
+						return false;
+					}
+
+					m_payload.insert(m_payload.end(), m_buffer.data(), m_buffer.data() + consumed);
+
+					// Something has been sent by now, so the hash could never cover the payload.
+					m_payloadHashValid = false;
+
+					if (result == BodyScanner::ScanResult::NeedMore)
+					{
+						return true;
+					}
+
+					m_bodyScanActive = false;
+
+					const bool keepAlive = http_should_keep_alive(m_httpParser) != 0;
+
+					// http_parser never saw the rest of the body, so it's reset to where it would
+					// have been had it parsed the body itself, expecting the next message.
+					const auto parserType = static_cast<http_parser_type>(m_httpParser->type);
+					http_parser_init(m_httpParser, parserType);
+					m_httpParser->data = this;
+
+					OnMessageComplete(m_httpParser);
+
+					if (consumed == bytesReceived)
+					{
+						return true;
+					}
+
+					if (!keepAlive)
+					{
+						if (reportErrors)
+						{
+							ReportError(u8"In BaseHttpTransaction::ScanBody(const size_t, const bool) - Data followed the end of a message on a connection that is to be closed.");
+						}
+
+						return false;
+					}
+
+					m_pipelined.assign(m_buffer.data() + consumed, m_buffer.data() + bytesReceived);
+
+					return true;
+				}
+
+				const bool BaseHttpTransaction::ExecuteParser(const char* data, const size_t length, const bool reportErrors)
 				{
-					auto nparsed = http_parser_execute(m_httpParser, &m_httpParserSettings, m_buffer.data(), bytesReceived);
+					m_parseEnd = data + length;
+
+					size_t nparsed = 0;
+					size_t headLength = 0;
+
+					if (!m_messageStarted && TokenizeHead(data, length, headLength))
+					{
+						// The headers themselves come from the tokenizer, so http_parser is only
+						// shown what it needs to frame the message, and then the body.
+						m_headTokenized = true;
+						const auto framingParsed = http_parser_execute(m_httpParser, &m_httpParserSettings, m_framingHead.data(), m_framingHead.size());
+						m_headTokenized = false;
+
+						// ::TokenizeHead(...) has already seen that a scratch parser reads all of it,
+						// so a short read here can only mean a callback stopped it. Nothing of the
+						// head is counted as consumed then, and the parse fails.
+						nparsed = framingParsed == m_framingHead.size() ? headLength : 0;
+
+						// Careful not to hand http_parser nothing, which it takes to mean the connection
+						// was closed.
+						if (HTTP_PARSER_ERRNO(m_httpParser) == HPE_OK && framingParsed == m_framingHead.size() && length > headLength)
+						{
+							nparsed += http_parser_execute(m_httpParser, &m_httpParserSettings, data + headLength, length - headLength);
+						}
+					}
+					else
+					{
+						nparsed = http_parser_execute(m_httpParser, &m_httpParserSettings, data, length);
+					}
+
+					m_parseEnd = nullptr;
 
 					if (m_httpParser->upgrade == 1)
 					{
-						ReportError(u8"In BaseHttpTransaction::Parse(const size_t&) - Upgrade requested. Unsupported.");
+						if (reportErrors)
+						{
+							ReportError(u8"In BaseHttpTransaction::Parse(const size_t&) - Upgrade requested. Unsupported.");
+						}
+
 						return false;
 					}
 
+					if (HTTP_PARSER_ERRNO(m_httpParser) == HPE_PAUSED)
+					{
+						// We paused at the end of the message, see ::OnMessageComplete(...), and
+						// nparsed is exactly where it ended.
+						http_parser_pause(m_httpParser, 0);
+
+						m_pipelined.assign(data + nparsed, data + length);
+
+						return true;
+					}
+
 					if (m_httpParser->http_errno != 0)
 					{
-						std::string errMsg(u8"In BaseHttpTransaction::Parse(const size_t&) - Failed to parse payload. Got http_parser error: ");
-						errMsg.append(http_errno_description(HTTP_PARSER_ERRNO(m_httpParser)));
-						ReportError(errMsg);
+						if (reportErrors)
+						{
+							std::string errMsg(u8"In BaseHttpTransaction::Parse(const size_t&) - Failed to parse payload. Got http_parser error: ");
+							errMsg.append(http_errno_description(HTTP_PARSER_ERRNO(m_httpParser)));
+							ReportError(errMsg);
+						}
+
 						return false;
 					}
 
-					if (nparsed != bytesReceived)
+					if (nparsed != length)
 					{
-						ReportError(u8"In BaseHttpTransaction::Parse(const size_t&) - Not all bytes were parsed. Unknown error occurred.");
+						if (reportErrors)
+						{
+							ReportError(u8"In BaseHttpTransaction::Parse(const size_t&) - Not all bytes were parsed. Unknown error occurred.");
+						}
+
 						return false;
 					}
 
 					return true;
 				}
 
+				const http_errno BaseHttpTransaction::GetParseError() const
+				{
+					return HTTP_PARSER_ERRNO(m_httpParser);
+				}
+
+				const bool BaseHttpTransaction::IsUpgradeRequested() const
+				{
+					return m_httpParser->upgrade == 1;
+				}
+
+				const std::vector<char>& BaseHttpTransaction::GetPipelinedData() const
+				{
+					return m_pipelined;
+				}
+
 				boost::asio::mutable_buffers_1 BaseHttpTransaction::GetReadBuffer()
 				{	
+					return GetReadBuffer(PayloadBufferReadSize);
+				}
+
+				boost::asio::mutable_buffers_1 BaseHttpTransaction::GetReadBuffer(const uint32_t maxReadSize)
+				{
 					if (m_buffer.size() < PayloadBufferReadSize)
 					{
 						m_buffer.resize(PayloadBufferReadSize);
@@ -185,7 +556,9 @@ namespace te
 						m_payload.clear();
 					}
 
-					return boost::asio::mutable_buffers_1(m_buffer.data(), PayloadBufferReadSize);
+					const uint32_t readSize = (maxReadSize == 0 || maxReadSize > PayloadBufferReadSize) ? PayloadBufferReadSize : maxReadSize;
+
+					return boost::asio::mutable_buffers_1(m_buffer.data(), readSize);
 				}
 
 				boost::asio::const_buffers_1 BaseHttpTransaction::GetWriteBuffer()
@@ -193,12 +566,22 @@ namespace te
 					if (!m_headersSent)
 					{
 						auto headersVector = HeadersToVector();				
-						auto newSize = headersVector.size() + m_payload.size();
-						headersVector.reserve(newSize);
 
-						if (m_payload.size() > 0)
-						{	
-							headersVector.insert(headersVector.end(), m_payload.begin(), m_payload.end());
+						if (m_payloadDechunked)
+						{
+							// The payload was held without its chunked framing, since nothing had
+							// been sent yet. Now that it's going out as it is, it needs framing.
+							AppendHeldPayloadAsChunks(headersVector);
+						}
+						else
+						{
+							auto newSize = headersVector.size() + m_payload.size();
+							headersVector.reserve(newSize);
+
+							if (m_payload.size() > 0)
+							{	
+								headersVector.insert(headersVector.end(), m_payload.begin(), m_payload.end());
+							}
 						}
 
 						m_payload = std::move(headersVector);
@@ -209,6 +592,121 @@ namespace te
 					return boost::asio::const_buffers_1(m_payload.data(), m_payload.size());
 				}
 
+				const bool BaseHttpTransaction::BeginEncodedWrite(const PayloadEncoder::Coding coding, const int level)
+				{
+					if (m_headersSent || !m_payloadComplete || m_encoder || IsPayloadCompressed())
+					{
+						return false;
+					}
+
+					try
+					{
+						m_encoder.reset(new PayloadEncoder(coding, level));
+					}
+					catch (std::exception& e)
+					{
+						std::string errMessage(u8"In BaseHttpTransaction::BeginEncodedWrite(const PayloadEncoder::Coding, const int) - ");
+						errMessage.append(e.what());
+						ReportError(errMessage);
+						return false;
+					}
+
+					std::string codingName(PayloadEncoder::GetCodingName(coding));
+					std::string chunked(u8"chunked");
+
+					RemoveHeader(util::http::headers::ContentLength);
+					RemoveHeader(util::http::headers::ContentEncoding);
+					RemoveHeader(util::http::headers::TransferEncoding);
+					AddHeader(util::http::headers::ContentEncoding, codingName);
+					AddHeader(util::http::headers::TransferEncoding, chunked);
+
+					m_encodeOffset = 0;
+					m_encodedWriteComplete = false;
+					m_encodedOutputBytes = 0;
+					m_encodeNanoseconds = 0;
+					m_encodeFirstSliceNanoseconds = 0;
+
+					return true;
+				}
+
+				boost::asio::const_buffers_1 BaseHttpTransaction::GetNextEncodedWriteBuffer(const size_t maxSliceSize)
+				{
+					if (!m_encoder || m_encodedWriteComplete)
+					{
+						throw std::runtime_error(u8"In BaseHttpTransaction::GetNextEncodedWriteBuffer(const size_t) - No encoded write is in progress.");
+					}
+
+					const auto start = std::chrono::steady_clock::now();
+					const bool isFirst = !m_headersSent;
+
+					m_encodedWriteBuffer.clear();
+
+					if (!m_headersSent)
+					{
+						m_encodedWriteBuffer = HeadersToVector();
+						m_headersSent = true;
+					}
+
+					std::vector<char> compressed;
+					compressed.reserve(maxSliceSize / 2);
+
+					// Keep going until the coding gives something up, so that we never hand out
+					// nothing but chunked framing, or nothing at all.
+					while (compressed.empty() && !m_encodedWriteComplete)
+					{
+						const size_t sliceSize = std::min(maxSliceSize, m_payload.size() - m_encodeOffset);
+
+						m_encoder->Encode(m_payload.data() + m_encodeOffset, sliceSize, compressed);
+						m_encodeOffset += sliceSize;
+
+						if (m_encodeOffset >= m_payload.size())
+						{
+							m_encoder->Finish(compressed);
+							m_encodedWriteComplete = true;
+						}
+					}
+
+					if (!compressed.empty())
+					{
+						m_encodedWriteBuffer.reserve(m_encodedWriteBuffer.size() + compressed.size() + 32);
+						AppendChunkHeader(m_encodedWriteBuffer, compressed.size());
+						m_encodedWriteBuffer.insert(m_encodedWriteBuffer.end(), compressed.begin(), compressed.end());
+						m_encodedWriteBuffer.push_back('\r');
+						m_encodedWriteBuffer.push_back('\n');
+						m_encodedOutputBytes += compressed.size();
+					}
+
+					if (m_encodedWriteComplete)
+					{
+						m_encodedWriteBuffer.insert(m_encodedWriteBuffer.end(), { '0', '\r', '\n', '\r', '\n' });
+						m_encoder.reset();
+					}
+
+					const uint64_t elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+					m_encodeNanoseconds += elapsed;
+
+					if (isFirst)
+					{
+						m_encodeFirstSliceNanoseconds = elapsed;
+					}
+
+					return boost::asio::const_buffers_1(m_encodedWriteBuffer.data(), m_encodedWriteBuffer.size());
+				}
+
+				const bool BaseHttpTransaction::IsEncodedWriteComplete() const
+				{
+					return m_encodedWriteComplete;
+				}
+
+				void BaseHttpTransaction::GetEncodedWriteStats(uint64_t& inputBytes, uint64_t& outputBytes, uint64_t& nanoseconds, uint64_t& firstSliceNanoseconds) const
+				{
+					inputBytes = static_cast<uint64_t>(m_encodeOffset);
+					outputBytes = m_encodedOutputBytes;
+					nanoseconds = m_encodeNanoseconds;
+					firstSliceNanoseconds = m_encodeFirstSliceNanoseconds;
+				}
+
 				const std::vector<char>& BaseHttpTransaction::GetPayload() const
 				{
 					return m_payload;
@@ -218,6 +716,8 @@ namespace te
 				{
 					m_payload = std::move(payload);
 					m_payloadComplete = true;
+					m_payloadDechunked = false;
+					m_payloadDecompressed = false;
 
 					if (includesHeaders)
 					{
@@ -242,6 +742,8 @@ namespace te
 				{
 					m_payload = payload;
 					m_payloadComplete = true;
+					m_payloadDechunked = false;
+					m_payloadDecompressed = false;
 
 					if (includesHeaders)
 					{
@@ -267,6 +769,19 @@ namespace te
 					return m_payloadComplete;
 				}
 
+				const bool BaseHttpTransaction::GetPayloadHash(uint64_t& hash, uint64_t& length) const
+				{
+					hash = m_payloadHash.Digest();
+					length = m_payloadHash.GetLength();
+
+					return m_payloadHashValid;
+				}
+
+				const uint64_t BaseHttpTransaction::GetPayloadHashNanoseconds() const
+				{
+					return m_payloadHashNanoseconds;
+				}
+
 				const int32_t BaseHttpTransaction::GetShouldBlock() const
 				{
 					return m_shouldBlock;
@@ -279,50 +794,8 @@ namespace te
 
 				void BaseHttpTransaction::Make204()
 				{
-					std::stringstream os;
-
-					os << u8"HTTP/"; 
-
-					switch (m_httpVersion)
-					{
-
-					case HttpProtocolVersion::HTTP1:
-						os << u8"1.0";
-						break;
-					case HttpProtocolVersion::HTTP1_1:
-						os << u8"1.1";
-						break;
-					case HttpProtocolVersion::HTTP2:
-						os << u8"2.0";
-						break;
-
-						default:
-							os << u8"1.1";
-						break;
-					}
-
-					os << u8" 204 No Content\r\nDate: ";
-
-					std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
-					std::time_t now_t = std::chrono::system_clock::to_time_t(now);
-					os << std::ctime(&now_t);
-					os << u8"\r\nExpires: ";
-					std::chrono::system_clock::time_point epoch;
-					std::time_t epoch_t = std::chrono::system_clock::to_time_t(epoch);
-					os << std::ctime(&epoch_t);                    
-					os << u8"\r\nContent-Length: 0\r\n\r\n";
-
-					std::string fs = os.str();
-
-					m_payload.clear();
-
-					m_payload.assign(fs.begin(), fs.end());
-
-					m_headers.clear();
-
-					m_headersSent = true;
-					m_headersComplete = true;
-					m_payloadComplete = true;
+					// The canned response is shared with every other block, so it's copied.
+					SetPayload(*BlockResponses::Get204(m_httpVersion), true);
 				}
 
 				const bool BaseHttpTransaction::GetConsumeAllBeforeSending() const
@@ -362,6 +835,61 @@ namespace te
 					return false;
 				}
 
+				const bool BaseHttpTransaction::IsPayloadDecodable() const
+				{
+					std::vector<std::string> codings;
+					return GetContentCodings(codings);
+				}
+
+				const bool BaseHttpTransaction::GetContentCodings(std::vector<std::string>& codings) const
+				{
+					codings.clear();
+
+					const auto contentEncoding = GetHeader(util::http::headers::ContentEncoding);
+
+					for (auto it = contentEncoding.first; it != contentEncoding.second; ++it)
+					{
+						boost::string_ref remaining(it->second);
+
+						while (!remaining.empty())
+						{
+							auto comma = remaining.find(',');
+							auto token = remaining.substr(0, comma);
+							remaining = comma == boost::string_ref::npos ? boost::string_ref() : remaining.substr(comma + 1);
+
+							while (!token.empty() && (token.front() == ' ' || token.front() == '\t'))
+							{
+								token.remove_prefix(1);
+							}
+
+							while (!token.empty() && (token.back() == ' ' || token.back() == '\t'))
+							{
+								token.remove_suffix(1);
+							}
+
+							if (token.empty() || boost::iequals(token, u8"identity"))
+							{
+								continue;
+							}
+
+							if (boost::iequals(token, u8"gzip") || boost::iequals(token, u8"x-gzip"))
+							{
+								codings.emplace_back(u8"gzip");
+							}
+							else if (boost::iequals(token, u8"deflate"))
+							{
+								codings.emplace_back(u8"deflate");
+							}
+							else
+							{
+								return false;
+							}
+						}
+					}
+
+					return true;
+				}
+
 				const bool BaseHttpTransaction::IsPayloadJson() const
 				{
 					return DoesContentTypeContain(ContentTypeJson);
@@ -531,69 +1059,51 @@ namespace te
 						return true;
 					}
 
-					std::string gzipEnc(u8"gzip");
-					std::string deflateEnc(u8"deflate");
+					std::vector<std::string> codings;
 
-					std::string detectedEncoding;					
-
-					const auto contentEncoding = GetHeader(util::http::headers::ContentEncoding);
-
-					if (contentEncoding.first != contentEncoding.second)
+					if (!GetContentCodings(codings))
 					{
-						if (boost::iequals(contentEncoding.first->second, gzipEnc))
-						{
-							detectedEncoding = gzipEnc;
-						}
-						else if (boost::iequals(contentEncoding.first->second, deflateEnc))
-						{
-							detectedEncoding = deflateEnc;
-						}
-						else
-						{
-							ReportError("In BaseHttpTransaction::DecompressPayload() - Unknown Content-Encoding, cannot decompress: " + contentEncoding.first->second);
-							return false;							
-						}
-					}
-
-					if (detectedEncoding.size() == 0)
-					{
-						// Count not determine content encoding for decompression.
-						ReportError("In BaseHttpTransaction::DecompressPayload() - Count not determine content encoding for decompression.");
+						const auto contentEncoding = GetHeader(util::http::headers::ContentEncoding);
+						ReportError("In BaseHttpTransaction::DecompressPayload() - Unknown Content-Encoding, cannot decompress: " + contentEncoding.first->second);
 						return false;
 					}
 
-					if (boost::iequals(detectedEncoding, deflateEnc))
-					{
-						// Decompress deflate.
-						if (!DecompressDeflate())
-						{						
-							ReportError("In BaseHttpTransaction::DecompressPayload() - Failed to decompress Deflate encoded payload!");
-							return false;							
-						}
-						else
-						{
-							RemoveHeader(util::http::headers::ContentEncoding);
-							RemoveHeader(util::http::headers::TransferEncoding);
-							return true;
-						}
-					}
-					else
+					// Codings are listed in the order they were applied, so they're undone in
+					// reverse.
+					for (auto it = codings.rbegin(); it != codings.rend(); ++it)
 					{
-						// Decompress gzip.
-						if (!DecompressGzip())
+						if (*it == u8"deflate")
 						{
-							ReportError("In BaseHttpTransaction::DecompressPayload() - Failed to decompress Gzip encoded payload!");
-							return false;							
+							if (!DecompressDeflate())
+							{
+								ReportError("In BaseHttpTransaction::DecompressPayload() - Failed to decompress Deflate encoded payload!");
+								return false;
+							}
 						}
 						else
 						{
-							RemoveHeader(util::http::headers::ContentEncoding);
-							RemoveHeader(util::http::headers::TransferEncoding);
-							return true;
+							if (!DecompressGzip())
+							{
+								ReportError("In BaseHttpTransaction::DecompressPayload() - Failed to decompress Gzip encoded payload!");
+								return false;
+							}
 						}
 					}
 
-					return false;
+					RemoveHeader(util::http::headers::ContentEncoding);
+					RemoveHeader(util::http::headers::TransferEncoding);
+					m_payloadDecompressed = !codings.empty();
+					return true;
+				}
+
+				const bool BaseHttpTransaction::WasPayloadDecompressed() const
+				{
+					return m_payloadDecompressed;
+				}
+
+				const bool BaseHttpTransaction::IsPayloadHeldInFull() const
+				{
+					return m_headersComplete && m_payloadComplete && !m_headersSent && (!IsPayloadChunked() || m_payloadDechunked);
 				}
 
 				const bool BaseHttpTransaction::DecompressGzip()
@@ -662,8 +1172,18 @@ namespace te
 						// For some reason, all the example code that boost gives, and all the examples
 						// you'll find of "this works" in terms of using boost::asio::gzip streams do
 						// not function correctly here. This code does.
+						// A zlib stream opens with a two byte header, which names the deflate method
+						// and whose big endian value is a multiple of 31. Anything else is taken
+						// to be a raw deflate stream.
+						const auto cmf = static_cast<unsigned char>(m_payload[0]);
+						const auto flg = m_payload.size() > 1 ? static_cast<unsigned char>(m_payload[1]) : 0;
+						const bool zlibWrapped = (cmf & 0x0F) == 8 && ((cmf << 8) | flg) % 31 == 0;
+
+						boost::iostreams::zlib_params params(boost::iostreams::zlib::default_compression);
+						params.noheader = !zlibWrapped;
+
 						boost::iostreams::back_insert_device< std::vector<char> > decompressorSnk(decompressed);
-						boost::iostreams::zlib_decompressor decomp(boost::iostreams::zlib::default_window_bits);
+						boost::iostreams::zlib_decompressor decomp(params);
 						decomp.write(decompressorSnk, m_payload.data(), m_payload.size());
 						
 					}
@@ -688,91 +1208,62 @@ namespace te
 					return true;
 				}
 			
-				const bool BaseHttpTransaction::ConvertPayloadFromChunkedToFixedLength()
+				void BaseHttpTransaction::AppendHeldPayloadAsChunks(std::vector<char>& out)
 				{
-					std::vector<char> parsedBody;
-					parsedBody.reserve(m_payload.size());
+					const uint64_t chunkSize = m_payload.size() + (m_chunkPhase == ChunkPhase::InChunk ? m_chunkRemaining : 0);
 
-					http_parser_settings parserSettings;
+					out.reserve(out.size() + m_payload.size() + 32);
 
-					auto onDataGeneric = [](http_parser* parser, const char *at, size_t length)->int
+					if (chunkSize > 0)
 					{
-						// This is made to accept but ignore data callbacks we don't care about.
-						return 0;
-					};
-
-					auto onNotificationGeneric = [](http_parser* parser)->int
-					{
-						// This is made to accept but ignore notification callbacks we don't care about.
-						return 0;
-					};
+						AppendChunkHeader(out, chunkSize);
+						out.insert(out.end(), m_payload.begin(), m_payload.end());
 
-					auto onBody = [](http_parser* parser, const char *at, size_t length)->int
-					{
-						if (parser->data == nullptr)
+						// Inside a chunk, the rest of it, and its CRLF, are still to be parsed,
+						// and are sent on as they are.
+						if (m_chunkPhase != ChunkPhase::InChunk)
 						{
-							return -1;
+							out.push_back('\r');
+							out.push_back('\n');
 						}
-
-						auto bodyContainer = static_cast<std::vector<char>*>(parser->data);
-						std::copy(at, at + length, std::back_inserter(*bodyContainer));
-						return 0;
-					};
-
-					parserSettings.on_body = onBody;
-					parserSettings.on_chunk_complete = onNotificationGeneric;
-					parserSettings.on_chunk_header = onNotificationGeneric;
-					parserSettings.on_headers_complete = onNotificationGeneric;
-					parserSettings.on_header_field = onDataGeneric;
-					parserSettings.on_header_value = onDataGeneric;
-					parserSettings.on_message_begin = onNotificationGeneric;
-					parserSettings.on_message_complete = onNotificationGeneric;
-					parserSettings.on_status = onDataGeneric;
-					parserSettings.on_url = onDataGeneric;					
-
-					http_parser* parser;
-					parser = static_cast<http_parser*>(malloc(sizeof(http_parser)));
-
-					if (!parser)
-					{
-						std::string error(u8"In BaseHttpTransaction::ConvertPayloadFromChunkedToFixedLength() - Failed to allocate memory for http-parser.");
-						ReportError(error);
-						return false;
 					}
 
-					http_parser_init(parser, HTTP_BOTH);
-
-					parser->data = &parsedBody;
+					switch (m_chunkPhase)
+					{
+						case ChunkPhase::InLastChunk:
+						{
+							// The CRLF that ends the message comes once any trailers are parsed.
+							out.insert(out.end(), { '0', '\r', '\n' });
+						}
+						break;
 
-					std::vector<char> finalVec = HeadersToVector();
-					auto newSize = finalVec.size() + m_payload.size();
-					finalVec.reserve(newSize);
+						case ChunkPhase::Done:
+						{
+							out.insert(out.end(), { '0', '\r', '\n', '\r', '\n' });
+						}
+						break;
 
-					if (m_payload.size() > 0)
-					{
-						finalVec.insert(finalVec.end(), m_payload.begin(), m_payload.end());
+						default:
+						break;
 					}
 
-					auto nparsed = http_parser_execute(parser, &parserSettings, finalVec.data(), finalVec.size());
+					m_payloadDechunked = false;
+				}
 
-					if (parser->http_errno != 0)
+				const bool BaseHttpTransaction::ConvertPayloadFromChunkedToFixedLength()
+				{
+					if (m_headersSent)
 					{
-						auto errorMessage = std::string(u8"In BaseHttpTransaction::ConvertPayloadFromChunkedToFixedLength() - Got http_parser error: ");
-						errorMessage.append(http_errno_description(HTTP_PARSER_ERRNO(parser)));
-						ReportError(errorMessage);						
-						free(parser);
-
-						auto body = std::string(finalVec.data());
-						ReportError(body);
-
+						ReportError(u8"In BaseHttpTransaction::ConvertPayloadFromChunkedToFixedLength() - Part of the payload has already been sent, so it can't be made fixed length.");
 						return false;
 					}
 
-					if (parsedBody.size() <= 0)
+					// Nothing has been sent, so the payload has been held as the bare body all
+					// along, with any chunked framing stripped as it was parsed.
+					if (m_payload.size() <= 0)
 					{
 						std::string errorMessage(u8"In BaseHttpTransaction::ConvertPayloadFromChunkedToFixedLength() - Finalized payload is empty.");
 						ReportWarning(errorMessage);
-						free(parser);
 						return false;
 					}
 
@@ -780,26 +1271,79 @@ namespace te
 					// will adjust our headers properly to make it a fixed length transaction.
 					if (!IsPayloadCompressed())
 					{	
-						SetPayload(std::move(parsedBody));						
+						std::vector<char> body;
+						body.swap(m_payload);
+						SetPayload(std::move(body));
+						return true;
 					}
-					else
+
+					// If the payload is compressed, calling the decompress function
+					// will handle mutating our headers correctly to make it a fixed
+					// length transaction.
+					if (!DecompressPayload())
+					{
+						std::string errorMessage(u8"In BaseHttpTransaction::ConvertPayloadFromChunkedToFixedLength() - Failed to decompress payload.");
+						ReportError(errorMessage);
+						return false;
+					}
+
+					return true;
+				}
+
+				const bool BaseHttpTransaction::TokenizeHead(const char* data, const size_t length, size_t& headLength)
+				{
+					#ifdef HTTP_FE_DISABLE_HEADER_TOKENIZER
+					return false;
+					#else
+					boost::string_ref startLine;
+
+					if (!HeaderBlockTokenizer::TokenizeHead(data, data + length, startLine, m_tokenizedHeaders, headLength))
 					{
-						m_payload = std::move(parsedBody);
+						return false;
+					}
 
-						// If the payload is compressed, calling the decompress function
-						// will handle mutating our headers correctly to make it a fixed
-						// length transaction.
-						if (!DecompressPayload())
+					m_framingHead.clear();
+					m_framingHead.append(startLine.data(), startLine.size()).append(u8"\r\n");
+
+					for (const auto& header : m_tokenizedHeaders)
+					{
+						if (IsFramingHeader(header.name))
 						{
-							std::string errorMessage(u8"In BaseHttpTransaction::ConvertPayloadFromChunkedToFixedLength() - Failed to decompress payload.");
-							ReportError(errorMessage);							
-							free(parser);
-							return false;
+							m_framingHead.append(header.name.data(), header.name.size()).append(u8": ");
+							m_framingHead.append(header.value.data(), header.value.size()).append(u8"\r\n");
 						}
 					}
 
-					free(parser);
-					return true;
+					m_framingHead.append(u8"\r\n");
+
+					return IsFramingHeadSound(*m_httpParser, m_framingHead, startLine.size());
+					#endif
+				}
+
+				void BaseHttpTransaction::AddLastHeader()
+				{
+					if (m_lastHeaderValuePending)
+					{
+						m_lastHeaderValuePending = false;
+						AddHeader(m_lastHeader, m_lastHeaderValue, false);
+					}
+				}
+
+				void BaseHttpTransaction::AddTokenizedHeaders()
+				{
+					for (const auto& header : m_tokenizedHeaders)
+					{
+						AddHeader(header.name.to_string(), header.value.to_string(), false);
+					}
+
+					if (!m_tokenizedHeaders.empty())
+					{
+						m_lastHeader = m_tokenizedHeaders.back().name.to_string();
+						m_lastHeaderFieldFresh = true;
+						m_lastHeaderValueFresh = false;
+					}
+
+					m_headerBlockTokenized = true;
 				}
 
 				int BaseHttpTransaction::OnMessageBegin(http_parser* parser)
@@ -820,8 +1364,25 @@ namespace te
 						trans->m_headersSent = false;
 						trans->m_headersComplete = false;
 						trans->m_lastHeader = std::string("");
+						trans->m_lastHeaderValue.clear();
+						trans->m_lastHeaderValuePending = false;
 						trans->m_lastHeaderValueFresh = false;
 						trans->m_lastHeaderFieldFresh = false;
+						trans->m_headerBlockTokenized = false;
+						trans->m_chunkPhase = ChunkPhase::BetweenChunks;
+						trans->m_chunkRemaining = 0;
+						trans->m_payloadDechunked = false;
+						trans->m_payloadDecompressed = false;
+						trans->m_bodyScanActive = false;
+						trans->m_payloadHash.Reset();
+						trans->m_payloadHashValid = true;
+						trans->m_payloadHashNanoseconds = 0;
+						trans->m_messageStarted = true;
+
+						if (trans->m_headTokenized)
+						{
+							trans->AddTokenizedHeaders();
+						}
 						
 					}
 					else
@@ -846,8 +1407,11 @@ namespace te
 							throw std::runtime_error(u8"In BaseHttpTransaction::OnHeadersComplete() - http_parser->data is nullptr when it should contain a pointer the http_parser's owning BaseHttpTransaction object.");
 						}
 
+						trans->AddLastHeader();
+
 						trans->m_headersComplete = true;
 						trans->m_headersSent = false;
+						trans->m_headerBlockTokenized = false;
 
 					}
 					else
@@ -872,8 +1436,19 @@ namespace te
 							throw std::runtime_error(u8"In BaseHttpTransaction::OnMessageComplete() - http_parser->data is nullptr when it should contain a pointer the http_parser's owning BaseHttpTransaction object.");
 						}
 
+						// The last trailer, if there were any.
+						trans->AddLastHeader();
+
 						trans->m_payloadComplete = true;
 
+						// Anything after this belongs to the next message, so http_parser is
+						// stopped here rather than carrying on into it and overwriting this one.
+						// Only while it's running though. ::ScanBody(...) calls this directly.
+						if (trans->m_parseEnd != nullptr)
+						{
+							http_parser_pause(parser, 1);
+						}
+
 						// When the payload is complete, and we want to consume it all, we need to convert it
 						// from chunked encoding to a fixed length payload.
 						if (trans->GetConsumeAllBeforeSending())
@@ -916,11 +1491,19 @@ namespace te
 							throw std::runtime_error(u8"In BaseHttpTransaction::OnChunkHeader() - http_parser->data is nullptr when it should contain a pointer the http_parser's owning BaseHttpTransaction object.");
 						}
 
-						std::stringstream chunkHeaderSs;
-						chunkHeaderSs << std::hex << parser->content_length;
-						chunkHeaderSs << u8"\r\n";
-						std::string chunkHeader(chunkHeaderSs.str());
-						trans->m_payload.insert(trans->m_payload.end(), chunkHeader.begin(), chunkHeader.end());
+						trans->m_chunkRemaining = parser->content_length;
+						trans->m_chunkPhase = parser->content_length > 0 ? ChunkPhase::InChunk : ChunkPhase::InLastChunk;
+
+						// Framing is only kept once the transaction is being sent on as it's read.
+						// Until then, the payload is held as the bare body.
+						if (trans->m_headersSent)
+						{
+							AppendChunkHeader(trans->m_payload, parser->content_length);
+						}
+						else
+						{
+							trans->m_payloadDechunked = true;
+						}
 					}
 					else
 					{
@@ -946,8 +1529,13 @@ namespace te
 							throw std::runtime_error(u8"In BaseHttpTransaction::OnChunkComplete() - http_parser->data is nullptr when it should contain a pointer the http_parser's owning BaseHttpTransaction object.");
 						}
 
-						trans->m_payload.push_back('\r');
-						trans->m_payload.push_back('\n');
+						if (trans->m_headersSent)
+						{
+							trans->m_payload.push_back('\r');
+							trans->m_payload.push_back('\n');
+						}
+
+						trans->m_chunkPhase = trans->m_chunkPhase == ChunkPhase::InLastChunk ? ChunkPhase::Done : ChunkPhase::BetweenChunks;
 					}
 					else
 					{
@@ -970,9 +1558,15 @@ namespace te
 						{
 							throw std::runtime_error(u8"In BaseHttpTransaction::OnHeaderField() - http_parser->data is nullptr when it should contain a pointer the http_parser's owning BaseHttpTransaction object.");
 						}
+
+						if (trans->m_headerBlockTokenized)
+						{
+							return 0;
+						}
 						
 						if (trans->m_lastHeaderFieldFresh)
 						{
+							trans->AddLastHeader();
 							trans->m_lastHeader = std::string(at, length);
 							trans->m_lastHeaderFieldFresh = false;
 						}
@@ -981,13 +1575,9 @@ namespace te
 							trans->m_lastHeader.append(std::string(at, length));
 						}
 						
+						// A read that ends exactly at the end of a name is followed by an empty
+						// fragment of it at the start of the next read, which is harmless.
 						trans->m_lastHeaderValueFresh = true;
-
-						if (length == 0)
-						{
-							trans->ReportError(u8"In BaseHttpTransaction::OnHeaderField() - Length provided for the parsed header field/name is zero.");
-							return -1;
-						}
 					}
 					else
 					{
@@ -1011,30 +1601,28 @@ namespace te
 							throw std::runtime_error(u8"In BaseHttpTransaction::OnHeaderValue() - http_parser->data is nullptr when it should contain a pointer the http_parser's owning BaseHttpTransaction object.");
 						}
 
+						if (trans->m_headerBlockTokenized)
+						{
+							return 0;
+						}
+
 						trans->m_lastHeaderFieldFresh = true;
 
 						if (trans->m_lastHeader.length() > 0)
 						{	
+							// Since we're not guaranteed to be given all of our header data in one
+							// shot, the value is only added once it's complete, which is when the
+							// next header or the end of the headers arrives. Adding it sooner would
+							// compare a fragment of it against the values already there.
 							if (trans->m_lastHeaderValueFresh)
 							{
-								std::string headerValue(at, length);
-								trans->AddHeader(trans->m_lastHeader, headerValue, false);			
+								trans->m_lastHeaderValue.assign(at, length);
 								trans->m_lastHeaderValueFresh = false;
+								trans->m_lastHeaderValuePending = true;
 							}
 							else
 							{
-								// Since we're not guaranteed to be given all of our header data
-								// in one shot, we must assume that this data is meant to be appended
-								// to the last entered header.
-								auto range = trans->m_headers.equal_range(trans->m_lastHeader); 
-								
-								if (range.first != range.second)
-								{	
-									auto appender = std::prev(range.second);
-									
-									// Ordering is supposed to be guaranteed. This must be it.
-									appender->second.append(std::string(at, length));
-								}
+								trans->m_lastHeaderValue.append(at, length);
 							}
 						}
 						else
@@ -1067,8 +1655,27 @@ namespace te
 							throw std::runtime_error(u8"In BaseHttpTransaction::OnBody() - http_parser->data is nullptr when it should contain a pointer the http_parser's owning BaseHttpTransaction object.");
 						}
 
-						trans->m_payload.reserve(trans->m_payload.capacity() + length);
-						std::copy(at, at + length, std::back_inserter(trans->m_payload));
+						trans->m_payload.insert(trans->m_payload.end(), at, at + length);
+
+						if (trans->m_chunkPhase == ChunkPhase::InChunk)
+						{
+							trans->m_chunkRemaining -= std::min(trans->m_chunkRemaining, static_cast<uint64_t>(length));
+						}
+
+						// Only worth hashing while the whole payload might still be held. Once
+						// anything has been sent on, the hash could never cover all of it.
+						if (!trans->m_headersSent && trans->m_payloadHashValid)
+						{
+							const auto hashStart = std::chrono::steady_clock::now();
+
+							trans->m_payloadHash.Update(at, length);
+
+							trans->m_payloadHashNanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - hashStart).count());
+						}
+						else
+						{
+							trans->m_payloadHashValid = false;
+						}
 					}
 					else
 					{
@@ -8,13 +8,18 @@
 #pragma once
 
 #include <cstring>
+#include <memory>
 #include <string>
 #include <map>
 #include <boost/asio/buffers_iterator.hpp>
 #include <boost/asio/streambuf.hpp>
 #include <boost/utility/string_ref.hpp>
 #include "http_parser.h"
+#include "HeaderBlockTokenizer.hpp"
+#include "BodyScanner.hpp"
+#include "PayloadEncoder.hpp"
 #include "../../util/cb/EventReporter.hpp"
+#include "../../util/hash/XxHash64.hpp"
 
 #ifdef _MSC_VER 
 	#define strncasecmp _strnicmp
@@ -90,6 +95,12 @@ namespace te
 				{
 				public:
 
+					/// <summary>
+					/// Increments by which the payload buffer will be resized, also the initial
+					/// reserved size. No single read delivers more than this.
+					/// </summary>
+					static constexpr uint32_t PayloadBufferReadSize = 131072;
+
 					BaseHttpTransaction();
 					
 					virtual ~BaseHttpTransaction();
@@ -213,6 +224,32 @@ namespace te
 					/// </returns>
 					virtual std::vector<char> HeadersToVector() = 0;
 
+					/// <summary>
+					/// Fills the supplied container with a view of every header, in the same order
+					/// that ::HeadersToString() would format them. Each view points directly into
+					/// the transaction's header storage, so the views are invalidated by anything
+					/// that modifies the headers. The container is cleared first, but its capacity
+					/// is kept, so reusing the same container for every call allocates nothing once
+					/// it has grown large enough.
+					/// </summary>
+					/// <param name="views">
+					/// The container to fill.
+					/// </param>
+					virtual void HeadersToViews(std::vector<HttpHeaderView>& views);
+
+					/// <summary>
+					/// Gets the HttpKnownHeader value for the supplied header name. The lookup is
+					/// case insensitive.
+					/// </summary>
+					/// <param name="header">
+					/// The name of the header.
+					/// </param>
+					/// <returns>
+					/// The HttpKnownHeader value for the supplied header name, or
+					/// HttpKnownHeaderUnknown if the header isn't one the Engine recognizes.
+					/// </returns>
+					static uint32_t GetKnownHeaderId(const std::string& header);
+
 					/// <summary>
 					/// Force the transaction to parse its content. This method absolutely must be
 					/// called immediately following any completed read operations using this
@@ -229,6 +266,11 @@ namespace te
 					/// making the sole purpose of the http_parser object to accurately extract
 					/// header information and signal when the end of the transaction has been
 					/// reached.
+					///
+					/// Parsing stops at the end of the message. Anything that followed it in the
+					/// same read, such as the next of several requests a client has pipelined, or
+					/// the final response read along with an interim one, is not parsed into this
+					/// transaction, but kept aside as it is. See ::GetPipelinedData().
 					/// </summary>
 					/// <param name="bytes_transferred">
 					/// The number of bytes_transferred indicated in the asio::async_read* handler
@@ -241,10 +283,43 @@ namespace te
 					/// as well. The value of this parameter is the key to successfully determining
 					/// this and acting accordingly.
 					/// </param>
+					/// <param name="reportErrors">
+					/// Whether a failure should be reported as an error. Pass false where failing
+					/// to parse is an expected answer rather than a fault, such as when finding out
+					/// whether a client is speaking HTTP at all, and consult ::GetParseError() and
+					/// ::IsUpgradeRequested() instead.
+					/// </param>
 					/// <returns>
 					/// True of the parsing operation was a success, false otherwise.
 					/// </returns>
-					const bool Parse(const size_t bytes_transferred);
+					const bool Parse(const size_t bytes_transferred, const bool reportErrors = true);
+
+					/// <summary>
+					/// Gets the error http_parser stopped on, if any.
+					/// </summary>
+					/// <returns>
+					/// The http_parser error, or HPE_OK if there has been none.
+					/// </returns>
+					const http_errno GetParseError() const;
+
+					/// <summary>
+					/// Gets whether http_parser stopped at the end of the headers because the
+					/// message asked to upgrade to another protocol.
+					/// </summary>
+					/// <returns>
+					/// True if an upgrade was requested, false otherwise.
+					/// </returns>
+					const bool IsUpgradeRequested() const;
+
+					/// <summary>
+					/// Gets whatever was read along with the end of the message, but lies beyond it,
+					/// and so wasn't parsed. This is the start of the next message, which is to be
+					/// parsed into a transaction of its own, constructed from it.
+					/// </summary>
+					/// <returns>
+					/// The bytes that followed the end of the message. Empty if there were none.
+					/// </returns>
+					const std::vector<char>& GetPipelinedData() const;
 
 					/// <summary>
 					/// Gets the internal transaction buffer wrapped in a
@@ -269,6 +344,24 @@ namespace te
 					/// </returns>
 					boost::asio::mutable_buffers_1 GetReadBuffer();
 
+					/// <summary>
+					/// Identical to ::GetReadBuffer(), except that the returned buffer will not
+					/// permit more than the specified number of bytes to be read into it. This is
+					/// used by bridges to bound the amount of data a single streaming read can pull
+					/// in, as governed by network::FlowControl.
+					/// </summary>
+					/// <param name="maxReadSize">
+					/// The maximum number of bytes that the returned buffer should accept. Values of
+					/// zero or greater than the internal read size are clamped to the internal read
+					/// size.
+					/// </param>
+					/// <returns>
+					/// A boost::asio::mutable_buffers_1 which wraps the internal buffer, configured
+					/// for reading according to the state and configuration of this object, and no
+					/// larger than the specified maximum.
+					/// </returns>
+					boost::asio::mutable_buffers_1 GetReadBuffer(const uint32_t maxReadSize);
+
 					/// <summary>
 					/// Retrieve a boost::asio::const_buffers_1 object which wraps the internal
 					/// transaction payload. Call this method when you intend to write the entire
@@ -286,6 +379,79 @@ namespace te
 					/// </returns>
 					boost::asio::const_buffers_1 GetWriteBuffer();
 
+					/// <summary>
+					/// Prepares to write the entire transaction outbound with its payload
+					/// compressed, in place of ::GetWriteBuffer(). The headers are changed to
+					/// declare the coding and a chunked transfer, and the payload is then
+					/// compressed a slice at a time by successive calls to
+					/// ::GetNextEncodedWriteBuffer(...), each slice going out as a chunk, so that
+					/// writing can start before the whole payload has been compressed.
+					/// 
+					/// The payload must be complete and uncompressed, and nothing of the
+					/// transaction may have been written yet. The peer it's written to must
+					/// understand chunked transfers, which is to say it mustn't be HTTP/1.0.
+					/// </summary>
+					/// <param name="coding">
+					/// The coding to compress with. Must not be PayloadEncoder::Coding::Identity.
+					/// </param>
+					/// <param name="level">
+					/// The compression level, from one, the fastest, to nine, the smallest.
+					/// </param>
+					/// <returns>
+					/// True if the transaction is now to be written with ::GetNextEncodedWriteBuffer(...),
+					/// false if it can't be, in which case nothing has changed and
+					/// ::GetWriteBuffer() is to be used as usual.
+					/// </returns>
+					const bool BeginEncodedWrite(const PayloadEncoder::Coding coding, const int level);
+
+					/// <summary>
+					/// Compresses the next slice of the payload, and gets the buffer to write next.
+					/// The first buffer leads with the headers, and the last one ends the chunked
+					/// transfer. Only to be called after ::BeginEncodedWrite(...) has succeeded,
+					/// and until ::IsEncodedWriteComplete() is true. The buffer stays valid until
+					/// the next call.
+					/// </summary>
+					/// <param name="maxSliceSize">
+					/// The most payload bytes to compress for this buffer. More may be compressed
+					/// if that produces no output, which is to say, if the coding is still holding
+					/// on to all of it.
+					/// </param>
+					/// <returns>
+					/// A boost::asio::const_buffers_1 object wrapping what's to be written next.
+					/// </returns>
+					/// <exception cref="std::exception">
+					/// If compression fails. The transaction can't be written after that, since
+					/// part of it may already have been.
+					/// </exception>
+					boost::asio::const_buffers_1 GetNextEncodedWriteBuffer(const size_t maxSliceSize);
+
+					/// <summary>
+					/// Checks whether the last buffer of a write started by ::BeginEncodedWrite(...)
+					/// has been handed out.
+					/// </summary>
+					/// <returns>
+					/// True if the whole transaction has been handed out, false otherwise.
+					/// </returns>
+					const bool IsEncodedWriteComplete() const;
+
+					/// <summary>
+					/// Gets what a write started by ::BeginEncodedWrite(...) has cost so far.
+					/// </summary>
+					/// <param name="inputBytes">
+					/// Set to the number of payload bytes compressed.
+					/// </param>
+					/// <param name="outputBytes">
+					/// Set to the number of compressed bytes produced, not counting chunked
+					/// framing.
+					/// </param>
+					/// <param name="nanoseconds">
+					/// Set to the time spent in ::GetNextEncodedWriteBuffer(...).
+					/// </param>
+					/// <param name="firstSliceNanoseconds">
+					/// Set to the time spent in the first call to ::GetNextEncodedWriteBuffer(...).
+					/// </param>
+					void GetEncodedWriteStats(uint64_t& inputBytes, uint64_t& outputBytes, uint64_t& nanoseconds, uint64_t& firstSliceNanoseconds) const;
+
 					/// <summary>
 					/// Fetch the raw payload data. In the event that ::ConsumeAllBeforeSending() is
 					/// true and ::IsPayloadComplete() is also true, the payload data should be
@@ -364,6 +530,32 @@ namespace te
 					/// </returns>
 					const bool IsPayloadComplete() const;
 
+					/// <summary>
+					/// Gets the 64 bit xxHash of the payload, as it came off the wire less any
+					/// chunked framing, so still compressed if it was sent compressed. The payload
+					/// is hashed as it's parsed, for as long as none of the transaction has been
+					/// sent on, which for a transaction flagged for inspection means all of it.
+					/// Once anything has been sent on, the hash no longer covers the payload.
+					/// </summary>
+					/// <param name="hash">
+					/// Set to the hash of the payload parsed so far.
+					/// </param>
+					/// <param name="length">
+					/// Set to the number of payload bytes hashed.
+					/// </param>
+					/// <returns>
+					/// True if the hash covers every payload byte parsed so far, false otherwise.
+					/// </returns>
+					const bool GetPayloadHash(uint64_t& hash, uint64_t& length) const;
+
+					/// <summary>
+					/// Gets the time spent hashing the payload, as returned by ::GetPayloadHash(...).
+					/// </summary>
+					/// <returns>
+					/// The time spent hashing the payload, in nanoseconds.
+					/// </returns>
+					const uint64_t GetPayloadHashNanoseconds() const;
+
 					/// <summary>
 					/// Check to see if the transaction has been marked for blocking. If any
 					/// non-zero value is returned, the transaction has been assigned a category
@@ -452,7 +644,8 @@ namespace te
 					/// (Content-Length specified) transaction. Also, the entire transaction payload
 					/// will be decompressed. Recompression is not automatic, not even for upstream
 					/// payloads, rather this is left to the user to determine and apply using the
-					/// provided convenience functions.
+					/// provided convenience functions, or in the case of responses, to the Engine's
+					/// recompression settings. See network::RecompressionControl.
 					/// 
 					/// Use caution with this, as this will blindly continue to consume the
 					/// payload/body of a transaction until the parser signals that it is complete.
@@ -479,6 +672,16 @@ namespace te
 					/// </returns>
 					const bool IsPayloadCompressed() const;
 
+					/// <summary>
+					/// Determine if the payload is in a content coding that ::DecompressPayload() can
+					/// undo. That's gzip and deflate, or any sequence of them, plus identity. An
+					/// uncompressed payload is trivially decodable.
+					/// </summary>
+					/// <returns>
+					/// True if the payload is uncompressed, or can be decompressed, false otherwise.
+					/// </returns>
+					const bool IsPayloadDecodable() const;
+
 					/// <summary>
 					/// Convenience function to determine if the payload of the transaction is JSON
 					/// data.
@@ -607,6 +810,28 @@ namespace te
 					/// </returns>
 					const bool DecompressPayload();
 
+					/// <summary>
+					/// Checks whether the payload was decompressed by ::DecompressPayload(), as a
+					/// payload that's consumed in full for inspection is, as opposed to having
+					/// been sent uncompressed in the first place. Replacing the payload clears
+					/// this.
+					/// </summary>
+					/// <returns>
+					/// True if the payload was decompressed, false otherwise.
+					/// </returns>
+					const bool WasPayloadDecompressed() const;
+
+					/// <summary>
+					/// Checks whether the entire payload is held, with none of the transaction
+					/// having been written yet, such that the payload as held is the whole of it.
+					/// A chunked payload that was held this way is held without its framing.
+					/// </summary>
+					/// <returns>
+					/// True if the entire payload is held and nothing has been written, false
+					/// otherwise.
+					/// </returns>
+					const bool IsPayloadHeldInFull() const;
+
 				protected:
 					
 					/// <summary>
@@ -645,12 +870,6 @@ namespace te
 					/// </summary>
 					static const boost::string_ref ContentTypeJavascript;
 
-					/// <summary>
-					/// Increments by which the payload buffer will be resized, also the initial
-					/// reserved size.
-					/// </summary>
-					static constexpr uint32_t PayloadBufferReadSize = 131072;
-
 					/// <summary>
 					/// Maximum size that the payload buffer can be resized to.
 					/// </summary>
@@ -687,10 +906,66 @@ namespace te
 					/// </summary>
 					std::string m_lastHeader;
 
+					/// <summary>
+					/// The value of m_lastHeader, as much of it as has been read. It's added along
+					/// with m_lastHeader by ::AddLastHeader() once it's known to be complete.
+					/// </summary>
+					std::string m_lastHeaderValue;
+
+					/// <summary>
+					/// Whether m_lastHeaderValue holds a value that has yet to be added.
+					/// </summary>
+					bool m_lastHeaderValuePending = false;
+
 					bool m_lastHeaderValueFresh = false;
 
 					bool m_lastHeaderFieldFresh = false;
 
+					/// <summary>
+					/// Set when the head of the current message was tokenized up front by
+					/// ::TokenizeHead(...), until the headers are complete. Any header callbacks
+					/// that http_parser makes in the meantime are for the framing head, and are
+					/// ignored, since the headers are already in place.
+					/// </summary>
+					bool m_headerBlockTokenized = false;
+
+					/// <summary>
+					/// Set while http_parser is being shown m_framingHead, so that ::OnMessageBegin(...)
+					/// knows to put the tokenized headers in place once it's reset everything.
+					/// </summary>
+					bool m_headTokenized = false;
+
+					/// <summary>
+					/// Set once http_parser has begun this transaction's message. Until then, the
+					/// next read starts at the very beginning of the message, which is the only
+					/// point where its head can be tokenized.
+					/// </summary>
+					bool m_messageStarted = false;
+
+					/// <summary>
+					/// Reused by ::TokenizeHead(...) so that it doesn't allocate per message.
+					/// </summary>
+					std::vector<HeaderBlockTokenizer::Header> m_tokenizedHeaders;
+
+					/// <summary>
+					/// What http_parser is shown in place of a tokenized head. The start line as it
+					/// was, followed by only those headers that http_parser reads for framing,
+					/// also as they were. Reused so that it doesn't allocate per message.
+					/// </summary>
+					std::string m_framingHead;
+
+					/// <summary>
+					/// One past the last byte handed to http_parser by the ::Parse(...) call in
+					/// progress, or nullptr outside of ::Parse(...).
+					/// </summary>
+					const char* m_parseEnd = nullptr;
+
+					/// <summary>
+					/// What followed the end of the message in the read that completed it. See
+					/// ::GetPipelinedData().
+					/// </summary>
+					std::vector<char> m_pipelined;
+
 					std::vector<char> m_buffer;
 
 					std::vector<char> m_payload;
@@ -710,6 +985,22 @@ namespace te
 					/// </summary>
 					bool m_headersSent = false;
 
+					/// <summary>
+					/// Hash of the payload bytes parsed while nothing had been sent on yet. See
+					/// ::GetPayloadHash(...).
+					/// </summary>
+					util::hash::XxHash64 m_payloadHash;
+
+					/// <summary>
+					/// Whether m_payloadHash still covers every payload byte parsed.
+					/// </summary>
+					bool m_payloadHashValid = true;
+
+					/// <summary>
+					/// The time spent updating m_payloadHash.
+					/// </summary>
+					uint64_t m_payloadHashNanoseconds = 0;
+
 					/// <summary>
 					/// Flag used to indicate if the payload for the transaction has been fully
 					/// read from the client/remote peer.
@@ -732,6 +1023,35 @@ namespace te
 					/// </summary>
 					bool m_consumeAllBeforeSending = false;
 
+					/// <summary>
+					/// Set once ::DecompressPayload() has decompressed the payload. See
+					/// ::WasPayloadDecompressed().
+					/// </summary>
+					bool m_payloadDecompressed = false;
+
+					/// <summary>
+					/// Compresses the payload as it's written, after ::BeginEncodedWrite(...).
+					/// </summary>
+					std::unique_ptr<PayloadEncoder> m_encoder;
+
+					/// <summary>
+					/// How much of the payload has been handed to m_encoder.
+					/// </summary>
+					size_t m_encodeOffset = 0;
+
+					/// <summary>
+					/// Holds the buffer last handed out by ::GetNextEncodedWriteBuffer(...).
+					/// </summary>
+					std::vector<char> m_encodedWriteBuffer;
+
+					bool m_encodedWriteComplete = false;
+
+					uint64_t m_encodedOutputBytes = 0;
+
+					uint64_t m_encodeNanoseconds = 0;
+
+					uint64_t m_encodeFirstSliceNanoseconds = 0;
+
 					/// <summary>
 					/// Decompress the payload contents, expecting gzip format.
 					/// </summary>
@@ -741,25 +1061,40 @@ namespace te
 					const bool DecompressGzip();
 
 					/// <summary>
-					/// Decompress the payload contents, expecting deflate format.
+					/// Decompress the payload contents, expecting deflate format. RFC 7230 says
+					/// deflate means a zlib stream, but enough servers send a raw deflate stream
+					/// under the same name that both are accepted, told apart by the zlib header.
 					/// </summary>
 					/// <returns>
 					/// True if the decompression succeeded, false otherwise.
 					/// </returns>
 					const bool DecompressDeflate();
 
+					/// <summary>
+					/// Lists the content codings applied to the payload, in the order they were
+					/// applied, according to the Content-Encoding headers. Names are normalized,
+					/// so that x-gzip comes out as gzip, and identity is left out.
+					/// </summary>
+					/// <param name="codings">
+					/// Receives the codings.
+					/// </param>
+					/// <returns>
+					/// True if every coding is one we can decompress, false otherwise.
+					/// </returns>
+					const bool GetContentCodings(std::vector<std::string>& codings) const;
+
 					/// <summary>
 					/// In the even that the user has specified that they wish collect the entire
 					/// payload of a transaction for inspection, certain guarantees are provided:
 					/// that chunked content will be converted to a normal,
 					/// fixed-length/precalculated transfer, and the payload will be decompressed.
 					/// 
-					/// Since this object owns the buffers directly used on the sockets, and in
-					/// order to maintain a valid state during and up-till a completely read
-					/// request/response, even though the http_parser is parsing the data on every
-					/// read, chunked data is not being extracted during any read operation leading
-					/// up to a completed transaction. This is to avoid fragmenting the object state
-					/// so that it remains valid. See notes on ::Parse(..) for more on that.
+					/// For as long as nothing of the transaction has been sent, the payload is
+					/// held as the bare body, with any chunked framing stripped as each chunk is
+					/// parsed. So by the time the transaction is complete, there is nothing left to
+					/// convert, and the payload only has to be given its Content-Length and be
+					/// decompressed. See ::AppendHeldPayloadAsChunks(...) for the case where held
+					/// chunked content ends up being sent on after all.
 					/// 
 					/// As such, when and only when the the following two conditions are met, the
 					/// transaction payload can/should be converted to a normal precalcuated
@@ -773,6 +1108,163 @@ namespace te
 					/// </returns>
 					const bool ConvertPayloadFromChunkedToFixedLength();					
 
+					/// <summary>
+					/// Where we are within the chunked framing of the payload.
+					/// </summary>
+					enum class ChunkPhase
+					{
+						/// <summary>
+						/// Not inside any chunk. Either between chunks, or the payload isn't chunked.
+						/// </summary>
+						BetweenChunks,
+
+						/// <summary>
+						/// Inside a chunk with data, whose header has been parsed but whose closing
+						/// CRLF hasn't.
+						/// </summary>
+						InChunk,
+
+						/// <summary>
+						/// Inside the last, empty chunk, which may still be followed by trailers.
+						/// </summary>
+						InLastChunk,
+
+						/// <summary>
+						/// The last chunk is complete.
+						/// </summary>
+						Done
+					};
+
+					/// <summary>
+					/// Where the parser is within the chunked framing of the payload.
+					/// </summary>
+					ChunkPhase m_chunkPhase = ChunkPhase::BetweenChunks;
+
+					/// <summary>
+					/// The bytes of the chunk in progress that have yet to be parsed.
+					/// </summary>
+					uint64_t m_chunkRemaining = 0;
+
+					/// <summary>
+					/// Set when chunked content has been parsed while nothing had been sent, and so
+					/// is held in the payload without its framing. Cleared once the framing has been
+					/// put back by ::AppendHeldPayloadAsChunks(...), or the payload has been
+					/// replaced.
+					/// </summary>
+					bool m_payloadDechunked = false;
+
+					/// <summary>
+					/// Appends the payload, held without its chunked framing, to the supplied
+					/// buffer as chunked content again, so that it can be sent on. Everything held
+					/// goes out as a single chunk, which, when the parser is part way through a
+					/// chunk, is sized to take in the rest of that chunk too, so that the rest and
+					/// its closing CRLF can be sent as they're parsed, exactly as they would have
+					/// been. If the last chunk has been reached, that's appended as well.
+					/// </summary>
+					/// <param name="out">
+					/// The buffer to append to.
+					/// </param>
+					void AppendHeldPayloadAsChunks(std::vector<char>& out);
+
+					/// <summary>
+					/// Finds the end of a body that's only being passed along, when m_bodyScanActive
+					/// is set. See ::TryStartBodyScan().
+					/// </summary>
+					BodyScanner m_bodyScanner;
+
+					/// <summary>
+					/// Set while the body of the current message is being scanned by m_bodyScanner
+					/// rather than parsed by http_parser.
+					/// </summary>
+					bool m_bodyScanActive = false;
+
+					/// <summary>
+					/// Checks whether the rest of the current body can be scanned for its end
+					/// rather than parsed, and if so, starts scanning it. That's the case when the
+					/// body is being passed along as it's read, so nobody needs any more from it
+					/// than where it ends, and where it ends is known exactly: either a number of
+					/// bytes away, or, for a chunked body, when the parser is part way through the
+					/// data of a chunk.
+					/// </summary>
+					/// <returns>
+					/// True if the body is now being scanned, false otherwise.
+					/// </returns>
+					const bool TryStartBodyScan();
+
+					/// <summary>
+					/// Scans the newly read bytes for the end of the body, and passes the bytes that
+					/// belong to it along untouched. Once the body ends, http_parser is reset to
+					/// expect the next message, and anything left over is parsed as usual.
+					/// </summary>
+					/// <param name="bytesReceived">
+					/// The number of bytes read.
+					/// </param>
+					/// <param name="reportErrors">
+					/// Whether a failure should be reported as an error.
+					/// </param>
+					/// <returns>
+					/// True on success, false if the body is malformed.
+					/// </returns>
+					const bool ScanBody(const size_t bytesReceived, const bool reportErrors);
+
+					/// <summary>
+					/// Runs http_parser over the supplied data. See ::Parse(...). When the data
+					/// begins a message and holds its complete head, the head is tokenized instead,
+					/// and http_parser is only shown what it needs for framing, followed by the rest
+					/// of the data. See ::TokenizeHead(...).
+					/// </summary>
+					/// <param name="data">
+					/// The data, which must lie within m_buffer.
+					/// </param>
+					/// <param name="length">
+					/// The length of the data.
+					/// </param>
+					/// <param name="reportErrors">
+					/// Whether a failure should be reported as an error.
+					/// </param>
+					/// <returns>
+					/// True if the parsing operation was a success, false otherwise.
+					/// </returns>
+					const bool ExecuteParser(const char* data, const size_t length, const bool reportErrors);
+
+					/// <summary>
+					/// Called by ::ExecuteParser(...) when a read begins at the start of a message.
+					/// If the read holds the complete head, and the head is plain enough that
+					/// HeaderBlockTokenizer accepts it, then the head is tokenized and m_framingHead
+					/// is built for http_parser to be shown in its place. The framing head is only
+					/// used if a scratch copy of http_parser reads its start line and headers just
+					/// where the tokenizer found them. Otherwise nothing is changed, and http_parser
+					/// parses the head itself, as it always has.
+					/// </summary>
+					/// <param name="data">
+					/// The data being parsed.
+					/// </param>
+					/// <param name="length">
+					/// The length of the data.
+					/// </param>
+					/// <param name="headLength">
+					/// The length of the head within the data. Only meaningful if the call
+					/// succeeds.
+					/// </param>
+					/// <returns>
+					/// True if the head was tokenized, false otherwise.
+					/// </returns>
+					const bool TokenizeHead(const char* data, const size_t length, size_t& headLength);
+
+					/// <summary>
+					/// Adds the header held in m_lastHeader and m_lastHeaderValue, if one is still
+					/// waiting to be added. Called by the callbacks once the value is known to be
+					/// complete.
+					/// </summary>
+					void AddLastHeader();
+
+					/// <summary>
+					/// Adds the headers found by ::TokenizeHead(...), leaving things as the header
+					/// callbacks would have after the last value, so that trailers, which always
+					/// go through the callbacks, carry on as before.
+					/// </summary>
+					void AddTokenizedHeaders();
+
 					/// <summary>
 					/// Called when the http_parser has begun reading a new transaction.
 					/// </summary>
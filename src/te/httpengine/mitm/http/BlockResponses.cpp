@@ -0,0 +1,204 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "BlockResponses.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace http
+			{
+
+				namespace
+				{
+					/// <summary>
+					/// Formats seconds since the Unix epoch as an IMF-fixdate, per RFC 7231
+					/// section 7.1.1.1, such as "Sun, 06 Nov 1994 08:49:37 GMT". Done by hand,
+					/// since the C library's conversions are either not thread safe or not
+					/// portable, and std::ctime doesn't produce an HTTP date to begin with.
+					/// </summary>
+					std::string FormatHttpDate(const int64_t seconds)
+					{
+						static const char* days[] = { u8"Thu", u8"Fri", u8"Sat", u8"Sun", u8"Mon", u8"Tue", u8"Wed" };
+						static const char* months[] = { u8"Jan", u8"Feb", u8"Mar", u8"Apr", u8"May", u8"Jun", u8"Jul", u8"Aug", u8"Sep", u8"Oct", u8"Nov", u8"Dec" };
+
+						const int64_t daysSinceEpoch = seconds / 86400;
+						const int64_t secondOfDay = seconds % 86400;
+
+						// Civil from days, after Howard Hinnant's algorithm.
+						const int64_t z = daysSinceEpoch + 719468;
+						const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+						const int64_t dayOfEra = z - (era * 146097);
+						const int64_t yearOfEra = (dayOfEra - (dayOfEra / 1460) + (dayOfEra / 36524) - (dayOfEra / 146096)) / 365;
+						const int64_t dayOfYear = dayOfEra - ((365 * yearOfEra) + (yearOfEra / 4) - (yearOfEra / 100));
+						const int64_t shiftedMonth = ((5 * dayOfYear) + 2) / 153;
+						const int64_t day = dayOfYear - (((153 * shiftedMonth) + 2) / 5) + 1;
+						const int64_t month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+						const int64_t year = yearOfEra + (era * 400) + (month <= 2 ? 1 : 0);
+
+						char formatted[32];
+
+						std::snprintf(
+							formatted,
+							sizeof(formatted),
+							u8"%s, %02d %s %04d %02d:%02d:%02d GMT",
+							days[daysSinceEpoch % 7],
+							static_cast<int>(day),
+							months[month - 1],
+							static_cast<int>(year),
+							static_cast<int>(secondOfDay / 3600),
+							static_cast<int>((secondOfDay % 3600) / 60),
+							static_cast<int>(secondOfDay % 60)
+							);
+
+						return std::string(formatted);
+					}
+
+					std::shared_ptr<const std::vector<char>> Build204(const char* statusLine, const std::string& date)
+					{
+						std::string response(statusLine);
+
+						// No Content-Length, which a 204 mustn't carry, per RFC 7230 section
+						// 3.3.2. The connection is closed once the block has been written.
+						response.append(u8"Date: ").append(date).append(u8"\r\n");
+						response.append(u8"Expires: Thu, 01 Jan 1970 00:00:00 GMT\r\n");
+						response.append(u8"Connection: close\r\n\r\n");
+
+						return std::make_shared<const std::vector<char>>(response.begin(), response.end());
+					}
+				}
+
+				std::shared_ptr<const std::vector<char>> BlockResponses::Get204(const HttpProtocolVersion version)
+				{
+					struct Canned
+					{
+						std::mutex mutex;
+
+						int64_t second = -1;
+
+						std::array<std::shared_ptr<const std::vector<char>>, 2> responses;
+					};
+
+					static Canned canned;
+
+					const int64_t now = static_cast<int64_t>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+
+					std::lock_guard<std::mutex> lock(canned.mutex);
+
+					if (canned.second != now)
+					{
+						const auto date = FormatHttpDate(now);
+
+						canned.responses[0] = Build204(u8"HTTP/1.0 204 No Content\r\n", date);
+						canned.responses[1] = Build204(u8"HTTP/1.1 204 No Content\r\n", date);
+						canned.second = now;
+					}
+
+					return canned.responses[version == HttpProtocolVersion::HTTP1 ? 0 : 1];
+				}
+
+				const bool BlockResponses::IsPageReference(const std::vector<char>& customResponse, uint32_t& pageId)
+				{
+					if (customResponse.size() != PageReferenceLength || customResponse[0] != 0)
+					{
+						return false;
+					}
+
+					pageId =
+						static_cast<uint32_t>(static_cast<uint8_t>(customResponse[1])) |
+						(static_cast<uint32_t>(static_cast<uint8_t>(customResponse[2])) << 8) |
+						(static_cast<uint32_t>(static_cast<uint8_t>(customResponse[3])) << 16) |
+						(static_cast<uint32_t>(static_cast<uint8_t>(customResponse[4])) << 24);
+
+					return true;
+				}
+
+				void BlockResponses::RegisterPage(const uint32_t pageId, const char* page, const size_t pageLength)
+				{
+					std::shared_ptr<const std::vector<char>> registered;
+
+					if (page != nullptr && pageLength > 0)
+					{
+						registered = std::make_shared<const std::vector<char>>(page, page + pageLength);
+					}
+
+					std::lock_guard<std::mutex> lock(m_pagesMutex);
+
+					if (registered)
+					{
+						m_pages[pageId] = std::move(registered);
+					}
+					else
+					{
+						m_pages.erase(pageId);
+					}
+				}
+
+				void BlockResponses::ClearPages()
+				{
+					std::lock_guard<std::mutex> lock(m_pagesMutex);
+					m_pages.clear();
+				}
+
+				const uint32_t BlockResponses::GetPageCount() const
+				{
+					std::lock_guard<std::mutex> lock(m_pagesMutex);
+					return static_cast<uint32_t>(m_pages.size());
+				}
+
+				std::shared_ptr<const std::vector<char>> BlockResponses::Resolve(const std::shared_ptr<const std::vector<char>>& customResponse, const HttpProtocolVersion version)
+				{
+					if (!customResponse || customResponse->size() == 0)
+					{
+						return Get204(version);
+					}
+
+					uint32_t pageId = 0;
+
+					if (!IsPageReference(*customResponse, pageId))
+					{
+						return customResponse;
+					}
+
+					{
+						std::lock_guard<std::mutex> lock(m_pagesMutex);
+
+						auto page = m_pages.find(pageId);
+
+						if (page != m_pages.end())
+						{
+							++m_pageHitCount;
+							return page->second;
+						}
+					}
+
+					++m_pageMissCount;
+					return Get204(version);
+				}
+
+				const uint64_t BlockResponses::GetPageHitCount() const
+				{
+					return m_pageHitCount.load();
+				}
+
+				const uint64_t BlockResponses::GetPageMissCount() const
+				{
+					return m_pageMissCount.load();
+				}
+
+			} /* namespace http */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
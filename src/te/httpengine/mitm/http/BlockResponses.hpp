@@ -0,0 +1,178 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "BaseHttpTransaction.hpp"
+#include "../../util/cb/EngineCallbackTypes.h"
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace http
+			{
+
+				/// <summary>
+				/// The BlockResponses class holds what's written to clients in place of a blocked
+				/// transaction, so that blocking is a single write of a buffer that already exists,
+				/// rather than a response being put together for every block.
+				///
+				/// Blocks without a custom response get a 204 No Content. There's one prebuilt for
+				/// each HTTP version, complete with a Date header, and rebuilt at most once a second,
+				/// when the date has moved on. Everything but the date is the same every time.
+				///
+				/// Consumers that block with the same page over and over can register it once under
+				/// an ID, and then have a verdict refer to the page by its ID, instead of writing the
+				/// whole page out for every block. See HTTP_BLOCK_PAGE_REFERENCE. Every transaction
+				/// blocked with a page shares the one registered copy of it. A reference is resolved
+				/// when the block is applied, so references remembered by the verdict caches pick up
+				/// a page that has been registered again. A reference to a page that isn't registered
+				/// gets the 204.
+				///
+				/// All members are thread safe.
+				/// </summary>
+				class BlockResponses
+				{
+
+				public:
+
+					/// <summary>
+					/// The length of a block page reference, a zero byte followed by the page ID
+					/// as four bytes, least significant first. A zero byte can't start an HTTP
+					/// response, so a reference can't be mistaken for one. See
+					/// HTTP_BLOCK_PAGE_REFERENCE.
+					/// </summary>
+					static constexpr size_t PageReferenceLength = HTTP_BLOCK_PAGE_REFERENCE_LENGTH;
+
+					/// <summary>
+					/// Constructs a new BlockResponses instance, with no pages registered.
+					/// </summary>
+					BlockResponses()
+					{
+
+					}
+
+					/// <summary>
+					/// No copy no move no thx.
+					/// </summary>
+					BlockResponses(const BlockResponses&) = delete;
+					BlockResponses(BlockResponses&&) = delete;
+					BlockResponses& operator=(const BlockResponses&) = delete;
+
+					/// <summary>
+					/// Gets the prebuilt 204 No Content response for an HTTP version. HTTP/2 is
+					/// answered as HTTP/1.1, since that's what's spoken on the connection.
+					/// </summary>
+					/// <param name="version">
+					/// The HTTP version of the request being answered.
+					/// </param>
+					/// <returns>
+					/// The complete response, status line and all.
+					/// </returns>
+					static std::shared_ptr<const std::vector<char>> Get204(const HttpProtocolVersion version);
+
+					/// <summary>
+					/// Checks whether a custom block response is a reference to a registered page,
+					/// rather than a response of its own.
+					/// </summary>
+					/// <param name="customResponse">
+					/// The custom block response.
+					/// </param>
+					/// <param name="pageId">
+					/// Set to the ID of the page referred to, if it's a reference.
+					/// </param>
+					/// <returns>
+					/// True if the custom block response is a page reference, false otherwise.
+					/// </returns>
+					static const bool IsPageReference(const std::vector<char>& customResponse, uint32_t& pageId);
+
+					/// <summary>
+					/// Registers a block page, replacing any page registered under the same ID.
+					/// Transactions already being blocked with the old page finish writing it.
+					/// </summary>
+					/// <param name="pageId">
+					/// The ID verdicts are to refer to the page by.
+					/// </param>
+					/// <param name="page">
+					/// The complete response, status line, headers and payload. May be nullptr to
+					/// remove the page.
+					/// </param>
+					/// <param name="pageLength">
+					/// The length of the response, in bytes. Zero removes the page.
+					/// </param>
+					void RegisterPage(const uint32_t pageId, const char* page, const size_t pageLength);
+
+					/// <summary>
+					/// Removes every registered page.
+					/// </summary>
+					void ClearPages();
+
+					/// <summary>
+					/// Gets the number of pages registered.
+					/// </summary>
+					/// <returns>
+					/// The number of pages registered.
+					/// </returns>
+					const uint32_t GetPageCount() const;
+
+					/// <summary>
+					/// Gets what's to be written to the client for a blocked transaction.
+					/// </summary>
+					/// <param name="customResponse">
+					/// The custom block response supplied with the verdict, if any. May be
+					/// nullptr.
+					/// </param>
+					/// <param name="version">
+					/// The HTTP version of the request being answered.
+					/// </param>
+					/// <returns>
+					/// The custom block response, the page it refers to, or the 204 if there's
+					/// neither.
+					/// </returns>
+					std::shared_ptr<const std::vector<char>> Resolve(const std::shared_ptr<const std::vector<char>>& customResponse, const HttpProtocolVersion version);
+
+					/// <summary>
+					/// Gets the number of blocks answered with a registered page.
+					/// </summary>
+					/// <returns>
+					/// The number of blocks answered with a registered page.
+					/// </returns>
+					const uint64_t GetPageHitCount() const;
+
+					/// <summary>
+					/// Gets the number of blocks that referred to a page that wasn't registered,
+					/// and were answered with the 204 instead.
+					/// </summary>
+					/// <returns>
+					/// The number of references to unregistered pages.
+					/// </returns>
+					const uint64_t GetPageMissCount() const;
+
+				private:
+
+					mutable std::mutex m_pagesMutex;
+
+					std::unordered_map<uint32_t, std::shared_ptr<const std::vector<char>>> m_pages;
+
+					std::atomic<uint64_t> m_pageHitCount{ 0 };
+
+					std::atomic<uint64_t> m_pageMissCount{ 0 };
+				};
+
+			} /* namespace http */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
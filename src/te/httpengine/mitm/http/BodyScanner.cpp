@@ -0,0 +1,231 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "BodyScanner.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace http
+			{
+
+				namespace
+				{
+					/// <summary>
+					/// Gets the value of a hex digit, or -1 if it isn't one.
+					/// </summary>
+					inline int HexValue(const char c)
+					{
+						if (c >= '0' && c <= '9') return c - '0';
+						if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+						if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+						return -1;
+					}
+
+					/// <summary>
+					/// More hex digits than this in a chunk size would overflow, and no sane server
+					/// sends chunks anywhere near that large anyway.
+					/// </summary>
+					constexpr uint32_t MaxChunkSizeDigits = 15;
+				}
+
+				void BodyScanner::StartLengthDelimited(const uint64_t remaining)
+				{
+					m_state = remaining > 0 ? State::Identity : State::Done;
+					m_remaining = remaining;
+				}
+
+				void BodyScanner::StartInChunk(const uint64_t remainingInChunk)
+				{
+					m_state = State::ChunkData;
+					m_remaining = remainingInChunk;
+				}
+
+				const BodyScanner::ScanResult BodyScanner::Scan(const char* data, const size_t length, size_t& consumed)
+				{
+					const char* p = data;
+					const char* const end = data + length;
+
+					while (p < end && m_state != State::Done)
+					{
+						switch (m_state)
+						{
+							case State::Identity:
+							case State::ChunkData:
+							{
+								const uint64_t take = std::min(m_remaining, static_cast<uint64_t>(end - p));
+								p += take;
+								m_remaining -= take;
+
+								if (m_remaining == 0)
+								{
+									m_state = m_state == State::Identity ? State::Done : State::ChunkDataCr;
+								}
+							}
+							break;
+
+							case State::ChunkSize:
+							{
+								const int value = HexValue(*p);
+
+								if (value >= 0)
+								{
+									if (++m_chunkSizeDigits > MaxChunkSizeDigits)
+									{
+										consumed = static_cast<size_t>(p - data);
+										return ScanResult::Error;
+									}
+
+									m_chunkSize = (m_chunkSize << 4) | static_cast<uint64_t>(value);
+									++p;
+									break;
+								}
+
+								if (m_chunkSizeDigits == 0)
+								{
+									consumed = static_cast<size_t>(p - data);
+									return ScanResult::Error;
+								}
+
+								if (*p == '\r')
+								{
+									m_state = State::ChunkSizeLf;
+								}
+								else if (*p == '\n')
+								{
+									m_remaining = m_chunkSize;
+									m_state = m_chunkSize > 0 ? State::ChunkData : State::TrailerLineStart;
+								}
+								else
+								{
+									m_state = State::ChunkExtension;
+								}
+
+								++p;
+							}
+							break;
+
+							case State::ChunkExtension:
+							{
+								const void* lineEnd = std::memchr(p, '\n', static_cast<size_t>(end - p));
+
+								if (lineEnd == nullptr)
+								{
+									p = end;
+									break;
+								}
+
+								p = static_cast<const char*>(lineEnd) + 1;
+								m_remaining = m_chunkSize;
+								m_state = m_chunkSize > 0 ? State::ChunkData : State::TrailerLineStart;
+							}
+							break;
+
+							case State::ChunkSizeLf:
+							{
+								if (*p != '\n')
+								{
+									consumed = static_cast<size_t>(p - data);
+									return ScanResult::Error;
+								}
+
+								++p;
+								m_remaining = m_chunkSize;
+								m_state = m_chunkSize > 0 ? State::ChunkData : State::TrailerLineStart;
+							}
+							break;
+
+							case State::ChunkDataCr:
+							case State::ChunkDataLf:
+							{
+								if (*p == '\r' && m_state == State::ChunkDataCr)
+								{
+									m_state = State::ChunkDataLf;
+									++p;
+									break;
+								}
+
+								if (*p != '\n')
+								{
+									consumed = static_cast<size_t>(p - data);
+									return ScanResult::Error;
+								}
+
+								++p;
+								m_chunkSize = 0;
+								m_chunkSizeDigits = 0;
+								m_state = State::ChunkSize;
+							}
+							break;
+
+							case State::TrailerLineStart:
+							{
+								if (*p == '\r')
+								{
+									m_state = State::FinalLf;
+								}
+								else if (*p == '\n')
+								{
+									m_state = State::Done;
+								}
+								else
+								{
+									m_state = State::TrailerLine;
+								}
+
+								++p;
+							}
+							break;
+
+							case State::TrailerLine:
+							{
+								const void* lineEnd = std::memchr(p, '\n', static_cast<size_t>(end - p));
+
+								if (lineEnd == nullptr)
+								{
+									p = end;
+									break;
+								}
+
+								p = static_cast<const char*>(lineEnd) + 1;
+								m_state = State::TrailerLineStart;
+							}
+							break;
+
+							case State::FinalLf:
+							{
+								if (*p != '\n')
+								{
+									consumed = static_cast<size_t>(p - data);
+									return ScanResult::Error;
+								}
+
+								++p;
+								m_state = State::Done;
+							}
+							break;
+
+							default:
+							break;
+						}
+					}
+
+					consumed = static_cast<size_t>(p - data);
+
+					return m_state == State::Done ? ScanResult::Complete : ScanResult::NeedMore;
+				}
+
+			} /* namespace http */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,135 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace http
+			{
+
+				/// <summary>
+				/// The BodyScanner class finds where an HTTP/1.x message body ends, without
+				/// otherwise looking at it. For a body of known length, that's a matter of counting
+				/// bytes. For a chunked body, it's a small state machine over the chunk framing that
+				/// skips the data of each chunk in one step, rather than going through http_parser
+				/// and a body callback for every read.
+				///
+				/// It exists for bodies that nobody has asked to inspect, which only need to be
+				/// passed along as they are, while keeping track of where the message ends. The
+				/// bytes aren't copied or altered, so a chunked body is passed along with its
+				/// framing, extensions and trailers exactly as they arrived.
+				/// </summary>
+				class BodyScanner
+				{
+
+				public:
+
+					/// <summary>
+					/// The outcome of a call to ::Scan(...).
+					/// </summary>
+					enum class ScanResult
+					{
+						/// <summary>
+						/// All of the supplied data belongs to the body, and there's more to come.
+						/// </summary>
+						NeedMore,
+
+						/// <summary>
+						/// The body ended within the supplied data.
+						/// </summary>
+						Complete,
+
+						/// <summary>
+						/// The chunked framing is malformed.
+						/// </summary>
+						Error
+					};
+
+					/// <summary>
+					/// Begins scanning a body of which the given number of bytes remain.
+					/// </summary>
+					/// <param name="remaining">
+					/// The number of body bytes that remain.
+					/// </param>
+					void StartLengthDelimited(const uint64_t remaining);
+
+					/// <summary>
+					/// Begins scanning a chunked body part way through the data of a chunk.
+					/// </summary>
+					/// <param name="remainingInChunk">
+					/// The number of data bytes of the current chunk that remain. Must be greater
+					/// than zero.
+					/// </param>
+					void StartInChunk(const uint64_t remainingInChunk);
+
+					/// <summary>
+					/// Advances over the supplied data.
+					/// </summary>
+					/// <param name="data">
+					/// The data.
+					/// </param>
+					/// <param name="length">
+					/// The length of the data.
+					/// </param>
+					/// <param name="consumed">
+					/// Set to the number of bytes that belong to the body. Less than the length only
+					/// when the body ended part way through the data.
+					/// </param>
+					/// <returns>
+					/// Whether the body needs more data, has ended, or is malformed.
+					/// </returns>
+					const ScanResult Scan(const char* data, const size_t length, size_t& consumed);
+
+				private:
+
+					enum class State
+					{
+						Identity,
+						ChunkSize,
+						ChunkExtension,
+						ChunkSizeLf,
+						ChunkData,
+						ChunkDataCr,
+						ChunkDataLf,
+						TrailerLineStart,
+						TrailerLine,
+						FinalLf,
+						Done
+					};
+
+					State m_state = State::Done;
+
+					/// <summary>
+					/// The body bytes that remain for State::Identity, or the data bytes of the
+					/// current chunk that remain for State::ChunkData.
+					/// </summary>
+					uint64_t m_remaining = 0;
+
+					/// <summary>
+					/// The size of the chunk whose header is being read.
+					/// </summary>
+					uint64_t m_chunkSize = 0;
+
+					/// <summary>
+					/// The number of hex digits read into m_chunkSize.
+					/// </summary>
+					uint32_t m_chunkSizeDigits = 0;
+
+				};
+
+			} /* namespace http */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
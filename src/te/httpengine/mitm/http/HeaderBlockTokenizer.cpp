@@ -0,0 +1,260 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "HeaderBlockTokenizer.hpp"
+
+#include <cstdint>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define TE_HEADER_TOKENIZER_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define TE_HEADER_TOKENIZER_SSE2
+#endif
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace http
+			{
+
+				namespace
+				{
+					/// <summary>
+					/// The token characters of RFC 7230, which is all a header name may contain.
+					/// </summary>
+					struct TokenTable
+					{
+						bool isToken[256] = {};
+
+						TokenTable()
+						{
+							for (int c = '0'; c <= '9'; ++c) isToken[c] = true;
+							for (int c = 'a'; c <= 'z'; ++c) isToken[c] = true;
+							for (int c = 'A'; c <= 'Z'; ++c) isToken[c] = true;
+
+							for (const char c : boost::string_ref(u8"!#$%&'*+-.^_`|~"))
+							{
+								isToken[static_cast<unsigned char>(c)] = true;
+							}
+						}
+					};
+
+					const TokenTable Tokens;
+
+					inline bool IsValueByte(const unsigned char c)
+					{
+						return (c >= 0x20 && c != 0x7F) || c == '\t';
+					}
+
+					inline uint32_t LowestSetBit(const uint32_t mask)
+					{
+						#ifdef _MSC_VER
+						unsigned long index;
+						_BitScanForward(&index, mask);
+						return static_cast<uint32_t>(index);
+						#else
+						return static_cast<uint32_t>(__builtin_ctz(mask));
+						#endif
+					}
+				}
+
+				const bool HeaderBlockTokenizer::TokenizeHead(const char* begin, const char* end, boost::string_ref& startLine, std::vector<Header>& headers, size_t& headLength)
+				{
+					headers.clear();
+
+					// http_parser counts the start line towards its limit as well.
+					if (static_cast<size_t>(end - begin) >= MaxHeaderBlockSize)
+					{
+						end = begin + MaxHeaderBlockSize - 1;
+					}
+
+					// http_parser skips blank lines ahead of a message. Those are left to it.
+					if (begin == end || *begin == '\r' || *begin == '\n')
+					{
+						return false;
+					}
+
+					// The start line may hold anything a value may. http_parser has the final say
+					// on it, since it's shown the start line as it is.
+					const char* p = FindValueEnd(begin, end);
+
+					// Its CRLF, and at least two more bytes for either the first header or the
+					// empty line.
+					if (end - p < 4 || p[0] != '\r' || p[1] != '\n')
+					{
+						return false;
+					}
+
+					startLine = boost::string_ref(begin, static_cast<size_t>(p - begin));
+
+					p += 2;
+
+					if (p[0] == '\r' && p[1] == '\n')
+					{
+						headLength = static_cast<size_t>(p + 2 - begin);
+						return true;
+					}
+
+					size_t blockLength = 0;
+
+					if (!Tokenize(p, end, headers, blockLength))
+					{
+						return false;
+					}
+
+					headLength = static_cast<size_t>(p - begin) + blockLength;
+
+					return true;
+				}
+
+				const bool HeaderBlockTokenizer::Tokenize(const char* begin, const char* end, std::vector<Header>& headers, size_t& blockLength)
+				{
+					headers.clear();
+
+					if (static_cast<size_t>(end - begin) > MaxHeaderBlockSize)
+					{
+						end = begin + MaxHeaderBlockSize;
+					}
+
+					const char* p = begin;
+
+					while (p < end)
+					{
+						// Name, up to the colon.
+						const char* nameBegin = p;
+
+						while (p < end && Tokens.isToken[static_cast<unsigned char>(*p)])
+						{
+							++p;
+						}
+
+						if (p == end || *p != ':' || p == nameBegin)
+						{
+							return false;
+						}
+
+						const boost::string_ref name(nameBegin, static_cast<size_t>(p - nameBegin));
+
+						++p;
+
+						// Leading whitespace isn't part of the value.
+						while (p < end && (*p == ' ' || *p == '\t'))
+						{
+							++p;
+						}
+
+						const char* valueBegin = p;
+
+						p = FindValueEnd(p, end);
+
+						// Two bytes for this line's CRLF, and at least one more to tell whether the
+						// block ends here or the next line is folded into this one.
+						if (end - p < 3 || p[0] != '\r' || p[1] != '\n' || p == valueBegin)
+						{
+							return false;
+						}
+
+						const char last = *(p - 1);
+
+						if (last == ' ' || last == '\t')
+						{
+							return false;
+						}
+
+						headers.push_back(Header{ name, boost::string_ref(valueBegin, static_cast<size_t>(p - valueBegin)) });
+
+						p += 2;
+
+						if (*p == '\r')
+						{
+							if (end - p < 2 || p[1] != '\n')
+							{
+								return false;
+							}
+
+							blockLength = static_cast<size_t>(p + 2 - begin);
+
+							return true;
+						}
+					}
+
+					return false;
+				}
+
+				const char* HeaderBlockTokenizer::FindValueEnd(const char* begin, const char* end)
+				{
+					const char* p = begin;
+
+					#if defined(TE_HEADER_TOKENIZER_AVX2)
+
+					// A byte is a control character when the unsigned max of it and 0x1F is 0x1F.
+					const __m256i controlMax = _mm256_set1_epi8(0x1F);
+					const __m256i tab = _mm256_set1_epi8('\t');
+					const __m256i del = _mm256_set1_epi8(0x7F);
+
+					while (end - p >= 32)
+					{
+						const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+						const __m256i isControl = _mm256_cmpeq_epi8(_mm256_max_epu8(bytes, controlMax), controlMax);
+						const __m256i isTab = _mm256_cmpeq_epi8(bytes, tab);
+						const __m256i isDel = _mm256_cmpeq_epi8(bytes, del);
+						const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_andnot_si256(isTab, isControl), isDel)));
+
+						if (mask != 0)
+						{
+							return p + LowestSetBit(mask);
+						}
+
+						p += 32;
+					}
+
+					#elif defined(TE_HEADER_TOKENIZER_SSE2)
+
+					// A byte is a control character when the unsigned max of it and 0x1F is 0x1F.
+					const __m128i controlMax = _mm_set1_epi8(0x1F);
+					const __m128i tab = _mm_set1_epi8('\t');
+					const __m128i del = _mm_set1_epi8(0x7F);
+
+					while (end - p >= 16)
+					{
+						const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+						const __m128i isControl = _mm_cmpeq_epi8(_mm_max_epu8(bytes, controlMax), controlMax);
+						const __m128i isTab = _mm_cmpeq_epi8(bytes, tab);
+						const __m128i isDel = _mm_cmpeq_epi8(bytes, del);
+						const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_andnot_si128(isTab, isControl), isDel)));
+
+						if (mask != 0)
+						{
+							return p + LowestSetBit(mask);
+						}
+
+						p += 16;
+					}
+
+					#endif
+
+					while (p < end && IsValueByte(static_cast<unsigned char>(*p)))
+					{
+						++p;
+					}
+
+					return p;
+				}
+
+			} /* namespace http */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,126 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace http
+			{
+
+				/// <summary>
+				/// The HeaderBlockTokenizer class splits a complete HTTP/1.x message head, the start
+				/// line and the header lines, into names and values in a single pass, using SIMD to
+				/// find the end of each line. It exists so that the common case, where the whole head
+				/// arrives in one read, doesn't have to go through http_parser byte by byte, with a
+				/// pair of callbacks per header and the fragment stitching that those callbacks have
+				/// to do in case a name or value was split across reads.
+				///
+				/// The tokenizer is deliberately narrow. It only accepts heads that it can be certain
+				/// http_parser would hand over byte for byte identically, and refuses anything else,
+				/// leaving it to http_parser. That means it refuses heads that are incomplete, that
+				/// begin with blank lines, or that reach http_parser's size limit, names containing
+				/// anything other than token characters, empty values, values with trailing
+				/// whitespace, control characters, line folding, and lines that end in anything but
+				/// CRLF. What it accepts, it is the authority on. See BaseHttpTransaction, which then
+				/// only shows http_parser the start line and the headers that decide framing.
+				/// </summary>
+				class HeaderBlockTokenizer
+				{
+
+				public:
+
+					/// <summary>
+					/// A single header, pointing into the block it was tokenized from.
+					/// </summary>
+					struct Header
+					{
+						boost::string_ref name;
+
+						boost::string_ref value;
+					};
+
+					/// <summary>
+					/// http_parser's default HTTP_MAX_HEADER_SIZE, at which http_parser fails the
+					/// message. The tokenizer only takes on heads that are smaller than this, start
+					/// line included, so that it never accepts what http_parser would have failed.
+					/// </summary>
+					static constexpr size_t MaxHeaderBlockSize = 80 * 1024;
+
+					/// <summary>
+					/// Tokenizes a message head, from the first byte of the start line up to and
+					/// including the empty line that ends the headers.
+					/// </summary>
+					/// <param name="begin">
+					/// The first byte of the message.
+					/// </param>
+					/// <param name="end">
+					/// One past the last byte available.
+					/// </param>
+					/// <param name="startLine">
+					/// The start line, without its CRLF. Only meaningful if the call succeeds.
+					/// </param>
+					/// <param name="headers">
+					/// The headers, in the order they appeared, which may be none. Cleared first.
+					/// Only meaningful if the call succeeds.
+					/// </param>
+					/// <param name="headLength">
+					/// The length of the whole head, which is where the body, if any, begins. Only
+					/// meaningful if the call succeeds.
+					/// </param>
+					/// <returns>
+					/// True if the complete head was found and tokenized, false if the head is
+					/// incomplete or contains anything the tokenizer refuses.
+					/// </returns>
+					static const bool TokenizeHead(const char* begin, const char* end, boost::string_ref& startLine, std::vector<Header>& headers, size_t& headLength);
+
+					/// <summary>
+					/// Tokenizes the header lines beginning at the start of the supplied data, up
+					/// to and including the empty line that ends them.
+					/// </summary>
+					/// <param name="begin">
+					/// The first byte of the first header name.
+					/// </param>
+					/// <param name="end">
+					/// One past the last byte available.
+					/// </param>
+					/// <param name="headers">
+					/// The headers, in the order they appeared. Cleared first. Only meaningful if
+					/// the call succeeds.
+					/// </param>
+					/// <param name="blockLength">
+					/// The length of the block, including the empty line that ends it. Only
+					/// meaningful if the call succeeds.
+					/// </param>
+					/// <returns>
+					/// True if the complete block was found and tokenized, false if the block is
+					/// incomplete or contains anything the tokenizer refuses.
+					/// </returns>
+					static const bool Tokenize(const char* begin, const char* end, std::vector<Header>& headers, size_t& blockLength);
+
+				private:
+
+					/// <summary>
+					/// Finds the first byte that cannot appear in a header value, meaning any
+					/// control character other than horizontal tab.
+					/// </summary>
+					static const char* FindValueEnd(const char* begin, const char* end);
+
+				};
+
+			} /* namespace http */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
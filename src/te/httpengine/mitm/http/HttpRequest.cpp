@@ -156,7 +156,8 @@ namespace te
 							trans->m_httpVersion = HttpProtocolVersion::HTTP1_1;
 						}
 
-						trans->m_requestURI = std::string(at, length);
+						// The URI can arrive in pieces when it's split across reads.
+						trans->m_requestURI.append(at, length);
 
 						trans->m_requestMethod = static_cast<http_method>(parser->method);
 						
@@ -66,6 +66,11 @@ namespace te
 					return m_statusCode;
 				}
 
+				const bool HttpResponse::IsInterim() const
+				{
+					return m_statusCode >= 100 && m_statusCode < 200 && m_statusCode != 101;
+				}
+
 				void HttpResponse::StatusCode(const uint16_t code)
 				{
 					m_statusCode = code;
@@ -144,6 +149,17 @@ namespace te
 					return std::vector<char>(headersAsString.begin(), headersAsString.end());
 				}
 
+				void HttpResponse::HeadersToViews(std::vector<HttpHeaderView>& views)
+				{
+					if (m_statusString.length() <= 0)
+					{
+						// See notes in ::HeadersToString().
+						OnStatus(m_httpParser, nullptr, 0);
+					}
+
+					BaseHttpTransaction::HeadersToViews(views);
+				}
+
 				int HttpResponse::OnStatus(http_parser* parser, const char *at, size_t length)
 				{	
 					// XXX TODO - Is it possible for this callback to be called
@@ -413,7 +429,9 @@ namespace te
 						return std::string(u8"Network connect timeout error");
 
 					default:
-						throw std::exception("Unknown status code");
+						// The reason phrase may be empty. Throwing here would mean throwing out of
+						// http_parser, from ::OnStatus(...), for any status a server cares to send.
+						return std::string();
 					}
 				}
 
@@ -65,6 +65,18 @@ namespace te
 					/// </returns>
 					const uint16_t StatusCode() const;
 
+					/// <summary>
+					/// Checks whether the response is an interim, informational response, such as
+					/// 100 Continue or 103 Early Hints. An interim response has no payload and is
+					/// followed, on the same connection, by the final response to the same request,
+					/// per RFC 7231 section 6.2. 101 Switching Protocols is not considered interim,
+					/// since nothing that follows it is HTTP.
+					/// </summary>
+					/// <returns>
+					/// True if the status code is 1xx other than 101, false otherwise.
+					/// </returns>
+					const bool IsInterim() const;
+
 					/// <summary>
 					/// Sets the status code of the response. Setting the status code also
 					/// internally sets the correct status message string. As such, passing an
@@ -138,6 +150,16 @@ namespace te
 					/// </returns>
 					virtual std::vector<char> HeadersToVector();
 
+					/// <summary>
+					/// Fills the supplied container with a view of every header. See
+					/// BaseHttpTransaction::HeadersToViews(...). Like ::HeadersToString(), this
+					/// also ensures that the status string is populated.
+					/// </summary>
+					/// <param name="views">
+					/// The container to fill.
+					/// </param>
+					virtual void HeadersToViews(std::vector<HttpHeaderView>& views);
+
 				protected:
 
 					/// <summary>
@@ -180,7 +202,8 @@ namespace te
 					/// The legal/defined HTTP Status Code. 
 					/// </param>
 					/// <returns>
-					/// The string message description to accompany the Http Status Code. 
+					/// The string message description to accompany the Http Status Code, or an
+					/// empty string for a code that has none defined.
 					/// </returns>
 					std::string StatusCodeToMessage(const uint16_t& code) const;
 
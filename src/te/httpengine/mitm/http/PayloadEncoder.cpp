@@ -0,0 +1,251 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "PayloadEncoder.hpp"
+
+#include <ios>
+#include <stdexcept>
+#include <boost/iostreams/device/back_inserter.hpp>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace http
+			{
+
+				namespace
+				{
+					inline bool IsSpace(const char c)
+					{
+						return c == ' ' || c == '\t';
+					}
+
+					inline boost::string_ref Trim(boost::string_ref value)
+					{
+						while (!value.empty() && IsSpace(value.front()))
+						{
+							value.remove_prefix(1);
+						}
+
+						while (!value.empty() && IsSpace(value.back()))
+						{
+							value.remove_suffix(1);
+						}
+
+						return value;
+					}
+
+					inline bool EqualsIgnoreCase(boost::string_ref value, boost::string_ref lowered)
+					{
+						if (value.size() != lowered.size())
+						{
+							return false;
+						}
+
+						for (size_t i = 0; i < value.size(); ++i)
+						{
+							const char c = value[i];
+
+							if (((c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c) != lowered[i])
+							{
+								return false;
+							}
+						}
+
+						return true;
+					}
+
+					/// <summary>
+					/// Parses a quality value, RFC 7231 section 5.3.1, into thousandths. Anything
+					/// that isn't a valid quality value is taken to be one, as if it were absent.
+					/// </summary>
+					uint16_t ParseQuality(boost::string_ref value)
+					{
+						if (value.empty() || value.front() != '0')
+						{
+							return 1000;
+						}
+
+						uint16_t quality = 0;
+						uint16_t scale = 100;
+
+						if (value.size() > 1 && value[1] == '.')
+						{
+							for (size_t i = 2; i < value.size() && scale > 0; ++i, scale /= 10)
+							{
+								if (value[i] < '0' || value[i] > '9')
+								{
+									return 1000;
+								}
+
+								quality += static_cast<uint16_t>((value[i] - '0') * scale);
+							}
+						}
+
+						return quality;
+					}
+				}
+
+				const PayloadEncoder::Acceptance PayloadEncoder::ParseAcceptEncoding(boost::string_ref acceptEncoding)
+				{
+					Acceptance acceptance;
+
+					// -1 for codings the client didn't mention.
+					int32_t gzip = -1;
+					int32_t deflate = -1;
+					int32_t identity = -1;
+					int32_t anything = -1;
+
+					while (!acceptEncoding.empty())
+					{
+						auto comma = acceptEncoding.find(',');
+						auto element = acceptEncoding.substr(0, comma);
+						acceptEncoding = comma == boost::string_ref::npos ? boost::string_ref() : acceptEncoding.substr(comma + 1);
+
+						auto semicolon = element.find(';');
+						auto coding = Trim(element.substr(0, semicolon));
+
+						uint16_t quality = 1000;
+
+						while (semicolon != boost::string_ref::npos)
+						{
+							element = element.substr(semicolon + 1);
+							semicolon = element.find(';');
+
+							auto parameter = Trim(element.substr(0, semicolon));
+
+							if (parameter.size() >= 2 && (parameter[0] == 'q' || parameter[0] == 'Q') && parameter[1] == '=')
+							{
+								quality = ParseQuality(Trim(parameter.substr(2)));
+							}
+						}
+
+						if (EqualsIgnoreCase(coding, u8"gzip") || EqualsIgnoreCase(coding, u8"x-gzip"))
+						{
+							gzip = quality;
+						}
+						else if (EqualsIgnoreCase(coding, u8"deflate"))
+						{
+							deflate = quality;
+						}
+						else if (EqualsIgnoreCase(coding, u8"identity"))
+						{
+							identity = quality;
+						}
+						else if (coding == u8"*")
+						{
+							anything = quality;
+						}
+					}
+
+					acceptance.gzip = static_cast<uint16_t>(gzip >= 0 ? gzip : (anything >= 0 ? anything : 0));
+					acceptance.deflate = static_cast<uint16_t>(deflate >= 0 ? deflate : (anything >= 0 ? anything : 0));
+
+					// Identity is always acceptable, unless it's refused outright, or everything
+					// not mentioned is refused and identity wasn't mentioned.
+					acceptance.identity = static_cast<uint16_t>(identity >= 0 ? identity : (anything == 0 ? 0 : 1000));
+
+					return acceptance;
+				}
+
+				const char* PayloadEncoder::GetCodingName(const Coding coding)
+				{
+					switch (coding)
+					{
+						case Coding::Gzip:
+							return u8"gzip";
+
+						case Coding::Deflate:
+							return u8"deflate";
+
+						default:
+							return u8"identity";
+					}
+				}
+
+				PayloadEncoder::PayloadEncoder(const Coding coding, const int level) : m_coding(coding)
+				{
+					const int clampedLevel = level < 1 ? 1 : (level > 9 ? 9 : level);
+
+					switch (coding)
+					{
+						case Coding::Gzip:
+						{
+							m_gzip.reset(new boost::iostreams::gzip_compressor(boost::iostreams::gzip_params(clampedLevel)));
+						}
+						break;
+
+						case Coding::Deflate:
+						{
+							m_zlib.reset(new boost::iostreams::zlib_compressor(boost::iostreams::zlib_params(clampedLevel)));
+						}
+						break;
+
+						default:
+						{
+							throw std::invalid_argument(u8"In PayloadEncoder::PayloadEncoder(const Coding, const int) - Identity isn't something that can be encoded.");
+						}
+					}
+				}
+
+				void PayloadEncoder::Encode(const char* data, const size_t length, std::vector<char>& out)
+				{
+					if (m_finished)
+					{
+						throw std::runtime_error(u8"In PayloadEncoder::Encode(const char*, const size_t, std::vector<char>&) - The stream has already been finished.");
+					}
+
+					if (length == 0)
+					{
+						return;
+					}
+
+					boost::iostreams::back_insert_device<std::vector<char>> sink(out);
+
+					if (m_gzip)
+					{
+						m_gzip->write(sink, data, static_cast<std::streamsize>(length));
+					}
+					else
+					{
+						m_zlib->write(sink, data, static_cast<std::streamsize>(length));
+					}
+				}
+
+				void PayloadEncoder::Finish(std::vector<char>& out)
+				{
+					if (m_finished)
+					{
+						throw std::runtime_error(u8"In PayloadEncoder::Finish(std::vector<char>&) - The stream has already been finished.");
+					}
+
+					m_finished = true;
+
+					boost::iostreams::back_insert_device<std::vector<char>> sink(out);
+
+					if (m_gzip)
+					{
+						m_gzip->close(sink, std::ios_base::out);
+					}
+					else
+					{
+						m_zlib->close(sink, std::ios_base::out);
+					}
+				}
+
+				const PayloadEncoder::Coding PayloadEncoder::GetCoding() const
+				{
+					return m_coding;
+				}
+
+			} /* namespace http */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,189 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace http
+			{
+
+				/// <summary>
+				/// The PayloadEncoder class compresses a payload a piece at a time, so that a
+				/// payload that was decompressed for inspection can be compressed again as it's
+				/// written to the client, rather than all at once before the first byte of it goes
+				/// out. Each call compresses only what it's given, and hands back whatever
+				/// compressed output is ready, which may be nothing until enough input has been
+				/// supplied.
+				///
+				/// It also works out which content codings a client will take, from the value of
+				/// the Accept-Encoding header of its request, per RFC 7231 section 5.3.4.
+				/// </summary>
+				class PayloadEncoder
+				{
+
+				public:
+
+					/// <summary>
+					/// A content coding.
+					/// </summary>
+					enum class Coding : uint32_t
+					{
+						/// <summary>
+						/// No compression.
+						/// </summary>
+						Identity = 0,
+
+						/// <summary>
+						/// Gzip, RFC 1952.
+						/// </summary>
+						Gzip = 1,
+
+						/// <summary>
+						/// Zlib wrapped deflate, RFC 1950. This is what "deflate" means in HTTP.
+						/// </summary>
+						Deflate = 2
+					};
+
+					/// <summary>
+					/// How much a client wants each of the content codings we can produce, as
+					/// quality values scaled to thousandths. Zero means not acceptable.
+					/// </summary>
+					struct Acceptance
+					{
+						uint16_t gzip = 0;
+
+						uint16_t deflate = 0;
+
+						uint16_t identity = 1000;
+					};
+
+					/// <summary>
+					/// The compression level used when none is specified. The fastest there is,
+					/// since recompressing is done on an io_service thread.
+					/// </summary>
+					static constexpr int DefaultLevel = 1;
+
+					/// <summary>
+					/// Works out which content codings a client will take.
+					/// </summary>
+					/// <param name="acceptEncoding">
+					/// The value of the Accept-Encoding header of the client's request. Empty if
+					/// the header was absent, in which case only identity is considered
+					/// acceptable. Strictly, a client that sends no Accept-Encoding at all takes
+					/// anything, but in practice, such clients are the ones least likely to
+					/// cope.
+					/// </param>
+					/// <returns>
+					/// How much the client wants each coding.
+					/// </returns>
+					static const Acceptance ParseAcceptEncoding(boost::string_ref acceptEncoding);
+
+					/// <summary>
+					/// Gets the name of a content coding, as it appears in the Content-Encoding
+					/// header.
+					/// </summary>
+					/// <param name="coding">
+					/// The coding.
+					/// </param>
+					/// <returns>
+					/// The name of the coding.
+					/// </returns>
+					static const char* GetCodingName(const Coding coding);
+
+					/// <summary>
+					/// Constructs a new PayloadEncoder.
+					/// </summary>
+					/// <param name="coding">
+					/// The coding to compress with. Must not be Coding::Identity.
+					/// </param>
+					/// <param name="level">
+					/// The compression level, from one, the fastest, to nine, the smallest.
+					/// Values outside of that are clamped.
+					/// </param>
+					/// <exception cref="std::invalid_argument">
+					/// If coding is Coding::Identity.
+					/// </exception>
+					PayloadEncoder(const Coding coding, const int level = DefaultLevel);
+
+					/// <summary>
+					/// No copy no move no thx.
+					/// </summary>
+					PayloadEncoder(const PayloadEncoder&) = delete;
+					PayloadEncoder(PayloadEncoder&&) = delete;
+					PayloadEncoder& operator=(const PayloadEncoder&) = delete;
+
+					/// <summary>
+					/// Compresses the next piece of the payload.
+					/// </summary>
+					/// <param name="data">
+					/// The next piece of the payload.
+					/// </param>
+					/// <param name="length">
+					/// The length of the piece, in bytes.
+					/// </param>
+					/// <param name="out">
+					/// Compressed output that's ready is appended to this.
+					/// </param>
+					/// <exception cref="std::exception">
+					/// If compression fails, or after ::Finish(...) has been called.
+					/// </exception>
+					void Encode(const char* data, const size_t length, std::vector<char>& out);
+
+					/// <summary>
+					/// Ends the compressed stream, appending whatever output is still held back,
+					/// along with any trailer the coding calls for.
+					/// </summary>
+					/// <param name="out">
+					/// The remaining output is appended to this.
+					/// </param>
+					/// <exception cref="std::exception">
+					/// If compression fails, or if called more than once.
+					/// </exception>
+					void Finish(std::vector<char>& out);
+
+					/// <summary>
+					/// Gets the coding being compressed with.
+					/// </summary>
+					/// <returns>
+					/// The coding being compressed with.
+					/// </returns>
+					const Coding GetCoding() const;
+
+				private:
+
+					Coding m_coding;
+
+					/// <summary>
+					/// Set for Coding::Gzip.
+					/// </summary>
+					std::unique_ptr<boost::iostreams::gzip_compressor> m_gzip;
+
+					/// <summary>
+					/// Set for Coding::Deflate.
+					/// </summary>
+					std::unique_ptr<boost::iostreams::zlib_compressor> m_zlib;
+
+					bool m_finished = false;
+				};
+
+			} /* namespace http */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,1205 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "ResponseCache.hpp"
+
+#include "HttpRequest.hpp"
+#include "HttpResponse.hpp"
+#include "../../../util/http/KnownHttpHeaders.hpp"
+#include <algorithm>
+#include <boost/utility/string_ref.hpp>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace http
+			{
+
+				namespace
+				{
+					using HeaderList = std::vector<std::pair<std::string, std::string>>;
+
+					inline char ToLower(const char c)
+					{
+						return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+					}
+
+					inline bool IsSpace(const char c)
+					{
+						return c == ' ' || c == '\t';
+					}
+
+					inline bool IsDigit(const char c)
+					{
+						return c >= '0' && c <= '9';
+					}
+
+					inline boost::string_ref Trim(boost::string_ref value)
+					{
+						while (!value.empty() && IsSpace(value.front()))
+						{
+							value.remove_prefix(1);
+						}
+
+						while (!value.empty() && IsSpace(value.back()))
+						{
+							value.remove_suffix(1);
+						}
+
+						return value;
+					}
+
+					bool EqualsIgnoreCase(boost::string_ref a, boost::string_ref b)
+					{
+						if (a.size() != b.size())
+						{
+							return false;
+						}
+
+						for (size_t i = 0; i < a.size(); ++i)
+						{
+							if (ToLower(a[i]) != ToLower(b[i]))
+							{
+								return false;
+							}
+						}
+
+						return true;
+					}
+
+					/// <summary>
+					/// Calls the supplied function with each comma separated element of a header
+					/// value, trimmed, skipping empty elements. Commas within quoted strings don't
+					/// separate.
+					/// </summary>
+					template<typename Fn>
+					void ForEachElement(boost::string_ref value, Fn fn)
+					{
+						bool quoted = false;
+						size_t start = 0;
+
+						for (size_t i = 0; i <= value.size(); ++i)
+						{
+							if (i < value.size())
+							{
+								if (value[i] == '"')
+								{
+									quoted = !quoted;
+									continue;
+								}
+
+								if (quoted || value[i] != ',')
+								{
+									continue;
+								}
+							}
+
+							auto element = Trim(value.substr(start, i - start));
+
+							if (!element.empty())
+							{
+								fn(element);
+							}
+
+							start = i + 1;
+						}
+					}
+
+					/// <summary>
+					/// Parses a non-negative number of seconds, optionally quoted, clamping rather
+					/// than overflowing, per RFC 7234 section 1.2.1.
+					/// </summary>
+					bool ParseDeltaSeconds(boost::string_ref value, int64_t& seconds)
+					{
+						value = Trim(value);
+
+						if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+						{
+							value = value.substr(1, value.size() - 2);
+						}
+
+						if (value.empty())
+						{
+							return false;
+						}
+
+						int64_t parsed = 0;
+
+						for (const char c : value)
+						{
+							if (!IsDigit(c))
+							{
+								return false;
+							}
+
+							if (parsed < INT32_MAX)
+							{
+								parsed = (parsed * 10) + (c - '0');
+							}
+						}
+
+						seconds = std::min<int64_t>(parsed, INT32_MAX);
+
+						return true;
+					}
+
+					/// <summary>
+					/// The Cache-Control directives we act on. Directives with field names, such as
+					/// private="Set-Cookie", are taken to apply to the whole response.
+					/// </summary>
+					struct CacheControl
+					{
+						bool noStore = false;
+
+						bool noCache = false;
+
+						bool isPrivate = false;
+
+						bool isPublic = false;
+
+						bool mustRevalidate = false;
+
+						int64_t maxAge = -1;
+
+						int64_t sMaxAge = -1;
+					};
+
+					void ParseCacheControl(boost::string_ref value, CacheControl& cc)
+					{
+						ForEachElement(value, [&cc](boost::string_ref directive)
+						{
+							auto equals = directive.find('=');
+							auto name = Trim(directive.substr(0, equals));
+							auto argument = equals == boost::string_ref::npos ? boost::string_ref() : directive.substr(equals + 1);
+
+							if (EqualsIgnoreCase(name, u8"no-store"))
+							{
+								cc.noStore = true;
+							}
+							else if (EqualsIgnoreCase(name, u8"no-cache"))
+							{
+								cc.noCache = true;
+							}
+							else if (EqualsIgnoreCase(name, u8"private"))
+							{
+								cc.isPrivate = true;
+							}
+							else if (EqualsIgnoreCase(name, u8"public"))
+							{
+								cc.isPublic = true;
+							}
+							else if (EqualsIgnoreCase(name, u8"must-revalidate") || EqualsIgnoreCase(name, u8"proxy-revalidate"))
+							{
+								cc.mustRevalidate = true;
+							}
+							else if (EqualsIgnoreCase(name, u8"max-age"))
+							{
+								// A malformed max-age makes the response stale, per RFC 7234
+								// section 4.2.1.
+								if (!ParseDeltaSeconds(argument, cc.maxAge))
+								{
+									cc.maxAge = 0;
+								}
+							}
+							else if (EqualsIgnoreCase(name, u8"s-maxage"))
+							{
+								if (!ParseDeltaSeconds(argument, cc.sMaxAge))
+								{
+									cc.sMaxAge = 0;
+								}
+							}
+						});
+					}
+
+					void ParseCacheControl(const BaseHttpTransaction& transaction, CacheControl& cc)
+					{
+						auto range = transaction.GetHeader(util::http::headers::CacheControl);
+
+						for (auto it = range.first; it != range.second; ++it)
+						{
+							ParseCacheControl(it->second, cc);
+						}
+					}
+
+					/// <summary>
+					/// Days since 1970-01-01 of a proleptic Gregorian date.
+					/// </summary>
+					int64_t DaysFromCivil(int64_t year, const int64_t month, const int64_t day)
+					{
+						year -= month <= 2 ? 1 : 0;
+						const int64_t era = (year >= 0 ? year : year - 399) / 400;
+						const int64_t yearOfEra = year - (era * 400);
+						const int64_t dayOfYear = ((153 * (month + (month > 2 ? -3 : 9)) + 2) / 5) + day - 1;
+						const int64_t dayOfEra = (yearOfEra * 365) + (yearOfEra / 4) - (yearOfEra / 100) + dayOfYear;
+						return (era * 146097) + dayOfEra - 719468;
+					}
+
+					/// <summary>
+					/// Parses an HTTP date, in any of the three formats RFC 7231 section 7.1.1.1
+					/// requires recipients to accept, into seconds since the Unix epoch. All three
+					/// put the day before the year, and only differ in punctuation and in where
+					/// the time goes, so the date is taken apart into tokens and each is identified
+					/// by its shape.
+					/// </summary>
+					bool ParseHttpDate(boost::string_ref value, int64_t& seconds)
+					{
+						static const char* months[] = { u8"jan", u8"feb", u8"mar", u8"apr", u8"may", u8"jun", u8"jul", u8"aug", u8"sep", u8"oct", u8"nov", u8"dec" };
+
+						int64_t day = -1;
+						int64_t month = -1;
+						int64_t year = -1;
+						int64_t hour = -1;
+						int64_t minute = -1;
+						int64_t second = -1;
+
+						size_t start = 0;
+
+						for (size_t i = 0; i <= value.size(); ++i)
+						{
+							if (i < value.size() && value[i] != ' ' && value[i] != ',' && value[i] != '-')
+							{
+								continue;
+							}
+
+							auto token = value.substr(start, i - start);
+							start = i + 1;
+
+							if (token.empty())
+							{
+								continue;
+							}
+
+							if (token.find(':') != boost::string_ref::npos)
+							{
+								if (token.size() != 8 || token[2] != ':' || token[5] != ':' ||
+									!IsDigit(token[0]) || !IsDigit(token[1]) || !IsDigit(token[3]) ||
+									!IsDigit(token[4]) || !IsDigit(token[6]) || !IsDigit(token[7]))
+								{
+									return false;
+								}
+
+								hour = ((token[0] - '0') * 10) + (token[1] - '0');
+								minute = ((token[3] - '0') * 10) + (token[4] - '0');
+								second = ((token[6] - '0') * 10) + (token[7] - '0');
+							}
+							else if (IsDigit(token.front()))
+							{
+								int64_t number = 0;
+
+								if (!ParseDeltaSeconds(token, number))
+								{
+									return false;
+								}
+
+								if (day < 0 && token.size() <= 2)
+								{
+									day = number;
+								}
+								else if (year < 0)
+								{
+									year = number;
+
+									// Two digit years, from RFC 850 dates, per RFC 7231 section
+									// 7.1.1.1.
+									if (token.size() == 2)
+									{
+										year += year >= 70 ? 1900 : 2000;
+									}
+								}
+								else
+								{
+									return false;
+								}
+							}
+							else if (token.size() == 3)
+							{
+								for (int64_t m = 0; m < 12; ++m)
+								{
+									if (EqualsIgnoreCase(token, months[m]))
+									{
+										month = m + 1;
+										break;
+									}
+								}
+
+								// Anything else is the day name or the zone, which is always GMT.
+							}
+						}
+
+						if (day < 1 || day > 31 || month < 0 || year < 1970 || hour < 0 || hour > 23 || minute > 59 || second > 60)
+						{
+							return false;
+						}
+
+						seconds = (DaysFromCivil(year, month, day) * 86400) + (hour * 3600) + (minute * 60) + second;
+
+						return true;
+					}
+
+					const std::string* FindHeader(const HeaderList& headers, const std::string& name)
+					{
+						for (const auto& header : headers)
+						{
+							if (EqualsIgnoreCase(header.first, name))
+							{
+								return &header.second;
+							}
+						}
+
+						return nullptr;
+					}
+
+					/// <summary>
+					/// Checks whether a header is hop by hop, or is otherwise not to be stored.
+					/// Content-Length and Age are generated whenever a stored response is served.
+					/// </summary>
+					bool IsExcludedHeader(boost::string_ref name, const std::vector<std::string>& connectionTokens)
+					{
+						static const std::string* excluded[] =
+						{
+							&util::http::headers::Connection,
+							&util::http::headers::KeepAlive,
+							&util::http::headers::ProxyAuthenticate,
+							&util::http::headers::ProxyAuthorization,
+							&util::http::headers::ProxyConnection,
+							&util::http::headers::TE,
+							&util::http::headers::Trailer,
+							&util::http::headers::TransferEncoding,
+							&util::http::headers::Upgrade,
+							&util::http::headers::ContentLength,
+							&util::http::headers::Age
+						};
+
+						for (const auto header : excluded)
+						{
+							if (EqualsIgnoreCase(name, *header))
+							{
+								return true;
+							}
+						}
+
+						for (const auto& token : connectionTokens)
+						{
+							if (EqualsIgnoreCase(name, token))
+							{
+								return true;
+							}
+						}
+
+						return false;
+					}
+
+					/// <summary>
+					/// Copies the end to end headers of a response, and gets the value of its Age
+					/// header, if it has one.
+					/// </summary>
+					void CopyEndToEndHeaders(HttpResponse& response, HeaderList& headers, int64_t& age)
+					{
+						std::vector<std::string> connectionTokens;
+
+						auto connection = response.GetHeader(util::http::headers::Connection);
+
+						for (auto it = connection.first; it != connection.second; ++it)
+						{
+							ForEachElement(it->second, [&connectionTokens](boost::string_ref token)
+							{
+								connectionTokens.emplace_back(token.begin(), token.end());
+							});
+						}
+
+						std::vector<HttpHeaderView> views;
+						response.HeadersToViews(views);
+
+						age = 0;
+
+						for (const auto& view : views)
+						{
+							boost::string_ref name(view.name, view.nameLength);
+							boost::string_ref value(view.value, view.valueLength);
+
+							if (EqualsIgnoreCase(name, util::http::headers::Age))
+							{
+								ParseDeltaSeconds(value, age);
+								continue;
+							}
+
+							if (!IsExcludedHeader(name, connectionTokens))
+							{
+								headers.emplace_back(std::string(name.begin(), name.end()), std::string(value.begin(), value.end()));
+							}
+						}
+					}
+
+					/// <summary>
+					/// Joins the values of every instance of a request header, for comparing
+					/// against the values a stored response varies on.
+					/// </summary>
+					std::string GetJoinedHeader(const BaseHttpTransaction& transaction, const std::string& name)
+					{
+						std::string joined;
+
+						auto range = transaction.GetHeader(name);
+
+						for (auto it = range.first; it != range.second; ++it)
+						{
+							auto value = Trim(it->second);
+
+							if (!joined.empty())
+							{
+								joined.append(u8", ");
+							}
+
+							joined.append(value.begin(), value.end());
+						}
+
+						return joined;
+					}
+
+					bool VaryMatches(const ResponseCache::Entry& entry, const HttpRequest& request)
+					{
+						for (const auto& vary : entry.varyValues)
+						{
+							if (GetJoinedHeader(request, vary.first) != vary.second)
+							{
+								return false;
+							}
+						}
+
+						return true;
+					}
+
+					/// <summary>
+					/// The weak comparison of RFC 7232 section 2.3.2.
+					/// </summary>
+					bool WeakETagEquals(boost::string_ref a, boost::string_ref b)
+					{
+						if (a.starts_with(u8"W/"))
+						{
+							a.remove_prefix(2);
+						}
+
+						if (b.starts_with(u8"W/"))
+						{
+							b.remove_prefix(2);
+						}
+
+						return a == b;
+					}
+
+					bool IsHeuristicallyCacheable(const uint16_t statusCode)
+					{
+						switch (statusCode)
+						{
+							case 200:
+							case 203:
+							case 204:
+							case 300:
+							case 301:
+							case 404:
+							case 405:
+							case 410:
+							case 414:
+							case 501:
+								return true;
+
+							default:
+								return false;
+						}
+					}
+
+					int64_t GetWallClockSeconds()
+					{
+						return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+					}
+
+					/// <summary>
+					/// Works out the validators, freshness lifetime and initial age of a stored
+					/// response from its headers, per RFC 7234 sections 4.2.1 through 4.2.3.
+					/// </summary>
+					void UpdateFreshness(ResponseCache::Entry& entry, const int64_t ageHeader)
+					{
+						const int64_t now = GetWallClockSeconds();
+
+						CacheControl cc;
+
+						for (const auto& header : entry.headers)
+						{
+							if (EqualsIgnoreCase(header.first, util::http::headers::CacheControl))
+							{
+								ParseCacheControl(header.second, cc);
+							}
+						}
+
+						auto etag = FindHeader(entry.headers, util::http::headers::ETag);
+						auto lastModified = FindHeader(entry.headers, util::http::headers::LastModified);
+						auto dateHeader = FindHeader(entry.headers, util::http::headers::Date);
+						auto expiresHeader = FindHeader(entry.headers, util::http::headers::Expires);
+
+						entry.etag = etag != nullptr ? Trim(*etag).to_string() : std::string();
+						entry.lastModified = lastModified != nullptr ? Trim(*lastModified).to_string() : std::string();
+
+						int64_t date = now;
+
+						if (dateHeader == nullptr || !ParseHttpDate(*dateHeader, date))
+						{
+							date = now;
+						}
+
+						int64_t freshness = 0;
+						int64_t lastModifiedTime = 0;
+						int64_t expires = 0;
+
+						if (cc.sMaxAge >= 0)
+						{
+							freshness = cc.sMaxAge;
+						}
+						else if (cc.maxAge >= 0)
+						{
+							freshness = cc.maxAge;
+						}
+						else if (expiresHeader != nullptr)
+						{
+							// An invalid Expires, such as "0", means already expired.
+							freshness = ParseHttpDate(*expiresHeader, expires) ? std::max<int64_t>(expires - date, 0) : 0;
+						}
+						else if (!cc.mustRevalidate && IsHeuristicallyCacheable(entry.statusCode) && lastModified != nullptr && ParseHttpDate(*lastModified, lastModifiedTime) && lastModifiedTime < date)
+						{
+							freshness = std::min<int64_t>((date - lastModifiedTime) / 10, ResponseCache::MaxHeuristicFreshnessSeconds);
+						}
+
+						entry.freshnessSeconds = static_cast<uint64_t>(freshness);
+						entry.initialAgeSeconds = static_cast<uint64_t>(std::max<int64_t>(ageHeader, std::max<int64_t>(now - date, 0)));
+						entry.noCache = cc.noCache;
+						entry.storedAt = std::chrono::steady_clock::now();
+					}
+
+					uint64_t GetCurrentAge(const ResponseCache::Entry& entry)
+					{
+						auto resident = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - entry.storedAt).count();
+
+						return entry.initialAgeSeconds + static_cast<uint64_t>(std::max<int64_t>(resident, 0));
+					}
+
+					uint64_t GetEntrySize(const ResponseCache::Entry& entry)
+					{
+						// A rough allowance for the entry, its nodes and its bookkeeping.
+						uint64_t size = 256 + entry.key.size() + entry.statusText.size() + entry.etag.size() + entry.lastModified.size();
+
+						for (const auto& header : entry.headers)
+						{
+							size += header.first.size() + header.second.size() + 64;
+						}
+
+						for (const auto& vary : entry.varyValues)
+						{
+							size += vary.first.size() + vary.second.size() + 64;
+						}
+
+						if (entry.body)
+						{
+							size += entry.body->size();
+						}
+
+						return size;
+					}
+
+					std::string MakeKey(const bool secure, const std::string& host, const std::string& requestUri)
+					{
+						std::string key(secure ? u8"https://" : u8"http://");
+						key.reserve(key.size() + host.size() + requestUri.size());
+
+						for (const char c : host)
+						{
+							key.push_back(ToLower(c));
+						}
+
+						key.append(requestUri);
+
+						return key;
+					}
+
+					bool HasHeader(const BaseHttpTransaction& transaction, const std::string& name)
+					{
+						auto range = transaction.GetHeader(name);
+						return range.first != range.second;
+					}
+				}
+
+				void ResponseCache::SetMaxBytes(const uint64_t maxBytes)
+				{
+					const uint64_t previous = m_maxBytes.exchange(maxBytes);
+
+					if (maxBytes == 0)
+					{
+						if (previous != 0)
+						{
+							Flush();
+						}
+
+						return;
+					}
+
+					if (maxBytes < previous)
+					{
+						for (auto& shard : m_shards)
+						{
+							std::lock_guard<std::mutex> lock(shard.mutex);
+							MakeRoom(shard, maxBytes / ShardCount, 0);
+						}
+					}
+				}
+
+				const uint64_t ResponseCache::GetMaxBytes() const
+				{
+					return m_maxBytes.load();
+				}
+
+				const ResponseCache::LookupResult ResponseCache::Lookup(const bool secure, const std::string& host, const HttpRequest& request, const uint64_t generation, std::shared_ptr<const Entry>& entry)
+				{
+					entry.reset();
+
+					if (m_maxBytes.load() == 0 || m_entryCount.load() == 0 || request.Method() != HTTP_GET)
+					{
+						return LookupResult::Miss;
+					}
+
+					// Requests we either can't answer from a whole stored response, or that we
+					// never store responses to.
+					if (HasHeader(request, util::http::headers::Range) ||
+						HasHeader(request, util::http::headers::IfMatch) ||
+						HasHeader(request, util::http::headers::IfUnmodifiedSince) ||
+						HasHeader(request, util::http::headers::IfRange))
+					{
+						return LookupResult::Miss;
+					}
+
+					CacheControl requestCc;
+					ParseCacheControl(request, requestCc);
+
+					if (requestCc.noStore)
+					{
+						return LookupResult::Miss;
+					}
+
+					auto key = MakeKey(secure, host, request.RequestURI());
+
+					auto& shard = GetShard(key);
+
+					std::shared_ptr<const Entry> found;
+
+					{
+						std::lock_guard<std::mutex> lock(shard.mutex);
+
+						auto range = shard.index.equal_range(key);
+
+						for (auto it = range.first; it != range.second; ++it)
+						{
+							if (!VaryMatches(**it->second, request))
+							{
+								continue;
+							}
+
+							if ((*it->second)->generation != generation)
+							{
+								// Allowed under a filtering configuration that's since been
+								// replaced, so it's to be inspected again.
+								Erase(shard, it->second);
+							}
+							else
+							{
+								found = *it->second;
+								shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+							}
+
+							break;
+						}
+					}
+
+					if (!found)
+					{
+						++m_missCount;
+						return LookupResult::Miss;
+					}
+
+					// A request with credentials may only be answered with what the server said
+					// can be shared with one, RFC 7234 section 3.2. The same rule decides whether
+					// responses to such requests are stored.
+					if (!found->sharedWithCredentials && HasHeader(request, util::http::headers::Authorization))
+					{
+						++m_missCount;
+						return LookupResult::Miss;
+					}
+
+					const uint64_t age = GetCurrentAge(*found);
+
+					bool stale = found->noCache || requestCc.noCache || age >= found->freshnessSeconds;
+
+					if (requestCc.maxAge >= 0 && age > static_cast<uint64_t>(requestCc.maxAge))
+					{
+						stale = true;
+					}
+
+					auto pragma = request.GetHeader(util::http::headers::Pragma);
+
+					for (auto it = pragma.first; it != pragma.second; ++it)
+					{
+						if (Trim(it->second) == u8"no-cache")
+						{
+							stale = true;
+						}
+					}
+
+					if (!stale)
+					{
+						++m_hitCount;
+						entry = std::move(found);
+						return LookupResult::Fresh;
+					}
+
+					// Revalidating means substituting our own validators, which we can't do
+					// over the client's own.
+					if ((found->etag.empty() && found->lastModified.empty()) ||
+						HasHeader(request, util::http::headers::IfNoneMatch) ||
+						HasHeader(request, util::http::headers::IfModifiedSince))
+					{
+						++m_missCount;
+						return LookupResult::Miss;
+					}
+
+					++m_staleCount;
+					entry = std::move(found);
+					return LookupResult::Stale;
+				}
+
+				const bool ResponseCache::Store(const bool secure, const std::string& host, const HttpRequest& request, HttpResponse& response, const uint64_t generation)
+				{
+					const uint64_t maxBytes = m_maxBytes.load();
+
+					if (maxBytes == 0 || request.Method() != HTTP_GET || HasHeader(request, util::http::headers::Range))
+					{
+						return false;
+					}
+
+					if (!IsHeuristicallyCacheable(response.StatusCode()) || !response.IsPayloadHeldInFull() || response.IsPayloadCompressed())
+					{
+						return false;
+					}
+
+					CacheControl requestCc;
+					ParseCacheControl(request, requestCc);
+
+					CacheControl responseCc;
+					ParseCacheControl(response, responseCc);
+
+					if (requestCc.noStore || responseCc.noStore || responseCc.isPrivate)
+					{
+						return false;
+					}
+
+					// Whatever sets cookies is meant for one client only, whatever it says.
+					if (HasHeader(response, util::http::headers::SetCookie) || HasHeader(response, util::http::headers::SetCookie2))
+					{
+						return false;
+					}
+
+					// Per RFC 7234 section 3.2, and going further with cookies, which are as good
+					// as credentials in practice.
+					const bool explicitlyShared = responseCc.isPublic || responseCc.sMaxAge >= 0;
+
+					if (HasHeader(request, util::http::headers::Authorization) && !explicitlyShared && !responseCc.mustRevalidate)
+					{
+						return false;
+					}
+
+					if (HasHeader(request, util::http::headers::Cookie) && !explicitlyShared)
+					{
+						return false;
+					}
+
+					auto entry = std::make_shared<Entry>();
+
+					auto vary = response.GetHeader(util::http::headers::Vary);
+
+					for (auto it = vary.first; it != vary.second; ++it)
+					{
+						bool varyAll = false;
+
+						ForEachElement(it->second, [&entry, &request, &varyAll](boost::string_ref name)
+						{
+							if (name == u8"*")
+							{
+								varyAll = true;
+								return;
+							}
+
+							std::string lowered;
+
+							for (const char c : name)
+							{
+								lowered.push_back(ToLower(c));
+							}
+
+							auto value = GetJoinedHeader(request, lowered);
+
+							entry->varyValues.emplace_back(std::move(lowered), std::move(value));
+						});
+
+						if (varyAll)
+						{
+							return false;
+						}
+					}
+
+					std::sort(entry->varyValues.begin(), entry->varyValues.end());
+
+					entry->key = MakeKey(secure, host, request.RequestURI());
+					entry->statusCode = response.StatusCode();
+
+					// The stored status line is served to clients of either version.
+					const auto& statusString = response.StatusString();
+					auto space = statusString.find(' ');
+					entry->statusText = space == std::string::npos ? std::to_string(entry->statusCode) : statusString.substr(space + 1);
+
+					int64_t ageHeader = 0;
+					CopyEndToEndHeaders(response, entry->headers, ageHeader);
+
+					entry->body = std::make_shared<const std::vector<char>>(response.GetPayload());
+					entry->generation = generation;
+					entry->sharedWithCredentials = explicitlyShared || responseCc.mustRevalidate;
+
+					UpdateFreshness(*entry, ageHeader);
+
+					if (entry->freshnessSeconds == 0 && entry->etag.empty() && entry->lastModified.empty())
+					{
+						// Could never be used without going to the server anyway.
+						return false;
+					}
+
+					entry->size = GetEntrySize(*entry);
+
+					const uint64_t shardBudget = maxBytes / ShardCount;
+
+					// Keep any one response from flushing out everything else.
+					if (entry->size > shardBudget / 2)
+					{
+						return false;
+					}
+
+					auto& shard = GetShard(entry->key);
+
+					std::lock_guard<std::mutex> lock(shard.mutex);
+
+					auto range = shard.index.equal_range(entry->key);
+
+					for (auto it = range.first; it != range.second; ++it)
+					{
+						if ((*it->second)->varyValues == entry->varyValues)
+						{
+							Erase(shard, it->second);
+							break;
+						}
+					}
+
+					MakeRoom(shard, shardBudget, entry->size);
+
+					shard.entries.push_front(entry);
+					shard.index.emplace(entry->key, shard.entries.begin());
+					shard.bytes += entry->size;
+
+					m_usedBytes += entry->size;
+					++m_entryCount;
+					++m_storeCount;
+
+					return true;
+				}
+
+				std::shared_ptr<const ResponseCache::Entry> ResponseCache::Refresh(const std::shared_ptr<const Entry>& entry, HttpResponse& notModified)
+				{
+					auto refreshed = std::make_shared<Entry>(*entry);
+
+					HeaderList updates;
+					int64_t ageHeader = 0;
+					CopyEndToEndHeaders(notModified, updates, ageHeader);
+
+					// Headers of the 304 replace all stored headers of the same name, per RFC
+					// 7234 section 4.3.4.
+					refreshed->headers.erase(
+						std::remove_if(refreshed->headers.begin(), refreshed->headers.end(), [&updates](const std::pair<std::string, std::string>& header)
+						{
+							return FindHeader(updates, header.first) != nullptr;
+						}),
+						refreshed->headers.end()
+						);
+
+					refreshed->headers.insert(refreshed->headers.end(), updates.begin(), updates.end());
+
+					UpdateFreshness(*refreshed, ageHeader);
+
+					refreshed->size = GetEntrySize(*refreshed);
+
+					++m_revalidatedCount;
+
+					auto& shard = GetShard(refreshed->key);
+
+					std::lock_guard<std::mutex> lock(shard.mutex);
+
+					auto range = shard.index.equal_range(refreshed->key);
+
+					for (auto it = range.first; it != range.second; ++it)
+					{
+						if (it->second->get() == entry.get())
+						{
+							shard.bytes -= entry->size;
+							shard.bytes += refreshed->size;
+							m_usedBytes -= entry->size;
+							m_usedBytes += refreshed->size;
+
+							*it->second = refreshed;
+							shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+							break;
+						}
+					}
+
+					return refreshed;
+				}
+
+				void ResponseCache::AddValidators(const Entry& entry, HttpRequest& request)
+				{
+					if (!entry.etag.empty())
+					{
+						request.AddHeader(util::http::headers::IfNoneMatch, entry.etag);
+					}
+
+					if (!entry.lastModified.empty())
+					{
+						request.AddHeader(util::http::headers::IfModifiedSince, entry.lastModified);
+					}
+				}
+
+				void ResponseCache::BuildResponse(const Entry& entry, const HttpRequest& request, const bool keepAlive, std::string& head, std::shared_ptr<const std::vector<char>>& body)
+				{
+					bool notModified = false;
+
+					if (entry.statusCode == 200)
+					{
+						auto ifNoneMatch = request.GetHeader(util::http::headers::IfNoneMatch);
+
+						if (ifNoneMatch.first != ifNoneMatch.second)
+						{
+							// If-Modified-Since is ignored when If-None-Match is present, per
+							// RFC 7232 section 3.3.
+							for (auto it = ifNoneMatch.first; it != ifNoneMatch.second && !notModified; ++it)
+							{
+								ForEachElement(it->second, [&entry, &notModified](boost::string_ref tag)
+								{
+									if (!entry.etag.empty() && (tag == u8"*" || WeakETagEquals(tag, entry.etag)))
+									{
+										notModified = true;
+									}
+								});
+							}
+						}
+						else if (!entry.lastModified.empty())
+						{
+							auto ifModifiedSince = request.GetHeader(util::http::headers::IfModifiedSince);
+
+							int64_t since = 0;
+							int64_t lastModified = 0;
+
+							if (ifModifiedSince.first != ifModifiedSince.second &&
+								ParseHttpDate(ifModifiedSince.first->second, since) &&
+								ParseHttpDate(entry.lastModified, lastModified) &&
+								lastModified <= since)
+							{
+								notModified = true;
+							}
+						}
+					}
+
+					head.clear();
+					head.append(request.GetHttpVersion() == HttpProtocolVersion::HTTP1 ? u8"HTTP/1.0 " : u8"HTTP/1.1 ");
+					head.append(notModified ? u8"304 Not Modified" : entry.statusText);
+					head.append(u8"\r\n");
+
+					// The headers a 304 is to carry, per RFC 7232 section 4.1.
+					static const std::string* notModifiedHeaders[] =
+					{
+						&util::http::headers::CacheControl,
+						&util::http::headers::ContentLocation,
+						&util::http::headers::Date,
+						&util::http::headers::ETag,
+						&util::http::headers::Expires,
+						&util::http::headers::Vary
+					};
+
+					for (const auto& header : entry.headers)
+					{
+						if (notModified)
+						{
+							bool permitted = false;
+
+							for (const auto name : notModifiedHeaders)
+							{
+								if (EqualsIgnoreCase(header.first, *name))
+								{
+									permitted = true;
+									break;
+								}
+							}
+
+							if (!permitted)
+							{
+								continue;
+							}
+						}
+
+						head.append(header.first).append(u8": ").append(header.second).append(u8"\r\n");
+					}
+
+					head.append(util::http::headers::Age).append(u8": ").append(std::to_string(GetCurrentAge(entry))).append(u8"\r\n");
+
+					body.reset();
+
+					if (!notModified && entry.statusCode != 204)
+					{
+						const size_t length = entry.body ? entry.body->size() : 0;
+
+						head.append(util::http::headers::ContentLength).append(u8": ").append(std::to_string(length)).append(u8"\r\n");
+
+						if (length > 0)
+						{
+							body = entry.body;
+							m_servedBytes += length;
+						}
+					}
+
+					if (!keepAlive)
+					{
+						head.append(util::http::headers::Connection).append(u8": close\r\n");
+					}
+
+					head.append(u8"\r\n");
+
+					if (notModified)
+					{
+						++m_notModifiedCount;
+					}
+				}
+
+				void ResponseCache::Flush()
+				{
+					for (auto& shard : m_shards)
+					{
+						std::lock_guard<std::mutex> lock(shard.mutex);
+
+						m_usedBytes -= shard.bytes;
+						m_entryCount -= static_cast<uint32_t>(shard.entries.size());
+
+						shard.index.clear();
+						shard.entries.clear();
+						shard.bytes = 0;
+					}
+
+					++m_flushCount;
+				}
+
+				const uint32_t ResponseCache::GetEntryCount() const
+				{
+					return m_entryCount.load();
+				}
+
+				const uint64_t ResponseCache::GetUsedBytes() const
+				{
+					return m_usedBytes.load();
+				}
+
+				const uint64_t ResponseCache::GetHitCount() const
+				{
+					return m_hitCount.load();
+				}
+
+				const uint64_t ResponseCache::GetStaleCount() const
+				{
+					return m_staleCount.load();
+				}
+
+				const uint64_t ResponseCache::GetMissCount() const
+				{
+					return m_missCount.load();
+				}
+
+				const uint64_t ResponseCache::GetRevalidatedCount() const
+				{
+					return m_revalidatedCount.load();
+				}
+
+				const uint64_t ResponseCache::GetNotModifiedCount() const
+				{
+					return m_notModifiedCount.load();
+				}
+
+				const uint64_t ResponseCache::GetStoreCount() const
+				{
+					return m_storeCount.load();
+				}
+
+				const uint64_t ResponseCache::GetEvictionCount() const
+				{
+					return m_evictionCount.load();
+				}
+
+				const uint64_t ResponseCache::GetFlushCount() const
+				{
+					return m_flushCount.load();
+				}
+
+				const uint64_t ResponseCache::GetServedBytes() const
+				{
+					return m_servedBytes.load();
+				}
+
+				ResponseCache::Shard& ResponseCache::GetShard(const std::string& key)
+				{
+					return m_shards[std::hash<std::string>()(key) % ShardCount];
+				}
+
+				void ResponseCache::Erase(Shard& shard, EntryList::iterator it)
+				{
+					auto range = shard.index.equal_range((*it)->key);
+
+					for (auto indexIt = range.first; indexIt != range.second; ++indexIt)
+					{
+						if (indexIt->second == it)
+						{
+							shard.index.erase(indexIt);
+							break;
+						}
+					}
+
+					shard.bytes -= (*it)->size;
+					m_usedBytes -= (*it)->size;
+					--m_entryCount;
+
+					shard.entries.erase(it);
+				}
+
+				void ResponseCache::MakeRoom(Shard& shard, const uint64_t shardBudget, const uint64_t bytes)
+				{
+					while (!shard.entries.empty() && shard.bytes + bytes > shardBudget)
+					{
+						Erase(shard, std::prev(shard.entries.end()));
+						++m_evictionCount;
+					}
+				}
+
+			} /* namespace http */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,487 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace http
+			{
+
+				class HttpRequest;
+				class HttpResponse;
+
+				/// <summary>
+				/// The ResponseCache class is a shared HTTP cache, after RFC 7234, that sits between
+				/// the bridges and the servers they talk to. Every client behind the Engine otherwise
+				/// downloads the same static assets from the origin, and has them inspected, over and
+				/// over. A response stored here is served straight to the next client that asks for
+				/// it, without a connection to the server and without the response being put before
+				/// the filters again. The request is still checked as usual beforehand, so a request
+				/// that's blocked now is blocked, whatever is stored for it.
+				///
+				/// What's stored is the response as it was written to the client, which for a
+				/// response that was inspected means after it was decompressed and allowed. Only
+				/// complete GET responses with a fixed length, uncompressed payload are stored, which
+				/// in practice means responses that were consumed in full for inspection, and small
+				/// ones that arrived in one read. Responses are stored and served as a shared cache
+				/// must: Cache-Control no-store and private are honoured, s-maxage takes precedence
+				/// over max-age, which takes precedence over Expires, and responses with neither get
+				/// a heuristic lifetime of a tenth of their age since Last-Modified, up to a day.
+				/// Responses that set cookies are never stored, nor are responses to requests
+				/// carrying credentials or cookies unless the response is explicitly public. Requests
+				/// carrying credentials are in turn only answered with responses that were marked
+				/// public, s-maxage or must-revalidate, per RFC 7234 section 3.2. Vary
+				/// is honoured, with one stored response per combination of the request headers it
+				/// names, and Vary: * is never stored.
+				///
+				/// Stored responses are never served stale. Once a stored response is no longer
+				/// fresh, or whenever it's marked no-cache, the request is forwarded to the server
+				/// along with the ETag and Last-Modified validators it was stored with, and if the
+				/// server answers 304 Not Modified, the stored response is refreshed and served.
+				/// Clients' own If-None-Match and If-Modified-Since are answered from fresh stored
+				/// responses, with 304 where they match. Responses stored under an older filtering
+				/// configuration are not served. See filtering::FilterSnapshot.
+				///
+				/// The cache holds its responses in memory, up to a budget in bytes, and is disabled
+				/// until given one. Entries are spread across a number of independently locked
+				/// shards so that bridges on different threads rarely contend, and each shard evicts
+				/// its least recently used responses to stay within its share of the budget. All
+				/// members are thread safe.
+				/// </summary>
+				class ResponseCache
+				{
+
+				public:
+
+					/// <summary>
+					/// The default memory budget, in bytes. The cache is disabled by default.
+					/// </summary>
+					static constexpr uint64_t DefaultMaxBytes = 0;
+
+					/// <summary>
+					/// The number of independently locked shards.
+					/// </summary>
+					static constexpr size_t ShardCount = 16;
+
+					/// <summary>
+					/// The longest a response without an explicit lifetime is considered fresh, in
+					/// seconds, per the suggestion in RFC 7234 section 4.2.2.
+					/// </summary>
+					static constexpr uint64_t MaxHeuristicFreshnessSeconds = 86400;
+
+					/// <summary>
+					/// A single stored response. Entries are never modified once stored. Refreshing
+					/// one after it has been revalidated stores a modified copy in its place.
+					/// </summary>
+					struct Entry
+					{
+						/// <summary>
+						/// The scheme, host and request URI the response was stored under.
+						/// </summary>
+						std::string key;
+
+						/// <summary>
+						/// The lowercased name and value of each request header the response
+						/// varies on, as the request that fetched it sent them.
+						/// </summary>
+						std::vector<std::pair<std::string, std::string>> varyValues;
+
+						uint16_t statusCode = 0;
+
+						/// <summary>
+						/// The status line, less the HTTP version, such as "200 OK".
+						/// </summary>
+						std::string statusText;
+
+						/// <summary>
+						/// The end to end headers. Content-Length and Age are left out, since
+						/// they're generated every time the response is served.
+						/// </summary>
+						std::vector<std::pair<std::string, std::string>> headers;
+
+						/// <summary>
+						/// The payload. Shared with whatever writes of it are in progress.
+						/// </summary>
+						std::shared_ptr<const std::vector<char>> body;
+
+						std::string etag;
+
+						std::string lastModified;
+
+						/// <summary>
+						/// When the response was received, or last revalidated.
+						/// </summary>
+						std::chrono::steady_clock::time_point storedAt;
+
+						/// <summary>
+						/// The age of the response when it was received, per RFC 7234 section
+						/// 4.2.3.
+						/// </summary>
+						uint64_t initialAgeSeconds = 0;
+
+						uint64_t freshnessSeconds = 0;
+
+						/// <summary>
+						/// Whether the response must be revalidated every time it's used.
+						/// </summary>
+						bool noCache = false;
+
+						/// <summary>
+						/// The generation of the filtering configuration the response was
+						/// allowed under.
+						/// </summary>
+						uint64_t generation = 0;
+
+						/// <summary>
+						/// Whether the response may be used to answer requests that carry an
+						/// Authorization header, which per RFC 7234 section 3.2 takes public,
+						/// s-maxage or must-revalidate.
+						/// </summary>
+						bool sharedWithCredentials = false;
+
+						/// <summary>
+						/// The number of bytes the entry is charged against the budget.
+						/// </summary>
+						uint64_t size = 0;
+					};
+
+					/// <summary>
+					/// The outcome of looking a request up.
+					/// </summary>
+					enum class LookupResult : uint32_t
+					{
+						/// <summary>
+						/// Nothing stored applies. Forward the request.
+						/// </summary>
+						Miss = 0,
+
+						/// <summary>
+						/// A fresh response is stored. Serve it.
+						/// </summary>
+						Fresh = 1,
+
+						/// <summary>
+						/// A response is stored but must be revalidated. Forward the request with
+						/// the validators from ::AddValidators(...), and on 304, ::Refresh(...) the
+						/// stored response and serve it.
+						/// </summary>
+						Stale = 2
+					};
+
+					/// <summary>
+					/// Constructs a new ResponseCache instance, disabled.
+					/// </summary>
+					ResponseCache()
+					{
+
+					}
+
+					/// <summary>
+					/// No copy no move no thx.
+					/// </summary>
+					ResponseCache(const ResponseCache&) = delete;
+					ResponseCache(ResponseCache&&) = delete;
+					ResponseCache& operator=(const ResponseCache&) = delete;
+
+					/// <summary>
+					/// Sets the memory budget. Zero disables the cache, and anything already
+					/// stored is flushed. Lowering the budget evicts whatever no longer fits.
+					/// </summary>
+					/// <param name="maxBytes">
+					/// The memory budget, in bytes.
+					/// </param>
+					void SetMaxBytes(const uint64_t maxBytes);
+
+					/// <summary>
+					/// Gets the memory budget.
+					/// </summary>
+					/// <returns>
+					/// The memory budget in bytes, or zero if the cache is disabled.
+					/// </returns>
+					const uint64_t GetMaxBytes() const;
+
+					/// <summary>
+					/// Looks for a stored response to a request.
+					/// </summary>
+					/// <param name="secure">
+					/// Whether the request arrived over TLS.
+					/// </param>
+					/// <param name="host">
+					/// The host the request is for, as given in the Host header.
+					/// </param>
+					/// <param name="request">
+					/// The request, with its headers complete.
+					/// </param>
+					/// <param name="generation">
+					/// The generation of the current filtering configuration.
+					/// </param>
+					/// <param name="entry">
+					/// Set to the stored response, unless the result is a miss.
+					/// </param>
+					/// <returns>
+					/// What's to be done with the request.
+					/// </returns>
+					const LookupResult Lookup(const bool secure, const std::string& host, const HttpRequest& request, const uint64_t generation, std::shared_ptr<const Entry>& entry);
+
+					/// <summary>
+					/// Stores a response, if it and the request it answers permit it. Whatever was
+					/// stored for the same request before is replaced.
+					/// </summary>
+					/// <param name="secure">
+					/// Whether the request arrived over TLS.
+					/// </param>
+					/// <param name="host">
+					/// The host the request is for, as given in the Host header.
+					/// </param>
+					/// <param name="request">
+					/// The request.
+					/// </param>
+					/// <param name="response">
+					/// The response, as it's about to be written to the client.
+					/// </param>
+					/// <param name="generation">
+					/// The generation of the filtering configuration the response was allowed
+					/// under.
+					/// </param>
+					/// <returns>
+					/// True if the response was stored, false otherwise.
+					/// </returns>
+					const bool Store(const bool secure, const std::string& host, const HttpRequest& request, HttpResponse& response, const uint64_t generation);
+
+					/// <summary>
+					/// Refreshes a stored response that the server has just confirmed, with 304
+					/// Not Modified, to be still valid. The headers of the 304 replace those of
+					/// the stored response, and its freshness is worked out anew, per RFC 7234
+					/// section 4.3.4.
+					/// </summary>
+					/// <param name="entry">
+					/// The stored response that was revalidated.
+					/// </param>
+					/// <param name="notModified">
+					/// The 304 response from the server.
+					/// </param>
+					/// <returns>
+					/// The refreshed response, to be served in place of the 304.
+					/// </returns>
+					std::shared_ptr<const Entry> Refresh(const std::shared_ptr<const Entry>& entry, HttpResponse& notModified);
+
+					/// <summary>
+					/// Adds the validators of a stored response to a request, so that the server
+					/// can answer 304 Not Modified if it's still valid.
+					/// </summary>
+					/// <param name="entry">
+					/// The stored response.
+					/// </param>
+					/// <param name="request">
+					/// The request to add the validators to.
+					/// </param>
+					static void AddValidators(const Entry& entry, HttpRequest& request);
+
+					/// <summary>
+					/// Builds what's to be written to the client to serve a stored response. Where
+					/// the request carries If-None-Match or If-Modified-Since that the stored
+					/// response satisfies, that's 304 Not Modified, without a payload.
+					/// </summary>
+					/// <param name="entry">
+					/// The stored response.
+					/// </param>
+					/// <param name="request">
+					/// The request being answered.
+					/// </param>
+					/// <param name="keepAlive">
+					/// Whether the connection is to be kept open afterwards.
+					/// </param>
+					/// <param name="head">
+					/// Set to the status line and headers.
+					/// </param>
+					/// <param name="body">
+					/// Set to the payload, or nullptr if there is none to write.
+					/// </param>
+					void BuildResponse(const Entry& entry, const HttpRequest& request, const bool keepAlive, std::string& head, std::shared_ptr<const std::vector<char>>& body);
+
+					/// <summary>
+					/// Discards every stored response. Meant to be called whenever whatever the
+					/// consumer decides on response content with has changed.
+					/// </summary>
+					void Flush();
+
+					/// <summary>
+					/// Gets the number of responses presently stored.
+					/// </summary>
+					/// <returns>
+					/// The number of responses presently stored.
+					/// </returns>
+					const uint32_t GetEntryCount() const;
+
+					/// <summary>
+					/// Gets the number of bytes presently charged against the budget.
+					/// </summary>
+					/// <returns>
+					/// The number of bytes in use.
+					/// </returns>
+					const uint64_t GetUsedBytes() const;
+
+					/// <summary>
+					/// Gets the number of requests answered with a fresh stored response, without
+					/// contacting the server.
+					/// </summary>
+					/// <returns>
+					/// The number of hits.
+					/// </returns>
+					const uint64_t GetHitCount() const;
+
+					/// <summary>
+					/// Gets the number of requests for which a stored response had to be
+					/// revalidated with the server.
+					/// </summary>
+					/// <returns>
+					/// The number of stale lookups.
+					/// </returns>
+					const uint64_t GetStaleCount() const;
+
+					/// <summary>
+					/// Gets the number of cacheable requests that nothing stored applied to.
+					/// Requests looked up while the cache was empty or disabled aren't counted.
+					/// </summary>
+					/// <returns>
+					/// The number of misses.
+					/// </returns>
+					const uint64_t GetMissCount() const;
+
+					/// <summary>
+					/// Gets the number of stored responses the server confirmed with 304 Not
+					/// Modified, and which were served in place of a full response.
+					/// </summary>
+					/// <returns>
+					/// The number of revalidated responses.
+					/// </returns>
+					const uint64_t GetRevalidatedCount() const;
+
+					/// <summary>
+					/// Gets the number of times a client's own conditional request was answered
+					/// with 304 Not Modified from a stored response.
+					/// </summary>
+					/// <returns>
+					/// The number of 304s served.
+					/// </returns>
+					const uint64_t GetNotModifiedCount() const;
+
+					/// <summary>
+					/// Gets the number of responses that have been stored.
+					/// </summary>
+					/// <returns>
+					/// The number of responses stored.
+					/// </returns>
+					const uint64_t GetStoreCount() const;
+
+					/// <summary>
+					/// Gets the number of stored responses evicted to stay within the budget.
+					/// </summary>
+					/// <returns>
+					/// The number of responses evicted.
+					/// </returns>
+					const uint64_t GetEvictionCount() const;
+
+					/// <summary>
+					/// Gets the number of times the cache has been flushed.
+					/// </summary>
+					/// <returns>
+					/// The number of times the cache has been flushed.
+					/// </returns>
+					const uint64_t GetFlushCount() const;
+
+					/// <summary>
+					/// Gets the total number of payload bytes served from stored responses, which
+					/// is how much would otherwise have been fetched from the server.
+					/// </summary>
+					/// <returns>
+					/// The number of payload bytes served.
+					/// </returns>
+					const uint64_t GetServedBytes() const;
+
+				private:
+
+					using EntryList = std::list<std::shared_ptr<const Entry>>;
+
+					struct Shard
+					{
+						std::mutex mutex;
+
+						/// <summary>
+						/// Most recently used first.
+						/// </summary>
+						EntryList entries;
+
+						/// <summary>
+						/// Every variant stored under a key.
+						/// </summary>
+						std::unordered_multimap<std::string, EntryList::iterator> index;
+
+						uint64_t bytes = 0;
+					};
+
+					Shard& GetShard(const std::string& key);
+
+					/// <summary>
+					/// Removes an entry from a shard. Must be called with the shard locked.
+					/// </summary>
+					void Erase(Shard& shard, EntryList::iterator it);
+
+					/// <summary>
+					/// Evicts the least recently used entries of a shard until it has room for
+					/// the given number of bytes. Must be called with the shard locked.
+					/// </summary>
+					void MakeRoom(Shard& shard, const uint64_t shardBudget, const uint64_t bytes);
+
+					std::atomic<uint64_t> m_maxBytes{ DefaultMaxBytes };
+
+					std::array<Shard, ShardCount> m_shards;
+
+					std::atomic<uint32_t> m_entryCount{ 0 };
+
+					std::atomic<uint64_t> m_usedBytes{ 0 };
+
+					std::atomic<uint64_t> m_hitCount{ 0 };
+
+					std::atomic<uint64_t> m_staleCount{ 0 };
+
+					std::atomic<uint64_t> m_missCount{ 0 };
+
+					std::atomic<uint64_t> m_revalidatedCount{ 0 };
+
+					std::atomic<uint64_t> m_notModifiedCount{ 0 };
+
+					std::atomic<uint64_t> m_storeCount{ 0 };
+
+					std::atomic<uint64_t> m_evictionCount{ 0 };
+
+					std::atomic<uint64_t> m_flushCount{ 0 };
+
+					std::atomic<uint64_t> m_servedBytes{ 0 };
+				};
+
+			} /* namespace http */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -41,10 +41,39 @@ namespace te
 					// Generate self signed CA cert.
 					m_thisCaKeyPair = GenerateEcKey();
 					m_thisCa = GenerateSelfSignedCert(m_thisCaKeyPair, m_caCountryCode, m_caOrgName, m_caCommonName);
+
+					// Spin up the crypto threads that asynchronous mints are handed to.
+					uint32_t numCryptoThreads = std::thread::hardware_concurrency() / 2;
+					numCryptoThreads = std::max(1u, std::min(numCryptoThreads, static_cast<uint32_t>(MaxCryptoThreads)));
+
+					m_cryptoWork.reset(new boost::asio::io_service::work(m_cryptoService));
+
+					for (uint32_t i = 0; i < numCryptoThreads; ++i)
+					{
+						m_cryptoThreads.emplace_back([this]()
+						{
+							m_cryptoService.run();
+						});
+					}
 				}
 
 				BaseInMemoryCertificateStore::~BaseInMemoryCertificateStore()
 				{
+					// Stop the crypto threads before tearing anything down that they touch. Any
+					// mints that haven't started yet are simply dropped, along with their callbacks.
+					m_cryptoWork.reset();
+					m_cryptoService.stop();
+
+					for (auto& cryptoThread : m_cryptoThreads)
+					{
+						if (cryptoThread.joinable())
+						{
+							cryptoThread.join();
+						}
+					}
+
+					m_cryptoThreads.clear();
+
 					// XXX TODO - What about the temp EC key? Does it simply die as part of the
 					// context? Why is there no method to fetch it later? If it doesn't die with
 					// the context, then we need to store it separately. :(
@@ -65,19 +94,142 @@ namespace te
 
 				boost::asio::ssl::context* BaseInMemoryCertificateStore::GetServerContext(const std::string& hostname, X509* originalCertificate)
 				{
+					std::string host = hostname;
+
+					std::transform(host.begin(), host.end(), host.begin(), ::tolower);
+
+					{
+						ScopedLock lock(m_spoofMutex);
+
+						const auto& result = m_hostContexts.find(host);
+
+						if (result != m_hostContexts.end())
+						{
+							return result->second;
+						}
+					}
+
+					// Minting is done without holding the lock, so that lookups for hosts that
+					// already have a context aren't stuck behind it.
+					std::vector<std::string> sanDomains;
+					boost::asio::ssl::context* ctx = MintServerContext(originalCertificate, sanDomains);
+
 					ScopedLock lock(m_spoofMutex);
 
+					return StoreServerContext(host, ctx, sanDomains);
+				}
+
+				boost::asio::ssl::context* BaseInMemoryCertificateStore::FindServerContext(const std::string& hostname)
+				{
 					std::string host = hostname;
 
 					std::transform(host.begin(), host.end(), host.begin(), ::tolower);
 
+					ScopedLock lock(m_spoofMutex);
+
 					const auto& result = m_hostContexts.find(host);
 
 					if (result != m_hostContexts.end())
 					{
 						return result->second;
-					}										
+					}
 
+					return nullptr;
+				}
+
+				void BaseInMemoryCertificateStore::GetServerContextAsync(const std::string& hostname, X509* originalCertificate, ServerContextCallback callback)
+				{
+					std::string host = hostname;
+
+					std::transform(host.begin(), host.end(), host.begin(), ::tolower);
+
+					ScopedLock lock(m_spoofMutex);
+
+					const auto& result = m_hostContexts.find(host);
+
+					if (result != m_hostContexts.end())
+					{
+						auto* ctx = result->second;
+						m_cryptoService.post([callback, ctx]()
+						{
+							callback(ctx, std::string());
+						});
+
+						return;
+					}
+
+					auto pending = m_pendingMints.find(host);
+
+					if (pending != m_pendingMints.end())
+					{
+						// A mint for this host is already under way. Just wait on its result.
+						pending->second.push_back(std::move(callback));
+						return;
+					}
+
+					if (originalCertificate == nullptr)
+					{
+						throw std::runtime_error(u8"In BaseInMemoryCertificateStore::GetServerContextAsync(std::string, X509*, ServerContextCallback) - Certificate to spoof is nullptr.");
+					}
+
+					// The original certificate belongs to the caller's SSL session, which may well
+					// be gone by the time a crypto thread gets around to it, so take a copy.
+					X509* certificateCopy = X509_dup(originalCertificate);
+
+					if (certificateCopy == nullptr)
+					{
+						throw std::runtime_error(u8"In BaseInMemoryCertificateStore::GetServerContextAsync(std::string, X509*, ServerContextCallback) - Failed to copy certificate to spoof.");
+					}
+
+					m_pendingMints[host].push_back(std::move(callback));
+
+					m_cryptoService.post(std::bind(&BaseInMemoryCertificateStore::CompleteServerContextAsync, this, host, certificateCopy));
+				}
+
+				void BaseInMemoryCertificateStore::CompleteServerContextAsync(const std::string& host, X509* certificateCopy)
+				{
+					boost::asio::ssl::context* ctx = nullptr;
+					std::string errorMessage;
+
+					try
+					{
+						std::vector<std::string> sanDomains;
+						ctx = MintServerContext(certificateCopy, sanDomains);
+
+						ScopedLock lock(m_spoofMutex);
+
+						ctx = StoreServerContext(host, ctx, sanDomains);
+					}
+					catch (std::exception& e)
+					{
+						ctx = nullptr;
+						errorMessage = e.what();
+					}
+
+					X509_free(certificateCopy);
+
+					std::vector<ServerContextCallback> callbacks;
+
+					{
+						ScopedLock lock(m_spoofMutex);
+
+						auto pending = m_pendingMints.find(host);
+
+						if (pending != m_pendingMints.end())
+						{
+							callbacks = std::move(pending->second);
+							m_pendingMints.erase(pending);
+						}
+					}
+
+					for (auto& callback : callbacks)
+					{
+						callback(ctx, errorMessage);
+					}
+				}
+
+				boost::asio::ssl::context* BaseInMemoryCertificateStore::MintServerContext(X509* originalCertificate, std::vector<std::string>& sanDomains)
+				{
 					if (m_thisCa != nullptr && m_thisCaKeyPair != nullptr && originalCertificate != nullptr)
 					{
 						char countryBuff[1024];
@@ -92,7 +244,7 @@ namespace te
 
 						if (certToSpoofName == nullptr)
 						{
-							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::GetServerContext(std::string, X509*) - Failed to load remote certificate X509_NAME data.");
+							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::MintServerContext(X509*, std::vector<std::string>&) - Failed to load remote certificate X509_NAME data.");
 						}
 
 						cnLen = X509_NAME_get_text_by_NID(certToSpoofName, NID_commonName, cnBuff, 1024);
@@ -122,7 +274,7 @@ namespace te
 
 						if (spoofedCertKeypair == nullptr)
 						{
-							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::GetServerContext(std::string, X509*) - Failed to generate EC key for spoofed certificate.");
+							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::MintServerContext(X509*, std::vector<std::string>&) - Failed to generate EC key for spoofed certificate.");
 						}
 
 						// We pass nullptr as the issuer keypair, because we don't want it to be signed yet. We
@@ -133,7 +285,7 @@ namespace te
 						{
 							EVP_PKEY_free(spoofedCertKeypair);
 
-							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::GetServerContext(std::string, X509*) - Failed to generate X509 structure.");
+							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::MintServerContext(X509*, std::vector<std::string>&) - Failed to generate X509 structure.");
 						}
 
 						// We need to get all the SAN, or Subject Alternative Names out of the certificate
@@ -156,7 +308,6 @@ namespace te
 						//
 						// The SAN string we're going to copy directly into our spoofed certificate is generated
 						// along side this vector, but stored entirely in the sanDnsString variable.
-						std::vector<std::string> sanDomains;
 						std::string sanDnsString;
 
 						for (i = 0; i < sanNamesCount; i++)
@@ -220,16 +371,24 @@ namespace te
 							{
 								EVP_PKEY_free(spoofedCertKeypair);
 								X509_free(spoofedCert);
-								throw std::runtime_error(u8"In BaseInMemoryCertificateStore::GetServerContext(std::string, X509*) - Failed to set SAN's for spoofed certificate.");
+								throw std::runtime_error(u8"In BaseInMemoryCertificateStore::MintServerContext(X509*, std::vector<std::string>&) - Failed to set SAN's for spoofed certificate.");
 							}
 						}
 
-						// Now we're done altering the cert, so sign it.
-						if (m_thisCaKeyPair == nullptr || X509_sign(spoofedCert, m_thisCaKeyPair, EVP_sha256()) == 0)
+						// Now we're done altering the cert, so sign it. Several crypto threads may be
+						// minting at once, but they all share the CA keypair, so only signing is serialized.
+						int signResult = 0;
+
+						{
+							ScopedLock signLock(m_signMutex);
+							signResult = X509_sign(spoofedCert, m_thisCaKeyPair, EVP_sha256());
+						}
+
+						if (signResult == 0)
 						{
 							EVP_PKEY_free(spoofedCertKeypair);
 							X509_free(spoofedCert);
-							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::GetServerContext(std::string, X509*) - Failed to sign certificate.");
+							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::MintServerContext(X509*, std::vector<std::string>&) - Failed to sign certificate.");
 						}
 
 						// Now we can create our server context.
@@ -239,7 +398,7 @@ namespace te
 						{
 							EVP_PKEY_free(spoofedCertKeypair);
 							X509_free(spoofedCert);
-							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::GetServerContext(std::string, X509*) - Failed to allocate new server context for spoofed certificate.");
+							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::MintServerContext(X509*, std::vector<std::string>&) - Failed to allocate new server context for spoofed certificate.");
 						}
 
 						ctx->set_options(
@@ -255,7 +414,7 @@ namespace te
 						{
 							EVP_PKEY_free(spoofedCertKeypair);
 							X509_free(spoofedCert);
-							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::GetServerContext(std::string, X509*) - Failed to set context cipher list.");
+							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::MintServerContext(X509*, std::vector<std::string>&) - Failed to set context cipher list.");
 						}
 						*/
 
@@ -263,57 +422,65 @@ namespace te
 						{
 							EVP_PKEY_free(spoofedCertKeypair);
 							X509_free(spoofedCert);
-							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::GetServerContext(std::string, X509*) - Failed to set server context certificate.");
+							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::MintServerContext(X509*, std::vector<std::string>&) - Failed to set server context certificate.");
 						}
 
 						if (SSL_CTX_use_PrivateKey(ctx->native_handle(), spoofedCertKeypair) != 1)
 						{
 							EVP_PKEY_free(spoofedCertKeypair);
 							X509_free(spoofedCert);
-							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::GetServerContext(std::string, X509*) - Failed to set server context private key.");
+							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::MintServerContext(X509*, std::vector<std::string>&) - Failed to set server context private key.");
 						}
 
 						SSL_CTX_set_options(ctx->native_handle(), SSL_OP_CIPHER_SERVER_PREFERENCE);
 
 						SSL_CTX_set_ecdh_auto(ctx->native_handle(), 1);
 
-						bool atLeastOneInsert = false;
+						return ctx;
+					}
+					else
+					{
+						throw std::runtime_error(u8"In BaseInMemoryCertificateStore::MintServerContext(X509*, std::vector<std::string>&) - Cannot spoof certificate. Either member CA , member CA keypair or certificate to spoof is nullptr.");
+					}
+				}
+
+				boost::asio::ssl::context* BaseInMemoryCertificateStore::StoreServerContext(const std::string& host, boost::asio::ssl::context* ctx, const std::vector<std::string>& sanDomains)
+				{
+					const auto& existing = m_hostContexts.find(host);
 
-						if (sanDomains.size() > 0)
-						{
-							for (const auto& domain : sanDomains)
-							{
-								if (m_hostContexts.find(domain) == m_hostContexts.end())
-								{
-									m_hostContexts.insert({ domain, ctx });
-									atLeastOneInsert = true;
-								}
-							}
-						}
+					if (existing != m_hostContexts.end())
+					{
+						// Another mint for this host was stored while we were minting ours. Keep
+						// theirs, throw ours away.
+						auto* nativeHandle = ctx->native_handle();
+						auto* contextCert = SSL_CTX_get0_certificate(nativeHandle);
+						auto* privkey = SSL_CTX_get0_privatekey(nativeHandle);
 
-						if (m_hostContexts.find(host) == m_hostContexts.end())
-						{
-							m_hostContexts.insert({ host, ctx });
-							atLeastOneInsert = true;
-						}
+						EVP_PKEY_free(privkey);
+						X509_free(contextCert);
+
+						delete ctx;
+
+						return existing->second;
+					}
 
-						if (!atLeastOneInsert)
+					if (sanDomains.size() > 0)
+					{
+						for (const auto& domain : sanDomains)
 						{
-							// In this case, either the user has made an error and is duplicating data, or perhaps
-							// something more dirty is going on, where we have spoofed a certificate that is lying
-							// about its SN and or SAN's.							
-							EVP_PKEY_free(spoofedCertKeypair);
-							X509_free(spoofedCert);
-							delete ctx;
-							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::GetServerContext(std::string, X509*) - Context already exists for specified host.");
+							if (m_hostContexts.find(domain) == m_hostContexts.end())
+							{
+								m_hostContexts.insert({ domain, ctx });
+							}
 						}
-
-						return ctx;
 					}
-					else
+
+					if (m_hostContexts.find(host) == m_hostContexts.end())
 					{
-						throw std::runtime_error(u8"In BaseInMemoryCertificateStore::GetServerContext(std::string, X509*) - Cannot spoof certificate. Either member CA , member CA keypair or certificate to spoof is nullptr.");
+						m_hostContexts.insert({ host, ctx });
 					}
+
+					return ctx;
 				}
 
 				std::vector<char> BaseInMemoryCertificateStore::GetRootCertificatePEM() const
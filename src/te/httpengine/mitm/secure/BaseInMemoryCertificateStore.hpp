@@ -14,6 +14,9 @@
 #include "../../network/SocketTypes.hpp"
 #include <mutex>
 #include <thread>
+#include <vector>
+#include <memory>
+#include <functional>
 
 namespace te
 {
@@ -52,6 +55,21 @@ namespace te
 					/// </summary>
 					static const std::string ContextCipherList;
 
+					/// <summary>
+					/// The upper bound on the number of threads dedicated to minting spoofed
+					/// certificates. The actual number is half the available hardware threads,
+					/// clamped between one and this value.
+					/// </summary>
+					static constexpr uint32_t MaxCryptoThreads = 4;
+
+					/// <summary>
+					/// Callback invoked when an asynchronous request for a server context completes.
+					/// On success, the context argument is valid and the error message is empty. On
+					/// failure, the context argument is nullptr and the error message describes what
+					/// went wrong.
+					/// </summary>
+					using ServerContextCallback = std::function<void(boost::asio::ssl::context*, const std::string&)>;
+
 					/// <summary>
 					/// Default constructor, delegates to the parameterized constructure which
 					/// takes country code, organization name and common name, with default values.
@@ -136,6 +154,48 @@ namespace te
 					/// </returns>
 					boost::asio::ssl::context* GetServerContext(const std::string& hostname, X509* certificate);
 
+					/// <summary>
+					/// Looks up an existing context for the supplied hostname without generating
+					/// anything. This is cheap, and is intended to let callers skip the trip through
+					/// the crypto workers when a context has already been minted.
+					/// </summary>
+					/// <param name="hostname">
+					/// The host to look up a context for.
+					/// </param>
+					/// <returns>
+					/// The existing context for the supplied host, or nullptr if none exists yet.
+					/// </returns>
+					boost::asio::ssl::context* FindServerContext(const std::string& hostname);
+
+					/// <summary>
+					/// Asynchronous version of ::GetServerContext(...). Key generation, building
+					/// and signing the spoofed certificate are expensive, and doing them on an io
+					/// thread stalls every other connection scheduled on that thread. This method
+					/// instead hands the work to a small, bounded pool of crypto threads owned by
+					/// this store and returns immediately.
+					/// 
+					/// Concurrent requests for the same host are coalesced, so that only the first
+					/// request mints a certificate and every request is completed with the result.
+					/// 
+					/// The callback is always invoked on one of the crypto threads, never from
+					/// within this call. Callers are expected to wrap the callback in whatever
+					/// strand they need to resume on. Be advised that if the store is destroyed
+					/// before a request completes, the callback is never invoked. The callback
+					/// itself must not throw.
+					/// </summary>
+					/// <param name="hostname">
+					/// The host that the supplied certificate structure was received from.
+					/// </param>
+					/// <param name="originalCertificate">
+					/// A valid pointer to the received, already validated upstream certificate to
+					/// spoof. The certificate is copied before this call returns, so the caller
+					/// need not keep it alive until the callback is invoked.
+					/// </param>
+					/// <param name="callback">
+					/// The callback to invoke with the result.
+					/// </param>
+					void GetServerContextAsync(const std::string& hostname, X509* originalCertificate, ServerContextCallback callback);
+
 					/// <summary>
 					/// Attempts to install the current temporary root CA certificate for
 					/// transparent filtering to the appropriate OS specific filesystem certificate
@@ -223,6 +283,83 @@ namespace te
 					/// </summary>
 					std::unordered_map<std::string, boost::asio::ssl::context*> m_hostContexts;								
 
+					/// <summary>
+					/// Serializes use of the CA keypair for signing, since the crypto threads may
+					/// otherwise sign with it concurrently. Key generation, which is the bulk of
+					/// the cost of minting, is not covered by this lock.
+					/// </summary>
+					std::mutex m_signMutex;
+
+					/// <summary>
+					/// Callbacks waiting on an asynchronous mint that is already under way, keyed
+					/// by the lower case host name. Guarded by m_spoofMutex.
+					/// </summary>
+					std::unordered_map<std::string, std::vector<ServerContextCallback>> m_pendingMints;
+
+					/// <summary>
+					/// The service that the crypto threads run. Asynchronous mints are posted here.
+					/// </summary>
+					boost::asio::io_service m_cryptoService;
+
+					/// <summary>
+					/// Keeps the crypto threads running while there is no work posted.
+					/// </summary>
+					std::unique_ptr<boost::asio::io_service::work> m_cryptoWork = nullptr;
+
+					/// <summary>
+					/// The crypto threads.
+					/// </summary>
+					std::vector<std::thread> m_cryptoThreads;
+
+					/// <summary>
+					/// Spoofs the supplied certificate and builds a server context around it. This
+					/// is the expensive part of ::GetServerContext(...), and touches no shared state
+					/// other than the member CA, so it is done without holding m_spoofMutex. Can
+					/// throw runtime_error.
+					/// </summary>
+					/// <param name="originalCertificate">
+					/// A valid pointer to the upstream certificate to spoof.
+					/// </param>
+					/// <param name="sanDomains">
+					/// Populated with the lower case DNS SAN's copied from the original certificate.
+					/// </param>
+					/// <returns>
+					/// The newly allocated server context.
+					/// </returns>
+					boost::asio::ssl::context* MintServerContext(X509* originalCertificate, std::vector<std::string>& sanDomains);
+
+					/// <summary>
+					/// Stores a freshly minted context under the supplied host and SAN's. Since
+					/// mints happen outside of m_spoofMutex, another mint for the same host may have
+					/// been stored in the meantime. In that case, the supplied context is freed and
+					/// the existing one is returned. Must be called with m_spoofMutex held.
+					/// </summary>
+					/// <param name="host">
+					/// The lower case host name.
+					/// </param>
+					/// <param name="ctx">
+					/// The freshly minted context.
+					/// </param>
+					/// <param name="sanDomains">
+					/// The SAN's extracted while minting the context.
+					/// </param>
+					/// <returns>
+					/// The context that is now stored for the supplied host.
+					/// </returns>
+					boost::asio::ssl::context* StoreServerContext(const std::string& host, boost::asio::ssl::context* ctx, const std::vector<std::string>& sanDomains);
+
+					/// <summary>
+					/// Runs an asynchronous mint on a crypto thread, stores the result and completes
+					/// every callback waiting on the host.
+					/// </summary>
+					/// <param name="host">
+					/// The lower case host name.
+					/// </param>
+					/// <param name="certificateCopy">
+					/// A copy of the certificate to spoof, owned by this call.
+					/// </param>
+					void CompleteServerContextAsync(const std::string& host, X509* certificateCopy);
+
 					/// <summary>
 					/// Generates an EC key with the given named curve. As with basically every
 					/// other method in this class, this can throw runtime_error in the event that
@@ -0,0 +1,220 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "CoroutineHttpBridge.hpp"
+#include <stdexcept>
+
+#if BOOST_OS_WINDOWS
+#include <http/client/x509_cert_utilities.h>
+#else
+#include <openssl/x509v3.h>
+#endif
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace secure
+			{
+
+				template<>
+				boost::asio::ip::tcp::socket& CoroutineHttpBridge<network::TcpSocket>::DownstreamSocket()
+				{
+					return m_downstreamSocket;
+				}
+
+				template<>
+				boost::asio::ip::tcp::socket& CoroutineHttpBridge<network::TlsSocket>::DownstreamSocket()
+				{
+					return m_downstreamSocket.next_layer();
+				}
+
+				template<>
+				boost::asio::ip::tcp::socket& CoroutineHttpBridge<network::TcpSocket>::UpstreamSocket()
+				{
+					return m_upstreamSocket;
+				}
+
+				template<>
+				boost::asio::ip::tcp::socket& CoroutineHttpBridge<network::TlsSocket>::UpstreamSocket()
+				{
+					return m_upstreamSocket.next_layer();
+				}
+
+				template<>
+				bool CoroutineHttpBridge<network::TcpSocket>::VerifyServerCertificate(const bool preverified, boost::asio::ssl::verify_context& ctx)
+				{
+					// Do nothing.
+					return false;
+				}
+
+				template<>
+				bool CoroutineHttpBridge<network::TlsSocket>::VerifyServerCertificate(const bool preverified, boost::asio::ssl::verify_context& ctx)
+				{
+					#if BOOST_OS_WINDOWS
+					auto res = web::http::client::details::verify_cert_chain_platform_specific(ctx, m_upstreamHost);
+					#else
+					// Same as TlsCapableHttpBridge::VerifyServerCertificateCallback(...). OpenSSL has
+					// verified the chain, and all that's left is to check the leaf names the host.
+					auto res = preverified;
+					if (res && X509_STORE_CTX_get_error_depth(ctx.native_handle()) == 0)
+					{
+						X509* leafCert = X509_STORE_CTX_get_current_cert(ctx.native_handle());
+						res = leafCert != nullptr && X509_check_host(leafCert, m_upstreamHost.c_str(), m_upstreamHost.size(), 0, nullptr) == 1;
+					}
+					#endif
+
+					m_upstreamCert = res ? X509_STORE_CTX_get_current_cert(ctx.native_handle()) : nullptr;
+
+					return res;
+				}
+
+				template<>
+				void CoroutineHttpBridge<network::TcpSocket>::HandshakeUpstream()
+				{
+					throw std::logic_error(u8"In CoroutineHttpBridge<network::TcpSocket>::HandshakeUpstream() - Plain TCP bridges don't handshake.");
+				}
+
+				template<>
+				void CoroutineHttpBridge<network::TlsSocket>::HandshakeUpstream()
+				{
+					SSL_set_tlsext_host_name(m_upstreamSocket.native_handle(), m_upstreamHost.c_str());
+
+					boost::system::error_code verifyError;
+
+					// Bound to this rather than a shared_ptr, since the socket keeps the callback,
+					// and the callback is only ever called during the handshake, which holds one.
+					m_upstreamSocket.set_verify_callback(
+						std::bind(
+							&CoroutineHttpBridge::VerifyServerCertificate,
+							this,
+							std::placeholders::_1,
+							std::placeholders::_2
+						),
+						verifyError
+					);
+
+					if (verifyError)
+					{
+						std::string errMsg(u8"In CoroutineHttpBridge<network::TlsSocket>::HandshakeUpstream() - While setting the verify callback, got error:\t");
+						errMsg.append(verifyError.message());
+						throw std::runtime_error(errMsg);
+					}
+
+					m_upstreamSocket.async_handshake(boost::asio::ssl::stream_base::client, ResumeRequestPath());
+				}
+
+				template<>
+				void CoroutineHttpBridge<network::TcpSocket>::HandshakeDownstream()
+				{
+					throw std::logic_error(u8"In CoroutineHttpBridge<network::TcpSocket>::HandshakeDownstream() - Plain TCP bridges don't handshake.");
+				}
+
+				template<>
+				void CoroutineHttpBridge<network::TlsSocket>::HandshakeDownstream()
+				{
+					if (SSL_set_SSL_CTX(m_downstreamSocket.native_handle(), m_serverContext->native_handle()) != m_serverContext->native_handle())
+					{
+						throw std::runtime_error(u8"In CoroutineHttpBridge<network::TlsSocket>::HandshakeDownstream() - Failed to set the server context.");
+					}
+
+					m_downstreamSocket.async_handshake(boost::asio::ssl::stream_base::server, ResumeRequestPath());
+				}
+
+				template<>
+				CoroutineHttpBridge<network::TcpSocket>::CoroutineHttpBridge(
+					boost::asio::io_service* service,
+					BaseInMemoryCertificateStore* certStore,
+					boost::asio::ssl::context* defaultServerContext,
+					boost::asio::ssl::context* clientContext,
+					network::FlowControl* flowControl,
+					network::AdmissionControl* admissionControl,
+					network::VerdictControl* verdictControl,
+					util::cb::HttpMessageBeginCheckFunction onMessageBegin,
+					util::cb::HttpMessageEndCheckFunction onMessageEnd,
+					util::cb::HttpMessageBeginViewFunction onMessageBeginView,
+					util::cb::HttpMessageEndViewFunction onMessageEndView,
+					util::cb::MessageFunction onInfoCb,
+					util::cb::MessageFunction onWarnCb,
+					util::cb::MessageFunction onErrorCb
+					)
+					:
+					util::cb::EventReporter(
+						onInfoCb,
+						onWarnCb,
+						onErrorCb
+						),
+					m_upstreamSocket(*service),
+					m_downstreamSocket(*service),
+					m_strand(*service),
+					m_resolver(*service),
+					m_streamTimer(*service),
+					m_requestFrame(Frames().Acquire()),
+					m_responseFrame(Frames().Acquire()),
+					m_admissionControl(admissionControl),
+					m_verdictControl(verdictControl),
+					m_verdictTimer(*service),
+					m_certStore(certStore),
+					m_onMessageBegin(onMessageBegin),
+					m_onMessageEnd(onMessageEnd),
+					m_onMessageBeginView(onMessageBeginView),
+					m_onMessageEndView(onMessageEndView)
+				{
+
+				}
+
+				template<>
+				CoroutineHttpBridge<network::TlsSocket>::CoroutineHttpBridge(
+					boost::asio::io_service* service,
+					BaseInMemoryCertificateStore* certStore,
+					boost::asio::ssl::context* defaultServerContext,
+					boost::asio::ssl::context* clientContext,
+					network::FlowControl* flowControl,
+					network::AdmissionControl* admissionControl,
+					network::VerdictControl* verdictControl,
+					util::cb::HttpMessageBeginCheckFunction onMessageBegin,
+					util::cb::HttpMessageEndCheckFunction onMessageEnd,
+					util::cb::HttpMessageBeginViewFunction onMessageBeginView,
+					util::cb::HttpMessageEndViewFunction onMessageEndView,
+					util::cb::MessageFunction onInfoCb,
+					util::cb::MessageFunction onWarnCb,
+					util::cb::MessageFunction onErrorCb
+					)
+					:
+					util::cb::EventReporter(
+						onInfoCb,
+						onWarnCb,
+						onErrorCb
+						),
+					m_upstreamSocket(*service, *clientContext),
+					m_downstreamSocket(*service, *defaultServerContext),
+					m_strand(*service),
+					m_resolver(*service),
+					m_streamTimer(*service),
+					m_requestFrame(Frames().Acquire()),
+					m_responseFrame(Frames().Acquire()),
+					m_admissionControl(admissionControl),
+					m_verdictControl(verdictControl),
+					m_verdictTimer(*service),
+					m_certStore(certStore),
+					m_onMessageBegin(onMessageBegin),
+					m_onMessageEnd(onMessageEnd),
+					m_onMessageBeginView(onMessageBeginView),
+					m_onMessageEndView(onMessageEndView)
+				{
+					if (m_certStore == nullptr)
+					{
+						throw std::runtime_error(u8"In CoroutineHttpBridge<network::TlsSocket>::CoroutineHttpBridge(... args) - Supplied certificate store is nullptr!");
+					}
+				}
+
+			} /* namespace secure */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
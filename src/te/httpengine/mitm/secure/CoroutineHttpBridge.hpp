@@ -0,0 +1,2436 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/asio/coroutine.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include "../../network/SocketTypes.hpp"
+#include "../../network/HandlerAllocator.hpp"
+#include "../../network/FramePool.hpp"
+#include "../../network/FlowControl.hpp"
+#include "../../network/AdmissionControl.hpp"
+#include "../../network/VerdictControl.hpp"
+#include "BaseInMemoryCertificateStore.hpp"
+#include "../http/HttpRequest.hpp"
+#include "../http/HttpResponse.hpp"
+#include "../../util/cb/EventReporter.hpp"
+#include "../../util/cb/StreamCopyUtils.hpp"
+#include "../../../util/http/KnownHttpHeaders.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Defines reenter, yield and fork, so it must come after every other include. Undone
+// at the bottom of this file by unyield.hpp.
+#include <boost/asio/yield.hpp>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace secure
+			{
+
+				/// <summary>
+				/// The CoroutineHttpBridge is an alternative to the TlsCapableHttpBridge that
+				/// serves the same connections, through the same acceptor, with the same
+				/// callbacks, but is written as two coroutines, one for each direction, rather
+				/// than as a chain of completion handlers. The request path reads what the client
+				/// sends and writes it to the server, and the response path does the opposite.
+				/// Each reads top to bottom as a loop over transactions, and suspends at every
+				/// asynchronous operation, to be resumed by the operation's completion.
+				///
+				/// The coroutines are stackless, in the manner of boost::asio::coroutine, since
+				/// the engine is built as C++14, where there are no language coroutines and so no
+				/// awaitables. Everything a direction keeps from one suspension to the next lives
+				/// in its Frame, or in the bridge itself. Frames are acquired from a pool shared
+				/// by every bridge, so that a new connection reuses the frames of one that has
+				/// gone rather than going to the heap for them, and each frame carries the
+				/// network::HandlerMemory that every operation of its direction is allocated
+				/// from. See network::FramePool.
+				///
+				/// The two directions never run at once, except while tunnelling. The request
+				/// path hands the transaction to the response path once the request has been
+				/// written, and gets it back once the response has, so every step of a
+				/// transaction runs on the one strand, and the only state shared between the two
+				/// is handed over with the transaction. While tunnelling, each direction touches
+				/// nothing but its own frame and socket ends.
+				///
+				/// Consumers are asked for verdicts exactly as they are by the TlsCapableHttpBridge,
+				/// synchronously or through the verdict control, and their verdicts are applied the
+				/// same way. Bypassed and blocklisted hosts are honoured. What this bridge does not
+				/// do, at least for now, is everything the TlsCapableHttpBridge does beyond that:
+				/// native rules, the verdict, content and response caches, the inspection policy and
+				/// response sampling, recompression, pipeline coalescing and flow control. A
+				/// response flagged for inspection is held in full, and streaming reads are bounded
+				/// to network::FlowControl::DefaultMaxBridgeInFlightBytes.
+				/// </summary>
+				template<class BridgeSocketType>
+				class CoroutineHttpBridge : public std::enable_shared_from_this< CoroutineHttpBridge<BridgeSocketType> >, public util::cb::EventReporter
+				{
+
+				/// <summary>
+				/// Enforce use of this class to the only two types of sockets it is intended to be
+				/// used with.
+				/// </summary>
+				static_assert((std::is_same<BridgeSocketType, network::TcpSocket> ::value || std::is_same<BridgeSocketType, network::TlsSocket>::value), "CoroutineHttpBridge can only accept boost::asio::ip::tcp::socket or boost::asio::ssl::stream<boost::asio::ip::tcp::socket> as valid template parameters.");
+
+				private:
+
+					/// <summary>
+					/// Everything a direction keeps from one suspension to the next, besides the
+					/// transaction itself.
+					/// </summary>
+					struct Frame
+					{
+						/// <summary>
+						/// Where in the direction's coroutine to resume.
+						/// </summary>
+						boost::asio::coroutine coroutine;
+
+						/// <summary>
+						/// Recycled memory for the handlers of the direction's operations. Only one is
+						/// ever pending at a time.
+						/// </summary>
+						network::HandlerMemory handlerMemory;
+
+						/// <summary>
+						/// What became of the last verdict asked for.
+						/// </summary>
+						uint32_t verdict;
+
+						/// <summary>
+						/// Whether or not the peer this direction reads from closed the connection
+						/// after the data we have.
+						/// </summary>
+						bool closeAfter;
+
+						/// <summary>
+						/// The number of bytes in the buffer waiting to be tunnelled.
+						/// </summary>
+						size_t tunnelBytes;
+
+						/// <summary>
+						/// For peeking at the TLS client hello, reading the first bytes of each
+						/// request, and tunnelling.
+						/// </summary>
+						std::array<char, 16384> buffer;
+					};
+
+					/// <summary>
+					/// The pool that every bridge of this type acquires its frames from.
+					/// </summary>
+					using FramePool = network::FramePool<Frame>;
+
+				public:
+
+					/// <summary>
+					/// Constructs a new CoroutineHttpBridge instance. The parameters are those of
+					/// the TlsCapableHttpBridge, and mean the same. A single constructor declaration
+					/// is used for both types of supported bridges, and specialized to initialize
+					/// the sockets correctly.
+					/// </summary>
+					/// <param name="service">
+					/// A valid pointer to the boost::asio::io_service that will drive the member
+					/// sockets, resolver, strand and timers.
+					/// </param>
+					/// <param name="certStore">
+					/// The certificate store that spoofs server contexts. Required when
+					/// BridgeSocketType is network::TlsSocket, ignored otherwise.
+					/// </param>
+					/// <param name="defaultServerContext">
+					/// The placeholder server context that the client socket is constructed with.
+					/// Required when BridgeSocketType is network::TlsSocket, ignored otherwise.
+					/// </param>
+					/// <param name="clientContext">
+					/// The client context that server certificates are verified with. Required when
+					/// BridgeSocketType is network::TlsSocket, ignored otherwise.
+					/// </param>
+					/// <param name="flowControl">
+					/// Accepted for the acceptor's sake, but not used. Streaming reads are bounded
+					/// to the default per-bridge limit.
+					/// </param>
+					/// <param name="admissionControl">
+					/// The admission control shared by every bridge the acceptor creates. Optional.
+					/// </param>
+					/// <param name="verdictControl">
+					/// The verdict control shared by every bridge the acceptor creates. Optional.
+					/// </param>
+					/// <param name="onMessageBegin">
+					/// See TlsCapableHttpBridge.
+					/// </param>
+					/// <param name="onMessageEnd">
+					/// See TlsCapableHttpBridge.
+					/// </param>
+					/// <param name="onMessageBeginView">
+					/// See TlsCapableHttpBridge.
+					/// </param>
+					/// <param name="onMessageEndView">
+					/// See TlsCapableHttpBridge.
+					/// </param>
+					/// <param name="onInfoCb">
+					/// A callback to receive generated information about general events. Must be
+					/// thread safe.
+					/// </param>
+					/// <param name="onWarnCb">
+					/// A callback to receive warnings. Must be thread safe.
+					/// </param>
+					/// <param name="onErrorCb">
+					/// A callback to receive errors that were handled. Must be thread safe.
+					/// </param>
+					CoroutineHttpBridge(
+						boost::asio::io_service* service,
+						BaseInMemoryCertificateStore* certStore = nullptr,
+						boost::asio::ssl::context* defaultServerContext = nullptr,
+						boost::asio::ssl::context* clientContext = nullptr,
+						network::FlowControl* flowControl = nullptr,
+						network::AdmissionControl* admissionControl = nullptr,
+						network::VerdictControl* verdictControl = nullptr,
+						util::cb::HttpMessageBeginCheckFunction onMessageBegin = nullptr,
+						util::cb::HttpMessageEndCheckFunction onMessageEnd = nullptr,
+						util::cb::HttpMessageBeginViewFunction onMessageBeginView = nullptr,
+						util::cb::HttpMessageEndViewFunction onMessageEndView = nullptr,
+						util::cb::MessageFunction onInfoCb = nullptr,
+						util::cb::MessageFunction onWarnCb = nullptr,
+						util::cb::MessageFunction onErrorCb = nullptr
+						);
+
+					/// <summary>
+					/// No copy no move no thx.
+					/// </summary>
+					CoroutineHttpBridge(const CoroutineHttpBridge&) = delete;
+					CoroutineHttpBridge(CoroutineHttpBridge&&) = delete;
+					CoroutineHttpBridge& operator=(const CoroutineHttpBridge&) = delete;
+
+					/// <summary>
+					/// Gives back any slots we hold against the admission control. The frames go
+					/// back to the pool with their pointers.
+					/// </summary>
+					~CoroutineHttpBridge()
+					{
+						ReleaseHandshakeSlot();
+						ReleaseSpoofSlot();
+
+						if (m_holdsBridgeSlot)
+						{
+							m_admissionControl->ReleaseBridge();
+							m_holdsBridgeSlot = false;
+						}
+					}
+
+					/// <summary>
+					/// Gets the TCP socket of the client connection, to accept a client into.
+					/// Specialized, since a TLS stream keeps its socket underneath.
+					/// </summary>
+					/// <returns>
+					/// The TCP socket of the client connection.
+					/// </returns>
+					boost::asio::ip::tcp::socket& DownstreamSocket();
+
+					/// <summary>
+					/// Gets the TCP socket of the server connection. Specialized, since a TLS
+					/// stream keeps its socket underneath.
+					/// </summary>
+					/// <returns>
+					/// The TCP socket of the server connection.
+					/// </returns>
+					boost::asio::ip::tcp::socket& UpstreamSocket();
+
+					/// <summary>
+					/// Starts the request path, which starts the response path in turn. After this
+					/// call, the bridge keeps itself alive through the handlers of its pending
+					/// operations, and goes once it has been killed and they have all returned.
+					/// </summary>
+					void Start()
+					{
+						Touch();
+						ArmStreamTimer(StreamTimeout);
+
+						m_strand.post(Resumer(this->shared_from_this(), true));
+					}
+
+					/// <summary>
+					/// Attempts to take a bridge slot from the admission control. Called by the
+					/// acceptor once a client has been accepted and before ::Start() is called.
+					/// </summary>
+					/// <returns>
+					/// True if the bridge was admitted or there is no admission control, false if
+					/// the bridge limit has been reached.
+					/// </returns>
+					const bool TryAdmit()
+					{
+						if (m_admissionControl == nullptr)
+						{
+							return true;
+						}
+
+						m_holdsBridgeSlot = m_admissionControl->TryAdmitBridge();
+						return m_holdsBridgeSlot;
+					}
+
+					/// <summary>
+					/// Gets the pool that every bridge of this type acquires its frames from, so
+					/// that how often frames had to come from the heap can be told.
+					/// </summary>
+					/// <returns>
+					/// The frame pool.
+					/// </returns>
+					static const FramePool& GetFramePool()
+					{
+						return Frames();
+					}
+
+				private:
+
+					/// <summary>
+					/// How long the bridge may go without completing an operation before it's
+					/// killed.
+					/// </summary>
+					static constexpr std::chrono::steady_clock::duration StreamTimeout = std::chrono::minutes(5);
+
+					/// <summary>
+					/// The fewest bytes a TLS client hello can take, up to the end of the client
+					/// random.
+					/// </summary>
+					static constexpr size_t MinTlsHelloLength = 43;
+
+					/// <summary>
+					/// The fewest bytes a request line can take, which is read before the first
+					/// bytes of a request are looked at.
+					/// </summary>
+					static constexpr size_t MinRequestLength = 18;
+
+					/// <summary>
+					/// What became of a request for a verdict.
+					/// </summary>
+					enum VerdictOutcome : uint32_t
+					{
+						Allow,
+						Block,
+						Pending
+					};
+
+					/// <summary>
+					/// How the bridge passes data along once it no longer speaks HTTP. Raw tunnels
+					/// the TCP streams underneath TLS, for hosts we're not to intercept. Stream
+					/// tunnels whatever BridgeSocketType carries, for upgraded connections, and for
+					/// whatever other protocol a TLS client speaks once the handshake is done.
+					/// </summary>
+					enum class Tunnel
+					{
+						None,
+						Raw,
+						Stream
+					};
+
+					/// <summary>
+					/// The completion handler of every operation the coroutines start. Keeps the
+					/// bridge alive while the operation is pending, stores whatever the operation
+					/// completed with beyond an error and a byte count, then resumes the direction
+					/// that started it.
+					/// </summary>
+					class Resumer
+					{
+
+					public:
+
+						Resumer(std::shared_ptr<CoroutineHttpBridge> bridge, const bool requestPath)
+							:
+							m_bridge(std::move(bridge)),
+							m_requestPath(requestPath)
+						{
+
+						}
+
+						void operator()(const boost::system::error_code& error = boost::system::error_code(), const size_t bytesTransferred = 0)
+						{
+							m_bridge->Resume(m_requestPath, error, bytesTransferred);
+						}
+
+						void operator()(const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpoints)
+						{
+							m_bridge->m_endpoints = endpoints;
+							m_bridge->Resume(m_requestPath, error, 0);
+						}
+
+						void operator()(boost::asio::ssl::context* serverContext, const std::string& errorMessage)
+						{
+							m_bridge->m_serverContext = serverContext;
+							m_bridge->m_serverContextError = errorMessage;
+							m_bridge->Resume(m_requestPath, boost::system::error_code(), 0);
+						}
+
+					private:
+
+						std::shared_ptr<CoroutineHttpBridge> m_bridge;
+
+						bool m_requestPath;
+					};
+
+					/// <summary>
+					/// HTTP request object which is read from the connected client and written to
+					/// the upstream host.
+					/// </summary>
+					std::unique_ptr<http::HttpRequest> m_request = nullptr;
+
+					/// <summary>
+					/// HTTP response object which is read from the upstream host and written to the
+					/// downstream client.
+					/// </summary>
+					std::unique_ptr<http::HttpResponse> m_response = nullptr;
+
+					/// <summary>
+					/// Socket used to connect to the client's desired host.
+					/// </summary>
+					BridgeSocketType m_upstreamSocket;
+
+					/// <summary>
+					/// Socket used for connecting to the client.
+					/// </summary>
+					BridgeSocketType m_downstreamSocket;
+
+					/// <summary>
+					/// Every handler of both directions runs on this strand.
+					/// </summary>
+					boost::asio::io_service::strand m_strand;
+
+					/// <summary>
+					/// Used for resolving the target upstream server after it has been discovered
+					/// from the client headers or TLS hello.
+					/// </summary>
+					boost::asio::ip::tcp::resolver m_resolver;
+
+					/// <summary>
+					/// The endpoints of the last resolve.
+					/// </summary>
+					boost::asio::ip::tcp::resolver::iterator m_endpoints;
+
+					/// <summary>
+					/// Kills the bridge once it has gone StreamTimeout without completing an
+					/// operation. Armed once, rather than for every operation, and re-armed for
+					/// whatever is left of the timeout whenever it expires early.
+					/// </summary>
+					boost::asio::steady_timer m_streamTimer;
+
+					/// <summary>
+					/// When the last operation completed.
+					/// </summary>
+					std::chrono::steady_clock::time_point m_lastActivity;
+
+					/// <summary>
+					/// The request path's frame.
+					/// </summary>
+					typename FramePool::Pointer m_requestFrame;
+
+					/// <summary>
+					/// The response path's frame.
+					/// </summary>
+					typename FramePool::Pointer m_responseFrame;
+
+					/// <summary>
+					/// How the bridge passes data along, once it no longer speaks HTTP.
+					/// </summary>
+					Tunnel m_tunnel = Tunnel::None;
+
+					/// <summary>
+					/// Whether or not the connection is to be kept for the next transaction once
+					/// the response is written.
+					/// </summary>
+					bool m_keepAlive = false;
+
+					/// <summary>
+					/// Set when the client sent Expect: 100-continue, and is presumably holding its
+					/// request payload back until it gets 100 Continue from us.
+					/// </summary>
+					bool m_continueOwed = false;
+
+					/// <summary>
+					/// Set once the bridge has been killed. Nothing is resumed after that.
+					/// </summary>
+					bool m_killed = false;
+
+					/// <summary>
+					/// Pointer to the admission control shared by all bridges created by our
+					/// acceptor. May be nullptr.
+					/// </summary>
+					network::AdmissionControl* m_admissionControl;
+
+					/// <summary>
+					/// Whether or not this bridge holds one of the admission control's bridge
+					/// slots.
+					/// </summary>
+					bool m_holdsBridgeSlot = false;
+
+					/// <summary>
+					/// Whether or not this bridge holds one of the admission control's handshake
+					/// slots.
+					/// </summary>
+					bool m_holdsHandshakeSlot = false;
+
+					/// <summary>
+					/// Whether or not this bridge holds one of the admission control's spoof slots.
+					/// </summary>
+					bool m_holdsSpoofSlot = false;
+
+					/// <summary>
+					/// Pointer to the verdict control shared by all bridges created by our
+					/// acceptor. May be nullptr.
+					/// </summary>
+					network::VerdictControl* m_verdictControl;
+
+					/// <summary>
+					/// Bounds how long we wait on a pending verdict before applying the default.
+					/// </summary>
+					boost::asio::steady_timer m_verdictTimer;
+
+					/// <summary>
+					/// The token we're parked under while waiting on a verdict, zero otherwise.
+					/// </summary>
+					uint64_t m_verdictToken = 0;
+
+					/// <summary>
+					/// Whether the pending verdict is a message end verdict.
+					/// </summary>
+					bool m_verdictIsMessageEnd = false;
+
+					/// <summary>
+					/// What's written to the client in place of a blocked transaction.
+					/// </summary>
+					std::shared_ptr<const std::vector<char>> m_blockResponse;
+
+					/// <summary>
+					/// Spoofs server contexts for the hosts TLS clients ask for.
+					/// </summary>
+					BaseInMemoryCertificateStore* m_certStore;
+
+					/// <summary>
+					/// The server's certificate, once it has been verified.
+					/// </summary>
+					X509* m_upstreamCert = nullptr;
+
+					/// <summary>
+					/// The context that the client is served with, once it has been found or
+					/// spoofed.
+					/// </summary>
+					boost::asio::ssl::context* m_serverContext = nullptr;
+
+					/// <summary>
+					/// Why the certificate store couldn't supply a server context, if it couldn't.
+					/// </summary>
+					std::string m_serverContextError;
+
+					/// <summary>
+					/// The host we're connected to, or about to be.
+					/// </summary>
+					std::string m_upstreamHost;
+
+					/// <summary>
+					/// The port that was given with the host, or zero if none was.
+					/// </summary>
+					uint16_t m_upstreamHostPort = 0;
+
+					util::cb::HttpMessageBeginCheckFunction m_onMessageBegin;
+
+					util::cb::HttpMessageEndCheckFunction m_onMessageEnd;
+
+					util::cb::HttpMessageBeginViewFunction m_onMessageBeginView;
+
+					util::cb::HttpMessageEndViewFunction m_onMessageEndView;
+
+					/// <summary>
+					/// Gets the pool that every bridge of this type acquires its frames from. Never
+					/// destroyed, since bridges may still be giving frames back while statics are.
+					/// </summary>
+					/// <returns>
+					/// The frame pool.
+					/// </returns>
+					static FramePool& Frames()
+					{
+						static FramePool* pool = new FramePool();
+						return *pool;
+					}
+
+					const bool IsTls() const
+					{
+						return std::is_same<BridgeSocketType, network::TlsSocket>::value;
+					}
+
+					/// <summary>
+					/// Creates the completion handler for an operation of the request path.
+					/// </summary>
+					auto ResumeRequestPath()
+					{
+						return m_strand.wrap(network::MakeCustomAllocHandler(m_requestFrame->handlerMemory, Resumer(this->shared_from_this(), true)));
+					}
+
+					/// <summary>
+					/// Creates the completion handler for an operation of the response path.
+					/// </summary>
+					auto ResumeResponsePath()
+					{
+						return m_strand.wrap(network::MakeCustomAllocHandler(m_responseFrame->handlerMemory, Resumer(this->shared_from_this(), false)));
+					}
+
+					/// <summary>
+					/// Hands the transaction to the other direction. The hand-off is allocated from
+					/// the frame of the direction it resumes, which has nothing pending while it
+					/// waits to be handed the transaction.
+					/// </summary>
+					/// <param name="toRequestPath">
+					/// True to resume the request path, false to resume the response path.
+					/// </param>
+					void Handoff(const bool toRequestPath)
+					{
+						auto& frame = toRequestPath ? *m_requestFrame : *m_responseFrame;
+						m_strand.post(network::MakeCustomAllocHandler(frame.handlerMemory, Resumer(this->shared_from_this(), toRequestPath)));
+					}
+
+					/// <summary>
+					/// Resumes a direction. Exceptions escaping either coroutine are reported and
+					/// kill the bridge, since there's no way to resume a coroutine partway through
+					/// a step.
+					/// </summary>
+					/// <param name="requestPath">
+					/// True to resume the request path, false to resume the response path.
+					/// </param>
+					/// <param name="error">
+					/// What the operation being resumed from completed with.
+					/// </param>
+					/// <param name="bytesTransferred">
+					/// The number of bytes the operation being resumed from transferred.
+					/// </param>
+					void Resume(const bool requestPath, const boost::system::error_code& error, const size_t bytesTransferred)
+					{
+						if (m_killed)
+						{
+							return;
+						}
+
+						Touch();
+
+						try
+						{
+							if (requestPath)
+							{
+								RunRequestPath(error, bytesTransferred);
+							}
+							else
+							{
+								RunResponsePath(error, bytesTransferred);
+							}
+
+							return;
+						}
+						catch (std::exception& e)
+						{
+							std::string errMsg(u8"In CoroutineHttpBridge::Resume(const bool, const boost::system::error_code&, const size_t) - Got error:\t");
+							errMsg.append(e.what());
+							ReportError(errMsg);
+						}
+
+						Kill();
+					}
+
+					/// <summary>
+					/// The request path. Sets up the connection, then reads each request from the
+					/// client, has it judged, and writes it to the server, handing the transaction
+					/// to the response path once it's written. Tunnels from the client to the
+					/// server once the bridge no longer speaks HTTP.
+					/// </summary>
+					/// <param name="error">
+					/// What the operation being resumed from completed with.
+					/// </param>
+					/// <param name="bytesTransferred">
+					/// The number of bytes the operation being resumed from transferred.
+					/// </param>
+					void RunRequestPath(const boost::system::error_code& error, const size_t bytesTransferred)
+					{
+						Frame& frame = *m_requestFrame;
+
+						reenter (frame.coroutine)
+						{
+							if (IsTls())
+							{
+								// The client hello is only peeked at, so that it's still there to be
+								// handshaken with, by us or, should we end up tunnelling, by the server.
+								yield DownstreamSocket().async_receive(boost::asio::buffer(frame.buffer), boost::asio::ip::tcp::socket::message_peek, ResumeRequestPath());
+
+								if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunRequestPath(...) - While peeking at the client hello, got error:\t") || !TakeClientHello(frame, bytesTransferred))
+								{
+									return;
+								}
+
+								yield m_resolver.async_resolve(boost::asio::ip::tcp::resolver::query(m_upstreamHost, GetUpstreamService()), ResumeRequestPath());
+
+								if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunRequestPath(...) - While resolving the upstream host, got error:\t"))
+								{
+									return;
+								}
+
+								yield boost::asio::async_connect(UpstreamSocket(), m_endpoints, ResumeRequestPath());
+
+								if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunRequestPath(...) - While connecting to the upstream host, got error:\t"))
+								{
+									return;
+								}
+
+								if (m_tunnel == Tunnel::None && !TryBeginTlsInterception())
+								{
+									if (!m_admissionControl->GetTunnelWhenOverloaded())
+									{
+										m_admissionControl->RecordShed();
+										Kill();
+										return;
+									}
+
+									ReportInfo(u8"In CoroutineHttpBridge::RunRequestPath(...) - Admission control refused TLS interception. Starting tunnel.");
+									m_admissionControl->RecordTunnelled();
+									m_tunnel = Tunnel::Raw;
+								}
+
+								if (m_tunnel == Tunnel::None)
+								{
+									yield HandshakeUpstream();
+
+									if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunRequestPath(...) - While handshaking with the upstream host, got error:\t"))
+									{
+										return;
+									}
+
+									if (m_upstreamCert == nullptr)
+									{
+										ReportError(u8"In CoroutineHttpBridge::RunRequestPath(...) - Handshake succeeded, but the upstream certificate is nullptr.");
+										Kill();
+										return;
+									}
+
+									m_serverContext = m_certStore->FindServerContext(m_upstreamHost);
+
+									if (m_serverContext == nullptr)
+									{
+										// Spoofing takes the store a while, and we're resumed once it's done.
+										yield m_certStore->GetServerContextAsync(m_upstreamHost, m_upstreamCert, m_strand.wrap(Resumer(this->shared_from_this(), true)));
+									}
+
+									ReleaseSpoofSlot();
+
+									if (m_serverContext == nullptr)
+									{
+										std::string errMsg(u8"In CoroutineHttpBridge::RunRequestPath(...) - Failed to get a server context:\t");
+										errMsg.append(m_serverContextError);
+										ReportError(errMsg);
+										Kill();
+										return;
+									}
+
+									yield HandshakeDownstream();
+
+									ReleaseHandshakeSlot();
+
+									if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunRequestPath(...) - While handshaking with the client, got error:\t"))
+									{
+										return;
+									}
+								}
+
+								SetNoDelay(UpstreamSocket());
+								SetNoDelay(DownstreamSocket());
+							}
+
+							while (m_tunnel == Tunnel::None)
+							{
+								if (m_request && !m_request->GetPipelinedData().empty())
+								{
+									// The client sent this one along with the last, so it's here already.
+									if (!TakePipelinedRequest())
+									{
+										return;
+									}
+								}
+								else
+								{
+									yield boost::asio::async_read(m_downstreamSocket, boost::asio::buffer(frame.buffer), boost::asio::transfer_at_least(MinRequestLength), ResumeRequestPath());
+
+									if (!TakeRequest(frame, error, bytesTransferred))
+									{
+										return;
+									}
+								}
+
+								if (m_tunnel == Tunnel::None)
+								{
+									while (!m_request->HeadersComplete())
+									{
+										if (frame.closeAfter)
+										{
+											Kill();
+											return;
+										}
+
+										yield boost::asio::async_read(m_downstreamSocket, m_request->GetReadBuffer(), boost::asio::transfer_at_least(1), ResumeRequestPath());
+
+										if (!TakeRead(*m_request, frame, error, bytesTransferred))
+										{
+											return;
+										}
+									}
+
+									frame.verdict = GetVerdict(true, m_request.get(), nullptr);
+
+									if (frame.verdict == Pending)
+									{
+										// Parked. ::OnVerdict(...) resumes us with the verdict.
+										yield;
+									}
+
+									if (frame.verdict == Block)
+									{
+										yield WriteBlockResponse(false, ResumeRequestPath());
+										Kill();
+										return;
+									}
+
+									PrepareRequestHeaders(*m_request);
+									TakeContinueExpectation(frame.closeAfter);
+								}
+
+								// Every request names its host, and the connection stays with the first
+								// one named. Only what a TLS client tunnels past a finished handshake is
+								// exempt, since it may not be HTTP at all.
+								if ((m_tunnel == Tunnel::None || !IsTls()) && !TakeRequestHost())
+								{
+									Kill();
+									return;
+								}
+
+								if (!UpstreamSocket().is_open())
+								{
+									yield m_resolver.async_resolve(boost::asio::ip::tcp::resolver::query(m_upstreamHost, GetUpstreamService()), ResumeRequestPath());
+
+									if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunRequestPath(...) - While resolving the upstream host, got error:\t"))
+									{
+										return;
+									}
+
+									yield boost::asio::async_connect(UpstreamSocket(), m_endpoints, ResumeRequestPath());
+
+									if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunRequestPath(...) - While connecting to the upstream host, got error:\t"))
+									{
+										return;
+									}
+
+									SetNoDelay(UpstreamSocket());
+									SetNoDelay(DownstreamSocket());
+								}
+
+								if (m_tunnel != Tunnel::None)
+								{
+									// What was read of the request is tunnelled as it is, below.
+									break;
+								}
+
+								// A payload flagged for inspection is read in full before any of the
+								// request goes to the server.
+								while (m_request->GetConsumeAllBeforeSending() && !m_request->IsPayloadComplete() && !frame.closeAfter)
+								{
+									if (m_continueOwed)
+									{
+										m_continueOwed = false;
+
+										yield boost::asio::async_write(m_downstreamSocket, ContinueResponse(), ResumeRequestPath());
+
+										if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunRequestPath(...) - While writing 100 Continue, got error:\t"))
+										{
+											return;
+										}
+									}
+
+									yield boost::asio::async_read(m_downstreamSocket, m_request->GetReadBuffer(), boost::asio::transfer_at_least(1), ResumeRequestPath());
+
+									if (!TakeRead(*m_request, frame, error, bytesTransferred))
+									{
+										return;
+									}
+								}
+
+								yield boost::asio::async_write(m_upstreamSocket, m_request->GetWriteBuffer(), ResumeRequestPath());
+
+								if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunRequestPath(...) - While writing the request, got error:\t"))
+								{
+									return;
+								}
+
+								while (!m_request->IsPayloadComplete() && !frame.closeAfter)
+								{
+									if (m_continueOwed)
+									{
+										m_continueOwed = false;
+
+										yield boost::asio::async_write(m_downstreamSocket, ContinueResponse(), ResumeRequestPath());
+
+										if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunRequestPath(...) - While writing 100 Continue, got error:\t"))
+										{
+											return;
+										}
+									}
+
+									yield boost::asio::async_read(m_downstreamSocket, m_request->GetReadBuffer(network::FlowControl::DefaultMaxBridgeInFlightBytes), boost::asio::transfer_at_least(1), ResumeRequestPath());
+
+									if (!TakeRead(*m_request, frame, error, bytesTransferred))
+									{
+										return;
+									}
+
+									yield boost::asio::async_write(m_upstreamSocket, m_request->GetWriteBuffer(), ResumeRequestPath());
+
+									if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunRequestPath(...) - While writing the request payload, got error:\t"))
+									{
+										return;
+									}
+								}
+
+								if (frame.closeAfter)
+								{
+									// The client is done with the connection, so there's no response it
+									// could still want.
+									Kill();
+									return;
+								}
+
+								// The response path takes it from here, and hands back once the
+								// response has been written.
+								yield Handoff(false);
+							}
+
+							// The response path tunnels the other way.
+							Handoff(false);
+
+							while (true)
+							{
+								if (frame.tunnelBytes > 0)
+								{
+									yield TunnelWrite(false, boost::asio::buffer(frame.buffer.data(), frame.tunnelBytes), ResumeRequestPath());
+
+									if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunRequestPath(...) - While tunnelling to the upstream host, got error:\t"))
+									{
+										return;
+									}
+								}
+
+								yield TunnelRead(true, boost::asio::buffer(frame.buffer), ResumeRequestPath());
+
+								if (error)
+								{
+									// Either end closing is how a tunnel ends, so it's not reported.
+									Kill();
+									return;
+								}
+
+								frame.tunnelBytes = bytesTransferred;
+							}
+						}
+					}
+
+					/// <summary>
+					/// The response path. Handed each transaction once the request has been written,
+					/// reads the response from the server, has it judged and writes it to the
+					/// client, then hands the transaction back if the connection is kept. Tunnels
+					/// from the server to the client once the bridge no longer speaks HTTP.
+					/// </summary>
+					/// <param name="error">
+					/// What the operation being resumed from completed with.
+					/// </param>
+					/// <param name="bytesTransferred">
+					/// The number of bytes the operation being resumed from transferred.
+					/// </param>
+					void RunResponsePath(const boost::system::error_code& error, const size_t bytesTransferred)
+					{
+						Frame& frame = *m_responseFrame;
+
+						reenter (frame.coroutine)
+						{
+							while (m_tunnel == Tunnel::None)
+							{
+								frame.closeAfter = false;
+								m_response = MakeTransaction<http::HttpResponse>();
+
+								while (true)
+								{
+									while (!m_response->HeadersComplete())
+									{
+										if (frame.closeAfter)
+										{
+											Kill();
+											return;
+										}
+
+										yield boost::asio::async_read(m_upstreamSocket, m_response->GetReadBuffer(), boost::asio::transfer_at_least(1), ResumeResponsePath());
+
+										if (!TakeRead(*m_response, frame, error, bytesTransferred))
+										{
+											return;
+										}
+									}
+
+									if (!m_response->IsInterim())
+									{
+										break;
+									}
+
+									// Interim responses come ahead of the one that answers the request,
+									// and are passed along as they are, except to HTTP/1.0 clients, which
+									// wouldn't know what to make of them.
+									if (m_request->GetHttpVersion() != http::HttpProtocolVersion::HTTP1)
+									{
+										yield boost::asio::async_write(m_downstreamSocket, m_response->GetWriteBuffer(), ResumeResponsePath());
+
+										if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunResponsePath(...) - While writing an interim response, got error:\t"))
+										{
+											return;
+										}
+									}
+
+									if (!TakeNextResponse(frame))
+									{
+										return;
+									}
+								}
+
+								if (m_request->GetShouldBlock() > -1)
+								{
+									frame.verdict = GetVerdict(false, m_request.get(), m_response.get());
+
+									if (frame.verdict == Pending)
+									{
+										yield;
+									}
+
+									if (frame.verdict == Block)
+									{
+										yield WriteBlockResponse(true, ResumeResponsePath());
+										Kill();
+										return;
+									}
+								}
+
+								PrepareResponseHeaders();
+
+								while (m_response->GetConsumeAllBeforeSending() && !m_response->IsPayloadComplete() && !frame.closeAfter)
+								{
+									yield boost::asio::async_read(m_upstreamSocket, m_response->GetReadBuffer(), boost::asio::transfer_at_least(1), ResumeResponsePath());
+
+									if (!TakeRead(*m_response, frame, error, bytesTransferred))
+									{
+										return;
+									}
+								}
+
+								if (m_response->GetConsumeAllBeforeSending() && m_response->IsPayloadComplete() && m_request->GetShouldBlock() > -1)
+								{
+									frame.verdict = GetVerdict(false, m_request.get(), m_response.get());
+
+									if (frame.verdict == Pending)
+									{
+										yield;
+									}
+
+									if (frame.verdict == Block)
+									{
+										yield WriteBlockResponse(true, ResumeResponsePath());
+										Kill();
+										return;
+									}
+								}
+
+								yield boost::asio::async_write(m_downstreamSocket, m_response->GetWriteBuffer(), ResumeResponsePath());
+
+								if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunResponsePath(...) - While writing the response, got error:\t"))
+								{
+									return;
+								}
+
+								while (!m_response->IsPayloadComplete() && !frame.closeAfter)
+								{
+									yield boost::asio::async_read(m_upstreamSocket, m_response->GetReadBuffer(network::FlowControl::DefaultMaxBridgeInFlightBytes), boost::asio::transfer_at_least(1), ResumeResponsePath());
+
+									if (!TakeRead(*m_response, frame, error, bytesTransferred))
+									{
+										return;
+									}
+
+									yield boost::asio::async_write(m_downstreamSocket, m_response->GetWriteBuffer(), ResumeResponsePath());
+
+									if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunResponsePath(...) - While writing the response payload, got error:\t"))
+									{
+										return;
+									}
+								}
+
+								if (frame.closeAfter || !m_keepAlive)
+								{
+									Kill();
+									return;
+								}
+
+								if (!m_response->GetPipelinedData().empty())
+								{
+									ReportWarning(u8"In CoroutineHttpBridge::RunResponsePath(...) - The server sent data beyond the end of the response.");
+									Kill();
+									return;
+								}
+
+								yield Handoff(true);
+							}
+
+							while (true)
+							{
+								yield TunnelRead(false, boost::asio::buffer(frame.buffer), ResumeResponsePath());
+
+								if (error)
+								{
+									Kill();
+									return;
+								}
+
+								yield TunnelWrite(true, boost::asio::buffer(frame.buffer.data(), bytesTransferred), ResumeResponsePath());
+
+								if (!CheckCompletion(error, u8"In CoroutineHttpBridge::RunResponsePath(...) - While tunnelling to the client, got error:\t"))
+								{
+									return;
+								}
+							}
+						}
+					}
+
+					/// <summary>
+					/// Checks the outcome of an operation that has no business failing.
+					/// </summary>
+					/// <param name="error">
+					/// What the operation completed with.
+					/// </param>
+					/// <param name="what">
+					/// The start of the message to report, should it have failed.
+					/// </param>
+					/// <returns>
+					/// True if the operation succeeded. Otherwise, the error has been reported and
+					/// the bridge killed.
+					/// </returns>
+					const bool CheckCompletion(const boost::system::error_code& error, const char* what)
+					{
+						if (!error)
+						{
+							return true;
+						}
+
+						std::string errMsg(what);
+						errMsg.append(error.message());
+						ReportError(errMsg);
+
+						Kill();
+						return false;
+					}
+
+					/// <summary>
+					/// Takes the host from the client hello the request path peeked at, and
+					/// decides whether it's to be intercepted or tunnelled.
+					/// </summary>
+					/// <param name="frame">
+					/// The request path's frame, holding the client hello.
+					/// </param>
+					/// <param name="bytesTransferred">
+					/// The number of bytes peeked.
+					/// </param>
+					/// <returns>
+					/// True if the connection is to go on, false if the bridge has been killed.
+					/// </returns>
+					const bool TakeClientHello(Frame& frame, const size_t bytesTransferred)
+					{
+						if (!ParseServerName(frame.buffer.data(), bytesTransferred, m_upstreamHost))
+						{
+							ReportError(u8"In CoroutineHttpBridge::TakeClientHello(Frame&, const size_t) - Failed to find a server name in the client hello.");
+							Kill();
+							return false;
+						}
+
+						m_upstreamHostPort = 443;
+
+						if (m_verdictControl != nullptr)
+						{
+							auto snapshot = m_verdictControl->GetSnapshot();
+
+							if (snapshot->IsBypassed(m_upstreamHost))
+							{
+								m_verdictControl->RecordBypassed();
+								m_tunnel = Tunnel::Raw;
+							}
+							else if (snapshot->blocklist)
+							{
+								const bool blocked = snapshot->blocklist->Contains(m_upstreamHost);
+
+								m_verdictControl->RecordBlocklistCheck(blocked);
+
+								if (blocked)
+								{
+									Kill();
+									return false;
+								}
+							}
+						}
+
+						frame.tunnelBytes = 0;
+						return true;
+					}
+
+					/// <summary>
+					/// Finds the host name in the server name extension of a TLS client hello. See
+					/// RFC 5246 section 7.4.1.2 and RFC 6066 section 3.
+					/// </summary>
+					/// <param name="data">
+					/// The start of the client hello record.
+					/// </param>
+					/// <param name="length">
+					/// The number of bytes of the record we have.
+					/// </param>
+					/// <param name="hostname">
+					/// Set to the host name, if one was found.
+					/// </param>
+					/// <returns>
+					/// True if a host name was found, false otherwise.
+					/// </returns>
+					static const bool ParseServerName(const char* data, const size_t length, std::string& hostname)
+					{
+						const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+
+						// A handshake record, carrying a client hello.
+						if (length < MinTlsHelloLength || bytes[0] != 22 || bytes[5] != 1)
+						{
+							return false;
+						}
+
+						size_t position = MinTlsHelloLength;
+
+						// The session id, cipher suites and compression methods, each preceded by
+						// its length, all come before the extensions.
+						const size_t lengthSizes[] = { 1, 2, 1 };
+
+						for (const size_t lengthSize : lengthSizes)
+						{
+							if (position + lengthSize > length)
+							{
+								return false;
+							}
+
+							position += lengthSize + ReadLength(bytes + position, lengthSize);
+						}
+
+						if (position + 2 > length)
+						{
+							return false;
+						}
+
+						const size_t extensionsEnd = std::min(length, position + 2 + ReadLength(bytes + position, 2));
+						position += 2;
+
+						while (position + 4 <= extensionsEnd)
+						{
+							const size_t type = ReadLength(bytes + position, 2);
+							const size_t extensionLength = ReadLength(bytes + position + 2, 2);
+							position += 4;
+
+							if (type != 0)
+							{
+								position += extensionLength;
+								continue;
+							}
+
+							// The server name list: its length, then entries of a name type and a
+							// length prefixed name.
+							const size_t listEnd = std::min(extensionsEnd, position + extensionLength);
+
+							for (size_t entry = position + 2; entry + 3 <= listEnd;)
+							{
+								const size_t nameLength = ReadLength(bytes + entry + 1, 2);
+
+								if (entry + 3 + nameLength > listEnd)
+								{
+									return false;
+								}
+
+								if (bytes[entry] == 0 && nameLength > 0)
+								{
+									hostname.assign(data + entry + 3, nameLength);
+									return true;
+								}
+
+								entry += 3 + nameLength;
+							}
+
+							return false;
+						}
+
+						return false;
+					}
+
+					/// <summary>
+					/// Reads a big endian length of the given number of bytes.
+					/// </summary>
+					static const size_t ReadLength(const uint8_t* at, const size_t size)
+					{
+						size_t value = 0;
+
+						for (size_t i = 0; i < size; ++i)
+						{
+							value = (value << 8) | at[i];
+						}
+
+						return value;
+					}
+
+					/// <summary>
+					/// Creates a request or response that reports through our callbacks.
+					/// </summary>
+					template<typename Transaction, typename... Args>
+					std::unique_ptr<Transaction> MakeTransaction(Args&&... args)
+					{
+						std::unique_ptr<Transaction> transaction(new Transaction(std::forward<Args>(args)...));
+
+						transaction->SetOnInfo(m_onInfo);
+						transaction->SetOnWarning(m_onWarning);
+						transaction->SetOnError(m_onError);
+
+						return transaction;
+					}
+
+					/// <summary>
+					/// Takes the first bytes of a request the client sent, and works out whether
+					/// it's speaking HTTP. If it asks to upgrade the connection, or a TLS client is
+					/// speaking something else, what was read is kept in the frame to be tunnelled.
+					/// </summary>
+					/// <param name="frame">
+					/// The request path's frame, holding what was read.
+					/// </param>
+					/// <param name="error">
+					/// What the read completed with.
+					/// </param>
+					/// <param name="bytesTransferred">
+					/// The number of bytes read.
+					/// </param>
+					/// <returns>
+					/// True if the connection is to go on, false if the bridge has been killed.
+					/// </returns>
+					const bool TakeRequest(Frame& frame, const boost::system::error_code& error, const size_t bytesTransferred)
+					{
+						if (error && error != boost::asio::error::eof && error != boost::asio::ssl::error::stream_truncated)
+						{
+							std::string errMsg(u8"In CoroutineHttpBridge::TakeRequest(Frame&, const boost::system::error_code&, const size_t) - Got error:\t");
+							errMsg.append(error.message());
+							ReportError(errMsg);
+						}
+
+						if (bytesTransferred == 0 || (error && error != boost::asio::error::eof && error != boost::asio::ssl::error::stream_truncated))
+						{
+							// A client that closes between requests is done with the connection.
+							Kill();
+							return false;
+						}
+
+						frame.closeAfter = static_cast<bool>(error);
+						frame.tunnelBytes = bytesTransferred;
+
+						m_request = MakeTransaction<http::HttpRequest>(frame.buffer.data(), bytesTransferred);
+
+						const bool parsed = m_request->Parse(bytesTransferred, false);
+
+						if (m_request->IsUpgradeRequested())
+						{
+							m_tunnel = Tunnel::Stream;
+							return true;
+						}
+
+						if (parsed)
+						{
+							return true;
+						}
+
+						const auto parseError = m_request->GetParseError();
+
+						if ((parseError == HPE_INVALID_METHOD || parseError == HPE_UNKNOWN) && IsTls())
+						{
+							// Whatever this is, the client wanted it to go to the host it named in its
+							// hello, which we're already connected to.
+							m_tunnel = Tunnel::Stream;
+							return true;
+						}
+
+						std::string errMsg(u8"In CoroutineHttpBridge::TakeRequest(Frame&, const boost::system::error_code&, const size_t) - Got http_parser error:\t");
+						errMsg.append(http_errno_description(parseError));
+						ReportError(errMsg);
+
+						Kill();
+						return false;
+					}
+
+					/// <summary>
+					/// Takes the next request from what the client sent along with the last one.
+					/// </summary>
+					/// <returns>
+					/// True if the connection is to go on, false if the bridge has been killed.
+					/// </returns>
+					const bool TakePipelinedRequest()
+					{
+						const auto& pipelined = m_request->GetPipelinedData();
+						const size_t length = pipelined.size();
+
+						auto request = MakeTransaction<http::HttpRequest>(pipelined.data(), length);
+						m_request = std::move(request);
+
+						if (m_verdictControl != nullptr)
+						{
+							m_verdictControl->RecordPipelined();
+						}
+
+						if (!m_request->Parse(length))
+						{
+							ReportError(u8"In CoroutineHttpBridge::TakePipelinedRequest() - Failed to parse a pipelined request.");
+							Kill();
+							return false;
+						}
+
+						return true;
+					}
+
+					/// <summary>
+					/// Takes the next response from what the server sent along with an interim one.
+					/// </summary>
+					/// <param name="frame">
+					/// The response path's frame.
+					/// </param>
+					/// <returns>
+					/// True if the connection is to go on, false if the bridge has been killed.
+					/// </returns>
+					const bool TakeNextResponse(Frame& frame)
+					{
+						const auto& pipelined = m_response->GetPipelinedData();
+						const size_t length = pipelined.size();
+
+						if (length == 0 && frame.closeAfter)
+						{
+							Kill();
+							return false;
+						}
+
+						auto response = MakeTransaction<http::HttpResponse>(pipelined.data(), length);
+						m_response = std::move(response);
+
+						if (length > 0 && !m_response->Parse(length))
+						{
+							ReportError(u8"In CoroutineHttpBridge::TakeNextResponse(Frame&) - Failed to parse the response after an interim one.");
+							Kill();
+							return false;
+						}
+
+						return true;
+					}
+
+					/// <summary>
+					/// Parses what a read of a request or response brought in. A peer that closed
+					/// the connection has the frame flagged, so that what we have is all there is.
+					/// </summary>
+					/// <param name="transaction">
+					/// The request or response that was read into.
+					/// </param>
+					/// <param name="frame">
+					/// The frame of the direction that read.
+					/// </param>
+					/// <param name="error">
+					/// What the read completed with.
+					/// </param>
+					/// <param name="bytesTransferred">
+					/// The number of bytes read.
+					/// </param>
+					/// <returns>
+					/// True if the transaction is to go on, false if the bridge has been killed.
+					/// </returns>
+					const bool TakeRead(http::BaseHttpTransaction& transaction, Frame& frame, const boost::system::error_code& error, const size_t bytesTransferred)
+					{
+						const bool truncated = error == boost::asio::ssl::error::stream_truncated;
+
+						if (error && error != boost::asio::error::eof && !truncated)
+						{
+							std::string errMsg(u8"In CoroutineHttpBridge::TakeRead(http::BaseHttpTransaction&, Frame&, const boost::system::error_code&, const size_t) - Got error:\t");
+							errMsg.append(error.message());
+							ReportError(errMsg);
+							Kill();
+							return false;
+						}
+
+						frame.closeAfter = frame.closeAfter || static_cast<bool>(error);
+
+						if (error && bytesTransferred == 0)
+						{
+							Kill();
+							return false;
+						}
+
+						if (!transaction.Parse(bytesTransferred))
+						{
+							Kill();
+							return false;
+						}
+
+						if (truncated && (!transaction.HeadersComplete() || !transaction.IsPayloadComplete()))
+						{
+							// Without close_notify, there's no telling a complete message from one cut
+							// short, unless the message says how long it is.
+							ReportInfo(u8"In CoroutineHttpBridge::TakeRead(http::BaseHttpTransaction&, Frame&, const boost::system::error_code&, const size_t) - Stream was truncated before the message was complete.");
+							Kill();
+							return false;
+						}
+
+						return true;
+					}
+
+					/// <summary>
+					/// Takes the host the request names, and the port with it if there is one. The
+					/// connection stays with the first host named.
+					/// </summary>
+					/// <returns>
+					/// True if the request names the host we're connected to, or the first host.
+					/// False otherwise, or if the request names no host at all.
+					/// </returns>
+					const bool TakeRequestHost()
+					{
+						auto hostHeader = m_request->GetHeader(util::http::headers::Host);
+
+						if (hostHeader.first == hostHeader.second)
+						{
+							ReportError(u8"In CoroutineHttpBridge::TakeRequestHost() - Failed to read Host header from request.");
+							return false;
+						}
+
+						auto host = boost::trim_copy(hostHeader.first->second);
+						uint16_t port = 0;
+
+						const auto portIndex = host.find(':');
+
+						if (portIndex != std::string::npos)
+						{
+							try
+							{
+								port = static_cast<uint16_t>(std::stoi(host.substr(portIndex + 1)));
+							}
+							catch (...)
+							{
+								ReportWarning(u8"In CoroutineHttpBridge::TakeRequestHost() - Failed to parse port in host entry. Assuming the default port.");
+							}
+
+							host.resize(portIndex);
+						}
+
+						if (m_upstreamHost.empty())
+						{
+							m_upstreamHost = host;
+							m_upstreamHostPort = port;
+							return true;
+						}
+
+						return host == m_upstreamHost;
+					}
+
+					/// <summary>
+					/// Gets the service the upstream host is resolved for. A port given with the
+					/// host is resolved as the service, so that every endpoint comes back with it.
+					/// </summary>
+					/// <returns>
+					/// The service.
+					/// </returns>
+					std::string GetUpstreamService() const
+					{
+						if (m_upstreamHostPort != 0)
+						{
+							return std::to_string(m_upstreamHostPort);
+						}
+
+						return IsTls() ? u8"https" : u8"http";
+					}
+
+					/// <summary>
+					/// Handshakes with the server as a client, after naming the host and arranging
+					/// for its certificate to be verified. Specialized, since only TLS bridges
+					/// handshake.
+					/// </summary>
+					void HandshakeUpstream();
+
+					/// <summary>
+					/// Handshakes with the client as the server, with the context that was found or
+					/// spoofed for the host. Specialized, since only TLS bridges handshake.
+					/// </summary>
+					void HandshakeDownstream();
+
+					/// <summary>
+					/// Verifies the server's certificate and, once the leaf is verified, keeps it
+					/// to be spoofed. Specialized, since only TLS bridges handshake.
+					/// </summary>
+					bool VerifyServerCertificate(const bool preverified, boost::asio::ssl::verify_context& ctx);
+
+					/// <summary>
+					/// Gets 100 Continue, to be written to a client that's waiting for it.
+					/// </summary>
+					/// <returns>
+					/// The buffer of 100 Continue.
+					/// </returns>
+					static boost::asio::const_buffers_1 ContinueResponse()
+					{
+						static const char response[] = u8"HTTP/1.1 100 Continue\r\n\r\n";
+						return boost::asio::buffer(response, sizeof(response) - 1);
+					}
+
+					/// <summary>
+					/// Takes Expect: 100-continue off a request, noting whether the client is owed
+					/// 100 Continue before the payload is read. The response is only owed when the
+					/// payload is still to come, since clients are allowed to send it without
+					/// waiting.
+					/// </summary>
+					/// <param name="closeAfter">
+					/// Whether or not the client closed the connection after the data we have.
+					/// </param>
+					void TakeContinueExpectation(const bool closeAfter)
+					{
+						m_continueOwed = false;
+
+						if (m_request->GetHttpVersion() != http::HttpProtocolVersion::HTTP1_1)
+						{
+							return;
+						}
+
+						auto expectHeader = m_request->GetHeader(util::http::headers::Expect);
+
+						for (auto it = expectHeader.first; it != expectHeader.second; ++it)
+						{
+							if (boost::iequals(boost::trim_copy(it->second), u8"100-continue"))
+							{
+								m_request->RemoveHeader(util::http::headers::Expect);
+								m_continueOwed = !closeAfter && !m_request->IsPayloadComplete();
+								return;
+							}
+						}
+					}
+
+					/// <summary>
+					/// Prepares the headers of a request to be written to the server, the same way
+					/// the TlsCapableHttpBridge does.
+					/// </summary>
+					/// <param name="request">
+					/// The request.
+					/// </param>
+					void PrepareRequestHeaders(http::HttpRequest& request)
+					{
+						const bool preserveEncoding = request.GetShouldBlock() == -1 ||
+							(m_verdictControl != nullptr && m_verdictControl->GetSnapshot()->IsEncodingPreserved(GetRequestHost(&request)));
+
+						if (!preserveEncoding)
+						{
+							std::string standardEncoding(u8"gzip, deflate");
+							request.AddHeader(util::http::headers::AcceptEncoding, standardEncoding);
+						}
+
+						request.RemoveHeader(util::http::headers::XSDHC);
+						request.RemoveHeader(util::http::headers::AvailDictionary);
+						request.RemoveHeader(util::http::headers::AlternateProtocol);
+						request.RemoveHeader(util::http::headers::AltSvc);
+						request.RemoveHeader(util::http::headers::PublicKeyPins);
+						request.RemoveHeader(util::http::headers::PublicKeyPinsReportOnly);
+					}
+
+					/// <summary>
+					/// Prepares the headers of a response to be written to the client, the same way
+					/// the TlsCapableHttpBridge does, and works out whether the connection is kept
+					/// after it. A response flagged for inspection in a coding we can't decompress
+					/// is streamed instead, since it could only be inspected as compressed bytes.
+					/// </summary>
+					void PrepareResponseHeaders()
+					{
+						m_response->RemoveHeader(util::http::headers::GetDictionary);
+						m_response->RemoveHeader(util::http::headers::AlternateProtocol);
+						m_response->RemoveHeader(util::http::headers::AltSvc);
+						m_response->RemoveHeader(util::http::headers::PublicKeyPins);
+						m_response->RemoveHeader(util::http::headers::PublicKeyPinsReportOnly);
+
+						m_keepAlive = m_request->GetHttpVersion() != http::HttpProtocolVersion::HTTP1 && !IsCloseRequested(*m_response);
+
+						if (m_response->GetConsumeAllBeforeSending() && !m_response->IsPayloadComplete() && !m_response->IsPayloadDecodable())
+						{
+							m_response->SetConsumeAllBeforeSending(false);
+						}
+					}
+
+					/// <summary>
+					/// Checks whether a request or response asks for the connection to be closed
+					/// after it.
+					/// </summary>
+					/// <param name="transaction">
+					/// The request or response.
+					/// </param>
+					/// <returns>
+					/// True if the transaction carries Connection: close, false otherwise.
+					/// </returns>
+					static const bool IsCloseRequested(const http::BaseHttpTransaction& transaction)
+					{
+						auto connectionHeader = transaction.GetHeader(util::http::headers::Connection);
+
+						for (auto it = connectionHeader.first; it != connectionHeader.second; ++it)
+						{
+							if (boost::iequals(boost::trim_copy(it->second), u8"close"))
+							{
+								return true;
+							}
+						}
+
+						return false;
+					}
+
+					/// <summary>
+					/// Reads from whichever end of a tunnel.
+					/// </summary>
+					/// <param name="fromClient">
+					/// True to read from the client, false to read from the server.
+					/// </param>
+					/// <param name="buffer">
+					/// The buffer to read into.
+					/// </param>
+					/// <param name="handler">
+					/// The completion handler.
+					/// </param>
+					template<typename Handler>
+					void TunnelRead(const bool fromClient, const boost::asio::mutable_buffers_1& buffer, Handler handler)
+					{
+						if (m_tunnel == Tunnel::Raw)
+						{
+							(fromClient ? DownstreamSocket() : UpstreamSocket()).async_read_some(buffer, std::move(handler));
+							return;
+						}
+
+						(fromClient ? m_downstreamSocket : m_upstreamSocket).async_read_some(buffer, std::move(handler));
+					}
+
+					/// <summary>
+					/// Writes to whichever end of a tunnel.
+					/// </summary>
+					/// <param name="toClient">
+					/// True to write to the client, false to write to the server.
+					/// </param>
+					/// <param name="buffer">
+					/// The data to write.
+					/// </param>
+					/// <param name="handler">
+					/// The completion handler.
+					/// </param>
+					template<typename Handler>
+					void TunnelWrite(const bool toClient, const boost::asio::mutable_buffers_1& buffer, Handler handler)
+					{
+						if (m_tunnel == Tunnel::Raw)
+						{
+							boost::asio::async_write(toClient ? DownstreamSocket() : UpstreamSocket(), buffer, std::move(handler));
+							return;
+						}
+
+						boost::asio::async_write(toClient ? m_downstreamSocket : m_upstreamSocket, buffer, std::move(handler));
+					}
+
+					/// <summary>
+					/// Records that an operation completed, for the stream timer.
+					/// </summary>
+					void Touch()
+					{
+						m_lastActivity = std::chrono::steady_clock::now();
+					}
+
+					/// <summary>
+					/// Arms the stream timer.
+					/// </summary>
+					/// <param name="timeout">
+					/// How long from now the timer is to expire.
+					/// </param>
+					void ArmStreamTimer(const std::chrono::steady_clock::duration timeout)
+					{
+						m_streamTimer.expires_from_now(timeout);
+						m_streamTimer.async_wait(m_strand.wrap(std::bind(&CoroutineHttpBridge::OnStreamTimeout, this->shared_from_this(), std::placeholders::_1)));
+					}
+
+					/// <summary>
+					/// Completion handler for the stream timer. Kills the bridge if it has been idle
+					/// for the whole timeout, otherwise re-arms the timer for whatever is left of it.
+					/// </summary>
+					/// <param name="error">
+					/// Error code that will indicate if the timer was cancelled.
+					/// </param>
+					void OnStreamTimeout(const boost::system::error_code& error)
+					{
+						if (error == boost::asio::error::operation_aborted || m_killed)
+						{
+							return;
+						}
+
+						const auto idle = std::chrono::steady_clock::now() - m_lastActivity;
+
+						if (idle < StreamTimeout)
+						{
+							ArmStreamTimer(StreamTimeout - idle);
+							return;
+						}
+
+						ReportWarning(u8"In CoroutineHttpBridge::OnStreamTimeout(const boost::system::error_code&) - Stream timed out.");
+						Kill();
+					}
+
+					/// <summary>
+					/// Shuts the bridge down. Every pending operation completes with an error, and
+					/// nothing is resumed, so the bridge goes once they have all returned. Only ever
+					/// called on the strand, so there's nothing to lock.
+					/// </summary>
+					void Kill()
+					{
+						if (m_killed)
+						{
+							return;
+						}
+
+						m_killed = true;
+
+						boost::system::error_code ignored;
+
+						m_resolver.cancel();
+						m_streamTimer.cancel(ignored);
+						m_verdictTimer.cancel(ignored);
+
+						// If we're parked on a verdict, the verdict control holds a reference to us
+						// until the verdict arrives, which might be never.
+						if (m_verdictToken != 0 && m_verdictControl != nullptr)
+						{
+							m_verdictControl->Withdraw(m_verdictToken);
+						}
+
+						m_verdictToken = 0;
+
+						DownstreamSocket().shutdown(boost::asio::socket_base::shutdown_both, ignored);
+						DownstreamSocket().close(ignored);
+
+						UpstreamSocket().shutdown(boost::asio::socket_base::shutdown_both, ignored);
+						UpstreamSocket().close(ignored);
+					}
+
+					/// <summary>
+					/// Attempts to take the handshake and spoof slots that a TLS bridge must hold
+					/// before it begins intercepting. If only one of the two could be taken, it is
+					/// given back.
+					/// </summary>
+					/// <returns>
+					/// True if both slots were taken or there is no admission control, false
+					/// otherwise.
+					/// </returns>
+					const bool TryBeginTlsInterception()
+					{
+						if (m_admissionControl == nullptr)
+						{
+							return true;
+						}
+
+						m_holdsHandshakeSlot = m_admissionControl->TryBeginHandshake();
+
+						if (!m_holdsHandshakeSlot)
+						{
+							return false;
+						}
+
+						m_holdsSpoofSlot = m_admissionControl->TryBeginSpoof();
+
+						if (!m_holdsSpoofSlot)
+						{
+							ReleaseHandshakeSlot();
+							return false;
+						}
+
+						return true;
+					}
+
+					/// <summary>
+					/// Releases the handshake slot, if held.
+					/// </summary>
+					void ReleaseHandshakeSlot()
+					{
+						if (m_holdsHandshakeSlot)
+						{
+							m_admissionControl->ReleaseHandshake();
+							m_holdsHandshakeSlot = false;
+						}
+					}
+
+					/// <summary>
+					/// Releases the spoof slot, if held.
+					/// </summary>
+					void ReleaseSpoofSlot()
+					{
+						if (m_holdsSpoofSlot)
+						{
+							m_admissionControl->ReleaseSpoof();
+							m_holdsSpoofSlot = false;
+						}
+					}
+
+					/// <summary>
+					/// Disables the Nagle algorithm for the supplied socket.
+					/// </summary>
+					/// <param name="socket">
+					/// The socket to configure.
+					/// </param>
+					void SetNoDelay(boost::asio::ip::tcp::socket& socket)
+					{
+						boost::system::error_code err;
+
+						socket.set_option(boost::asio::ip::tcp::no_delay(true), err);
+
+						if (err)
+						{
+							std::string errorMessage(u8"In CoroutineHttpBridge::SetNoDelay(boost::asio::ip::tcp::socket&) - While disabling the Nagle algorithm, got error:\t");
+							errorMessage.append(err.message());
+							ReportError(errorMessage);
+						}
+					}
+
+					/// <summary>
+					/// Gets the host a request is for, from its Host header if it has one, or else
+					/// the host we're connected to.
+					/// </summary>
+					/// <param name="request">
+					/// The request.
+					/// </param>
+					/// <returns>
+					/// The host the request is for, possibly including a port.
+					/// </returns>
+					const std::string& GetRequestHost(http::HttpRequest* request)
+					{
+						auto hostHeader = request->GetHeader(util::http::headers::Host);
+
+						if (hostHeader.first != hostHeader.second)
+						{
+							return hostHeader.first->second;
+						}
+
+						return m_upstreamHost;
+					}
+
+					/// <summary>
+					/// Fills the supplied message view for the supplied transaction, the same way
+					/// the TlsCapableHttpBridge does.
+					/// </summary>
+					/// <param name="message">
+					/// The message view to fill. Body fields are left for the caller.
+					/// </param>
+					/// <param name="request">
+					/// The request.
+					/// </param>
+					/// <param name="response">
+					/// The response, if any.
+					/// </param>
+					void FillMessageView(HttpMessageView& message, http::HttpRequest* request, http::HttpResponse* response)
+					{
+						static thread_local std::vector<HttpHeaderView> requestHeaderViews;
+						static thread_local std::vector<HttpHeaderView> responseHeaderViews;
+
+						std::memset(&message, 0, sizeof(message));
+
+						request->HeadersToViews(requestHeaderViews);
+
+						const char* method = http_method_str(request->Method());
+
+						message.method = method;
+						message.methodLength = static_cast<uint32_t>(std::strlen(method));
+						message.uri = request->RequestURI().c_str();
+						message.uriLength = static_cast<uint32_t>(request->RequestURI().size());
+						message.requestHeaders = requestHeaderViews.data();
+						message.requestHeaderCount = static_cast<uint32_t>(requestHeaderViews.size());
+
+						for (const auto& view : requestHeaderViews)
+						{
+							if (view.knownHeaderId == HttpKnownHeaderHost)
+							{
+								message.host = view.value;
+								message.hostLength = view.valueLength;
+								break;
+							}
+						}
+
+						if (message.host == nullptr)
+						{
+							message.host = m_upstreamHost.c_str();
+							message.hostLength = static_cast<uint32_t>(m_upstreamHost.size());
+						}
+
+						if (response != nullptr)
+						{
+							response->HeadersToViews(responseHeaderViews);
+
+							message.statusCode = response->StatusCode();
+							message.statusLine = response->StatusString().c_str();
+							message.statusLineLength = static_cast<uint32_t>(response->StatusString().size());
+							message.responseHeaders = responseHeaderViews.data();
+							message.responseHeaderCount = static_cast<uint32_t>(responseHeaderViews.size());
+						}
+					}
+
+					/// <summary>
+					/// Asks for a verdict on a transaction. Bypassed hosts have the transaction
+					/// whitelisted, and blocklisted hosts have it blocked, without asking. If the
+					/// asynchronous form of the relevant message callback was supplied, it's used,
+					/// and if the consumer doesn't answer right away, we're parked: the direction
+					/// must suspend without starting anything, and ::OnVerdict(...) resumes it.
+					/// Otherwise, the synchronous callbacks are asked.
+					/// </summary>
+					/// <param name="requestPath">
+					/// True if asked by the request path, false if by the response path.
+					/// </param>
+					/// <param name="request">
+					/// The request.
+					/// </param>
+					/// <param name="response">
+					/// The response, or nullptr when checking the request headers.
+					/// </param>
+					/// <returns>
+					/// Allow or Block if a verdict was reached right away, Pending if we've been
+					/// parked.
+					/// </returns>
+					const VerdictOutcome GetVerdict(const bool requestPath, http::HttpRequest* request, http::HttpResponse* response)
+					{
+						const bool inspectRequest = request->GetConsumeAllBeforeSending() && request->IsPayloadComplete();
+						const bool inspectResponse = response != nullptr && response->GetConsumeAllBeforeSending() && response->IsPayloadComplete();
+						const bool messageEnd = inspectRequest || inspectResponse;
+
+						if (!messageEnd && response == nullptr && m_verdictControl != nullptr)
+						{
+							auto snapshot = m_verdictControl->GetSnapshot();
+							const auto& host = GetRequestHost(request);
+
+							if (snapshot->IsBypassed(host))
+							{
+								m_verdictControl->RecordBypassed();
+								return ApplyMessageBeginVerdict(request, nullptr, 3, nullptr) ? Block : Allow;
+							}
+
+							if (snapshot->blocklist)
+							{
+								const bool blocked = snapshot->blocklist->Contains(host);
+
+								m_verdictControl->RecordBlocklistCheck(blocked);
+
+								if (blocked)
+								{
+									return ApplyMessageBeginVerdict(request, nullptr, 2, nullptr) ? Block : Allow;
+								}
+							}
+						}
+
+						if (m_verdictControl == nullptr || (messageEnd ? !m_verdictControl->GetOnMessageEnd() : !m_verdictControl->GetOnMessageBegin()))
+						{
+							return ShouldBlockTransaction(request, response, messageEnd, inspectRequest, inspectResponse) ? Block : Allow;
+						}
+
+						auto self = this->shared_from_this();
+
+						// Registered before the consumer ever sees the token, since it may well
+						// complete it from another thread before the callback even returns.
+						const uint64_t token = m_verdictControl->Park(
+							[self, requestPath](const uint32_t verdict, const uint32_t, std::vector<char> customResponse)
+							{
+								self->m_strand.post(std::bind(&CoroutineHttpBridge::OnVerdict, self, requestPath, verdict, std::move(customResponse)));
+							}
+						);
+
+						m_verdictToken = token;
+						m_verdictIsMessageEnd = messageEnd;
+
+						uint32_t nextAction = 0;
+						uint32_t responseSampleBytes = 0;
+						bool shouldBlock = false;
+
+						std::vector<char> customBlockResponse;
+
+						void* writerContext = util::cb::ContextStreamCopyUtil::GetContext(&customBlockResponse);
+
+						HttpMessageView message;
+						FillMessageView(message, request, response);
+
+						bool pending = false;
+
+						if (messageEnd)
+						{
+							message.requestBody = request->GetPayload().data();
+							message.requestBodyLength = static_cast<uint32_t>(request->GetPayload().size());
+							message.responseBody = inspectResponse ? response->GetPayload().data() : nullptr;
+							message.responseBodyLength = inspectResponse ? static_cast<uint32_t>(response->GetPayload().size()) : 0;
+
+							pending = m_verdictControl->GetOnMessageEnd()(&message, token, &shouldBlock, &util::cb::ContextStreamCopyUtil::Write, writerContext);
+						}
+						else
+						{
+							pending = m_verdictControl->GetOnMessageBegin()(&message, token, &nextAction, &responseSampleBytes, &util::cb::ContextStreamCopyUtil::Write, writerContext);
+						}
+
+						// If the consumer answered right away, we take the answer, unless it also
+						// went and completed the token, in which case the completion is already on
+						// its way to ::OnVerdict(...) and we treat this as pending.
+						if (!pending && m_verdictControl->Withdraw(token))
+						{
+							m_verdictToken = 0;
+
+							const auto sharedBlockResponse = ShareCustomBlockResponse(customBlockResponse);
+
+							const bool blocked = messageEnd ?
+								ApplyMessageEndVerdict(request, shouldBlock, sharedBlockResponse) :
+								ApplyMessageBeginVerdict(request, response, nextAction, sharedBlockResponse);
+
+							return blocked ? Block : Allow;
+						}
+
+						m_verdictTimer.expires_from_now(std::chrono::milliseconds(m_verdictControl->GetTimeoutMilliseconds()));
+						m_verdictTimer.async_wait(m_strand.wrap(std::bind(&CoroutineHttpBridge::OnVerdictTimeout, self, requestPath, token, std::placeholders::_1)));
+
+						return Pending;
+					}
+
+					/// <summary>
+					/// Resumes a direction that was parked by ::GetVerdict(...), once the verdict
+					/// has been supplied or the verdict timer has expired.
+					/// </summary>
+					/// <param name="requestPath">
+					/// True if the request path is parked, false if the response path is.
+					/// </param>
+					/// <param name="verdict">
+					/// For a message begin verdict, the nextAction. For a message end verdict,
+					/// non-zero to block.
+					/// </param>
+					/// <param name="customResponse">
+					/// The custom block response supplied with the verdict, if any.
+					/// </param>
+					void OnVerdict(const bool requestPath, const uint32_t verdict, std::vector<char>& customResponse)
+					{
+						boost::system::error_code verdictTimerCancelErr;
+						m_verdictTimer.cancel(verdictTimerCancelErr);
+
+						if (m_killed || m_verdictToken == 0)
+						{
+							return;
+						}
+
+						m_verdictToken = 0;
+
+						http::HttpResponse* response = requestPath ? nullptr : m_response.get();
+
+						const auto sharedBlockResponse = ShareCustomBlockResponse(customResponse);
+
+						const bool blocked = m_verdictIsMessageEnd ?
+							ApplyMessageEndVerdict(m_request.get(), verdict != 0, sharedBlockResponse) :
+							ApplyMessageBeginVerdict(m_request.get(), response, verdict, sharedBlockResponse);
+
+						(requestPath ? m_requestFrame : m_responseFrame)->verdict = blocked ? Block : Allow;
+
+						Resume(requestPath, boost::system::error_code(), 0);
+					}
+
+					/// <summary>
+					/// Completion handler for the verdict timer. If the verdict we're parked on
+					/// still hasn't been supplied, we withdraw from the verdict control, so that a
+					/// late completion is ignored, and resume with the default verdict.
+					/// </summary>
+					/// <param name="requestPath">
+					/// True if the request path is parked, false if the response path is.
+					/// </param>
+					/// <param name="token">
+					/// The token we were parked under when the timer was armed.
+					/// </param>
+					/// <param name="error">
+					/// Error code that will indicate if the timer was cancelled.
+					/// </param>
+					void OnVerdictTimeout(const bool requestPath, const uint64_t token, const boost::system::error_code& error)
+					{
+						if (error == boost::asio::error::operation_aborted || m_killed || m_verdictToken != token)
+						{
+							return;
+						}
+
+						if (!m_verdictControl->Withdraw(token))
+						{
+							// Lost the race to a completion, which is on its way to ::OnVerdict(...).
+							return;
+						}
+
+						m_verdictControl->RecordTimedOut();
+
+						ReportWarning(u8"In CoroutineHttpBridge::OnVerdictTimeout(const bool, const uint64_t, const boost::system::error_code&) - Verdict timed out. Applying the default verdict.");
+
+						std::vector<char> noCustomResponse;
+						OnVerdict(requestPath, m_verdictControl->GetDefaultVerdict(m_verdictIsMessageEnd), noCustomResponse);
+					}
+
+					/// <summary>
+					/// Asks the synchronous callbacks for a verdict, in whichever form was
+					/// supplied. Without any callback for the stage, the transaction is allowed.
+					/// </summary>
+					/// <returns>
+					/// True if the transaction was blocked, false otherwise.
+					/// </returns>
+					const bool ShouldBlockTransaction(http::HttpRequest* request, http::HttpResponse* response, const bool messageEnd, const bool inspectRequest, const bool inspectResponse)
+					{
+						uint32_t nextAction = 0;
+						uint32_t responseSampleBytes = 0;
+						bool shouldBlock = false;
+
+						std::vector<char> customBlockResponse;
+
+						void* writerContext = util::cb::ContextStreamCopyUtil::GetContext(&customBlockResponse);
+
+						if (messageEnd)
+						{
+							if (!m_onMessageEndView && !m_onMessageEnd)
+							{
+								return false;
+							}
+
+							const char* requestPayload = inspectRequest ? request->GetPayload().data() : nullptr;
+							const uint32_t requestPayloadSize = inspectRequest ? static_cast<uint32_t>(request->GetPayload().size()) : 0;
+
+							const char* responsePayload = inspectResponse ? response->GetPayload().data() : nullptr;
+							const uint32_t responsePayloadSize = inspectResponse ? static_cast<uint32_t>(response->GetPayload().size()) : 0;
+
+							if (m_onMessageEndView)
+							{
+								HttpMessageView message;
+								FillMessageView(message, request, response);
+
+								message.requestBody = requestPayload;
+								message.requestBodyLength = requestPayloadSize;
+								message.responseBody = responsePayload;
+								message.responseBodyLength = responsePayloadSize;
+
+								m_onMessageEndView(&message, &shouldBlock, &util::cb::ContextStreamCopyUtil::Write, writerContext);
+							}
+							else
+							{
+								auto requestHeaders = request->HeadersToString();
+								auto responseHeaders = response != nullptr ? response->HeadersToString() : std::string();
+
+								m_onMessageEnd(
+									requestHeaders.c_str(), requestHeaders.size(),
+									requestPayload, requestPayloadSize,
+									responseHeaders.c_str(), responseHeaders.size(),
+									responsePayload, responsePayloadSize,
+									&shouldBlock, &util::cb::ContextStreamCopyUtil::Write, writerContext
+									);
+							}
+
+							return ApplyMessageEndVerdict(request, shouldBlock, ShareCustomBlockResponse(customBlockResponse));
+						}
+
+						if (!m_onMessageBeginView && !m_onMessageBegin)
+						{
+							return false;
+						}
+
+						if (m_onMessageBeginView)
+						{
+							HttpMessageView message;
+							FillMessageView(message, request, response);
+
+							m_onMessageBeginView(&message, &nextAction, &responseSampleBytes, &util::cb::ContextStreamCopyUtil::Write, writerContext);
+						}
+						else
+						{
+							auto requestHeaders = request->HeadersToString();
+							auto responseHeaders = response != nullptr ? response->HeadersToString() : std::string();
+
+							m_onMessageBegin(
+								requestHeaders.c_str(), requestHeaders.size(),
+								nullptr, 0,
+								responseHeaders.c_str(), responseHeaders.size(),
+								nullptr, 0,
+								&nextAction, &util::cb::ContextStreamCopyUtil::Write, writerContext
+								);
+						}
+
+						return ApplyMessageBeginVerdict(request, response, nextAction, ShareCustomBlockResponse(customBlockResponse));
+					}
+
+					/// <summary>
+					/// Applies the answer given by the message end callback to the transaction.
+					/// </summary>
+					/// <returns>
+					/// True if the transaction was blocked, false otherwise.
+					/// </returns>
+					const bool ApplyMessageEndVerdict(http::HttpRequest* request, const bool shouldBlock, const std::shared_ptr<const std::vector<char>>& customBlockResponse)
+					{
+						if (!shouldBlock)
+						{
+							return false;
+						}
+
+						SetBlockResponse(request, customBlockResponse);
+
+						if (!customBlockResponse || customBlockResponse->empty())
+						{
+							request->SetShouldBlock(1);
+						}
+
+						return true;
+					}
+
+					/// <summary>
+					/// Applies the nextAction given by the message begin callback to the
+					/// transaction, the same way the TlsCapableHttpBridge does. Verdict caching and
+					/// response samples aren't supported, so what the nextAction says of them is
+					/// ignored.
+					/// </summary>
+					/// <returns>
+					/// True if the transaction was blocked, false otherwise.
+					/// </returns>
+					const bool ApplyMessageBeginVerdict(http::HttpRequest* request, http::HttpResponse* response, const uint32_t nextAction, const std::shared_ptr<const std::vector<char>>& customBlockResponse)
+					{
+						const uint32_t action = nextAction & HTTP_NEXT_ACTION_MASK;
+
+						if (action == 2)
+						{
+							// Block.
+							SetBlockResponse(request, customBlockResponse);
+
+							request->SetShouldBlock(1);
+
+							if (response)
+							{
+								response->SetShouldBlock(1);
+							}
+
+							return true;
+						}
+
+						// Allow. 1 wants the payloads inspected, and 3 whitelists the rest of the
+						// transaction, including the response.
+						const int16_t shouldBlock = action == 3 ? -1 : 0;
+						const bool consumeAll = action == 1;
+
+						request->SetShouldBlock(shouldBlock);
+						request->SetConsumeAllBeforeSending(consumeAll);
+
+						if (response)
+						{
+							response->SetShouldBlock(shouldBlock);
+							response->SetConsumeAllBeforeSending(consumeAll);
+						}
+
+						return false;
+					}
+
+					/// <summary>
+					/// Decides what's to be written to the client in place of a blocked
+					/// transaction. See http::BlockResponses.
+					/// </summary>
+					/// <param name="request">
+					/// The request being blocked.
+					/// </param>
+					/// <param name="customBlockResponse">
+					/// The custom block response supplied with the verdict. May be nullptr.
+					/// </param>
+					void SetBlockResponse(http::HttpRequest* request, const std::shared_ptr<const std::vector<char>>& customBlockResponse)
+					{
+						if (m_verdictControl != nullptr)
+						{
+							m_blockResponse = m_verdictControl->GetBlockResponses().Resolve(customBlockResponse, request->GetHttpVersion());
+						}
+						else if (customBlockResponse && customBlockResponse->size() > 0)
+						{
+							m_blockResponse = customBlockResponse;
+						}
+						else
+						{
+							m_blockResponse = http::BlockResponses::Get204(request->GetHttpVersion());
+						}
+					}
+
+					/// <summary>
+					/// Takes ownership of the custom block response a consumer wrote, so that it
+					/// can be shared from then on, without being copied again.
+					/// </summary>
+					/// <param name="customBlockResponse">
+					/// The custom block response. Left empty.
+					/// </param>
+					/// <returns>
+					/// The shared custom block response, or nullptr if none was written.
+					/// </returns>
+					static std::shared_ptr<const std::vector<char>> ShareCustomBlockResponse(std::vector<char>& customBlockResponse)
+					{
+						if (customBlockResponse.empty())
+						{
+							return nullptr;
+						}
+
+						return std::make_shared<const std::vector<char>>(std::move(customBlockResponse));
+					}
+
+					/// <summary>
+					/// Writes the block response to the client. The caller kills the bridge once
+					/// the write completes.
+					/// </summary>
+					/// <param name="markBlocked">
+					/// Whether or not to flag the request as blocked first. Checks of the response
+					/// always do this. The request header check leaves it to the verdict, since a
+					/// custom block response doesn't set the flag.
+					/// </param>
+					/// <param name="handler">
+					/// The completion handler.
+					/// </param>
+					template<typename Handler>
+					void WriteBlockResponse(const bool markBlocked, Handler handler)
+					{
+						if (markBlocked)
+						{
+							m_request->SetShouldBlock(1);
+						}
+
+						if (!m_blockResponse)
+						{
+							m_blockResponse = http::BlockResponses::Get204(m_request->GetHttpVersion());
+						}
+
+						boost::asio::async_write(m_downstreamSocket, boost::asio::buffer(*m_blockResponse), std::move(handler));
+					}
+				};
+
+				template<class BridgeSocketType>
+				constexpr std::chrono::steady_clock::duration CoroutineHttpBridge<BridgeSocketType>::StreamTimeout;
+
+				template<class BridgeSocketType>
+				constexpr size_t CoroutineHttpBridge<BridgeSocketType>::MinTlsHelloLength;
+
+				template<class BridgeSocketType>
+				constexpr size_t CoroutineHttpBridge<BridgeSocketType>::MinRequestLength;
+
+			} /* namespace secure */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
+
+#include <boost/asio/unyield.hpp>
@@ -8,13 +8,16 @@
 #pragma once
 
 #include "TlsCapableHttpBridge.hpp"
+#include "CoroutineHttpBridge.hpp"
 #include "../../util/cb/EventReporter.hpp"
+#include "../../network/AcceptControl.hpp"
 
 #include <boost/asio.hpp>
 #include <type_traits>
 #include <memory>
 #include <boost/predef/os.h>
 #include <stdexcept>
+#include <chrono>
 
 namespace te
 {
@@ -46,8 +49,12 @@ namespace te
 				/// 
 				/// In the event that AcceptorType is network::TlsSocket, some of the optional
 				/// parameters become required, such as the in memory certificate store,
+				///
+				/// BridgeType is the bridge that accepted clients are served by. Either
+				/// TlsCapableHttpBridge, the default, or CoroutineHttpBridge, which takes the same
+				/// arguments.
 				/// </summary>
-				template<class AcceptorType>
+				template<class AcceptorType, template<class> class BridgeType = TlsCapableHttpBridge>
 				class TlsCapableHttpAcceptor : public util::cb::EventReporter
 				{
 
@@ -59,7 +66,7 @@ namespace te
 
 				private:
 
-					using SharedBridge = std::shared_ptr< TlsCapableHttpBridge<AcceptorType> >;
+					using SharedBridge = std::shared_ptr< BridgeType<AcceptorType> >;
 
 				public:
 
@@ -97,6 +104,26 @@ namespace te
 					/// 
 					/// This parameter is only required when AcceptorType is network::TlsSocket.
 					/// </param>
+					/// <param name="flowControl">
+					/// An optional pointer to the flow control that every bridge created by this
+					/// acceptor will reserve its streaming reads against. Must outlive every bridge.
+					/// </param>
+					/// <param name="admissionControl">
+					/// An optional pointer to the admission control that decides whether or not
+					/// newly accepted clients get a bridge, and whether or not TLS bridges may
+					/// begin intercepting. Must outlive every bridge.
+					/// </param>
+					/// <param name="acceptControl">
+					/// An optional pointer to the accept control that configures how many accepts
+					/// are kept outstanding, how many waiting clients are drained per wakeup and
+					/// how deep the listen backlog is, and that records how well the accept loop is
+					/// keeping up. Read at construction. Must outlive the acceptor.
+					/// </param>
+					/// <param name="verdictControl">
+					/// An optional pointer to the verdict control that holds the asynchronous form
+					/// of the message callbacks, and keeps track of bridges waiting on a verdict.
+					/// Must outlive every bridge.
+					/// </param>
 					/// <param name="onInfoCb">
 					/// An optional callback for general information about non-critical events.
 					/// </param>
@@ -112,8 +139,14 @@ namespace te
 						uint16_t port = 0,
 						const std::string& caBundleAbsPath = std::string(u8"none"),
 						BaseInMemoryCertificateStore* store = nullptr,
+						network::FlowControl* flowControl = nullptr,
+						network::AdmissionControl* admissionControl = nullptr,
+						network::AcceptControl* acceptControl = nullptr,
+						network::VerdictControl* verdictControl = nullptr,
 						util::cb::HttpMessageBeginCheckFunction onMessageBegin = nullptr,
 						util::cb::HttpMessageEndCheckFunction onMessageEnd = nullptr,
+						util::cb::HttpMessageBeginViewFunction onMessageBeginView = nullptr,
+						util::cb::HttpMessageEndViewFunction onMessageEndView = nullptr,
 						util::cb::MessageFunction onInfoCb = nullptr,
 						util::cb::MessageFunction onWarnCb = nullptr,
 						util::cb::MessageFunction onErrorCb = nullptr
@@ -123,11 +156,19 @@ namespace te
 						m_service(service),
 						m_caBundleAbsolutePath(caBundleAbsPath),
 						m_store(store),
+						m_flowControl(flowControl),
+						m_admissionControl(admissionControl),
 						m_acceptor(*service), // Don't use a ctor here that auto opens and binds the listener!
-						m_clientContext(*service, boost::asio::ssl::context::sslv23_client),
-						m_defaultServerContext(*service, boost::asio::ssl::context::tlsv12_server),
+						m_deferTimer(*service),
+						m_acceptControl(acceptControl),
+						m_verdictControl(verdictControl),
+						m_strand(*service),
+						m_clientContext(boost::asio::ssl::context::sslv23_client),
+						m_defaultServerContext(boost::asio::ssl::context::tlsv12_server),
 						m_onMessageBegin(onMessageBegin),
-						m_onMessageEnd(onMessageEnd)
+						m_onMessageEnd(onMessageEnd),
+						m_onMessageBeginView(onMessageBeginView),
+						m_onMessageEndView(onMessageEndView)
 					{	
 						bool isTls = std::is_same<AcceptorType, network::TlsSocket>::value;
 						#ifndef NDEBUG
@@ -158,7 +199,28 @@ namespace te
 						m_acceptor.set_option(boost::asio::socket_base::reuse_address(true), reuseAddrEc);
 
 						m_acceptor.bind(listenerEndpoint);
-						m_acceptor.listen();
+
+						int listenBacklog = boost::asio::socket_base::max_connections;
+
+						if (m_acceptControl != nullptr)
+						{
+							m_outstandingAccepts = m_acceptControl->GetOutstandingAccepts();
+							m_maxAcceptsPerWakeup = m_acceptControl->GetMaxAcceptsPerWakeup();
+
+							if (m_acceptControl->GetListenBacklog() > 0)
+							{
+								listenBacklog = static_cast<int>(m_acceptControl->GetListenBacklog());
+							}
+						}
+
+						m_acceptor.listen(listenBacklog);
+
+						if (m_maxAcceptsPerWakeup > 1)
+						{
+							// Draining relies on synchronous accepts that fail with would_block when
+							// the backlog is empty, rather than sitting there waiting for a client.
+							m_acceptor.non_blocking(true);
+						}
 
 						if (reuseAddrEc)
 						{
@@ -205,37 +267,25 @@ namespace te
 					}
 
 					/// <summary>
-					/// Initiates the process of accepting a new client asynchronously.
+					/// Initiates the process of accepting new clients asynchronously, by arming as
+					/// many accepts as the accept control says to keep outstanding. Every accept
+					/// that completes arms its own replacement, so this should only be called once,
+					/// before the io_service begins running.
 					/// </summary>
 					/// <returns>
-					/// True if the async_accept was initiated without error, false otherwise.
+					/// True if at least one async_accept was initiated without error, false
+					/// otherwise.
 					/// </returns>
 					const bool AcceptConnections()
 					{
-						if (m_service != nullptr)
-						{
-							try
-							{
-								SharedBridge session = std::make_shared<TlsCapableHttpBridge<AcceptorType>>(m_service, m_store, &m_defaultServerContext, &m_clientContext, m_onMessageBegin, m_onMessageEnd, m_onInfo, m_onWarning, m_onError);
+						bool armedAny = false;
 
-								if (session == nullptr)
-								{
-									ReportError(u8"In TlsCapableHttpAcceptor::HandleAccept(const boost::system::error_code&) - Failed to allocate new session!");
-									return false;
-								}
-
-								m_acceptor.async_accept(session->DownstreamSocket(), std::bind(&TlsCapableHttpAcceptor::HandleAccept, this, std::placeholders::_1, session));
-								return true;
-							}
-							catch (std::exception& e)
-							{
-								std::string errMessage(u8"In TlsCapableHttpAcceptor::HandleAccept(const boost::system::error_code&) - Got error:\t");
-								errMessage.append(e.what());
-								ReportError(errMessage);
-							}
+						for (uint32_t i = 0; i < m_outstandingAccepts; ++i)
+						{
+							armedAny = ArmAccept(nullptr) || armedAny;
 						}
 
-						return false;
+						return armedAny;
 					}
 
 					/// <summary>
@@ -247,6 +297,9 @@ namespace te
 						boost::system::error_code e;
 						m_acceptor.cancel(e);
 
+						boost::system::error_code deferCancelErr;
+						m_deferTimer.cancel(deferCancelErr);
+
 						if (e)
 						{
 							std::string errMessage(u8"In TlsCapableHttpAcceptor::StopAccepting(const boost::system::error_code&) - Got error:\t");
@@ -260,6 +313,9 @@ namespace te
 					util::cb::HttpMessageBeginCheckFunction m_onMessageBegin;
 					util::cb::HttpMessageEndCheckFunction m_onMessageEnd;
 
+					util::cb::HttpMessageBeginViewFunction m_onMessageBeginView;
+					util::cb::HttpMessageEndViewFunction m_onMessageEndView;
+
 					/// <summary>
 					/// Initializes the default server and the client contexts, which are to be used
 					/// in every single Tls client bridge. Only ever called when AcceptorType is
@@ -321,7 +377,7 @@ namespace te
 						}
 						*/
 
-						if (X509_VERIFY_PARAM_set_flags(m_clientContext.native_handle()->param, X509_V_FLAG_TRUSTED_FIRST) != 1)
+						if (X509_VERIFY_PARAM_set_flags(SSL_CTX_get0_param(m_clientContext.native_handle()), X509_V_FLAG_TRUSTED_FIRST) != 1)
 						{
 							ReportWarning(u8"In TlsCapableHttpAcceptor::InitContexts() - Failed to set X509_V_FLAG_TRUSTED_FIRST flag on client context. \
 								This may cause some valid certificates to fail verification, because a cert found in their chain is unreachable and without this \
@@ -329,10 +385,213 @@ namespace te
 						}
 					}
 
+					/// <summary>
+					/// Arms a single async_accept. If the admission control says we're full and
+					/// should defer, the accept is instead put off until the defer timer fires.
+					/// </summary>
+					/// <param name="spare">
+					/// A session left over from draining, which has not had a client accepted into
+					/// it. If nullptr, a new session is created.
+					/// </param>
+					/// <returns>
+					/// True if the async_accept was initiated or deferred without error, false
+					/// otherwise.
+					/// </returns>
+					const bool ArmAccept(SharedBridge spare)
+					{
+						if (m_service != nullptr)
+						{
+							try
+							{
+								if (ShouldDefer())
+								{
+									// We're full. Rather than accepting clients only to throw them away, we
+									// leave them sitting in the backlog and check back shortly.
+									DeferAccept(true);
+									return true;
+								}
+
+								SharedBridge session = spare != nullptr ? spare : CreateSession();
+
+								if (session == nullptr)
+								{
+									ReportError(u8"In TlsCapableHttpAcceptor::ArmAccept(SharedBridge) - Failed to allocate new session!");
+									return false;
+								}
+
+								if (m_acceptControl != nullptr)
+								{
+									m_acceptControl->RecordArmed();
+								}
+
+								m_acceptor.async_accept(session->DownstreamSocket(), m_strand.wrap(std::bind(&TlsCapableHttpAcceptor::HandleAccept, this, std::placeholders::_1, session)));
+								return true;
+							}
+							catch (std::exception& e)
+							{
+								std::string errMessage(u8"In TlsCapableHttpAcceptor::ArmAccept(SharedBridge) - Got error:\t");
+								errMessage.append(e.what());
+								ReportError(errMessage);
+							}
+						}
+
+						return false;
+					}
+
+					/// <summary>
+					/// Creates a new session for a client to be accepted into.
+					/// </summary>
+					/// <returns>
+					/// The new session.
+					/// </returns>
+					SharedBridge CreateSession()
+					{
+						return std::make_shared<BridgeType<AcceptorType>>(m_service, m_store, &m_defaultServerContext, &m_clientContext, m_flowControl, m_admissionControl, m_verdictControl, m_onMessageBegin, m_onMessageEnd, m_onMessageBeginView, m_onMessageEndView, m_onInfo, m_onWarning, m_onError);
+					}
+
+					/// <summary>
+					/// Checks whether the admission control wants us to stop accepting for now.
+					/// </summary>
+					/// <returns>
+					/// True if accepting should be deferred, false otherwise.
+					/// </returns>
+					const bool ShouldDefer() const
+					{
+						return m_admissionControl != nullptr && m_admissionControl->GetDeferWhenFull() && !m_admissionControl->HasBridgeCapacity();
+					}
+
+					/// <summary>
+					/// Puts off arming an accept until the defer timer fires. Every accept that is
+					/// deferred shares the one timer, and they're all re-armed together when it
+					/// fires.
+					/// </summary>
+					/// <param name="dueToAdmission">
+					/// True if we're deferring because the admission control says we're full,
+					/// false if we're backing off after an accept error.
+					/// </param>
+					void DeferAccept(const bool dueToAdmission)
+					{
+						if (m_deferredAccepts++ > 0)
+						{
+							return;
+						}
+
+						if (dueToAdmission)
+						{
+							m_admissionControl->RecordDeferred();
+						}
+
+						m_deferTimer.expires_from_now(boost::posix_time::milliseconds(static_cast<long>(network::AdmissionControl::DeferIntervalMilliseconds)));
+						m_deferTimer.async_wait(m_strand.wrap(std::bind(&TlsCapableHttpAcceptor::HandleDeferElapsed, this, std::placeholders::_1)));
+					}
+
+					/// <summary>
+					/// Hands a freshly accepted client to its session, so long as the admission
+					/// control has room for it. Otherwise, the client is reset right away rather
+					/// than being left hanging, and the session dies without ever being started.
+					/// </summary>
+					/// <param name="session">
+					/// The session the client was accepted into.
+					/// </param>
+					/// <param name="drained">
+					/// True if the client was picked up while draining.
+					/// </param>
+					void AdmitAndStart(SharedBridge session, const bool drained)
+					{
+						if (m_acceptControl != nullptr)
+						{
+							m_acceptControl->RecordAccepted(drained);
+						}
+
+						if (session->TryAdmit())
+						{
+							session->Start();
+							return;
+						}
+
+						boost::system::error_code lingerErr;
+						boost::system::error_code closeErr;
+						session->DownstreamSocket().set_option(boost::asio::socket_base::linger(true, 0), lingerErr);
+						session->DownstreamSocket().close(closeErr);
+					}
+
+					/// <summary>
+					/// Synchronously accepts clients that are already waiting in the backlog, up
+					/// to the per-wakeup limit, so that a burst is picked up in one go rather than
+					/// one io_service wakeup per client. The listener is non-blocking whenever
+					/// draining is enabled, so this stops as soon as the backlog is empty.
+					/// </summary>
+					/// <returns>
+					/// A session that was created for draining but never had a client accepted
+					/// into it, which the caller should reuse for its next accept. May be nullptr.
+					/// </returns>
+					SharedBridge DrainReadyConnections()
+					{
+						SharedBridge session = nullptr;
+						uint32_t depth = 0;
+						bool hitLimit = false;
+
+						try
+						{
+							// The client that woke us up counts against the limit.
+							while (!ShouldDefer())
+							{
+								if (depth + 1 >= m_maxAcceptsPerWakeup)
+								{
+									hitLimit = true;
+									break;
+								}
+
+								if (session == nullptr)
+								{
+									session = CreateSession();
+								}
+
+								boost::system::error_code acceptErr;
+								m_acceptor.accept(session->DownstreamSocket(), acceptErr);
+
+								if (acceptErr)
+								{
+									if (acceptErr != boost::asio::error::would_block && acceptErr != boost::asio::error::try_again)
+									{
+										if (m_acceptControl != nullptr)
+										{
+											m_acceptControl->RecordAcceptError();
+										}
+
+										std::string errMessage(u8"In TlsCapableHttpAcceptor::DrainReadyConnections() - Got error:\t");
+										errMessage.append(acceptErr.message());
+										ReportError(errMessage);
+									}
+
+									break;
+								}
+
+								++depth;
+								AdmitAndStart(session, true);
+								session = nullptr;
+							}
+						}
+						catch (std::exception& e)
+						{
+							std::string errMessage(u8"In TlsCapableHttpAcceptor::DrainReadyConnections() - Got error:\t");
+							errMessage.append(e.what());
+							ReportError(errMessage);
+						}
+
+						if (m_acceptControl != nullptr)
+						{
+							m_acceptControl->RecordDrain(depth, hitLimit);
+						}
+
+						return session;
+					}
+
 					/// <summary>
 					/// Completion handler for the acceptor async_accept calls. Attempts to initate
-					/// the bridge transactions for the newly connected client, then moves to begin
-					/// a new async_accept.
+					/// the bridge transactions for the newly connected client, drains anything else
+					/// already waiting if draining is enabled, then moves to begin a new
+					/// async_accept to replace this one.
 					/// </summary>
 					/// <param name="error">
 					/// Error code that will indicate if any errors were handled during the async
@@ -344,21 +603,53 @@ namespace te
 					/// </param>
 					void HandleAccept(const boost::system::error_code& error, SharedBridge session)
 					{
+						if (m_acceptControl != nullptr)
+						{
+							m_acceptControl->RecordCompleted();
+						}
+
 						if (!error && session.get() != nullptr)
 						{
-							session->Start();
+							const auto wokeAt = std::chrono::steady_clock::now();
+
+							AdmitAndStart(session, false);
+
+							SharedBridge spare = nullptr;
+
+							if (m_maxAcceptsPerWakeup > 1)
+							{
+								spare = DrainReadyConnections();
+							}
 
-							if (!AcceptConnections())
+							if (!ArmAccept(spare))
 							{
 								ReportError(u8"In TlsCapableHttpAcceptor::HandleAccept(const boost::system::error_code&) - Failed to reinitiate accept.");
 							}
+
+							if (m_acceptControl != nullptr)
+							{
+								m_acceptControl->RecordRearmLatency(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - wokeAt).count()));
+							}
 						}
 						else
 						{
 							if (error)
 							{
-								std::string errMessage(u8"In TlsCapableHttpAcceptor::HandleAccept(const boost::system::error_code&) - Got error:\t");
-								errMessage.append(error.message());
+								if (error != boost::asio::error::operation_aborted)
+								{
+									std::string errMessage(u8"In TlsCapableHttpAcceptor::HandleAccept(const boost::system::error_code&) - Got error:\t");
+									errMessage.append(error.message());
+									ReportError(errMessage);
+
+									if (m_acceptControl != nullptr)
+									{
+										m_acceptControl->RecordAcceptError();
+									}
+
+									// Things like running out of descriptors. Don't let that permanently
+									// cost us this accept, but don't spin on it either.
+									DeferAccept(false);
+								}
 							}
 							else
 							{
@@ -367,6 +658,41 @@ namespace te
 						}
 					}
 
+					/// <summary>
+					/// Completion handler for the timer used to put off accepting while deferring
+					/// or backing off. Re-arms every accept that was put off, each of which will be
+					/// put off again if there's still no room.
+					/// </summary>
+					/// <param name="error">
+					/// Error code that will indicate if any errors were handled during the async
+					/// operation, providing details if an error did occur and was handled.
+					/// </param>
+					void HandleDeferElapsed(const boost::system::error_code& error)
+					{
+						const uint32_t deferredAccepts = m_deferredAccepts;
+						m_deferredAccepts = 0;
+
+						if (error)
+						{
+							if (error != boost::asio::error::operation_aborted)
+							{
+								std::string errMessage(u8"In TlsCapableHttpAcceptor::HandleDeferElapsed(const boost::system::error_code&) - Got error:\t");
+								errMessage.append(error.message());
+								ReportError(errMessage);
+							}
+
+							return;
+						}
+
+						for (uint32_t i = 0; i < deferredAccepts; ++i)
+						{
+							if (!ArmAccept(nullptr))
+							{
+								ReportError(u8"In TlsCapableHttpAcceptor::HandleDeferElapsed(const boost::system::error_code&) - Failed to reinitiate accept.");
+							}
+						}
+					}
+
 					/// <summary>
 					/// Pointer to the io_service driving the acceptor.
 					/// </summary>
@@ -389,11 +715,66 @@ namespace te
 					/// </summary>
 					BaseInMemoryCertificateStore* m_store = nullptr;
 
+					/// <summary>
+					/// Pointer to the flow control to be supplied to each client bridge. May be
+					/// nullptr. See network::FlowControl.
+					/// </summary>
+					network::FlowControl* m_flowControl = nullptr;
+
+					/// <summary>
+					/// Pointer to the admission control to be supplied to each client bridge. May
+					/// be nullptr. See network::AdmissionControl.
+					/// </summary>
+					network::AdmissionControl* m_admissionControl = nullptr;
+
 					/// <summary>
 					/// The underlying TCP acceptor itself.
 					/// </summary>
 					boost::asio::ip::tcp::acceptor m_acceptor;
 
+					/// <summary>
+					/// Used to check back for a free bridge slot while deferring, or to back off
+					/// after an accept error.
+					/// </summary>
+					boost::asio::deadline_timer m_deferTimer;
+
+					/// <summary>
+					/// The number of accepts presently put off until the defer timer fires.
+					/// </summary>
+					uint32_t m_deferredAccepts = 0;
+
+					/// <summary>
+					/// Pointer to the accept control that configures and instruments this
+					/// acceptor's accept loop. May be nullptr, in which case a single accept is kept
+					/// outstanding and nothing is drained. See network::AcceptControl.
+					/// </summary>
+					network::AcceptControl* m_acceptControl = nullptr;
+
+					/// <summary>
+					/// Pointer to the verdict control to be supplied to each client bridge. May be
+					/// nullptr. See network::VerdictControl.
+					/// </summary>
+					network::VerdictControl* m_verdictControl = nullptr;
+
+					/// <summary>
+					/// The number of accepts to keep outstanding, fixed at construction.
+					/// </summary>
+					uint32_t m_outstandingAccepts = 1;
+
+					/// <summary>
+					/// The maximum number of clients to accept per completed accept, fixed at
+					/// construction. One means no draining.
+					/// </summary>
+					uint32_t m_maxAcceptsPerWakeup = 1;
+
+					/// <summary>
+					/// With several accepts outstanding, their handlers could otherwise run
+					/// concurrently on different io_service threads. Every accept and defer timer
+					/// handler is wrapped in this strand, since they all share the acceptor and
+					/// the deferral state.
+					/// </summary>
+					boost::asio::io_service::strand m_strand;
+
 					/// <summary>
 					/// The client context for each Tls client bridge. Only used when AcceptorType
 					/// is network::TlsSocket.
@@ -413,6 +794,9 @@ namespace te
 				using TcpAcceptor = TlsCapableHttpAcceptor<network::TcpSocket>;
 				using TlsAcceptor = TlsCapableHttpAcceptor<network::TlsSocket>;
 
+				using CoroutineTcpAcceptor = TlsCapableHttpAcceptor<network::TcpSocket, CoroutineHttpBridge>;
+				using CoroutineTlsAcceptor = TlsCapableHttpAcceptor<network::TlsSocket, CoroutineHttpBridge>;
+
 			} /* namespace secure */
 		} /* namespace mitm */
 	} /* namespace httpengine */
@@ -6,9 +6,14 @@
 */
 
 #include "TlsCapableHttpBridge.hpp"
-#include <http/client/x509_cert_utilities.h>
 #include <stdexcept>
 
+#if BOOST_OS_WINDOWS
+#include <http/client/x509_cert_utilities.h>
+#else
+#include <openssl/x509v3.h>
+#endif
+
 namespace te
 {
 	namespace httpengine
@@ -23,19 +28,60 @@ namespace te
 				template <typename T>
 				std::atomic_flag TlsCapableHttpBridge<T>::s_clientContextLock = ATOMIC_FLAG_INIT;
 
-                template <typename T>
-                constexpr uint32_t TlsCapableHttpBridge<T>::s_streamChannelMultiplier = 10;
+				template<>
+				bool TlsCapableHttpBridge<network::TcpSocket>::VerifyServerCertificateCallback(bool preverified, boost::asio::ssl::verify_context& ctx)
+				{
+					// Do nothing.
+					return false;
+				}
+
+				template<>
+				bool TlsCapableHttpBridge<network::TlsSocket>::VerifyServerCertificateCallback(const bool preverified, boost::asio::ssl::verify_context& ctx)
+				{	
 
-                template <typename T>
-                util::cb::CStreamCopyUtilContainer<std::is_same<T, network::TlsSocket>::value, TlsCapableHttpBridge<T>::s_streamChannelMultiplier> TlsCapableHttpBridge<T>::s_streamCopyContainer;
+					#ifndef NDEBUG
+					ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::VerifyServerCertificateCallback");
+					#endif // !NDEBUG
 
+					#if BOOST_OS_WINDOWS
+					auto res = web::http::client::details::verify_cert_chain_platform_specific(ctx, m_upstreamHost);
+					#else
+					// Elsewhere there's no platform store to consult, OpenSSL has already verified
+					// the chain against the client context's store. All that's left is to check
+					// that the leaf was issued for the host we're connecting to.
+					auto res = preverified;
+					if (res && X509_STORE_CTX_get_error_depth(ctx.native_handle()) == 0)
+					{
+						X509* leafCert = X509_STORE_CTX_get_current_cert(ctx.native_handle());
+						res = leafCert != nullptr && X509_check_host(leafCert, m_upstreamHost.c_str(), m_upstreamHost.size(), 0, nullptr) == 1;
+					}
+					#endif
+					if (res)
+					{
+						X509* curCert = X509_STORE_CTX_get_current_cert(ctx.native_handle());
+						m_upstreamCert = curCert;
+					}
+					else
+					{
+						m_upstreamCert = nullptr;
+					}
+
+					return res;
+				}
+
+				template<>
 				TlsCapableHttpBridge<network::TcpSocket>::TlsCapableHttpBridge(
 					boost::asio::io_service* service,
 					BaseInMemoryCertificateStore* certStore,
 					boost::asio::ssl::context* defaultServerContext,
 					boost::asio::ssl::context* clientContext,
+					network::FlowControl* flowControl,
+					network::AdmissionControl* admissionControl,
+					network::VerdictControl* verdictControl,
 					util::cb::HttpMessageBeginCheckFunction onMessageBegin,
 					util::cb::HttpMessageEndCheckFunction onMessageEnd,
+					util::cb::HttpMessageBeginViewFunction onMessageBeginView,
+					util::cb::HttpMessageEndViewFunction onMessageEndView,
 					util::cb::MessageFunction onInfoCb,
 					util::cb::MessageFunction onWarnCb,
 					util::cb::MessageFunction onErrorCb
@@ -51,9 +97,17 @@ namespace te
 					m_downstreamStrand(*service),
 					m_resolver(*service),
 					m_streamTimer(*service),
+					m_requestPathPauseTimer(*service),
+					m_responsePathPauseTimer(*service),
+					m_flowControl(flowControl),
+					m_admissionControl(admissionControl),
+					m_verdictControl(verdictControl),
+					m_verdictTimer(*service),
 					m_certStore(certStore),
 					m_onMessageBegin(onMessageBegin),
-					m_onMessageEnd(onMessageEnd)
+					m_onMessageEnd(onMessageEnd),
+					m_onMessageBeginView(onMessageBeginView),
+					m_onMessageEndView(onMessageEndView)
 				{	
 
 					// We purposely don't catch here. We want the acceptor to catch.
@@ -70,13 +124,19 @@ namespace te
 					m_response->SetOnError(m_onError);
 				}
 				
+				template<>
 				TlsCapableHttpBridge<network::TlsSocket>::TlsCapableHttpBridge(
 					boost::asio::io_service* service,
 					BaseInMemoryCertificateStore* certStore,
 					boost::asio::ssl::context* defaultServerContext,
 					boost::asio::ssl::context* clientContext,
+					network::FlowControl* flowControl,
+					network::AdmissionControl* admissionControl,
+					network::VerdictControl* verdictControl,
 					util::cb::HttpMessageBeginCheckFunction onMessageBegin,
 					util::cb::HttpMessageEndCheckFunction onMessageEnd,
+					util::cb::HttpMessageBeginViewFunction onMessageBeginView,
+					util::cb::HttpMessageEndViewFunction onMessageEndView,
 					util::cb::MessageFunction onInfoCb,
 					util::cb::MessageFunction onWarnCb,
 					util::cb::MessageFunction onErrorCb
@@ -93,9 +153,17 @@ namespace te
 					m_downstreamStrand(*service),
 					m_resolver(*service),
 					m_streamTimer(*service),
+					m_requestPathPauseTimer(*service),
+					m_responsePathPauseTimer(*service),
+					m_flowControl(flowControl),
+					m_admissionControl(admissionControl),
+					m_verdictControl(verdictControl),
+					m_verdictTimer(*service),
 					m_certStore(certStore),
 					m_onMessageBegin(onMessageBegin),
-					m_onMessageEnd(onMessageEnd)
+					m_onMessageEnd(onMessageEnd),
+					m_onMessageBeginView(onMessageBeginView),
+					m_onMessageEndView(onMessageEndView)
 				{
 					#ifndef NDEBUG
 						assert(m_certStore != nullptr && u8"In TlsCapableHttpBridge<network::TlsSocket>::TlsCapableHttpBridge(... args) - Supplied certificate store is nullptr!");						
@@ -204,7 +272,7 @@ namespace te
 					else
 					{
 						std::unique_ptr<boost::asio::ssl::context> newContext;
-						newContext.reset(new boost::asio::ssl::context(sslStream.get_io_service(), boost::asio::ssl::context::sslv23_client));
+						newContext.reset(new boost::asio::ssl::context(boost::asio::ssl::context::sslv23_client));
 
                         newContext->set_options(
                             boost::asio::ssl::context::no_compression |
@@ -219,7 +287,7 @@ namespace te
 
 						SSL_CTX_set_ecdh_auto(newContext->native_handle(), 1);
 
-                        if (X509_VERIFY_PARAM_set_flags(newContext->native_handle()->param, X509_V_FLAG_TRUSTED_FIRST) != 1)
+                        if (X509_VERIFY_PARAM_set_flags(SSL_CTX_get0_param(newContext->native_handle()), X509_V_FLAG_TRUSTED_FIRST) != 1)
                         {
                             // XXX TODO
                             // No context from which to call ReportX methods because we're a static function here.
@@ -286,33 +354,12 @@ namespace te
 							// Means that there is a request payload, it's not complete, and it's been flagged
 							// for inspection before being sent upstream. Another read from the client is
 							// required.
-							
-							try
+							if (!SendContinueIfOwed())
 							{
-								auto requestReadBuffer = m_request->GetReadBuffer();
-
-								boost::asio::async_read(
-									m_downstreamSocket,
-									requestReadBuffer,
-									boost::asio::transfer_at_least(1),
-									m_downstreamStrand.wrap(
-										std::bind(
-											&TlsCapableHttpBridge::OnDownstreamRead,
-											shared_from_this(),
-											std::placeholders::_1,
-											std::placeholders::_2
-											)
-										)
-									);
-
-								return;
+								ReadInspectedRequestPayload();
 							}
-							catch (std::exception& e)
-							{
-								std::string errMsg(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamConnect(const boost::system::error_code&) - Got error:\t");
-								errMsg.append(e.what());
-								ReportError(errMsg);
-							}							
+
+							return;
 						}
 
 						// Means that we need to start off by simply writing whatever we've got from the client to 
@@ -326,11 +373,14 @@ namespace te
 							writeBuffer, 
 							boost::asio::transfer_all(), 
 							m_upstreamStrand.wrap(
-								std::bind(
-									&TlsCapableHttpBridge::OnUpstreamWrite, 
-									shared_from_this(), 
-									std::placeholders::_1
-									)
+								network::MakeCustomAllocHandler(
+									m_requestPathHandlerMemory,
+									std::bind(
+										&TlsCapableHttpBridge::OnUpstreamWrite, 
+										shared_from_this(), 
+										std::placeholders::_1
+										)
+								)
 								)
 							);
 
@@ -358,6 +408,32 @@ namespace te
 					{						
 						SetStreamTimeout(boost::posix_time::minutes(5));
 
+						// Hosts on the bypass list are never intercepted. The client hello has only
+						// been peeked so far, so the client can handshake with the server itself.
+						if (m_verdictControl != nullptr && m_verdictControl->GetSnapshot()->IsBypassed(m_upstreamHost))
+						{
+							m_verdictControl->RecordBypassed();
+							StartTunnel();
+							return;
+						}
+
+						if (!TryBeginTlsInterception())
+						{
+							// Too many handshakes or spoofs in progress. Since the client hello has only
+							// been peeked so far, we're free to just get out of the way.
+							if (m_admissionControl->GetTunnelWhenOverloaded())
+							{
+								ReportInfo(u8"Admission control refused TLS interception. Starting tunnel.");
+								m_admissionControl->RecordTunnelled();
+								StartTunnel();
+								return;
+							}
+
+							m_admissionControl->RecordShed();
+							Kill();
+							return;
+						}
+
 						boost::system::error_code scerr;
 
 						m_upstreamSocket.set_verify_callback(
@@ -414,29 +490,14 @@ namespace te
 					{
 						SetStreamTimeout(boost::posix_time::minutes(5));
 
-						//auto ep = *endpointIterator;
-
 						// Perhaps client requested a port other than 80. We should have already parsed
 						// this before initiating the resolve of the upstream host, so that this information
 						// was not polluting the hostname during resolution.
 						//
 						// RFC2616 Section 14.23 demands that non-port-80 requests include the port in with
-						// the host name, so this should be reliable. If m_upstreamHostPort is zero, the 
-						// default value, then we leave the configured port alone, because we resolved this
-						// using "http" as the service parameter on the resolver. The service parameter consults
-						// something unknown to me (I vaguely remember the details) which has a list of port
-						// numbers associated with specific services. So by default, every iterator result
-						// here should be preconfigured to port 80.
-						if (m_upstreamHostPort != 0)
-						{
-							auto epClone = endpointIterator;
-							boost::asio::ip::tcp::resolver::iterator end;
-							while (epClone != end)
-							{
-								epClone->endpoint().port(m_upstreamHostPort);
-								++epClone;
-							}							
-						}
+						// the host name, so this should be reliable. If m_upstreamHostPort is not zero, it
+						// was given to the resolver as the service, so every endpoint here already has it.
+						// Otherwise the service was "http", and every endpoint has port 80.
 
 						// XXX TODO. The correct thing to do here is keep the iterator somehow, then in
 						// the completion handler, in the event of a connection related error, keep
@@ -584,35 +645,6 @@ namespace te
 
 					Kill();
 				}
-				
-				template<>
-				bool TlsCapableHttpBridge<network::TcpSocket>::VerifyServerCertificateCallback(bool preverified, boost::asio::ssl::verify_context& ctx)
-				{
-					// Do nothing.
-					return false;
-				}
-
-				template<>
-				bool TlsCapableHttpBridge<network::TlsSocket>::VerifyServerCertificateCallback(const bool preverified, boost::asio::ssl::verify_context& ctx)
-				{	
-
-					#ifndef NDEBUG
-					ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::VerifyServerCertificateCallback");
-					#endif // !NDEBUG
-
-					auto res = web::http::client::details::verify_cert_chain_platform_specific(ctx, m_upstreamHost);
-					if (res)
-					{
-						X509* curCert = X509_STORE_CTX_get_current_cert(ctx.native_handle());
-						m_upstreamCert = curCert;
-					}
-					else
-					{
-						m_upstreamCert = nullptr;
-					}
-
-					return res;
-				}
 
 			} /* namespace secure */
 		} /* namespace mitm */
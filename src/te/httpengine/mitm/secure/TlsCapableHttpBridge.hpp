@@ -12,6 +12,10 @@
 #include <boost/predef/compiler.h>
 #include <boost/algorithm/string.hpp>
 #include "../../network/SocketTypes.hpp"
+#include "../../network/HandlerAllocator.hpp"
+#include "../../network/FlowControl.hpp"
+#include "../../network/AdmissionControl.hpp"
+#include "../../network/VerdictControl.hpp"
 #include "BaseInMemoryCertificateStore.hpp"
 #include "../http/HttpRequest.hpp"
 #include "../http/HttpResponse.hpp"
@@ -23,6 +27,10 @@
 #include <memory>
 #include <atomic>
 #include <type_traits>
+#include <array>
+#include <deque>
+#include <functional>
+#include <thread>
 
 #if BOOST_OS_WINDOWS
 
@@ -48,7 +56,12 @@
 		#endif
 	#endif
 #else
-	// XXX TODO - Ensure we've got cpu_relax for other platforms.
+
+	#if BOOST_ARCH_X86
+		#define cpu_relax() asm volatile("pause" ::: "memory")
+	#else
+		#define cpu_relax() std::this_thread::yield()
+	#endif
 #endif	
 
 /*
@@ -151,6 +164,14 @@ namespace te
 				/// per-client/per-connection class context. So, rather than using the provided API,
 				/// we parse it manually according the spec.
 				/// 
+				/// Transactions are handled one at a time. Requests a client pipelines, sending
+				/// the next before it has the response to the last, are taken up in the order they
+				/// were sent, each from whatever of it was read along with the one before, and the
+				/// responses are matched to them in the same order. When pipeline coalescing is
+				/// enabled, pipelined requests that no callback would be asked about are written to
+				/// the server along with the request before them. See ::StartNextTransaction() and
+				/// ::CoalescePipelinedRequests(...).
+				/// 
 				/// Presently this class is tighly bound to the intended functionality of the
 				/// library: to provide filtering of requests and content based on Adblock Plus
 				/// formatted filters and CSS selectors.
@@ -212,6 +233,34 @@ namespace te
 					/// uses this for verifying server certificates. In this context, the "client"
 					/// is the proxy.
 					/// </param>
+					/// <param name="flowControl">
+					/// A pointer to the flow control shared by every bridge the acceptor creates.
+					/// Bounds the size of every streaming read this bridge issues, and requires that
+					/// those reads be reserved against a global in flight budget first. Optional.
+					/// If nullptr, streaming reads are bounded to the default per-bridge limit and
+					/// no global budget is enforced.
+					/// </param>
+					/// <param name="admissionControl">
+					/// A pointer to the admission control shared by every bridge the acceptor
+					/// creates. The acceptor takes a bridge slot on our behalf through ::TryAdmit()
+					/// and TLS bridges take handshake and spoof slots before they begin
+					/// handshaking. Optional. If nullptr, nothing is limited.
+					/// </param>
+					/// <param name="verdictControl">
+					/// A pointer to the verdict control shared by every bridge the acceptor creates.
+					/// Holds the asynchronous form of the message callbacks, if any were supplied,
+					/// and the registry of bridges waiting on a pending verdict. Optional. If
+					/// nullptr, or if no asynchronous callbacks were supplied, verdicts are always
+					/// reached synchronously.
+					/// </param>
+					/// <param name="onMessageBeginView">
+					/// The view form of onMessageBegin. Optional. If supplied, this and
+					/// onMessageEndView are called instead of onMessageBegin and onMessageEnd, and
+					/// the headers are never formatted into strings.
+					/// </param>
+					/// <param name="onMessageEndView">
+					/// The view form of onMessageEnd. Optional. See onMessageBeginView.
+					/// </param>
 					/// <param name="onInfoCb">
 					/// A callback to receive generated information about general events. Data that
 					/// may be sent through this callback, if provided, is simply "verbose" output
@@ -242,8 +291,13 @@ namespace te
 						BaseInMemoryCertificateStore* certStore = nullptr,
 						boost::asio::ssl::context* defaultServerContext = nullptr,
 						boost::asio::ssl::context* clientContext = nullptr,
+						network::FlowControl* flowControl = nullptr,
+						network::AdmissionControl* admissionControl = nullptr,
+						network::VerdictControl* verdictControl = nullptr,
 						util::cb::HttpMessageBeginCheckFunction onMessageBegin = nullptr,
 						util::cb::HttpMessageEndCheckFunction onMessageEnd = nullptr,
+						util::cb::HttpMessageBeginViewFunction onMessageBeginView = nullptr,
+						util::cb::HttpMessageEndViewFunction onMessageEndView = nullptr,
 						util::cb::MessageFunction onInfoCb = nullptr,
 						util::cb::MessageFunction onWarnCb = nullptr,
 						util::cb::MessageFunction onErrorCb = nullptr
@@ -257,11 +311,24 @@ namespace te
 					TlsCapableHttpBridge& operator=(const TlsCapableHttpBridge&) = delete;
 
 					/// <summary>
-					/// Default destructor.
+					/// Default destructor. Anything still reserved against the flow control at
+					/// this point was read, or about to be read, but never made it to the other
+					/// side. It's handed back here so that other bridges can have it. The same
+					/// goes for any slots we hold against the admission control.
 					/// </summary>
 					~TlsCapableHttpBridge()
 					{
+						ReleaseInFlightBytes(m_requestPathInFlightBytes);
+						ReleaseInFlightBytes(m_responsePathInFlightBytes);
+
+						ReleaseHandshakeSlot();
+						ReleaseSpoofSlot();
 
+						if (m_holdsBridgeSlot)
+						{
+							m_admissionControl->ReleaseBridge();
+							m_holdsBridgeSlot = false;
+						}
 					}
 
 				private:
@@ -274,6 +341,20 @@ namespace te
 					/// </summary>
 					std::unique_ptr<http::HttpRequest> m_request = nullptr;
 
+					/// <summary>
+					/// Set when m_request has already parsed everything that was read into it, so
+					/// that ::OnDownstreamHeaders(...) carries on without parsing it a second time.
+					/// See PreviewParser.
+					/// </summary>
+					bool m_requestAlreadyParsed = false;
+
+					/// <summary>
+					/// Set when the client sent Expect: 100-continue, and is presumably holding its
+					/// request payload back until it gets 100 Continue from us. See
+					/// ::SendContinueIfOwed().
+					/// </summary>
+					bool m_continueOwed = false;
+
 					/// <summary>
 					/// HTTP response object which is read from the upstream host and written to the
 					/// downstream client.
@@ -294,13 +375,13 @@ namespace te
 					/// For ensuring that asynchronous operation callback handlers involving the
 					/// upstream server connection are not concurrently executed.
 					/// </summary>
-					boost::asio::strand m_upstreamStrand;
+					boost::asio::io_service::strand m_upstreamStrand;
 
 					/// <summary>
 					/// For ensuring that asynchronous operation callback handlers involving the
 					/// downstream client connection are not concurrently executed.
 					/// </summary>
-					boost::asio::strand m_downstreamStrand;
+					boost::asio::io_service::strand m_downstreamStrand;
 
 					/// <summary>
 					/// Used for resolving the target upstream server after it has been discovered
@@ -318,6 +399,297 @@ namespace te
 					/// </summary>
 					boost::asio::deadline_timer m_streamTimer;					
 
+					/// <summary>
+					/// Recycled memory for the handlers of operations that move data from the
+					/// client to the server, meaning reads from the downstream socket and writes to
+					/// the upstream socket. Since we never have more than one such operation
+					/// pending at a time, a single block serves every hop in this direction for the
+					/// life of the bridge, rather than having asio hit the heap on every read and
+					/// write. See network::HandlerMemory.
+					/// </summary>
+					network::HandlerMemory m_requestPathHandlerMemory;
+
+					/// <summary>
+					/// Recycled memory for the handlers of operations that move data from the
+					/// server to the client, meaning reads from the upstream socket and writes to
+					/// the downstream socket. Kept separate from the request path block, because
+					/// during a passthrough volley both directions are in flight at once.
+					/// </summary>
+					network::HandlerMemory m_responsePathHandlerMemory;
+
+					/// <summary>
+					/// Fallback for resuming streaming reads from the client, after having been
+					/// refused a reservation by the flow control. See ::PauseRead(...).
+					/// </summary>
+					boost::asio::deadline_timer m_requestPathPauseTimer;
+
+					/// <summary>
+					/// Fallback for resuming streaming reads from the server, after having been
+					/// refused a reservation by the flow control. See ::PauseRead(...).
+					/// </summary>
+					boost::asio::deadline_timer m_responsePathPauseTimer;
+
+					/// <summary>
+					/// Set while reading from the client is paused by the flow control, and
+					/// cleared by whichever resumes it first. Atomic since the flow control checks
+					/// it from whatever thread released the bytes.
+					/// </summary>
+					std::atomic<bool> m_requestPathPaused{ false };
+
+					/// <summary>
+					/// Set while reading from the server is paused by the flow control, and
+					/// cleared by whichever resumes it first.
+					/// </summary>
+					std::atomic<bool> m_responsePathPaused{ false };
+
+					/// <summary>
+					/// The read from the client to retry once resumed. Only touched on the
+					/// downstream strand.
+					/// </summary>
+					std::function<void()> m_requestPathRetry;
+
+					/// <summary>
+					/// The read from the server to retry once resumed. Only touched on the
+					/// upstream strand.
+					/// </summary>
+					std::function<void()> m_responsePathRetry;
+
+					/// <summary>
+					/// Pointer to the flow control shared by all bridges created by our acceptor.
+					/// May be nullptr, in which case reads are bounded to the default per-bridge
+					/// limit and nothing is reserved. See network::FlowControl.
+					/// </summary>
+					network::FlowControl* m_flowControl;
+
+					/// <summary>
+					/// The number of bytes this bridge presently holds reserved against the flow
+					/// control, in both directions combined. This is what the per-bridge limit is
+					/// checked against. Atomic since each direction reserves from its own strand.
+					/// </summary>
+					std::atomic<uint32_t> m_inFlightBytes{ 0 };
+
+					/// <summary>
+					/// The share of m_inFlightBytes held for data moving from the client to the
+					/// server. Reserved before a streaming read from the client, released once the
+					/// data has been written to the server.
+					/// </summary>
+					uint32_t m_requestPathInFlightBytes = 0;
+
+					/// <summary>
+					/// The share of m_inFlightBytes held for data moving from the server to the
+					/// client. Reserved before a streaming read from the server, released once the
+					/// data has been written to the client.
+					/// </summary>
+					uint32_t m_responsePathInFlightBytes = 0;
+
+					/// <summary>
+					/// Pointer to the admission control shared by all bridges created by our
+					/// acceptor. May be nullptr, in which case nothing is limited. See
+					/// network::AdmissionControl.
+					/// </summary>
+					network::AdmissionControl* m_admissionControl;
+
+					/// <summary>
+					/// Whether or not this bridge holds one of the admission control's bridge
+					/// slots, which is taken by the acceptor through ::TryAdmit().
+					/// </summary>
+					bool m_holdsBridgeSlot = false;
+
+					/// <summary>
+					/// Whether or not this bridge holds one of the admission control's handshake
+					/// slots. Taken before the upstream handshake begins, released once the
+					/// downstream handshake has completed. Only ever touched from handlers that
+					/// have been sequenced one after the other.
+					/// </summary>
+					bool m_holdsHandshakeSlot = false;
+
+					/// <summary>
+					/// Whether or not this bridge holds one of the admission control's spoof
+					/// slots. Taken before the upstream handshake begins, released once the
+					/// certificate store has handed back a server context.
+					/// </summary>
+					bool m_holdsSpoofSlot = false;
+
+					/// <summary>
+					/// Pointer to the verdict control shared by all bridges created by our
+					/// acceptor. May be nullptr, in which case verdicts are always reached
+					/// synchronously. See network::VerdictControl.
+					/// </summary>
+					network::VerdictControl* m_verdictControl;
+
+					/// <summary>
+					/// The points in a transaction where we ask for a verdict, and so the points we
+					/// may have to resume from after waiting on one.
+					/// </summary>
+					enum class VerdictStage
+					{
+						RequestHeaders,
+						ResponseHeaders,
+						ResponsePayload
+					};
+
+					/// <summary>
+					/// What became of a request for a verdict.
+					/// </summary>
+					enum class VerdictOutcome
+					{
+						Allow,
+						Block,
+						Pending
+					};
+
+					/// <summary>
+					/// Bounds how long we wait on a pending verdict before applying the default.
+					/// </summary>
+					boost::asio::deadline_timer m_verdictTimer;
+
+					/// <summary>
+					/// The token we're parked under while waiting on a verdict, zero otherwise. Read
+					/// by ::Kill(), which may be called from either strand, hence atomic.
+					/// </summary>
+					std::atomic<uint64_t> m_verdictToken{ 0 };
+
+					/// <summary>
+					/// Where to resume once the pending verdict arrives.
+					/// </summary>
+					VerdictStage m_verdictStage = VerdictStage::RequestHeaders;
+
+					/// <summary>
+					/// Whether or not the peer had closed the connection when we parked.
+					/// </summary>
+					bool m_verdictCloseAfter = false;
+
+					/// <summary>
+					/// Whether the pending verdict is for the message end callback, rather than the
+					/// message begin callback.
+					/// </summary>
+					bool m_verdictIsMessageEnd = false;
+
+					/// <summary>
+					/// The inspection policy that decided how much of the current response to hold
+					/// for inspection, if any. Held so that the bytes can be attributed to the entry
+					/// that decided, even if the policy is replaced meanwhile.
+					/// </summary>
+					std::shared_ptr<const filtering::InspectionPolicy> m_responsePolicy;
+
+					/// <summary>
+					/// The policy entry that decided for the current response.
+					/// </summary>
+					uint32_t m_responsePolicyEntry = 0;
+
+					/// <summary>
+					/// When non-zero, the current response is inspected once this many bytes of its
+					/// payload have been buffered, rather than once it's complete, after which the
+					/// rest of it is streamed. Set either by the message begin callback, through its
+					/// responseSampleBytes argument, or by the inspection policy.
+					/// </summary>
+					uint32_t m_responseSampleBytes = 0;
+
+					/// <summary>
+					/// Whether the message end verdict being sought is to be cached by the content
+					/// of the response body, once reached. See network::ContentVerdictCache.
+					/// </summary>
+					bool m_contentVerdictPending = false;
+
+					/// <summary>
+					/// The Accept-Encoding the client sent with the current request, before it was
+					/// replaced with the one we send upstream. Empty if it sent none. Decides how an
+					/// inspected response is encoded on its way back, see ::WriteResponse().
+					/// </summary>
+					std::string m_clientAcceptEncoding;
+
+					/// <summary>
+					/// The stored response the current request was sent upstream to revalidate, if
+					/// any. See ::TryServeFromCache().
+					/// </summary>
+					std::shared_ptr<const http::ResponseCache::Entry> m_cacheRevalidating;
+
+					/// <summary>
+					/// The status line and headers of the stored response being written to the
+					/// client. See ::ServeCachedResponse(...).
+					/// </summary>
+					std::string m_cachedResponseHead;
+
+					/// <summary>
+					/// The payload of the stored response being written to the client, shared with
+					/// the cache.
+					/// </summary>
+					std::shared_ptr<const std::vector<char>> m_cachedResponseBody;
+
+					/// <summary>
+					/// What's to be written to the client in place of the transaction, once it has
+					/// been blocked. Shared with whatever else holds it, be it a registered block
+					/// page, a verdict cache or the canned 204. See ::SetBlockResponse(...).
+					/// </summary>
+					std::shared_ptr<const std::vector<char>> m_blockResponse;
+
+					/// <summary>
+					/// A pipelined request that was written to the server along with the one before
+					/// it, waiting for its turn. See ::CoalescePipelinedRequests(...).
+					/// </summary>
+					struct ForwardedRequest
+					{
+						std::unique_ptr<http::HttpRequest> request;
+
+						/// <summary>
+						/// What m_clientAcceptEncoding is to be once this is the current request.
+						/// </summary>
+						std::string clientAcceptEncoding;
+					};
+
+					/// <summary>
+					/// A verdict on a request that was reached without asking the consumer. See
+					/// ::FindStandingVerdict(...).
+					/// </summary>
+					struct StandingVerdict
+					{
+						/// <summary>
+						/// The nextAction to apply. 3 for a bypassed host, 2 for a request the
+						/// blocklist or the native rules block.
+						/// </summary>
+						uint32_t nextAction = 0;
+
+						/// <summary>
+						/// The custom block response cached along with the verdict, if any.
+						/// </summary>
+						std::shared_ptr<const std::vector<char>> customResponse;
+
+						/// <summary>
+						/// Whether the verdict came from the bypass list, before anything else was
+						/// checked.
+						/// </summary>
+						bool bypassed = false;
+
+						/// <summary>
+						/// What the native rules made of the request, unless bypassed.
+						/// </summary>
+						filtering::RuleMatcher::Verdict ruleVerdict = filtering::RuleMatcher::Verdict::NoMatch;
+					};
+
+					/// <summary>
+					/// Pipelined requests that were written to the server along with m_request,
+					/// oldest first. Their responses follow the response to m_request in the same
+					/// order, so each becomes the current request in turn, as the response before
+					/// it is finished. See ::StartNextTransaction().
+					/// </summary>
+					std::deque<ForwardedRequest> m_forwardedRequests;
+
+					/// <summary>
+					/// The most pipelined requests written to the server along with the one before
+					/// them.
+					/// </summary>
+					static constexpr size_t MaxCoalescedRequests = 8;
+
+					/// <summary>
+					/// The hash of the response body the pending verdict is to be cached under.
+					/// </summary>
+					uint64_t m_contentVerdictHash = 0;
+
+					/// <summary>
+					/// The length of the response body the pending verdict is to be cached under.
+					/// </summary>
+					uint64_t m_contentVerdictLength = 0;
+
 					/// <summary>
 					/// Pointer to the in memory certificate store that is required for TLS
 					/// connections, to fetch and or generate certificates and corresponding server
@@ -328,6 +700,9 @@ namespace te
 					util::cb::HttpMessageBeginCheckFunction m_onMessageBegin;
 					util::cb::HttpMessageEndCheckFunction m_onMessageEnd;
 
+					util::cb::HttpMessageBeginViewFunction m_onMessageBeginView;
+					util::cb::HttpMessageEndViewFunction m_onMessageEndView;
+
 					/// <summary>
 					/// Member that is to be set whenever the upstream certificate verification
 					/// callback method is invoked. This member is held, then used to request the in
@@ -413,21 +788,6 @@ namespace te
 					/// </summary>
 					static std::atomic_flag s_clientContextLock;
 
-                    /// <summary>
-                    /// The multiplier that determines the total number of stream channels that can be used concurrently. The
-                    /// actual number of channels will be 1000 * s_streamChannelMultiplier.
-                    /// At this value, 20K channels will be created. 10K for the TLS template, 10K for the non-TLS.
-                    /// Due to implementation constraints, this means that we are guaranteed to have 7294 channels
-                    /// between the oldest acquired and newest acquired channels.
-                    /// </summary>
-                    static constexpr size_t s_streamChannelMultiplier = 10;
-
-                    /// <summary>
-                    /// This holds a global set of stream channels that enable library users to stream blocked data
-                    /// back into responses rather than pinning pointers and passing them around.
-                    /// </summary>
-                    static util::cb::CStreamCopyUtilContainer<std::is_same<BridgeSocketType, network::TlsSocket>::value, s_streamChannelMultiplier> s_streamCopyContainer;
-
 					/// <summary>
 					/// Called once we discover the SNI hostname for a TLS connection. This will
 					/// either retrieve an existing context, or create and retrieve a context,
@@ -498,19 +858,41 @@ namespace te
 					/// </summary>
 					void Start();
 
+					/// <summary>
+					/// Attempts to take a bridge slot from the admission control. Called by the
+					/// acceptor once a client has been accepted and before ::Start() is called. If
+					/// this returns false, the acceptor is expected to drop the client and never
+					/// start the bridge. The slot is released when the bridge is destroyed.
+					/// </summary>
+					/// <returns>
+					/// True if the bridge was admitted or there is no admission control, false if
+					/// the bridge limit has been reached.
+					/// </returns>
+					const bool TryAdmit()
+					{
+						if (m_admissionControl == nullptr)
+						{
+							return true;
+						}
+
+						m_holdsBridgeSlot = m_admissionControl->TryAdmitBridge();
+						return m_holdsBridgeSlot;
+					}
+
 				private:
 
+					/// <summary>
+					/// Works out, from the first bytes a client sends, whether it's speaking HTTP,
+					/// and if so, which host it's after. This is done by parsing those bytes into
+					/// the request that will go on to carry them, rather than into a throwaway
+					/// parser, so that when they turn out to be HTTP, which they almost always do,
+					/// the request's headers have already been parsed exactly once and
+					/// ::OnDownstreamHeaders(...) carries on from there without parsing them again.
+					/// </summary>
 					class PreviewParser
 					{
 						private:
 
-							struct HeaderCbData
-							{
-								std::unordered_map<std::string, std::string> headers;
-								std::string lastHeaderName;
-								bool headersComplete;
-							};
-
 							bool m_headersComplete = false;
 
 						public:
@@ -530,138 +912,27 @@ namespace te
 
 							std::string errorMessage;
 
-							const ParseResult Parse(const char* data, const size_t dataLength, std::string& outHost)
+							const ParseResult Parse(http::HttpRequest& request, const size_t dataLength, std::string& outHost)
 							{
 
-								if (!data || dataLength == 0)
-								{
-									return ParseResult::Failure;
-								}
-
-								auto onBody = [](http_parser* parser, const char *at, size_t length)->int
-								{
-									return 0;
-								};
-
-								auto onChunkComplete = [](http_parser* parser)->int
-								{
-									return 0;
-								};
-
-								auto onChunkHeader = [](http_parser* parser)->int
-								{
-									return 0;
-								};
-
-								auto onHeadersComplete = [](http_parser* parser)->int
-								{
-									if (parser == nullptr)
-									{
-										// Failure. Somehow.
-										return -1;
-									}
-
-									auto* data = static_cast<HeaderCbData*>(parser->data);
-									if (data != nullptr)
-									{
-										data->headersComplete = true;
-										return 0;
-									}
-
-									return -1;
-								};
-
-								auto onHeaderField = [](http_parser* parser, const char *at, size_t length)->int
-								{
-									if (parser == nullptr || at == nullptr || parser->data == nullptr)
-									{
-										// Failure. Somehow.
-										return -1;
-									}
-
-									auto* data = static_cast<HeaderCbData*>(parser->data);
-									if (data != nullptr)
-									{
-										data->lastHeaderName = std::string(at, length);
-										return 0;
-									}
-
-									return -1;
-								};
-
-								auto onHeaderValue = [](http_parser* parser, const char *at, size_t length)->int
-								{
-									if (parser == nullptr || at == nullptr || parser->data == nullptr)
-									{
-										// Failure. Somehow.
-										return -1;
-									}
-
-									auto* data = static_cast<HeaderCbData*>(parser->data);
-									if (data != nullptr)
-									{
-										data->headers[data->lastHeaderName] = std::string(at, length);
-										return 0;
-									}
-
-									return -1;
-								};
-
-								auto onUrl = [](http_parser* parser, const char *at, size_t length)->int
-								{
-									return 0;
-								};
-
-								auto onMessageBegin = [](http_parser* parser)->int
-								{
-									return 0;
-								};
-
-								auto onMessageComplete = [](http_parser* parser)->int
-								{
-									return 0;
-								};
-
-								http_parser_settings parserSettings;
-
-								parserSettings.on_body = onBody;
-								parserSettings.on_chunk_complete = onChunkComplete;
-								parserSettings.on_chunk_header = onChunkHeader;
-								parserSettings.on_headers_complete = onHeadersComplete;
-								parserSettings.on_header_field = onHeaderField;
-								parserSettings.on_header_value = onHeaderValue;
-								parserSettings.on_message_begin = onMessageBegin;
-								parserSettings.on_message_complete = onMessageComplete;
-								parserSettings.on_status = onUrl;
-								parserSettings.on_url = onUrl;
-
-								http_parser* parser;
-								parser = static_cast<http_parser*>(malloc(sizeof(http_parser)));
-
-								if (!parser)
+								if (dataLength == 0)
 								{
 									return ParseResult::Failure;
 								}
 
-								http_parser_init(parser, HTTP_REQUEST);
-
-								HeaderCbData parserData;
-								parser->data = &parserData;
-
-								auto nparsed = http_parser_execute(parser, &parserSettings, data, dataLength);
+								const bool parsed = request.Parse(dataLength, false);
 
 								// Set the host before we leave.
-								auto host = parserData.headers.find(util::http::headers::Host);
-								if (host != parserData.headers.end())
+								auto host = request.GetHeader(util::http::headers::Host);
+								if (host.first != host.second)
 								{
-									outHost = host->second;
+									outHost = host.first->second;
 								}
 
-								m_headersComplete = parserData.headersComplete;
+								m_headersComplete = request.HeadersComplete();
 
-								if (parser->upgrade == 1)
+								if (request.IsUpgradeRequested())
 								{
-									free(parser);
 									if (outHost.size() == 0)
 									{
 										// Most definitely should not be empty.
@@ -671,26 +942,30 @@ namespace te
 									return ParseResult::HttpWithUpgrade;
 								}
 
-								if (parser->http_errno != 0)
-								{	
+								if (!parsed)
+								{
+									const auto parseError = request.GetParseError();
+
 									errorMessage = std::string(u8"In ParseResult::Parse(...) -Got http_parser error: ");
-									errorMessage.append(http_errno_description(HTTP_PARSER_ERRNO(parser)));									
-									
-									if (parser->http_errno == HPE_INVALID_METHOD || parser->http_errno == HPE_UNKNOWN)
+									errorMessage.append(http_errno_description(parseError));
+
+									if (parseError == HPE_INVALID_METHOD || parseError == HPE_UNKNOWN)
 									{
-										free(parser);
 										return ParseResult::NotHttp;
 									}
+
+									// Anything else is HTTP that we can't make sense of, which the
+									// request would have been killed for as soon as it was parsed
+									// anyway.
+									return ParseResult::Failure;
 								}
 
 								if (outHost.size() == 0)
 								{
-									free(parser);
 									// Most definitely should not be empty.
 									return ParseResult::Failure;
 								}
 
-								free(parser);
 								return ParseResult::IsHttp;
 							}							
 					};
@@ -747,6 +1022,26 @@ namespace te
 							// Force cancel any async waiting of the timer.
 							SetInfiniteStreamTimeout();
 
+							// Same for any read that's been paused by flow control. Clearing the flags
+							// keeps the flow control from resuming us, should we still be queued.
+							m_requestPathPaused.store(false);
+							m_responsePathPaused.store(false);
+
+							boost::system::error_code pauseTimerCancelErr;
+							m_requestPathPauseTimer.cancel(pauseTimerCancelErr);
+							m_responsePathPauseTimer.cancel(pauseTimerCancelErr);
+
+							// If we're parked on a verdict, the verdict control holds a reference to
+							// us until the verdict arrives, which might be never.
+							const uint64_t verdictToken = m_verdictToken.exchange(0);
+							if (verdictToken != 0 && m_verdictControl != nullptr)
+							{
+								m_verdictControl->Withdraw(verdictToken);
+							}
+
+							boost::system::error_code verdictTimerCancelErr;
+							m_verdictTimer.cancel(verdictTimerCancelErr);
+
 							if (downstreamShutdownErr)
 							{
 								/*
@@ -905,10 +1200,10 @@ namespace te
 						// EOF doesn't necessarily mean something critical happened. Could simply be
 						// that we got the entire valid response, and the server closed the connection
 						// after.
-						if ((!error || (error == boost::asio::error::eof || (error.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(error.value()) == SSL_R_SHORT_READ))))
+						if (!error || error == boost::asio::error::eof || error == boost::asio::ssl::error::stream_truncated)
 						{
-							bool closeAfter = (error == boost::asio::error::eof) || ((error.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(error.value()) == SSL_R_SHORT_READ));
-							bool wasSslShortRead = ((error.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(error.value()) == SSL_R_SHORT_READ));
+							bool closeAfter = (error == boost::asio::error::eof) || (error == boost::asio::ssl::error::stream_truncated);
+							bool wasSslShortRead = (error == boost::asio::ssl::error::stream_truncated);
 
 							if (closeAfter && !wasSslShortRead && bytesTransferred <= 0)
 							{
@@ -946,11 +1241,14 @@ namespace te
 										m_response->GetReadBuffer(),
 										boost::asio::transfer_at_least(1),
 										m_upstreamStrand.wrap(
-											std::bind(
-												&TlsCapableHttpBridge::OnUpstreamHeaders,
-												shared_from_this(),
-												std::placeholders::_1,
-												std::placeholders::_2
+											network::MakeCustomAllocHandler(
+												m_responsePathHandlerMemory,
+												std::bind(
+													&TlsCapableHttpBridge::OnUpstreamHeaders,
+													this->shared_from_this(),
+													std::placeholders::_1,
+													std::placeholders::_2
+												)
 											)
 										)
 									);
@@ -958,134 +1256,66 @@ namespace te
 									return;
 								}
 
-								// We only bother to check if the response should be blocked
-								// if the request has not been whitelisted.
-								if (m_request->GetShouldBlock() > -1)
+								// Interim responses aren't the answer to the request, they just precede
+								// it. They're passed along as-is, without being put before any filter,
+								// and then we go back to waiting for the real thing. Should the final
+								// response have been read along with the interim one, it's picked up
+								// from there, see ::StartNextResponse().
+								if (m_response->IsInterim())
+								{
+									RelayInterimResponse();
+									return;
+								}
+
+								// If we asked the server to revalidate a stored response, and it's
+								// still good, the client gets the stored response.
+								if (m_cacheRevalidating)
 								{
-									auto shouldBlockResponse = ShouldBlockTransaction(m_request.get(), m_response.get());
+									auto revalidated = std::move(m_cacheRevalidating);
 
-									if (shouldBlockResponse)
+									if (m_response->StatusCode() == 304 && m_verdictControl != nullptr)
 									{
-										m_request->SetShouldBlock(1);
-										auto responseBuffer = m_request->GetWriteBuffer();
+										auto refreshed = m_verdictControl->GetResponseCache().Refresh(revalidated, *m_response);
 
-										boost::asio::async_write(
-											m_downstreamSocket,
-											responseBuffer,
-											boost::asio::transfer_all(),
-											m_downstreamStrand.wrap(
-												std::bind(
-													&TlsCapableHttpBridge::OnDownstreamWrite,
-													shared_from_this(),
-													std::placeholders::_1
-												)
-											)
-										);
+										bool keepAlive = m_request->GetHttpVersion() != http::HttpProtocolVersion::HTTP1;
 
+										auto connectionHeader = m_response->GetHeader(util::http::headers::Connection);
+
+										for (auto it = connectionHeader.first; it != connectionHeader.second; ++it)
+										{
+											if (boost::iequals(boost::trim_copy(it->second), u8"close"))
+											{
+												keepAlive = false;
+											}
+										}
+
+										m_keepAlive = keepAlive && !closeAfter;
+
+										ServeCachedResponse(*refreshed);
 										return;
 									}
 								}
 
-								// We want to remove any header that has to do with Google's SDHC
-								// compression method. We don't want it, because we don't support it
-								// so we'd have no way to handle content compressed with this method.
-								m_response->RemoveHeader(util::http::headers::GetDictionary);
-
-								// Ensure that nobody is advertising for QUIC support.
-								m_response->RemoveHeader(util::http::headers::AlternateProtocol);
-
-								// Sigh, also remove declaration of any alternative protocol
-								m_response->RemoveHeader(util::http::headers::AltSvc);
-
-								// Firefox developers are bunch of double talking liars, and claim that you
-								// can disable public key pinning. However, for their buddies who must
-								// pay them off or something, this isn't true. It's enforced no matter
-								// what do you. So what's the solution? We strip the headers from
-								// the client altogether.
-								m_response->RemoveHeader(util::http::headers::PublicKeyPins);
-								m_response->RemoveHeader(util::http::headers::PublicKeyPinsReportOnly);
-
-								// Set m_keepAlive to what the server has specified. The client may have requested it, but
-								// ultimately it's up to the server how it's going to serve us.
-								auto connectionHeader = m_response->GetHeader(util::http::headers::Connection);
-
-								bool keepAlive = false;
-
-								if (m_request->GetHttpVersion() != http::HttpProtocolVersion::HTTP1)
+								// We only bother to check if the response should be blocked
+								// if the request has not been whitelisted.
+								if (m_request->GetShouldBlock() > -1)
 								{
-									keepAlive = true;
-								}								
+									auto verdict = GetVerdict(m_request.get(), m_response.get(), VerdictStage::ResponseHeaders, closeAfter);
 
-								while (connectionHeader.first != connectionHeader.second)
-								{
-									if (connectionHeader.first->second.compare(u8"close") == 0)
+									if (verdict == VerdictOutcome::Pending)
 									{
-										keepAlive = false;										
+										return;
 									}
-									++connectionHeader.first;
-								}
-
-								m_keepAlive = keepAlive;								
 
-								if (!closeAfter && m_response->IsPayloadComplete() == false && m_response->GetConsumeAllBeforeSending() == true)
-								{
-									// We need to reinitiate sequential reads of the response
-									// payload until we have all of the response body, as it has
-									// been marked for inspection.
-
-									// We do this in a try/catch because getting the read buffer for the payload
-									// can throw if the maximum payload size has been reached. This is defined as
-									// a constexpr in BaseHttpTransaction. 
-									try
+									if (verdict == VerdictOutcome::Block)
 									{
-										auto readBuffer = m_response->GetReadBuffer();
-
-										SetStreamTimeout(boost::posix_time::minutes(5));
-
-										boost::asio::async_read(
-											m_upstreamSocket,
-											readBuffer,
-											boost::asio::transfer_at_least(1),
-											m_upstreamStrand.wrap(
-												std::bind(
-													&TlsCapableHttpBridge::OnUpstreamRead,
-													shared_from_this(),
-													std::placeholders::_1,
-													std::placeholders::_2
-													)
-												)
-											);
-
+										WriteBlockResponse(true);
 										return;
 									}
-									catch (std::exception& e)
-									{
-										ReportError(e.what());
-									}									
 								}
-								else
-								{
-									// We need to write what we have to the client.
-
-									SetStreamTimeout(boost::posix_time::minutes(5));
-
-									auto writeBuffer = m_response->GetWriteBuffer();
-
-									boost::asio::async_write(
-										m_downstreamSocket,
-										writeBuffer,
-										boost::asio::transfer_all(),
-										m_downstreamStrand.wrap(
-											std::bind(
-												&TlsCapableHttpBridge::OnDownstreamWrite,
-												shared_from_this(),
-												std::placeholders::_1
-												)
-											)
-										);
 
-									return;
-								}								
+								ContinueUpstreamHeaders(closeAfter);
+								return;
 							}
 							else
 							{
@@ -1103,6 +1333,190 @@ namespace te
 						Kill();
 					}
 
+					/// <summary>
+					/// Writes the interim response that was just read from the server to the client,
+					/// then resumes reading the response headers of the final response. HTTP/1.0
+					/// clients don't understand interim responses, so for them, the interim response
+					/// is discarded, per RFC 7231 section 6.2.
+					/// </summary>
+					void RelayInterimResponse()
+					{
+						if (m_request->GetHttpVersion() == http::HttpProtocolVersion::HTTP1)
+						{
+							OnInterimResponseWritten(boost::system::error_code());
+							return;
+						}
+
+						SetStreamTimeout(boost::posix_time::minutes(5));
+
+						auto writeBuffer = m_response->GetWriteBuffer();
+
+						boost::asio::async_write(
+							m_downstreamSocket,
+							writeBuffer,
+							boost::asio::transfer_all(),
+							m_downstreamStrand.wrap(
+								network::MakeCustomAllocHandler(
+									m_responsePathHandlerMemory,
+									std::bind(
+										&TlsCapableHttpBridge::OnInterimResponseWritten,
+										this->shared_from_this(),
+										std::placeholders::_1
+									)
+								)
+							)
+						);
+					}
+
+					/// <summary>
+					/// Completion handler for when an interim response has been written to the
+					/// client. Starts a fresh response object for the final response, and reads its
+					/// headers from the server.
+					/// 
+					/// In the event that this operation was a failure, meaning that the supplied
+					/// error parameter was set, the bridge will be terminated.
+					/// </summary>
+					/// <param name="error">
+					/// Error code that will indicate if any errors were handled during the async
+					/// operation, providing details if an error did occur and was handled.
+					/// </param>
+					void OnInterimResponseWritten(const boost::system::error_code& error)
+					{
+
+						#ifndef NDEBUG
+						ReportInfo(u8"TlsCapableHttpBridge::OnInterimResponseWritten");
+						#endif // !NDEBUG
+
+						if (m_shouldTerminate && m_response->GetPipelinedData().empty())
+						{
+							// The server closed the connection after the interim response, so
+							// there's no final response coming.
+							Kill();
+							return;
+						}
+
+						if (!error)
+						{
+							StartNextResponse();
+							return;
+						}
+						else
+						{
+							std::string errMsg(u8"In TlsCapableHttpBridge::OnInterimResponseWritten(const boost::system::error_code&) - Got error:\t");
+							errMsg.append(error.message());
+							ReportError(errMsg);
+						}
+
+						Kill();
+					}
+
+					/// <summary>
+					/// Picks up where ::OnUpstreamHeaders(...) leaves off once the response headers
+					/// have been checked and were not blocked. Strips the headers we don't want the
+					/// client to see, then either continues reading a response payload that has been
+					/// flagged for inspection, or writes what we have to the client. Split out so
+					/// that ::OnVerdict(...) can resume here after waiting on a pending verdict.
+					/// </summary>
+					/// <param name="closeAfter">
+					/// Whether or not the server closed the connection after the data we have.
+					/// </param>
+					void ContinueUpstreamHeaders(const bool closeAfter)
+					{
+						// We want to remove any header that has to do with Google's SDHC
+						// compression method. We don't want it, because we don't support it
+						// so we'd have no way to handle content compressed with this method.
+						m_response->RemoveHeader(util::http::headers::GetDictionary);
+
+						// Ensure that nobody is advertising for QUIC support.
+						m_response->RemoveHeader(util::http::headers::AlternateProtocol);
+
+						// Sigh, also remove declaration of any alternative protocol
+						m_response->RemoveHeader(util::http::headers::AltSvc);
+
+						// Firefox developers are bunch of double talking liars, and claim that you
+						// can disable public key pinning. However, for their buddies who must
+						// pay them off or something, this isn't true. It's enforced no matter
+						// what do you. So what's the solution? We strip the headers from
+						// the client altogether.
+						m_response->RemoveHeader(util::http::headers::PublicKeyPins);
+						m_response->RemoveHeader(util::http::headers::PublicKeyPinsReportOnly);
+
+						// Set m_keepAlive to what the server has specified. The client may have requested it, but
+						// ultimately it's up to the server how it's going to serve us.
+						bool keepAlive = false;
+
+						if (m_request->GetHttpVersion() != http::HttpProtocolVersion::HTTP1)
+						{
+							keepAlive = true;
+						}								
+
+						if (IsCloseRequested(*m_response))
+						{
+							keepAlive = false;
+						}
+
+						m_keepAlive = keepAlive;								
+
+						ApplyInspectionPolicy();
+
+						if (!closeAfter && m_response->IsPayloadComplete() == false && m_response->GetConsumeAllBeforeSending() == true)
+						{
+							// We need to reinitiate sequential reads of the response
+							// payload until we have all of the response body, as it has
+							// been marked for inspection.
+
+							// We do this in a try/catch because getting the read buffer for the payload
+							// can throw if the maximum payload size has been reached. This is defined as
+							// a constexpr in BaseHttpTransaction. 
+							try
+							{
+								auto readBuffer = m_response->GetReadBuffer();
+
+								SetStreamTimeout(boost::posix_time::minutes(5));
+
+								boost::asio::async_read(
+									m_upstreamSocket,
+									readBuffer,
+									boost::asio::transfer_at_least(1),
+									m_upstreamStrand.wrap(
+										network::MakeCustomAllocHandler(
+											m_responsePathHandlerMemory,
+											std::bind(
+												&TlsCapableHttpBridge::OnUpstreamRead,
+												this->shared_from_this(),
+												std::placeholders::_1,
+												std::placeholders::_2
+												)
+										)
+										)
+									);
+
+								return;
+							}
+							catch (std::exception& e)
+							{
+								ReportError(e.what());
+							}									
+						}
+						else
+						{
+							// We need to write what we have to the client.
+
+							SetStreamTimeout(boost::posix_time::minutes(5));
+
+							if (m_responsePolicy)
+							{
+								m_responsePolicy->RecordStreamed(m_responsePolicyEntry, m_response->GetPayload().size());
+							}
+
+							WriteResponse();
+
+							return;
+						}
+
+						Kill();
+					}
+
 					/// <summary>
 					/// Completion handler for when an asynchronous read of the response payload
 					/// from the upstream server completes. Requests the response payload to be
@@ -1142,10 +1556,10 @@ namespace te
 						// EOF doesn't necessarily mean something critical happened. Could simply be
 						// that we got the entire valid response, and the server closed the connection
 						// after.
-						if ((!error || (error == boost::asio::error::eof || (error.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(error.value()) == SSL_R_SHORT_READ))))
+						if (!error || error == boost::asio::error::eof || error == boost::asio::ssl::error::stream_truncated)
 						{
-							bool closeAfter = (error == boost::asio::error::eof) || ((error.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(error.value()) == SSL_R_SHORT_READ));
-							bool wasSslShortRead = ((error.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(error.value()) == SSL_R_SHORT_READ));
+							bool closeAfter = (error == boost::asio::error::eof) || (error == boost::asio::ssl::error::stream_truncated);
+							bool wasSslShortRead = (error == boost::asio::ssl::error::stream_truncated);
 
 							if (closeAfter && !wasSslShortRead && bytesTransferred <= 0)
 							{
@@ -1176,31 +1590,35 @@ namespace te
 									ReportWarning(u8"In TlsCapableHttpBridge::OnUpstreamRead(const boost::system::error_code&, const size_t) - Got TLS short read, but payload is complete. The naughty remote server did not do a proper TLS shutdown.");
 								}
 
-								if (m_request->GetShouldBlock() > -1 && m_response->IsPayloadComplete() && m_response->GetConsumeAllBeforeSending())
+								if (IsResponseReadyForInspection(m_response.get()))
 								{
-									// Response was flagged for further inspection. Supply to ShouldBlock...
-									auto shouldBlock = ShouldBlockTransaction(m_request.get(), m_response.get());
+									if (m_responsePolicy)
+									{
+										m_responsePolicy->RecordBuffered(m_responsePolicyEntry, m_response->GetPayload().size());
+									}
 
-									if (shouldBlock)
-									{	
-										m_request->SetShouldBlock(1);
-										auto responseBuffer = m_request->GetWriteBuffer();
+									if (m_request->GetShouldBlock() > -1)
+									{
+										// Response was flagged for further inspection. Supply to ShouldBlock...
+										auto verdict = GetVerdict(m_request.get(), m_response.get(), VerdictStage::ResponsePayload, closeAfter);
 
-										boost::asio::async_write(
-											m_downstreamSocket,
-											responseBuffer,
-											boost::asio::transfer_all(),
-											m_downstreamStrand.wrap(
-												std::bind(
-													&TlsCapableHttpBridge::OnDownstreamWrite,
-													shared_from_this(),
-													std::placeholders::_1
-												)
-											)
-										);
+										if (verdict == VerdictOutcome::Pending)
+										{
+											return;
+										}
 
-										return;
+										if (verdict == VerdictOutcome::Block)
+										{
+											WriteBlockResponse(true);
+											return;
+										}
 									}
+
+									EndResponseSample();
+								}
+								else if (m_responsePolicy && !m_response->GetConsumeAllBeforeSending())
+								{
+									m_responsePolicy->RecordStreamed(m_responsePolicyEntry, m_response->GetPayload().size());
 								}
 								
 								if (!closeAfter && m_response->IsPayloadComplete() == false && m_response->GetConsumeAllBeforeSending() == true)
@@ -1216,12 +1634,15 @@ namespace te
 											readBuffer,
 											boost::asio::transfer_at_least(1),
 											m_upstreamStrand.wrap(
-												std::bind(
-													&TlsCapableHttpBridge::OnUpstreamRead,
-													shared_from_this(),
-													std::placeholders::_1,
-													std::placeholders::_2
-													)
+												network::MakeCustomAllocHandler(
+													m_responsePathHandlerMemory,
+													std::bind(
+														&TlsCapableHttpBridge::OnUpstreamRead,
+														this->shared_from_this(),
+														std::placeholders::_1,
+														std::placeholders::_2
+														)
+												)
 												)
 											);
 
@@ -1238,20 +1659,7 @@ namespace te
 								}
 								
 								// Simply write what we've got to the client.
-								auto writeBuffer = m_response->GetWriteBuffer();
-
-								boost::asio::async_write(
-									m_downstreamSocket,
-									writeBuffer,
-									boost::asio::transfer_all(),
-									m_downstreamStrand.wrap(
-										std::bind(
-											&TlsCapableHttpBridge::OnDownstreamWrite,
-											shared_from_this(),
-											std::placeholders::_1
-											)
-										)
-									);
+								WriteResponse();
 
 								return;
 							}
@@ -1302,6 +1710,9 @@ namespace te
 						ReportInfo(u8"TlsCapableHttpBridge::OnUpstreamWrite");
 						#endif // !NDEBUG
 
+						// Whatever we had in flight towards the server has landed.
+						ReleaseInFlightBytes(m_requestPathInFlightBytes);
+
 						if (m_shouldTerminate)
 						{
 							// The session was flagged to be killed AFTER this write completes.
@@ -1320,32 +1731,12 @@ namespace te
 
 								SetStreamTimeout(boost::posix_time::minutes(5));
 
-								try
-								{
-									auto readBuffer = m_request->GetReadBuffer();
-
-									boost::asio::async_read(
-										m_downstreamSocket,
-										readBuffer,
-										boost::asio::transfer_at_least(1),
-										m_downstreamStrand.wrap(
-											std::bind(
-												&TlsCapableHttpBridge::OnDownstreamRead,
-												shared_from_this(),
-												std::placeholders::_1,
-												std::placeholders::_2
-												)
-											)
-										);
-
-									return;
-								}
-								catch (std::exception& e)
+								if (!SendContinueIfOwed())
 								{
-									std::string errMsg(u8"In TlsCapableHttpBridge::OnUpstreamWrite(const boost::system::error_code&) - Got error:\t");
-									errMsg.append(e.what());
-									ReportError(errMsg);
+									ReadDownstreamPayload();
 								}
+
+								return;
 							}
 							else
 							{
@@ -1358,12 +1749,15 @@ namespace te
 									m_response->GetReadBuffer(), 
 									boost::asio::transfer_at_least(1),
 									m_upstreamStrand.wrap(
-										std::bind(
-											&TlsCapableHttpBridge::OnUpstreamHeaders, 
-											shared_from_this(), 
-											std::placeholders::_1,
-											std::placeholders::_2
-											)
+										network::MakeCustomAllocHandler(
+											m_responsePathHandlerMemory,
+											std::bind(
+												&TlsCapableHttpBridge::OnUpstreamHeaders, 
+												this->shared_from_this(), 
+												std::placeholders::_1,
+												std::placeholders::_2
+												)
+										)
 										)
 									);
 
@@ -1439,10 +1833,10 @@ namespace te
 						// EOF doesn't necessarily mean something critical happened. Could simply be
 						// that we got the entire valid response, and the server closed the connection
 						// after.
-						if ((!error || (error == boost::asio::error::eof || (error.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(error.value()) == SSL_R_SHORT_READ))))
+						if (!error || error == boost::asio::error::eof || error == boost::asio::ssl::error::stream_truncated)
 						{
-							bool closeAfter = (error == boost::asio::error::eof) || ((error.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(error.value()) == SSL_R_SHORT_READ));
-							bool wasSslShortRead = ((error.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(error.value()) == SSL_R_SHORT_READ));
+							bool closeAfter = (error == boost::asio::error::eof) || (error == boost::asio::ssl::error::stream_truncated);
+							bool wasSslShortRead = (error == boost::asio::ssl::error::stream_truncated);
 
 							if (closeAfter && !wasSslShortRead && bytesTransferred <= 0)
 							{
@@ -1455,7 +1849,11 @@ namespace te
 								m_shouldTerminate = true;
 							}
 
-							if (m_request->Parse(bytesTransferred))
+							const bool parsed = m_requestAlreadyParsed || m_request->Parse(bytesTransferred);
+
+							m_requestAlreadyParsed = false;
+
+							if (parsed)
 							{			
 
 								if (wasSslShortRead && (!m_request->IsPayloadComplete() || !m_request->HeadersComplete()))
@@ -1481,11 +1879,14 @@ namespace te
 										m_request->GetReadBuffer(),
 										boost::asio::transfer_at_least(1),
 										m_downstreamStrand.wrap(
-											std::bind(
-												&TlsCapableHttpBridge::OnDownstreamHeaders,
-												shared_from_this(),
-												std::placeholders::_1,
-												std::placeholders::_2
+											network::MakeCustomAllocHandler(
+												m_requestPathHandlerMemory,
+												std::bind(
+													&TlsCapableHttpBridge::OnDownstreamHeaders,
+													this->shared_from_this(),
+													std::placeholders::_1,
+													std::placeholders::_2
+												)
 											)
 										)
 									);
@@ -1494,214 +1895,475 @@ namespace te
 								}
 
 								
-								auto shouldBlockRequest = ShouldBlockTransaction(m_request.get());
+								auto verdict = GetVerdict(m_request.get(), nullptr, VerdictStage::RequestHeaders, closeAfter);
+
+								if (verdict == VerdictOutcome::Pending)
+								{
+									// We've been parked. We'll pick up from here in ::OnVerdict(...).
+									return;
+								}
 
-								if (shouldBlockRequest)
+								if (verdict == VerdictOutcome::Block)
 								{
 									// If should-block was set here, then that means the request 
 									// has already been set externally with a response buffer for
 									// the request, because it was blocked immediately. Just go
 									// ahead and write this back down to the client and then exit.
-									auto responseBuffer = m_request->GetWriteBuffer();
-
-									boost::asio::async_write(
-										m_downstreamSocket,
-										responseBuffer,
-										boost::asio::transfer_all(),
-										m_downstreamStrand.wrap(
-											std::bind(
-												&TlsCapableHttpBridge::OnDownstreamWrite,
-												shared_from_this(),
-												std::placeholders::_1
-											)
-										)
-									);
+									WriteBlockResponse(false);
 									return;
 								}
 
-								// This little business is for dealing with browsers like Chrome, who just have
-								// to use their own "I'm too cool for skool" compression methods like SDHC. We
-								// want to be sure that we get normal, non-hipster encoded, non-organic smoothie
-								// encoded reponses that sane people can decompress. So we just always replace
-								// the Accept-Encoding header with this.
-								std::string standardEncoding(u8"gzip");
-								m_request->AddHeader(util::http::headers::AcceptEncoding, standardEncoding);
-
-								// Modifying content-encoding isn't enough for that sweet organic spraytanned
-								// browser Chrome and its server cartel buddies. If these special headers make
-								// it through, even though we've explicitly defined our accepted encoding,
-								// you're still going to get SDHC encoded data.
-								m_request->RemoveHeader(util::http::headers::XSDHC);
-								m_request->RemoveHeader(util::http::headers::AvailDictionary);
-								
-								// Ensure that nobody is advertising for QUIC support.
-								m_request->RemoveHeader(util::http::headers::AlternateProtocol);
+								ContinueDownstreamHeaders(closeAfter);
+								return;
+							}
+							else
+							{
+								ReportError(u8"In TlsCapableHttpBridge::OnDownstreamHeaders(const boost::system::error_code&, const size_t) - Failed to parse request.");
+							}
+						}
 
-								// Sigh, also remove declaration of any alternative protocol.
-								m_request->RemoveHeader(util::http::headers::AltSvc);
+						if (error)
+						{
+							std::string errMsg(u8"In TlsCapableHttpBridge::OnDownstreamHeaders(const boost::system::error_code&, const size_t) - Got error:\t");
+							errMsg.append(error.message());
+							ReportError(errMsg);
+						}
 
-								// Firefox developers are bunch of double talking liars, and claim that you
-								// can disable public key pinning. However, for their buddies who must
-								// pay them off or something, this isn't true. It's enforced no matter
-								// what do you. So what's the solution? We strip the headers from
-								// the client altogether.
-								m_request->RemoveHeader(util::http::headers::PublicKeyPins);
-								m_request->RemoveHeader(util::http::headers::PublicKeyPinsReportOnly);
+						Kill();
+					}
 
-								auto hostHeader = m_request->GetHeader(util::http::headers::Host);
+					/// <summary>
+					/// Picks up where ::OnDownstreamHeaders(...) leaves off once the request headers
+					/// have been checked and were not blocked. Sanitizes the request headers, then
+					/// either resolves the host, continues reading a request payload that has been
+					/// flagged for inspection, or writes what we have to the server. Split out so
+					/// that ::OnVerdict(...) can resume here after waiting on a pending verdict.
+					/// </summary>
+					/// <param name="closeAfter">
+					/// Whether or not the client closed the connection after the data we have.
+					/// </param>
+					void ContinueDownstreamHeaders(const bool closeAfter)
+					{
+						PrepareRequestHeaders(*m_request, m_clientAcceptEncoding);
+
+						// A client that sends Expect: 100-continue holds its payload back until it's
+						// told to go ahead, which is normally the server's job. But we don't read
+						// anything from the server until we're done writing the request to it, and
+						// when the payload is flagged for inspection, we don't write any of it until
+						// we've read all of it. So instead of passing the expectation on, we tell the
+						// client to go ahead ourselves, right before we first read its payload. The
+						// expectation means nothing coming from an HTTP/1.0 client, RFC 7231 section
+						// 5.1.1, so those are left alone.
+						m_continueOwed = false;
+
+						if (m_request->GetHttpVersion() == http::HttpProtocolVersion::HTTP1_1)
+						{
+							auto expectHeader = m_request->GetHeader(util::http::headers::Expect);
 
-								if (hostHeader.first != hostHeader.second)
+							for (auto it = expectHeader.first; it != expectHeader.second; ++it)
+							{
+								if (boost::iequals(boost::trim_copy(it->second), u8"100-continue"))
 								{
-									auto hostWithoutPort = hostHeader.first->second;
-
-									boost::trim(hostWithoutPort);
+									m_continueOwed = true;
+								}
+							}
 
-									auto portInd = hostWithoutPort.find(':');
+							if (m_continueOwed)
+							{
+								m_request->RemoveHeader(util::http::headers::Expect);
 
-									if (portInd != std::string::npos && portInd < hostWithoutPort.size())
-									{
-										auto portString = hostWithoutPort.substr(portInd + 1);
+								// Clients are allowed to send the payload without waiting, in which
+								// case we may already have all of it.
+								m_continueOwed = !closeAfter && !m_request->IsPayloadComplete();
+							}
+						}
 
-										hostWithoutPort = hostWithoutPort.substr(0, portInd);
+						auto hostHeader = m_request->GetHeader(util::http::headers::Host);
 
-										try
-										{
-											m_upstreamHostPort = static_cast<uint16_t>(std::stoi(portString));
-										}
-										catch (...)
-										{
-											// We don't really care what went wrong. We failed to parse the port in the host. We'll
-											// simply issue a warning, and assume port 80.
-											ReportWarning(u8"In TlsCapableHttpBridge::OnDownstreamHeaders(const boost::system::error_code&, const size_t) - Failed to parse port in host entry. Assuming port 80.");
-										}										
-									}
+						if (hostHeader.first != hostHeader.second)
+						{
+							auto hostWithoutPort = hostHeader.first->second;
 
-									// If the we're already connected to a host and it's not the same, just quit.
-									bool needsResolve = true;
-									if (m_upstreamHost.size() > 0)
-									{
-										auto hostComparison = hostWithoutPort.compare(m_upstreamHost);
-										
-										if (hostComparison != 0)
-										{
-											Kill();
-											return;
-										}
+							boost::trim(hostWithoutPort);
 
-										needsResolve = false;
-									}
+							auto portInd = hostWithoutPort.find(':');
 
-									if (needsResolve)
-									{
-										// If we're not already connected to a host, then we need to resolve it and
-										// connect to it. This **should** only ever be true in the event that its a 
-										// non-TLS (plain HTTP) connection.
-										SetStreamTimeout(boost::posix_time::minutes(5));
+							if (portInd != std::string::npos && portInd < hostWithoutPort.size())
+							{
+								auto portString = hostWithoutPort.substr(portInd + 1);
 
-										m_upstreamHost = hostWithoutPort;
-										boost::asio::ip::tcp::resolver::query query(m_upstreamHost, std::is_same<BridgeSocketType, network::TlsSocket>::value ? "https" : "http");
+								hostWithoutPort = hostWithoutPort.substr(0, portInd);
 
-										m_resolver.async_resolve(
-											query,
-											m_upstreamStrand.wrap(
-												std::bind(
-													&TlsCapableHttpBridge::OnResolve,
-													shared_from_this(),
-													std::placeholders::_1,
-													std::placeholders::_2
-													)
-												)
-											);
+								try
+								{
+									m_upstreamHostPort = static_cast<uint16_t>(std::stoi(portString));
+								}
+								catch (...)
+								{
+									// We don't really care what went wrong. We failed to parse the port in the host. We'll
+									// simply issue a warning, and assume port 80.
+									ReportWarning(u8"In TlsCapableHttpBridge::ContinueDownstreamHeaders(const bool) - Failed to parse port in host entry. Assuming port 80.");
+								}										
+							}
 
-										return;
-									}
-									
-									if (!closeAfter && m_request->IsPayloadComplete() == false && m_request->GetConsumeAllBeforeSending() == true)
-									{
-										// We need to reinitiate sequential reads of the request
-										// payload until we have all of the request body, as it has
-										// been marked for inspection.
-
-										// We do this in a try/catch because getting the read buffer for the payload
-										// can throw if the maximum payload size has been reached. This is defined as
-										// a constexpr in BaseHttpTransaction. 
-										try
-										{
-											auto readBuffer = m_request->GetReadBuffer();
+							// If the we're already connected to a host and it's not the same, just quit.
+							// The host is recorded before the cache is consulted, so that a response
+							// served from the cache still pins the connection to its host. That also
+							// means the host can be set without a connection behind it, in which case
+							// the first request to miss the cache makes one.
+							bool needsResolve = true;
+							if (m_upstreamHost.size() > 0)
+							{
+								auto hostComparison = hostWithoutPort.compare(m_upstreamHost);
+								
+								if (hostComparison != 0)
+								{
+									Kill();
+									return;
+								}
 
-											SetStreamTimeout(boost::posix_time::minutes(5));
+								needsResolve = !UpstreamSocket().is_open();
+							}
+							else
+							{
+								m_upstreamHost = hostWithoutPort;
+							}
 
-											boost::asio::async_read(
-												m_downstreamSocket,
-												readBuffer,
-												boost::asio::transfer_at_least(1),
-												m_upstreamStrand.wrap(
-													std::bind(
-														&TlsCapableHttpBridge::OnDownstreamRead,
-														shared_from_this(),
-														std::placeholders::_1,
-														std::placeholders::_2
-													)
-												)
-											);
+							if (TryServeFromCache())
+							{
+								return;
+							}
 
-											return;
-										}
-										catch (std::exception& e)
-										{
-											ReportError(e.what());
-										}
-									}
-									else
-									{
-										// Just write to the server that we're apparently already connected to. We
-										// don't concern ourselves with the ShouldBlock value here on the request.
-										// Once we get the upstream response headers, which gives us data about the
-										// size of a yet-to-be-completed request, we will block if the value was set
-										// here, but not before the http filtering engine reports this data to
-										// any observer(s).
+							if (needsResolve)
+							{
+								// If we're not already connected to a host, then we need to resolve it and
+								// connect to it. This **should** only ever be true in the event that its a 
+								// non-TLS (plain HTTP) connection.
+								SetStreamTimeout(boost::posix_time::minutes(5));
 
-										SetStreamTimeout(boost::posix_time::minutes(5));
+								// A port given with the host is resolved as the service, so that every
+								// endpoint comes back with it. Endpoints can't be changed once resolved.
+								const std::string service = m_upstreamHostPort != 0 ? std::to_string(m_upstreamHostPort) :
+									std::is_same<BridgeSocketType, network::TlsSocket>::value ? u8"https" : u8"http";
 
-										auto writeBuffer = m_request->GetWriteBuffer();
+								boost::asio::ip::tcp::resolver::query query(m_upstreamHost, service);
 
-										boost::asio::async_write(
-											m_upstreamSocket,
-											writeBuffer,
-											boost::asio::transfer_all(),
-											m_upstreamStrand.wrap(
-												std::bind(
-													&TlsCapableHttpBridge::OnUpstreamWrite,
-													shared_from_this(),
-													std::placeholders::_1
-												)
+								m_resolver.async_resolve(
+									query,
+									m_upstreamStrand.wrap(
+										std::bind(
+											&TlsCapableHttpBridge::OnResolve,
+											this->shared_from_this(),
+											std::placeholders::_1,
+											std::placeholders::_2
 											)
-										);
+										)
+									);
 
-										return;
-									}
-								}
-								else
+								return;
+							}
+							
+							if (!closeAfter && m_request->IsPayloadComplete() == false && m_request->GetConsumeAllBeforeSending() == true)
+							{
+								// We need to reinitiate sequential reads of the request
+								// payload until we have all of the request body, as it has
+								// been marked for inspection.
+								if (!SendContinueIfOwed())
 								{
-									ReportError(u8"In TlsCapableHttpBridge::OnDownstreamHeaders(const boost::system::error_code&, const size_t) - Failed to read Host header from request.");
+									ReadInspectedRequestPayload();
 								}
+
+								return;
 							}
 							else
 							{
-								ReportError(u8"In TlsCapableHttpBridge::OnDownstreamHeaders(const boost::system::error_code&, const size_t) - Failed to parse request.");
+								// Just write to the server that we're apparently already connected to. We
+								// don't concern ourselves with the ShouldBlock value here on the request.
+								// Once we get the upstream response headers, which gives us data about the
+								// size of a yet-to-be-completed request, we will block if the value was set
+								// here, but not before the http filtering engine reports this data to
+								// any observer(s).
+
+								SetStreamTimeout(boost::posix_time::minutes(5));
+
+								auto writeBuffer = m_request->GetWriteBuffer();
+
+								if (!closeAfter && m_request->IsPayloadComplete() && CoalescePipelinedRequests(writeBuffer))
+								{
+									return;
+								}
+
+								boost::asio::async_write(
+									m_upstreamSocket,
+									writeBuffer,
+									boost::asio::transfer_all(),
+									m_upstreamStrand.wrap(
+										network::MakeCustomAllocHandler(
+											m_requestPathHandlerMemory,
+											std::bind(
+												&TlsCapableHttpBridge::OnUpstreamWrite,
+												this->shared_from_this(),
+												std::placeholders::_1
+											)
+										)
+									)
+								);
+
+								return;
 							}
 						}
-
-						if (error)
+						else
 						{
-							std::string errMsg(u8"In TlsCapableHttpBridge::OnDownstreamHeaders(const boost::system::error_code&, const size_t) - Got error:\t");
-							errMsg.append(error.message());
-							ReportError(errMsg);
+							ReportError(u8"In TlsCapableHttpBridge::ContinueDownstreamHeaders(const bool) - Failed to read Host header from request.");
 						}
 
 						Kill();
 					}
 
+					/// <summary>
+					/// Prepares the headers of a request to be written to the server. Narrows what
+					/// the client accepts to the codings we can decompress, remembering what it would
+					/// have taken, and strips the headers that would have the server answer in a way
+					/// we can't handle, or have the client pin keys we can't present.
+					/// </summary>
+					/// <param name="request">
+					/// The request.
+					/// </param>
+					/// <param name="clientAcceptEncoding">
+					/// Set to the Accept-Encoding the client sent, before it was replaced. Empty if it
+					/// sent none.
+					/// </param>
+					void PrepareRequestHeaders(http::HttpRequest& request, std::string& clientAcceptEncoding)
+					{
+						// This little business is for dealing with browsers like Chrome, who just have
+						// to use their own "I'm too cool for skool" compression methods like SDHC. We
+						// want to be sure that we get normal, non-hipster encoded, non-organic smoothie
+						// encoded reponses that sane people can decompress. So we replace the
+						// Accept-Encoding header with the codings we can decompress.
+						// What the client would have taken is remembered, since it decides what we
+						// send back, should we end up decompressing the response.
+						clientAcceptEncoding.clear();
+
+						auto acceptEncodingHeader = request.GetHeader(util::http::headers::AcceptEncoding);
+
+						for (auto it = acceptEncodingHeader.first; it != acceptEncodingHeader.second; ++it)
+						{
+							if (!clientAcceptEncoding.empty())
+							{
+								clientAcceptEncoding.push_back(',');
+							}
+
+							clientAcceptEncoding.append(it->second);
+						}
+
+						// Narrowing it only matters when the response might be decompressed for
+						// inspection. A transaction allowed outright, response and all, or one to a
+						// host whose compression is to be preserved, keeps what the client asked for.
+						// Should such a response come back in a coding we can't undo, it's streamed
+						// rather than inspected, see ::ApplyInspectionPolicy().
+						const bool preserveEncoding = request.GetShouldBlock() == -1 ||
+							(m_verdictControl != nullptr && m_verdictControl->GetSnapshot()->IsEncodingPreserved(GetRequestHost(&request)));
+
+						if (!preserveEncoding)
+						{
+							std::string standardEncoding(u8"gzip, deflate");
+							request.AddHeader(util::http::headers::AcceptEncoding, standardEncoding);
+						}
+
+						// Modifying content-encoding isn't enough for that sweet organic spraytanned
+						// browser Chrome and its server cartel buddies. If these special headers make
+						// it through, even though we've explicitly defined our accepted encoding,
+						// you're still going to get SDHC encoded data.
+						request.RemoveHeader(util::http::headers::XSDHC);
+						request.RemoveHeader(util::http::headers::AvailDictionary);
+						
+						// Ensure that nobody is advertising for QUIC support.
+						request.RemoveHeader(util::http::headers::AlternateProtocol);
+
+						// Sigh, also remove declaration of any alternative protocol.
+						request.RemoveHeader(util::http::headers::AltSvc);
+
+						// Firefox developers are bunch of double talking liars, and claim that you
+						// can disable public key pinning. However, for their buddies who must
+						// pay them off or something, this isn't true. It's enforced no matter
+						// what do you. So what's the solution? We strip the headers from
+						// the client altogether.
+						request.RemoveHeader(util::http::headers::PublicKeyPins);
+						request.RemoveHeader(util::http::headers::PublicKeyPinsReportOnly);
+					}
+
+					/// <summary>
+					/// Writes the current request to the server along with the requests the client
+					/// pipelined after it, when pipeline coalescing is enabled and any of them can go
+					/// ahead of the response to the current one. Only requests that already have a
+					/// verdict that neither blocks them nor has them inspected can, since nothing
+					/// would stop them on the way to the server anyway: complete HTTP/1.1 GET
+					/// requests for the same host that is bypassed, or that the verdict cache allows
+					/// and the blocklist and native rules don't block. See ::FindStandingVerdict(...).
+					/// The verdict on each is exactly what it would have been had it waited its turn,
+					/// and the response callbacks are still made in turn. GET alone, since a client
+					/// may send it again should the connection be lost before its response arrives,
+					/// RFC 7230 section 6.3.2, and since, unlike a response to HEAD, a response to GET
+					/// can be parsed without knowing what it answers. The first request that can't go
+					/// ahead, and everything after it, waits its turn as usual.
+					/// </summary>
+					/// <param name="writeBuffer">
+					/// The current request, as it's to be written.
+					/// </param>
+					/// <returns>
+					/// True if the write was issued, false if no pipelined request could go ahead, in
+					/// which case the current request is to be written on its own.
+					/// </returns>
+					const bool CoalescePipelinedRequests(const boost::asio::const_buffers_1& writeBuffer)
+					{
+						if (m_verdictControl == nullptr || !m_verdictControl->GetPipelineCoalescing())
+						{
+							return false;
+						}
+
+						if (m_request->GetHttpVersion() != http::HttpProtocolVersion::HTTP1_1 || IsCloseRequested(*m_request))
+						{
+							return false;
+						}
+
+						// Held for the duration, as in ::GetVerdict(...).
+						auto snapshot = m_verdictControl->GetSnapshot();
+
+						const http::HttpRequest* previous = m_request.get();
+
+						while (m_forwardedRequests.size() < MaxCoalescedRequests && !previous->GetPipelinedData().empty())
+						{
+							const auto& pipelined = previous->GetPipelinedData();
+
+							std::unique_ptr<http::HttpRequest> request;
+
+							try
+							{
+								request.reset(new http::HttpRequest(pipelined.data(), pipelined.size()));
+							}
+							catch (std::exception& e)
+							{
+								ReportError(e.what());
+								break;
+							}
+
+							// Whatever is wrong with it is reported when it's parsed again in its
+							// turn.
+							if (!request->Parse(pipelined.size(), false) || !request->HeadersComplete() || !request->IsPayloadComplete())
+							{
+								break;
+							}
+
+							if (request->Method() != HTTP_GET || request->GetHttpVersion() != http::HttpProtocolVersion::HTTP1_1)
+							{
+								break;
+							}
+
+							if (GetRequestHost(request.get()).compare(GetRequestHost(m_request.get())) != 0)
+							{
+								break;
+							}
+
+							// Not counted yet, so that a request left to wait its turn isn't counted
+							// twice.
+							StandingVerdict standing;
+
+							if (!FindStandingVerdict(*snapshot, request.get(), false, standing))
+							{
+								break;
+							}
+
+							const uint32_t action = standing.nextAction & HTTP_NEXT_ACTION_MASK;
+
+							if (action != 0 && action != 3)
+							{
+								break;
+							}
+
+							request->SetOnInfo(m_onInfo);
+							request->SetOnWarning(m_onWarning);
+							request->SetOnError(m_onError);
+
+							// Just as ::GetVerdict(...) would have.
+							RecordStandingVerdict(*snapshot, standing);
+							ApplyMessageBeginVerdict(request.get(), nullptr, standing.nextAction, standing.customResponse);
+
+							ForwardedRequest forwarded;
+							PrepareRequestHeaders(*request, forwarded.clientAcceptEncoding);
+							forwarded.request = std::move(request);
+
+							m_forwardedRequests.push_back(std::move(forwarded));
+
+							m_verdictControl->RecordPipelined();
+							m_verdictControl->RecordCoalesced();
+
+							previous = m_forwardedRequests.back().request.get();
+
+							if (IsCloseRequested(*previous))
+							{
+								// The server won't read past it.
+								break;
+							}
+						}
+
+						if (m_forwardedRequests.empty())
+						{
+							return false;
+						}
+
+						std::vector<boost::asio::const_buffer> writeBuffers;
+						writeBuffers.reserve(m_forwardedRequests.size() + 1);
+						writeBuffers.push_back(writeBuffer);
+
+						for (auto& forwarded : m_forwardedRequests)
+						{
+							writeBuffers.push_back(forwarded.request->GetWriteBuffer());
+						}
+
+						boost::asio::async_write(
+							m_upstreamSocket,
+							writeBuffers,
+							boost::asio::transfer_all(),
+							m_upstreamStrand.wrap(
+								network::MakeCustomAllocHandler(
+									m_requestPathHandlerMemory,
+									std::bind(
+										&TlsCapableHttpBridge::OnUpstreamWrite,
+										this->shared_from_this(),
+										std::placeholders::_1
+									)
+								)
+							)
+						);
+
+						return true;
+					}
+
+					/// <summary>
+					/// Checks whether a request or response asks for the connection to be closed
+					/// after it.
+					/// </summary>
+					/// <param name="transaction">
+					/// The request or response.
+					/// </param>
+					/// <returns>
+					/// True if the transaction carries Connection: close, false otherwise.
+					/// </returns>
+					static const bool IsCloseRequested(const http::BaseHttpTransaction& transaction)
+					{
+						auto connectionHeader = transaction.GetHeader(util::http::headers::Connection);
+
+						for (auto it = connectionHeader.first; it != connectionHeader.second; ++it)
+						{
+							if (boost::iequals(boost::trim_copy(it->second), u8"close"))
+							{
+								return true;
+							}
+						}
+
+						return false;
+					}
+
 					/// <summary>
 					/// Completion handler for when an asynchronous read of the request payload from
 					/// the connected client completes. Requests the request payload to be parsed
@@ -1741,10 +2403,10 @@ namespace te
 						// EOF doesn't necessarily mean something critical happened. Could simply be
 						// that we got the entire valid response, and the server closed the connection
 						// after.
-						if ((!error || (error == boost::asio::error::eof || (error.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(error.value()) == SSL_R_SHORT_READ))))
+						if (!error || error == boost::asio::error::eof || error == boost::asio::ssl::error::stream_truncated)
 						{
-							bool closeAfter = (error == boost::asio::error::eof) || ((error.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(error.value()) == SSL_R_SHORT_READ));
-							bool wasSslShortRead = ((error.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(error.value()) == SSL_R_SHORT_READ));
+							bool closeAfter = (error == boost::asio::error::eof) || (error == boost::asio::ssl::error::stream_truncated);
+							bool wasSslShortRead = (error == boost::asio::ssl::error::stream_truncated);
 
 							if (closeAfter && !wasSslShortRead && bytesTransferred <= 0)
 							{
@@ -1791,12 +2453,15 @@ namespace te
 											readBuffer,
 											boost::asio::transfer_at_least(1),
 											m_downstreamStrand.wrap(
-												std::bind(
-													&TlsCapableHttpBridge::OnDownstreamRead,
-													shared_from_this(),
-													std::placeholders::_1,
-													std::placeholders::_2
-													)
+												network::MakeCustomAllocHandler(
+													m_requestPathHandlerMemory,
+													std::bind(
+														&TlsCapableHttpBridge::OnDownstreamRead,
+														this->shared_from_this(),
+														std::placeholders::_1,
+														std::placeholders::_2
+														)
+												)
 												)
 											);
 
@@ -1820,11 +2485,14 @@ namespace te
 									writeBuffer, 
 									boost::asio::transfer_all(), 
 									m_upstreamStrand.wrap(
-										std::bind(
-											&TlsCapableHttpBridge::OnUpstreamWrite, 
-											shared_from_this(), 
-											std::placeholders::_1
-											)
+										network::MakeCustomAllocHandler(
+											m_requestPathHandlerMemory,
+											std::bind(
+												&TlsCapableHttpBridge::OnUpstreamWrite, 
+												this->shared_from_this(), 
+												std::placeholders::_1
+												)
+										)
 										)
 									);
 
@@ -1864,6 +2532,9 @@ namespace te
 						ReportInfo(u8"TlsCapableHttpBridge::OnDownstreamWrite");
 						#endif // !NDEBUG
 
+						// Whatever we had in flight towards the client has landed.
+						ReleaseInFlightBytes(m_responsePathInFlightBytes);
+
 						if (m_shouldTerminate)
 						{
 							// The session was flagged to be killed AFTER this write completes.
@@ -1898,42 +2569,18 @@ namespace te
 
 								SetStreamTimeout(boost::posix_time::minutes(5));
 
-								try
+								ReadUpstreamPayload();
+								return;
+							}
+							else
+							{							
+								// We've fulfilled the request. Now, if keep-alive was specified, we'll reset and
+								// start over again. Otherwise, we'll just die.
+								if (m_keepAlive)
 								{
-									auto readBuffer = m_response->GetReadBuffer();
-
-									boost::asio::async_read(
-										m_upstreamSocket,
-										readBuffer,
-										boost::asio::transfer_at_least(1),
-										m_upstreamStrand.wrap(
-											std::bind(
-												&TlsCapableHttpBridge::OnUpstreamRead,
-												shared_from_this(),
-												std::placeholders::_1,
-												std::placeholders::_2
-												)
-											)
-										);
-
-									return;
-								}
-								catch (std::exception& e)
-								{
-									std::string errMsg(u8"In TlsCapableHttpBridge::OnDownstreamWrite(const boost::system::error_code&) - Got error:\t");
-									errMsg.append(e.what());
-									ReportError(errMsg);
-								}
-							}
-							else
-							{							
-								// We've fulfilled the request. Now, if keep-alive was specified, we'll reset and
-								// start over again. Otherwise, we'll just die.
-								if (m_keepAlive)
-								{
-									#ifndef NDEBUG
-									ReportInfo(u8"In TlsCapableHttpBridge::OnDownstreamWrite(const boost::system::error_code&) - Keep-alive specified, initiating new read.");
-									#endif
+									#ifndef NDEBUG
+									ReportInfo(u8"In TlsCapableHttpBridge::OnDownstreamWrite(const boost::system::error_code&) - Keep-alive specified, initiating new read.");
+									#endif
 
 									// We cannot use keep-alive when we've actively blocked a
 									// transaction from completing early. If we do, then the follow
@@ -1941,40 +2588,16 @@ namespace te
 									// polluted by the left over data from the previous, aborted
 									// (blocked) request. Therefore, we have no choice but to
 									// entirely terminate the bridge and force the client to open a
-									// new connection.
-
-									if ((m_request && m_request->GetShouldBlock() != 0) || (m_response && m_response->GetShouldBlock() != 0))
-									{
-										Kill();
-										return;
-									}
-
-									SetStreamTimeout(boost::posix_time::minutes(5));
+									// new connection. A whitelisted transaction, -1, was never cut
+									// short, so there's nothing left over from it.
 
-									try
-									{
-										m_request.reset(new http::HttpRequest());
-										m_response.reset(new http::HttpResponse());
-									}
-									catch (std::exception& e)
+									if ((m_request && m_request->GetShouldBlock() > 0) || (m_response && m_response->GetShouldBlock() > 0))
 									{
-										ReportError(e.what());
 										Kill();
 										return;
 									}
 
-									m_shouldTerminate = false;
-
-									// XXX TODO - This is ugly, our bad design is showing. See notes in the
-									// EventReporter class header.
-									m_request->SetOnInfo(m_onInfo);
-									m_request->SetOnWarning(m_onWarning);
-									m_request->SetOnError(m_onError);
-									m_response->SetOnInfo(m_onInfo);
-									m_response->SetOnWarning(m_onWarning);
-									m_response->SetOnError(m_onError);
-
-									TryInitiateHttpTransaction();
+									StartNextTransaction();
 									return;
 								}
 							}							
@@ -1990,1044 +2613,3080 @@ namespace te
 					}
 
 					/// <summary>
-					/// Completion handler for when the asynchrous wait operation on the stream
-					/// timer is finished, meaning that the timeout period has been reached, or that
-					/// the operation was cancelled. If the timeout has been reached, then the
-					/// bridge should be terminated. If the operation was aborted, then the function
-					/// will return without calling for a termination of the bridge.
-					/// 
-					/// In the event that this operation was a failure, meaning that the supplied
-					/// error parameter was set and the code was one unexpected, the bridge will be 
-					/// terminated.
+					/// Starts the next transaction on a connection that's being kept alive, once the
+					/// response to the last one has been written to the client. Should the last
+					/// request have been followed by pipelined requests that were written to the
+					/// server along with it, the oldest of them is next, and we go straight to its
+					/// response. Failing that, should the client have sent more along with the last
+					/// request, that's the start of the next one, and it's taken up from there, just
+					/// as though it had only now been read. Otherwise, we wait to hear from the
+					/// client again.
 					/// </summary>
-					/// <param name="error">
-					/// Error code that will indicate if any errors were handled during the async
-					/// operation, providing details if an error did occur and was handled.
-					/// </param>
-					void OnStreamTimeout(const boost::system::error_code& error)
+					void StartNextTransaction()
 					{
+						SetStreamTimeout(boost::posix_time::minutes(5));
 
-						#ifndef NDEBUG
-							ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnStreamTimeout");
-						#endif // !NDEBUG
+						m_shouldTerminate = false;
 
-						if (error)
+						if (!m_forwardedRequests.empty())
 						{
-							if (error == boost::asio::error::operation_aborted)
-							{
-								// Aborts are normal, as pending async_waits are cancelled every time that
-								// the timeout is reset. Therefore, we safely ignore them.
-								return;
-							}
-							else
-							{
-								// XXX TODO - Perhaps in the event of an error, we should return and avoid
-								// calling ::Kill()?
-								std::string errMessage(u8"In TlsCapableHttpBridge<BridgeSocketType>::OnStreamTimeout(const boost::system::error_code&) - Got error:\t");
-								errMessage.append(error.message());
-								ReportError(errMessage);
-							}
+							m_request = std::move(m_forwardedRequests.front().request);
+							m_clientAcceptEncoding = std::move(m_forwardedRequests.front().clientAcceptEncoding);
+							m_forwardedRequests.pop_front();
+
+							StartNextResponse();
+							return;
 						}
 
-						Kill();
-					}					
+						if (m_response && !m_response->GetPipelinedData().empty())
+						{
+							// We didn't ask for anything that this could be the answer to.
+							ReportWarning(u8"In TlsCapableHttpBridge::StartNextTransaction() - Server sent data beyond the end of the response.");
+							Kill();
+							return;
+						}
+
+						const auto pipelinedLength = m_request->GetPipelinedData().size();
+
+						try
+						{
+							std::unique_ptr<http::HttpRequest> request(pipelinedLength > 0 ? new http::HttpRequest(m_request->GetPipelinedData().data(), pipelinedLength) : new http::HttpRequest());
+
+							m_request = std::move(request);
+							m_response.reset(new http::HttpResponse());
+						}
+						catch (std::exception& e)
+						{
+							ReportError(e.what());
+							Kill();
+							return;
+						}
+
+						// XXX TODO - This is ugly, our bad design is showing. See notes in the
+						// EventReporter class header.
+						m_request->SetOnInfo(m_onInfo);
+						m_request->SetOnWarning(m_onWarning);
+						m_request->SetOnError(m_onError);
+						m_response->SetOnInfo(m_onInfo);
+						m_response->SetOnWarning(m_onWarning);
+						m_response->SetOnError(m_onError);
+
+						if (pipelinedLength == 0)
+						{
+							TryInitiateHttpTransaction();
+							return;
+						}
+
+						if (m_verdictControl != nullptr)
+						{
+							m_verdictControl->RecordPipelined();
+						}
+
+						OnDownstreamHeaders(boost::system::error_code(), pipelinedLength);
+					}
 
 					/// <summary>
-					/// Completion handler for when the asynchrous handshake operation with the
-					/// remote upstream host has finished. If the operation was a success, then a
-					/// context by which to serve the connected client will either be retrieved, or
-					/// created, stored and then retrieved.
-					/// 
-					/// In the event that this operation was a failure, meaning that the supplied
-					/// error parameter was set and the code was one unexpected, the bridge will be 
-					/// terminated.
+					/// Replaces m_response with a fresh response for the next response from the
+					/// server, and gets its headers. That's the final response after an interim one,
+					/// or the response to a pipelined request that was written to the server along
+					/// with the request before it. Should whatever followed the end of the last
+					/// response have been read along with it, that's the start of this one, and it's
+					/// parsed first, just as though it had only now been read.
 					/// </summary>
-					/// <param name="error">
-					/// Error code that will indicate if any errors were handled during the async
-					/// operation, providing details if an error did occur and was handled.
-					/// </param>
-					void OnUpstreamHandshake(const boost::system::error_code& error)
+					void StartNextResponse()
 					{
+						const auto pipelinedLength = m_response->GetPipelinedData().size();
 
-						#ifndef NDEBUG
-						ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake");
-						#endif // !NDEBUG
+						try
+						{
+							std::unique_ptr<http::HttpResponse> response(pipelinedLength > 0 ? new http::HttpResponse(m_response->GetPipelinedData().data(), pipelinedLength) : new http::HttpResponse());
 
-						if (!error && m_upstreamCert != nullptr)
+							m_response = std::move(response);
+						}
+						catch (std::exception& e)
 						{
-							boost::asio::ssl::context* serverCtx = nullptr;
+							std::string errMsg(u8"In TlsCapableHttpBridge::StartNextResponse() - Got error:\t");
+							errMsg.append(e.what());
+							ReportError(errMsg);
+							Kill();
+							return;
+						}
 
-							try
-							{
-								serverCtx = m_certStore->GetServerContext(m_upstreamHost, m_upstreamCert);
-							}
-							catch (std::exception& e)
-							{
-								serverCtx = nullptr;
-								std::string errMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake(const boost::system::error_code&) - While spoofing, got error:\t");
-								errMessage.append(e.what());
-								ReportError(errMessage);
-							}
+						m_response->SetOnInfo(m_onInfo);
+						m_response->SetOnWarning(m_onWarning);
+						m_response->SetOnError(m_onError);
 
-							if (serverCtx != nullptr)
-							{
-								if (SSL_set_SSL_CTX(m_downstreamSocket.native_handle(), serverCtx->native_handle()) == serverCtx->native_handle())
-								{
-									// Set timeouts
-									SetStreamTimeout(boost::posix_time::minutes(5));
-									//
-									
-									m_downstreamSocket.async_handshake(
-										network::TlsSocket::server, 
-										m_downstreamStrand.wrap(
-											std::bind(
-												&TlsCapableHttpBridge::OnDownstreamHandshake, 
-												shared_from_this(), 
-												std::placeholders::_1
-												)
-											)
-										);
+						SetStreamTimeout(boost::posix_time::minutes(5));
 
-									return;
-								}
-								else
-								{
-									ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake(const boost::system::error_code&) - Failed to correctly set context.");
-								}
-							}
-							else
+						if (pipelinedLength > 0)
+						{
+							// Should the server have closed the connection right after what we
+							// already have, it's handled as though it had closed after this read.
+							boost::system::error_code error;
+
+							if (m_shouldTerminate)
 							{
-								ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake(const boost::system::error_code&) - Failed to fetch spoofed context.");
+								error = boost::asio::error::eof;
 							}
+
+							m_upstreamStrand.post(
+								std::bind(
+									&TlsCapableHttpBridge::OnUpstreamHeaders,
+									this->shared_from_this(),
+									error,
+									pipelinedLength
+								)
+							);
+
+							return;
 						}
-						else
+
+						boost::asio::async_read(
+							m_upstreamSocket,
+							m_response->GetReadBuffer(),
+							boost::asio::transfer_at_least(1),
+							m_upstreamStrand.wrap(
+								network::MakeCustomAllocHandler(
+									m_responsePathHandlerMemory,
+									std::bind(
+										&TlsCapableHttpBridge::OnUpstreamHeaders,
+										this->shared_from_this(),
+										std::placeholders::_1,
+										std::placeholders::_2
+									)
+								)
+							)
+						);
+					}
+
+					/// <summary>
+					/// Initiates a read of the next portion of a request payload that is being
+					/// streamed from the client to the server, rather than being consumed for
+					/// inspection. Before the read is issued, the bytes it may deliver are reserved
+					/// against the flow control, and the read is bounded to what was reserved. If
+					/// nothing could be reserved, reading from the client is paused until bytes are
+					/// released, see ::PauseRead(...). The reservation is held until the data has
+					/// been written to the server, see ::OnUpstreamWrite(...).
+					/// </summary>
+					void ReadDownstreamPayload()
+					{
+						const uint32_t maxReadSize = ReserveInFlightBytes(m_requestPathInFlightBytes);
+
+						if (maxReadSize == 0)
 						{
-							if (error)
-							{
-								std::string errMsg(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake(const boost::system::error_code&) - Got error:\t");
-								errMsg.append(error.message());
-								ReportError(errMsg);
+							PauseRead(true, [this]() { ReadDownstreamPayload(); });
+							return;
+						}
 
-								bool wasSSlError = (error.category() == boost::asio::error::get_ssl_category());
+						try
+						{
+							auto readBuffer = m_request->GetReadBuffer(maxReadSize);
 
-								if (wasSSlError)
-								{
-									ReportError(u8"Was TLS error.");
-								}
-							}
+							boost::asio::async_read(
+								m_downstreamSocket,
+								readBuffer,
+								boost::asio::transfer_at_least(1),
+								m_downstreamStrand.wrap(
+									network::MakeCustomAllocHandler(
+										m_requestPathHandlerMemory,
+										std::bind(
+											&TlsCapableHttpBridge::OnDownstreamRead,
+											this->shared_from_this(),
+											std::placeholders::_1,
+											std::placeholders::_2
+										)
+									)
+								)
+							);
 
-							if (m_upstreamCert == nullptr)
-							{
-								ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake(const boost::system::error_code&) - Upstream cert is nullptr!");
-							}
+							return;
+						}
+						catch (std::exception& e)
+						{
+							std::string errMsg(u8"In TlsCapableHttpBridge::ReadDownstreamPayload() - Got error:\t");
+							errMsg.append(e.what());
+							ReportError(errMsg);
 						}
 
 						Kill();
 					}
 
 					/// <summary>
-					/// Completion handler for when the asynchrous handshake operation with the
-					/// connected client has finished. If the operation was a success, then the
-					/// process of reading the client's request headers will begin.
-					/// 
-					/// In the event that this operation was a failure, meaning that the supplied
-					/// error parameter was set and the code was one unexpected, the bridge will be 
-					/// terminated.
+					/// Initiates a read of the next portion of a request payload that has been
+					/// flagged for inspection, and so is being read in full before any of it is
+					/// written to the server. Such a payload isn't subject to flow control, since it
+					/// is bounded by the maximum payload size instead.
 					/// </summary>
-					/// <param name="error">
-					/// Error code that will indicate if any errors were handled during the async
-					/// operation, providing details if an error did occur and was handled.
-					/// </param>
-					void OnDownstreamHandshake(const boost::system::error_code& error)
+					void ReadInspectedRequestPayload()
 					{
+						// We do this in a try/catch because getting the read buffer for the payload
+						// can throw if the maximum payload size has been reached. This is defined as
+						// a constexpr in BaseHttpTransaction. 
+						try
+						{
+							auto readBuffer = m_request->GetReadBuffer();
 
-						#ifndef NDEBUG
-						ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnDownstreamHandshake");
-						#endif // !NDEBUG
+							SetStreamTimeout(boost::posix_time::minutes(5));
 
-						if (!error)
-						{
-							SetNoDelay(UpstreamSocket(), true);
-							SetNoDelay(DownstreamSocket(), true);
+							boost::asio::async_read(
+								m_downstreamSocket,
+								readBuffer,
+								boost::asio::transfer_at_least(1),
+								m_downstreamStrand.wrap(
+									network::MakeCustomAllocHandler(
+										m_requestPathHandlerMemory,
+										std::bind(
+											&TlsCapableHttpBridge::OnDownstreamRead,
+											this->shared_from_this(),
+											std::placeholders::_1,
+											std::placeholders::_2
+										)
+									)
+								)
+							);
 
-							TryInitiateHttpTransaction();
 							return;
 						}
-
-						std::string errMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnDownstreamHandshake(const boost::system::error_code&) - Got error:\t");
-						errMessage.append(error.message());
-						ReportError(errMessage);
+						catch (std::exception& e)
+						{
+							std::string errMsg(u8"In TlsCapableHttpBridge::ReadInspectedRequestPayload() - Got error:\t");
+							errMsg.append(e.what());
+							ReportError(errMsg);
+						}
 
 						Kill();
 					}
-	
+
 					/// <summary>
-					/// Handler for the peek read operation on newly connected TLS clients. Only
-					/// ever used in the case that BridgeSocketType is network::TlsSocket. In this
-					/// handler, we manually parse the TLS client hello message, search for the SNI
-					/// extension and attempt to extract the value. If we succeed, then the
-					/// extracted host will be resolved with "https" as the service, so that we get
-					/// endpoints already configured to connect to port 443. The OnResolve handlers
-					/// are specialized, so the correct functionality and order of operations will
-					/// be initiated once the resolver handler is invoked depending for TLS or
-					/// non-TLS clients. For TLS clients, handshakes and upstream server certificate
-					/// verification will occur when the resolver returns valid enpoints.
+					/// If the client is holding its request payload back until it gets 100 Continue,
+					/// see ::ContinueDownstreamHeaders(const bool), writes 100 Continue to the client,
+					/// then carries on reading the payload once that's done.
+					/// </summary>
+					/// <returns>
+					/// True if 100 Continue is being written, in which case the caller must not read
+					/// the payload itself. False if the payload can be read right away.
+					/// </returns>
+					const bool SendContinueIfOwed()
+					{
+						if (!m_continueOwed)
+						{
+							return false;
+						}
+
+						m_continueOwed = false;
+
+						static const char continueResponse[] = u8"HTTP/1.1 100 Continue\r\n\r\n";
+
+						SetStreamTimeout(boost::posix_time::minutes(5));
+
+						boost::asio::async_write(
+							m_downstreamSocket,
+							boost::asio::buffer(continueResponse, sizeof(continueResponse) - 1),
+							boost::asio::transfer_all(),
+							m_downstreamStrand.wrap(
+								network::MakeCustomAllocHandler(
+									m_requestPathHandlerMemory,
+									std::bind(
+										&TlsCapableHttpBridge::OnContinueWritten,
+										this->shared_from_this(),
+										std::placeholders::_1
+									)
+								)
+							)
+						);
+
+						return true;
+					}
+
+					/// <summary>
+					/// Completion handler for when 100 Continue has been written to the client.
+					/// Begins reading the request payload, whether it's being inspected or streamed.
 					/// 
 					/// In the event that this operation was a failure, meaning that the supplied
-					/// error parameter was set and the code was one unexpected, the bridge will be 
-					/// terminated.
+					/// error parameter was set, the bridge will be terminated.
 					/// </summary>
 					/// <param name="error">
 					/// Error code that will indicate if any errors were handled during the async
 					/// operation, providing details if an error did occur and was handled.
 					/// </param>
-					/// <param name="bytesTransferred">
-					/// The amount of bytes read during the async peek read operation. This is how
-					/// many valid bytes were written to the m_tlsPeekBuffer member array.
-					/// </param>
-					void OnTlsPeek(const boost::system::error_code& error, const size_t bytesTransferred)
+					void OnContinueWritten(const boost::system::error_code& error)
 					{
-					
+
 						#ifndef NDEBUG
-						ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek");
+						ReportInfo(u8"TlsCapableHttpBridge::OnContinueWritten");
 						#endif // !NDEBUG
 
-						// Parsing Numbers
-						//
-						// https://www.ietf.org/rfc/rfc5246.txt Sections 4.1, 4.4:
-						// Data is stored is big-endian. Basic storage unit is uint8_t (one byte, 8 bits). Multibyte data sequences are
-						// concatenated left to right. Example code given is:
-						// value = (byte[0] << 8*(n-1)) | (byte[1] << 8*(n-2)) ... | byte[n - 1];
-						//
-						//
-						// Parsing Strings
-						//
-						// https://www.ietf.org/rfc/rfc4366.txt Section 3.1, page 9:
-						// "The hostname is represented as a byte string using UTF - 8 encoding[UTF8], without a trailing dot."
-						// If hostname only contains US-ASCII chars, labels must be separated using 0x2E byte, representing
-						// the U+002E char.
-
-						if (m_tlsPeekBuffer != nullptr && !error && bytesTransferred > 0)
-						{						
-							if (bytesTransferred > MinTlsHelloLength)
+						if (!error)
+						{
+							if (m_request->GetConsumeAllBeforeSending())
 							{
-								auto sharedThis = shared_from_this();
-								auto WithinBounds = [sharedThis, this]
-									(const std::unique_ptr< std::array<char, TlsPeekBufferSize> >& arr, const size_t position, const size_t validDataLength, int crumb = 0)->bool
-								{
-									// Crumb param helps identify which point the check was done and failed. Not really
-									// sure if I should take this out after I finish sorting this parsing method, as it
-									// may assist in the future.
-									if (position >= arr->size() || position > validDataLength)
-									{
-										#ifndef NDEBUG
-											std::string errMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - ");
-											errMessage.append(u8"Index in buffer is out of bounds at position ").append(std::to_string(position)).append(u8".\n\n");
-											errMessage.append(u8"Went out of bounds at check ").append(std::to_string(crumb)).append(u8".");
-											ReportError(errMessage);
-										#endif
-										
-										return false;
-									}
+								ReadInspectedRequestPayload();
+							}
+							else
+							{
+								ReadDownstreamPayload();
+							}
 
-									return true;
-								};
+							return;
+						}
 
-								auto contentType = (*m_tlsPeekBuffer)[0];
-								auto versionMajor = (*m_tlsPeekBuffer)[1];
-								auto versionMinor = (*m_tlsPeekBuffer)[2];
-								auto handshakeType = (*m_tlsPeekBuffer)[5];
+						std::string errMsg(u8"In TlsCapableHttpBridge::OnContinueWritten(const boost::system::error_code&) - Got error:\t");
+						errMsg.append(error.message());
+						ReportError(errMsg);
 
-								if ((versionMajor == 3 && versionMinor > 0) || (versionMinor > 3))
-								{
-									if (contentType == 22 && handshakeType == 1)
-									{
-										boost::string_ref hostName(m_tlsPeekBuffer->data(), bytesTransferred);
-										size_t hostnameLength = 0;
+						Kill();
+					}
 
-										size_t position = MinTlsHelloLength;
+					/// <summary>
+					/// Writes what we have of the response to the client, completing at
+					/// ::OnDownstreamWrite(...). A response that was decompressed for inspection may
+					/// be compressed again on the way, depending on the recompression settings and
+					/// what the client accepts, in which case it's compressed and written a slice at
+					/// a time, see ::WriteEncodedResponseSlice(). See network::RecompressionControl.
+					/// </summary>
+					void WriteResponse()
+					{
+						// What's stored is what the client would get without recompression.
+						StoreResponseInCache();
 
-										// Get session ID length.
-										size_t sessionIdLength = reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position]);
+						if (TryBeginEncodedResponse())
+						{
+							WriteEncodedResponseSlice();
+							return;
+						}
 
-										// Now skip past session ID.
-										position += sessionIdLength + 1;
+						auto writeBuffer = m_response->GetWriteBuffer();
 
-										if (!WithinBounds(m_tlsPeekBuffer, position + 1, bytesTransferred))
-										{
-											Kill();
-											return;
-										}
+						boost::asio::async_write(
+							m_downstreamSocket,
+							writeBuffer,
+							boost::asio::transfer_all(),
+							m_downstreamStrand.wrap(
+								network::MakeCustomAllocHandler(
+									m_responsePathHandlerMemory,
+									std::bind(
+										&TlsCapableHttpBridge::OnDownstreamWrite,
+										this->shared_from_this(),
+										std::placeholders::_1
+										)
+								)
+								)
+							);
+					}
 
-										// Get cipher suites length.
-										size_t cipherSuitesLength = ((reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position])) << 8) | reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position + 1]);
+					/// <summary>
+					/// Stores the response about to be written to the client in the shared response
+					/// cache, if it's held in full and the cache will take it. See
+					/// http::ResponseCache.
+					/// </summary>
+					void StoreResponseInCache()
+					{
+						if (m_verdictControl == nullptr || m_verdictControl->GetResponseCache().GetMaxBytes() == 0)
+						{
+							return;
+						}
 
-										// Now skip past cipher suites.
-										position += cipherSuitesLength + 2;
+						const bool secure = std::is_same<BridgeSocketType, network::TlsSocket>::value;
 
-										if (!WithinBounds(m_tlsPeekBuffer, position, bytesTransferred, 1))
-										{
-											Kill();
-											return;
-										}
+						m_verdictControl->GetResponseCache().Store(secure, GetRequestHost(m_request.get()), *m_request, *m_response, m_verdictControl->GetGeneration());
+					}
 
-										// Get compression methods length.
-										size_t compressionMethodsLength = reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position]);
+					/// <summary>
+					/// Looks the current request up in the shared response cache, once it has been
+					/// allowed. A fresh stored response is written to the client straight away,
+					/// without anything being sent upstream. A stale one has its validators added
+					/// to the request, so that the server can confirm it with 304 Not Modified,
+					/// see ::OnUpstreamHeaders(...).
+					/// </summary>
+					/// <returns>
+					/// True if the request is being answered from the cache, false if it's to be
+					/// sent upstream.
+					/// </returns>
+					const bool TryServeFromCache()
+					{
+						m_cacheRevalidating.reset();
 
-										// Now skip past compression methods.
-										position += compressionMethodsLength + 1;
+						if (m_verdictControl == nullptr || !m_request->IsPayloadComplete())
+						{
+							return false;
+						}
 
-										if (!WithinBounds(m_tlsPeekBuffer, position + 1, bytesTransferred, 2))
-										{
-											Kill();
-											return;
-										}
+						auto& cache = m_verdictControl->GetResponseCache();
 
-										// Get extensions length.
-										size_t extensionsLength = ((reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position])) << 8) | reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position + 1]);
+						std::shared_ptr<const http::ResponseCache::Entry> entry;
 
-										// Now skip past just the extensions length bytes.
-										position += 2;
+						const bool secure = std::is_same<BridgeSocketType, network::TlsSocket>::value;
 
-										if (!WithinBounds(m_tlsPeekBuffer, position, bytesTransferred, 3))
-										{
-											Kill();
-											return;
-										}
+						switch (cache.Lookup(secure, GetRequestHost(m_request.get()), *m_request, m_verdictControl->GetGeneration(), entry))
+						{
+							case http::ResponseCache::LookupResult::Fresh:
+							{
+								bool keepAlive = m_request->GetHttpVersion() != http::HttpProtocolVersion::HTTP1;
 
-										// Parse each extension till we hopefully find SNI
-										bool notDone = true;
-										while (position < bytesTransferred && notDone)
-										{
-											if (!WithinBounds(m_tlsPeekBuffer, position + 4, bytesTransferred, 4))
-											{
-												Kill();
-												return;
-											}
+								auto connectionHeader = m_request->GetHeader(util::http::headers::Connection);
 
-											// Get the extension type.
-											size_t extensionType = ((reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position])) << 8) | reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position + 1]);
+								for (auto it = connectionHeader.first; it != connectionHeader.second; ++it)
+								{
+									if (boost::iequals(boost::trim_copy(it->second), u8"close"))
+									{
+										keepAlive = false;
+									}
+								}
 
-											// Get the length of this extension.
-											size_t extensionLength = ((reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position + 2])) << 8) | reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position + 3]);
-												
-											// Skip beyond extension type and extension length.
-											position += 4;
+								m_keepAlive = keepAlive;
 
-											// Check if it's SNI
-											if (extensionType == 0)
-											{
-												// Skip Server Name Indication Length.
-												position += 2;
+								ServeCachedResponse(*entry);
+							}
+							return true;
 
-												if (!WithinBounds(m_tlsPeekBuffer, position + 4, bytesTransferred, 5))
-												{
-													Kill();
-													return;
-												}
+							case http::ResponseCache::LookupResult::Stale:
+							{
+								http::ResponseCache::AddValidators(*entry, *m_request);
+								m_cacheRevalidating = std::move(entry);
+							}
+							return false;
 
-												while (position < bytesTransferred && notDone)
-												{
-													if (!WithinBounds(m_tlsPeekBuffer, position + 3, bytesTransferred, 6))
-													{
-														Kill();
-														return;
-													}
+							default:
+							return false;
+						}
+					}
 
-													// Get SNI part length.
-													size_t sniPartLength = ((reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position + 1])) << 8) | reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position + 2]);
-																									
-													if ((*m_tlsPeekBuffer)[position] == 0)
-													{
-														hostnameLength = sniPartLength;
-														hostName = hostName.substr(position + 3, sniPartLength);
-														notDone = false;
-														break;
-													}
+					/// <summary>
+					/// Writes a stored response to the client in place of one from the server,
+					/// completing at ::OnCachedResponseWrite(...). The response transaction is
+					/// marked complete, so that the connection carries on as though it had been
+					/// read in full.
+					/// </summary>
+					/// <param name="entry">
+					/// The stored response.
+					/// </param>
+					void ServeCachedResponse(const http::ResponseCache::Entry& entry)
+					{
+						m_verdictControl->GetResponseCache().BuildResponse(entry, *m_request, m_keepAlive, m_cachedResponseHead, m_cachedResponseBody);
 
-													position += 3 + sniPartLength;
-												}
-											}
+						m_response->SetPayload(std::vector<char>(), true);
 
-											position += extensionLength;
-										}
+						SetStreamTimeout(boost::posix_time::minutes(5));
 
-										if (hostnameLength > 0)
-										{
-											m_upstreamHost = hostName.to_string();
+						std::array<boost::asio::const_buffer, 2> writeBuffers =
+						{
+							boost::asio::buffer(m_cachedResponseHead),
+							m_cachedResponseBody ? boost::asio::buffer(*m_cachedResponseBody) : boost::asio::const_buffer()
+						};
+
+						boost::asio::async_write(
+							m_downstreamSocket,
+							writeBuffers,
+							boost::asio::transfer_all(),
+							m_downstreamStrand.wrap(
+								network::MakeCustomAllocHandler(
+									m_responsePathHandlerMemory,
+									std::bind(
+										&TlsCapableHttpBridge::OnCachedResponseWrite,
+										this->shared_from_this(),
+										std::placeholders::_1
+										)
+								)
+								)
+							);
+					}
 
-											// XXX TODO - See notes in the version of ::OnResolve(...), specialized for TLS clients.
-											m_upstreamHostPort = 443;
+					/// <summary>
+					/// Completion handler for when a stored response has been written to the client.
+					/// Lets go of the stored response, then carries on as for any other response.
+					/// </summary>
+					/// <param name="error">
+					/// Error code that will indicate if any errors were handled during the async
+					/// operation, providing details if an error did occur and was handled.
+					/// </param>
+					void OnCachedResponseWrite(const boost::system::error_code& error)
+					{
+						#ifndef NDEBUG
+						ReportInfo(u8"TlsCapableHttpBridge::OnCachedResponseWrite");
+						#endif // !NDEBUG
 
-											try
-											{	
-												boost::asio::ip::tcp::resolver::query query(m_upstreamHost, "https");
-												
-												m_resolver.async_resolve(
-													query, 
-													m_upstreamStrand.wrap(
-														std::bind(
-															&TlsCapableHttpBridge::OnResolve, 
-															shared_from_this(), 
-															std::placeholders::_1, 
-															std::placeholders::_2
-															)
-														)
-													);
+						m_cachedResponseHead.clear();
+						m_cachedResponseBody.reset();
 
-												return;
+						OnDownstreamWrite(error);
+					}
+
+					/// <summary>
+					/// Decides whether a response is to be compressed again before it's written
+					/// to the client, and if so, with what, and sets the response up for it.
+					/// </summary>
+					/// <returns>
+					/// True if the response is to be written with ::WriteEncodedResponseSlice(),
+					/// false if it's to be written as it is.
+					/// </returns>
+					const bool TryBeginEncodedResponse()
+					{
+						if (m_verdictControl == nullptr || !m_response->WasPayloadDecompressed() || !m_response->IsPayloadComplete())
+						{
+							return false;
+						}
+
+						auto& recompression = m_verdictControl->GetRecompression();
+
+						auto coding = http::PayloadEncoder::Coding::Identity;
+
+						if (m_request->GetHttpVersion() != http::HttpProtocolVersion::HTTP1 && m_response->GetPayload().size() >= network::RecompressionControl::MinPayloadBytes)
+						{
+							const auto acceptance = http::PayloadEncoder::ParseAcceptEncoding(m_clientAcceptEncoding);
+
+							// The client's favourite, ties going to gzip.
+							auto preferred = http::PayloadEncoder::Coding::Identity;
+
+							if (acceptance.gzip > 0 && acceptance.gzip >= acceptance.deflate)
+							{
+								preferred = http::PayloadEncoder::Coding::Gzip;
+							}
+							else if (acceptance.deflate > 0)
+							{
+								preferred = http::PayloadEncoder::Coding::Deflate;
+							}
+
+							switch (recompression.GetMode())
+							{
+								case network::RecompressionControl::Mode::ClientPreference:
+								{
+									coding = preferred;
+								}
+								break;
+
+								case network::RecompressionControl::Mode::Gzip:
+								{
+									coding = acceptance.gzip > 0 ? http::PayloadEncoder::Coding::Gzip : http::PayloadEncoder::Coding::Identity;
+								}
+								break;
+
+								case network::RecompressionControl::Mode::Deflate:
+								{
+									coding = acceptance.deflate > 0 ? http::PayloadEncoder::Coding::Deflate : http::PayloadEncoder::Coding::Identity;
+								}
+								break;
+
+								default:
+								break;
+							}
+
+							// A client that won't take identity gets whatever it will take.
+							if (coding == http::PayloadEncoder::Coding::Identity && acceptance.identity == 0)
+							{
+								coding = preferred;
+							}
+						}
+
+						if (coding == http::PayloadEncoder::Coding::Identity || !m_response->BeginEncodedWrite(coding, recompression.GetLevel()))
+						{
+							recompression.RecordIdentity();
+							return false;
+						}
+
+						return true;
+					}
+
+					/// <summary>
+					/// Compresses the next slice of a response being compressed again, and writes
+					/// it to the client, completing at ::OnEncodedResponseWrite(...).
+					/// </summary>
+					void WriteEncodedResponseSlice()
+					{
+						try
+						{
+							auto writeBuffer = m_response->GetNextEncodedWriteBuffer(network::RecompressionControl::SliceBytes);
+
+							boost::asio::async_write(
+								m_downstreamSocket,
+								writeBuffer,
+								boost::asio::transfer_all(),
+								m_downstreamStrand.wrap(
+									network::MakeCustomAllocHandler(
+										m_responsePathHandlerMemory,
+										std::bind(
+											&TlsCapableHttpBridge::OnEncodedResponseWrite,
+											this->shared_from_this(),
+											std::placeholders::_1
+											)
+									)
+									)
+								);
+
+							return;
+						}
+						catch (std::exception& e)
+						{
+							std::string errMsg(u8"In TlsCapableHttpBridge::WriteEncodedResponseSlice() - Got error:\t");
+							errMsg.append(e.what());
+							ReportError(errMsg);
+						}
+
+						Kill();
+					}
+
+					/// <summary>
+					/// Completion handler for when a slice of a response being compressed again has
+					/// been written to the client. Writes the next slice, or once the last one has
+					/// been written, carries on exactly as ::OnDownstreamWrite(...) would after
+					/// writing a response in one go.
+					/// </summary>
+					/// <param name="error">
+					/// Error code that will indicate if any errors were handled during the async
+					/// operation, providing details if an error did occur and was handled.
+					/// </param>
+					void OnEncodedResponseWrite(const boost::system::error_code& error)
+					{
+
+						#ifndef NDEBUG
+						ReportInfo(u8"TlsCapableHttpBridge::OnEncodedResponseWrite");
+						#endif // !NDEBUG
+
+						if (!error && !m_response->IsEncodedWriteComplete())
+						{
+							// Even if the server has since closed the connection, the client is owed
+							// the rest of what we already have.
+							SetStreamTimeout(boost::posix_time::minutes(5));
+
+							WriteEncodedResponseSlice();
+							return;
+						}
+
+						if (!error && m_verdictControl != nullptr)
+						{
+							uint64_t inputBytes = 0;
+							uint64_t outputBytes = 0;
+							uint64_t nanoseconds = 0;
+							uint64_t firstSliceNanoseconds = 0;
+
+							m_response->GetEncodedWriteStats(inputBytes, outputBytes, nanoseconds, firstSliceNanoseconds);
+
+							m_verdictControl->GetRecompression().RecordRecompressed(inputBytes, outputBytes, nanoseconds, firstSliceNanoseconds);
+						}
+
+						OnDownstreamWrite(error);
+					}
+
+					/// <summary>
+					/// Initiates a read of the next portion of a response payload that is being
+					/// streamed from the server to the client, rather than being consumed for
+					/// inspection. Before the read is issued, the bytes it may deliver are reserved
+					/// against the flow control, and the read is bounded to what was reserved. If
+					/// nothing could be reserved, reading from the server is paused until bytes are
+					/// released, see ::PauseRead(...). The reservation is held until the data has
+					/// been written to the client, see ::OnDownstreamWrite(...).
+					/// </summary>
+					void ReadUpstreamPayload()
+					{
+						const uint32_t maxReadSize = ReserveInFlightBytes(m_responsePathInFlightBytes);
+
+						if (maxReadSize == 0)
+						{
+							PauseRead(false, [this]() { ReadUpstreamPayload(); });
+							return;
+						}
+
+						try
+						{
+							auto readBuffer = m_response->GetReadBuffer(maxReadSize);
+
+							boost::asio::async_read(
+								m_upstreamSocket,
+								readBuffer,
+								boost::asio::transfer_at_least(1),
+								m_upstreamStrand.wrap(
+									network::MakeCustomAllocHandler(
+										m_responsePathHandlerMemory,
+										std::bind(
+											&TlsCapableHttpBridge::OnUpstreamRead,
+											this->shared_from_this(),
+											std::placeholders::_1,
+											std::placeholders::_2
+										)
+									)
+								)
+							);
+
+							return;
+						}
+						catch (std::exception& e)
+						{
+							std::string errMsg(u8"In TlsCapableHttpBridge::ReadUpstreamPayload() - Got error:\t");
+							errMsg.append(e.what());
+							ReportError(errMsg);
+						}
+
+						Kill();
+					}
+
+					/// <summary>
+					/// Pauses reading in one direction, after having been refused a reservation by
+					/// the flow control. The bridge queues up with the flow control, which resumes
+					/// it as soon as enough bytes have been released, by posting ::ResumeRead(...)
+					/// to the strand of the paused direction. A timer is also armed, which resumes
+					/// the read anyway after network::FlowControl::PauseFallbackMilliseconds, should
+					/// that never happen, such as when our own limit was lowered under us.
+					/// </summary>
+					/// <param name="requestPath">
+					/// True if reading from the client is being paused, false if reading from the
+					/// server is.
+					/// </param>
+					/// <param name="retry">
+					/// Retries the read that was refused. Must not hold a reference to us, since
+					/// it's kept by us until it's called.
+					/// </param>
+					void PauseRead(const bool requestPath, std::function<void()> retry)
+					{
+						auto& strand = requestPath ? m_downstreamStrand : m_upstreamStrand;
+						auto& timer = requestPath ? m_requestPathPauseTimer : m_responsePathPauseTimer;
+
+						if (requestPath)
+						{
+							m_requestPathRetry = std::move(retry);
+							m_requestPathPaused.store(true);
+						}
+						else
+						{
+							m_responsePathRetry = std::move(retry);
+							m_responsePathPaused.store(true);
+						}
+
+						timer.expires_from_now(boost::posix_time::milliseconds(static_cast<long>(network::FlowControl::PauseFallbackMilliseconds)));
+
+						timer.async_wait(
+							strand.wrap(
+								std::bind(
+									&TlsCapableHttpBridge::OnPauseTimeout,
+									this->shared_from_this(),
+									requestPath,
+									std::placeholders::_1
+								)
+							)
+						);
+
+						if (m_flowControl == nullptr)
+						{
+							return;
+						}
+
+						// Held weakly, since a killed bridge may sit in the queue until bytes are
+						// released, which could be a while.
+						std::weak_ptr<TlsCapableHttpBridge> weakSelf(this->shared_from_this());
+
+						m_flowControl->Wait(
+							[weakSelf, requestPath]() -> bool
+							{
+								auto bridge = weakSelf.lock();
+
+								if (bridge == nullptr)
+								{
+									return false;
+								}
+
+								const auto& paused = requestPath ? bridge->m_requestPathPaused : bridge->m_responsePathPaused;
+
+								if (!paused.load())
+								{
+									return false;
+								}
+
+								auto& strand = requestPath ? bridge->m_downstreamStrand : bridge->m_upstreamStrand;
+
+								strand.post(std::bind(&TlsCapableHttpBridge::ResumeRead, bridge, requestPath));
+
+								return true;
+							}
+						);
+					}
+
+					/// <summary>
+					/// Retries a read that was paused by ::PauseRead(...), unless it's already been
+					/// retried, or the bridge was killed in the meantime. Whichever of the flow
+					/// control and the fallback timer gets here first wins, and the other finds
+					/// nothing left to do.
+					/// </summary>
+					/// <param name="requestPath">
+					/// True if reading from the client is being resumed, false if reading from the
+					/// server is.
+					/// </param>
+					void ResumeRead(const bool requestPath)
+					{
+						auto& paused = requestPath ? m_requestPathPaused : m_responsePathPaused;
+
+						if (!paused.exchange(false))
+						{
+							return;
+						}
+
+						boost::system::error_code cancelErr;
+						(requestPath ? m_requestPathPauseTimer : m_responsePathPauseTimer).cancel(cancelErr);
+
+						std::function<void()> retry;
+						retry.swap(requestPath ? m_requestPathRetry : m_responsePathRetry);
+
+						if (retry)
+						{
+							retry();
+						}
+					}
+
+					/// <summary>
+					/// Completion handler for the fallback timer armed by ::PauseRead(...). Resumes
+					/// the paused read if nothing else has. If the wait was aborted, the read was
+					/// either resumed already or the bridge is being killed, so nothing is done.
+					/// </summary>
+					/// <param name="requestPath">
+					/// True if the timer belongs to the request path, false if it belongs to the
+					/// response path.
+					/// </param>
+					/// <param name="error">
+					/// Error code that will indicate if any errors were handled during the async
+					/// operation, providing details if an error did occur and was handled.
+					/// </param>
+					void OnPauseTimeout(const bool requestPath, const boost::system::error_code& error)
+					{
+						if (!error)
+						{
+							ResumeRead(requestPath);
+							return;
+						}
+
+						if (error != boost::asio::error::operation_aborted)
+						{
+							std::string errMsg(u8"In TlsCapableHttpBridge::OnPauseTimeout(const bool, const boost::system::error_code&) - Got error:\t");
+							errMsg.append(error.message());
+							ReportError(errMsg);
+							Kill();
+						}
+					}
+
+					/// <summary>
+					/// Attempts to reserve the bytes for the next streaming read against the flow
+					/// control. Any reservation still held in the supplied slot is released first.
+					/// The read is first charged against what's left of the per-bridge limit after
+					/// the other direction's share, then against the global limit. While the other
+					/// direction holds nothing, network::FlowControl::MinReservation is left for it,
+					/// so that it can always read something, even with our read still pending.
+					/// </summary>
+					/// <param name="reservation">
+					/// The member holding the reservation for the direction being read, either
+					/// m_requestPathInFlightBytes or m_responsePathInFlightBytes.
+					/// </param>
+					/// <returns>
+					/// The maximum number of bytes the next read may deliver. Zero if either budget
+					/// is exhausted, meaning that the read must be paused.
+					/// </returns>
+					const uint32_t ReserveInFlightBytes(uint32_t& reservation)
+					{
+						ReleaseInFlightBytes(reservation);
+
+						if (m_flowControl == nullptr)
+						{
+							return network::FlowControl::DefaultMaxBridgeInFlightBytes;
+						}
+
+						const uint32_t bridgeMax = m_flowControl->GetMaxBridgeInFlightBytes();
+
+						// With ours released, whatever is held belongs to the other direction.
+						uint32_t held = m_inFlightBytes.load(std::memory_order_relaxed);
+						uint32_t wanted = 0;
+
+						do
+						{
+							const uint32_t ceiling = held == 0 ? bridgeMax - network::FlowControl::MinReservation : bridgeMax;
+
+							if (held >= ceiling || ceiling - held < network::FlowControl::MinReservation)
+							{
+								// Only possible when the limit was lowered while the other
+								// direction had a read pending.
+								return 0;
+							}
+
+							// No read delivers more than a transaction's read buffer holds, so
+							// there's no sense in keeping more than that from everyone else.
+							wanted = ceiling - held;
+							wanted = wanted > http::BaseHttpTransaction::PayloadBufferReadSize ? http::BaseHttpTransaction::PayloadBufferReadSize : wanted;
+						} while (!m_inFlightBytes.compare_exchange_weak(held, held + wanted, std::memory_order_relaxed));
+
+						reservation = m_flowControl->TryReserve(wanted);
+
+						if (reservation < wanted)
+						{
+							m_inFlightBytes.fetch_sub(wanted - reservation, std::memory_order_relaxed);
+						}
+
+						return reservation;
+					}
+
+					/// <summary>
+					/// Releases the reservation held in the supplied slot, if any.
+					/// </summary>
+					/// <param name="reservation">
+					/// The member holding the reservation for the direction that has completed,
+					/// either m_requestPathInFlightBytes or m_responsePathInFlightBytes.
+					/// </param>
+					void ReleaseInFlightBytes(uint32_t& reservation)
+					{
+						if (m_flowControl != nullptr && reservation > 0)
+						{
+							m_inFlightBytes.fetch_sub(reservation, std::memory_order_relaxed);
+							m_flowControl->Release(reservation);
+						}
+
+						reservation = 0;
+					}
+
+					/// <summary>
+					/// Completion handler for when the asynchrous wait operation on the stream
+					/// timer is finished, meaning that the timeout period has been reached, or that
+					/// the operation was cancelled. If the timeout has been reached, then the
+					/// bridge should be terminated. If the operation was aborted, then the function
+					/// will return without calling for a termination of the bridge.
+					/// 
+					/// In the event that this operation was a failure, meaning that the supplied
+					/// error parameter was set and the code was one unexpected, the bridge will be 
+					/// terminated.
+					/// </summary>
+					/// <param name="error">
+					/// Error code that will indicate if any errors were handled during the async
+					/// operation, providing details if an error did occur and was handled.
+					/// </param>
+					void OnStreamTimeout(const boost::system::error_code& error)
+					{
+
+						#ifndef NDEBUG
+							ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnStreamTimeout");
+						#endif // !NDEBUG
+
+						if (error)
+						{
+							if (error == boost::asio::error::operation_aborted)
+							{
+								// Aborts are normal, as pending async_waits are cancelled every time that
+								// the timeout is reset. Therefore, we safely ignore them.
+								return;
+							}
+							else
+							{
+								// XXX TODO - Perhaps in the event of an error, we should return and avoid
+								// calling ::Kill()?
+								std::string errMessage(u8"In TlsCapableHttpBridge<BridgeSocketType>::OnStreamTimeout(const boost::system::error_code&) - Got error:\t");
+								errMessage.append(error.message());
+								ReportError(errMessage);
+							}
+						}
+
+						Kill();
+					}					
+
+					/// <summary>
+					/// Completion handler for when the asynchrous handshake operation with the
+					/// remote upstream host has finished. If the operation was a success, then a
+					/// context by which to serve the connected client will either be retrieved, or
+					/// created, stored and then retrieved.
+					/// 
+					/// Creating a context means minting a spoofed certificate, which is far too
+					/// expensive to do on an io thread. When no context exists yet, the store is
+					/// asked to mint one on its crypto workers, and the handshake resumes in
+					/// ::OnServerContext(...) once that's done.
+					/// 
+					/// In the event that this operation was a failure, meaning that the supplied
+					/// error parameter was set and the code was one unexpected, the bridge will be 
+					/// terminated.
+					/// </summary>
+					/// <param name="error">
+					/// Error code that will indicate if any errors were handled during the async
+					/// operation, providing details if an error did occur and was handled.
+					/// </param>
+					void OnUpstreamHandshake(const boost::system::error_code& error)
+					{
+
+						#ifndef NDEBUG
+						ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake");
+						#endif // !NDEBUG
+
+						if (!error && m_upstreamCert != nullptr)
+						{
+							boost::asio::ssl::context* serverCtx = nullptr;
+							std::string errMessage;
+
+							try
+							{
+								// Most of the time, we've seen this host before and a context already
+								// exists, so there's no need to go through the crypto workers at all.
+								serverCtx = m_certStore->FindServerContext(m_upstreamHost);
+
+								if (serverCtx == nullptr)
+								{
+									m_certStore->GetServerContextAsync(
+										m_upstreamHost, 
+										m_upstreamCert, 
+										m_upstreamStrand.wrap(
+											std::bind(
+												&TlsCapableHttpBridge::OnServerContext, 
+												this->shared_from_this(), 
+												std::placeholders::_1, 
+												std::placeholders::_2
+												)
+											)
+										);
+
+									return;
+								}
+							}
+							catch (std::exception& e)
+							{
+								serverCtx = nullptr;
+								errMessage = e.what();
+							}
+
+							OnServerContext(serverCtx, errMessage);
+							return;
+						}
+						else
+						{
+							if (error)
+							{
+								std::string errMsg(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake(const boost::system::error_code&) - Got error:\t");
+								errMsg.append(error.message());
+								ReportError(errMsg);
+
+								bool wasSSlError = (error.category() == boost::asio::error::get_ssl_category());
+
+								if (wasSSlError)
+								{
+									ReportError(u8"Was TLS error.");
+								}
+							}
+
+							if (m_upstreamCert == nullptr)
+							{
+								ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake(const boost::system::error_code&) - Upstream cert is nullptr!");
+							}
+						}
+
+						Kill();
+					}
+
+					/// <summary>
+					/// Completion handler for when a context by which to serve the connected client
+					/// has been retrieved or minted. If a context was obtained, it is set on the
+					/// downstream socket and the handshake with the connected client begins.
+					/// Otherwise, the bridge will be terminated.
+					/// </summary>
+					/// <param name="serverCtx">
+					/// The context to serve the connected client with, or nullptr on failure.
+					/// </param>
+					/// <param name="errorMessage">
+					/// If minting the context failed, a description of what went wrong.
+					/// </param>
+					void OnServerContext(boost::asio::ssl::context* serverCtx, const std::string& errorMessage)
+					{
+
+						#ifndef NDEBUG
+						ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnServerContext");
+						#endif // !NDEBUG
+
+						ReleaseSpoofSlot();
+
+						if (serverCtx != nullptr)
+						{
+							if (SSL_set_SSL_CTX(m_downstreamSocket.native_handle(), serverCtx->native_handle()) == serverCtx->native_handle())
+							{
+								// Set timeouts
+								SetStreamTimeout(boost::posix_time::minutes(5));
+								//
+								
+								m_downstreamSocket.async_handshake(
+									network::TlsSocket::server, 
+									m_downstreamStrand.wrap(
+										std::bind(
+											&TlsCapableHttpBridge::OnDownstreamHandshake, 
+											this->shared_from_this(), 
+											std::placeholders::_1
+											)
+										)
+									);
+
+								return;
+							}
+							else
+							{
+								ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnServerContext(boost::asio::ssl::context*, const std::string&) - Failed to correctly set context.");
+							}
+						}
+						else if (errorMessage.size() > 0)
+						{
+							std::string errMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnServerContext(boost::asio::ssl::context*, const std::string&) - While spoofing, got error:\t");
+							errMessage.append(errorMessage);
+							ReportError(errMessage);
+						}
+						else
+						{
+							ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnServerContext(boost::asio::ssl::context*, const std::string&) - Failed to fetch spoofed context.");
+						}
+
+						Kill();
+					}
+
+					/// <summary>
+					/// Completion handler for when the asynchrous handshake operation with the
+					/// connected client has finished. If the operation was a success, then the
+					/// process of reading the client's request headers will begin.
+					/// 
+					/// In the event that this operation was a failure, meaning that the supplied
+					/// error parameter was set and the code was one unexpected, the bridge will be 
+					/// terminated.
+					/// </summary>
+					/// <param name="error">
+					/// Error code that will indicate if any errors were handled during the async
+					/// operation, providing details if an error did occur and was handled.
+					/// </param>
+					void OnDownstreamHandshake(const boost::system::error_code& error)
+					{
+
+						#ifndef NDEBUG
+						ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnDownstreamHandshake");
+						#endif // !NDEBUG
+
+						ReleaseHandshakeSlot();
+
+						if (!error)
+						{
+							SetNoDelay(UpstreamSocket(), true);
+							SetNoDelay(DownstreamSocket(), true);
+
+							TryInitiateHttpTransaction();
+							return;
+						}
+
+						std::string errMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnDownstreamHandshake(const boost::system::error_code&) - Got error:\t");
+						errMessage.append(error.message());
+						ReportError(errMessage);
+
+						Kill();
+					}
+	
+					/// <summary>
+					/// Handler for the peek read operation on newly connected TLS clients. Only
+					/// ever used in the case that BridgeSocketType is network::TlsSocket. In this
+					/// handler, we manually parse the TLS client hello message, search for the SNI
+					/// extension and attempt to extract the value. If we succeed, then the
+					/// extracted host will be resolved with "https" as the service, so that we get
+					/// endpoints already configured to connect to port 443. The OnResolve handlers
+					/// are specialized, so the correct functionality and order of operations will
+					/// be initiated once the resolver handler is invoked depending for TLS or
+					/// non-TLS clients. For TLS clients, handshakes and upstream server certificate
+					/// verification will occur when the resolver returns valid enpoints.
+					/// 
+					/// In the event that this operation was a failure, meaning that the supplied
+					/// error parameter was set and the code was one unexpected, the bridge will be 
+					/// terminated.
+					/// </summary>
+					/// <param name="error">
+					/// Error code that will indicate if any errors were handled during the async
+					/// operation, providing details if an error did occur and was handled.
+					/// </param>
+					/// <param name="bytesTransferred">
+					/// The amount of bytes read during the async peek read operation. This is how
+					/// many valid bytes were written to the m_tlsPeekBuffer member array.
+					/// </param>
+					void OnTlsPeek(const boost::system::error_code& error, const size_t bytesTransferred)
+					{
+					
+						#ifndef NDEBUG
+						ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek");
+						#endif // !NDEBUG
+
+						// Parsing Numbers
+						//
+						// https://www.ietf.org/rfc/rfc5246.txt Sections 4.1, 4.4:
+						// Data is stored is big-endian. Basic storage unit is uint8_t (one byte, 8 bits). Multibyte data sequences are
+						// concatenated left to right. Example code given is:
+						// value = (byte[0] << 8*(n-1)) | (byte[1] << 8*(n-2)) ... | byte[n - 1];
+						//
+						//
+						// Parsing Strings
+						//
+						// https://www.ietf.org/rfc/rfc4366.txt Section 3.1, page 9:
+						// "The hostname is represented as a byte string using UTF - 8 encoding[UTF8], without a trailing dot."
+						// If hostname only contains US-ASCII chars, labels must be separated using 0x2E byte, representing
+						// the U+002E char.
+
+						if (m_tlsPeekBuffer != nullptr && !error && bytesTransferred > 0)
+						{						
+							if (bytesTransferred > MinTlsHelloLength)
+							{
+								auto sharedThis = this->shared_from_this();
+								auto WithinBounds = [sharedThis, this]
+									(const std::unique_ptr< std::array<char, TlsPeekBufferSize> >& arr, const size_t position, const size_t validDataLength, int crumb = 0)->bool
+								{
+									// Crumb param helps identify which point the check was done and failed. Not really
+									// sure if I should take this out after I finish sorting this parsing method, as it
+									// may assist in the future.
+									if (position >= arr->size() || position > validDataLength)
+									{
+										#ifndef NDEBUG
+											std::string errMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - ");
+											errMessage.append(u8"Index in buffer is out of bounds at position ").append(std::to_string(position)).append(u8".\n\n");
+											errMessage.append(u8"Went out of bounds at check ").append(std::to_string(crumb)).append(u8".");
+											ReportError(errMessage);
+										#endif
+										
+										return false;
+									}
+
+									return true;
+								};
+
+								auto contentType = (*m_tlsPeekBuffer)[0];
+								auto versionMajor = (*m_tlsPeekBuffer)[1];
+								auto versionMinor = (*m_tlsPeekBuffer)[2];
+								auto handshakeType = (*m_tlsPeekBuffer)[5];
+
+								if ((versionMajor == 3 && versionMinor > 0) || (versionMinor > 3))
+								{
+									if (contentType == 22 && handshakeType == 1)
+									{
+										boost::string_ref hostName(m_tlsPeekBuffer->data(), bytesTransferred);
+										size_t hostnameLength = 0;
+
+										size_t position = MinTlsHelloLength;
+
+										// Get session ID length.
+										size_t sessionIdLength = reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position]);
+
+										// Now skip past session ID.
+										position += sessionIdLength + 1;
+
+										if (!WithinBounds(m_tlsPeekBuffer, position + 1, bytesTransferred))
+										{
+											Kill();
+											return;
+										}
+
+										// Get cipher suites length.
+										size_t cipherSuitesLength = ((reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position])) << 8) | reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position + 1]);
+
+										// Now skip past cipher suites.
+										position += cipherSuitesLength + 2;
+
+										if (!WithinBounds(m_tlsPeekBuffer, position, bytesTransferred, 1))
+										{
+											Kill();
+											return;
+										}
+
+										// Get compression methods length.
+										size_t compressionMethodsLength = reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position]);
+
+										// Now skip past compression methods.
+										position += compressionMethodsLength + 1;
+
+										if (!WithinBounds(m_tlsPeekBuffer, position + 1, bytesTransferred, 2))
+										{
+											Kill();
+											return;
+										}
+
+										// Get extensions length.
+										size_t extensionsLength = ((reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position])) << 8) | reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position + 1]);
+
+										// Now skip past just the extensions length bytes.
+										position += 2;
+
+										if (!WithinBounds(m_tlsPeekBuffer, position, bytesTransferred, 3))
+										{
+											Kill();
+											return;
+										}
+
+										// Parse each extension till we hopefully find SNI
+										bool notDone = true;
+										while (position < bytesTransferred && notDone)
+										{
+											if (!WithinBounds(m_tlsPeekBuffer, position + 4, bytesTransferred, 4))
+											{
+												Kill();
+												return;
+											}
+
+											// Get the extension type.
+											size_t extensionType = ((reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position])) << 8) | reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position + 1]);
+
+											// Get the length of this extension.
+											size_t extensionLength = ((reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position + 2])) << 8) | reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position + 3]);
+												
+											// Skip beyond extension type and extension length.
+											position += 4;
+
+											// Check if it's SNI
+											if (extensionType == 0)
+											{
+												// Skip Server Name Indication Length.
+												position += 2;
+
+												if (!WithinBounds(m_tlsPeekBuffer, position + 4, bytesTransferred, 5))
+												{
+													Kill();
+													return;
+												}
+
+												while (position < bytesTransferred && notDone)
+												{
+													if (!WithinBounds(m_tlsPeekBuffer, position + 3, bytesTransferred, 6))
+													{
+														Kill();
+														return;
+													}
+
+													// Get SNI part length.
+													size_t sniPartLength = ((reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position + 1])) << 8) | reinterpret_cast<const char&>((*m_tlsPeekBuffer)[position + 2]);
+																									
+													if ((*m_tlsPeekBuffer)[position] == 0)
+													{
+														hostnameLength = sniPartLength;
+														hostName = hostName.substr(position + 3, sniPartLength);
+														notDone = false;
+														break;
+													}
+
+													position += 3 + sniPartLength;
+												}
+											}
+
+											position += extensionLength;
+										}
+
+										if (hostnameLength > 0)
+										{
+											// There's no sense in resolving, let alone minting a
+											// certificate for, a host we're going to block. Without
+											// a handshake we can't send a block response either, so
+											// the client just sees the connection close. Hosts on
+											// the bypass list are exempt, as they are from everything.
+											if (m_verdictControl != nullptr)
+											{
+												auto snapshot = m_verdictControl->GetSnapshot();
+
+												if (!snapshot->IsBypassed(hostName) && IsHostBlocklisted(*snapshot, hostName))
+												{
+													Kill();
+													return;
+												}
+											}
+
+											m_upstreamHost = hostName.to_string();
+
+											// XXX TODO - See notes in the version of ::OnResolve(...), specialized for TLS clients.
+											m_upstreamHostPort = 443;
+
+											try
+											{	
+												boost::asio::ip::tcp::resolver::query query(m_upstreamHost, "https");
+												
+												m_resolver.async_resolve(
+													query, 
+													m_upstreamStrand.wrap(
+														std::bind(
+															&TlsCapableHttpBridge::OnResolve, 
+															this->shared_from_this(), 
+															std::placeholders::_1, 
+															std::placeholders::_2
+															)
+														)
+													);
+
+												return;
 											}
 											catch (std::exception& e)
 											{
-												std::string errorMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Got Error:\t");
-												errorMessage.append(e.what());
-												ReportError(errorMessage);
+												std::string errorMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Got Error:\t");
+												errorMessage.append(e.what());
+												ReportError(errorMessage);
+											}
+										}
+										else
+										{
+											ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Failed to extract hostname from SNI extension.");
+										}
+									}
+									else
+									{
+										ReportWarning(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Not a TLS client hello.");
+									}
+								}
+								else
+								{
+									ReportWarning(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Not a TLS client.");
+								}
+							}
+						}
+						else
+						{							
+							if (error)
+							{
+								std::string errorMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Got Error:\t");
+								errorMessage.append(error.message());
+								ReportError(errorMessage);
+							}
+							else if(!m_tlsPeekBuffer)
+							{
+								ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - TLS peek buffer is nullptr!");
+							}
+						}
+
+						Kill();
+					}
+
+					/// <summary>
+					/// Callback supplied for the handshake process with the remote upstream server.
+					/// This is the client verifying the validity of the server's certificate. This
+					/// callback performs certificate verification according to RFC 2818, which is
+					/// little more than verifying the subject information of the certificate. This
+					/// is not the only verification that takes place. The upstream socket, which
+					/// acts on behalf of the client, is configured with a default client context
+					/// which has been configured with the cURL/Mozilla ca-bundle to use for
+					/// verification. This callback serves as an additional layer of verification,
+					/// and our only real purpose of implementing it at all is to scoop up a pointer
+					/// to the remote certificate for the purpose of spoofing it later on.
+					/// 
+					/// In the event that the remote upstream server's certificate passes
+					/// verification, it will be stored for subsuquent methods to supply to the in
+					/// memory certificate store, if no context for the remote host's hostname yet exists.
+					/// </summary>
+					/// <param name="preverified">
+					/// A bool which indicates if the current peer certificate and other context
+					/// data has pass pre-verification.
+					/// </param>
+					/// <param name="ctx">
+					/// The context containing data about the remote peer, such as the certificate
+					/// being verified.
+					/// </param>
+					/// <returns>
+					/// True if the certificate has been verified, false otherwise.
+					/// </returns>
+					bool VerifyServerCertificateCallback(bool preverified, boost::asio::ssl::verify_context& ctx);
+
+					template<bool RawTunnel>
+					void HandleDownstreamPassthrough(std::shared_ptr<std::vector<char>> buff, const boost::system::error_code& ec, const size_t bytesTransferred)
+					{
+						//ReportInfo(u8"HandleDownstreamPassthrough");
+
+						//if ((!ec || (ec == boost::asio::error::eof || (ec.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(ec.value()) == SSL_R_SHORT_READ))))
+						if(!ec)
+						{
+							SetStreamTimeout(boost::posix_time::minutes(5));
+
+							bool closeAfter = (ec == boost::asio::error::eof) || (ec == boost::asio::ssl::error::stream_truncated);
+
+							if (bytesTransferred > 0)
+							{
+								auto self(this->shared_from_this());
+
+								boost::asio::async_write(
+									PassthroughUpstream(std::integral_constant<bool, RawTunnel>()),
+									boost::asio::buffer(buff->data(), bytesTransferred),
+									boost::asio::transfer_exactly(bytesTransferred),
+									m_upstreamStrand.wrap(
+										network::MakeCustomAllocHandler(
+											m_requestPathHandlerMemory,
+											[this, self, buff, closeAfter](const boost::system::error_code& err, const size_t bytesSent)
+											{
+												if (closeAfter)
+												{
+													ReportInfo(u8"In TlsCapableHttpBridge::HandleDownstreamPassthrough(const boost::system::error_code&) - Connection closed by downstream.");
+													Kill();
+													return;
+												}
+
+												if (!err)
+												{
+													ReleaseInFlightBytes(m_requestPathInFlightBytes);
+													ReadDownstreamPassthrough<RawTunnel>(buff);
+												}
+											}
+										)
+									)
+								);
+
+								return;
+							}
+
+							if (closeAfter)
+							{
+								ReportInfo(u8"In TlsCapableHttpBridge::HandleDownstreamPassthrough(const boost::system::error_code&) - Connection closed by downstream.");
+								Kill();
+								return;
+							}
+
+							ReadDownstreamPassthrough<RawTunnel>(buff);
+							return;
+						}
+						else
+						{
+							if (ec)
+							{
+								//std::string errMsg(u8"In TlsCapableHttpBridge::HandleDownstreamPassthrough(const boost::system::error_code&) - Got error in handler:\t");
+								//errMsg.append(ec.message());
+								//ReportError(errMsg);
+							}
+						}
+
+						Kill();
+					}
+
+					template<bool RawTunnel>
+					void HandleUpstreamPassthrough(std::shared_ptr<std::vector<char>> buff, const boost::system::error_code& ec, const size_t bytesTransferred)
+					{
+						//ReportInfo(u8"HandleUpstreamPassthrough");
+
+						//if ((!ec || (ec == boost::asio::error::eof || (ec.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(ec.value()) == SSL_R_SHORT_READ))))
+						if (!ec)
+						{
+							SetStreamTimeout(boost::posix_time::minutes(5));
+
+							bool closeAfter = (ec == boost::asio::error::eof) || (ec == boost::asio::ssl::error::stream_truncated);
+
+							if (bytesTransferred > 0)
+							{
+								auto self(this->shared_from_this());
+
+								boost::asio::async_write(
+									PassthroughDownstream(std::integral_constant<bool, RawTunnel>()),
+									boost::asio::buffer(buff->data(), bytesTransferred),
+									boost::asio::transfer_exactly(bytesTransferred),
+									m_downstreamStrand.wrap(
+										network::MakeCustomAllocHandler(
+											m_responsePathHandlerMemory,
+											[this, self, buff, closeAfter](const boost::system::error_code& err, const size_t bytesSent)
+											{
+												if (closeAfter)
+												{
+													ReportInfo(u8"In TlsCapableHttpBridge::HandleUpstreamPassthrough(const boost::system::error_code&) - Connection closed by upstream.");
+													Kill();
+													return;
+												}
+
+												if (!err)
+												{
+													ReleaseInFlightBytes(m_responsePathInFlightBytes);
+													ReadUpstreamPassthrough<RawTunnel>(buff);
+												}
+											}
+										)
+									)
+								);
+
+								return;
+							}
+
+							if (closeAfter)
+							{
+								ReportInfo(u8"In TlsCapableHttpBridge::HandleUpstreamPassthrough(const boost::system::error_code&) - Connection closed by upstream.");
+								Kill();
+								return;
+							}
+
+							ReadUpstreamPassthrough<RawTunnel>(buff);
+							return;
+						}
+						else
+						{
+							if (ec)
+							{
+								//std::string errMsg(u8"In TlsCapableHttpBridge::HandleUpstreamPassthrough(const boost::system::error_code&) - Got error in handler:\t");
+								//errMsg.append(ec.message());
+								//ReportError(errMsg);
+							}
+						}
+
+						Kill();
+					}
+
+					/// <summary>
+					/// Initiates the next passthrough read from the client. Like streamed HTTP
+					/// payloads, the read is bounded to what could be reserved against the flow
+					/// control, and is paused if nothing could be reserved. The reservation is
+					/// released once the data has been written to the server.
+					/// </summary>
+					/// <param name="buff">
+					/// The buffer to read into, sized to the per-bridge limit when the volley began.
+					/// </param>
+					template<bool RawTunnel>
+					void ReadDownstreamPassthrough(std::shared_ptr<std::vector<char>> buff)
+					{
+						const uint32_t maxReadSize = ReserveInFlightBytes(m_requestPathInFlightBytes);
+
+						if (maxReadSize == 0)
+						{
+							PauseRead(true, [this, buff]() { ReadDownstreamPassthrough<RawTunnel>(buff); });
+							return;
+						}
+
+						boost::asio::async_read(
+							PassthroughDownstream(std::integral_constant<bool, RawTunnel>()),
+							boost::asio::buffer(buff->data(), std::min<size_t>(maxReadSize, buff->size())),
+							boost::asio::transfer_at_least(1),
+							network::MakeCustomAllocHandler(
+								m_requestPathHandlerMemory,
+								std::bind(
+									&TlsCapableHttpBridge::HandleDownstreamPassthrough<RawTunnel>,
+									this->shared_from_this(),
+									buff,
+									std::placeholders::_1,
+									std::placeholders::_2
+								)
+							)
+						);
+					}
+
+					/// <summary>
+					/// Initiates the next passthrough read from the server. Like streamed HTTP
+					/// payloads, the read is bounded to what could be reserved against the flow
+					/// control, and is paused if nothing could be reserved. The reservation is
+					/// released once the data has been written to the client.
+					/// </summary>
+					/// <param name="buff">
+					/// The buffer to read into, sized to the per-bridge limit when the volley began.
+					/// </param>
+					template<bool RawTunnel>
+					void ReadUpstreamPassthrough(std::shared_ptr<std::vector<char>> buff)
+					{
+						const uint32_t maxReadSize = ReserveInFlightBytes(m_responsePathInFlightBytes);
+
+						if (maxReadSize == 0)
+						{
+							PauseRead(false, [this, buff]() { ReadUpstreamPassthrough<RawTunnel>(buff); });
+							return;
+						}
+
+						boost::asio::async_read(
+							PassthroughUpstream(std::integral_constant<bool, RawTunnel>()),
+							boost::asio::buffer(buff->data(), std::min<size_t>(maxReadSize, buff->size())),
+							boost::asio::transfer_at_least(1),
+							network::MakeCustomAllocHandler(
+								m_responsePathHandlerMemory,
+								std::bind(
+									&TlsCapableHttpBridge::HandleUpstreamPassthrough<RawTunnel>,
+									this->shared_from_this(),
+									buff,
+									std::placeholders::_1,
+									std::placeholders::_2
+								)
+							)
+						);
+					}
+
+					void StartPassthroughVolley(std::shared_ptr<std::array<char, TlsPeekBufferSize>> downstreamBuff, const size_t initialBytes)
+					{	
+						ReportInfo(u8"Starting passthrough.");
+						SetStreamTimeout(boost::posix_time::minutes(5));
+
+						boost::system::error_code err;
+						err.clear();
+
+						boost::system::error_code iwe;
+						iwe.clear();
+
+						try
+						{
+							boost::asio::write(m_upstreamSocket, boost::asio::buffer(downstreamBuff->data(), initialBytes), boost::asio::transfer_exactly(initialBytes), iwe);
+						}
+						catch (std::exception& e)
+						{
+							std::string errMsg(u8"In TlsCapableHttpBridge::StartPassthroughVolley(std::shared_ptr<std::array<char, TlsPeekBufferSize>>, const size_t) - Got error while writing initial payload:\t");
+							errMsg.append(e.what());
+							ReportError(errMsg);
+						}
+
+						if (iwe)
+						{
+							std::string errMsg(u8"In TlsCapableHttpBridge::StartPassthroughVolley(std::shared_ptr<std::array<char, TlsPeekBufferSize>>, const size_t) - Got error while writing initial payload:\t");
+							errMsg.append(iwe.message());
+							ReportError(errMsg);
+						}
+
+						try
+						{
+							// Each direction only ever needs room for one bounded read, which never
+							// exceeds the per-bridge flow control limit.
+							const size_t passthroughBufferSize = m_flowControl != nullptr ? m_flowControl->GetMaxBridgeInFlightBytes() : network::FlowControl::DefaultMaxBridgeInFlightBytes;
+
+							std::shared_ptr<std::vector<char>> dsb = std::make_shared< std::vector<char> >(passthroughBufferSize);
+							std::shared_ptr<std::vector<char>> usb = std::make_shared< std::vector<char> >(passthroughBufferSize);
+
+							HandleDownstreamPassthrough<false>(dsb, err, 0);
+							HandleUpstreamPassthrough<false>(usb, err, 0);
+
+						}
+						catch (std::exception& e)
+						{
+							std::string errMsg(u8"In TlsCapableHttpBridge::StartPassthroughVolley(std::shared_ptr<std::array<char, TlsPeekBufferSize>>, const size_t) - Got errorsss while writing initial payload:\t");
+							errMsg.append(e.what());
+							ReportError(errMsg);
+						}
+					}
+
+					/// <summary>
+					/// Degrades the bridge to a plain TCP tunnel between the client and the server.
+					/// Only valid for TLS bridges that have connected upstream but have not yet
+					/// begun handshaking. At that point the client hello has only been peeked, so
+					/// it is still waiting to be read from the client's socket, and the client and
+					/// server can simply handshake with each other through us. Nothing is filtered.
+					/// </summary>
+					void StartTunnel()
+					{
+						SetStreamTimeout(boost::posix_time::minutes(5));
+
+						SetNoDelay(UpstreamSocket(), true);
+						SetNoDelay(DownstreamSocket(), true);
+
+						try
+						{
+							const size_t tunnelBufferSize = m_flowControl != nullptr ? m_flowControl->GetMaxBridgeInFlightBytes() : network::FlowControl::DefaultMaxBridgeInFlightBytes;
+
+							std::shared_ptr<std::vector<char>> dsb = std::make_shared< std::vector<char> >(tunnelBufferSize);
+							std::shared_ptr<std::vector<char>> usb = std::make_shared< std::vector<char> >(tunnelBufferSize);
+
+							boost::system::error_code err;
+							HandleDownstreamPassthrough<true>(dsb, err, 0);
+							HandleUpstreamPassthrough<true>(usb, err, 0);
+							return;
+						}
+						catch (std::exception& e)
+						{
+							std::string errMsg(u8"In TlsCapableHttpBridge::StartTunnel() - Got error:\t");
+							errMsg.append(e.what());
+							ReportError(errMsg);
+						}
+
+						Kill();
+					}
+
+					/// <summary>
+					/// Gets the stream that passthrough data is written to and read from on the
+					/// server's side. For a regular volley, that's the bridge socket, which for TLS
+					/// bridges means going through the TLS session we have with the server.
+					/// </summary>
+					BridgeSocketType& PassthroughUpstream(std::false_type)
+					{
+						return m_upstreamSocket;
+					}
+
+					/// <summary>
+					/// Gets the stream that passthrough data is written to and read from on the
+					/// server's side. For a tunnel, that's always the underlying TCP socket.
+					/// </summary>
+					boost::asio::ip::tcp::socket& PassthroughUpstream(std::true_type)
+					{
+						return UpstreamSocket();
+					}
+
+					/// <summary>
+					/// Gets the stream that passthrough data is written to and read from on the
+					/// client's side. For a regular volley, that's the bridge socket, which for TLS
+					/// bridges means going through the TLS session we have with the client.
+					/// </summary>
+					BridgeSocketType& PassthroughDownstream(std::false_type)
+					{
+						return m_downstreamSocket;
+					}
+
+					/// <summary>
+					/// Gets the stream that passthrough data is written to and read from on the
+					/// client's side. For a tunnel, that's always the underlying TCP socket.
+					/// </summary>
+					boost::asio::ip::tcp::socket& PassthroughDownstream(std::true_type)
+					{
+						return DownstreamSocket();
+					}
+
+					/// <summary>
+					/// Attempts to take the handshake and spoof slots that a TLS bridge must hold
+					/// before it begins intercepting. If only one of the two could be taken, it is
+					/// given back.
+					/// </summary>
+					/// <returns>
+					/// True if both slots were taken or there is no admission control, false
+					/// otherwise.
+					/// </returns>
+					const bool TryBeginTlsInterception()
+					{
+						if (m_admissionControl == nullptr)
+						{
+							return true;
+						}
+
+						m_holdsHandshakeSlot = m_admissionControl->TryBeginHandshake();
+
+						if (!m_holdsHandshakeSlot)
+						{
+							return false;
+						}
+
+						m_holdsSpoofSlot = m_admissionControl->TryBeginSpoof();
+
+						if (!m_holdsSpoofSlot)
+						{
+							ReleaseHandshakeSlot();
+							return false;
+						}
+
+						return true;
+					}
+
+					/// <summary>
+					/// Releases the handshake slot, if held.
+					/// </summary>
+					void ReleaseHandshakeSlot()
+					{
+						if (m_holdsHandshakeSlot)
+						{
+							m_admissionControl->ReleaseHandshake();
+							m_holdsHandshakeSlot = false;
+						}
+					}
+
+					/// <summary>
+					/// Releases the spoof slot, if held.
+					/// </summary>
+					void ReleaseSpoofSlot()
+					{
+						if (m_holdsSpoofSlot)
+						{
+							m_admissionControl->ReleaseSpoof();
+							m_holdsSpoofSlot = false;
+						}
+					}
+
+					/// <summary>
+					/// Attempts to start the HTTP transaction process by doing a peek read from the
+					/// downstream (client) socket, to determine if the incoming data is legal HTTP
+					/// data. If this is the case, then this function will initiate the asynchronous
+					/// operation to read all headers from the downstream socket.
+					///
+					/// If it is determined that the incoming data is not HTTP data, but is Websocket
+					/// data, then the process will start a back and forth volley with a raw buffer
+					/// between the upstream and downstream sockets, passing the data through
+					/// directly without processing or parsing it.
+					/// </summary>
+					void TryInitiateHttpTransaction()
+					{
+						try
+						{
+							// Allow 5 seconds for a peek read.
+							SetStreamTimeout(boost::posix_time::minutes(5));
+
+							std::shared_ptr<std::array<char, TlsPeekBufferSize>> httpPeekBuffer = std::make_shared< std::array<char, TlsPeekBufferSize> >();
+
+							boost::asio::async_read(
+								m_downstreamSocket,
+								boost::asio::buffer(httpPeekBuffer->data(), httpPeekBuffer->size()),
+								boost::asio::transfer_at_least(18),
+								m_downstreamStrand.wrap(
+									network::MakeCustomAllocHandler(
+										m_requestPathHandlerMemory,
+										std::bind(
+											&TlsCapableHttpBridge::OnInitialPeek,
+											this->shared_from_this(),
+											std::placeholders::_1,
+											std::placeholders::_2,
+											httpPeekBuffer)
+									)
+								)
+							);
+						}
+						catch (std::exception& e)
+						{
+							std::string err(e.what());
+							ReportError(err);
+						}
+					}
+					
+
+					void OnInitialPeek(const boost::system::error_code& error, const size_t bytesTransferred, std::shared_ptr<std::array<char, TlsPeekBufferSize>> httpPeekBuffer)
+					{
+						if (!error && httpPeekBuffer && httpPeekBuffer.get() && httpPeekBuffer->data() && bytesTransferred > 0)
+						{
+							
+							// Cancel the stream timeout mechanism before entering starting this process. We're going to need
+							// to possibly leave this cancelled if we're handling a passthrough connection.
+							SetStreamTimeout(boost::posix_time::minutes(5));
+							
+							// The peeked bytes go straight into the request that will carry them, and
+							// are parsed there, once.
+							std::unique_ptr<http::HttpRequest> request;
+
+							try
+							{
+								request.reset(new http::HttpRequest(httpPeekBuffer->data(), bytesTransferred));
+							}
+							catch (std::exception& e)
+							{
+								ReportError(e.what());
+								Kill();
+								return;
+							}
+
+							PreviewParser p;
+							std::string parsedHost;
+							auto parseResult = p.Parse(*request, bytesTransferred, parsedHost);
+
+							switch (parseResult)
+							{
+								case PreviewParser::ParseResult::Failure:
+								{
+									ReportError(u8"In TlsCapableHttpBridge:: InitiateHttpTransaction() - Failed when trying to peek connected client.");
+									Kill();
+									return;
+								}
+								break;
+
+								case PreviewParser::ParseResult::IsHttp:
+								{	
+									// Just go ahead and start officially reading the headers.
+
+									// Set the timeout to something reasonable.
+									SetStreamTimeout(boost::posix_time::minutes(5));
+
+									// Hand over the request the peeked data was parsed into and just jump to
+									// OnDownstreamHeaders.
+									m_request = std::move(request);
+									m_requestAlreadyParsed = true;
+									m_shouldTerminate = false;
+
+									OnDownstreamHeaders(error, bytesTransferred);
+									return;									
+								}
+								break;
+
+								case PreviewParser::ParseResult::HttpWithUpgrade:
+								{
+									ReportInfo(u8"HTTP with upgrade.");
+
+									// If it's non-TLS, then we need to resolve the host and connect to it
+									// as well. If it is TLS, then we don't care because this is done
+									// right away on connect with TLS clients because the host is extracted
+									// from SNI extension.
+									bool needsResolveAndConnect = std::is_same<BridgeSocketType, network::TcpSocket>::value;
+
+									if (needsResolveAndConnect)
+									{
+										
+										SetStreamTimeout(boost::posix_time::minutes(5));
+
+										if (parsedHost.size() == 0)
+										{
+											ReportWarning(u8"HTTP-With-Upgrade passthrough detected, but no host extracted.");
+											Kill();
+											return;
+										}
+
+										// Trim port, if present.
+										auto portPos = parsedHost.find_last_of(u8":");
+
+										// Find out if a custom port is being used and pass it
+										// to our resolve handler so we can adjust where we're
+										// connecting to on resolve.
+										uint16_t customPort = 0;
+
+										if (portPos != std::string::npos)
+										{
+											
+											parsedHost = parsedHost.substr(0, portPos);
+
+											if (portPos + 1 < parsedHost.size())
+											{
+												
+												try
+												{
+													customPort = static_cast<uint16_t>(std::stoi(parsedHost.substr(portPos + 1)));
+												}
+												catch (...)
+												{
+													
+													customPort = 0;
+												}
 											}
 										}
-										else
+
+										/*
+										if (m_filteringEngine->ShouldBlockHost(parsedHost))
 										{
-											ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Failed to extract hostname from SNI extension.");
+											// This host is filtered.
+											Kill();
+											return;
 										}
+										*/
+
+										boost::asio::ip::tcp::resolver::query query(parsedHost, std::is_same<BridgeSocketType, network::TlsSocket>::value ? "https" : "http");
+
+										auto self(this->shared_from_this());
+
+										m_resolver.async_resolve(
+											query,
+											m_upstreamStrand.wrap(											
+												[this, self, customPort, httpPeekBuffer, bytesTransferred](const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpointIterator)
+												{
+													if (!error)
+													{
+														auto ep = *endpointIterator;
+
+														if (customPort != 0)
+														{
+															// A custom port was parsed from the peeked request headers.
+								
+															ep.endpoint().port(customPort);
+														}
+
+														UpstreamSocket().async_connect(
+															ep,
+															m_upstreamStrand.wrap(
+																[this, self, httpPeekBuffer, bytesTransferred](const boost::system::error_code& error)
+																{
+																	if (!error)
+																	{
+																		// We managed to connect, do just start to volley.
+																		StartPassthroughVolley(httpPeekBuffer, bytesTransferred);
+																		return;
+																	}
+
+																	// Failed to connect.
+																	ReportInfo(u8"Failed to connect");
+																	Kill();
+																}
+															)
+														);
+
+														return;
+													}
+
+						
+													// Failed to resolve host.
+													ReportInfo(u8"Failed to resolve");
+													Kill();
+												}
+											)
+										);										
+
+										return;
 									}
 									else
 									{
-										ReportWarning(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Not a TLS client hello.");
+										// Check here if already-established host is blocked. In this case, the host would have been
+										// extracted via SNI extension parsing.
+										if (m_upstreamHost.size() > 0)
+										{
+											/*
+											if (m_filteringEngine->ShouldBlockHost(m_upstreamHost))
+											{
+												// This host is filtered.
+												Kill();
+												return;
+											}
+											*/
+										}
+
+										// We're already connected as HTTPS so just do the volley.
+										StartPassthroughVolley(httpPeekBuffer, bytesTransferred);
+										return;
 									}
 								}
-								else
-								{
-									ReportWarning(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Not a TLS client.");
+								break;
+
+								case PreviewParser::ParseResult::NotHttp:
+								{	
+									// If this is not HTTP AND it's not TLS with SNI, then we can't do anything about this.
+									if (std::is_same<BridgeSocketType, network::TcpSocket>::value)
+									{
+										
+										ReportError(u8"In TlsCapableHttpBridge::TryInitiateHttpTransaction() - Connected client is non-tls and sending content in an unexpected protocol. Terminating because no mechanism exists to resolve the original upstream host.");
+										Kill();
+										return;
+									}
+									else
+									{
+										ReportInfo(u8"Not http and is TLS.");
+
+										// Check here if already-established host is blocked. In this case, the host would have been
+										// extracted via SNI extension parsing.
+										if (m_upstreamHost.size() > 0)
+										{
+											/*
+											if (m_filteringEngine->ShouldBlockHost(m_upstreamHost))
+											{
+												// This host is filtered.
+												Kill();
+												return;
+											}
+											*/
+										}
+
+										// We're already connected as HTTPS so just do the volley.
+										StartPassthroughVolley(httpPeekBuffer, bytesTransferred);
+										return;
+									}
 								}
+								break;
 							}
 						}
-						else
-						{							
-							if (error)
-							{
-								std::string errorMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Got Error:\t");
-								errorMessage.append(error.message());
-								ReportError(errorMessage);
-							}
-							else if(!m_tlsPeekBuffer)
+
+						//Kill();
+					}								
+
+					/// <summary>
+					/// Sets the duration from now when the stream timer should expire.
+					/// </summary>
+					/// <param name="expiry">
+					/// The boost::posix_time::time_duration when the expiry should occur from now.
+					/// </param>
+					void SetStreamTimeout(const boost::posix_time::time_duration& expiry)
+					{
+						m_streamTimer.cancel();
+
+						m_streamTimer.expires_from_now(expiry);
+
+						m_streamTimer.async_wait(std::bind(&TlsCapableHttpBridge::OnStreamTimeout, this->shared_from_this(), std::placeholders::_1));
+					}
+
+					/// <summary>
+					/// Cancels the current stream timer and then sets it to positive infinity.
+					/// </summary>
+					void SetInfiniteStreamTimeout()
+					{
+						m_streamTimer.cancel();
+
+						m_streamTimer.expires_at(boost::posix_time::pos_infin);
+						return;
+					}
+
+					/// <summary>
+					/// Sets the linger option to the specified values for the supplied socket.
+					/// </summary>
+					/// <param name="socket">
+					/// The socket to configure.
+					/// </param>
+					/// <param name="enabled">
+					/// The value indicating whether the property should be enabled or disabled.
+					/// </param>
+					/// <param name="value">
+					/// The linger timeout, in the event that the property is enabled.
+					/// </param>
+					void SetLinger(boost::asio::ip::tcp::socket& socket, const bool enabled, const int value)
+					{
+						boost::system::error_code err;
+
+						socket.lowest_layer().set_option(boost::asio::socket_base::linger(enabled, value), err);
+
+						if (err)
+						{
+							std::string errorMessage(u8"In TlsCapableHttpBridge<BridgeSocketType>::SetLinger(boost::asio::ip::tcp::socket&, const bool) - While setting linger state, got error:\t");
+							errorMessage.append(err.message());
+							ReportError(errorMessage);
+						}
+					}
+
+					/// <summary>
+					/// Enables or disables the TCP Nagle algorithm for the supplied socket.
+					/// </summary>
+					/// <param name="socket">
+					/// The socket to configure.
+					/// </param>
+					/// <param name="value">
+					/// The value indicating whether the property should be enabled or disabled.
+					/// </param>
+					void SetNoDelay(boost::asio::ip::tcp::socket& socket, const bool value)
+					{
+						boost::system::error_code err;
+						
+						socket.lowest_layer().set_option(boost::asio::ip::tcp::no_delay(value), err);
+
+						if (err)
+						{
+							std::string errorMessage(u8"In TlsCapableHttpBridge<BridgeSocketType>::SetNoDelay(boost::asio::ip::tcp::socket&, const bool) - While setting Nagle algorithm enabled state, got error:\t");
+							errorMessage.append(err.message());
+							ReportError(errorMessage);
+						}
+					}
+
+					/// <summary>
+					/// Determines if the supplied socket has data waiting to be read off the buffer.
+					/// This is used to attempt to determine if a transaction is complete whenever we
+					/// have to handle a passthrough connection.
+					/// </summary>
+					/// <param name="socket">
+					/// The socket to be polled.
+					/// </param>
+					/// <returns>
+					/// True of the supplied socket has data to be read, false otherwise.
+					/// </returns>
+					const bool SocketHasData(boost::asio::ip::tcp::socket& socket)
+					{
+						boost::asio::socket_base::bytes_readable command(true);
+						socket.io_control(command);
+						std::size_t bytes_readable = command.get();
+
+						return bytes_readable > 0;
+					}
+
+					/// <summary>
+					/// Fills the supplied message view for the supplied transaction. Header views
+					/// are kept in thread local containers that are reused for every call, so once
+					/// they've grown large enough, this allocates nothing. The views are valid until
+					/// the next call on the same thread, or until the transaction is modified.
+					/// </summary>
+					/// <param name="message">
+					/// The message view to fill. Body fields are left for the caller.
+					/// </param>
+					/// <param name="request">
+					/// The request.
+					/// </param>
+					/// <param name="response">
+					/// The response, if any.
+					/// </param>
+					void FillMessageView(HttpMessageView& message, http::HttpRequest* request, http::HttpResponse* response)
+					{
+						static thread_local std::vector<HttpHeaderView> requestHeaderViews;
+						static thread_local std::vector<HttpHeaderView> responseHeaderViews;
+
+						std::memset(&message, 0, sizeof(message));
+
+						request->HeadersToViews(requestHeaderViews);
+
+						const char* method = http_method_str(request->Method());
+
+						message.method = method;
+						message.methodLength = static_cast<uint32_t>(std::strlen(method));
+						message.uri = request->RequestURI().c_str();
+						message.uriLength = static_cast<uint32_t>(request->RequestURI().size());
+						message.requestHeaders = requestHeaderViews.data();
+						message.requestHeaderCount = static_cast<uint32_t>(requestHeaderViews.size());
+
+						for (const auto& view : requestHeaderViews)
+						{
+							if (view.knownHeaderId == HttpKnownHeaderHost)
 							{
-								ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - TLS peek buffer is nullptr!");
+								message.host = view.value;
+								message.hostLength = view.valueLength;
+								break;
 							}
 						}
 
-						Kill();
+						if (message.host == nullptr)
+						{
+							message.host = m_upstreamHost.c_str();
+							message.hostLength = static_cast<uint32_t>(m_upstreamHost.size());
+						}
+
+						if (response != nullptr)
+						{
+							response->HeadersToViews(responseHeaderViews);
+
+							message.statusCode = response->StatusCode();
+							message.statusLine = response->StatusString().c_str();
+							message.statusLineLength = static_cast<uint32_t>(response->StatusString().size());
+							message.responseHeaders = responseHeaderViews.data();
+							message.responseHeaderCount = static_cast<uint32_t>(responseHeaderViews.size());
+						}
 					}
 
 					/// <summary>
-					/// Callback supplied for the handshake process with the remote upstream server.
-					/// This is the client verifying the validity of the server's certificate. This
-					/// callback performs certificate verification according to RFC 2818, which is
-					/// little more than verifying the subject information of the certificate. This
-					/// is not the only verification that takes place. The upstream socket, which
-					/// acts on behalf of the client, is configured with a default client context
-					/// which has been configured with the cURL/Mozilla ca-bundle to use for
-					/// verification. This callback serves as an additional layer of verification,
-					/// and our only real purpose of implementing it at all is to scoop up a pointer
-					/// to the remote certificate for the purpose of spoofing it later on.
-					/// 
-					/// In the event that the remote upstream server's certificate passes
-					/// verification, it will be stored for subsuquent methods to supply to the in
-					/// memory certificate store, if no context for the remote host's hostname yet exists.
+					/// Gets the host a request is for, from its Host header if it has one, or else
+					/// the host we're connected to.
 					/// </summary>
-					/// <param name="preverified">
-					/// A bool which indicates if the current peer certificate and other context
-					/// data has pass pre-verification.
+					/// <param name="request">
+					/// The request.
 					/// </param>
-					/// <param name="ctx">
-					/// The context containing data about the remote peer, such as the certificate
-					/// being verified.
+					/// <returns>
+					/// The host the request is for, possibly including a port.
+					/// </returns>
+					const std::string& GetRequestHost(http::HttpRequest* request)
+					{
+						auto hostHeader = request->GetHeader(util::http::headers::Host);
+
+						if (hostHeader.first != hostHeader.second)
+						{
+							return hostHeader.first->second;
+						}
+
+						return m_upstreamHost;
+					}
+
+					/// <summary>
+					/// Checks a host against the hostname blocklist, if one is loaded. m_verdictControl
+					/// must not be nullptr.
+					/// </summary>
+					/// <param name="snapshot">
+					/// The filtering snapshot to check against.
+					/// </param>
+					/// <param name="host">
+					/// The host, possibly including a port.
+					/// </param>
+					/// <param name="record">
+					/// Whether to count the check.
 					/// </param>
 					/// <returns>
-					/// True if the certificate has been verified, false otherwise.
+					/// True if the host or one of its parents is on the blocklist, false otherwise.
 					/// </returns>
-					bool VerifyServerCertificateCallback(bool preverified, boost::asio::ssl::verify_context& ctx);
+					const bool IsHostBlocklisted(const filtering::FilterSnapshot& snapshot, boost::string_ref host, const bool record = true)
+					{
+						if (!snapshot.blocklist)
+						{
+							return false;
+						}
+
+						const bool blocked = snapshot.blocklist->Contains(host);
+
+						if (record)
+						{
+							m_verdictControl->RecordBlocklistCheck(blocked);
+						}
 
-					void HandleDownstreamPassthrough(std::shared_ptr<std::array<char, 1638400>> buff, const boost::system::error_code& ec, const size_t bytesTransferred)
+						return blocked;
+					}
+
+					/// <summary>
+					/// Matches a request against the native rules, if any are loaded. m_verdictControl
+					/// must not be nullptr.
+					/// </summary>
+					/// <param name="snapshot">
+					/// The filtering snapshot to match against.
+					/// </param>
+					/// <param name="request">
+					/// The request.
+					/// </param>
+					/// <param name="record">
+					/// Whether to count the verdict.
+					/// </param>
+					/// <returns>
+					/// The verdict of the native rules, or NoMatch if none are loaded.
+					/// </returns>
+					const filtering::RuleMatcher::Verdict MatchRules(const filtering::FilterSnapshot& snapshot, http::HttpRequest* request, const bool record = true)
 					{
-						//ReportInfo(u8"HandleDownstreamPassthrough");
+						const auto& rules = snapshot.rules;
 
-						//if ((!ec || (ec == boost::asio::error::eof || (ec.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(ec.value()) == SSL_R_SHORT_READ))))
-						if(!ec)
+						if (!rules)
 						{
-							SetStreamTimeout(boost::posix_time::minutes(5));
+							return filtering::RuleMatcher::Verdict::NoMatch;
+						}
 
-							bool closeAfter = (ec == boost::asio::error::eof) || ((ec.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(ec.value()) == SSL_R_SHORT_READ));
+						static const std::string SecFetchDest{ u8"Sec-Fetch-Dest" };
 
-							if (bytesTransferred > 0)
-							{
-								auto self(shared_from_this());
+						auto headerValue = [request](const std::string& name)
+						{
+							auto header = request->GetHeader(name);
+							return header.first != header.second ? boost::string_ref(header.first->second) : boost::string_ref();
+						};
 
-								boost::asio::async_write(
-									m_upstreamSocket,
-									boost::asio::buffer(buff->data(), bytesTransferred),
-									boost::asio::transfer_exactly(bytesTransferred),
-									m_upstreamStrand.wrap(
-										[this, self, buff, closeAfter](const boost::system::error_code& err, const size_t bytesSent)
-										{
-											if (closeAfter)
-											{
-												ReportInfo(u8"In TlsCapableHttpBridge::HandleDownstreamPassthrough(const boost::system::error_code&) - Connection closed by downstream.");
-												Kill();
-												return;
-											}
+						const std::string& uri = request->RequestURI();
 
-											if (!err)
-											{
-												boost::asio::async_read(
-													m_downstreamSocket,
-													boost::asio::buffer(buff->data(), buff->size()),
-													boost::asio::transfer_at_least(1),
-													std::bind(
-														&TlsCapableHttpBridge::HandleDownstreamPassthrough,
-														shared_from_this(),
-														buff,
-														std::placeholders::_1,
-														std::placeholders::_2
-													)
-												);
-											}
-										}
-									)
-								);
+						// Requests meant for a proxy already carry the absolute URL.
+						std::string url;
+						if (uri.find(u8"://") != std::string::npos)
+						{
+							url = uri;
+						}
+						else
+						{
+							url = std::is_same<BridgeSocketType, network::TlsSocket>::value ? u8"https://" : u8"http://";
+							url.append(GetRequestHost(request));
+							url.append(uri);
+						}
 
-								return;
-							}
+						filtering::RuleMatcher::Request ruleRequest;
+						ruleRequest.url = url;
+						ruleRequest.documentUrl = headerValue(util::http::headers::Referer);
 
-							if (closeAfter)
+						if (ruleRequest.documentUrl.empty())
+						{
+							ruleRequest.documentUrl = headerValue(util::http::headers::Origin);
+
+							// Sent by sandboxed and privacy sensitive contexts, and means nothing.
+							if (ruleRequest.documentUrl == u8"null")
 							{
-								ReportInfo(u8"In TlsCapableHttpBridge::HandleDownstreamPassthrough(const boost::system::error_code&) - Connection closed by downstream.");
-								Kill();
-								return;
+								ruleRequest.documentUrl.clear();
 							}
+						}
 
-							boost::asio::async_read(
-								m_downstreamSocket,
-								boost::asio::buffer(buff->data(), buff->size()),
-								boost::asio::transfer_at_least(1),
-								std::bind(
-									&TlsCapableHttpBridge::HandleDownstreamPassthrough,
-									shared_from_this(),
-									buff,
-									std::placeholders::_1,
-									std::placeholders::_2
-								)
+						ruleRequest.type = filtering::RuleMatcher::InferRequestType(
+							headerValue(SecFetchDest), headerValue(util::http::headers::Accept),
+							headerValue(util::http::headers::XRequestedWith), headerValue(util::http::headers::Upgrade),
+							uri
 							);
 
-							return;
-						}
-						else
+						auto verdict = rules->Match(ruleRequest);
+
+						if (record)
 						{
-							if (ec)
-							{
-								//std::string errMsg(u8"In TlsCapableHttpBridge::HandleDownstreamPassthrough(const boost::system::error_code&) - Got error in handler:\t");
-								//errMsg.append(ec.message());
-								//ReportError(errMsg);
-							}
+							m_verdictControl->RecordRuleVerdict(verdict);
 						}
 
-						Kill();
+						return verdict;
 					}
 
-					void HandleUpstreamPassthrough(std::shared_ptr<std::array<char, 1638400>> buff, const boost::system::error_code& ec, const size_t bytesTransferred)
+					/// <summary>
+					/// Consults the inspection policy, if there is one, about a response that has
+					/// been flagged for inspection and whose headers have just been checked. The
+					/// policy may have the response streamed without inspection, in which case it's
+					/// no longer flagged, or have only its first bytes inspected. A sample asked for
+					/// by the message begin callback takes precedence over the policy. A response in
+					/// a coding we can't decompress is streamed regardless. Forgets whatever was
+					/// decided for the previous response either way.
+					/// </summary>
+					void ApplyInspectionPolicy()
 					{
-						//ReportInfo(u8"HandleUpstreamPassthrough");
+						m_responsePolicy.reset();
+						m_responsePolicyEntry = 0;
 
-						//if ((!ec || (ec == boost::asio::error::eof || (ec.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(ec.value()) == SSL_R_SHORT_READ))))
-						if (!ec)
+						if (!m_response->GetConsumeAllBeforeSending() || m_response->IsPayloadComplete())
 						{
-							SetStreamTimeout(boost::posix_time::minutes(5));
+							m_responseSampleBytes = 0;
+							return;
+						}
 
-							bool closeAfter = (ec == boost::asio::error::eof) || ((ec.category() == boost::asio::error::get_ssl_category()) && (ERR_GET_REASON(ec.value()) == SSL_R_SHORT_READ));
+						// A response in a coding we can't decompress, which hosts that keep the
+						// client's Accept-Encoding may well send, could only ever be inspected as
+						// compressed bytes. So there's no point holding any of it.
+						if (!m_response->IsPayloadDecodable())
+						{
+							m_response->SetConsumeAllBeforeSending(false);
+							m_responseSampleBytes = 0;
+							return;
+						}
 
-							if (bytesTransferred > 0)
-							{
-								auto self(shared_from_this());
+						if (m_verdictControl == nullptr || m_responseSampleBytes > 0)
+						{
+							return;
+						}
 
-								boost::asio::async_write(
-									m_downstreamSocket,
-									boost::asio::buffer(buff->data(), bytesTransferred),
-									boost::asio::transfer_exactly(bytesTransferred),
-									m_downstreamStrand.wrap(
-										[this, self, buff, closeAfter](const boost::system::error_code& err, const size_t bytesSent)
-										{
-											if (closeAfter)
-											{
-												ReportInfo(u8"In TlsCapableHttpBridge::HandleUpstreamPassthrough(const boost::system::error_code&) - Connection closed by upstream.");
-												Kill();
-												return;
-											}
+						auto policy = m_verdictControl->GetSnapshot()->inspectionPolicy;
 
-											if (!err)
-											{
-												boost::asio::async_read(
-													m_upstreamSocket,
-													boost::asio::buffer(buff->data(), buff->size()),
-													boost::asio::transfer_at_least(1),
-													std::bind(
-														&TlsCapableHttpBridge::HandleUpstreamPassthrough,
-														shared_from_this(),
-														buff,
-														std::placeholders::_1,
-														std::placeholders::_2
-													)
-												);
-											}
-										}
-									)
-								);
+						if (!policy)
+						{
+							return;
+						}
 
-								return;
-							}
+						auto contentTypeHeader = m_response->GetHeader(util::http::headers::ContentType);
+						auto contentLengthHeader = m_response->GetHeader(util::http::headers::ContentLength);
 
-							if (closeAfter)
+						boost::string_ref contentType;
+						if (contentTypeHeader.first != contentTypeHeader.second)
+						{
+							contentType = contentTypeHeader.first->second;
+						}
+
+						// Chunked transfer wins over any Content-Length, and without either, the
+						// response runs until the server closes the connection.
+						int64_t contentLength = -1;
+						if (contentLengthHeader.first != contentLengthHeader.second && !m_response->IsPayloadChunked())
+						{
+							try
 							{
-								ReportInfo(u8"In TlsCapableHttpBridge::HandleUpstreamPassthrough(const boost::system::error_code&) - Connection closed by upstream.");
-								Kill();
-								return;
+								contentLength = static_cast<int64_t>(std::stoll(contentLengthHeader.first->second));
+							}
+							catch (...)
+							{
+								contentLength = -1;
 							}
+						}
 
-							boost::asio::async_read(
-								m_upstreamSocket,
-								boost::asio::buffer(buff->data(), buff->size()),
-								boost::asio::transfer_at_least(1),
-								std::bind(
-									&TlsCapableHttpBridge::HandleUpstreamPassthrough,
-									shared_from_this(),
-									buff,
-									std::placeholders::_1,
-									std::placeholders::_2
-								)
-							);
+						const auto decision = policy->Decide(contentType, contentLength);
 
-							return;
-						}
-						else
+						switch (decision.action)
 						{
-							if (ec)
+							case filtering::InspectionPolicy::Action::Stream:
 							{
-								//std::string errMsg(u8"In TlsCapableHttpBridge::HandleUpstreamPassthrough(const boost::system::error_code&) - Got error in handler:\t");
-								//errMsg.append(ec.message());
-								//ReportError(errMsg);
+								m_response->SetConsumeAllBeforeSending(false);
 							}
-						}
-
-						Kill();
-					}
+							break;
 
-					void StartPassthroughVolley(std::shared_ptr<std::array<char, TlsPeekBufferSize>> downstreamBuff, const size_t initialBytes)
-					{	
-						ReportInfo(u8"Starting passthrough.");
-						SetStreamTimeout(boost::posix_time::minutes(5));
+							case filtering::InspectionPolicy::Action::Sample:
+							{
+								m_responseSampleBytes = decision.sampleBytes;
+							}
+							break;
 
-						boost::system::error_code err;
-						err.clear();
+							default:
+							break;
+						}
 
-						boost::system::error_code iwe;
-						iwe.clear();
+						m_responsePolicyEntry = decision.entry;
+						m_responsePolicy = std::move(policy);
+					}
 
-						try
-						{
-							boost::asio::write(m_upstreamSocket, boost::asio::buffer(downstreamBuff->data(), initialBytes), boost::asio::transfer_exactly(initialBytes), iwe);
-						}
-						catch (std::exception& e)
+					/// <summary>
+					/// Checks whether a response flagged for inspection is ready to be handed to
+					/// the message end callback, either because it's complete, or because we're
+					/// only inspecting its first bytes and have enough of them.
+					/// </summary>
+					/// <param name="response">
+					/// The response. May be nullptr.
+					/// </param>
+					/// <returns>
+					/// True if the response is ready for inspection, false otherwise.
+					/// </returns>
+					const bool IsResponseReadyForInspection(http::HttpResponse* response) const
+					{
+						if (response == nullptr || !response->GetConsumeAllBeforeSending())
 						{
-							std::string errMsg(u8"In TlsCapableHttpBridge::StartPassthroughVolley(std::shared_ptr<std::array<char, TlsPeekBufferSize>>, const size_t) - Got error while writing initial payload:\t");
-							errMsg.append(e.what());
-							ReportError(errMsg);
+							return false;
 						}
 
-						if (iwe)
+						return response->IsPayloadComplete() || (m_responseSampleBytes > 0 && response->GetPayload().size() >= m_responseSampleBytes);
+					}
+
+					/// <summary>
+					/// Checks whether what we have of a response is only the first bytes of its
+					/// payload, held for inspection under the inspection policy.
+					/// </summary>
+					/// <param name="response">
+					/// The response. May be nullptr.
+					/// </param>
+					/// <returns>
+					/// True if the response payload is a sample, false otherwise.
+					/// </returns>
+					const bool IsResponseSample(http::HttpResponse* response) const
+					{
+						return response != nullptr && m_responseSampleBytes > 0 && response->GetConsumeAllBeforeSending() && !response->IsPayloadComplete();
+					}
+
+					/// <summary>
+					/// Once a sample of the response has been inspected and allowed, has the rest
+					/// of the response streamed, starting with the sample itself. The sample was
+					/// held without its chunked framing, if it had any, which the response puts
+					/// back when it's written.
+					/// </summary>
+					void EndResponseSample()
+					{
+						if (IsResponseSample(m_response.get()))
 						{
-							std::string errMsg(u8"In TlsCapableHttpBridge::StartPassthroughVolley(std::shared_ptr<std::array<char, TlsPeekBufferSize>>, const size_t) - Got error while writing initial payload:\t");
-							errMsg.append(iwe.message());
-							ReportError(errMsg);
+							m_response->SetConsumeAllBeforeSending(false);
 						}
 
-						try
+						m_responseSampleBytes = 0;
+					}
+
+					/// <summary>
+					/// Hands a transaction that was flagged for inspection and is now complete to
+					/// the message end callback, in whichever form was supplied.
+					/// </summary>
+					void NotifyMessageEnd(
+						http::HttpRequest* request, http::HttpResponse* response,
+						const char* requestPayload, const uint32_t requestPayloadSize,
+						const char* responsePayload, const uint32_t responsePayloadSize,
+						bool* shouldBlock, void* writerContext
+						)
+					{
+						if (m_onMessageEndView)
 						{
-							std::shared_ptr<std::array<char, 1638400>> dsb = std::make_shared< std::array<char, 1638400> >();
-							std::shared_ptr<std::array<char, 1638400>> usb = std::make_shared< std::array<char, 1638400> >();
+							HttpMessageView message;
+							FillMessageView(message, request, response);
 
-							HandleDownstreamPassthrough(dsb, err, 0);
-							HandleUpstreamPassthrough(usb, err, 0);
+							if (IsResponseSample(response))
+							{
+								message.flags |= HttpMessageFlagResponseBodyTruncated;
+							}
 
+							message.requestBody = requestPayload;
+							message.requestBodyLength = requestPayloadSize;
+							message.responseBody = responsePayload;
+							message.responseBodyLength = responsePayloadSize;
+
+							m_onMessageEndView(&message, shouldBlock, &util::cb::ContextStreamCopyUtil::Write, writerContext);
+							return;
 						}
-						catch (std::exception& e)
-						{
-							std::string errMsg(u8"In TlsCapableHttpBridge::StartPassthroughVolley(std::shared_ptr<std::array<char, TlsPeekBufferSize>>, const size_t) - Got errorsss while writing initial payload:\t");
-							errMsg.append(e.what());
-							ReportError(errMsg);
-						}
+
+						auto requestHeaders = request->HeadersToString();
+						auto responseHeaders = response != nullptr ? response->HeadersToString() : std::string();
+
+						m_onMessageEnd(
+							requestHeaders.c_str(), requestHeaders.size(),
+							requestPayload, requestPayloadSize,
+							responseHeaders.c_str(), responseHeaders.size(),
+							responsePayload, responsePayloadSize,
+							shouldBlock, &util::cb::ContextStreamCopyUtil::Write, writerContext
+							);
 					}
 
 					/// <summary>
-					/// Attempts to start the HTTP transaction process by doing a peek read from the
-					/// downstream (client) socket, to determine if the incoming data is legal HTTP
-					/// data. If this is the case, then this function will initiate the asynchronous
-					/// operation to read all headers from the downstream socket.
-					///
-					/// If it is determined that the incoming data is not HTTP data, but is Websocket
-					/// data, then the process will start a back and forth volley with a raw buffer
-					/// between the upstream and downstream sockets, passing the data through
-					/// directly without processing or parsing it.
+					/// Hands a transaction whose headers are complete to the message begin
+					/// callback, in whichever form was supplied. Only the view form can ask for a
+					/// sample of the response, so responseSampleBytes is left alone otherwise.
 					/// </summary>
-					void TryInitiateHttpTransaction()
+					void NotifyMessageBegin(http::HttpRequest* request, http::HttpResponse* response, uint32_t* nextAction, uint32_t* responseSampleBytes, void* writerContext)
 					{
-						try
+						if (m_onMessageBeginView)
 						{
-							// Allow 5 seconds for a peek read.
-							SetStreamTimeout(boost::posix_time::minutes(5));
+							HttpMessageView message;
+							FillMessageView(message, request, response);
 
-							std::shared_ptr<std::array<char, TlsPeekBufferSize>> httpPeekBuffer = std::make_shared< std::array<char, TlsPeekBufferSize> >();
+							m_onMessageBeginView(&message, nextAction, responseSampleBytes, &util::cb::ContextStreamCopyUtil::Write, writerContext);
+							return;
+						}
 
-							boost::asio::async_read(
-								m_downstreamSocket,
-								boost::asio::buffer(httpPeekBuffer->data(), httpPeekBuffer->size()),
-								boost::asio::transfer_at_least(18),
-								m_downstreamStrand.wrap(
-									std::bind(
-										&TlsCapableHttpBridge::OnInitialPeek,
-										shared_from_this(),
-										std::placeholders::_1,
-										std::placeholders::_2,
-										httpPeekBuffer)
-								)
+						auto requestHeaders = request->HeadersToString();
+						auto responseHeaders = response != nullptr ? response->HeadersToString() : std::string();
+
+						m_onMessageBegin(
+							requestHeaders.c_str(), requestHeaders.size(),
+							nullptr, 0, 
+							responseHeaders.c_str(), responseHeaders.size(),
+							nullptr, 0,
+							nextAction, &util::cb::ContextStreamCopyUtil::Write, writerContext
 							);
-						}
-						catch (std::exception& e)
-						{
-							std::string err(e.what());
-							ReportError(err);
-						}
 					}
-					
 
-					void OnInitialPeek(const boost::system::error_code& error, const size_t bytesTransferred, std::shared_ptr<std::array<char, TlsPeekBufferSize>> httpPeekBuffer)
+					/// <summary>
+					/// Looks for a verdict on a request's headers that doesn't involve the consumer.
+					/// Bypassed hosts have the whole transaction whitelisted, response included.
+					/// Otherwise, the hostname blocklist and native rules may block the request, and
+					/// failing that, the consumer may have had a verdict on requests like this one
+					/// cached. m_verdictControl must not be nullptr.
+					/// </summary>
+					/// <param name="snapshot">
+					/// The filtering snapshot to check against.
+					/// </param>
+					/// <param name="request">
+					/// The request.
+					/// </param>
+					/// <param name="record">
+					/// Whether to count the checks made. If not, and the verdict is then used, it
+					/// must be counted with ::RecordStandingVerdict(...).
+					/// </param>
+					/// <param name="verdict">
+					/// Set to the verdict, if one was found.
+					/// </param>
+					/// <returns>
+					/// True if a verdict was found, false if the consumer is to be asked.
+					/// </returns>
+					const bool FindStandingVerdict(const filtering::FilterSnapshot& snapshot, http::HttpRequest* request, const bool record, StandingVerdict& verdict)
 					{
-						if (!error && httpPeekBuffer && httpPeekBuffer.get() && httpPeekBuffer->data() && bytesTransferred > 0)
-						{
-							
-							// Cancel the stream timeout mechanism before entering starting this process. We're going to need
-							// to possibly leave this cancelled if we're handling a passthrough connection.
-							SetStreamTimeout(boost::posix_time::minutes(5));
-							
-							PreviewParser p;
-							std::string parsedHost;
-							auto parseResult = p.Parse(httpPeekBuffer->data(), bytesTransferred, parsedHost);
+						const auto& host = GetRequestHost(request);
 
-							switch (parseResult)
+						if (snapshot.IsBypassed(host))
+						{
+							if (record)
 							{
-								case PreviewParser::ParseResult::Failure:
-								{
-									ReportError(u8"In TlsCapableHttpBridge:: InitiateHttpTransaction() - Failed when trying to peek connected client.");
-									Kill();
-									return;
-								}
-								break;
+								m_verdictControl->RecordBypassed();
+							}
 
-								case PreviewParser::ParseResult::IsHttp:
-								{	
-									// Just go ahead and start officially reading the headers.
+							verdict.nextAction = 3;
+							verdict.bypassed = true;
+							return true;
+						}
 
-									// Set the timeout to something reasonable.
-									SetStreamTimeout(boost::posix_time::minutes(5));
+						if (IsHostBlocklisted(snapshot, host, record))
+						{
+							verdict.nextAction = 2;
+							return true;
+						}
 
-									// Create a new request for this data and just jump to OnDownstreamHeaders.
-									try
-									{
-										m_request.reset(new http::HttpRequest(httpPeekBuffer->data(), bytesTransferred));
-										m_shouldTerminate = false;
-									}
-									catch (std::exception& e)
-									{
-										ReportError(e.what());
-										Kill();
-										return;
-									}
+						verdict.ruleVerdict = MatchRules(snapshot, request, record);
 
-									OnDownstreamHeaders(error, bytesTransferred);
-									return;									
-								}
-								break;
+						if (verdict.ruleVerdict == filtering::RuleMatcher::Verdict::Block)
+						{
+							verdict.nextAction = 2;
+							return true;
+						}
 
-								case PreviewParser::ParseResult::HttpWithUpgrade:
-								{
-									ReportInfo(u8"HTTP with upgrade.");
+						return m_verdictControl->GetCache().Lookup(host, request->RequestURI(), verdict.nextAction, verdict.customResponse, record);
+					}
 
-									// If it's non-TLS, then we need to resolve the host and connect to it
-									// as well. If it is TLS, then we don't care because this is done
-									// right away on connect with TLS clients because the host is extracted
-									// from SNI extension.
-									bool needsResolveAndConnect = std::is_same<BridgeSocketType, network::TcpSocket>::value;
+					/// <summary>
+					/// Counts the checks behind a verdict that ::FindStandingVerdict(...) found
+					/// without counting them, once the verdict is used. Only verdicts that don't
+					/// block are expected here.
+					/// </summary>
+					/// <param name="snapshot">
+					/// The filtering snapshot the verdict was found with.
+					/// </param>
+					/// <param name="verdict">
+					/// The verdict.
+					/// </param>
+					void RecordStandingVerdict(const filtering::FilterSnapshot& snapshot, const StandingVerdict& verdict)
+					{
+						if (verdict.bypassed)
+						{
+							m_verdictControl->RecordBypassed();
+							return;
+						}
 
-									if (needsResolveAndConnect)
-									{
-										
-										SetStreamTimeout(boost::posix_time::minutes(5));
+						if (snapshot.blocklist)
+						{
+							m_verdictControl->RecordBlocklistCheck(false);
+						}
 
-										if (parsedHost.size() == 0)
-										{
-											ReportWarning(u8"HTTP-With-Upgrade passthrough detected, but no host extracted.");
-											Kill();
-											return;
-										}
+						if (snapshot.rules)
+						{
+							m_verdictControl->RecordRuleVerdict(verdict.ruleVerdict);
+						}
 
-										// Trim port, if present.
-										auto portPos = parsedHost.find_last_of(u8":");
+						m_verdictControl->GetCache().RecordHit();
+					}
 
-										// Find out if a custom port is being used and pass it
-										// to our resolve handler so we can adjust where we're
-										// connecting to on resolve.
-										uint16_t customPort = 0;
+					/// <summary>
+					/// Asks for a verdict on a transaction at the given stage. If the asynchronous
+					/// form of the relevant message callback was supplied, it's used, and the
+					/// consumer may answer later, in which case we're parked: we register with the
+					/// verdict control, arm the verdict timer and return Pending, and the caller
+					/// must return without issuing any further operations. The stage and closeAfter
+					/// are kept so that ::OnVerdict(...) knows where to resume. Otherwise, this is
+					/// the same as ::ShouldBlockTransaction(...).
+					/// </summary>
+					/// <param name="request">
+					/// The request.
+					/// </param>
+					/// <param name="response">
+					/// The response, or nullptr when checking the request headers.
+					/// </param>
+					/// <param name="stage">
+					/// Where in the transaction we are, and so where to resume.
+					/// </param>
+					/// <param name="closeAfter">
+					/// Whether or not the peer closed the connection after the data we have.
+					/// </param>
+					/// <returns>
+					/// Allow or Block if a verdict was reached right away, Pending if we've been
+					/// parked.
+					/// </returns>
+					const VerdictOutcome GetVerdict(http::HttpRequest* request, http::HttpResponse* response, const VerdictStage stage, const bool closeAfter)
+					{
+						bool inspectRequest = request->GetConsumeAllBeforeSending() && request->IsPayloadComplete();
+						bool inspectResponse = IsResponseReadyForInspection(response);
 
-										if (portPos != std::string::npos)
-										{
-											
-											parsedHost = parsedHost.substr(0, portPos);
+						// Same rule as ::ShouldBlockTransaction(...).
+						const bool messageEnd = inspectRequest || inspectResponse;
 
-											if (portPos + 1 < parsedHost.size())
-											{
-												
-												try
-												{
-													customPort = static_cast<uint16_t>(std::stoi(parsedHost.substr(portPos + 1)));
-												}
-												catch (...)
-												{
-													
-													customPort = 0;
-												}
-											}
-										}
+						// See if the native rules, or failing that the consumer, already told us
+						// how to handle requests like this one.
+						if (!messageEnd && response == nullptr && m_verdictControl != nullptr)
+						{
+							// Held for the duration, so that every check below is made against the
+							// same configuration, and none of it can be released out from under us.
+							auto snapshot = m_verdictControl->GetSnapshot();
 
-										/*
-										if (m_filteringEngine->ShouldBlockHost(parsedHost))
-										{
-											// This host is filtered.
-											Kill();
-											return;
-										}
-										*/
+							StandingVerdict standing;
 
-										boost::asio::ip::tcp::resolver::query query(parsedHost, std::is_same<BridgeSocketType, network::TlsSocket>::value ? "https" : "http");
+							if (FindStandingVerdict(*snapshot, request, true, standing))
+							{
+								return ApplyMessageBeginVerdict(request, nullptr, standing.nextAction, standing.customResponse) ? VerdictOutcome::Block : VerdictOutcome::Allow;
+							}
+						}
 
-										auto self(shared_from_this());
+						// A response body we've already reached a verdict on doesn't need to be
+						// looked at again.
+						m_contentVerdictPending = false;
 
-										m_resolver.async_resolve(
-											query,
-											m_upstreamStrand.wrap(											
-												[this, self, customPort, httpPeekBuffer, bytesTransferred](const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpointIterator)
-												{
-													if (!error)
-													{
-														auto ep = *endpointIterator;
+						if (messageEnd && inspectResponse && !inspectRequest && m_verdictControl != nullptr && !IsResponseSample(response))
+						{
+							auto& contentCache = m_verdictControl->GetContentCache();
 
-														if (customPort != 0)
-														{
-															// A custom port was parsed from the peeked request headers.
-								
-															ep.endpoint().port(customPort);
-														}
+							uint64_t bodyHash = 0;
+							uint64_t bodyLength = 0;
 
-														UpstreamSocket().async_connect(
-															ep,
-															m_upstreamStrand.wrap(
-																[this, self, httpPeekBuffer, bytesTransferred](const boost::system::error_code& error)
-																{
-																	if (!error)
-																	{
-																		// We managed to connect, do just start to volley.
-																		StartPassthroughVolley(httpPeekBuffer, bytesTransferred);
-																		return;
-																	}
+							if (contentCache.GetMaxEntries() > 0 && response->GetPayloadHash(bodyHash, bodyLength))
+							{
+								contentCache.RecordHashed(bodyLength, response->GetPayloadHashNanoseconds());
 
-																	// Failed to connect.
-																	ReportInfo(u8"Failed to connect");
-																	Kill();
-																}
-															)
-														);
+								bool cachedShouldBlock = false;
+								std::shared_ptr<const std::vector<char>> cachedResponse;
 
-														return;
-													}
+								if (contentCache.Lookup(bodyHash, bodyLength, cachedShouldBlock, cachedResponse))
+								{
+									return ApplyMessageEndVerdict(request, cachedShouldBlock, cachedResponse) ? VerdictOutcome::Block : VerdictOutcome::Allow;
+								}
 
-						
-													// Failed to resolve host.
-													ReportInfo(u8"Failed to resolve");
-													Kill();
-												}
-											)
-										);										
+								m_contentVerdictHash = bodyHash;
+								m_contentVerdictLength = bodyLength;
+								m_contentVerdictPending = true;
+							}
+						}
 
-										return;
-									}
-									else
-									{
-										// Check here if already-established host is blocked. In this case, the host would have been
-										// extracted via SNI extension parsing.
-										if (m_upstreamHost.size() > 0)
-										{
-											/*
-											if (m_filteringEngine->ShouldBlockHost(m_upstreamHost))
-											{
-												// This host is filtered.
-												Kill();
-												return;
-											}
-											*/
-										}
+						if (m_verdictControl == nullptr || (messageEnd ? !m_verdictControl->GetOnMessageEnd() : !m_verdictControl->GetOnMessageBegin()))
+						{
+							return ShouldBlockTransaction(request, response) ? VerdictOutcome::Block : VerdictOutcome::Allow;
+						}
+
+						// The strand that the handler we were called from is running on, which is
+						// where we must resume.
+						auto strand = stage == VerdictStage::RequestHeaders ? &m_downstreamStrand : &m_upstreamStrand;
+
+						auto self = this->shared_from_this();
 
-										// We're already connected as HTTPS so just do the volley.
-										StartPassthroughVolley(httpPeekBuffer, bytesTransferred);
-										return;
-									}
-								}
-								break;
+						// Registered before the consumer ever sees the token, since it may well
+						// complete it from another thread before the callback even returns.
+						const uint64_t token = m_verdictControl->Park(
+							[self, strand](const uint32_t verdict, const uint32_t responseSampleBytes, std::vector<char> customResponse)
+							{
+								strand->post(std::bind(&TlsCapableHttpBridge::OnVerdict, self, verdict, responseSampleBytes, std::move(customResponse)));
+							}
+						);
 
-								case PreviewParser::ParseResult::NotHttp:
-								{	
-									// If this is not HTTP AND it's not TLS with SNI, then we can't do anything about this.
-									if (std::is_same<BridgeSocketType, network::TcpSocket>::value)
-									{
-										
-										ReportError(u8"In TlsCapableHttpBridge::TryInitiateHttpTransaction() - Connected client is non-tls and sending content in an unexpected protocol. Terminating because no mechanism exists to resolve the original upstream host.");
-										Kill();
-										return;
-									}
-									else
-									{
-										ReportInfo(u8"Not http and is TLS.");
+						m_verdictToken = token;
+						m_verdictStage = stage;
+						m_verdictCloseAfter = closeAfter;
+						m_verdictIsMessageEnd = messageEnd;
 
-										// Check here if already-established host is blocked. In this case, the host would have been
-										// extracted via SNI extension parsing.
-										if (m_upstreamHost.size() > 0)
-										{
-											/*
-											if (m_filteringEngine->ShouldBlockHost(m_upstreamHost))
-											{
-												// This host is filtered.
-												Kill();
-												return;
-											}
-											*/
-										}
+						uint32_t nextAction = 0;
+						uint32_t responseSampleBytes = 0;
+						bool shouldBlock = false;
 
-										// We're already connected as HTTPS so just do the volley.
-										StartPassthroughVolley(httpPeekBuffer, bytesTransferred);
-										return;
-									}
-								}
-								break;
+						std::vector<char> customBlockResponse;
+
+						void* writerContext = util::cb::ContextStreamCopyUtil::GetContext(&customBlockResponse);
+
+						HttpMessageView message;
+						FillMessageView(message, request, response);
+
+						bool pending = false;
+
+						if (messageEnd)
+						{
+							message.requestBody = request->GetPayload().data();
+							message.requestBodyLength = static_cast<uint32_t>(request->GetPayload().size());
+							message.responseBody = inspectResponse ? response->GetPayload().data() : nullptr;
+							message.responseBodyLength = inspectResponse ? static_cast<uint32_t>(response->GetPayload().size()) : 0;
+
+							if (inspectResponse && IsResponseSample(response))
+							{
+								message.flags |= HttpMessageFlagResponseBodyTruncated;
 							}
+
+							pending = m_verdictControl->GetOnMessageEnd()(&message, token, &shouldBlock, &util::cb::ContextStreamCopyUtil::Write, writerContext);
+						}
+						else
+						{
+							pending = m_verdictControl->GetOnMessageBegin()(&message, token, &nextAction, &responseSampleBytes, &util::cb::ContextStreamCopyUtil::Write, writerContext);
 						}
 
-						//Kill();
-					}								
+						// If the consumer answered right away, we take the answer, unless it also
+						// went and completed the token, in which case the completion is already on
+						// its way to ::OnVerdict(...) and we treat this as pending.
+						if (!pending && m_verdictControl->Withdraw(token))
+						{
+							m_verdictToken = 0;
+
+							const auto sharedBlockResponse = ShareCustomBlockResponse(customBlockResponse);
+
+							const bool blocked = messageEnd ?
+								ApplyMessageEndVerdict(request, shouldBlock, sharedBlockResponse) :
+								ApplyMessageBeginVerdict(request, response, nextAction, sharedBlockResponse, responseSampleBytes);
+
+							return blocked ? VerdictOutcome::Block : VerdictOutcome::Allow;
+						}
+
+						m_verdictTimer.expires_from_now(boost::posix_time::milliseconds(static_cast<long>(m_verdictControl->GetTimeoutMilliseconds())));
+
+						m_verdictTimer.async_wait(
+							strand->wrap(
+								std::bind(
+									&TlsCapableHttpBridge::OnVerdictTimeout,
+									this->shared_from_this(),
+									token,
+									std::placeholders::_1
+								)
+							)
+						);
+
+						return VerdictOutcome::Pending;
+					}
 
 					/// <summary>
-					/// Sets the duration from now when the stream timer should expire.
+					/// Resumes a bridge that was parked by ::GetVerdict(...), once the verdict has
+					/// been supplied or the verdict timer has expired. Always runs on the strand
+					/// that the parked handler was running on. Applies the verdict exactly as
+					/// ::ShouldBlockTransaction(...) would have, then carries on from the stage we
+					/// were parked at.
 					/// </summary>
-					/// <param name="expiry">
-					/// The boost::posix_time::time_duration when the expiry should occur from now.
+					/// <param name="verdict">
+					/// For a message begin verdict, the nextAction. For a message end verdict,
+					/// non-zero to block.
 					/// </param>
-					void SetStreamTimeout(const boost::posix_time::time_duration& expiry)
+					/// <param name="responseSampleBytes">
+					/// For a message begin verdict on a response, how many bytes of the payload to
+					/// inspect, or zero for all of it. Ignored otherwise.
+					/// </param>
+					/// <param name="customResponse">
+					/// The custom block response supplied with the verdict, if any.
+					/// </param>
+					void OnVerdict(const uint32_t verdict, const uint32_t responseSampleBytes, std::vector<char>& customResponse)
 					{
-						m_streamTimer.cancel();
+						#ifndef NDEBUG
+						ReportInfo(u8"TlsCapableHttpBridge::OnVerdict");
+						#endif // !NDEBUG
 
-						m_streamTimer.expires_from_now(expiry);
+						boost::system::error_code verdictTimerCancelErr;
+						m_verdictTimer.cancel(verdictTimerCancelErr);
+
+						if (m_verdictToken.exchange(0) == 0)
+						{
+							// We were killed while waiting.
+							return;
+						}
+
+						http::HttpResponse* response = m_verdictStage == VerdictStage::RequestHeaders ? nullptr : m_response.get();
+
+						const auto sharedBlockResponse = ShareCustomBlockResponse(customResponse);
+
+						const bool blocked = m_verdictIsMessageEnd ?
+							ApplyMessageEndVerdict(m_request.get(), verdict != 0, sharedBlockResponse) :
+							ApplyMessageBeginVerdict(m_request.get(), response, verdict, sharedBlockResponse, responseSampleBytes);
+
+						if (blocked)
+						{
+							WriteBlockResponse(m_verdictStage != VerdictStage::RequestHeaders);
+							return;
+						}
+
+						switch (m_verdictStage)
+						{
+							case VerdictStage::RequestHeaders:
+							{
+								ContinueDownstreamHeaders(m_verdictCloseAfter);
+							}
+							break;
+
+							case VerdictStage::ResponseHeaders:
+							{
+								ContinueUpstreamHeaders(m_verdictCloseAfter);
+							}
+							break;
 
-						m_streamTimer.async_wait(std::bind(&TlsCapableHttpBridge::OnStreamTimeout, shared_from_this(), std::placeholders::_1));
+							case VerdictStage::ResponsePayload:
+							{
+								// The payload is complete, or we've inspected as much of it as we
+								// were going to, so all that's left is to write what we have to the
+								// client, same as ::OnUpstreamRead(...) does.
+								EndResponseSample();
+
+								WriteResponse();
+							}
+							break;
+						}
 					}
 
 					/// <summary>
-					/// Cancels the current stream timer and then sets it to positive infinity.
+					/// Completion handler for the verdict timer. If the verdict we're parked on
+					/// still hasn't been supplied, we withdraw from the verdict control, so that a
+					/// late completion is ignored, and resume with the default verdict.
 					/// </summary>
-					void SetInfiniteStreamTimeout()
+					/// <param name="token">
+					/// The token we were parked under when the timer was armed.
+					/// </param>
+					/// <param name="error">
+					/// Error code that will indicate if the timer was cancelled.
+					/// </param>
+					void OnVerdictTimeout(const uint64_t token, const boost::system::error_code& error)
 					{
-						m_streamTimer.cancel();
+						if (error == boost::asio::error::operation_aborted || m_verdictToken != token)
+						{
+							return;
+						}
 
-						m_streamTimer.expires_at(boost::posix_time::pos_infin);
-						return;
+						if (!m_verdictControl->Withdraw(token))
+						{
+							// Lost the race to a completion, which is on its way to ::OnVerdict(...).
+							return;
+						}
+
+						m_verdictControl->RecordTimedOut();
+
+						// The default says nothing about the body, so it mustn't be remembered for it.
+						m_contentVerdictPending = false;
+
+						ReportWarning(u8"In TlsCapableHttpBridge::OnVerdictTimeout(const uint64_t, const boost::system::error_code&) - Verdict timed out. Applying the default verdict.");
+
+						std::vector<char> noCustomResponse;
+						OnVerdict(m_verdictControl->GetDefaultVerdict(m_verdictIsMessageEnd), 0, noCustomResponse);
 					}
 
 					/// <summary>
-					/// Sets the linger option to the specified values for the supplied socket.
+					/// Writes the block response set by ::SetBlockResponse(...) to the client. The
+					/// client is disconnected once the write completes.
 					/// </summary>
-					/// <param name="socket">
-					/// The socket to configure.
-					/// </param>
-					/// <param name="enabled">
-					/// The value indicating whether the property should be enabled or disabled.
+					/// <param name="markBlocked">
+					/// Whether or not to flag the request as blocked first. Checks of the response
+					/// always do this. The request header check leaves it to the verdict, since a
+					/// custom block response doesn't set the flag.
 					/// </param>
-					/// <param name="value">
-					/// The linger timeout, in the event that the property is enabled.
-					/// </param>
-					void SetLinger(boost::asio::ip::tcp::socket& socket, const bool enabled, const int value)
+					void WriteBlockResponse(const bool markBlocked)
 					{
-						boost::system::error_code err;
-
-						socket.lowest_layer().set_option(boost::asio::socket_base::linger(enabled, value), err);
+						if (markBlocked)
+						{
+							m_request->SetShouldBlock(1);
+						}
 
-						if (err)
+						if (!m_blockResponse)
 						{
-							std::string errorMessage(u8"In TlsCapableHttpBridge<BridgeSocketType>::SetLinger(boost::asio::ip::tcp::socket&, const bool) - While setting linger state, got error:\t");
-							errorMessage.append(err.message());
-							ReportError(errorMessage);
+							m_blockResponse = http::BlockResponses::Get204(m_request->GetHttpVersion());
 						}
+
+						boost::asio::async_write(
+							m_downstreamSocket,
+							boost::asio::buffer(*m_blockResponse),
+							boost::asio::transfer_all(),
+							m_downstreamStrand.wrap(
+								network::MakeCustomAllocHandler(
+									m_responsePathHandlerMemory,
+									std::bind(
+										&TlsCapableHttpBridge::OnDownstreamWrite,
+										this->shared_from_this(),
+										std::placeholders::_1
+									)
+								)
+							)
+						);
 					}
 
 					/// <summary>
-					/// Enables or disables the TCP Nagle algorithm for the supplied socket.
+					/// Decides what's to be written to the client in place of a blocked
+					/// transaction: the custom block response, the registered page it refers to, or
+					/// failing either, the canned 204. See http::BlockResponses.
 					/// </summary>
-					/// <param name="socket">
-					/// The socket to configure.
+					/// <param name="request">
+					/// The request being blocked.
 					/// </param>
-					/// <param name="value">
-					/// The value indicating whether the property should be enabled or disabled.
+					/// <param name="customBlockResponse">
+					/// The custom block response supplied with the verdict. May be nullptr.
 					/// </param>
-					void SetNoDelay(boost::asio::ip::tcp::socket& socket, const bool value)
+					void SetBlockResponse(http::HttpRequest* request, const std::shared_ptr<const std::vector<char>>& customBlockResponse)
 					{
-						boost::system::error_code err;
-						
-						socket.lowest_layer().set_option(boost::asio::ip::tcp::no_delay(value), err);
-
-						if (err)
+						if (m_verdictControl != nullptr)
 						{
-							std::string errorMessage(u8"In TlsCapableHttpBridge<BridgeSocketType>::SetNoDelay(boost::asio::ip::tcp::socket&, const bool) - While setting Nagle algorithm enabled state, got error:\t");
-							errorMessage.append(err.message());
-							ReportError(errorMessage);
+							m_blockResponse = m_verdictControl->GetBlockResponses().Resolve(customBlockResponse, request->GetHttpVersion());
+						}
+						else if (customBlockResponse && customBlockResponse->size() > 0)
+						{
+							m_blockResponse = customBlockResponse;
+						}
+						else
+						{
+							m_blockResponse = http::BlockResponses::Get204(request->GetHttpVersion());
 						}
 					}
 
 					/// <summary>
-					/// Determines if the supplied socket has data waiting to be read off the buffer.
-					/// This is used to attempt to determine if a transaction is complete whenever we
-					/// have to handle a passthrough connection.
+					/// Takes ownership of the custom block response a consumer wrote, so that it
+					/// can be shared from then on, without being copied again.
 					/// </summary>
-					/// <param name="socket">
-					/// The socket to be polled.
+					/// <param name="customBlockResponse">
+					/// The custom block response. Left empty.
 					/// </param>
 					/// <returns>
-					/// True of the supplied socket has data to be read, false otherwise.
+					/// The shared custom block response, or nullptr if none was written.
 					/// </returns>
-					const bool SocketHasData(boost::asio::ip::tcp::socket& socket)
+					static std::shared_ptr<const std::vector<char>> ShareCustomBlockResponse(std::vector<char>& customBlockResponse)
 					{
-						boost::asio::socket_base::bytes_readable command(true);
-						socket.io_control(command);
-						std::size_t bytes_readable = command.get();
+						if (customBlockResponse.empty())
+						{
+							return nullptr;
+						}
 
-						return bytes_readable > 0;
+						return std::make_shared<const std::vector<char>>(std::move(customBlockResponse));
 					}
 
-					const bool ShouldBlockTransaction(http::BaseHttpTransaction* request, http::BaseHttpTransaction* response = nullptr)
+					const bool ShouldBlockTransaction(http::HttpRequest* request, http::HttpResponse* response = nullptr)
 					{
-						auto requestHeaders = request->HeadersToString();
-						auto responseHeaders = response != nullptr ? response->HeadersToString() : std::string();
-						
 						const char* requestPayload = nullptr;
 						uint32_t requestPayloadSize = 0;
 
@@ -3036,16 +5695,19 @@ namespace te
 
 
 						uint32_t nextAction = 0;						
+						uint32_t responseSampleBytes = 0;
 						bool shouldBlock = false;
 
 						std::vector<char> customBlockResponse;
-						
-                        const auto myStreamChannel = s_streamCopyContainer.ClaimNextChannel(&customBlockResponse);                        
+
+						void* writerContext = util::cb::ContextStreamCopyUtil::GetContext(&customBlockResponse);
 
 						bool inspectRequest = request->GetConsumeAllBeforeSending() && request->IsPayloadComplete();
-						bool inspectResponse = (response != nullptr && response->GetConsumeAllBeforeSending() && response->IsPayloadComplete());
+						bool inspectResponse = IsResponseReadyForInspection(response);
 
-						if ((inspectRequest && !inspectResponse) || (inspectRequest && inspectResponse))
+						// A response that was inspected on its own belongs to the message end
+						// callback too. It's the only one that's ever handed the body.
+						if (inspectRequest || inspectResponse)
 						{
 							requestPayload = inspectRequest ? request->GetPayload().data() : nullptr;
 							requestPayloadSize = inspectRequest ? request->GetPayload().size() : 0;
@@ -3053,114 +5715,144 @@ namespace te
 							responsePayload = inspectResponse ? response->GetPayload().data() : nullptr;
 							responsePayloadSize = inspectResponse ? response->GetPayload().size() : 0;
 
-							m_onMessageEnd(
-								requestHeaders.c_str(), requestHeaders.size(),
+							NotifyMessageEnd(
+								request, response,
 								requestPayload, requestPayloadSize,
-								responseHeaders.c_str(), responseHeaders.size(),
 								responsePayload, responsePayloadSize,
-								&shouldBlock, myStreamChannel.GetWriter()
-                            );
+								&shouldBlock, writerContext
+								);
 
-							if (shouldBlock)
-							{
-								if (customBlockResponse.size() > 0)
-								{									
-									request->SetPayload(std::move(customBlockResponse), true);
-									return true;
-								}
-								else
-								{	
-									request->Make204();
-								}
+							return ApplyMessageEndVerdict(request, shouldBlock, ShareCustomBlockResponse(customBlockResponse));
+						}
+						
+						NotifyMessageBegin(request, response, &nextAction, &responseSampleBytes, writerContext);
 
-								request->SetShouldBlock(1);
-								
+						return ApplyMessageBeginVerdict(request, response, nextAction, ShareCustomBlockResponse(customBlockResponse), responseSampleBytes);
+					}
+
+					/// <summary>
+					/// Applies the answer given by the message end callback to the transaction.
+					/// </summary>
+					/// <returns>
+					/// True if the transaction was blocked, false otherwise.
+					/// </returns>
+					const bool ApplyMessageEndVerdict(http::HttpRequest* request, const bool shouldBlock, const std::shared_ptr<const std::vector<char>>& customBlockResponse)
+					{
+						if (m_contentVerdictPending && m_verdictControl != nullptr)
+						{
+							m_contentVerdictPending = false;
+							m_verdictControl->GetContentCache().Store(m_contentVerdictHash, m_contentVerdictLength, shouldBlock, customBlockResponse);
+						}
+
+						if (shouldBlock)
+						{
+							SetBlockResponse(request, customBlockResponse);
+
+							if (customBlockResponse && customBlockResponse->size() > 0)
+							{
 								return true;
 							}
+
+							request->SetShouldBlock(1);
+							
+							return true;
 						}
-						else
+
+						return false;
+					}
+
+					/// <summary>
+					/// Applies the nextAction given by the message begin callback to the transaction.
+					/// When a response is allowed for inspection, responseSampleBytes says how much
+					/// of its payload to inspect, zero meaning all of it.
+					/// </summary>
+					/// <returns>
+					/// True if the transaction was blocked, false otherwise.
+					/// </returns>
+					const bool ApplyMessageBeginVerdict(http::HttpRequest* request, http::HttpResponse* response, const uint32_t nextAction, const std::shared_ptr<const std::vector<char>>& customBlockResponse, const uint32_t responseSampleBytes = 0)
+					{
+						const uint32_t action = nextAction & HTTP_NEXT_ACTION_MASK;
+
+						// The consumer may have asked for a verdict on a request to be reused.
+						if (response == nullptr && m_verdictControl != nullptr)
 						{
-							m_onMessageBegin(
-								requestHeaders.c_str(), requestHeaders.size(),
-								nullptr, 0, 
-								responseHeaders.c_str(), responseHeaders.size(),
-								nullptr, 0,
-								&nextAction, myStreamChannel.GetWriter()
-							);
+							const uint32_t cacheScope = (nextAction >> 8) & 0x3;
+							const uint32_t cacheTtlSeconds = nextAction >> 16;
 
-							switch (nextAction)
+							if (cacheScope != HttpVerdictCacheScopeNone && cacheTtlSeconds > 0)
 							{
-								case 0:
-								{
-									// Allow without inspection, but if a response
-									// comes, it is still wanted.
-									request->SetShouldBlock(0);
-									request->SetConsumeAllBeforeSending(false);
+								m_verdictControl->GetCache().Store(GetRequestHost(request), request->RequestURI(), cacheScope, cacheTtlSeconds, action, customBlockResponse);
+							}
+						}
 
-									if (response)
-									{
-										response->SetShouldBlock(0);
-										response->SetConsumeAllBeforeSending(false);
-									}
+						switch (action)
+						{
+							case 0:
+							{
+								// Allow without inspection, but if a response
+								// comes, it is still wanted.
+								request->SetShouldBlock(0);
+								request->SetConsumeAllBeforeSending(false);
 
-									return false;
+								if (response)
+								{
+									response->SetShouldBlock(0);
+									response->SetConsumeAllBeforeSending(false);
 								}
-								break;
 
-								case 1:
+								return false;
+							}
+							break;
+
+							case 1:
+							{
+								// Allow but want to inspect payload.
+								request->SetShouldBlock(0);
+								request->SetConsumeAllBeforeSending(true);
+
+								if (response)
 								{
-									// Allow but want to inspect payload.
-									request->SetShouldBlock(0);
-									request->SetConsumeAllBeforeSending(true);
+									response->SetShouldBlock(0);
+									response->SetConsumeAllBeforeSending(true);
 
-									if (response)
-									{
-										response->SetShouldBlock(0);
-										response->SetConsumeAllBeforeSending(true);
-									}
-									return false;
+									// Zero, unless only the first bytes are wanted.
+									m_responseSampleBytes = responseSampleBytes;
 								}
-								break;
+								return false;
+							}
+							break;
 
-								case 2:
-								{
-									// Block.
-									if (customBlockResponse.size() > 0)
-									{	
-										request->SetPayload(std::move(customBlockResponse), true);										
-									}
-									else
-									{	
-										request->Make204();
-									}
+							case 2:
+							{
+								// Block.
+								SetBlockResponse(request, customBlockResponse);
 
-									request->SetShouldBlock(1);
+								request->SetShouldBlock(1);
 
-									if (response)
-									{
-										response->SetShouldBlock(1);										
-									}
-									return true;
+								if (response)
+								{
+									response->SetShouldBlock(1);										
 								}
-								break;
+								return true;
+							}
+							break;
 
-								case 3:
-								{
-									// Allow without inspection, for both request and a response.									
-									// Setting to -1 will whitelist the rest of this transaction, 
-									// including the response.
-									request->SetShouldBlock(-1);
-									request->SetConsumeAllBeforeSending(false);
+							case 3:
+							{
+								// Allow without inspection, for both request and a response.									
+								// Setting to -1 will whitelist the rest of this transaction, 
+								// including the response.
+								request->SetShouldBlock(-1);
+								request->SetConsumeAllBeforeSending(false);
 
-									if (response)
-									{
-										response->SetShouldBlock(-1);
-										response->SetConsumeAllBeforeSending(false);
-									}
-									return false;
+								if (response)
+								{
+									response->SetShouldBlock(-1);
+									response->SetConsumeAllBeforeSending(false);
 								}
-								break;
+								return false;
 							}
+							break;
 						}
 
 						return false;
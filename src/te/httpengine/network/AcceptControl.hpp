@@ -0,0 +1,334 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// The AcceptControl class holds the configuration of a single acceptor's accept
+			/// loop, and the instrumentation that tells us how well that loop is keeping up.
+			///
+			/// An acceptor that keeps a single accept outstanding, and only re-arms it once it has
+			/// finished setting up the client it just got, leaves everything else that arrives in
+			/// the meantime sitting in the kernel's backlog. During a burst, that's where clients
+			/// wait, and if the backlog fills up, that's where they get dropped. So, an acceptor
+			/// may keep several accepts outstanding at once, so that several io_service threads
+			/// can be picking up clients at the same time. It may also drain, meaning that every
+			/// time an accept completes, it'll keep synchronously accepting whatever else is
+			/// already waiting, up to a limit, before going back to waiting on the io_service.
+			///
+			/// The kernel won't tell us how deep the backlog is or how many clients it has
+			/// dropped, at least not portably. What we can see is how many clients were already
+			/// waiting each time we drained, and how often a drain stopped because it hit its
+			/// limit rather than because the backlog was empty. When drains routinely hit the
+			/// limit, the backlog is at risk of overflowing. Accept errors, such as running out of
+			/// descriptors, are counted separately.
+			///
+			/// Configuration is read by the acceptor when it is constructed and starts accepting,
+			/// so changes take effect the next time the Engine is started. All members are thread
+			/// safe.
+			/// </summary>
+			class AcceptControl
+			{
+
+			public:
+
+				/// <summary>
+				/// The default number of accepts an acceptor keeps outstanding at once.
+				/// </summary>
+				static constexpr uint32_t DefaultOutstandingAccepts = 4;
+
+				/// <summary>
+				/// The default maximum number of clients accepted per completed accept, including
+				/// the one that completed. One means no draining.
+				/// </summary>
+				static constexpr uint32_t DefaultMaxAcceptsPerWakeup = 16;
+
+				/// <summary>
+				/// Constructs a new AcceptControl instance with default configuration.
+				/// </summary>
+				AcceptControl()
+				{
+
+				}
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				AcceptControl(const AcceptControl&) = delete;
+				AcceptControl(AcceptControl&&) = delete;
+				AcceptControl& operator=(const AcceptControl&) = delete;
+
+				/// <summary>
+				/// Sets the accept loop configuration.
+				/// </summary>
+				/// <param name="outstandingAccepts">
+				/// The number of accepts to keep outstanding at once. Values below one are raised
+				/// to one.
+				/// </param>
+				/// <param name="maxAcceptsPerWakeup">
+				/// The maximum number of clients accepted per completed accept, including the one
+				/// that completed. Values below one are raised to one, which disables draining.
+				/// </param>
+				/// <param name="listenBacklog">
+				/// The backlog to request when the listener begins listening. Zero means the
+				/// platform maximum. The platform may silently clamp this.
+				/// </param>
+				void Configure(const uint32_t outstandingAccepts, const uint32_t maxAcceptsPerWakeup, const uint32_t listenBacklog)
+				{
+					m_outstandingAccepts.store(outstandingAccepts < 1 ? 1 : outstandingAccepts, std::memory_order_relaxed);
+					m_maxAcceptsPerWakeup.store(maxAcceptsPerWakeup < 1 ? 1 : maxAcceptsPerWakeup, std::memory_order_relaxed);
+					m_listenBacklog.store(listenBacklog, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of accepts to keep outstanding at once.
+				/// </summary>
+				/// <returns>
+				/// The number of accepts to keep outstanding at once.
+				/// </returns>
+				const uint32_t GetOutstandingAccepts() const
+				{
+					return m_outstandingAccepts.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the maximum number of clients accepted per completed accept.
+				/// </summary>
+				/// <returns>
+				/// The maximum number of clients accepted per completed accept.
+				/// </returns>
+				const uint32_t GetMaxAcceptsPerWakeup() const
+				{
+					return m_maxAcceptsPerWakeup.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the backlog to request when listening.
+				/// </summary>
+				/// <returns>
+				/// The backlog to request when listening, or zero for the platform maximum.
+				/// </returns>
+				const uint32_t GetListenBacklog() const
+				{
+					return m_listenBacklog.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Records that an accept has been armed.
+				/// </summary>
+				void RecordArmed()
+				{
+					m_armedAccepts.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Records that an armed accept has completed, successfully or otherwise.
+				/// </summary>
+				void RecordCompleted()
+				{
+					m_armedAccepts.fetch_sub(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Records that a client was accepted.
+				/// </summary>
+				/// <param name="drained">
+				/// True if the client was picked up synchronously while draining, false if it was
+				/// delivered by an armed accept.
+				/// </param>
+				void RecordAccepted(const bool drained)
+				{
+					m_acceptedCount.fetch_add(1, std::memory_order_relaxed);
+
+					if (drained)
+					{
+						m_drainedCount.fetch_add(1, std::memory_order_relaxed);
+					}
+				}
+
+				/// <summary>
+				/// Records the outcome of a single drain.
+				/// </summary>
+				/// <param name="depth">
+				/// How many clients were found already waiting.
+				/// </param>
+				/// <param name="hitLimit">
+				/// True if the drain stopped because it reached the per-wakeup limit rather than
+				/// because nothing else was waiting.
+				/// </param>
+				void RecordDrain(const uint32_t depth, const bool hitLimit)
+				{
+					uint32_t peak = m_peakDrainDepth.load(std::memory_order_relaxed);
+					while (depth > peak && !m_peakDrainDepth.compare_exchange_weak(peak, depth, std::memory_order_relaxed))
+					{
+					}
+
+					if (hitLimit)
+					{
+						m_backlogSaturationCount.fetch_add(1, std::memory_order_relaxed);
+					}
+				}
+
+				/// <summary>
+				/// Records that an accept failed for a reason other than cancellation.
+				/// </summary>
+				void RecordAcceptError()
+				{
+					m_acceptErrorCount.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Records how long it took from an accept completing until the accept that
+				/// replaces it was armed. During this window, that accept isn't available to pick
+				/// up new clients.
+				/// </summary>
+				/// <param name="microseconds">
+				/// The elapsed time, in microseconds.
+				/// </param>
+				void RecordRearmLatency(const uint64_t microseconds)
+				{
+					m_rearmCount.fetch_add(1, std::memory_order_relaxed);
+					m_totalRearmMicroseconds.fetch_add(microseconds, std::memory_order_relaxed);
+
+					uint64_t peak = m_peakRearmMicroseconds.load(std::memory_order_relaxed);
+					while (microseconds > peak && !m_peakRearmMicroseconds.compare_exchange_weak(peak, microseconds, std::memory_order_relaxed))
+					{
+					}
+				}
+
+				/// <summary>
+				/// Gets the number of accepts presently armed.
+				/// </summary>
+				/// <returns>
+				/// The number of accepts presently armed.
+				/// </returns>
+				const uint32_t GetArmedAccepts() const
+				{
+					return m_armedAccepts.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the total number of clients accepted.
+				/// </summary>
+				/// <returns>
+				/// The total number of clients accepted.
+				/// </returns>
+				const uint64_t GetAcceptedCount() const
+				{
+					return m_acceptedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of clients that were picked up while draining.
+				/// </summary>
+				/// <returns>
+				/// The number of clients that were picked up while draining.
+				/// </returns>
+				const uint64_t GetDrainedCount() const
+				{
+					return m_drainedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the most clients that have been found already waiting in a single drain.
+				/// </summary>
+				/// <returns>
+				/// The deepest the backlog has been observed to be.
+				/// </returns>
+				const uint32_t GetPeakDrainDepth() const
+				{
+					return m_peakDrainDepth.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of drains that stopped because they hit the per-wakeup limit.
+				/// </summary>
+				/// <returns>
+				/// The number of drains that stopped because they hit the per-wakeup limit.
+				/// </returns>
+				const uint64_t GetBacklogSaturationCount() const
+				{
+					return m_backlogSaturationCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of accepts that failed for a reason other than cancellation.
+				/// </summary>
+				/// <returns>
+				/// The number of accepts that failed.
+				/// </returns>
+				const uint64_t GetAcceptErrorCount() const
+				{
+					return m_acceptErrorCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the average time, in microseconds, from an accept completing until its
+				/// replacement was armed.
+				/// </summary>
+				/// <returns>
+				/// The average re-arm latency in microseconds, or zero if nothing has been
+				/// accepted yet.
+				/// </returns>
+				const uint64_t GetAverageRearmMicroseconds() const
+				{
+					const uint64_t count = m_rearmCount.load(std::memory_order_relaxed);
+					return count == 0 ? 0 : m_totalRearmMicroseconds.load(std::memory_order_relaxed) / count;
+				}
+
+				/// <summary>
+				/// Gets the longest time, in microseconds, from an accept completing until its
+				/// replacement was armed.
+				/// </summary>
+				/// <returns>
+				/// The peak re-arm latency in microseconds.
+				/// </returns>
+				const uint64_t GetPeakRearmMicroseconds() const
+				{
+					return m_peakRearmMicroseconds.load(std::memory_order_relaxed);
+				}
+
+			private:
+
+				std::atomic<uint32_t> m_outstandingAccepts{ DefaultOutstandingAccepts };
+
+				std::atomic<uint32_t> m_maxAcceptsPerWakeup{ DefaultMaxAcceptsPerWakeup };
+
+				std::atomic<uint32_t> m_listenBacklog{ 0 };
+
+				std::atomic<uint32_t> m_armedAccepts{ 0 };
+
+				std::atomic<uint64_t> m_acceptedCount{ 0 };
+
+				std::atomic<uint64_t> m_drainedCount{ 0 };
+
+				std::atomic<uint32_t> m_peakDrainDepth{ 0 };
+
+				std::atomic<uint64_t> m_backlogSaturationCount{ 0 };
+
+				std::atomic<uint64_t> m_acceptErrorCount{ 0 };
+
+				std::atomic<uint64_t> m_rearmCount{ 0 };
+
+				std::atomic<uint64_t> m_totalRearmMicroseconds{ 0 };
+
+				std::atomic<uint64_t> m_peakRearmMicroseconds{ 0 };
+			};
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
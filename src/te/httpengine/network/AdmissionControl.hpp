@@ -0,0 +1,406 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// The AdmissionControl class decides whether or not the proxy has room for more
+			/// work when new work shows up. Without it, every accepted client immediately gets a
+			/// bridge, every TLS bridge immediately begins handshaking and every handshake
+			/// immediately asks the certificate store for a context, which may mean minting a
+			/// new certificate. Under a connection storm, that means the io_service threads spend
+			/// all of their time on crypto for new arrivals, and sessions that are already
+			/// established see their latency go through the roof.
+			///
+			/// There are three limits, each of which may be zero, meaning no limit.
+			///
+			/// The first is the number of active bridges. When it's reached, the acceptors can
+			/// either defer, meaning they simply stop accepting and leave new connections
+			/// waiting in the kernel's backlog until a bridge finishes, or they can keep
+			/// accepting and immediately reset anything that doesn't fit.
+			///
+			/// The second is the number of TLS bridges that are in the middle of the upstream
+			/// and downstream handshakes. The third is the number of TLS bridges that have asked
+			/// the certificate store for a server context and haven't gotten one back yet. Both
+			/// of these are checked by a TLS bridge right after it has connected upstream,
+			/// before any handshaking has taken place. At that point the client's hello has
+			/// only been peeked at, so a bridge that is refused can either degrade to a plain
+			/// TCP tunnel between the client and the server, without any filtering, or it can
+			/// simply drop the client.
+			///
+			/// Every decision is counted, so consumers can see when and how we shed load.
+			///
+			/// All members are thread safe.
+			/// </summary>
+			class AdmissionControl
+			{
+
+			public:
+
+				/// <summary>
+				/// How long an acceptor that is deferring should wait, in milliseconds, before
+				/// checking for a free bridge slot again.
+				/// </summary>
+				static constexpr uint32_t DeferIntervalMilliseconds = 25;
+
+				/// <summary>
+				/// Constructs a new AdmissionControl instance with no limits.
+				/// </summary>
+				AdmissionControl()
+				{
+
+				}
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				AdmissionControl(const AdmissionControl&) = delete;
+				AdmissionControl(AdmissionControl&&) = delete;
+				AdmissionControl& operator=(const AdmissionControl&) = delete;
+
+				/// <summary>
+				/// Sets all limits and overload behaviour. Lowering a limit below the present
+				/// value of the gauge it governs doesn't evict anything, it simply refuses new
+				/// work until enough has finished.
+				/// </summary>
+				/// <param name="maxActiveBridges">
+				/// The maximum number of bridges that may exist at once. Zero means no limit.
+				/// </param>
+				/// <param name="maxPendingHandshakes">
+				/// The maximum number of TLS bridges that may be handshaking at once. Zero means
+				/// no limit.
+				/// </param>
+				/// <param name="maxPendingSpoofs">
+				/// The maximum number of TLS bridges that may be waiting on the certificate store
+				/// at once. Zero means no limit.
+				/// </param>
+				/// <param name="deferWhenFull">
+				/// If true, acceptors stop accepting while the bridge limit is reached. If false,
+				/// they keep accepting and reset connections that don't fit.
+				/// </param>
+				/// <param name="tunnelWhenOverloaded">
+				/// If true, TLS bridges refused by the handshake or spoof limit are tunnelled
+				/// without filtering. If false, they're dropped.
+				/// </param>
+				void Configure(
+					const uint32_t maxActiveBridges,
+					const uint32_t maxPendingHandshakes,
+					const uint32_t maxPendingSpoofs,
+					const bool deferWhenFull,
+					const bool tunnelWhenOverloaded
+					)
+				{
+					m_maxActiveBridges.store(maxActiveBridges, std::memory_order_relaxed);
+					m_maxPendingHandshakes.store(maxPendingHandshakes, std::memory_order_relaxed);
+					m_maxPendingSpoofs.store(maxPendingSpoofs, std::memory_order_relaxed);
+					m_deferWhenFull.store(deferWhenFull, std::memory_order_relaxed);
+					m_tunnelWhenOverloaded.store(tunnelWhenOverloaded, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets whether acceptors should stop accepting while the bridge limit is reached,
+				/// rather than accepting and resetting.
+				/// </summary>
+				/// <returns>
+				/// True if acceptors should defer, false if they should reset.
+				/// </returns>
+				const bool GetDeferWhenFull() const
+				{
+					return m_deferWhenFull.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets whether TLS bridges refused by the handshake or spoof limit should be
+				/// tunnelled without filtering, rather than dropped.
+				/// </summary>
+				/// <returns>
+				/// True if refused TLS bridges should be tunnelled, false if they should be
+				/// dropped.
+				/// </returns>
+				const bool GetTunnelWhenOverloaded() const
+				{
+					return m_tunnelWhenOverloaded.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Checks whether or not there is presently room for another bridge. This is only
+				/// a hint, used by acceptors to decide whether or not to defer. Another acceptor
+				/// may take the slot before ::TryAdmitBridge() is called.
+				/// </summary>
+				/// <returns>
+				/// True if another bridge would presently be admitted, false otherwise.
+				/// </returns>
+				const bool HasBridgeCapacity() const
+				{
+					const uint32_t limit = m_maxActiveBridges.load(std::memory_order_relaxed);
+					return limit == 0 || m_activeBridges.load(std::memory_order_relaxed) < limit;
+				}
+
+				/// <summary>
+				/// Attempts to take a bridge slot for a newly accepted client. Counted as either
+				/// accepted or rejected.
+				/// </summary>
+				/// <returns>
+				/// True if the slot was taken, in which case ::ReleaseBridge() must be called
+				/// when the bridge is destroyed. False if the bridge limit is reached.
+				/// </returns>
+				const bool TryAdmitBridge()
+				{
+					if (TryAcquire(m_activeBridges, m_maxActiveBridges.load(std::memory_order_relaxed)))
+					{
+						m_acceptedCount.fetch_add(1, std::memory_order_relaxed);
+						return true;
+					}
+
+					m_rejectedCount.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+
+				/// <summary>
+				/// Releases a slot taken through ::TryAdmitBridge().
+				/// </summary>
+				void ReleaseBridge()
+				{
+					m_activeBridges.fetch_sub(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Attempts to take a handshake slot for a TLS bridge about to begin handshaking.
+				/// </summary>
+				/// <returns>
+				/// True if the slot was taken, in which case ::ReleaseHandshake() must be called
+				/// once the downstream handshake has completed or the bridge is destroyed. False
+				/// if the handshake limit is reached.
+				/// </returns>
+				const bool TryBeginHandshake()
+				{
+					return TryAcquire(m_pendingHandshakes, m_maxPendingHandshakes.load(std::memory_order_relaxed));
+				}
+
+				/// <summary>
+				/// Releases a slot taken through ::TryBeginHandshake().
+				/// </summary>
+				void ReleaseHandshake()
+				{
+					m_pendingHandshakes.fetch_sub(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Attempts to take a spoof slot for a TLS bridge that will be asking the
+				/// certificate store for a server context.
+				/// </summary>
+				/// <returns>
+				/// True if the slot was taken, in which case ::ReleaseSpoof() must be called once
+				/// the certificate store has answered or the bridge is destroyed. False if the
+				/// spoof limit is reached.
+				/// </returns>
+				const bool TryBeginSpoof()
+				{
+					return TryAcquire(m_pendingSpoofs, m_maxPendingSpoofs.load(std::memory_order_relaxed));
+				}
+
+				/// <summary>
+				/// Releases a slot taken through ::TryBeginSpoof().
+				/// </summary>
+				void ReleaseSpoof()
+				{
+					m_pendingSpoofs.fetch_sub(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Records that an acceptor has stopped accepting because the bridge limit was
+				/// reached. Counted once each time an acceptor begins deferring, not once per
+				/// connection left waiting in the backlog, since we can't see those.
+				/// </summary>
+				void RecordDeferred()
+				{
+					m_deferredCount.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Records that a TLS bridge refused by the handshake or spoof limit was degraded
+				/// to a plain tunnel.
+				/// </summary>
+				void RecordTunnelled()
+				{
+					m_tunnelledCount.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Records that a TLS bridge refused by the handshake or spoof limit was dropped.
+				/// </summary>
+				void RecordShed()
+				{
+					m_shedCount.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of bridges presently holding a slot.
+				/// </summary>
+				/// <returns>
+				/// The number of bridges presently holding a slot.
+				/// </returns>
+				const uint32_t GetActiveBridges() const
+				{
+					return m_activeBridges.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of TLS bridges presently handshaking.
+				/// </summary>
+				/// <returns>
+				/// The number of TLS bridges presently handshaking.
+				/// </returns>
+				const uint32_t GetPendingHandshakes() const
+				{
+					return m_pendingHandshakes.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of TLS bridges presently waiting on the certificate store.
+				/// </summary>
+				/// <returns>
+				/// The number of TLS bridges presently waiting on the certificate store.
+				/// </returns>
+				const uint32_t GetPendingSpoofs() const
+				{
+					return m_pendingSpoofs.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of clients that were given a bridge slot.
+				/// </summary>
+				/// <returns>
+				/// The number of clients that were given a bridge slot.
+				/// </returns>
+				const uint64_t GetAcceptedCount() const
+				{
+					return m_acceptedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of times an acceptor began deferring.
+				/// </summary>
+				/// <returns>
+				/// The number of times an acceptor began deferring.
+				/// </returns>
+				const uint64_t GetDeferredCount() const
+				{
+					return m_deferredCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of accepted clients that were reset because there was no
+				/// bridge slot for them.
+				/// </summary>
+				/// <returns>
+				/// The number of accepted clients that were reset.
+				/// </returns>
+				const uint64_t GetRejectedCount() const
+				{
+					return m_rejectedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of TLS bridges that were degraded to a plain tunnel.
+				/// </summary>
+				/// <returns>
+				/// The number of TLS bridges that were degraded to a plain tunnel.
+				/// </returns>
+				const uint64_t GetTunnelledCount() const
+				{
+					return m_tunnelledCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of TLS bridges that were dropped by the handshake or spoof
+				/// limit.
+				/// </summary>
+				/// <returns>
+				/// The number of TLS bridges that were dropped by the handshake or spoof limit.
+				/// </returns>
+				const uint64_t GetShedCount() const
+				{
+					return m_shedCount.load(std::memory_order_relaxed);
+				}
+
+			private:
+
+				/// <summary>
+				/// Increments the supplied gauge, so long as doing so doesn't exceed the supplied
+				/// limit.
+				/// </summary>
+				/// <param name="gauge">
+				/// The gauge to increment.
+				/// </param>
+				/// <param name="limit">
+				/// The limit. Zero means no limit.
+				/// </param>
+				/// <returns>
+				/// True if the gauge was incremented, false otherwise.
+				/// </returns>
+				static const bool TryAcquire(std::atomic<uint32_t>& gauge, const uint32_t limit)
+				{
+					if (limit == 0)
+					{
+						gauge.fetch_add(1, std::memory_order_relaxed);
+						return true;
+					}
+
+					uint32_t current = gauge.load(std::memory_order_relaxed);
+
+					do
+					{
+						if (current >= limit)
+						{
+							return false;
+						}
+					} while (!gauge.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+
+					return true;
+				}
+
+				std::atomic<uint32_t> m_maxActiveBridges{ 0 };
+
+				std::atomic<uint32_t> m_maxPendingHandshakes{ 0 };
+
+				std::atomic<uint32_t> m_maxPendingSpoofs{ 0 };
+
+				std::atomic<bool> m_deferWhenFull{ true };
+
+				std::atomic<bool> m_tunnelWhenOverloaded{ true };
+
+				std::atomic<uint32_t> m_activeBridges{ 0 };
+
+				std::atomic<uint32_t> m_pendingHandshakes{ 0 };
+
+				std::atomic<uint32_t> m_pendingSpoofs{ 0 };
+
+				std::atomic<uint64_t> m_acceptedCount{ 0 };
+
+				std::atomic<uint64_t> m_deferredCount{ 0 };
+
+				std::atomic<uint64_t> m_rejectedCount{ 0 };
+
+				std::atomic<uint64_t> m_tunnelledCount{ 0 };
+
+				std::atomic<uint64_t> m_shedCount{ 0 };
+			};
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,388 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// The ContentVerdictCache class remembers message end verdicts by the content of the
+			/// response body they were reached for, so that when the very same body turns up
+			/// again, as the same script bundles, stylesheets and images constantly do, it can be
+			/// decided without handing it to the consumer again. Bodies are identified by their
+			/// length and the 64 bit xxHash of their bytes as they came off the wire, which every
+			/// transaction computes as the body is read. See BaseHttpTransaction::GetPayloadHash.
+			///
+			/// This assumes that the consumer's verdict depends on the body and nothing else, not
+			/// the URL it came from nor the request that asked for it, so the cache is disabled
+			/// until given a capacity. Only responses inspected in full and on their own are ever
+			/// cached: not samples, and not transactions whose request body was inspected along
+			/// with the response. Verdicts supplied by the timeout default are never cached
+			/// either.
+			///
+			/// Entries are spread across a number of independently locked shards so that bridges
+			/// on different threads rarely contend, and each shard evicts its least recently used
+			/// entry when full. All members are thread safe.
+			/// </summary>
+			class ContentVerdictCache
+			{
+
+			public:
+
+				/// <summary>
+				/// The default maximum number of cached verdicts. The cache is disabled by default.
+				/// </summary>
+				static constexpr uint32_t DefaultMaxEntries = 0;
+
+				/// <summary>
+				/// The number of independently locked shards.
+				/// </summary>
+				static constexpr size_t ShardCount = 16;
+
+				/// <summary>
+				/// Constructs a new ContentVerdictCache instance, disabled.
+				/// </summary>
+				ContentVerdictCache()
+				{
+
+				}
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				ContentVerdictCache(const ContentVerdictCache&) = delete;
+				ContentVerdictCache(ContentVerdictCache&&) = delete;
+				ContentVerdictCache& operator=(const ContentVerdictCache&) = delete;
+
+				/// <summary>
+				/// Sets the maximum number of cached verdicts. Zero disables the cache. Anything
+				/// already cached is flushed whenever the capacity changes.
+				/// </summary>
+				/// <param name="maxEntries">
+				/// The maximum number of cached verdicts.
+				/// </param>
+				void SetMaxEntries(const uint32_t maxEntries)
+				{
+					m_maxEntries.store(maxEntries, std::memory_order_relaxed);
+					Flush();
+				}
+
+				/// <summary>
+				/// Gets the maximum number of cached verdicts.
+				/// </summary>
+				/// <returns>
+				/// The maximum number of cached verdicts, or zero if the cache is disabled.
+				/// </returns>
+				const uint32_t GetMaxEntries() const
+				{
+					return m_maxEntries.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Looks for a verdict cached for a body.
+				/// </summary>
+				/// <param name="hash">
+				/// The hash of the body.
+				/// </param>
+				/// <param name="length">
+				/// The length of the body.
+				/// </param>
+				/// <param name="shouldBlock">
+				/// Set to the cached verdict on a hit.
+				/// </param>
+				/// <param name="customResponse">
+				/// Set to the cached custom block response on a hit, if one was supplied along
+				/// with the verdict.
+				/// </param>
+				/// <returns>
+				/// True if a verdict was found, false otherwise.
+				/// </returns>
+				const bool Lookup(const uint64_t hash, const uint64_t length, bool& shouldBlock, std::shared_ptr<const std::vector<char>>& customResponse)
+				{
+					if (m_maxEntries.load(std::memory_order_relaxed) == 0)
+					{
+						return false;
+					}
+
+					auto& shard = GetShard(hash);
+
+					std::lock_guard<std::mutex> lock(shard.mutex);
+
+					auto it = shard.index.find(hash);
+
+					if (it == shard.index.end() || it->second->length != length)
+					{
+						m_missCount.fetch_add(1, std::memory_order_relaxed);
+						return false;
+					}
+
+					// Most recently used at the front.
+					shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+
+					shouldBlock = it->second->shouldBlock;
+					customResponse = it->second->customResponse;
+
+					m_hitCount.fetch_add(1, std::memory_order_relaxed);
+
+					return true;
+				}
+
+				/// <summary>
+				/// Caches the verdict reached for a body.
+				/// </summary>
+				/// <param name="hash">
+				/// The hash of the body.
+				/// </param>
+				/// <param name="length">
+				/// The length of the body.
+				/// </param>
+				/// <param name="shouldBlock">
+				/// The verdict.
+				/// </param>
+				/// <param name="customResponse">
+				/// The custom block response supplied with the verdict. May be nullptr. It's
+				/// shared, not copied.
+				/// </param>
+				void Store(const uint64_t hash, const uint64_t length, const bool shouldBlock, const std::shared_ptr<const std::vector<char>>& customResponse)
+				{
+					const uint32_t maxEntries = m_maxEntries.load(std::memory_order_relaxed);
+
+					if (maxEntries == 0)
+					{
+						return;
+					}
+
+					const size_t maxShardEntries = maxEntries < ShardCount ? 1 : maxEntries / ShardCount;
+
+					std::shared_ptr<const std::vector<char>> sharedResponse;
+
+					if (shouldBlock && customResponse && customResponse->size() > 0)
+					{
+						sharedResponse = customResponse;
+					}
+
+					auto& shard = GetShard(hash);
+
+					std::lock_guard<std::mutex> lock(shard.mutex);
+
+					auto existing = shard.index.find(hash);
+
+					if (existing != shard.index.end())
+					{
+						existing->second->length = length;
+						existing->second->shouldBlock = shouldBlock;
+						existing->second->customResponse = std::move(sharedResponse);
+						shard.entries.splice(shard.entries.begin(), shard.entries, existing->second);
+						m_insertCount.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+
+					while (shard.entries.size() >= maxShardEntries && shard.entries.size() > 0)
+					{
+						shard.index.erase(shard.entries.back().hash);
+						shard.entries.pop_back();
+						m_entryCount.fetch_sub(1, std::memory_order_relaxed);
+						m_evictionCount.fetch_add(1, std::memory_order_relaxed);
+					}
+
+					Entry entry;
+					entry.hash = hash;
+					entry.length = length;
+					entry.shouldBlock = shouldBlock;
+					entry.customResponse = std::move(sharedResponse);
+
+					shard.entries.push_front(std::move(entry));
+					shard.index.emplace(hash, shard.entries.begin());
+
+					m_entryCount.fetch_add(1, std::memory_order_relaxed);
+					m_insertCount.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Discards every cached verdict. Meant to be called whenever the classifier the
+				/// consumer reaches its verdicts with has changed.
+				/// </summary>
+				void Flush()
+				{
+					for (auto& shard : m_shards)
+					{
+						std::lock_guard<std::mutex> lock(shard.mutex);
+						m_entryCount.fetch_sub(static_cast<uint32_t>(shard.entries.size()), std::memory_order_relaxed);
+						shard.index.clear();
+						shard.entries.clear();
+					}
+
+					m_flushCount.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Records the hashing done for a body that was looked up.
+				/// </summary>
+				/// <param name="bytes">
+				/// The number of bytes hashed.
+				/// </param>
+				/// <param name="nanoseconds">
+				/// The time spent hashing them.
+				/// </param>
+				void RecordHashed(const uint64_t bytes, const uint64_t nanoseconds)
+				{
+					m_hashedBytes.fetch_add(bytes, std::memory_order_relaxed);
+					m_hashNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of verdicts presently cached.
+				/// </summary>
+				/// <returns>
+				/// The number of verdicts presently cached.
+				/// </returns>
+				const uint32_t GetEntryCount() const
+				{
+					return m_entryCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of bodies decided from the cache.
+				/// </summary>
+				/// <returns>
+				/// The number of cache hits.
+				/// </returns>
+				const uint64_t GetHitCount() const
+				{
+					return m_hitCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of bodies that had to be handed to the consumer because no
+				/// verdict was cached for them. Bodies checked while the cache was disabled
+				/// aren't counted.
+				/// </summary>
+				/// <returns>
+				/// The number of cache misses.
+				/// </returns>
+				const uint64_t GetMissCount() const
+				{
+					return m_missCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of verdicts that have been cached.
+				/// </summary>
+				/// <returns>
+				/// The number of verdicts that have been cached.
+				/// </returns>
+				const uint64_t GetInsertCount() const
+				{
+					return m_insertCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of verdicts evicted to make room.
+				/// </summary>
+				/// <returns>
+				/// The number of verdicts evicted.
+				/// </returns>
+				const uint64_t GetEvictionCount() const
+				{
+					return m_evictionCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of times the cache has been flushed.
+				/// </summary>
+				/// <returns>
+				/// The number of times the cache has been flushed.
+				/// </returns>
+				const uint64_t GetFlushCount() const
+				{
+					return m_flushCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the total number of body bytes hashed for bodies that were looked up.
+				/// </summary>
+				/// <returns>
+				/// The number of bytes hashed.
+				/// </returns>
+				const uint64_t GetHashedBytes() const
+				{
+					return m_hashedBytes.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the total time spent hashing the bytes counted by ::GetHashedBytes(). The
+				/// two together give the hashing throughput.
+				/// </summary>
+				/// <returns>
+				/// The time spent hashing, in nanoseconds.
+				/// </returns>
+				const uint64_t GetHashNanoseconds() const
+				{
+					return m_hashNanoseconds.load(std::memory_order_relaxed);
+				}
+
+			private:
+
+				struct Entry
+				{
+					uint64_t hash = 0;
+					uint64_t length = 0;
+					bool shouldBlock = false;
+					std::shared_ptr<const std::vector<char>> customResponse;
+				};
+
+				struct Shard
+				{
+					std::mutex mutex;
+					std::list<Entry> entries;
+					std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+				};
+
+				Shard& GetShard(const uint64_t hash)
+				{
+					// The low bits are as good as any, the hash being what it is.
+					return m_shards[static_cast<size_t>(hash % ShardCount)];
+				}
+
+				std::atomic<uint32_t> m_maxEntries{ DefaultMaxEntries };
+
+				std::array<Shard, ShardCount> m_shards;
+
+				std::atomic<uint32_t> m_entryCount{ 0 };
+
+				std::atomic<uint64_t> m_hitCount{ 0 };
+
+				std::atomic<uint64_t> m_missCount{ 0 };
+
+				std::atomic<uint64_t> m_insertCount{ 0 };
+
+				std::atomic<uint64_t> m_evictionCount{ 0 };
+
+				std::atomic<uint64_t> m_flushCount{ 0 };
+
+				std::atomic<uint64_t> m_hashedBytes{ 0 };
+
+				std::atomic<uint64_t> m_hashNanoseconds{ 0 };
+			};
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
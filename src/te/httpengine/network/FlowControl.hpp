@@ -0,0 +1,397 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// The FlowControl class governs how many bytes may be in flight through the proxy at
+			/// any given time. A byte is "in flight" from the moment that a bridge initiates a read
+			/// that may deliver it, until the moment that the bridge has finished writing it to
+			/// the opposite peer. Since bridges move data in lock-step (read, write, read again),
+			/// the amount a single bridge can have in flight in one direction is simply the size
+			/// of the read it issues, so bounding the read size bounds the bridge.
+			///
+			/// There are two limits. The first is a per-bridge limit, which caps what a bridge
+			/// has in flight in both directions combined. This keeps a fast origin feeding a slow
+			/// local client (or a fast client uploading to a slow server) from ever having more
+			/// than this many bytes sitting in our memory per bridge. Bridges charge their reads
+			/// in either direction against one counter of their own, and keep MinReservation of
+			/// the limit free for the other direction while it has nothing in flight, so that a
+			/// read left pending in one direction never starves the other. The second is a global
+			/// limit, shared across every bridge. Before a bridge issues a streaming read, it must
+			/// reserve the bytes it intends to read against the global limit. If the global limit
+			/// is exhausted, the reservation fails and the bridge is expected to pause reading
+			/// until it's resumed. This way, a burst of fast downloads can't balloon memory.
+			///
+			/// Paused bridges queue up with ::Wait(...), and are resumed in the order they
+			/// paused as bytes are released, as many at a time as the released bytes could
+			/// serve. Nothing is woken while the budget stays exhausted, however many bridges are
+			/// paused. Bridges also arm a timer of PauseFallbackMilliseconds when they pause, and
+			/// retry when it expires, in case a wake up is ever missed.
+			///
+			/// Bodies that have been flagged for inspection are not governed here. Those must be
+			/// consumed entirely before anything is written, and are already bounded by
+			/// BaseHttpTransaction::MaxPayloadResize. Pausing them against the global limit would
+			/// allow a group of inspecting bridges to deadlock each other until timeout.
+			///
+			/// All members are thread safe.
+			/// </summary>
+			class FlowControl
+			{
+
+			public:
+
+				/// <summary>
+				/// The default maximum number of bytes a single bridge may have in flight, in both
+				/// directions combined. Matches the read size that bridges have always used for
+				/// HTTP payloads.
+				/// </summary>
+				static constexpr uint32_t DefaultMaxBridgeInFlightBytes = 131072;
+
+				/// <summary>
+				/// The smallest reservation that will be granted. When the global limit only has
+				/// crumbs left, it's better to pause briefly and then read a reasonable amount than
+				/// to spin issuing tiny reads. This is also the floor for the global limit.
+				/// </summary>
+				static constexpr uint32_t MinReservation = 4096;
+
+				/// <summary>
+				/// The floor for the per-bridge limit, which must leave room for a reservation in
+				/// each direction at once.
+				/// </summary>
+				static constexpr uint32_t MinBridgeInFlightBytes = MinReservation * 2;
+
+				/// <summary>
+				/// How long a bridge that was refused a reservation should wait, in milliseconds,
+				/// before trying again if it hasn't been resumed by then. Bridges are normally
+				/// resumed as soon as bytes are released, so this only matters if that's missed,
+				/// such as when the per-bridge limit is lowered under a paused bridge.
+				/// </summary>
+				static constexpr uint32_t PauseFallbackMilliseconds = 250;
+
+				/// <summary>
+				/// Resumes a bridge that was refused a reservation, by posting the retry of its
+				/// read to the strand it belongs to. Must not do the retry inline, since it's
+				/// called from whichever thread released the bytes. Returns false if there was
+				/// nothing to resume, such as when the bridge has since been destroyed or resumed
+				/// by its fallback timer, so that the released bytes go to the next waiter instead.
+				/// </summary>
+				using ResumeFunction = std::function<bool()>;
+
+				/// <summary>
+				/// Constructs a new FlowControl instance.
+				/// </summary>
+				/// <param name="maxBridgeInFlightBytes">
+				/// The maximum number of bytes a single bridge may have in flight, in both
+				/// directions combined. Values below MinBridgeInFlightBytes are raised to
+				/// MinBridgeInFlightBytes.
+				/// </param>
+				/// <param name="maxGlobalInFlightBytes">
+				/// The maximum number of bytes that may be in flight across all bridges combined.
+				/// A value of zero means no global limit. Nonzero values below MinReservation
+				/// are raised to MinReservation.
+				/// </param>
+				FlowControl(
+					const uint32_t maxBridgeInFlightBytes = DefaultMaxBridgeInFlightBytes,
+					const uint64_t maxGlobalInFlightBytes = 0
+					)
+				{
+					SetMaxBridgeInFlightBytes(maxBridgeInFlightBytes);
+					SetMaxGlobalInFlightBytes(maxGlobalInFlightBytes);
+				}
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				FlowControl(const FlowControl&) = delete;
+				FlowControl(FlowControl&&) = delete;
+				FlowControl& operator=(const FlowControl&) = delete;
+
+				/// <summary>
+				/// Gets the maximum number of bytes a single bridge may have in flight, in both
+				/// directions combined.
+				/// </summary>
+				/// <returns>
+				/// The maximum number of bytes a single bridge may have in flight.
+				/// </returns>
+				const uint32_t GetMaxBridgeInFlightBytes() const
+				{
+					return m_maxBridgeInFlightBytes.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Sets the maximum number of bytes a single bridge may have in flight, in both
+				/// directions combined. Takes effect on the next read each bridge issues.
+				/// </summary>
+				/// <param name="value">
+				/// The new limit. Values below MinBridgeInFlightBytes are raised to
+				/// MinBridgeInFlightBytes.
+				/// </param>
+				void SetMaxBridgeInFlightBytes(const uint32_t value)
+				{
+					m_maxBridgeInFlightBytes.store(value < MinBridgeInFlightBytes ? MinBridgeInFlightBytes : value, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the maximum number of bytes that may be in flight across all bridges
+				/// combined.
+				/// </summary>
+				/// <returns>
+				/// The global limit, or zero if there is no global limit.
+				/// </returns>
+				const uint64_t GetMaxGlobalInFlightBytes() const
+				{
+					return m_maxGlobalInFlightBytes.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Sets the maximum number of bytes that may be in flight across all bridges
+				/// combined. Lowering the limit below what is currently in flight doesn't revoke
+				/// anything, it simply refuses new reservations until enough has been released.
+				/// </summary>
+				/// <param name="value">
+				/// The new limit. Zero means no global limit. Nonzero values below
+				/// MinReservation are raised to MinReservation.
+				/// </param>
+				void SetMaxGlobalInFlightBytes(const uint64_t value)
+				{
+					m_maxGlobalInFlightBytes.store((value == 0 || value >= MinReservation) ? value : MinReservation, std::memory_order_relaxed);
+
+					// The limit may have been raised.
+					ResumeWaiters();
+				}
+
+				/// <summary>
+				/// Attempts to reserve bytes against the global limit.
+				/// </summary>
+				/// <param name="wanted">
+				/// The most the caller would like to reserve, which is whatever its share of the
+				/// per-bridge limit leaves it.
+				/// </param>
+				/// <returns>
+				/// The number of bytes reserved, which is the most the caller may read before
+				/// releasing them. Zero if the global limit is presently exhausted, in which case
+				/// the caller should pause, and ::Wait(...) to be resumed.
+				/// </returns>
+				const uint32_t TryReserve(const uint32_t wanted)
+				{
+					const uint64_t globalMax = GetMaxGlobalInFlightBytes();
+
+					uint64_t inFlight = m_inFlightBytes.load(std::memory_order_relaxed);
+					uint32_t granted = 0;
+
+					do
+					{
+						granted = wanted;
+
+						if (globalMax > 0)
+						{
+							const uint64_t available = inFlight < globalMax ? globalMax - inFlight : 0;
+
+							if (available < MinReservation)
+							{
+								m_pauseCount.fetch_add(1, std::memory_order_relaxed);
+								return 0;
+							}
+
+							granted = static_cast<uint32_t>(std::min<uint64_t>(wanted, available));
+						}
+					} while (!m_inFlightBytes.compare_exchange_weak(inFlight, inFlight + granted, std::memory_order_relaxed));
+
+					const uint64_t nowInFlight = inFlight + granted;
+					uint64_t peak = m_peakInFlightBytes.load(std::memory_order_relaxed);
+					while (nowInFlight > peak && !m_peakInFlightBytes.compare_exchange_weak(peak, nowInFlight, std::memory_order_relaxed))
+					{
+					}
+
+					return granted;
+				}
+
+				/// <summary>
+				/// Releases bytes previously obtained through ::TryReserve().
+				/// </summary>
+				/// <param name="bytes">
+				/// The exact number of bytes that ::TryReserve() returned.
+				/// </param>
+				void Release(const uint32_t bytes)
+				{
+					m_inFlightBytes.fetch_sub(bytes, std::memory_order_relaxed);
+
+					if (m_waiterCount.load(std::memory_order_relaxed) > 0)
+					{
+						ResumeWaiters();
+					}
+				}
+
+				/// <summary>
+				/// Queues a bridge that was just refused a reservation, to be resumed once enough
+				/// bytes have been released. If enough were released between the refusal and this
+				/// call, waiters are resumed right away, so that the release isn't missed.
+				/// </summary>
+				/// <param name="resume">
+				/// Resumes the bridge. See ResumeFunction.
+				/// </param>
+				void Wait(ResumeFunction resume)
+				{
+					{
+						std::lock_guard<std::mutex> lock(m_waitersLock);
+						m_waiters.push_back(std::move(resume));
+						m_waiterCount.fetch_add(1, std::memory_order_relaxed);
+					}
+
+					ResumeWaiters();
+				}
+
+				/// <summary>
+				/// Gets the number of bridges presently waiting to be resumed. Waiters that have
+				/// since been resumed by their fallback timer are included until they're dropped.
+				/// </summary>
+				/// <returns>
+				/// The number of queued waiters.
+				/// </returns>
+				const uint64_t GetWaiterCount() const
+				{
+					return m_waiterCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the total number of bytes presently reserved across all bridges.
+				/// </summary>
+				/// <returns>
+				/// The total number of bytes presently reserved across all bridges.
+				/// </returns>
+				const uint64_t GetInFlightBytes() const
+				{
+					return m_inFlightBytes.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the highest number of bytes that have been reserved at any one time.
+				/// </summary>
+				/// <returns>
+				/// The highest number of bytes that have been reserved at any one time.
+				/// </returns>
+				const uint64_t GetPeakInFlightBytes() const
+				{
+					return m_peakInFlightBytes.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of times that a reservation was refused, meaning that a
+				/// bridge had to pause reading.
+				/// </summary>
+				/// <returns>
+				/// The number of times that a reservation was refused.
+				/// </returns>
+				const uint64_t GetPauseCount() const
+				{
+					return m_pauseCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of times that a paused bridge was resumed because bytes were
+				/// released, rather than by its fallback timer.
+				/// </summary>
+				/// <returns>
+				/// The number of times that a paused bridge was resumed on release.
+				/// </returns>
+				const uint64_t GetResumeCount() const
+				{
+					return m_resumeCount.load(std::memory_order_relaxed);
+				}
+
+			private:
+
+				/// <summary>
+				/// Resumes queued waiters, oldest first, for as long as what's available under the
+				/// global limit could serve them, counting a full per-bridge reservation for each.
+				/// Waiters that had nothing to resume don't count against what's available.
+				/// </summary>
+				void ResumeWaiters()
+				{
+					const uint64_t globalMax = GetMaxGlobalInFlightBytes();
+					const uint64_t inFlight = GetInFlightBytes();
+
+					uint64_t available = std::numeric_limits<uint64_t>::max();
+
+					if (globalMax > 0)
+					{
+						available = inFlight < globalMax ? globalMax - inFlight : 0;
+					}
+
+					const uint64_t perWaiter = GetMaxBridgeInFlightBytes();
+
+					while (available >= MinReservation)
+					{
+						ResumeFunction resume;
+
+						{
+							std::lock_guard<std::mutex> lock(m_waitersLock);
+
+							if (m_waiters.empty())
+							{
+								return;
+							}
+
+							resume = std::move(m_waiters.front());
+							m_waiters.pop_front();
+							m_waiterCount.fetch_sub(1, std::memory_order_relaxed);
+						}
+
+						// Called outside of the lock, since it may take the strand's lock.
+						if (resume())
+						{
+							m_resumeCount.fetch_add(1, std::memory_order_relaxed);
+							available -= std::min(available, perWaiter);
+						}
+					}
+				}
+
+				std::atomic<uint32_t> m_maxBridgeInFlightBytes{ DefaultMaxBridgeInFlightBytes };
+
+				std::atomic<uint64_t> m_maxGlobalInFlightBytes{ 0 };
+
+				std::atomic<uint64_t> m_inFlightBytes{ 0 };
+
+				std::atomic<uint64_t> m_peakInFlightBytes{ 0 };
+
+				std::atomic<uint64_t> m_pauseCount{ 0 };
+
+				std::atomic<uint64_t> m_resumeCount{ 0 };
+
+				/// <summary>
+				/// Bridges waiting to be resumed, oldest first. See ::Wait(...).
+				/// </summary>
+				std::deque<ResumeFunction> m_waiters;
+
+				std::mutex m_waitersLock;
+
+				/// <summary>
+				/// The size of m_waiters, readable without taking the lock, so that ::Release(...)
+				/// costs nothing extra while nobody waits.
+				/// </summary>
+				std::atomic<uint64_t> m_waiterCount{ 0 };
+			};
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
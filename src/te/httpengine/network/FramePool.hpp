@@ -0,0 +1,247 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// The FramePool class hands out the frames that hold the state of a coroutine
+			/// bridge, one for each direction, and takes them back when the bridge goes. A
+			/// frame holds everything a direction keeps between one suspension and the next,
+			/// including its HandlerMemory and a buffer for peeking and tunnelling, so it's
+			/// well into the tens of kilobytes. Getting one from the global heap for every
+			/// connection, and giving it back a moment later, is exactly the churn the pool is
+			/// there to avoid.
+			///
+			/// The memory of a frame that's given back is kept, up to a limit, and the next
+			/// frame is constructed in it. Beyond the limit, memory goes back to the heap. So a
+			/// burst of connections costs allocations only for as many frames as were never
+			/// in use at once before.
+			///
+			/// All members are thread safe. Frames are acquired and released by whichever io
+			/// thread the bridge is on at the time.
+			/// </summary>
+			template<typename Frame>
+			class FramePool
+			{
+
+			private:
+
+				/// <summary>
+				/// Returns a frame to the pool it came from, rather than deleting it.
+				/// </summary>
+				class Releaser
+				{
+
+				public:
+
+					Releaser(FramePool* pool = nullptr)
+						:
+						m_pool(pool)
+					{
+
+					}
+
+					void operator()(Frame* frame) const
+					{
+						m_pool->Release(frame);
+					}
+
+				private:
+
+					FramePool* m_pool;
+				};
+
+			public:
+
+				/// <summary>
+				/// A frame that goes back to its pool when it's destroyed.
+				/// </summary>
+				using Pointer = std::unique_ptr<Frame, Releaser>;
+
+				/// <summary>
+				/// The default number of idle frames kept for reuse.
+				/// </summary>
+				static constexpr size_t DefaultMaxIdleFrames = 512;
+
+				/// <summary>
+				/// Constructs a new, empty FramePool.
+				/// </summary>
+				/// <param name="maxIdleFrames">
+				/// The most frames that are kept for reuse once they're released. Space for
+				/// that many is reserved up front, so that releasing a frame never allocates.
+				/// </param>
+				FramePool(const size_t maxIdleFrames = DefaultMaxIdleFrames)
+					:
+					m_maxIdleFrames(maxIdleFrames)
+				{
+					m_idle.reserve(m_maxIdleFrames);
+				}
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				FramePool(const FramePool&) = delete;
+				FramePool(FramePool&&) = delete;
+				FramePool& operator=(const FramePool&) = delete;
+
+				/// <summary>
+				/// Gives the memory of every idle frame back to the heap. Every frame that was
+				/// acquired must have been released by now.
+				/// </summary>
+				~FramePool()
+				{
+					for (void* block : m_idle)
+					{
+						::operator delete(block);
+					}
+				}
+
+				/// <summary>
+				/// Constructs a frame, in the memory of one that was released if there is one.
+				/// The frame is default initialized, not value initialized, so that a frame's
+				/// buffers aren't zeroed for nothing every time.
+				/// </summary>
+				/// <returns>
+				/// The frame, which goes back to the pool when the pointer is destroyed.
+				/// </returns>
+				Pointer Acquire()
+				{
+					void* block = nullptr;
+
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+
+						if (!m_idle.empty())
+						{
+							block = m_idle.back();
+							m_idle.pop_back();
+						}
+					}
+
+					if (block == nullptr)
+					{
+						block = ::operator new(sizeof(Frame));
+						m_allocatedCount.fetch_add(1, std::memory_order_relaxed);
+					}
+					else
+					{
+						m_reusedCount.fetch_add(1, std::memory_order_relaxed);
+					}
+
+					try
+					{
+						return Pointer(new (block) Frame, Releaser(this));
+					}
+					catch (...)
+					{
+						Recycle(block);
+						throw;
+					}
+				}
+
+				/// <summary>
+				/// Gets the number of frames that needed fresh memory from the heap.
+				/// </summary>
+				/// <returns>
+				/// The number of frames that needed fresh memory from the heap.
+				/// </returns>
+				const uint64_t GetAllocatedCount() const
+				{
+					return m_allocatedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of frames that were constructed in the memory of a released
+				/// one.
+				/// </summary>
+				/// <returns>
+				/// The number of frames that were constructed in the memory of a released one.
+				/// </returns>
+				const uint64_t GetReusedCount() const
+				{
+					return m_reusedCount.load(std::memory_order_relaxed);
+				}
+
+			private:
+
+				/// <summary>
+				/// Destroys a frame and keeps its memory for the next one.
+				/// </summary>
+				/// <param name="frame">
+				/// The frame.
+				/// </param>
+				void Release(Frame* frame)
+				{
+					frame->~Frame();
+					Recycle(frame);
+				}
+
+				/// <summary>
+				/// Keeps the memory of a frame for the next one, or gives it back to the heap if
+				/// enough are kept already.
+				/// </summary>
+				/// <param name="block">
+				/// The memory of a frame that has been destroyed.
+				/// </param>
+				void Recycle(void* block)
+				{
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+
+						if (m_idle.size() < m_maxIdleFrames)
+						{
+							m_idle.push_back(block);
+							return;
+						}
+					}
+
+					::operator delete(block);
+				}
+
+				/// <summary>
+				/// The most frames that are kept for reuse.
+				/// </summary>
+				const size_t m_maxIdleFrames;
+
+				/// <summary>
+				/// Guards m_idle.
+				/// </summary>
+				std::mutex m_mutex;
+
+				/// <summary>
+				/// The memory of released frames, ready to construct new ones in.
+				/// </summary>
+				std::vector<void*> m_idle;
+
+				/// <summary>
+				/// The number of frames that needed fresh memory from the heap.
+				/// </summary>
+				std::atomic<uint64_t> m_allocatedCount{ 0 };
+
+				/// <summary>
+				/// The number of frames that were constructed in the memory of a released one.
+				/// </summary>
+				std::atomic<uint64_t> m_reusedCount{ 0 };
+			};
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,194 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/aligned_storage.hpp>
+#include <atomic>
+#include <type_traits>
+#include <utility>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// A small, fixed block of memory that asynchronous operations on a single direction
+			/// of a bridge can have their handlers allocated from. Every hop in the bridge
+			/// (read, parse, write, read again...) otherwise results in asio allocating a new
+			/// operation object to hold our bound handler, plus the strand wrapper and any
+			/// composed operation state, on the heap. Since every direction of a bridge only
+			/// ever has a single read or write pending at any given time, we can simply keep
+			/// one block per direction and recycle it for the entire lifetime of the bridge.
+			///
+			/// In the event that the block is already in use, or the requested size is larger
+			/// than the block, we fall back to the global heap. So correctness never depends on
+			/// the one-op-per-direction assumption holding, it's purely an optimization.
+			///
+			/// This is based on the allocation example that ships with asio.
+			/// </summary>
+			class HandlerMemory
+			{
+
+			public:
+
+				/// <summary>
+				/// The size of the block that will be recycled. This needs to be large enough
+				/// for a strand wrapped, std::bind'd bridge member plus the state of a composed
+				/// read or write over an ssl::stream. Anything larger goes to the heap.
+				/// </summary>
+				static constexpr size_t BlockSize = 1024;
+
+				HandlerMemory()
+				{
+
+				}
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				HandlerMemory(const HandlerMemory&) = delete;
+				HandlerMemory(HandlerMemory&&) = delete;
+				HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+				/// <summary>
+				/// Allocates memory for a handler. If the internal block is available and
+				/// large enough, it will be handed out. Otherwise, the request is forwarded to
+				/// the global heap.
+				/// </summary>
+				/// <param name="size">
+				/// The number of bytes requested.
+				/// </param>
+				/// <returns>
+				/// A pointer to memory of at least the requested size.
+				/// </returns>
+				void* Allocate(const size_t size)
+				{
+					if (size <= m_storage.size && !m_inUse.exchange(true, std::memory_order_acquire))
+					{
+						return m_storage.address();
+					}
+
+					return ::operator new(size);
+				}
+
+				/// <summary>
+				/// Releases memory previously obtained from ::Allocate(size_t).
+				/// </summary>
+				/// <param name="pointer">
+				/// The pointer previously returned by ::Allocate(size_t).
+				/// </param>
+				void Deallocate(void* pointer)
+				{
+					if (pointer == m_storage.address())
+					{
+						m_inUse.store(false, std::memory_order_release);
+						return;
+					}
+
+					::operator delete(pointer);
+				}
+
+			private:
+
+				/// <summary>
+				/// The recycled block.
+				/// </summary>
+				boost::aligned_storage<BlockSize> m_storage;
+
+				/// <summary>
+				/// Whether or not the block is currently handed out. Operations for a single
+				/// direction of a bridge are issued one after the other, but the completion
+				/// that gives the block back and the initiation that takes it again aren't
+				/// always on the same thread, and a block that lives in a pooled frame is
+				/// handed from one bridge to the next. So the flag is taken with an exchange,
+				/// and whoever takes it sees everything the last holder wrote into the block.
+				/// </summary>
+				std::atomic<bool> m_inUse{ false };
+			};
+
+			/// <summary>
+			/// Wraps a completion handler so that asio will obtain the memory for the
+			/// operation that holds it from the supplied HandlerMemory instance rather than
+			/// from the global heap.
+			///
+			/// When used with a strand, this must be the handler that is wrapped by the
+			/// strand, not the other way around. ie strand.wrap(MakeCustomAllocHandler(...)).
+			/// The strand's wrapper forwards allocation to the handler it wraps, including
+			/// the allocation it does when it has to queue the handler, and it keeps its own
+			/// invocation hook so that intermediate handlers of composed operations still run
+			/// within the strand.
+			/// </summary>
+			template<typename Handler>
+			class CustomAllocHandler
+			{
+
+			public:
+
+				CustomAllocHandler(HandlerMemory& memory, Handler handler)
+					:
+					m_memory(memory),
+					m_handler(std::move(handler))
+				{
+
+				}
+
+				template<typename... Args>
+				void operator()(Args&&... args)
+				{
+					m_handler(std::forward<Args>(args)...);
+				}
+
+				friend void* asio_handler_allocate(std::size_t size, CustomAllocHandler<Handler>* thisHandler)
+				{
+					return thisHandler->m_memory.Allocate(size);
+				}
+
+				friend void asio_handler_deallocate(void* pointer, std::size_t, CustomAllocHandler<Handler>* thisHandler)
+				{
+					thisHandler->m_memory.Deallocate(pointer);
+				}
+
+				friend bool asio_handler_is_continuation(CustomAllocHandler<Handler>* thisHandler)
+				{
+					return boost_asio_handler_cont_helpers::is_continuation(thisHandler->m_handler);
+				}
+
+			private:
+
+				HandlerMemory& m_memory;
+
+				Handler m_handler;
+			};
+
+			/// <summary>
+			/// Convenience function for constructing a CustomAllocHandler with type deduction.
+			/// </summary>
+			/// <param name="memory">
+			/// The memory block that the operation holding the handler should be allocated
+			/// from. Must outlive the operation. In the case of the bridges, the block is a
+			/// member, and the handler holds a shared_ptr to the bridge, so this is guaranteed.
+			/// </param>
+			/// <param name="handler">
+			/// The completion handler to wrap.
+			/// </param>
+			/// <returns>
+			/// The wrapped handler.
+			/// </returns>
+			template<typename Handler>
+			inline CustomAllocHandler<typename std::decay<Handler>::type> MakeCustomAllocHandler(HandlerMemory& memory, Handler&& handler)
+			{
+				return CustomAllocHandler<typename std::decay<Handler>::type>(memory, std::forward<Handler>(handler));
+			}
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,266 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// The RecompressionControl class holds the settings that decide how a response that
+			/// was decompressed for inspection is encoded on its way to the client, and counts
+			/// what came of them.
+			///
+			/// A response that's consumed in full for inspection is decompressed, so that the
+			/// message end callback sees the real content. By default, it's then sent to the
+			/// client as it is, uncompressed, which costs nothing but bandwidth. It can instead be
+			/// compressed again, with gzip or deflate, whichever the settings and the client's
+			/// Accept-Encoding allow. Compressing happens on the io_service thread, so rather than
+			/// compressing the whole payload before any of it is sent, it's compressed a slice at
+			/// a time, each slice as the one before it has been written, and sent chunked. That
+			/// bounds how long any one handler holds the thread, and means the first bytes reach
+			/// the client after compressing one slice rather than the whole thing.
+			///
+			/// Whatever the settings, a client that refuses identity, by way of "identity;q=0" or
+			/// "*;q=0", gets the payload compressed with a coding it does accept, and a client
+			/// that accepts neither gzip nor deflate gets it uncompressed. HTTP/1.0 clients, which
+			/// don't understand chunked transfers, and payloads too small to be worth it, are
+			/// always sent uncompressed.
+			///
+			/// Settings take effect for responses written after the change. All members are
+			/// thread safe.
+			/// </summary>
+			class RecompressionControl
+			{
+
+			public:
+
+				/// <summary>
+				/// How a decompressed response is encoded for the client.
+				/// </summary>
+				enum class Mode : uint32_t
+				{
+					/// <summary>
+					/// Uncompressed, whenever the client allows it. The default.
+					/// </summary>
+					Identity = 0,
+
+					/// <summary>
+					/// Compressed with whichever of gzip and deflate the client prefers.
+					/// </summary>
+					ClientPreference = 1,
+
+					/// <summary>
+					/// Compressed with gzip, if the client accepts it.
+					/// </summary>
+					Gzip = 2,
+
+					/// <summary>
+					/// Compressed with deflate, if the client accepts it.
+					/// </summary>
+					Deflate = 3
+				};
+
+				/// <summary>
+				/// The default compression level. The fastest there is.
+				/// </summary>
+				static constexpr int32_t DefaultLevel = 1;
+
+				/// <summary>
+				/// Payloads smaller than this are always sent uncompressed. Below about this size,
+				/// compressing saves less than it costs, and often doesn't save anything at all.
+				/// </summary>
+				static constexpr uint32_t MinPayloadBytes = 1024;
+
+				/// <summary>
+				/// How much of the payload is compressed for each write to the client.
+				/// </summary>
+				static constexpr uint32_t SliceBytes = 64 * 1024;
+
+				/// <summary>
+				/// Constructs a new RecompressionControl instance with default settings.
+				/// </summary>
+				RecompressionControl()
+				{
+
+				}
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				RecompressionControl(const RecompressionControl&) = delete;
+				RecompressionControl(RecompressionControl&&) = delete;
+				RecompressionControl& operator=(const RecompressionControl&) = delete;
+
+				/// <summary>
+				/// Sets how decompressed responses are encoded for the client.
+				/// </summary>
+				/// <param name="mode">
+				/// How decompressed responses are encoded. Unknown values are taken to mean
+				/// Mode::Identity.
+				/// </param>
+				/// <param name="level">
+				/// The compression level, from one, the fastest, to nine, the smallest. Values
+				/// outside of that are clamped.
+				/// </param>
+				void Configure(const Mode mode, const int32_t level)
+				{
+					m_mode.store(static_cast<uint32_t>(mode) > static_cast<uint32_t>(Mode::Deflate) ? static_cast<uint32_t>(Mode::Identity) : static_cast<uint32_t>(mode), std::memory_order_relaxed);
+					m_level.store(level < 1 ? 1 : (level > 9 ? 9 : level), std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets how decompressed responses are encoded for the client.
+				/// </summary>
+				/// <returns>
+				/// How decompressed responses are encoded.
+				/// </returns>
+				const Mode GetMode() const
+				{
+					return static_cast<Mode>(m_mode.load(std::memory_order_relaxed));
+				}
+
+				/// <summary>
+				/// Gets the compression level.
+				/// </summary>
+				/// <returns>
+				/// The compression level.
+				/// </returns>
+				const int32_t GetLevel() const
+				{
+					return m_level.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Records that a decompressed response was sent to the client uncompressed.
+				/// </summary>
+				void RecordIdentity()
+				{
+					m_identityCount.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Records that a decompressed response was compressed again and sent to the
+				/// client in full.
+				/// </summary>
+				/// <param name="inputBytes">
+				/// The size of the payload before compression.
+				/// </param>
+				/// <param name="outputBytes">
+				/// The size of the payload after compression, not counting chunked framing.
+				/// </param>
+				/// <param name="nanoseconds">
+				/// The time spent compressing it.
+				/// </param>
+				/// <param name="firstSliceNanoseconds">
+				/// The time spent preparing the first write, headers and first slice included,
+				/// which is how long compressing held up the first byte.
+				/// </param>
+				void RecordRecompressed(const uint64_t inputBytes, const uint64_t outputBytes, const uint64_t nanoseconds, const uint64_t firstSliceNanoseconds)
+				{
+					m_recompressedCount.fetch_add(1, std::memory_order_relaxed);
+					m_inputBytes.fetch_add(inputBytes, std::memory_order_relaxed);
+					m_outputBytes.fetch_add(outputBytes, std::memory_order_relaxed);
+					m_nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+					m_firstSliceNanoseconds.fetch_add(firstSliceNanoseconds, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of decompressed responses sent uncompressed.
+				/// </summary>
+				/// <returns>
+				/// The number of decompressed responses sent uncompressed.
+				/// </returns>
+				const uint64_t GetIdentityCount() const
+				{
+					return m_identityCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of decompressed responses compressed again.
+				/// </summary>
+				/// <returns>
+				/// The number of decompressed responses compressed again.
+				/// </returns>
+				const uint64_t GetRecompressedCount() const
+				{
+					return m_recompressedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the total size of the payloads compressed again, before compression.
+				/// </summary>
+				/// <returns>
+				/// The total size of the payloads before compression.
+				/// </returns>
+				const uint64_t GetInputBytes() const
+				{
+					return m_inputBytes.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the total size of the payloads compressed again, after compression.
+				/// </summary>
+				/// <returns>
+				/// The total size of the payloads after compression.
+				/// </returns>
+				const uint64_t GetOutputBytes() const
+				{
+					return m_outputBytes.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the total time spent compressing.
+				/// </summary>
+				/// <returns>
+				/// The total time spent compressing, in nanoseconds.
+				/// </returns>
+				const uint64_t GetNanoseconds() const
+				{
+					return m_nanoseconds.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the total time spent preparing first writes.
+				/// </summary>
+				/// <returns>
+				/// The total time spent preparing first writes, in nanoseconds.
+				/// </returns>
+				const uint64_t GetFirstSliceNanoseconds() const
+				{
+					return m_firstSliceNanoseconds.load(std::memory_order_relaxed);
+				}
+
+			private:
+
+				std::atomic<uint32_t> m_mode{ static_cast<uint32_t>(Mode::Identity) };
+
+				std::atomic<int32_t> m_level{ DefaultLevel };
+
+				std::atomic<uint64_t> m_identityCount{ 0 };
+
+				std::atomic<uint64_t> m_recompressedCount{ 0 };
+
+				std::atomic<uint64_t> m_inputBytes{ 0 };
+
+				std::atomic<uint64_t> m_outputBytes{ 0 };
+
+				std::atomic<uint64_t> m_nanoseconds{ 0 };
+
+				std::atomic<uint64_t> m_firstSliceNanoseconds{ 0 };
+			};
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,496 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../util/cb/EngineCallbackTypes.h"
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// The VerdictCache class remembers message begin verdicts that the consumer has said
+			/// may be reused, so that later requests they apply to can be decided without calling
+			/// out at all. Most such verdicts depend on nothing more than the host, or the host and
+			/// the path, and calling out for every request to the same CDN asset is pure overhead.
+			///
+			/// A verdict is only ever cached when the consumer asks for it, by encoding a scope and
+			/// a lifetime into the nextAction it answers with. See HttpVerdictCacheScope. A verdict
+			/// cached for a host applies to every request to that host. A verdict cached for a path
+			/// prefix applies to every request to that host whose path begins with the directory
+			/// of the path it was reached for, meaning everything up to and including the last
+			/// '/'. A verdict cached for a URL applies only to requests for exactly that path and
+			/// query. Lookups try the URL first, then each directory of the path from the deepest
+			/// up, then the host.
+			///
+			/// Entries are spread across a number of independently locked shards so that bridges
+			/// on different threads rarely contend. When a shard is full, expired entries are swept
+			/// out of it, and if that doesn't make room, an arbitrary entry is evicted. All members
+			/// are thread safe.
+			/// </summary>
+			class VerdictCache
+			{
+
+			public:
+
+				/// <summary>
+				/// The default maximum number of cached verdicts.
+				/// </summary>
+				static constexpr uint32_t DefaultMaxEntries = 16384;
+
+				/// <summary>
+				/// The number of independently locked shards.
+				/// </summary>
+				static constexpr size_t ShardCount = 16;
+
+				/// <summary>
+				/// Constructs a new VerdictCache instance with the default capacity.
+				/// </summary>
+				VerdictCache()
+				{
+
+				}
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				VerdictCache(const VerdictCache&) = delete;
+				VerdictCache(VerdictCache&&) = delete;
+				VerdictCache& operator=(const VerdictCache&) = delete;
+
+				/// <summary>
+				/// Sets the maximum number of cached verdicts. Zero disables the cache, and
+				/// anything already cached is flushed.
+				/// </summary>
+				/// <param name="maxEntries">
+				/// The maximum number of cached verdicts.
+				/// </param>
+				void SetMaxEntries(const uint32_t maxEntries)
+				{
+					m_maxEntries.store(maxEntries, std::memory_order_relaxed);
+
+					if (maxEntries == 0)
+					{
+						Flush();
+					}
+				}
+
+				/// <summary>
+				/// Gets the maximum number of cached verdicts.
+				/// </summary>
+				/// <returns>
+				/// The maximum number of cached verdicts, or zero if the cache is disabled.
+				/// </returns>
+				const uint32_t GetMaxEntries() const
+				{
+					return m_maxEntries.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Looks for a cached verdict that applies to the given request.
+				/// </summary>
+				/// <param name="host">
+				/// The host the request is for, as given in the Host header. Any port is ignored.
+				/// </param>
+				/// <param name="uri">
+				/// The request URI.
+				/// </param>
+				/// <param name="nextAction">
+				/// Set to the cached nextAction on a hit.
+				/// </param>
+				/// <param name="customResponse">
+				/// Set to the cached custom block response on a hit, if one was supplied along
+				/// with the verdict.
+				/// </param>
+				/// <param name="record">
+				/// Whether to count the hit or miss. A lookup that isn't counted, but whose verdict
+				/// ends up being used, should be counted with ::RecordHit().
+				/// </param>
+				/// <returns>
+				/// True if a verdict was found, false otherwise.
+				/// </returns>
+				const bool Lookup(const std::string& host, const std::string& uri, uint32_t& nextAction, std::shared_ptr<const std::vector<char>>& customResponse, const bool record = true)
+				{
+					if (m_maxEntries.load(std::memory_order_relaxed) == 0 || m_entryCount.load(std::memory_order_relaxed) == 0)
+					{
+						return false;
+					}
+
+					const auto now = std::chrono::steady_clock::now();
+
+					std::string key;
+					key.reserve(host.size() + uri.size() + 1);
+
+					MakeKey(key, HttpVerdictCacheScopeUrl, host, uri);
+					if (Find(key, now, nextAction, customResponse, record))
+					{
+						return true;
+					}
+
+					// Every directory of the path, deepest first.
+					const size_t pathEnd = uri.find_first_of(u8"?#");
+					const std::string path = uri.substr(0, pathEnd);
+
+					size_t slash = path.rfind('/');
+					while (slash != std::string::npos)
+					{
+						MakeKey(key, HttpVerdictCacheScopeHostPathPrefix, host, path.substr(0, slash + 1));
+						if (Find(key, now, nextAction, customResponse, record))
+						{
+							return true;
+						}
+
+						if (slash == 0)
+						{
+							break;
+						}
+
+						slash = path.rfind('/', slash - 1);
+					}
+
+					MakeKey(key, HttpVerdictCacheScopeHost, host, std::string());
+					if (Find(key, now, nextAction, customResponse, record))
+					{
+						return true;
+					}
+
+					if (record)
+					{
+						m_missCount.fetch_add(1, std::memory_order_relaxed);
+					}
+
+					return false;
+				}
+
+				/// <summary>
+				/// Counts a hit for a verdict that was looked up without being counted.
+				/// </summary>
+				void RecordHit()
+				{
+					m_hitCount.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Caches a verdict.
+				/// </summary>
+				/// <param name="host">
+				/// The host the request was for.
+				/// </param>
+				/// <param name="uri">
+				/// The request URI.
+				/// </param>
+				/// <param name="scope">
+				/// Which requests the verdict applies to. See HttpVerdictCacheScope.
+				/// </param>
+				/// <param name="ttlSeconds">
+				/// How long the verdict may be reused for.
+				/// </param>
+				/// <param name="nextAction">
+				/// The verdict, with the cache scope and lifetime stripped.
+				/// </param>
+				/// <param name="customResponse">
+				/// The custom block response supplied with the verdict. May be nullptr. It's
+				/// shared, not copied.
+				/// </param>
+				void Store(const std::string& host, const std::string& uri, const uint32_t scope, const uint32_t ttlSeconds, const uint32_t nextAction, const std::shared_ptr<const std::vector<char>>& customResponse)
+				{
+					const uint32_t maxEntries = m_maxEntries.load(std::memory_order_relaxed);
+
+					if (maxEntries == 0 || ttlSeconds == 0 || scope == HttpVerdictCacheScopeNone || scope > HttpVerdictCacheScopeUrl)
+					{
+						return;
+					}
+
+					std::string key;
+
+					switch (scope)
+					{
+						case HttpVerdictCacheScopeHost:
+						{
+							MakeKey(key, scope, host, std::string());
+						}
+						break;
+
+						case HttpVerdictCacheScopeHostPathPrefix:
+						{
+							const std::string path = uri.substr(0, uri.find_first_of(u8"?#"));
+							const size_t slash = path.rfind('/');
+							MakeKey(key, scope, host, slash == std::string::npos ? std::string(u8"/") : path.substr(0, slash + 1));
+						}
+						break;
+
+						case HttpVerdictCacheScopeUrl:
+						{
+							MakeKey(key, scope, host, uri);
+						}
+						break;
+					}
+
+					Entry entry;
+					entry.nextAction = nextAction;
+					entry.expiry = std::chrono::steady_clock::now() + std::chrono::seconds(ttlSeconds);
+
+					if (customResponse && customResponse->size() > 0)
+					{
+						entry.customResponse = customResponse;
+					}
+
+					const size_t maxShardEntries = maxEntries < ShardCount ? 1 : maxEntries / ShardCount;
+
+					auto& shard = GetShard(key);
+
+					std::lock_guard<std::mutex> lock(shard.mutex);
+
+					auto existing = shard.entries.find(key);
+
+					if (existing != shard.entries.end())
+					{
+						existing->second = std::move(entry);
+						m_insertCount.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+
+					if (shard.entries.size() >= maxShardEntries)
+					{
+						MakeRoom(shard, maxShardEntries);
+					}
+
+					shard.entries.emplace(std::move(key), std::move(entry));
+
+					m_entryCount.fetch_add(1, std::memory_order_relaxed);
+					m_insertCount.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Discards every cached verdict. Meant to be called whenever the rules the
+				/// consumer reaches its verdicts with have changed.
+				/// </summary>
+				void Flush()
+				{
+					for (auto& shard : m_shards)
+					{
+						std::lock_guard<std::mutex> lock(shard.mutex);
+						m_entryCount.fetch_sub(static_cast<uint32_t>(shard.entries.size()), std::memory_order_relaxed);
+						shard.entries.clear();
+					}
+
+					m_flushCount.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of verdicts presently cached, including any that have expired
+				/// but haven't been swept out yet.
+				/// </summary>
+				/// <returns>
+				/// The number of verdicts presently cached.
+				/// </returns>
+				const uint32_t GetEntryCount() const
+				{
+					return m_entryCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of requests decided from the cache.
+				/// </summary>
+				/// <returns>
+				/// The number of cache hits.
+				/// </returns>
+				const uint64_t GetHitCount() const
+				{
+					return m_hitCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of requests that had to be handed to the consumer because no
+				/// cached verdict applied. Requests checked while the cache was empty or disabled
+				/// aren't counted.
+				/// </summary>
+				/// <returns>
+				/// The number of cache misses.
+				/// </returns>
+				const uint64_t GetMissCount() const
+				{
+					return m_missCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of verdicts that have been cached.
+				/// </summary>
+				/// <returns>
+				/// The number of verdicts that have been cached.
+				/// </returns>
+				const uint64_t GetInsertCount() const
+				{
+					return m_insertCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of unexpired verdicts evicted to make room.
+				/// </summary>
+				/// <returns>
+				/// The number of unexpired verdicts evicted.
+				/// </returns>
+				const uint64_t GetEvictionCount() const
+				{
+					return m_evictionCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of times the cache has been flushed.
+				/// </summary>
+				/// <returns>
+				/// The number of times the cache has been flushed.
+				/// </returns>
+				const uint64_t GetFlushCount() const
+				{
+					return m_flushCount.load(std::memory_order_relaxed);
+				}
+
+			private:
+
+				struct Entry
+				{
+					uint32_t nextAction = 0;
+					std::chrono::steady_clock::time_point expiry;
+					std::shared_ptr<const std::vector<char>> customResponse;
+				};
+
+				struct Shard
+				{
+					std::mutex mutex;
+					std::unordered_map<std::string, Entry> entries;
+				};
+
+				/// <summary>
+				/// Builds the key for the given scope into the supplied string. The host is
+				/// lower cased and stripped of any port, since it comes straight from the Host
+				/// header.
+				/// </summary>
+				static void MakeKey(std::string& key, const uint32_t scope, const std::string& host, const std::string& path)
+				{
+					key.clear();
+					key.push_back(static_cast<char>('0' + scope));
+
+					bool inBrackets = false;
+
+					for (const char c : host)
+					{
+						// Don't mistake the colons of an IPv6 literal for the port separator.
+						if (c == '[' || c == ']')
+						{
+							inBrackets = (c == '[');
+						}
+						else if (c == ':' && !inBrackets)
+						{
+							break;
+						}
+
+						key.push_back((c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c);
+					}
+
+					key.append(path);
+				}
+
+				Shard& GetShard(const std::string& key)
+				{
+					return m_shards[std::hash<std::string>()(key) % ShardCount];
+				}
+
+				const bool Find(const std::string& key, const std::chrono::steady_clock::time_point& now, uint32_t& nextAction, std::shared_ptr<const std::vector<char>>& customResponse, const bool record)
+				{
+					auto& shard = GetShard(key);
+
+					std::lock_guard<std::mutex> lock(shard.mutex);
+
+					auto it = shard.entries.find(key);
+
+					if (it == shard.entries.end())
+					{
+						return false;
+					}
+
+					if (it->second.expiry <= now)
+					{
+						shard.entries.erase(it);
+						m_entryCount.fetch_sub(1, std::memory_order_relaxed);
+						return false;
+					}
+
+					nextAction = it->second.nextAction;
+					customResponse = it->second.customResponse;
+
+					if (record)
+					{
+						m_hitCount.fetch_add(1, std::memory_order_relaxed);
+					}
+
+					return true;
+				}
+
+				/// <summary>
+				/// Makes room for one more entry in a full shard. Must be called with the shard
+				/// locked.
+				/// </summary>
+				void MakeRoom(Shard& shard, const size_t maxShardEntries)
+				{
+					const auto now = std::chrono::steady_clock::now();
+
+					for (auto it = shard.entries.begin(); it != shard.entries.end();)
+					{
+						if (it->second.expiry <= now)
+						{
+							it = shard.entries.erase(it);
+							m_entryCount.fetch_sub(1, std::memory_order_relaxed);
+						}
+						else
+						{
+							++it;
+						}
+					}
+
+					while (shard.entries.size() >= maxShardEntries && shard.entries.size() > 0)
+					{
+						shard.entries.erase(shard.entries.begin());
+						m_entryCount.fetch_sub(1, std::memory_order_relaxed);
+						m_evictionCount.fetch_add(1, std::memory_order_relaxed);
+					}
+				}
+
+				std::atomic<uint32_t> m_maxEntries{ DefaultMaxEntries };
+
+				std::array<Shard, ShardCount> m_shards;
+
+				std::atomic<uint32_t> m_entryCount{ 0 };
+
+				std::atomic<uint64_t> m_hitCount{ 0 };
+
+				std::atomic<uint64_t> m_missCount{ 0 };
+
+				std::atomic<uint64_t> m_insertCount{ 0 };
+
+				std::atomic<uint64_t> m_evictionCount{ 0 };
+
+				std::atomic<uint64_t> m_flushCount{ 0 };
+			};
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,971 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "../util/cb/EngineCallbackTypes.h"
+#include "../filtering/FilterSnapshot.hpp"
+#include "VerdictCache.hpp"
+#include "ContentVerdictCache.hpp"
+#include "RecompressionControl.hpp"
+#include "../mitm/http/ResponseCache.hpp"
+#include "../mitm/http/BlockResponses.hpp"
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// The VerdictControl class holds the asynchronous form of the message callbacks, and
+			/// keeps track of every bridge that has been parked waiting on one of them.
+			///
+			/// A consumer that takes a long time over a verdict can hand back "pending" instead of
+			/// holding the io_service thread. The bridge then registers itself here under a token
+			/// and stops issuing operations. When the consumer calls ::Complete(...) with that
+			/// token, or the bridge's verdict timer expires, the bridge withdraws its registration
+			/// and resumes on its own strand. Whichever withdraws it first wins.
+			///
+			/// It is also where the bridges find everything else that goes into a verdict, or
+			/// follows from one: the filtering::FilterSnapshot of bypass list, hostname blocklist,
+			/// native rules and verdict timeout, the VerdictCache, the response cache, the block
+			/// pages, the recompression settings and whether pipelined requests may be coalesced.
+			/// The snapshot is replaced as a whole when any part of it changes, and reading it
+			/// doesn't take a lock unless a new one has been published since the thread last looked.
+			///
+			/// Callbacks are only to be changed while the Engine is stopped. Parking, completing
+			/// and withdrawing are thread safe, as is the cache. Snapshots may be published at any
+			/// time.
+			/// </summary>
+			class VerdictControl
+			{
+
+			public:
+
+				/// <summary>
+				/// Called to resume a parked bridge with the verdict the consumer supplied. Must do
+				/// nothing more than post the work to the bridge's strand, since it's invoked on
+				/// whatever thread the consumer completed the verdict from.
+				/// </summary>
+				using ResumeFunction = std::function<void(const uint32_t verdict, const uint32_t responseSampleBytes, std::vector<char> customResponse)>;
+
+				/// <summary>
+				/// The default number of milliseconds a bridge waits on a pending verdict before
+				/// applying the default verdict.
+				/// </summary>
+				static constexpr uint32_t DefaultTimeoutMilliseconds = filtering::FilterSnapshot::DefaultVerdictTimeoutMilliseconds;
+
+				/// <summary>
+				/// Constructs a new VerdictControl instance with no asynchronous callbacks, and an
+				/// empty snapshot published.
+				/// </summary>
+				VerdictControl()
+				{
+					Publish(std::make_shared<filtering::FilterSnapshot>());
+				}
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				VerdictControl(const VerdictControl&) = delete;
+				VerdictControl(VerdictControl&&) = delete;
+				VerdictControl& operator=(const VerdictControl&) = delete;
+
+				/// <summary>
+				/// Sets the asynchronous message callbacks, and what to do when they take too long.
+				/// Either callback may be empty, in which case the synchronous form is used for
+				/// that stage of the transaction.
+				/// </summary>
+				/// <param name="onMessageBegin">
+				/// The asynchronous form of the message begin callback.
+				/// </param>
+				/// <param name="onMessageEnd">
+				/// The asynchronous form of the message end callback.
+				/// </param>
+				/// <param name="timeoutMilliseconds">
+				/// How long a bridge waits on a pending verdict. Values below one are raised to one.
+				/// </param>
+				/// <param name="defaultBeginAction">
+				/// The nextAction applied when a pending message begin verdict times out.
+				/// </param>
+				/// <param name="defaultEndShouldBlock">
+				/// Whether or not a transaction is blocked when a pending message end verdict
+				/// times out.
+				/// </param>
+				void Configure(
+					util::cb::HttpMessageBeginAsyncFunction onMessageBegin,
+					util::cb::HttpMessageEndAsyncFunction onMessageEnd,
+					const uint32_t timeoutMilliseconds,
+					const uint32_t defaultBeginAction,
+					const bool defaultEndShouldBlock
+					)
+				{
+					m_onMessageBegin = onMessageBegin;
+					m_onMessageEnd = onMessageEnd;
+
+					Modify([timeoutMilliseconds, defaultBeginAction, defaultEndShouldBlock](filtering::FilterSnapshot& snapshot)
+					{
+						snapshot.verdictTimeoutMilliseconds = timeoutMilliseconds;
+						snapshot.defaultBeginAction = defaultBeginAction;
+						snapshot.defaultEndShouldBlock = defaultEndShouldBlock;
+					});
+				}
+
+				/// <summary>
+				/// Gets the asynchronous form of the message begin callback.
+				/// </summary>
+				/// <returns>
+				/// The asynchronous form of the message begin callback, which may be empty.
+				/// </returns>
+				const util::cb::HttpMessageBeginAsyncFunction& GetOnMessageBegin() const
+				{
+					return m_onMessageBegin;
+				}
+
+				/// <summary>
+				/// Gets the asynchronous form of the message end callback.
+				/// </summary>
+				/// <returns>
+				/// The asynchronous form of the message end callback, which may be empty.
+				/// </returns>
+				const util::cb::HttpMessageEndAsyncFunction& GetOnMessageEnd() const
+				{
+					return m_onMessageEnd;
+				}
+
+				/// <summary>
+				/// Gets how long a bridge waits on a pending verdict.
+				/// </summary>
+				/// <returns>
+				/// How long a bridge waits on a pending verdict, in milliseconds.
+				/// </returns>
+				const uint32_t GetTimeoutMilliseconds() const
+				{
+					return GetSnapshot()->verdictTimeoutMilliseconds;
+				}
+
+				/// <summary>
+				/// Gets the verdict applied when a pending verdict times out.
+				/// </summary>
+				/// <param name="messageEnd">
+				/// True for a message end verdict, false for a message begin verdict.
+				/// </param>
+				/// <returns>
+				/// For a message begin verdict, the nextAction to apply. For a message end
+				/// verdict, one if the transaction is to be blocked, zero otherwise.
+				/// </returns>
+				const uint32_t GetDefaultVerdict(const bool messageEnd) const
+				{
+					auto snapshot = GetSnapshot();
+					return messageEnd ? (snapshot->defaultEndShouldBlock ? 1 : 0) : snapshot->defaultBeginAction;
+				}
+
+				/// <summary>
+				/// Gets the current snapshot. This is what bridges call, and it doesn't take a lock
+				/// unless a new snapshot has been published since the calling thread last called
+				/// it. The calling thread keeps a reference to the snapshot until its next call, so
+				/// threads that only call this once in a long while should use
+				/// ::GetPublishedSnapshot() instead.
+				/// </summary>
+				/// <returns>
+				/// The current snapshot. Never nullptr.
+				/// </returns>
+				std::shared_ptr<const filtering::FilterSnapshot> GetSnapshot() const
+				{
+					struct CachedSnapshot
+					{
+						uint64_t generation = 0;
+						std::shared_ptr<const filtering::FilterSnapshot> snapshot;
+					};
+
+					// Shared by every VerdictControl, which is fine, since generations are unique
+					// across all of them. A thread alternating between two Engines just takes the
+					// lock every time.
+					static thread_local CachedSnapshot cached;
+
+					if (cached.generation != m_generation.load(std::memory_order_acquire))
+					{
+						std::lock_guard<std::mutex> lock(m_snapshotMutex);
+						cached.snapshot = m_snapshot;
+						cached.generation = m_snapshot->generation;
+					}
+
+					return cached.snapshot;
+				}
+
+				/// <summary>
+				/// Gets the current snapshot without remembering it on the calling thread. Always
+				/// takes the lock.
+				/// </summary>
+				/// <returns>
+				/// The current snapshot. Never nullptr.
+				/// </returns>
+				std::shared_ptr<const filtering::FilterSnapshot> GetPublishedSnapshot() const
+				{
+					std::lock_guard<std::mutex> lock(m_snapshotMutex);
+					return m_snapshot;
+				}
+
+				/// <summary>
+				/// Publishes a new snapshot in place of the current one, whatever it contains.
+				/// </summary>
+				/// <param name="snapshot">
+				/// The new snapshot. Its generation is assigned here. Must not be modified after
+				/// this call.
+				/// </param>
+				/// <returns>
+				/// The generation assigned to the snapshot.
+				/// </returns>
+				const uint64_t Publish(std::shared_ptr<filtering::FilterSnapshot> snapshot)
+				{
+					std::lock_guard<std::mutex> lock(m_snapshotMutex);
+					return PublishLocked(std::move(snapshot));
+				}
+
+				/// <summary>
+				/// Publishes a copy of the current snapshot, with whatever changes the supplied
+				/// function makes to it. Concurrent modifications are applied one after the other,
+				/// so none of them is lost.
+				/// </summary>
+				/// <param name="modify">
+				/// Called with the copy, while the lock is held. Must not call back into this
+				/// object.
+				/// </param>
+				/// <returns>
+				/// The generation assigned to the new snapshot.
+				/// </returns>
+				template<typename ModifyFunction>
+				const uint64_t Modify(ModifyFunction&& modify)
+				{
+					std::lock_guard<std::mutex> lock(m_snapshotMutex);
+
+					auto snapshot = std::make_shared<filtering::FilterSnapshot>(*m_snapshot);
+					modify(*snapshot);
+
+					return PublishLocked(std::move(snapshot));
+				}
+
+				/// <summary>
+				/// Gets the generation of the current snapshot.
+				/// </summary>
+				/// <returns>
+				/// The generation of the current snapshot.
+				/// </returns>
+				const uint64_t GetGeneration() const
+				{
+					return m_generation.load(std::memory_order_acquire);
+				}
+
+				/// <summary>
+				/// Gets the number of snapshots that have been published, including the empty one
+				/// published on construction.
+				/// </summary>
+				/// <returns>
+				/// The number of snapshots published.
+				/// </returns>
+				const uint64_t GetPublishedCount() const
+				{
+					return m_publishedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Replaces the bypass list, keeping the rest of the current snapshot.
+				/// </summary>
+				/// <param name="bypassHosts">
+				/// The compiled bypass list, or nullptr to filter every host.
+				/// </param>
+				void SetBypassHosts(std::shared_ptr<const filtering::DomainTrie> bypassHosts)
+				{
+					Modify([&bypassHosts](filtering::FilterSnapshot& snapshot)
+					{
+						snapshot.bypassHosts = std::move(bypassHosts);
+					});
+				}
+
+				/// <summary>
+				/// Replaces the list of hosts whose requests keep the client's Accept-Encoding,
+				/// keeping the rest of the current snapshot.
+				/// </summary>
+				/// <param name="preservedEncodingHosts">
+				/// The compiled list, or nullptr to narrow Accept-Encoding for every host.
+				/// </param>
+				void SetPreservedEncodingHosts(std::shared_ptr<const filtering::DomainTrie> preservedEncodingHosts)
+				{
+					Modify([&preservedEncodingHosts](filtering::FilterSnapshot& snapshot)
+					{
+						snapshot.preservedEncodingHosts = std::move(preservedEncodingHosts);
+					});
+				}
+
+				/// <summary>
+				/// Records that a connection or request was passed through because its host is on
+				/// the bypass list.
+				/// </summary>
+				void RecordBypassed()
+				{
+					m_bypassedCount.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of connections and requests passed through because their host
+				/// is on the bypass list.
+				/// </summary>
+				/// <returns>
+				/// The number of connections and requests passed through.
+				/// </returns>
+				const uint64_t GetBypassedCount() const
+				{
+					return m_bypassedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Sets whether requests a client has pipelined may be written to the server along
+				/// with the request before them, rather than each waiting for the response before
+				/// it to be written to the client. Only requests that no callback would be asked
+				/// about are ever sent ahead like this. See mitm::secure::TlsCapableHttpBridge.
+				/// Disabled by default.
+				/// </summary>
+				/// <param name="enabled">
+				/// Whether pipelined requests may be coalesced.
+				/// </param>
+				void SetPipelineCoalescing(const bool enabled)
+				{
+					m_pipelineCoalescing.store(enabled, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets whether requests a client has pipelined may be written to the server along
+				/// with the request before them.
+				/// </summary>
+				/// <returns>
+				/// True if pipelined requests may be coalesced, false otherwise.
+				/// </returns>
+				const bool GetPipelineCoalescing() const
+				{
+					return m_pipelineCoalescing.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Records that a request was taken from what the client sent along with the
+				/// request before it, rather than read from the client on its own.
+				/// </summary>
+				void RecordPipelined()
+				{
+					m_pipelinedCount.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of requests taken from what the client sent along with the
+				/// request before them.
+				/// </summary>
+				/// <returns>
+				/// The number of pipelined requests.
+				/// </returns>
+				const uint64_t GetPipelinedCount() const
+				{
+					return m_pipelinedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Records that a pipelined request was written to the server along with the
+				/// request before it.
+				/// </summary>
+				void RecordCoalesced()
+				{
+					m_coalescedCount.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of pipelined requests written to the server along with the
+				/// request before them.
+				/// </summary>
+				/// <returns>
+				/// The number of coalesced requests.
+				/// </returns>
+				const uint64_t GetCoalescedCount() const
+				{
+					return m_coalescedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the cache of reusable message begin verdicts.
+				/// </summary>
+				/// <returns>
+				/// The verdict cache.
+				/// </returns>
+				VerdictCache& GetCache()
+				{
+					return m_cache;
+				}
+
+				/// <summary>
+				/// Gets the cache of reusable message begin verdicts.
+				/// </summary>
+				/// <returns>
+				/// The verdict cache.
+				/// </returns>
+				const VerdictCache& GetCache() const
+				{
+					return m_cache;
+				}
+
+				/// <summary>
+				/// Gets the cache of message end verdicts, keyed by response body content.
+				/// </summary>
+				/// <returns>
+				/// The content verdict cache.
+				/// </returns>
+				ContentVerdictCache& GetContentCache()
+				{
+					return m_contentCache;
+				}
+
+				/// <summary>
+				/// Gets the cache of message end verdicts, keyed by response body content.
+				/// </summary>
+				/// <returns>
+				/// The content verdict cache.
+				/// </returns>
+				const ContentVerdictCache& GetContentCache() const
+				{
+					return m_contentCache;
+				}
+
+				/// <summary>
+				/// Gets the settings and counters for recompressing inspected responses.
+				/// </summary>
+				/// <returns>
+				/// The recompression settings.
+				/// </returns>
+				RecompressionControl& GetRecompression()
+				{
+					return m_recompression;
+				}
+
+				/// <summary>
+				/// Gets the settings and counters for recompressing inspected responses.
+				/// </summary>
+				/// <returns>
+				/// The recompression settings.
+				/// </returns>
+				const RecompressionControl& GetRecompression() const
+				{
+					return m_recompression;
+				}
+
+				/// <summary>
+				/// Gets the shared response cache.
+				/// </summary>
+				/// <returns>
+				/// The response cache.
+				/// </returns>
+				mitm::http::ResponseCache& GetResponseCache()
+				{
+					return m_responseCache;
+				}
+
+				/// <summary>
+				/// Gets the shared response cache.
+				/// </summary>
+				/// <returns>
+				/// The response cache.
+				/// </returns>
+				const mitm::http::ResponseCache& GetResponseCache() const
+				{
+					return m_responseCache;
+				}
+
+				/// <summary>
+				/// Gets the registered block pages.
+				/// </summary>
+				/// <returns>
+				/// The block responses.
+				/// </returns>
+				mitm::http::BlockResponses& GetBlockResponses()
+				{
+					return m_blockResponses;
+				}
+
+				/// <summary>
+				/// Gets the registered block pages.
+				/// </summary>
+				/// <returns>
+				/// The block responses.
+				/// </returns>
+				const mitm::http::BlockResponses& GetBlockResponses() const
+				{
+					return m_blockResponses;
+				}
+
+				/// <summary>
+				/// Replaces the native rules, keeping the rest of the current snapshot.
+				/// </summary>
+				/// <param name="rules">
+				/// The compiled rules, or nullptr to stop matching natively.
+				/// </param>
+				void SetRules(std::shared_ptr<const filtering::RuleMatcher> rules)
+				{
+					Modify([&rules](filtering::FilterSnapshot& snapshot)
+					{
+						snapshot.rules = std::move(rules);
+					});
+				}
+
+				/// <summary>
+				/// Gets the native rules.
+				/// </summary>
+				/// <returns>
+				/// The compiled rules, or nullptr if none are loaded.
+				/// </returns>
+				std::shared_ptr<const filtering::RuleMatcher> GetRules() const
+				{
+					return GetPublishedSnapshot()->rules;
+				}
+
+				/// <summary>
+				/// Records the outcome of matching a request against the native rules.
+				/// </summary>
+				/// <param name="verdict">
+				/// The outcome.
+				/// </param>
+				void RecordRuleVerdict(const filtering::RuleMatcher::Verdict verdict)
+				{
+					m_ruleCheckedCount.fetch_add(1, std::memory_order_relaxed);
+
+					switch (verdict)
+					{
+						case filtering::RuleMatcher::Verdict::Block:
+						{
+							m_ruleBlockedCount.fetch_add(1, std::memory_order_relaxed);
+						}
+						break;
+
+						case filtering::RuleMatcher::Verdict::Exception:
+						{
+							m_ruleExceptedCount.fetch_add(1, std::memory_order_relaxed);
+						}
+						break;
+
+						default:
+						break;
+					}
+				}
+
+				/// <summary>
+				/// Gets the number of requests matched against the native rules.
+				/// </summary>
+				/// <returns>
+				/// The number of requests matched against the native rules.
+				/// </returns>
+				const uint64_t GetRuleCheckedCount() const
+				{
+					return m_ruleCheckedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of requests blocked by the native rules.
+				/// </summary>
+				/// <returns>
+				/// The number of requests blocked by the native rules.
+				/// </returns>
+				const uint64_t GetRuleBlockedCount() const
+				{
+					return m_ruleBlockedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of requests that matched a native blocking rule, but were let
+				/// through by an exception rule.
+				/// </summary>
+				/// <returns>
+				/// The number of requests let through by an exception rule.
+				/// </returns>
+				const uint64_t GetRuleExceptedCount() const
+				{
+					return m_ruleExceptedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Replaces the hostname blocklist, keeping the rest of the current snapshot.
+				/// </summary>
+				/// <param name="blocklist">
+				/// The mapped blocklist, or nullptr to stop checking hosts.
+				/// </param>
+				void SetBlocklist(std::shared_ptr<const filtering::HostnameSet> blocklist)
+				{
+					Modify([&blocklist](filtering::FilterSnapshot& snapshot)
+					{
+						snapshot.blocklist = std::move(blocklist);
+					});
+				}
+
+				/// <summary>
+				/// Gets the hostname blocklist.
+				/// </summary>
+				/// <returns>
+				/// The mapped blocklist, or nullptr if none is loaded.
+				/// </returns>
+				std::shared_ptr<const filtering::HostnameSet> GetBlocklist() const
+				{
+					return GetPublishedSnapshot()->blocklist;
+				}
+
+				/// <summary>
+				/// Sets the response inspection policy. Bridges consult it for responses that
+				/// begin after the change.
+				/// </summary>
+				/// <param name="policy">
+				/// The compiled policy, or nullptr to buffer every inspected response in full.
+				/// </param>
+				void SetInspectionPolicy(std::shared_ptr<const filtering::InspectionPolicy> policy)
+				{
+					Modify([&policy](filtering::FilterSnapshot& snapshot)
+					{
+						snapshot.inspectionPolicy = std::move(policy);
+					});
+				}
+
+				/// <summary>
+				/// Gets the response inspection policy.
+				/// </summary>
+				/// <returns>
+				/// The compiled policy, or nullptr if none is set.
+				/// </returns>
+				std::shared_ptr<const filtering::InspectionPolicy> GetInspectionPolicy() const
+				{
+					return GetPublishedSnapshot()->inspectionPolicy;
+				}
+
+				/// <summary>
+				/// Records the outcome of checking a host against the blocklist.
+				/// </summary>
+				/// <param name="blocked">
+				/// Whether the host was on the blocklist.
+				/// </param>
+				void RecordBlocklistCheck(const bool blocked)
+				{
+					m_blocklistCheckedCount.fetch_add(1, std::memory_order_relaxed);
+
+					if (blocked)
+					{
+						m_blocklistBlockedCount.fetch_add(1, std::memory_order_relaxed);
+					}
+				}
+
+				/// <summary>
+				/// Gets the number of hosts checked against the blocklist.
+				/// </summary>
+				/// <returns>
+				/// The number of hosts checked against the blocklist.
+				/// </returns>
+				const uint64_t GetBlocklistCheckedCount() const
+				{
+					return m_blocklistCheckedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of hosts found on the blocklist.
+				/// </summary>
+				/// <returns>
+				/// The number of hosts found on the blocklist.
+				/// </returns>
+				const uint64_t GetBlocklistBlockedCount() const
+				{
+					return m_blocklistBlockedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Registers a bridge that's about to wait on a verdict.
+				/// </summary>
+				/// <param name="resume">
+				/// The function to call when the verdict is supplied through ::Complete(...).
+				/// </param>
+				/// <returns>
+				/// The token the consumer must supply to complete the verdict. Never zero.
+				/// </returns>
+				const uint64_t Park(ResumeFunction resume)
+				{
+					const uint64_t token = m_nextToken.fetch_add(1, std::memory_order_relaxed);
+
+					{
+						std::lock_guard<std::mutex> lock(m_pendingMutex);
+						m_pending.emplace(token, std::move(resume));
+					}
+
+					m_parkedCount.fetch_add(1, std::memory_order_relaxed);
+
+					return token;
+				}
+
+				/// <summary>
+				/// Supplies the verdict for a parked bridge and resumes it.
+				/// </summary>
+				/// <param name="token">
+				/// The token the bridge was parked under.
+				/// </param>
+				/// <param name="verdict">
+				/// For a message begin verdict, the nextAction. For a message end verdict, non-zero
+				/// to block the transaction.
+				/// </param>
+				/// <param name="responseSampleBytes">
+				/// For a message begin verdict on a response, how many bytes of the payload to
+				/// inspect, or zero for all of it. Ignored otherwise.
+				/// </param>
+				/// <param name="customResponse">
+				/// Optional custom block response. May be nullptr.
+				/// </param>
+				/// <param name="customResponseLength">
+				/// The length of the custom block response.
+				/// </param>
+				/// <returns>
+				/// True if the bridge was waiting on this token and has been resumed. False if the
+				/// token is unknown, which happens when the verdict timed out, the bridge was
+				/// terminated, or the token was already completed.
+				/// </returns>
+				const bool Complete(const uint64_t token, const uint32_t verdict, const uint32_t responseSampleBytes, const char* customResponse, const uint32_t customResponseLength)
+				{
+					ResumeFunction resume;
+
+					{
+						std::lock_guard<std::mutex> lock(m_pendingMutex);
+
+						auto it = m_pending.find(token);
+
+						if (it == m_pending.end())
+						{
+							m_lateCompletionCount.fetch_add(1, std::memory_order_relaxed);
+							return false;
+						}
+
+						resume = std::move(it->second);
+						m_pending.erase(it);
+					}
+
+					std::vector<char> response;
+
+					if (customResponse != nullptr && customResponseLength > 0)
+					{
+						response.assign(customResponse, customResponse + customResponseLength);
+					}
+
+					m_completedCount.fetch_add(1, std::memory_order_relaxed);
+
+					// Invoked outside of the lock, because the function holds a reference to the
+					// bridge, and the bridge may come back to us when it's destroyed.
+					resume(verdict, responseSampleBytes, std::move(response));
+
+					return true;
+				}
+
+				/// <summary>
+				/// Withdraws the registration of a parked bridge without resuming it. Called by the
+				/// bridge itself when the consumer answered immediately, when its verdict timer
+				/// expires, or when it's terminated while waiting.
+				/// </summary>
+				/// <param name="token">
+				/// The token the bridge was parked under.
+				/// </param>
+				/// <returns>
+				/// True if the registration was withdrawn, false if the verdict has already been
+				/// completed.
+				/// </returns>
+				const bool Withdraw(const uint64_t token)
+				{
+					ResumeFunction resume;
+
+					{
+						std::lock_guard<std::mutex> lock(m_pendingMutex);
+
+						auto it = m_pending.find(token);
+
+						if (it == m_pending.end())
+						{
+							return false;
+						}
+
+						resume = std::move(it->second);
+						m_pending.erase(it);
+					}
+
+					return true;
+				}
+
+				/// <summary>
+				/// Drops every registration. Called once the Engine has been stopped, so that
+				/// parked bridges are released while the io_service that their sockets belong to
+				/// still exists.
+				/// </summary>
+				void WithdrawAll()
+				{
+					std::unordered_map<uint64_t, ResumeFunction> pending;
+
+					{
+						std::lock_guard<std::mutex> lock(m_pendingMutex);
+						pending.swap(m_pending);
+					}
+				}
+
+				/// <summary>
+				/// Records that a pending verdict timed out and the default verdict was applied.
+				/// </summary>
+				void RecordTimedOut()
+				{
+					m_timedOutCount.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of bridges presently waiting on a verdict.
+				/// </summary>
+				/// <returns>
+				/// The number of bridges presently waiting on a verdict.
+				/// </returns>
+				const uint32_t GetPendingCount() const
+				{
+					std::lock_guard<std::mutex> lock(m_pendingMutex);
+					return static_cast<uint32_t>(m_pending.size());
+				}
+
+				/// <summary>
+				/// Gets the total number of times a bridge has been parked.
+				/// </summary>
+				/// <returns>
+				/// The total number of times a bridge has been parked.
+				/// </returns>
+				const uint64_t GetParkedCount() const
+				{
+					return m_parkedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of pending verdicts completed by the consumer in time.
+				/// </summary>
+				/// <returns>
+				/// The number of pending verdicts completed in time.
+				/// </returns>
+				const uint64_t GetCompletedCount() const
+				{
+					return m_completedCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of pending verdicts that timed out.
+				/// </summary>
+				/// <returns>
+				/// The number of pending verdicts that timed out.
+				/// </returns>
+				const uint64_t GetTimedOutCount() const
+				{
+					return m_timedOutCount.load(std::memory_order_relaxed);
+				}
+
+				/// <summary>
+				/// Gets the number of completions that arrived for a token nobody was waiting on.
+				/// </summary>
+				/// <returns>
+				/// The number of late or unknown completions.
+				/// </returns>
+				const uint64_t GetLateCompletionCount() const
+				{
+					return m_lateCompletionCount.load(std::memory_order_relaxed);
+				}
+
+			private:
+
+				/// <summary>
+				/// Stamps and publishes a snapshot. m_snapshotMutex must be held.
+				/// </summary>
+				const uint64_t PublishLocked(std::shared_ptr<filtering::FilterSnapshot> snapshot)
+				{
+					// Process wide, so that the thread local cache in ::GetSnapshot() can never
+					// mistake one Engine's snapshot for another's.
+					static std::atomic<uint64_t> nextGeneration{ 1 };
+
+					snapshot->generation = nextGeneration.fetch_add(1, std::memory_order_relaxed);
+
+					if (snapshot->verdictTimeoutMilliseconds < 1)
+					{
+						snapshot->verdictTimeoutMilliseconds = 1;
+					}
+
+					const uint64_t generation = snapshot->generation;
+
+					// The previous snapshot is only freed here if no bridge, and no thread's cached
+					// copy, still refers to it. Otherwise whoever lets go of it last frees it.
+					m_snapshot = std::move(snapshot);
+					m_generation.store(generation, std::memory_order_release);
+					m_publishedCount.fetch_add(1, std::memory_order_relaxed);
+
+					return generation;
+				}
+
+				util::cb::HttpMessageBeginAsyncFunction m_onMessageBegin;
+
+				util::cb::HttpMessageEndAsyncFunction m_onMessageEnd;
+
+				mutable std::mutex m_snapshotMutex;
+
+				std::shared_ptr<const filtering::FilterSnapshot> m_snapshot;
+
+				std::atomic<uint64_t> m_generation{ 0 };
+
+				std::atomic<uint64_t> m_publishedCount{ 0 };
+
+				std::atomic<uint64_t> m_bypassedCount{ 0 };
+
+				std::atomic<bool> m_pipelineCoalescing{ false };
+
+				std::atomic<uint64_t> m_pipelinedCount{ 0 };
+
+				std::atomic<uint64_t> m_coalescedCount{ 0 };
+
+				std::atomic<uint64_t> m_nextToken{ 1 };
+
+				mutable std::mutex m_pendingMutex;
+
+				std::unordered_map<uint64_t, ResumeFunction> m_pending;
+
+				std::atomic<uint64_t> m_parkedCount{ 0 };
+
+				std::atomic<uint64_t> m_completedCount{ 0 };
+
+				std::atomic<uint64_t> m_timedOutCount{ 0 };
+
+				std::atomic<uint64_t> m_lateCompletionCount{ 0 };
+
+				VerdictCache m_cache;
+
+				ContentVerdictCache m_contentCache;
+
+				RecompressionControl m_recompression;
+
+				mitm::http::ResponseCache m_responseCache;
+
+				mitm::http::BlockResponses m_blockResponses;
+
+				std::atomic<uint64_t> m_ruleCheckedCount{ 0 };
+
+				std::atomic<uint64_t> m_ruleBlockedCount{ 0 };
+
+				std::atomic<uint64_t> m_ruleExceptedCount{ 0 };
+
+				std::atomic<uint64_t> m_blocklistCheckedCount{ 0 };
+
+				std::atomic<uint64_t> m_blocklistBlockedCount{ 0 };
+			};
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
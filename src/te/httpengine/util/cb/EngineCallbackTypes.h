@@ -50,6 +50,254 @@ typedef void(*HttpMessageEndCallback)(
 	bool* shouldBlock, const CustomResponseStreamWriter customBlockResponseStreamWriter
 	);
 
+/// <summary>
+/// Writes custom block response data for a single transaction. Unlike CustomResponseStreamWriter,
+/// which has to be a distinct function per transaction so that it knows where to write, this
+/// writer is the same function for every transaction, and is told where to write by the opaque
+/// writerContext argument. The writerContext supplied to the message callback must be passed back
+/// unmodified, and is only valid for the duration of that callback.
+/// </summary>
+typedef void(*CustomResponseStreamWriterV2)(void* writerContext, const char* data, const uint32_t dataLength);
+
+typedef void(*HttpMessageBeginCallbackV2)(
+	const char* requestHeaders, const uint32_t requestHeadersLength, const char* requestBody, const uint32_t requestBodyLength, 
+	const char* responseHeaders, const uint32_t responseHeadersLength, const char* responseBody, const uint32_t responseBodyLength,
+	uint32_t* nextAction, const CustomResponseStreamWriterV2 customBlockResponseStreamWriter, void* writerContext
+	);
+
+typedef void(*HttpMessageEndCallbackV2)(
+	const char* requestHeaders, const uint32_t requestHeadersLength, const char* requestBody, const uint32_t requestBodyLength, 
+	const char* responseHeaders, const uint32_t responseHeadersLength, const char* responseBody, const uint32_t responseBodyLength,
+	bool* shouldBlock, const CustomResponseStreamWriterV2 customBlockResponseStreamWriter, void* writerContext
+	);
+
+/// <summary>
+/// The message begin callbacks answer with a nextAction. The low byte is the action itself: 0 to
+/// allow without inspecting the payload, 1 to allow but inspect the payload once complete, 2 to
+/// block, or 3 to allow the rest of the transaction, response included, without any further
+/// checks.
+///
+/// When answering for a request, the consumer may also ask the Engine to reuse the answer for
+/// later requests, so that they're decided without calling out. Bits 8 and 9 hold one of these
+/// scopes, and bits 16 through 31 hold how many seconds the answer may be reused for. Build such a
+/// nextAction with HTTP_NEXT_ACTION_CACHED. A custom block response supplied along with the answer
+/// is reused as well. Answers given for a response are never reused.
+///
+/// Bits 10 through 15 are reserved, and must be zero. To inspect only the first bytes of a
+/// response, see the responseSampleBytes argument of HttpMessageBeginViewCallback.
+/// </summary>
+enum HttpVerdictCacheScope
+{
+	/// <summary>
+	/// The answer is not to be reused.
+	/// </summary>
+	HttpVerdictCacheScopeNone = 0,
+
+	/// <summary>
+	/// The answer applies to every request to the same host.
+	/// </summary>
+	HttpVerdictCacheScopeHost = 1,
+
+	/// <summary>
+	/// The answer applies to every request to the same host whose path begins with the
+	/// directory of this request's path, meaning everything up to and including its last '/'.
+	/// </summary>
+	HttpVerdictCacheScopeHostPathPrefix = 2,
+
+	/// <summary>
+	/// The answer applies only to requests for exactly the same host, path and query.
+	/// </summary>
+	HttpVerdictCacheScopeUrl = 3
+};
+
+#define HTTP_NEXT_ACTION_MASK 0xFFu
+#define HTTP_NEXT_ACTION_CACHED(action, scope, ttlSeconds) \
+	(((uint32_t)(action) & HTTP_NEXT_ACTION_MASK) | (((uint32_t)(scope) & 0x3u) << 8) | (((uint32_t)(ttlSeconds) & 0xFFFFu) << 16))
+
+/// <summary>
+/// Rather than writing a whole custom block response, a message callback may refer to a block
+/// page registered beforehand with fe_ctl_register_block_page, by writing a block page reference
+/// as the custom block response, and nothing else. A reference is HTTP_BLOCK_PAGE_REFERENCE_LENGTH
+/// bytes long: a zero byte, which no HTTP response starts with, followed by the page ID as four
+/// bytes, least significant first. Fill a buffer with one using HTTP_BLOCK_PAGE_REFERENCE. A
+/// reference to a page that isn't registered when the block is applied is answered with the
+/// usual 204. References are reused by the verdict caches like any other custom block response.
+/// </summary>
+#define HTTP_BLOCK_PAGE_REFERENCE_LENGTH 5u
+#define HTTP_BLOCK_PAGE_REFERENCE(buffer, pageId) \
+	((buffer)[0] = 0, \
+	(buffer)[1] = (char)((uint32_t)(pageId) & 0xFFu), \
+	(buffer)[2] = (char)(((uint32_t)(pageId) >> 8) & 0xFFu), \
+	(buffer)[3] = (char)(((uint32_t)(pageId) >> 16) & 0xFFu), \
+	(buffer)[4] = (char)(((uint32_t)(pageId) >> 24) & 0xFFu))
+
+/// <summary>
+/// Identifies headers that the Engine recognizes by name, so that consumers of HttpHeaderView can
+/// switch on an integer rather than doing case insensitive string comparisons. Any header not
+/// listed here is reported as HttpKnownHeaderUnknown. New values may be appended, but existing
+/// values will never change.
+/// </summary>
+enum HttpKnownHeader
+{
+	HttpKnownHeaderUnknown = 0,
+	HttpKnownHeaderHost = 1,
+	HttpKnownHeaderConnection = 2,
+	HttpKnownHeaderProxyConnection = 3,
+	HttpKnownHeaderKeepAlive = 4,
+	HttpKnownHeaderContentType = 5,
+	HttpKnownHeaderContentLength = 6,
+	HttpKnownHeaderContentEncoding = 7,
+	HttpKnownHeaderTransferEncoding = 8,
+	HttpKnownHeaderAccept = 9,
+	HttpKnownHeaderAcceptEncoding = 10,
+	HttpKnownHeaderAcceptLanguage = 11,
+	HttpKnownHeaderUserAgent = 12,
+	HttpKnownHeaderReferer = 13,
+	HttpKnownHeaderOrigin = 14,
+	HttpKnownHeaderCookie = 15,
+	HttpKnownHeaderSetCookie = 16,
+	HttpKnownHeaderLocation = 17,
+	HttpKnownHeaderCacheControl = 18,
+	HttpKnownHeaderPragma = 19,
+	HttpKnownHeaderExpires = 20,
+	HttpKnownHeaderLastModified = 21,
+	HttpKnownHeaderETag = 22,
+	HttpKnownHeaderIfModifiedSince = 23,
+	HttpKnownHeaderIfNoneMatch = 24,
+	HttpKnownHeaderAuthorization = 25,
+	HttpKnownHeaderExpect = 26,
+	HttpKnownHeaderUpgrade = 27,
+	HttpKnownHeaderRange = 28,
+	HttpKnownHeaderContentRange = 29,
+	HttpKnownHeaderVary = 30,
+	HttpKnownHeaderDate = 31,
+	HttpKnownHeaderServer = 32,
+	HttpKnownHeaderContentDisposition = 33,
+	HttpKnownHeaderTe = 34,
+	HttpKnownHeaderTrailer = 35
+};
+
+/// <summary>
+/// A view of a single header. The name and value point directly into the transaction's own
+/// header storage. They are not null terminated, and are only valid for the duration of the
+/// callback they were supplied to.
+/// </summary>
+typedef struct HttpHeaderView
+{
+	const char* name;
+	uint32_t nameLength;
+	const char* value;
+	uint32_t valueLength;
+	uint32_t knownHeaderId;
+} HttpHeaderView;
+
+/// <summary>
+/// Flags describing a message supplied through HttpMessageView. Values may be combined. New values
+/// may be appended, but existing values will never change.
+/// </summary>
+enum HttpMessageFlags
+{
+	HttpMessageFlagNone = 0,
+
+	/// <summary>
+	/// The response body is only the first bytes of the response, held for inspection under the
+	/// inspection policy, or because the message begin callback asked for only that much through
+	/// responseSampleBytes. Any chunked framing has been removed, but it's otherwise as it came off
+	/// the wire, so it may still be compressed. If the message is allowed, the rest of the response is streamed to the client
+	/// without being inspected. See fe_ctl_set_inspection_policy.
+	/// </summary>
+	HttpMessageFlagResponseBodyTruncated = 1
+};
+
+/// <summary>
+/// A view of a transaction, supplied to the view form of the message callbacks. Everything here
+/// points into the transaction's own storage, so nothing is copied or formatted to produce it, and
+/// nothing needs to be parsed to consume it. None of the strings are null terminated, and none of
+/// the pointers are valid beyond the duration of the callback.
+/// 
+/// The response fields are only populated when there is a response, otherwise statusCode is zero,
+/// responseHeaderCount is zero and the other response pointers are nullptr. Bodies are only
+/// populated when the transaction was previously flagged for inspection and is complete, exactly
+/// as for the string form of the callbacks, or when the inspection policy asked for only the
+/// first bytes of the response to be inspected, in which case flags says so.
+/// </summary>
+typedef struct HttpMessageView
+{
+	const char* method;
+	uint32_t methodLength;
+	const char* uri;
+	uint32_t uriLength;
+	const char* host;
+	uint32_t hostLength;
+	uint32_t statusCode;
+	const char* statusLine;
+	uint32_t statusLineLength;
+	const HttpHeaderView* requestHeaders;
+	uint32_t requestHeaderCount;
+	const HttpHeaderView* responseHeaders;
+	uint32_t responseHeaderCount;
+	const char* requestBody;
+	uint32_t requestBodyLength;
+	const char* responseBody;
+	uint32_t responseBodyLength;
+	uint32_t flags;
+} HttpMessageView;
+
+/// <summary>
+/// View form of the message begin callback. Answers with a nextAction, exactly as the string forms
+/// do. When answering 1 for a response, the callback may also set responseSampleBytes to have only
+/// the first bytes of the payload inspected. Once that many have arrived, or the payload is
+/// complete, whichever comes first, the message end callback is handed what has arrived, with
+/// HttpMessageFlagResponseBodyTruncated set if it's only part of the payload. If the message is
+/// allowed, what was held is sent on and the rest of the payload is streamed without being held.
+/// This takes precedence over the inspection policy. responseSampleBytes is zero on entry, which
+/// means the whole payload, and is ignored for requests and for any other nextAction.
+/// </summary>
+typedef void(*HttpMessageBeginViewCallback)(
+	const HttpMessageView* message,
+	uint32_t* nextAction, uint32_t* responseSampleBytes, const CustomResponseStreamWriterV2 customBlockResponseStreamWriter, void* writerContext
+	);
+
+typedef void(*HttpMessageEndViewCallback)(
+	const HttpMessageView* message,
+	bool* shouldBlock, const CustomResponseStreamWriterV2 customBlockResponseStreamWriter, void* writerContext
+	);
+
+/// <summary>
+/// Asynchronous form of HttpMessageBeginViewCallback. The callback may answer immediately, exactly
+/// as HttpMessageBeginViewCallback does, by setting nextAction, and possibly responseSampleBytes,
+/// and returning false. Or, it may return true to indicate that the verdict is pending. In that
+/// case both out arguments and anything written through the writer are ignored, the connection
+/// is parked without holding a thread, and it is resumed once fe_ctl_complete_verdict(...) is
+/// called with the supplied verdictToken, or once the configured verdict timeout expires,
+/// whichever comes first. The message view is only valid for the duration of the callback, so
+/// anything needed to reach the verdict later must be copied.
+/// </summary>
+typedef bool(*HttpMessageBeginAsyncCallback)(
+	const HttpMessageView* message, const uint64_t verdictToken,
+	uint32_t* nextAction, uint32_t* responseSampleBytes, const CustomResponseStreamWriterV2 customBlockResponseStreamWriter, void* writerContext
+	);
+
+/// <summary>
+/// Asynchronous form of HttpMessageEndViewCallback. See HttpMessageBeginAsyncCallback.
+/// </summary>
+typedef bool(*HttpMessageEndAsyncCallback)(
+	const HttpMessageView* message, const uint64_t verdictToken,
+	bool* shouldBlock, const CustomResponseStreamWriterV2 customBlockResponseStreamWriter, void* writerContext
+	);
+
+/// <summary>
+/// Called once a filtering configuration supplied to fe_ctl_load_filter_configuration(...) has
+/// been loaded and published, or has failed to load. Called on the Engine's configuration thread.
+/// When success is false, the configuration that was current beforehand is still in effect, and
+/// the reason has been reported through the error callback. Otherwise, generation identifies the
+/// configuration now in effect, and the counts describe what it contains.
+/// </summary>
+typedef void(*FilterConfigurationLoadedCallback)(
+	void* context, const bool success, const uint64_t generation,
+	const uint32_t ruleCount, const uint32_t failedRuleCount, const uint32_t blocklistEntryCount
+	);
+
 #ifdef __cplusplus
 namespace te
 {
@@ -63,16 +311,44 @@ namespace te
 				using FirewallCheckFunction = std::function<bool(const char* binaryAbsolutePath, const size_t binaryAbsolutePathLength)>;
 				using MessageFunction = std::function<void(const char* message, const size_t messageLength)>;
 
+				// Internally, everything speaks the context carrying V2 form. Callbacks supplied in the
+				// original form are adapted to it. See StreamCopyUtils.hpp.
+
 				using HttpMessageBeginCheckFunction = std::function<void(
 					const char* requestHeaders, const uint32_t requestHeadersLength, const char* requestBody, const uint32_t requestBodyLength,
 					const char* responseHeaders, const uint32_t responseHeadersLength, const char* responseBody, const uint32_t responseBodyLength,
-					uint32_t* nextAction, const CustomResponseStreamWriter customBlockResponseStreamWriter
+					uint32_t* nextAction, const CustomResponseStreamWriterV2 customBlockResponseStreamWriter, void* writerContext
 					)>;
 
 				using HttpMessageEndCheckFunction = std::function<void(
 					const char* requestHeaders, const uint32_t requestHeadersLength, const char* requestBody, const uint32_t requestBodyLength,
 					const char* responseHeaders, const uint32_t responseHeadersLength, const char* responseBody, const uint32_t responseBodyLength,
-					bool* shouldBlock, const CustomResponseStreamWriter customBlockResponseStreamWriter
+					bool* shouldBlock, const CustomResponseStreamWriterV2 customBlockResponseStreamWriter, void* writerContext
+					)>;
+
+				using HttpMessageBeginViewFunction = std::function<void(
+					const HttpMessageView* message,
+					uint32_t* nextAction, uint32_t* responseSampleBytes, const CustomResponseStreamWriterV2 customBlockResponseStreamWriter, void* writerContext
+					)>;
+
+				using HttpMessageEndViewFunction = std::function<void(
+					const HttpMessageView* message,
+					bool* shouldBlock, const CustomResponseStreamWriterV2 customBlockResponseStreamWriter, void* writerContext
+					)>;
+
+				using HttpMessageBeginAsyncFunction = std::function<bool(
+					const HttpMessageView* message, const uint64_t verdictToken,
+					uint32_t* nextAction, uint32_t* responseSampleBytes, const CustomResponseStreamWriterV2 customBlockResponseStreamWriter, void* writerContext
+					)>;
+
+				using HttpMessageEndAsyncFunction = std::function<bool(
+					const HttpMessageView* message, const uint64_t verdictToken,
+					bool* shouldBlock, const CustomResponseStreamWriterV2 customBlockResponseStreamWriter, void* writerContext
+					)>;
+
+				using FilterConfigurationLoadedFunction = std::function<void(
+					const bool success, const uint64_t generation,
+					const uint32_t ruleCount, const uint32_t failedRuleCount, const uint32_t blocklistEntryCount
 					)>;
 
 			} /* namespace cb */
@@ -249,7 +249,7 @@ namespace te
                 constexpr std::array<std::array<CStreamCopyUtilProxy, 1000>, ArrSize> CStreamCopyUtilContainer<TT, ArrSize>::m_arr;
 
                 template<bool TT, size_t ArrSize>
-                std::atomic_uint32_t CStreamCopyUtilContainer<TT, ArrSize>::s_acquireIdx = 0;
+                std::atomic_uint32_t CStreamCopyUtilContainer<TT, ArrSize>::s_acquireIdx{ 0 };
 
                 template<bool TT, size_t ArrSize>
                 inline TempWriterChannel CStreamCopyUtilContainer<TT, ArrSize>::ClaimNextChannel(std::vector<char>* outContainer) noexcept
@@ -279,6 +279,133 @@ namespace te
                         outContainer
                     };
                 }
+
+                /// <summary>
+                /// The ContextStreamCopyUtil is what the Engine hands to callbacks as the block response
+                /// writer. Since the CustomResponseStreamWriterV2 signature carries a context argument that
+                /// tells the writer where to write, the one function serves every transaction at once. There
+                /// is nothing to claim, nothing to release and nothing to run out of. The CStreamCopyUtil
+                /// channel table above is kept only to adapt callbacks supplied in the original form.
+                /// </summary>
+                struct ContextStreamCopyUtil
+                {
+                    ContextStreamCopyUtil() = delete;
+                    ContextStreamCopyUtil(const ContextStreamCopyUtil&) = delete;
+                    ContextStreamCopyUtil(const ContextStreamCopyUtil&&) = delete;
+                    ~ContextStreamCopyUtil() = delete;
+
+                    /// <summary>
+                    /// Gets the writer context that directs writes to the supplied container.
+                    /// </summary>
+                    /// <param name="container">
+                    /// The container to write to.
+                    /// </param>
+                    /// <returns>
+                    /// The opaque writer context to hand to callbacks alongside ::Write.
+                    /// </returns>
+                    static void* GetContext(std::vector<char>* container) noexcept
+                    {
+                        return static_cast<void*>(container);
+                    }
+
+                    /// <summary>
+                    /// Appends the supplied data to the container that the writer context points to.
+                    /// </summary>
+                    /// <param name="writerContext">
+                    /// A writer context previously obtained from ::GetContext(...).
+                    /// </param>
+                    /// <param name="data">
+                    /// The data to write.
+                    /// </param>
+                    /// <param name="dataLength">
+                    /// The length of the data to write.
+                    /// </param>
+                    static void Write(void* writerContext, const char* data, const uint32_t dataLength)
+                    {
+                        auto* container = static_cast<std::vector<char>*>(writerContext);
+
+                        if (container != nullptr && data != nullptr && dataLength > 0)
+                        {
+                            container->insert(container->end(), data, data + dataLength);
+                        }
+                    }
+                };
+
+                /// <summary>
+                /// The channel table used to adapt callbacks supplied in the original form. The actual
+                /// number of channels is 1000 times the second argument. This used to be instantiated
+                /// once per bridge type, for 20K channels in all. There's now only the one table of 10K,
+                /// and only transactions whose callbacks were supplied in the original form use it.
+                /// </summary>
+                using LegacyStreamCopyContainer = CStreamCopyUtilContainer<false, 10>;
+
+                /// <summary>
+                /// Adapts a message begin callback in the original form, which takes a writer that
+                /// knows where to write by itself, to the V2 form used internally. For every call, a
+                /// channel is claimed from the legacy channel table and pointed at the container that
+                /// the V2 writer context refers to.
+                /// </summary>
+                /// <param name="legacyCallback">
+                /// The callback to adapt. May be nullptr.
+                /// </param>
+                /// <returns>
+                /// The adapted callback, or an empty function if the supplied callback was nullptr.
+                /// </returns>
+                inline HttpMessageBeginCheckFunction AdaptLegacyCallback(const HttpMessageBeginCallback legacyCallback)
+                {
+                    if (legacyCallback == nullptr)
+                    {
+                        return nullptr;
+                    }
+
+                    return [legacyCallback](
+                        const char* requestHeaders, const uint32_t requestHeadersLength, const char* requestBody, const uint32_t requestBodyLength,
+                        const char* responseHeaders, const uint32_t responseHeadersLength, const char* responseBody, const uint32_t responseBodyLength,
+                        uint32_t* nextAction, const CustomResponseStreamWriterV2 customBlockResponseStreamWriter, void* writerContext
+                        )
+                    {
+                        const auto channel = LegacyStreamCopyContainer::ClaimNextChannel(static_cast<std::vector<char>*>(writerContext));
+
+                        legacyCallback(
+                            requestHeaders, requestHeadersLength, requestBody, requestBodyLength,
+                            responseHeaders, responseHeadersLength, responseBody, responseBodyLength,
+                            nextAction, channel.GetWriter()
+                            );
+                    };
+                }
+
+                /// <summary>
+                /// Adapts a message end callback in the original form to the V2 form used internally.
+                /// See the message begin overload.
+                /// </summary>
+                /// <param name="legacyCallback">
+                /// The callback to adapt. May be nullptr.
+                /// </param>
+                /// <returns>
+                /// The adapted callback, or an empty function if the supplied callback was nullptr.
+                /// </returns>
+                inline HttpMessageEndCheckFunction AdaptLegacyCallback(const HttpMessageEndCallback legacyCallback)
+                {
+                    if (legacyCallback == nullptr)
+                    {
+                        return nullptr;
+                    }
+
+                    return [legacyCallback](
+                        const char* requestHeaders, const uint32_t requestHeadersLength, const char* requestBody, const uint32_t requestBodyLength,
+                        const char* responseHeaders, const uint32_t responseHeadersLength, const char* responseBody, const uint32_t responseBodyLength,
+                        bool* shouldBlock, const CustomResponseStreamWriterV2 customBlockResponseStreamWriter, void* writerContext
+                        )
+                    {
+                        const auto channel = LegacyStreamCopyContainer::ClaimNextChannel(static_cast<std::vector<char>*>(writerContext));
+
+                        legacyCallback(
+                            requestHeaders, requestHeadersLength, requestBody, requestBodyLength,
+                            responseHeaders, responseHeadersLength, responseBody, responseBodyLength,
+                            shouldBlock, channel.GetWriter()
+                            );
+                    };
+                }
 			}
 		}
 	}
@@ -0,0 +1,251 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace util
+		{
+			namespace hash
+			{
+
+				/// <summary>
+				/// Streaming implementation of the 64 bit xxHash, XXH64. Data may be supplied in
+				/// pieces of any size, in order, and the digest is the same as if it had been
+				/// supplied all at once. This is a fast, non-cryptographic hash, suitable for
+				/// recognizing content we've seen before, but not for anything an attacker could
+				/// profit from forging a collision against.
+				/// </summary>
+				class XxHash64
+				{
+
+				public:
+
+					/// <summary>
+					/// Constructs a new XxHash64 instance, ready to hash.
+					/// </summary>
+					/// <param name="seed">
+					/// The seed.
+					/// </param>
+					XxHash64(const uint64_t seed = 0)
+					{
+						Reset(seed);
+					}
+
+					/// <summary>
+					/// Discards everything hashed so far and starts over.
+					/// </summary>
+					/// <param name="seed">
+					/// The seed.
+					/// </param>
+					void Reset(const uint64_t seed = 0)
+					{
+						m_seed = seed;
+						m_accumulators[0] = seed + Prime1 + Prime2;
+						m_accumulators[1] = seed + Prime2;
+						m_accumulators[2] = seed;
+						m_accumulators[3] = seed - Prime1;
+						m_totalLength = 0;
+						m_bufferedLength = 0;
+					}
+
+					/// <summary>
+					/// Hashes the next piece of data.
+					/// </summary>
+					/// <param name="data">
+					/// The data. May be nullptr if length is zero.
+					/// </param>
+					/// <param name="length">
+					/// The length of the data, in bytes.
+					/// </param>
+					void Update(const char* data, size_t length)
+					{
+						if (length == 0)
+						{
+							return;
+						}
+
+						const uint8_t* input = reinterpret_cast<const uint8_t*>(data);
+
+						m_totalLength += length;
+
+						// Top up a stripe left over from the last piece first.
+						if (m_bufferedLength > 0)
+						{
+							const size_t needed = StripeLength - m_bufferedLength;
+
+							if (length < needed)
+							{
+								std::memcpy(m_buffer + m_bufferedLength, input, length);
+								m_bufferedLength += length;
+								return;
+							}
+
+							std::memcpy(m_buffer + m_bufferedLength, input, needed);
+							ConsumeStripe(m_buffer);
+
+							input += needed;
+							length -= needed;
+							m_bufferedLength = 0;
+						}
+
+						while (length >= StripeLength)
+						{
+							ConsumeStripe(input);
+							input += StripeLength;
+							length -= StripeLength;
+						}
+
+						if (length > 0)
+						{
+							std::memcpy(m_buffer, input, length);
+							m_bufferedLength = length;
+						}
+					}
+
+					/// <summary>
+					/// Gets the digest of everything hashed so far. Doesn't alter the state, so
+					/// hashing may carry on afterwards.
+					/// </summary>
+					/// <returns>
+					/// The digest.
+					/// </returns>
+					const uint64_t Digest() const
+					{
+						uint64_t hash;
+
+						if (m_totalLength >= StripeLength)
+						{
+							hash = RotateLeft(m_accumulators[0], 1) + RotateLeft(m_accumulators[1], 7) + RotateLeft(m_accumulators[2], 12) + RotateLeft(m_accumulators[3], 18);
+
+							for (const uint64_t accumulator : m_accumulators)
+							{
+								hash ^= Round(0, accumulator);
+								hash = hash * Prime1 + Prime4;
+							}
+						}
+						else
+						{
+							hash = m_seed + Prime5;
+						}
+
+						hash += m_totalLength;
+
+						const uint8_t* tail = m_buffer;
+						size_t remaining = m_bufferedLength;
+
+						while (remaining >= 8)
+						{
+							hash ^= Round(0, Read64(tail));
+							hash = RotateLeft(hash, 27) * Prime1 + Prime4;
+							tail += 8;
+							remaining -= 8;
+						}
+
+						if (remaining >= 4)
+						{
+							hash ^= static_cast<uint64_t>(Read32(tail)) * Prime1;
+							hash = RotateLeft(hash, 23) * Prime2 + Prime3;
+							tail += 4;
+							remaining -= 4;
+						}
+
+						while (remaining > 0)
+						{
+							hash ^= (*tail) * Prime5;
+							hash = RotateLeft(hash, 11) * Prime1;
+							++tail;
+							--remaining;
+						}
+
+						hash ^= hash >> 33;
+						hash *= Prime2;
+						hash ^= hash >> 29;
+						hash *= Prime3;
+						hash ^= hash >> 32;
+
+						return hash;
+					}
+
+					/// <summary>
+					/// Gets the number of bytes hashed so far.
+					/// </summary>
+					/// <returns>
+					/// The number of bytes hashed so far.
+					/// </returns>
+					const uint64_t GetLength() const
+					{
+						return m_totalLength;
+					}
+
+				private:
+
+					static constexpr uint64_t Prime1 = 11400714785074694791ULL;
+					static constexpr uint64_t Prime2 = 14029467366897019727ULL;
+					static constexpr uint64_t Prime3 = 1609587929392839161ULL;
+					static constexpr uint64_t Prime4 = 9650029242287828579ULL;
+					static constexpr uint64_t Prime5 = 2870177450012600261ULL;
+
+					static constexpr size_t StripeLength = 32;
+
+					static inline uint64_t RotateLeft(const uint64_t value, const int bits)
+					{
+						return (value << bits) | (value >> (64 - bits));
+					}
+
+					static inline uint64_t Round(uint64_t accumulator, const uint64_t lane)
+					{
+						accumulator += lane * Prime2;
+						accumulator = RotateLeft(accumulator, 31);
+						return accumulator * Prime1;
+					}
+
+					// The digest is defined over little endian lanes, which is what every
+					// platform we build for is.
+					static inline uint64_t Read64(const uint8_t* p)
+					{
+						uint64_t value;
+						std::memcpy(&value, p, sizeof(value));
+						return value;
+					}
+
+					static inline uint32_t Read32(const uint8_t* p)
+					{
+						uint32_t value;
+						std::memcpy(&value, p, sizeof(value));
+						return value;
+					}
+
+					void ConsumeStripe(const uint8_t* stripe)
+					{
+						m_accumulators[0] = Round(m_accumulators[0], Read64(stripe));
+						m_accumulators[1] = Round(m_accumulators[1], Read64(stripe + 8));
+						m_accumulators[2] = Round(m_accumulators[2], Read64(stripe + 16));
+						m_accumulators[3] = Round(m_accumulators[3], Read64(stripe + 24));
+					}
+
+					uint64_t m_seed = 0;
+
+					uint64_t m_accumulators[4];
+
+					uint64_t m_totalLength = 0;
+
+					uint8_t m_buffer[StripeLength];
+
+					size_t m_bufferedLength = 0;
+				};
+
+			} /* namespace hash */
+		} /* namespace util */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,275 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "Bench.hpp"
+
+#include "te/httpengine/mitm/http/HttpRequest.hpp"
+#include "te/httpengine/network/VerdictControl.hpp"
+
+#include <boost/asio.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace test
+		{
+
+			/// <summary>
+			/// How long the slow classifier takes over each verdict.
+			/// </summary>
+			const std::chrono::milliseconds SlowVerdict(50);
+
+			/// <summary>
+			/// How long each configuration is run for.
+			/// </summary>
+			const std::chrono::milliseconds Window(1000);
+
+			/// <summary>
+			/// The number of connections that get their verdicts immediately.
+			/// </summary>
+			const size_t FastConnections = 8;
+
+			const std::string Request =
+				u8"GET /index.html HTTP/1.1\r\n"
+				u8"Host: www.example.com\r\n"
+				u8"User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/60.0.3112.113 Safari/537.36\r\n"
+				u8"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+				u8"Accept-Encoding: gzip, deflate, br\r\n"
+				u8"\r\n";
+
+			/// <summary>
+			/// A classifier on a thread of its own, such as a managed model, which answers one
+			/// verdict at a time, each after SlowVerdict, through VerdictControl::Complete(...)
+			/// just as fe_ctl_complete_verdict() does.
+			/// </summary>
+			class SlowClassifier
+			{
+
+			public:
+
+				SlowClassifier(network::VerdictControl& verdicts)
+					:
+					m_verdicts(verdicts),
+					m_thread(&SlowClassifier::Run, this)
+				{
+
+				}
+
+				~SlowClassifier()
+				{
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_stopping = true;
+					}
+
+					m_wake.notify_one();
+					m_thread.join();
+				}
+
+				void Classify(const uint64_t token)
+				{
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_tokens.push_back(token);
+					}
+
+					m_wake.notify_one();
+				}
+
+			private:
+
+				void Run()
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+
+					while (true)
+					{
+						m_wake.wait(lock, [this]() { return m_stopping || !m_tokens.empty(); });
+
+						if (m_stopping)
+						{
+							return;
+						}
+
+						const uint64_t token = m_tokens.front();
+						m_tokens.pop_front();
+
+						lock.unlock();
+						std::this_thread::sleep_for(SlowVerdict);
+						m_verdicts.Complete(token, 0, 0, nullptr, 0);
+						lock.lock();
+					}
+				}
+
+				network::VerdictControl& m_verdicts;
+
+				std::mutex m_mutex;
+
+				std::condition_variable m_wake;
+
+				std::deque<uint64_t> m_tokens;
+
+				bool m_stopping = false;
+
+				std::thread m_thread;
+			};
+
+			/// <summary>
+			/// A connection that does nothing but have requests parsed and judged, one after
+			/// the other, on its own strand, the way a bridge does.
+			/// </summary>
+			class Connection
+			{
+
+			public:
+
+				Connection(boost::asio::io_service& service, SlowClassifier* classifier, network::VerdictControl* verdicts)
+					:
+					m_strand(service),
+					m_classifier(classifier),
+					m_verdicts(verdicts)
+				{
+
+				}
+
+				void Start()
+				{
+					m_strand.post(std::bind(&Connection::Serve, this));
+				}
+
+				uint64_t GetServed() const
+				{
+					return m_served;
+				}
+
+			private:
+
+				void Serve()
+				{
+					mitm::http::HttpRequest request(Request.data(), Request.size());
+					request.Parse(Request.size(), false);
+					Bench::KeepAlive(request);
+
+					if (m_classifier == nullptr)
+					{
+						OnVerdict();
+						return;
+					}
+
+					if (m_verdicts == nullptr)
+					{
+						// A synchronous callback holds the io_service thread for as long as the
+						// classifier takes.
+						std::this_thread::sleep_for(SlowVerdict);
+						OnVerdict();
+						return;
+					}
+
+					const uint64_t token = m_verdicts->Park([this](const uint32_t, const uint32_t, std::vector<char>)
+					{
+						m_strand.post(std::bind(&Connection::OnVerdict, this));
+					});
+
+					m_classifier->Classify(token);
+				}
+
+				void OnVerdict()
+				{
+					++m_served;
+					m_strand.post(std::bind(&Connection::Serve, this));
+				}
+
+				boost::asio::io_service::strand m_strand;
+
+				SlowClassifier* m_classifier;
+
+				network::VerdictControl* m_verdicts;
+
+				uint64_t m_served = 0;
+			};
+
+			/// <summary>
+			/// Runs the fast connections, and optionally one slow one, on a single io_service
+			/// thread for Window, then reports how many requests each got through.
+			/// </summary>
+			void Measure(const std::string& name, const bool slow, const bool async)
+			{
+				boost::asio::io_service service;
+				network::VerdictControl verdicts;
+
+				std::vector<std::unique_ptr<Connection>> connections;
+
+				for (size_t i = 0; i < FastConnections; ++i)
+				{
+					connections.emplace_back(new Connection(service, nullptr, nullptr));
+				}
+
+				{
+					// Declared ahead of the classifier, so that the classifier has stopped before
+					// the connection it answers for goes.
+					std::unique_ptr<Connection> slowConnection;
+
+					SlowClassifier classifier(verdicts);
+
+					if (slow)
+					{
+						slowConnection.reset(new Connection(service, &classifier, async ? &verdicts : nullptr));
+						slowConnection->Start();
+					}
+
+					for (const auto& connection : connections)
+					{
+						connection->Start();
+					}
+
+					boost::asio::steady_timer window(service, Window);
+					window.async_wait([&service](const boost::system::error_code&) { service.stop(); });
+
+					service.run();
+
+					uint64_t fastServed = 0;
+
+					for (const auto& connection : connections)
+					{
+						fastServed += connection->GetServed();
+					}
+
+					const double seconds = std::chrono::duration<double>(Window).count();
+
+					std::cout << std::left << std::setw(56) << name << std::right << std::fixed << std::setprecision(0)
+						<< std::setw(12) << static_cast<double>(fastServed) / seconds << u8" fast requests/s"
+						<< std::setw(8) << (slowConnection ? static_cast<double>(slowConnection->GetServed()) / seconds : 0.0) << u8" slow requests/s" << std::endl;
+				}
+
+				// Whatever the classifier didn't get to would otherwise refer to connections
+				// that are about to go.
+				verdicts.WithdrawAll();
+			}
+
+		} /* namespace test */
+	} /* namespace httpengine */
+} /* namespace te */
+
+int main()
+{
+	using namespace te::httpengine::test;
+
+	Measure(u8"8 connections, no slow verdicts", false, false);
+	Measure(u8"8 connections, plus one with synchronous slow verdicts", true, false);
+	Measure(u8"8 connections, plus one with asynchronous slow verdicts", true, true);
+
+	return 0;
+}
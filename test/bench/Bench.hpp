@@ -0,0 +1,154 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace test
+		{
+
+			/// <summary>
+			/// A deliberately small microbenchmark runner. Each benchmark is a callable that
+			/// performs one operation, which is run for a fixed number of operations per
+			/// sample, over several samples, after a warmup. The median and fastest samples
+			/// are reported in nanoseconds per operation and, where the benchmark says how
+			/// many bytes one operation covers, in megabytes per second.
+			///
+			/// Every benchmark executable takes a single optional argument, a multiplier for
+			/// the number of operations per sample, so that a run can be made quicker or
+			/// steadier without rebuilding.
+			/// </summary>
+			class Bench
+			{
+
+			public:
+
+				/// <summary>
+				/// The number of timed samples taken for each benchmark.
+				/// </summary>
+				static constexpr size_t Samples = 7;
+
+				Bench(int argc, char* argv[])
+				{
+					if (argc > 1)
+					{
+						const double scale = std::atof(argv[1]);
+
+						if (scale > 0)
+						{
+							m_scale = scale;
+						}
+					}
+				}
+
+				/// <summary>
+				/// Runs and reports a single benchmark.
+				/// </summary>
+				/// <param name="name">
+				/// The name to report the results under.
+				/// </param>
+				/// <param name="operations">
+				/// The number of operations per sample, before scaling.
+				/// </param>
+				/// <param name="bytesPerOperation">
+				/// The number of bytes one operation processes, or zero if throughput isn't
+				/// meaningful for this benchmark.
+				/// </param>
+				/// <param name="operation">
+				/// The operation to time.
+				/// </param>
+				/// <returns>
+				/// The median time for one operation, in nanoseconds.
+				/// </returns>
+				template<typename Operation>
+				double Run(const std::string& name, const size_t operations, const size_t bytesPerOperation, Operation&& operation)
+				{
+					const size_t scaled = std::max<size_t>(1, static_cast<size_t>(operations * m_scale));
+
+					for (size_t i = 0; i < std::max<size_t>(1, scaled / 10); ++i)
+					{
+						operation();
+					}
+
+					std::vector<double> samples;
+					samples.reserve(Samples);
+
+					for (size_t sample = 0; sample < Samples; ++sample)
+					{
+						const auto start = std::chrono::steady_clock::now();
+
+						for (size_t i = 0; i < scaled; ++i)
+						{
+							operation();
+						}
+
+						const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+						samples.push_back(static_cast<double>(elapsed) / static_cast<double>(scaled));
+					}
+
+					std::sort(samples.begin(), samples.end());
+
+					const double median = samples[samples.size() / 2];
+					const double fastest = samples.front();
+
+					std::cout << std::left << std::setw(56) << name << std::right << std::fixed << std::setprecision(1)
+						<< std::setw(12) << median << u8" ns/op" << std::setw(12) << fastest << u8" ns/op (fastest)";
+
+					if (bytesPerOperation > 0)
+					{
+						std::cout << std::setw(10) << (static_cast<double>(bytesPerOperation) * 1000.0 / median) << u8" MB/s";
+					}
+
+					std::cout << std::endl;
+
+					return median;
+				}
+
+				/// <summary>
+				/// Keeps the compiler from discarding a result that is otherwise unused.
+				/// </summary>
+				template<typename T>
+				static void KeepAlive(const T& value)
+				{
+					Sink() = &value;
+				}
+
+			private:
+
+				/// <summary>
+				/// Where ::KeepAlive(...) stores the address of every result. A volatile write
+				/// can't be discarded, and it's held behind a function rather than as a local
+				/// static so that the compiler can't see it's never read.
+				/// </summary>
+				static const void* volatile& Sink()
+				{
+					static const void* volatile sink = nullptr;
+					return sink;
+				}
+
+				/// <summary>
+				/// The multiplier applied to the number of operations per sample.
+				/// </summary>
+				double m_scale = 1.0;
+			};
+
+		} /* namespace test */
+	} /* namespace httpengine */
+} /* namespace te */
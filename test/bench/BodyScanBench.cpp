@@ -0,0 +1,220 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "Bench.hpp"
+
+#include "te/httpengine/mitm/http/HttpResponse.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace test
+		{
+
+			using mitm::http::HttpResponse;
+
+			/// <summary>
+			/// The size of the body every run passes through, a bulk download.
+			/// </summary>
+			const size_t BodySize = 16 * 1024 * 1024;
+
+			/// <summary>
+			/// The size of every read, which is what the bridge reads at a time.
+			/// </summary>
+			const size_t ReadSize = 131072;
+
+			std::string MakeFixedLengthBody(std::string& head)
+			{
+				head =
+					u8"HTTP/1.1 200 OK\r\n"
+					u8"Content-Type: application/octet-stream\r\n"
+					u8"Content-Length: " + std::to_string(BodySize) + u8"\r\n"
+					u8"\r\n";
+
+				return std::string(BodySize, 'x');
+			}
+
+			std::string MakeChunkedBody(std::string& head, const size_t chunkSize)
+			{
+				head =
+					u8"HTTP/1.1 200 OK\r\n"
+					u8"Content-Type: application/octet-stream\r\n"
+					u8"Transfer-Encoding: chunked\r\n"
+					u8"\r\n";
+
+				std::string body;
+				char sizeLine[32];
+
+				for (size_t written = 0; written < BodySize; written += chunkSize)
+				{
+					std::snprintf(sizeLine, sizeof(sizeLine), "%zx\r\n", chunkSize);
+					body.append(sizeLine);
+					body.append(chunkSize, 'x');
+					body.append(u8"\r\n");
+				}
+
+				body.append(u8"0\r\n\r\n");
+
+				return body;
+			}
+
+			std::string MakeLargeChunkedBody(std::string& head)
+			{
+				return MakeChunkedBody(head, 16384);
+			}
+
+			std::string MakeSmallChunkedBody(std::string& head)
+			{
+				return MakeChunkedBody(head, 1024);
+			}
+
+			/// <summary>
+			/// Passes a response through the way the bridge does when nobody has asked to
+			/// inspect it. The headers are sent on as soon as they're complete, then every
+			/// read is parsed and handed back out as the next write.
+			/// </summary>
+			size_t PassThrough(const std::string& head, const std::string& body)
+			{
+				HttpResponse response(head.data(), head.size());
+				response.Parse(head.size(), false);
+
+				size_t written = boost::asio::buffer_size(response.GetWriteBuffer());
+
+				for (size_t offset = 0; offset < body.size() && !response.IsPayloadComplete();)
+				{
+					auto buffer = response.GetReadBuffer();
+					const size_t length = std::min(boost::asio::buffer_size(buffer), body.size() - offset);
+
+					std::memcpy(boost::asio::buffer_cast<char*>(buffer), body.data() + offset, length);
+
+					if (!response.Parse(length, false))
+					{
+						throw std::runtime_error(u8"The body failed to parse.");
+					}
+
+					written += boost::asio::buffer_size(response.GetWriteBuffer());
+					offset += length;
+				}
+
+				if (!response.IsPayloadComplete())
+				{
+					throw std::runtime_error(u8"The body didn't complete the response.");
+				}
+
+				return written;
+			}
+
+			/// <summary>
+			/// What passing a body through used to cost. Every byte is run through
+			/// http_parser and copied out of its body callback.
+			/// </summary>
+			size_t ParseThrough(const std::string& head, const std::string& body)
+			{
+				std::vector<char> out;
+
+				http_parser parser;
+				http_parser_init(&parser, HTTP_RESPONSE);
+				parser.data = &out;
+
+				http_parser_settings settings;
+				http_parser_settings_init(&settings);
+				settings.on_body = [](http_parser* p, const char* at, size_t length)
+				{
+					auto& payload = *static_cast<std::vector<char>*>(p->data);
+					payload.insert(payload.end(), at, at + length);
+					return 0;
+				};
+
+				size_t written = http_parser_execute(&parser, &settings, head.data(), head.size());
+
+				std::vector<char> buffer(ReadSize);
+
+				for (size_t offset = 0; offset < body.size(); offset += ReadSize)
+				{
+					const size_t length = std::min(ReadSize, body.size() - offset);
+
+					std::memcpy(buffer.data(), body.data() + offset, length);
+
+					out.clear();
+					http_parser_execute(&parser, &settings, buffer.data(), length);
+					written += out.size();
+				}
+
+				return written;
+			}
+
+			/// <summary>
+			/// Raw passthrough, every read copied in and nothing else, as the ceiling.
+			/// </summary>
+			size_t CopyThrough(const std::string& body)
+			{
+				std::vector<char> buffer(ReadSize);
+
+				for (size_t offset = 0; offset < body.size(); offset += ReadSize)
+				{
+					const size_t length = std::min(ReadSize, body.size() - offset);
+					std::memcpy(buffer.data(), body.data() + offset, length);
+					Bench::KeepAlive(buffer);
+				}
+
+				return body.size();
+			}
+
+		} /* namespace test */
+	} /* namespace httpengine */
+} /* namespace te */
+
+int main(int argc, char* argv[])
+{
+	using namespace te::httpengine::test;
+
+	Bench bench(argc, argv);
+
+	struct Shape
+	{
+		const char* name;
+		std::string (*make)(std::string& head);
+	};
+
+	const Shape shapes[] =
+	{
+		{ u8"Content-Length", &MakeFixedLengthBody },
+		{ u8"chunked, 16 KB chunks", &MakeLargeChunkedBody },
+		{ u8"chunked, 1 KB chunks", &MakeSmallChunkedBody }
+	};
+
+	for (const Shape& shape : shapes)
+	{
+		std::string head;
+		const std::string body = shape.make(head);
+		const std::string name = std::string(u8"16 MB, ") + shape.name;
+
+		bench.Run(name + u8", engine", 5, BodySize, [&head, &body]()
+		{
+			Bench::KeepAlive(PassThrough(head, body));
+		});
+
+		bench.Run(name + u8", http_parser with body copy", 5, BodySize, [&head, &body]()
+		{
+			Bench::KeepAlive(ParseThrough(head, body));
+		});
+
+		bench.Run(name + u8", raw copy", 5, BodySize, [&body]()
+		{
+			Bench::KeepAlive(CopyThrough(body));
+		});
+	}
+
+	return 0;
+}
@@ -0,0 +1,483 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "Bench.hpp"
+#include "HeapCounter.hpp"
+
+#include "te/httpengine/mitm/secure/TlsCapableHttpAcceptor.hpp"
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace test
+		{
+
+			using boost::asio::ip::tcp;
+
+			/// <summary>
+			/// How many threads run the io_service the bridges are on.
+			/// </summary>
+			const size_t BridgeThreads = 2;
+
+			/// <summary>
+			/// The size of the body the origin answers every request with.
+			/// </summary>
+			const size_t ResponseBodyLength = 1024;
+
+			/// <summary>
+			/// Gets the response the origin answers every request with.
+			/// </summary>
+			const std::string& GetOriginResponse()
+			{
+				static const std::string response =
+					std::string(u8"HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: ") +
+					std::to_string(ResponseBodyLength) + u8"\r\n\r\n" + std::string(ResponseBodyLength, 'x');
+
+				return response;
+			}
+
+			/// <summary>
+			/// Finds the end of a header block in the first length bytes of a buffer.
+			/// </summary>
+			/// <returns>
+			/// The number of bytes up to and including the blank line that ends the headers,
+			/// or zero if the headers aren't complete.
+			/// </returns>
+			size_t FindHeadersEnd(const char* data, const size_t length)
+			{
+				static const char terminator[] = "\r\n\r\n";
+
+				const char* end = std::search(data, data + length, terminator, terminator + 4);
+
+				return end == data + length ? 0 : static_cast<size_t>(end - data) + 4;
+			}
+
+			/// <summary>
+			/// One connection to the origin. Reads requests, which never have a body, and
+			/// answers each with the same response. Keeps the connection open until the
+			/// bridge closes it.
+			/// </summary>
+			class OriginConnection
+			{
+
+			public:
+
+				OriginConnection(boost::asio::io_service& service)
+					:
+					m_socket(service)
+				{
+
+				}
+
+				tcp::socket& Socket()
+				{
+					return m_socket;
+				}
+
+				void Read()
+				{
+					m_socket.async_read_some(
+						boost::asio::buffer(m_buffer.data() + m_held, m_buffer.size() - m_held),
+						[this](const boost::system::error_code& error, const size_t bytesRead) { OnRead(error, bytesRead); }
+					);
+				}
+
+			private:
+
+				void OnRead(const boost::system::error_code& error, const size_t bytesRead)
+				{
+					if (error)
+					{
+						return;
+					}
+
+					m_held += bytesRead;
+
+					Answer();
+				}
+
+				/// <summary>
+				/// Answers the request at the front of the buffer if it's complete, and reads
+				/// more otherwise.
+				/// </summary>
+				void Answer()
+				{
+					const size_t requestLength = FindHeadersEnd(m_buffer.data(), m_held);
+
+					if (requestLength == 0)
+					{
+						if (m_held < m_buffer.size())
+						{
+							Read();
+						}
+
+						return;
+					}
+
+					std::memmove(m_buffer.data(), m_buffer.data() + requestLength, m_held - requestLength);
+					m_held -= requestLength;
+
+					boost::asio::async_write(
+						m_socket,
+						boost::asio::buffer(GetOriginResponse()),
+						[this](const boost::system::error_code& error, const size_t) { if (!error) { Answer(); } }
+					);
+				}
+
+				tcp::socket m_socket;
+
+				std::array<char, 8192> m_buffer;
+
+				size_t m_held = 0;
+			};
+
+			/// <summary>
+			/// The server the bridges connect to, on a loopback port of its own and a thread
+			/// of its own.
+			/// </summary>
+			class Origin
+			{
+
+			public:
+
+				Origin()
+					:
+					m_acceptor(m_service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+				{
+					Accept();
+
+					m_thread = std::thread([this]() { m_service.run(); });
+				}
+
+				~Origin()
+				{
+					m_service.stop();
+					m_thread.join();
+				}
+
+				uint16_t GetPort() const
+				{
+					return m_acceptor.local_endpoint().port();
+				}
+
+			private:
+
+				void Accept()
+				{
+					m_connections.emplace_back(new OriginConnection(m_service));
+
+					m_acceptor.async_accept(m_connections.back()->Socket(), [this](const boost::system::error_code& error)
+					{
+						if (error)
+						{
+							return;
+						}
+
+						m_connections.back()->Socket().set_option(tcp::no_delay(true));
+						m_connections.back()->Read();
+
+						Accept();
+					});
+				}
+
+				boost::asio::io_service m_service;
+
+				tcp::acceptor m_acceptor;
+
+				std::vector<std::unique_ptr<OriginConnection>> m_connections;
+
+				std::thread m_thread;
+			};
+
+			/// <summary>
+			/// A client on a blocking socket of its own, sending one request at a time through
+			/// the bridge and timing each until its response has been read in full.
+			/// </summary>
+			class Client
+			{
+
+			public:
+
+				Client(const uint16_t bridgePort, const uint16_t originPort)
+					:
+					m_socket(m_service),
+					m_request(std::string(u8"GET / HTTP/1.1\r\nHost: 127.0.0.1:") + std::to_string(originPort) + u8"\r\n\r\n")
+				{
+					m_socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), bridgePort));
+					m_socket.set_option(tcp::no_delay(true));
+				}
+
+				/// <summary>
+				/// Sends a request and reads its response.
+				/// </summary>
+				/// <returns>
+				/// How long it took, in nanoseconds.
+				/// </returns>
+				double RoundTrip()
+				{
+					const auto start = std::chrono::steady_clock::now();
+
+					boost::asio::write(m_socket, boost::asio::buffer(m_request));
+
+					size_t held = 0;
+					size_t headersLength = 0;
+
+					while ((headersLength = FindHeadersEnd(m_buffer.data(), held)) == 0)
+					{
+						held += m_socket.read_some(boost::asio::buffer(m_buffer.data() + held, m_buffer.size() - held));
+					}
+
+					const size_t responseLength = headersLength + GetContentLength(headersLength);
+
+					while (held < responseLength)
+					{
+						held += m_socket.read_some(boost::asio::buffer(m_buffer.data() + held, m_buffer.size() - held));
+					}
+
+					return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+				}
+
+			private:
+
+				/// <summary>
+				/// Reads the Content-Length of the response whose headers are at the front of
+				/// the buffer. The bridges may rewrite the headers, so the name is looked for
+				/// without regard to case.
+				/// </summary>
+				size_t GetContentLength(const size_t headersLength) const
+				{
+					static const char name[] = "content-length:";
+
+					const char* headers = m_buffer.data();
+
+					const char* found = std::search(headers, headers + headersLength, name, name + sizeof(name) - 1,
+						[](const char a, const char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+
+					if (found == headers + headersLength)
+					{
+						throw std::runtime_error(u8"In Client::GetContentLength(const size_t) - Response has no Content-Length.");
+					}
+
+					return static_cast<size_t>(std::strtoull(found + sizeof(name) - 1, nullptr, 10));
+				}
+
+				boost::asio::io_service m_service;
+
+				tcp::socket m_socket;
+
+				const std::string m_request;
+
+				std::array<char, 8192> m_buffer;
+			};
+
+			/// <summary>
+			/// Allows every message on its headers, so that every request and response goes
+			/// through the callbacks but nothing is held back for inspection.
+			/// </summary>
+			void AllowMessageBegin(const HttpMessageView*, uint32_t* nextAction, uint32_t*, const CustomResponseStreamWriterV2, void*)
+			{
+				*nextAction = 0;
+			}
+
+			void AllowMessageEnd(const HttpMessageView*, bool* shouldBlock, const CustomResponseStreamWriterV2, void*)
+			{
+				*shouldBlock = false;
+			}
+
+			template<typename BridgeSocketType>
+			void ReportFrames(const mitm::secure::TlsCapableHttpBridge<BridgeSocketType>*, const uint64_t, const uint64_t)
+			{
+
+			}
+
+			template<typename BridgeSocketType>
+			void ReportFrames(const mitm::secure::CoroutineHttpBridge<BridgeSocketType>*, const uint64_t allocatedBefore, const uint64_t reusedBefore)
+			{
+				const auto& frames = mitm::secure::CoroutineHttpBridge<BridgeSocketType>::GetFramePool();
+
+				std::cout << std::left << std::setw(56) << u8"  frames" << std::right
+					<< std::setw(12) << (frames.GetAllocatedCount() - allocatedBefore) << u8" from the heap"
+					<< std::setw(12) << (frames.GetReusedCount() - reusedBefore) << u8" reused" << std::endl;
+			}
+
+			/// <summary>
+			/// Runs the given number of clients through a plain TCP acceptor of the given
+			/// bridge type to the origin, each on a connection of its own, and reports the
+			/// latency of their requests, and what each request cost in CPU time and heap
+			/// allocations. Each client warms up first, so the measured requests all find
+			/// their connections established and both directions of the bridge running.
+			/// CPU time and allocations are those of the whole process, clients and origin
+			/// included, which do exactly the same work for either bridge.
+			/// </summary>
+			template<template<class> class BridgeType>
+			void Measure(const std::string& name, const size_t clients, const size_t requestsPerClient)
+			{
+				using Acceptor = mitm::secure::TlsCapableHttpAcceptor<network::TcpSocket, BridgeType>;
+
+				const uint64_t framesAllocatedBefore = mitm::secure::CoroutineHttpBridge<network::TcpSocket>::GetFramePool().GetAllocatedCount();
+				const uint64_t framesReusedBefore = mitm::secure::CoroutineHttpBridge<network::TcpSocket>::GetFramePool().GetReusedCount();
+
+				Origin origin;
+
+				boost::asio::io_service service;
+				boost::asio::io_service::work work(service);
+
+				Acceptor acceptor(
+					&service, 0, u8"none", nullptr, nullptr, nullptr, nullptr, nullptr,
+					nullptr, nullptr, &AllowMessageBegin, &AllowMessageEnd,
+					nullptr, nullptr,
+					[](const char* message, const size_t) { std::cerr << message << std::endl; }
+				);
+
+				acceptor.AcceptConnections();
+
+				std::vector<std::thread> serviceThreads;
+
+				for (size_t i = 0; i < BridgeThreads; ++i)
+				{
+					serviceThreads.emplace_back([&service]() { service.run(); });
+				}
+
+				std::mutex mutex;
+				std::condition_variable changed;
+				size_t warmedUp = 0;
+				bool measuring = false;
+
+				std::vector<std::vector<double>> latencies(clients);
+				std::vector<std::thread> clientThreads;
+
+				for (size_t c = 0; c < clients; ++c)
+				{
+					clientThreads.emplace_back([&, c]()
+					{
+						Client client(acceptor.GetListenerPort(), origin.GetPort());
+						latencies[c].reserve(requestsPerClient);
+
+						for (size_t i = 0; i < std::max<size_t>(1, requestsPerClient / 10); ++i)
+						{
+							client.RoundTrip();
+						}
+
+						{
+							std::unique_lock<std::mutex> lock(mutex);
+							++warmedUp;
+							changed.notify_all();
+							changed.wait(lock, [&measuring]() { return measuring; });
+						}
+
+						for (size_t i = 0; i < requestsPerClient; ++i)
+						{
+							latencies[c].push_back(client.RoundTrip());
+						}
+					});
+				}
+
+				std::clock_t cpuBefore;
+				uint64_t allocationsBefore;
+
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					changed.wait(lock, [&]() { return warmedUp == clients; });
+
+					cpuBefore = std::clock();
+					allocationsBefore = GetGlobalAllocations();
+
+					measuring = true;
+					changed.notify_all();
+				}
+
+				for (auto& thread : clientThreads)
+				{
+					thread.join();
+				}
+
+				const std::clock_t cpuAfter = std::clock();
+				const uint64_t allocationsAfter = GetGlobalAllocations();
+
+				// The coroutine bridges go as soon as they see their clients close, but a
+				// callback bridge waiting on a kept alive connection only goes once its stream
+				// timer runs out. So rather than wait for the service to run out of work, it's
+				// stopped, and whatever is left goes with it.
+				acceptor.StopAccepting();
+				service.stop();
+
+				for (auto& thread : serviceThreads)
+				{
+					thread.join();
+				}
+
+				std::vector<double> all;
+				all.reserve(clients * requestsPerClient);
+
+				for (const auto& clientLatencies : latencies)
+				{
+					all.insert(all.end(), clientLatencies.begin(), clientLatencies.end());
+				}
+
+				std::sort(all.begin(), all.end());
+
+				const auto percentile = [&all](const double p) { return all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))] / 1000.0; };
+
+				const double requests = static_cast<double>(all.size());
+
+				std::cout << std::left << std::setw(56) << name << std::right << std::fixed << std::setprecision(1)
+					<< std::setw(10) << percentile(0.5) << u8" us p50"
+					<< std::setw(10) << percentile(0.99) << u8" us p99"
+					<< std::setw(10) << percentile(0.999) << u8" us p99.9" << std::endl;
+
+				std::cout << std::left << std::setw(56) << u8"  process CPU time" << std::right << std::fixed << std::setprecision(1)
+					<< std::setw(10) << (static_cast<double>(cpuAfter - cpuBefore) * 1000000.0 / CLOCKS_PER_SEC / requests) << u8" us per request" << std::endl;
+
+				std::cout << std::left << std::setw(56) << u8"  heap allocations" << std::right << std::fixed << std::setprecision(2)
+					<< std::setw(10) << static_cast<double>(allocationsAfter - allocationsBefore) / requests << u8" per request" << std::endl;
+
+				ReportFrames(static_cast<BridgeType<network::TcpSocket>*>(nullptr), framesAllocatedBefore, framesReusedBefore);
+			}
+
+		} /* namespace test */
+	} /* namespace httpengine */
+} /* namespace te */
+
+int main(int argc, char* argv[])
+{
+	using namespace te::httpengine::test;
+	using te::httpengine::mitm::secure::TlsCapableHttpBridge;
+	using te::httpengine::mitm::secure::CoroutineHttpBridge;
+
+	double scale = 1.0;
+
+	if (argc > 1 && std::atof(argv[1]) > 0)
+	{
+		scale = std::atof(argv[1]);
+	}
+
+	const size_t serial = std::max<size_t>(10, static_cast<size_t>(20000 * scale));
+	const size_t concurrent = std::max<size_t>(10, static_cast<size_t>(2000 * scale));
+
+	// Each configuration is run with the callback bridge and then the coroutine bridge,
+	// so that the two see the machine in as near the same state as can be had.
+	Measure<TlsCapableHttpBridge>(u8"1 connection, callback bridge", 1, serial);
+	Measure<CoroutineHttpBridge>(u8"1 connection, coroutine bridge", 1, serial);
+	Measure<TlsCapableHttpBridge>(u8"16 connections, callback bridge", 16, concurrent);
+	Measure<CoroutineHttpBridge>(u8"16 connections, coroutine bridge", 16, concurrent);
+
+	return 0;
+}
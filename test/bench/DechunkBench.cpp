@@ -0,0 +1,139 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "Bench.hpp"
+
+#include "te/httpengine/mitm/http/HttpResponse.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace test
+		{
+
+			using mitm::http::HttpResponse;
+
+			/// <summary>
+			/// The size of the body every run de-chunks.
+			/// </summary>
+			const size_t BodySize = 4 * 1024 * 1024;
+
+			const std::string Head =
+				u8"HTTP/1.1 200 OK\r\n"
+				u8"Content-Type: text/html; charset=UTF-8\r\n"
+				u8"Transfer-Encoding: chunked\r\n"
+				u8"\r\n";
+
+			/// <summary>
+			/// A chunked body of BodySize bytes, in chunks of the given size.
+			/// </summary>
+			std::string MakeChunkedBody(const size_t chunkSize)
+			{
+				std::string body;
+				body.reserve(BodySize + (BodySize / chunkSize + 1) * 16);
+
+				char sizeLine[32];
+
+				for (size_t written = 0; written < BodySize; written += chunkSize)
+				{
+					const size_t length = std::min(chunkSize, BodySize - written);
+
+					std::snprintf(sizeLine, sizeof(sizeLine), "%zx\r\n", length);
+					body.append(sizeLine);
+					body.append(length, static_cast<char>('a' + (written / chunkSize) % 26));
+					body.append(u8"\r\n");
+				}
+
+				body.append(u8"0\r\n\r\n");
+
+				return body;
+			}
+
+			/// <summary>
+			/// Parses the head, has the response held for inspection the way the bridge does
+			/// once the message begin callback asks for it, then feeds the body a full read
+			/// buffer at a time.
+			/// </summary>
+			size_t HoldAndDechunk(const std::string& body)
+			{
+				HttpResponse response(Head.data(), Head.size());
+				response.Parse(Head.size(), false);
+				response.SetConsumeAllBeforeSending(true);
+
+				for (size_t offset = 0; offset < body.size() && !response.IsPayloadComplete();)
+				{
+					auto buffer = response.GetReadBuffer();
+					const size_t length = std::min(boost::asio::buffer_size(buffer), body.size() - offset);
+
+					std::memcpy(boost::asio::buffer_cast<char*>(buffer), body.data() + offset, length);
+
+					if (!response.Parse(length, false))
+					{
+						throw std::runtime_error(u8"The chunked body failed to parse.");
+					}
+
+					offset += length;
+				}
+
+				if (!response.IsPayloadComplete() || response.GetPayload().size() != BodySize)
+				{
+					throw std::runtime_error(u8"The held payload isn't the de-chunked body.");
+				}
+
+				return response.GetPayload().size();
+			}
+
+			/// <summary>
+			/// http_parser alone over the same bytes, with no callbacks, as the floor that
+			/// de-chunking in the engine can be held up against.
+			/// </summary>
+			size_t ParseOnly(const std::string& message)
+			{
+				http_parser parser;
+				http_parser_init(&parser, HTTP_RESPONSE);
+
+				http_parser_settings settings;
+				http_parser_settings_init(&settings);
+
+				return http_parser_execute(&parser, &settings, message.data(), message.size());
+			}
+
+		} /* namespace test */
+	} /* namespace httpengine */
+} /* namespace te */
+
+int main(int argc, char* argv[])
+{
+	using namespace te::httpengine::test;
+
+	Bench bench(argc, argv);
+
+	for (const size_t chunkSize : { 64, 1024, 16384 })
+	{
+		const std::string body = MakeChunkedBody(chunkSize);
+		const std::string message = Head + body;
+		const std::string chunks = std::to_string(chunkSize) + u8" byte chunks";
+
+		bench.Run(u8"4 MB, " + chunks + u8", held and de-chunked", 10, BodySize, [&body]()
+		{
+			Bench::KeepAlive(HoldAndDechunk(body));
+		});
+
+		bench.Run(u8"4 MB, " + chunks + u8", http_parser alone", 10, BodySize, [&message]()
+		{
+			Bench::KeepAlive(ParseOnly(message));
+		});
+	}
+
+	return 0;
+}
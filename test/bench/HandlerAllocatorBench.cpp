@@ -0,0 +1,168 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "Bench.hpp"
+#include "HeapCounter.hpp"
+
+#include "te/httpengine/network/HandlerAllocator.hpp"
+
+#include <functional>
+#include <type_traits>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace test
+		{
+
+			using boost::asio::ip::tcp;
+
+			/// <summary>
+			/// One byte ping pong between two loopback sockets, with every completion handler
+			/// bound and strand wrapped the way the bridge does it. The one template argument
+			/// decides whether the handlers are also given recycled memory, so the two runs
+			/// differ in nothing else.
+			/// </summary>
+			template<bool Recycled>
+			class PingPong
+			{
+
+			public:
+
+				PingPong(boost::asio::io_service& service)
+					:
+					m_service(service),
+					m_strand(service),
+					m_client(service),
+					m_server(service)
+				{
+					tcp::acceptor acceptor(service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+					m_client.connect(acceptor.local_endpoint());
+					acceptor.accept(m_server);
+
+					m_client.set_option(tcp::no_delay(true));
+					m_server.set_option(tcp::no_delay(true));
+				}
+
+				/// <summary>
+				/// A single round trip. The client writes and waits for the echo, the server
+				/// reads and echoes.
+				/// </summary>
+				void RoundTrip()
+				{
+					boost::asio::async_read(m_server, boost::asio::buffer(&m_serverByte, 1), Wrap(m_serverReadMemory, std::bind(&PingPong::OnServerRead, this, std::placeholders::_1, std::placeholders::_2)));
+					boost::asio::async_write(m_client, boost::asio::buffer(&m_clientByte, 1), Wrap(m_clientWriteMemory, std::bind(&PingPong::OnClientWrite, this, std::placeholders::_1, std::placeholders::_2)));
+
+					m_service.run();
+					m_service.reset();
+				}
+
+			private:
+
+				using Recycling = std::integral_constant<bool, Recycled>;
+
+				template<typename Handler>
+				auto Wrap(network::HandlerMemory& memory, Handler&& handler)
+				{
+					return Wrap(memory, std::forward<Handler>(handler), Recycling());
+				}
+
+				template<typename Handler>
+				auto Wrap(network::HandlerMemory& memory, Handler&& handler, std::true_type)
+				{
+					return m_strand.wrap(network::MakeCustomAllocHandler(memory, std::forward<Handler>(handler)));
+				}
+
+				template<typename Handler>
+				auto Wrap(network::HandlerMemory&, Handler&& handler, std::false_type)
+				{
+					return m_strand.wrap(std::forward<Handler>(handler));
+				}
+
+				void OnServerRead(const boost::system::error_code& error, std::size_t)
+				{
+					if (!error)
+					{
+						boost::asio::async_write(m_server, boost::asio::buffer(&m_serverByte, 1), Wrap(m_serverWriteMemory, std::bind(&PingPong::OnServerWrite, this, std::placeholders::_1, std::placeholders::_2)));
+					}
+				}
+
+				void OnServerWrite(const boost::system::error_code&, std::size_t)
+				{
+
+				}
+
+				void OnClientWrite(const boost::system::error_code& error, std::size_t)
+				{
+					if (!error)
+					{
+						boost::asio::async_read(m_client, boost::asio::buffer(&m_clientByte, 1), Wrap(m_clientReadMemory, std::bind(&PingPong::OnClientRead, this, std::placeholders::_1, std::placeholders::_2)));
+					}
+				}
+
+				void OnClientRead(const boost::system::error_code&, std::size_t)
+				{
+
+				}
+
+				boost::asio::io_service& m_service;
+
+				boost::asio::io_service::strand m_strand;
+
+				tcp::socket m_client;
+
+				tcp::socket m_server;
+
+				char m_clientByte = 'x';
+
+				char m_serverByte = 0;
+
+				network::HandlerMemory m_clientReadMemory;
+
+				network::HandlerMemory m_clientWriteMemory;
+
+				network::HandlerMemory m_serverReadMemory;
+
+				network::HandlerMemory m_serverWriteMemory;
+			};
+
+			template<bool Recycled>
+			void Measure(Bench& bench, const std::string& name)
+			{
+				boost::asio::io_service service;
+				PingPong<Recycled> pingPong(service);
+
+				bench.Run(name, 20000, 0, [&pingPong]() { pingPong.RoundTrip(); });
+
+				const size_t counted = 1000;
+				const uint64_t before = GetGlobalAllocations();
+
+				for (size_t i = 0; i < counted; ++i)
+				{
+					pingPong.RoundTrip();
+				}
+
+				const double allocations = static_cast<double>(GetGlobalAllocations() - before) / static_cast<double>(counted);
+
+				std::cout << std::left << std::setw(56) << u8"  heap allocations" << std::right << std::fixed << std::setprecision(2)
+					<< std::setw(12) << allocations << u8" per round trip" << std::endl;
+			}
+
+		} /* namespace test */
+	} /* namespace httpengine */
+} /* namespace te */
+
+int main(int argc, char* argv[])
+{
+	te::httpengine::test::Bench bench(argc, argv);
+
+	te::httpengine::test::Measure<false>(bench, u8"round trip, default handler allocation");
+	te::httpengine::test::Measure<true>(bench, u8"round trip, recycled handler memory");
+
+	return 0;
+}
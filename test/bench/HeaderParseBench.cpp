@@ -0,0 +1,91 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "Bench.hpp"
+
+#include "te/httpengine/mitm/http/HttpRequest.hpp"
+#include "te/httpengine/mitm/http/HttpResponse.hpp"
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace test
+		{
+
+			/// <summary>
+			/// A request head much like a desktop browser sends.
+			/// </summary>
+			const std::string BrowserRequest =
+				u8"GET /search?q=http+header+parsing&source=hp&ei=abcdefghijklmnop HTTP/1.1\r\n"
+				u8"Host: www.example.com\r\n"
+				u8"Connection: keep-alive\r\n"
+				u8"Upgrade-Insecure-Requests: 1\r\n"
+				u8"User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/60.0.3112.113 Safari/537.36\r\n"
+				u8"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,image/apng,*/*;q=0.8\r\n"
+				u8"Referer: https://www.example.com/\r\n"
+				u8"Accept-Encoding: gzip, deflate, br\r\n"
+				u8"Accept-Language: en-US,en;q=0.8\r\n"
+				u8"Cookie: SID=0123456789abcdefghijklmnopqrstuvwxyz; HSID=AbCdEfGhIjKlMnOp; SSID=QrStUvWxYz012345; APISID=abcdefghijklmnop/qrstuvwxyz0123456; NID=111=abcdefghijklmnopqrstuvwxyz0123456789\r\n"
+				u8"\r\n";
+
+			/// <summary>
+			/// A response head much like a large site sends, without a body.
+			/// </summary>
+			const std::string SiteResponse =
+				u8"HTTP/1.1 200 OK\r\n"
+				u8"Date: Mon, 18 Sep 2017 14:15:16 GMT\r\n"
+				u8"Expires: -1\r\n"
+				u8"Cache-Control: private, max-age=0\r\n"
+				u8"Content-Type: text/html; charset=UTF-8\r\n"
+				u8"Strict-Transport-Security: max-age=86400\r\n"
+				u8"Content-Encoding: gzip\r\n"
+				u8"Server: gws\r\n"
+				u8"X-XSS-Protection: 1; mode=block\r\n"
+				u8"X-Frame-Options: SAMEORIGIN\r\n"
+				u8"Set-Cookie: NID=111=abcdefghijklmnopqrstuvwxyz0123456789; expires=Tue, 20-Mar-2018 14:15:16 GMT; path=/; domain=.example.com; HttpOnly\r\n"
+				u8"Alt-Svc: quic=\":443\"; ma=2592000; v=\"39,38,37,35\"\r\n"
+				u8"Transfer-Encoding: chunked\r\n"
+				u8"\r\n"
+				u8"0\r\n"
+				u8"\r\n";
+
+			template<typename Transaction>
+			void Measure(Bench& bench, const std::string& name, const std::string& head)
+			{
+				// http_parser skips blank lines ahead of a message, but the tokenizer leaves them to
+				// it, so a leading CRLF sends the same head down the callback path.
+				const std::string viaCallbacks = u8"\r\n" + head;
+
+				bench.Run(name + u8", tokenized", 20000, head.size(), [&head]()
+				{
+					Transaction transaction(head.data(), head.size());
+					Bench::KeepAlive(transaction.Parse(head.size(), false));
+				});
+
+				bench.Run(name + u8", http_parser callbacks", 20000, head.size(), [&viaCallbacks]()
+				{
+					Transaction transaction(viaCallbacks.data(), viaCallbacks.size());
+					Bench::KeepAlive(transaction.Parse(viaCallbacks.size(), false));
+				});
+			}
+
+		} /* namespace test */
+	} /* namespace httpengine */
+} /* namespace te */
+
+int main(int argc, char* argv[])
+{
+	using namespace te::httpengine;
+
+	test::Bench bench(argc, argv);
+
+	test::Measure<mitm::http::HttpRequest>(bench, u8"browser request head", test::BrowserRequest);
+	test::Measure<mitm::http::HttpResponse>(bench, u8"site response head", test::SiteResponse);
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "HeapCounter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// The replacements are kept in a translation unit of their own, so that they can never
+// be inlined into code that the compiler can see allocating through the library's own
+// operator new, and every form is replaced, so that nothing allocated by one family is
+// ever released by the other.
+
+namespace
+{
+	std::atomic<uint64_t> GlobalAllocations{ 0 };
+
+	void* Allocate(const std::size_t size)
+	{
+		++GlobalAllocations;
+
+		void* pointer = std::malloc(size == 0 ? 1 : size);
+
+		if (pointer == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+
+		return pointer;
+	}
+
+	void* AllocateNoThrow(const std::size_t size) noexcept
+	{
+		++GlobalAllocations;
+
+		return std::malloc(size == 0 ? 1 : size);
+	}
+}
+
+void* operator new(std::size_t size)
+{
+	return Allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+	return Allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return AllocateNoThrow(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return AllocateNoThrow(size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+	std::free(pointer);
+}
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace test
+		{
+
+			uint64_t GetGlobalAllocations()
+			{
+				return GlobalAllocations.load();
+			}
+
+		} /* namespace test */
+	} /* namespace httpengine */
+} /* namespace te */
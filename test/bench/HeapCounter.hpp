@@ -0,0 +1,31 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace test
+		{
+
+			/// <summary>
+			/// Gets the number of trips the process has made to the global heap so far, so
+			/// that a benchmark can show what an allocation strategy actually saves, not
+			/// just what it costs.
+			///
+			/// Only benchmarks that are built with HeapCounter.cpp, which replaces the global
+			/// allocation functions, can call this.
+			/// </summary>
+			uint64_t GetGlobalAllocations();
+
+		} /* namespace test */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,208 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "Bench.hpp"
+
+#include "te/httpengine/mitm/http/HttpResponse.hpp"
+#include "te/httpengine/network/RecompressionControl.hpp"
+
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/write.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace test
+		{
+
+			using mitm::http::HttpResponse;
+			using mitm::http::PayloadEncoder;
+
+			/// <summary>
+			/// The size of the inspected payload that's recompressed.
+			/// </summary>
+			const size_t PayloadSize = 4 * 1024 * 1024;
+
+			/// <summary>
+			/// Markup that compresses about as well as real pages do. Repetitive in structure,
+			/// but not in content.
+			/// </summary>
+			std::string MakePage()
+			{
+				std::string page;
+				page.reserve(PayloadSize + 256);
+
+				uint64_t state = 0x2545F4914F6CDD1Dull;
+
+				while (page.size() < PayloadSize)
+				{
+					state ^= state << 13;
+					state ^= state >> 7;
+					state ^= state << 17;
+
+					page.append(u8"<div class=\"item item-").append(std::to_string(state % 97)).append(u8"\"><a href=\"/article/");
+					page.append(std::to_string(state % 1000003)).append(u8"\">Article ").append(std::to_string((state >> 20) % 50021));
+					page.append(u8"</a><span class=\"meta\">").append(std::to_string((state >> 8) % 60)).append(u8" minutes ago</span></div>\n");
+				}
+
+				page.resize(PayloadSize);
+
+				return page;
+			}
+
+			/// <summary>
+			/// A response held in full for inspection, as it is when the message end callback
+			/// has seen it and it's about to be written to the client.
+			/// </summary>
+			std::unique_ptr<HttpResponse> MakeHeldResponse(const std::string& page)
+			{
+				const std::string head =
+					u8"HTTP/1.1 200 OK\r\n"
+					u8"Content-Type: text/html; charset=UTF-8\r\n"
+					u8"Content-Length: " + std::to_string(page.size()) + u8"\r\n"
+					u8"\r\n";
+
+				std::unique_ptr<HttpResponse> response(new HttpResponse(head.data(), head.size()));
+				response->Parse(head.size(), false);
+				response->SetConsumeAllBeforeSending(true);
+
+				for (size_t offset = 0; offset < page.size();)
+				{
+					auto buffer = response->GetReadBuffer();
+					const size_t length = std::min(boost::asio::buffer_size(buffer), page.size() - offset);
+
+					std::memcpy(boost::asio::buffer_cast<char*>(buffer), page.data() + offset, length);
+					response->Parse(length, false);
+
+					offset += length;
+				}
+
+				if (!response->IsPayloadComplete())
+				{
+					throw std::runtime_error(u8"The page didn't complete the response.");
+				}
+
+				return response;
+			}
+
+			/// <summary>
+			/// The whole payload compressed in one blocking pass, the way
+			/// BaseHttpTransaction::CompressGzip() does it. Nothing can be written until it's
+			/// done.
+			/// </summary>
+			size_t CompressInOnePass(const std::string& page, const int level)
+			{
+				std::vector<char> compressed;
+
+				boost::iostreams::filtering_ostream os;
+				os.push(boost::iostreams::gzip_compressor(boost::iostreams::gzip_params(level)));
+				os.push(boost::iostreams::back_inserter(compressed));
+
+				boost::iostreams::write(os, page.data(), page.size());
+				os.reset();
+
+				return compressed.size();
+			}
+
+			/// <summary>
+			/// The payload written out the way the bridge writes it when recompressing, a
+			/// slice at a time.
+			/// </summary>
+			struct EncodedWrite
+			{
+				uint64_t outputBytes = 0;
+
+				uint64_t nanoseconds = 0;
+
+				uint64_t firstSliceNanoseconds = 0;
+			};
+
+			EncodedWrite WriteEncoded(HttpResponse& response, const int level)
+			{
+				if (!response.BeginEncodedWrite(PayloadEncoder::Coding::Gzip, level))
+				{
+					throw std::runtime_error(u8"The response couldn't be written encoded.");
+				}
+
+				while (!response.IsEncodedWriteComplete())
+				{
+					Bench::KeepAlive(response.GetNextEncodedWriteBuffer(network::RecompressionControl::SliceBytes));
+				}
+
+				EncodedWrite result;
+				uint64_t inputBytes = 0;
+
+				response.GetEncodedWriteStats(inputBytes, result.outputBytes, result.nanoseconds, result.firstSliceNanoseconds);
+
+				return result;
+			}
+
+			void Measure(Bench& bench, const std::string& page, const int level)
+			{
+				const std::string name = u8"4 MB page, gzip level " + std::to_string(level);
+
+				const double onePass = bench.Run(name + u8", one pass", 3, PayloadSize, [&page, level]()
+				{
+					Bench::KeepAlive(CompressInOnePass(page, level));
+				});
+
+				// Every write needs a freshly held response, which takes far longer to build
+				// than it does to compress, so these are timed by the engine's own write
+				// statistics rather than by the runner.
+				std::vector<EncodedWrite> writes;
+
+				for (size_t i = 0; i < Bench::Samples; ++i)
+				{
+					auto response = MakeHeldResponse(page);
+					writes.push_back(WriteEncoded(*response, level));
+				}
+
+				std::sort(writes.begin(), writes.end(), [](const EncodedWrite& a, const EncodedWrite& b) { return a.nanoseconds < b.nanoseconds; });
+				const EncodedWrite& median = writes[writes.size() / 2];
+
+				std::sort(writes.begin(), writes.end(), [](const EncodedWrite& a, const EncodedWrite& b) { return a.firstSliceNanoseconds < b.firstSliceNanoseconds; });
+				const uint64_t firstSlice = writes[writes.size() / 2].firstSliceNanoseconds;
+
+				const double megabytes = static_cast<double>(PayloadSize) / (1024.0 * 1024.0);
+
+				std::cout << std::left << std::setw(56) << u8"  one pass, CPU per MB" << std::right << std::fixed << std::setprecision(2)
+					<< std::setw(12) << onePass / megabytes / 1e6 << u8" ms, first byte after " << onePass / 1e6 << u8" ms" << std::endl;
+
+				std::cout << std::left << std::setw(56) << u8"  sliced, CPU per MB" << std::right << std::fixed << std::setprecision(2)
+					<< std::setw(12) << static_cast<double>(median.nanoseconds) / megabytes / 1e6 << u8" ms, first byte after "
+					<< static_cast<double>(firstSlice) / 1e6 << u8" ms" << std::endl;
+
+				std::cout << std::left << std::setw(56) << u8"  sliced, compressed size" << std::right << std::fixed << std::setprecision(2)
+					<< std::setw(12) << 100.0 * static_cast<double>(median.outputBytes) / static_cast<double>(PayloadSize) << u8" % of the payload" << std::endl;
+			}
+
+		} /* namespace test */
+	} /* namespace httpengine */
+} /* namespace te */
+
+int main(int argc, char* argv[])
+{
+	using namespace te::httpengine::test;
+
+	Bench bench(argc, argv);
+
+	const std::string page = MakePage();
+
+	Measure(bench, page, PayloadEncoder::DefaultLevel);
+	Measure(bench, page, 6);
+
+	return 0;
+}
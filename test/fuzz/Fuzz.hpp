@@ -0,0 +1,226 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace test
+		{
+
+			/// <summary>
+			/// A small, dependency free, deterministic fuzz driver. Every iteration is given its
+			/// own generator, seeded from the run seed and the iteration number, so that any
+			/// failure can be replayed on its own by passing the seed and iteration it reports.
+			///
+			/// Every fuzz executable takes up to three optional arguments: the number of
+			/// iterations, the run seed and a single iteration to replay.
+			/// </summary>
+			class Fuzz
+			{
+
+			public:
+
+				/// <summary>
+				/// Seeded pseudo random generator, splitmix64. Fast, and good enough to pick
+				/// mutations with.
+				/// </summary>
+				class Random
+				{
+
+				public:
+
+					explicit Random(const uint64_t seed) : m_state(seed)
+					{
+
+					}
+
+					uint64_t Next()
+					{
+						uint64_t z = (m_state += 0x9E3779B97F4A7C15ull);
+						z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+						z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+						return z ^ (z >> 31);
+					}
+
+					/// <summary>
+					/// A value in [0, bound). Returns zero for a bound of zero.
+					/// </summary>
+					size_t Below(const size_t bound)
+					{
+						return bound == 0 ? 0 : static_cast<size_t>(Next() % bound);
+					}
+
+					/// <summary>
+					/// True with the given chance, out of one hundred.
+					/// </summary>
+					bool Chance(const unsigned percent)
+					{
+						return Below(100) < percent;
+					}
+
+					/// <summary>
+					/// Picks one of the supplied values.
+					/// </summary>
+					template<typename T, size_t N>
+					const T& Pick(const T (&values)[N])
+					{
+						return values[Below(N)];
+					}
+
+				private:
+
+					uint64_t m_state;
+				};
+
+				Fuzz(int argc, char* argv[])
+				{
+					if (argc > 1)
+					{
+						m_iterations = std::strtoull(argv[1], nullptr, 10);
+					}
+
+					if (argc > 2)
+					{
+						m_seed = std::strtoull(argv[2], nullptr, 10);
+					}
+
+					if (argc > 3)
+					{
+						m_replay = true;
+						m_replayIteration = std::strtoull(argv[3], nullptr, 10);
+					}
+				}
+
+				/// <summary>
+				/// Runs a fuzz case for every iteration, or just the one being replayed.
+				/// </summary>
+				/// <param name="name">
+				/// The name to report under.
+				/// </param>
+				/// <param name="fuzzCase">
+				/// Called with a freshly seeded generator for each iteration. Returns true if
+				/// the iteration passed. A case can describe a failure on std::cerr before
+				/// returning false.
+				/// </param>
+				/// <returns>
+				/// Zero if every iteration passed, one otherwise, suitable for returning from
+				/// main.
+				/// </returns>
+				template<typename Case>
+				int Run(const std::string& name, Case&& fuzzCase)
+				{
+					const uint64_t first = m_replay ? m_replayIteration : 0;
+					const uint64_t last = m_replay ? m_replayIteration + 1 : m_iterations;
+
+					for (uint64_t iteration = first; iteration < last; ++iteration)
+					{
+						Random random(m_seed ^ (iteration * 0xD1B54A32D192ED03ull));
+
+						if (!fuzzCase(random))
+						{
+							std::cerr << name << u8" failed. Replay with: <iterations> " << m_seed << u8" " << iteration << std::endl;
+							return 1;
+						}
+					}
+
+					std::cout << name << u8" passed " << (last - first) << u8" iterations with seed " << m_seed << std::endl;
+
+					return 0;
+				}
+
+				/// <summary>
+				/// Applies a handful of random byte level mutations to the supplied data. The
+				/// mutations favour the bytes that matter to HTTP framing, so that mutated
+				/// messages stay close enough to valid to get past the first line.
+				/// </summary>
+				static void Mutate(Random& random, std::string& data)
+				{
+					static const char interesting[] = { '\r', '\n', ':', ' ', '\t', '\0', '\x7F', '\xFF', '0', 'a', ';', ',' };
+
+					const size_t mutations = 1 + random.Below(4);
+
+					for (size_t i = 0; i < mutations; ++i)
+					{
+						const size_t at = random.Below(data.size() + 1);
+
+						switch (random.Below(6))
+						{
+							case 0:
+							{
+								if (at < data.size())
+								{
+									data[at] = static_cast<char>(random.Next());
+								}
+							}
+							break;
+
+							case 1:
+							{
+								data.insert(at, 1, random.Pick(interesting));
+							}
+							break;
+
+							case 2:
+							{
+								if (at < data.size())
+								{
+									data.erase(at, 1 + random.Below(std::min<size_t>(8, data.size() - at)));
+								}
+							}
+							break;
+
+							case 3:
+							{
+								data.insert(at, u8"\r\n");
+							}
+							break;
+
+							case 4:
+							{
+								if (at < data.size())
+								{
+									const size_t length = 1 + random.Below(std::min<size_t>(32, data.size() - at));
+									data.insert(random.Below(data.size() + 1), data.substr(at, length));
+								}
+							}
+							break;
+
+							default:
+							{
+								if (at < data.size())
+								{
+									data[at] = random.Pick(interesting);
+								}
+							}
+							break;
+						}
+					}
+				}
+
+			private:
+
+				uint64_t m_iterations = 10000;
+
+				uint64_t m_seed = 0x48464531ull;
+
+				bool m_replay = false;
+
+				uint64_t m_replayIteration = 0;
+			};
+
+		} /* namespace test */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,562 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "Fuzz.hpp"
+
+#include "te/httpengine/mitm/http/HttpRequest.hpp"
+#include "te/httpengine/mitm/http/HttpResponse.hpp"
+
+#include <boost/algorithm/string.hpp>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace test
+		{
+
+			using mitm::http::BaseHttpTransaction;
+			using mitm::http::HttpHeaderMap;
+			using mitm::http::HttpRequest;
+			using mitm::http::HttpResponse;
+
+			/// <summary>
+			/// Everything http_parser reports about a single message.
+			/// </summary>
+			struct Reference
+			{
+				bool ok = true;
+
+				http_errno error = HPE_OK;
+
+				bool headersComplete = false;
+
+				bool messageComplete = false;
+
+				std::string url;
+
+				std::vector<std::pair<std::string, std::string>> headers;
+
+				/// <summary>
+				/// How many of the headers are known to be complete. The last one isn't, until
+				/// something follows it.
+				/// </summary>
+				size_t completeHeaders = 0;
+
+				bool lastWasValue = true;
+
+				std::string body;
+
+				std::string pipelined;
+
+				unsigned int method = 0;
+
+				unsigned int statusCode = 0;
+
+				unsigned short major = 0;
+
+				unsigned short minor = 0;
+
+				static Reference& From(http_parser* parser)
+				{
+					return *static_cast<Reference*>(parser->data);
+				}
+			};
+
+			const http_parser_settings& ReferenceSettings()
+			{
+				static http_parser_settings settings = []()
+				{
+					http_parser_settings s;
+					std::memset(&s, 0, sizeof(s));
+
+					s.on_url = [](http_parser* p, const char* at, size_t length) { Reference::From(p).url.append(at, length); return 0; };
+
+					s.on_header_field = [](http_parser* p, const char* at, size_t length)
+					{
+						auto& r = Reference::From(p);
+
+						if (r.lastWasValue)
+						{
+							r.completeHeaders = r.headers.size();
+							r.headers.emplace_back();
+						}
+
+						r.headers.back().first.append(at, length);
+						r.lastWasValue = false;
+						return 0;
+					};
+
+					s.on_header_value = [](http_parser* p, const char* at, size_t length)
+					{
+						auto& r = Reference::From(p);
+						r.headers.back().second.append(at, length);
+						r.lastWasValue = true;
+						return 0;
+					};
+
+					s.on_headers_complete = [](http_parser* p)
+					{
+						auto& r = Reference::From(p);
+						r.completeHeaders = r.headers.size();
+						r.headersComplete = true;
+						r.method = p->method;
+						r.statusCode = p->status_code;
+						r.major = p->http_major;
+						r.minor = p->http_minor;
+						return 0;
+					};
+
+					s.on_body = [](http_parser* p, const char* at, size_t length) { Reference::From(p).body.append(at, length); return 0; };
+
+					s.on_message_complete = [](http_parser* p)
+					{
+						auto& r = Reference::From(p);
+						r.completeHeaders = r.headers.size();
+						r.messageComplete = true;
+						http_parser_pause(p, 1);
+						return 0;
+					};
+
+					return s;
+				}();
+
+				return settings;
+			}
+
+			/// <summary>
+			/// Parses the message with http_parser alone, in the same reads, stopping at the end of
+			/// the first message, the way BaseHttpTransaction does.
+			/// </summary>
+			Reference ParseReference(const http_parser_type type, const std::string& message, const std::vector<size_t>& reads)
+			{
+				Reference reference;
+
+				http_parser parser;
+				http_parser_init(&parser, type);
+				parser.data = &reference;
+
+				size_t offset = 0;
+
+				for (const size_t read : reads)
+				{
+					const size_t parsed = http_parser_execute(&parser, &ReferenceSettings(), message.data() + offset, read);
+
+					// An upgrade is refused even when http_parser has paused at the end of the
+					// message, as BaseHttpTransaction does.
+					if (parser.upgrade == 1)
+					{
+						reference.ok = false;
+						reference.error = HTTP_PARSER_ERRNO(&parser);
+						break;
+					}
+
+					if (HTTP_PARSER_ERRNO(&parser) == HPE_PAUSED)
+					{
+						reference.pipelined.assign(message, offset + parsed, read - parsed);
+						break;
+					}
+
+					if (parser.http_errno != HPE_OK || parsed != read)
+					{
+						reference.ok = false;
+						reference.error = HTTP_PARSER_ERRNO(&parser);
+						break;
+					}
+
+					offset += read;
+				}
+
+				return reference;
+			}
+
+			/// <summary>
+			/// Feeds the message to the transaction in the given reads, collecting the payload as
+			/// it goes, since each new read buffer drops the last read's payload.
+			/// </summary>
+			bool ParseTransaction(BaseHttpTransaction& transaction, const std::string& message, const std::vector<size_t>& reads, std::string& body)
+			{
+				size_t offset = 0;
+
+				for (size_t i = 0; i < reads.size(); ++i)
+				{
+					if (i > 0)
+					{
+						auto buffer = transaction.GetReadBuffer();
+						std::memcpy(boost::asio::buffer_cast<char*>(buffer), message.data() + offset, reads[i]);
+					}
+
+					const bool parsed = transaction.Parse(reads[i], false);
+
+					const auto& payload = transaction.GetPayload();
+					body.append(payload.begin(), payload.end());
+
+					if (!parsed)
+					{
+						return false;
+					}
+
+					if (transaction.IsPayloadComplete())
+					{
+						break;
+					}
+
+					offset += reads[i];
+				}
+
+				return true;
+			}
+
+			/// <summary>
+			/// The headers as BaseHttpTransaction keeps them, which drops exact repeats.
+			/// </summary>
+			HttpHeaderMap ExpectedHeaders(const Reference& reference)
+			{
+				HttpHeaderMap expected;
+
+				for (size_t i = 0; i < reference.completeHeaders; ++i)
+				{
+					const auto& header = reference.headers[i];
+					auto range = expected.equal_range(header.first);
+
+					if (std::none_of(range.first, range.second, [&header](const HttpHeaderMap::value_type& existing) { return boost::iequals(existing.second, header.second); }))
+					{
+						expected.insert(header);
+					}
+				}
+
+				return expected;
+			}
+
+			bool Compare(BaseHttpTransaction& transaction, const bool parsed, const std::string& body, const Reference& reference, const std::string& message)
+			{
+				auto fail = [&message](const std::string& what)
+				{
+					std::cerr << what << u8"\nMessage (" << message.size() << u8" bytes):\n" << message.substr(0, 2048) << std::endl;
+					return false;
+				};
+
+				if (parsed != reference.ok)
+				{
+					return fail(std::string(u8"Validity differs. Transaction: ") + (parsed ? u8"ok" : u8"failed") + u8", http_parser: " + http_errno_name(reference.error));
+				}
+
+				if (!parsed)
+				{
+					if (transaction.GetParseError() != reference.error)
+					{
+						return fail(std::string(u8"Errors differ. Transaction: ") + http_errno_name(transaction.GetParseError()) + u8", http_parser: " + http_errno_name(reference.error));
+					}
+
+					return true;
+				}
+
+				if (transaction.HeadersComplete() != reference.headersComplete || transaction.IsPayloadComplete() != reference.messageComplete)
+				{
+					return fail(u8"Progress differs.");
+				}
+
+				if (!reference.headersComplete)
+				{
+					return true;
+				}
+
+				// Not HttpResponse's own, which fills in the status text first and throws on
+				// status codes it has no text for.
+				std::vector<HttpHeaderView> views;
+				transaction.BaseHttpTransaction::HeadersToViews(views);
+
+				const auto expected = ExpectedHeaders(reference);
+
+				if (views.size() != expected.size())
+				{
+					return fail(u8"Header counts differ. Transaction: " + std::to_string(views.size()) + u8", http_parser: " + std::to_string(expected.size()));
+				}
+
+				size_t index = 0;
+
+				for (const auto& header : expected)
+				{
+					const auto& view = views[index++];
+
+					if (header.first != std::string(view.name, view.nameLength) || header.second != std::string(view.value, view.valueLength))
+					{
+						return fail(u8"Headers differ at " + header.first + u8": " + header.second);
+					}
+				}
+
+				if (body != reference.body)
+				{
+					return fail(u8"Bodies differ.");
+				}
+
+				const auto& pipelined = transaction.GetPipelinedData();
+
+				if (std::string(pipelined.begin(), pipelined.end()) != reference.pipelined)
+				{
+					return fail(u8"Pipelined data differs.");
+				}
+
+				return true;
+			}
+
+			/// <summary>
+			/// Builds a message around the headers that http_parser frames with, including names
+			/// that only start like them, repeats, and odd casing.
+			/// </summary>
+			std::string Generate(Fuzz::Random& random, const bool request)
+			{
+				static const char* const methods[] = { u8"GET", u8"POST", u8"PUT", u8"HEAD", u8"DELETE", u8"OPTIONS", u8"PATCH", u8"CONNECT" };
+				static const char* const uris[] = { u8"/", u8"/index.html", u8"/a/b?c=d&e=f#g", u8"http://example.com/x", u8"example.com:443", u8"*" };
+				static const char* const versions[] = { u8"HTTP/1.1", u8"HTTP/1.1", u8"HTTP/1.0", u8"HTTP/2.0" };
+				static const char* const statuses[] = { u8"200 OK", u8"204 No Content", u8"304 Not Modified", u8"101 Switching Protocols", u8"100 Continue", u8"404", u8"500 Internal Server Error" };
+
+				static const char* const names[] = {
+					u8"Host", u8"User-Agent", u8"Accept", u8"Accept-Encoding", u8"Cookie", u8"Set-Cookie", u8"Content-Type",
+					u8"Content-Length", u8"content-length", u8"CONTENT-LENGTH", u8"Content-Lengthy", u8"Content-Len",
+					u8"Transfer-Encoding", u8"transfer-encoding", u8"Transfer-Encodings",
+					u8"Connection", u8"connection", u8"Connectionx", u8"Proxy-Connection", u8"proxy-connection",
+					u8"Upgrade", u8"Upgrade-Insecure-Requests", u8"Keep-Alive", u8"X-Custom_Header", u8"TE", u8"Trailer"
+				};
+
+				static const char* const values[] = {
+					u8"0", u8"5", u8"12", u8"18446744073709551615", u8"99999999999999999999", u8"-1", u8"5, 5", u8"abc",
+					u8"chunked", u8"gzip, chunked", u8"chunked, gzip", u8"identity", u8"CHUNKED",
+					u8"keep-alive", u8"close", u8"upgrade", u8"Keep-Alive, Upgrade", u8"close, keep-alive", u8"Upgrade",
+					u8"websocket", u8"example.com", u8"text/html; charset=utf-8", u8"a=b; c=d", u8"\xC3\xA9t\xC3\xA9",
+					u8"x\ty", u8"Mozilla/5.0 (Windows NT 10.0; Win64; x64)"
+				};
+
+				std::string message;
+
+				if (request)
+				{
+					message.append(random.Pick(methods)).append(u8" ").append(random.Pick(uris)).append(u8" ").append(random.Pick(versions));
+				}
+				else
+				{
+					message.append(random.Pick(versions)).append(u8" ").append(random.Pick(statuses));
+				}
+
+				message.append(u8"\r\n");
+
+				const size_t headerCount = random.Below(12);
+				bool chunked = false;
+				size_t contentLength = 0;
+
+				for (size_t i = 0; i < headerCount; ++i)
+				{
+					std::string name = random.Pick(names);
+					std::string value = random.Pick(values);
+
+					if (random.Chance(30))
+					{
+						value = std::to_string(random.Below(64));
+						name = u8"Content-Length";
+						contentLength = std::stoul(value);
+					}
+					else if (random.Chance(15))
+					{
+						name = u8"Transfer-Encoding";
+						value = u8"chunked";
+						chunked = true;
+					}
+
+					if (random.Chance(5))
+					{
+						value.assign(random.Below(4000), 'v');
+					}
+
+					message.append(name).append(random.Chance(80) ? u8": " : u8":").append(value).append(u8"\r\n");
+				}
+
+				message.append(u8"\r\n");
+
+				if (chunked)
+				{
+					const size_t chunks = random.Below(4);
+
+					for (size_t i = 0; i < chunks; ++i)
+					{
+						const size_t size = 1 + random.Below(40);
+						char hex[16];
+						std::snprintf(hex, sizeof(hex), "%zx", size);
+						message.append(hex).append(random.Chance(10) ? u8";ext=1" : u8"").append(u8"\r\n").append(size, 'c').append(u8"\r\n");
+					}
+
+					message.append(u8"0\r\n");
+
+					if (random.Chance(30))
+					{
+						message.append(u8"Trailer-Field: value\r\n");
+					}
+
+					message.append(u8"\r\n");
+				}
+				else
+				{
+					message.append(contentLength, 'b');
+				}
+
+				if (random.Chance(20))
+				{
+					message.append(request ? u8"GET /next HTTP/1.1\r\nHost: example.com\r\n\r\n" : u8"HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+				}
+
+				if (random.Chance(3))
+				{
+					message.insert(0, u8"\r\n");
+				}
+
+				return message;
+			}
+
+			/// <summary>
+			/// Most messages arrive in one read, which is what the tokenized path is for. The
+			/// rest are split, which leaves at least the first read to http_parser.
+			/// </summary>
+			std::vector<size_t> SplitIntoReads(Fuzz::Random& random, const size_t length)
+			{
+				std::vector<size_t> reads;
+
+				if (length == 0)
+				{
+					reads.push_back(0);
+					return reads;
+				}
+
+				size_t remaining = length;
+
+				while (remaining > 0)
+				{
+					const size_t read = random.Chance(60) ? remaining : 1 + random.Below(remaining);
+					reads.push_back(read);
+					remaining -= read;
+				}
+
+				return reads;
+			}
+
+			/// <summary>
+			/// Parses the message as the given reads, once by an HttpRequest or HttpResponse and
+			/// once by a bare http_parser, and checks that the two agree.
+			/// </summary>
+			bool CheckMessage(const bool request, const std::string& message, const std::vector<size_t>& reads)
+			{
+				const auto reference = ParseReference(request ? HTTP_REQUEST : HTTP_RESPONSE, message, reads);
+
+				std::string body;
+
+				if (request)
+				{
+					HttpRequest transaction(message.data(), reads.front());
+					const bool parsed = ParseTransaction(transaction, message, reads, body);
+
+					if (!Compare(transaction, parsed, body, reference, message))
+					{
+						return false;
+					}
+
+					if (parsed && reference.headersComplete && (transaction.RequestURI() != reference.url || static_cast<unsigned int>(transaction.Method()) != reference.method))
+					{
+						std::cerr << u8"Request line differs.\n" << message << std::endl;
+						return false;
+					}
+
+					return true;
+				}
+
+				HttpResponse transaction(message.data(), reads.front());
+				const bool parsed = ParseTransaction(transaction, message, reads, body);
+
+				if (!Compare(transaction, parsed, body, reference, message))
+				{
+					return false;
+				}
+
+				if (parsed && reference.headersComplete && transaction.StatusCode() != reference.statusCode)
+				{
+					std::cerr << u8"Status differs.\n" << message << std::endl;
+					return false;
+				}
+
+				return true;
+			}
+
+			/// <summary>
+			/// Messages that have found differences before, each checked in a single read so
+			/// that it goes down the tokenized path.
+			/// </summary>
+			bool RunRegressions()
+			{
+				struct Regression
+				{
+					bool request;
+					std::string message;
+				};
+
+				const Regression regressions[] =
+				{
+					// http_parser reads the line endings after a short start line as the rest
+					// of "HTTP/", so the framing head alone didn't fail the way the message did.
+					{ false, std::string(u8"H\r\nT:P/1.0 100 Continu\xFF\r\n\r\n") }
+				};
+
+				for (const auto& regression : regressions)
+				{
+					if (!CheckMessage(regression.request, regression.message, std::vector<size_t>(1, regression.message.size())))
+					{
+						std::cerr << u8"HeaderTokenizerFuzz failed a regression." << std::endl;
+						return false;
+					}
+				}
+
+				return true;
+			}
+
+			/// <summary>
+			/// Differential fuzz test of the tokenized head path in BaseHttpTransaction against http_parser
+			/// on its own. Every message is parsed twice, once by an HttpRequest or HttpResponse and once by
+			/// a bare http_parser with callbacks that collect everything, and the two have to agree on
+			/// whether the message is valid, on every header, on the start line, on the body and on where
+			/// the message ended. Messages are generated around the headers that http_parser frames with,
+			/// then often mutated, and fed in one or more reads so that both the tokenized path and the
+			/// callback path are exercised.
+			/// </summary>
+			bool RunCase(Fuzz::Random& random)
+			{
+				const bool request = random.Chance(50);
+
+				std::string message = Generate(random, request);
+
+				if (random.Chance(50))
+				{
+					Fuzz::Mutate(random, message);
+				}
+
+				return CheckMessage(request, message, SplitIntoReads(random, message.size()));
+			}
+
+		} /* namespace test */
+	} /* namespace httpengine */
+} /* namespace te */
+
+int main(int argc, char* argv[])
+{
+	te::httpengine::test::Fuzz fuzz(argc, argv);
+
+	if (!te::httpengine::test::RunRegressions())
+	{
+		return 1;
+	}
+
+	return fuzz.Run(u8"HeaderTokenizerFuzz", &te::httpengine::test::RunCase);
+}
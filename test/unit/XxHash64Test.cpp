@@ -0,0 +1,149 @@
+/*
+* Copyright  2017 Jesse Nicholson
+* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "te/httpengine/util/hash/XxHash64.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace test
+		{
+
+			using util::hash::XxHash64;
+
+			const uint64_t Prime32 = 2654435761ULL;
+
+			/// <summary>
+			/// The sanity buffer the reference implementation checks itself against, in
+			/// xxhsum.
+			/// </summary>
+			std::vector<char> MakeSanityBuffer(const size_t length)
+			{
+				std::vector<char> buffer(length);
+
+				uint64_t byteGen = Prime32;
+
+				for (auto& byte : buffer)
+				{
+					byte = static_cast<char>(byteGen >> 56);
+					byteGen *= 11400714785074694797ULL;
+				}
+
+				return buffer;
+			}
+
+			/// <summary>
+			/// A digest the reference implementation gives for the first length bytes of the
+			/// sanity buffer with the given seed.
+			/// </summary>
+			struct Vector
+			{
+				size_t length;
+
+				uint64_t seed;
+
+				uint64_t digest;
+			};
+
+			const Vector Vectors[] =
+			{
+				{ 0, 0, 0xEF46DB3751D8E999ULL },
+				{ 0, Prime32, 0xAC75FDA2929B17EFULL },
+				{ 1, 0, 0xE934A84ADB052768ULL },
+				{ 1, Prime32, 0x5014607643A9B4C3ULL },
+				{ 4, 0, 0x9136A0DCA57457EEULL },
+				{ 4, Prime32, 0xCAAB286BD8E9FDB5ULL },
+				{ 14, 0, 0x8282DCC4994E35C8ULL },
+				{ 14, Prime32, 0xC3BD6BF63DEB6DF0ULL },
+				{ 222, 0, 0xB641AE8CB691C174ULL },
+				{ 222, Prime32, 0x20CB8AB7AE10C14AULL },
+				{ 2367, 0, 0xA82418DDEC0EA581ULL },
+				{ 2367, Prime32, 0xA36A93C18052673AULL }
+			};
+
+			bool Check(const char* how, const Vector& vector, const uint64_t digest)
+			{
+				if (digest == vector.digest)
+				{
+					return true;
+				}
+
+				std::cerr << u8"XxHash64Test: " << how << u8", " << vector.length << u8" bytes, seed " << vector.seed
+					<< std::hex << u8": expected 0x" << vector.digest << u8", got 0x" << digest << std::dec << std::endl;
+
+				return false;
+			}
+
+			/// <summary>
+			/// Checks every vector hashed all at once, in pieces of every size up to a few
+			/// stripes, and with a digest taken after every piece, which mustn't change what
+			/// follows. Then checks that a reset hasher gives the same again.
+			/// </summary>
+			bool RunVectors()
+			{
+				const auto buffer = MakeSanityBuffer(2367);
+
+				for (const auto& vector : Vectors)
+				{
+					XxHash64 hash(vector.seed);
+					hash.Update(buffer.data(), vector.length);
+
+					if (!Check(u8"all at once", vector, hash.Digest()) || hash.GetLength() != vector.length)
+					{
+						return false;
+					}
+
+					for (size_t piece = 1; piece <= 100; ++piece)
+					{
+						XxHash64 pieces(vector.seed);
+
+						for (size_t offset = 0; offset < vector.length; offset += piece)
+						{
+							pieces.Update(buffer.data() + offset, std::min(piece, vector.length - offset));
+							pieces.Digest();
+						}
+
+						if (!Check((u8"in pieces of " + std::to_string(piece)).c_str(), vector, pieces.Digest()))
+						{
+							return false;
+						}
+					}
+
+					hash.Reset(vector.seed);
+					hash.Update(buffer.data(), vector.length);
+
+					if (!Check(u8"after a reset", vector, hash.Digest()))
+					{
+						return false;
+					}
+				}
+
+				return true;
+			}
+
+		} /* namespace test */
+	} /* namespace httpengine */
+} /* namespace te */
+
+int main()
+{
+	if (!te::httpengine::test::RunVectors())
+	{
+		return 1;
+	}
+
+	std::cout << u8"XxHash64Test passed " << (sizeof(te::httpengine::test::Vectors) / sizeof(te::httpengine::test::Vectors[0])) << u8" reference vectors" << std::endl;
+
+	return 0;
+}